@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include "dll/neural/dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
 
@@ -24,9 +25,10 @@ int main(int /*argc*/, char* /*argv*/ []) {
             dll::dense_layer_desc<128, 64 , dll::relu>::layer_t,
             dll::dense_layer_desc<64 , 32 , dll::relu>::layer_t,
             // Encoded Features
-            dll::dense_layer_desc<32 , 64 , dll::relu>::layer_t,
-            dll::dense_layer_desc<64 , 128, dll::relu>::layer_t,
-            dll::dense_layer_desc<128, 784, dll::sigmoid>::layer_t
+            // The decoder uses the transposed weights of the encoder
+            dll::tied_dense_layer_desc<32 , 64 , dll::relu>::layer_t,
+            dll::tied_dense_layer_desc<64 , 128, dll::relu>::layer_t,
+            dll::tied_dense_layer_desc<128, 784, dll::sigmoid>::layer_t
         >
         , dll::batch_size<256>       // The mini-batch size
         , dll::shuffle               // Shuffle the dataset before each epoch
@@ -0,0 +1,288 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Anomaly scores of samples, from the reconstruction errors or the
+ * free energies of trained RBMs and autoencoders.
+ *
+ * The samples are scored by batches: the up and down passes of the RBMs
+ * are batched products and the reconstructions of the autoencoders are
+ * batched forward passes. The chunks of a range of samples are scored in
+ * parallel, the batches of a generator are scored one after the other, as
+ * they are streamed.
+ *
+ * The reconstructions of the RBMs are computed with the activation
+ * probabilities (mean-field), the scores are deterministic.
+ */
+
+#pragma once
+
+#include <vector>
+#include <iterator>
+
+#include "etl/etl.hpp"
+
+#include "dll/generators.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/util/chunk.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+namespace anomaly_detail {
+
+/*!
+ * \brief Score the given batch with the given RBM
+ * \param rbm The RBM
+ * \param batch The batch of samples
+ * \param errors The output reconstruction errors, nullptr if not computed
+ * \param energies The output free energies, nullptr if not computed
+ */
+template <typename RBM, typename V>
+void rbm_scores(const RBM& rbm, const V& batch, double* errors, double* energies) {
+    using weight = typename RBM::weight;
+
+    const size_t B  = etl::dim<0>(batch);
+    const size_t nv = dll::input_size(rbm);
+    const size_t nh = dll::output_size(rbm);
+
+    etl::dyn_matrix<weight, 2> v(B, nv);
+    etl::dyn_matrix<weight, 2> h_a(B, nh);
+
+    v = etl::reshape(batch, B, nv);
+
+    // Up pass
+    rbm.batch_activate_hidden(h_a, v);
+
+    if (energies) {
+        for (size_t b = 0; b < B; ++b) {
+            energies[b] = rbm.free_energy_hidden(v(b), h_a(b));
+        }
+    }
+
+    if (errors) {
+        etl::dyn_matrix<weight, 2> v_a(B, nv);
+
+        // Down pass, from the probabilities
+        rbm.template batch_activate_visible<true, false>(h_a, h_a, v_a, v_a);
+
+        for (size_t b = 0; b < B; ++b) {
+            errors[b] = etl::mean((v(b) - v_a(b)) >> (v(b) - v_a(b)));
+        }
+    }
+}
+
+/*!
+ * \brief Score the given batch with the given autoencoder
+ * \param dbn The autoencoder network
+ * \param batch The batch of samples
+ * \param errors The output reconstruction errors
+ */
+template <typename DBN, typename V>
+void ae_scores(const DBN& dbn, const V& batch, double* errors) {
+    decltype(auto) out = dbn.forward_batch(batch);
+
+    cpp_assert(etl::size(out) == etl::size(batch), "The network is not an autoencoder");
+
+    for (size_t b = 0; b < etl::dim<0>(batch); ++b) {
+        errors[b] = etl::mean((batch(b) - out(b)) >> (batch(b) - out(b)));
+    }
+}
+
+/*!
+ * \brief Score the given range of samples, by chunks of B samples scored
+ * in parallel
+ */
+template <typename T, typename Iterator, typename Functor>
+std::vector<double> score_range(const Iterator& first, const Iterator& last, size_t B, Functor&& score) {
+    const size_t n      = std::distance(first, last);
+    const size_t chunks = (n + B - 1) / B;
+
+    std::vector<double> scores(n);
+
+    parallel_for_n(chunks, [&](size_t c) {
+        auto input = stage_chunk<T>(first, c, n, B);
+
+        score(input, scores.data() + c * B);
+    });
+
+    return scores;
+}
+
+/*!
+ * \brief Score all the batches of the given generator
+ */
+template <typename Generator, typename Functor>
+std::vector<double> score_generator(Generator& generator, Functor&& score) {
+    std::vector<double> scores;
+    scores.reserve(generator.size());
+
+    generator.reset();
+
+    while (generator.has_next_batch()) {
+        auto batch = generator.data_batch();
+
+        const size_t offset = scores.size();
+
+        scores.resize(offset + etl::dim<0>(batch));
+
+        score(batch, scores.data() + offset);
+
+        generator.next_batch();
+    }
+
+    return scores;
+}
+
+} //end of namespace anomaly_detail
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given range with the given RBM
+ * \param rbm The RBM
+ * \param first Iterator to the first sample
+ * \param last Iterator to the past-the-end sample
+ * \return the reconstruction error of each sample
+ */
+template <typename RBM, typename Iterator>
+std::vector<double> reconstruction_errors(const RBM& rbm, const Iterator& first, const Iterator& last) {
+    static_assert(decay_layer_traits<RBM>::is_dense_rbm_layer(), "Only the dense RBMs can score samples");
+
+    dll::auto_timer timer("anomaly:rbm:reconstruction_errors");
+
+    return anomaly_detail::score_range<typename RBM::weight>(first, last, RBM::batch_size, [&rbm](const auto& batch, double* scores) {
+        anomaly_detail::rbm_scores(rbm, batch, scores, nullptr);
+    });
+}
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given container with the given RBM
+ * \param rbm The RBM
+ * \param samples The samples
+ * \return the reconstruction error of each sample
+ */
+template <typename RBM, typename Samples, cpp_disable_if(is_generator<Samples>)>
+std::vector<double> reconstruction_errors(const RBM& rbm, const Samples& samples) {
+    return reconstruction_errors(rbm, samples.begin(), samples.end());
+}
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given generator with the given RBM
+ * \param rbm The RBM
+ * \param generator The generator of the samples
+ * \return the reconstruction error of each sample
+ */
+template <typename RBM, typename Generator, cpp_enable_iff(is_generator<Generator>)>
+std::vector<double> reconstruction_errors(const RBM& rbm, Generator& generator) {
+    static_assert(decay_layer_traits<RBM>::is_dense_rbm_layer(), "Only the dense RBMs can score samples");
+
+    dll::auto_timer timer("anomaly:rbm:reconstruction_errors");
+
+    return anomaly_detail::score_generator(generator, [&rbm](const auto& batch, double* scores) {
+        anomaly_detail::rbm_scores(rbm, batch, scores, nullptr);
+    });
+}
+
+/*!
+ * \brief Return the free energy of each sample of the given range with
+ * the given RBM
+ * \param rbm The RBM, with binary hidden units
+ * \param first Iterator to the first sample
+ * \param last Iterator to the past-the-end sample
+ * \return the free energy of each sample
+ */
+template <typename RBM, typename Iterator>
+std::vector<double> free_energies(const RBM& rbm, const Iterator& first, const Iterator& last) {
+    static_assert(decay_layer_traits<RBM>::is_dense_rbm_layer(), "Only the dense RBMs can score samples");
+
+    dll::auto_timer timer("anomaly:rbm:free_energies");
+
+    return anomaly_detail::score_range<typename RBM::weight>(first, last, RBM::batch_size, [&rbm](const auto& batch, double* scores) {
+        anomaly_detail::rbm_scores(rbm, batch, nullptr, scores);
+    });
+}
+
+/*!
+ * \brief Return the free energy of each sample of the given container with
+ * the given RBM
+ * \param rbm The RBM, with binary hidden units
+ * \param samples The samples
+ * \return the free energy of each sample
+ */
+template <typename RBM, typename Samples, cpp_disable_if(is_generator<Samples>)>
+std::vector<double> free_energies(const RBM& rbm, const Samples& samples) {
+    return free_energies(rbm, samples.begin(), samples.end());
+}
+
+/*!
+ * \brief Return the free energy of each sample of the given generator with
+ * the given RBM
+ * \param rbm The RBM, with binary hidden units
+ * \param generator The generator of the samples
+ * \return the free energy of each sample
+ */
+template <typename RBM, typename Generator, cpp_enable_iff(is_generator<Generator>)>
+std::vector<double> free_energies(const RBM& rbm, Generator& generator) {
+    static_assert(decay_layer_traits<RBM>::is_dense_rbm_layer(), "Only the dense RBMs can score samples");
+
+    dll::auto_timer timer("anomaly:rbm:free_energies");
+
+    return anomaly_detail::score_generator(generator, [&rbm](const auto& batch, double* scores) {
+        anomaly_detail::rbm_scores(rbm, batch, nullptr, scores);
+    });
+}
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given range with the given autoencoder network
+ * \param dbn The autoencoder
+ * \param first Iterator to the first sample
+ * \param last Iterator to the past-the-end sample
+ * \return the reconstruction error of each sample
+ */
+template <typename DBN, typename Iterator>
+std::vector<double> ae_reconstruction_errors(const DBN& dbn, const Iterator& first, const Iterator& last) {
+    dll::auto_timer timer("anomaly:ae:reconstruction_errors");
+
+    return anomaly_detail::score_range<typename DBN::weight>(first, last, DBN::batch_size, [&dbn](const auto& batch, double* scores) {
+        anomaly_detail::ae_scores(dbn, batch, scores);
+    });
+}
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given container with the given autoencoder network
+ * \param dbn The autoencoder
+ * \param samples The samples
+ * \return the reconstruction error of each sample
+ */
+template <typename DBN, typename Samples, cpp_disable_if(is_generator<Samples>)>
+std::vector<double> ae_reconstruction_errors(const DBN& dbn, const Samples& samples) {
+    return ae_reconstruction_errors(dbn, samples.begin(), samples.end());
+}
+
+/*!
+ * \brief Return the reconstruction error (mean squared error) of each
+ * sample of the given generator with the given autoencoder network
+ * \param dbn The autoencoder
+ * \param generator The generator of the samples
+ * \return the reconstruction error of each sample
+ */
+template <typename DBN, typename Generator, cpp_enable_iff(is_generator<Generator>)>
+std::vector<double> ae_reconstruction_errors(const DBN& dbn, Generator& generator) {
+    dll::auto_timer timer("anomaly:ae:reconstruction_errors");
+
+    return anomaly_detail::score_generator(generator, [&dbn](const auto& batch, double* scores) {
+        anomaly_detail::ae_scores(dbn, batch, scores);
+    });
+}
+
+} //end of dll namespace
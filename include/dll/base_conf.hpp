@@ -18,7 +18,9 @@
 #include "version.hpp"
 #include "unit_type.hpp"
 #include "updater_type.hpp"
+#include "compression_type.hpp"
 #include "strategy.hpp"
+#include "conv_algorithm.hpp"
 #include "function.hpp"
 #include "loss.hpp"
 #include "decay_type.hpp"
@@ -120,6 +122,8 @@ struct sparsity_id;
 struct bias_id;
 struct momentum_id;
 struct serial_id;
+struct hogwild_id;
+struct parameter_server_id;
 struct verbose_id;
 struct horizontal_id;
 struct vertical_id;
@@ -134,22 +138,55 @@ struct free_energy_id;
 struct no_epoch_error_id;
 struct random_crop_id;
 struct batch_mode_id;
+struct pretrain_cache_id;
 struct dbn_only_id;
 struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
 struct threaded_id;
+struct threaded_workers_id;
+struct spin_wait_id;
+struct bf16_cache_id;
+struct index_shuffle_id;
+struct importance_sampling_id;
+struct u8_cache_id;
+struct compact_labels_id;
+struct prefetch_budget_id;
+struct cache_budget_id;
+struct prefetch_time_id;
+struct pinned_cache_id;
 struct nop_id;
 struct no_bias_id;
 struct elastic_distortion_id;
 struct noise_id;
+struct gaussian_noise_id;
+struct masking_noise_id;
+struct salt_pepper_noise_id;
 struct scale_pre_id;
 struct normalize_pre_id;
+struct standardize_pre_id;
+struct channel_standardize_pre_id;
 struct binarize_pre_id;
 struct autoencoder_id;
 struct updater_id;
+struct gradient_compression_id;
 struct early_stopping_id;
 struct early_training_id;
+struct data_parallel_id;
+struct pipeline_parallel_id;
+struct batch_metrics_period_id;
+struct parallel_evaluation_id;
+struct async_validation_id;
+struct gradient_checkpointing_id;
+struct conv_engine_id;
+struct stride_id;
+struct padding_id;
+struct sparse_input_id;
+struct fast_math_id;
+struct quantization_aware_id;
+struct sparse_relu_id;
+struct unpool_indices_id;
+struct inference_only_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -175,6 +212,18 @@ struct big_batch_size : value_conf_elt<big_batch_size_id, size_t, B> {};
 template <updater_type UT>
 struct updater : value_conf_elt<updater_id, updater_type, UT> {};
 
+/*!
+ * \brief Sets the compression of the gradients exchanged during
+ * distributed training.
+ *
+ * The part of the gradients lost by the compression is kept and added
+ * to the next gradients (error feedback).
+ *
+ * \tparam C The compression type
+ */
+template <compression_type C>
+struct gradient_compression : value_conf_elt<gradient_compression_id, compression_type, C> {};
+
 /*!
  * \brief Sets the strategy type for early stopping
  * \tparam UT The strategy type
@@ -188,6 +237,93 @@ struct early_stopping : value_conf_elt<early_stopping_id, strategy, S> {};
  */
 struct early_training : basic_conf_elt<early_training_id> {};
 
+/*!
+ * \brief Evaluate the validation set asynchronously, on a snapshot of the
+ * weights, while the next epoch is trained.
+ *
+ * The validation statistics are delivered one epoch late and early
+ * stopping uses this lagged signal.
+ */
+struct async_validation : basic_conf_elt<async_validation_id> {};
+
+/*!
+ * \brief Recompute the activations of the layers during the backward pass
+ * of the fine-tuning instead of keeping them for the whole batch.
+ *
+ * The activations are only kept at the boundaries of segments of layers,
+ * chosen automatically, and each segment is forwarded again just before
+ * being backpropagated. This only saves the memory of the dynamic layers
+ * and is not used by data-parallel and distributed fine-tuning.
+ */
+struct gradient_checkpointing : basic_conf_elt<gradient_checkpointing_id> {};
+
+/*!
+ * \brief Sets the algorithm used to compute the convolutions of a layer
+ */
+template <conv_algorithm A>
+struct conv_engine : value_conf_elt<conv_engine_id, conv_algorithm, A> {};
+
+/*!
+ * \brief Sets the stride of the convolutions of a layer
+ * \tparam S1 The stride in the first dimension
+ * \tparam S2 The stride in the second dimension
+ */
+template <size_t S1, size_t S2 = S1>
+struct stride : value_pair_conf_elt<stride_id, size_t, S1, S2> {};
+
+/*!
+ * \brief Sets the zero-padding of the input of the convolutions of a layer
+ * \tparam P1 The padding on each side of the first dimension
+ * \tparam P2 The padding on each side of the second dimension
+ */
+template <size_t P1, size_t P2 = P1>
+struct padding : value_pair_conf_elt<padding_id, size_t, P1, P2> {};
+
+/*!
+ * \brief Use sparse products for the (very sparse) inputs of a layer.
+ *
+ * Each batch is compressed (CSR) and the products are only computed on
+ * the non-zero values. The dense products are used for the batches that
+ * are not sparse enough.
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
+/*!
+ * \brief Use fast approximations of the sigmoid, tanh and softmax
+ * activation functions (relative error of exp below 3e-6).
+ */
+struct fast_math : basic_conf_elt<fast_math_id> {};
+
+/*!
+ * \brief Train the layer for int8 inference: the weights and the input
+ * are fake-quantized during the training, with learned scales that are
+ * used by the int8 runtime (dll::quantize).
+ */
+struct quantization_aware : basic_conf_elt<quantization_aware_id> {};
+
+/*!
+ * \brief Use sparse products over the zeros of the ReLU units for the
+ * backpropagation and the gradients, when a batch is sparse enough.
+ *
+ * The errors of a dense layer (or the hidden activations of an RBM) are
+ * compressed at each batch and the dense products are used for the
+ * batches that are not sparse enough.
+ */
+struct sparse_relu : basic_conf_elt<sparse_relu_id> {};
+
+/*!
+ * \brief Unpool each value at the position of the maximum of its window
+ * recorded by the max pooling layer L of the network (max unpooling),
+ * the other outputs being zero, instead of replicating it in its window.
+ *
+ * The positions are only known during the SGD training, the values are
+ * replicated in their window by the inference.
+ *
+ * \tparam L The index of the max pooling layer in the network
+ */
+template <size_t L>
+struct unpool_indices : value_conf_elt<unpool_indices_id, size_t, L> {};
+
 /*!
  * \brief Sets the visible unit type
  * \tparam VT The visible unit type
@@ -313,6 +449,79 @@ struct momentum : basic_conf_elt<momentum_id> {};
  */
 struct serial : basic_conf_elt<serial_id> {};
 
+/*!
+ * \brief Train the RBM with several threads updating the weights without
+ * locking (Hogwild!).
+ */
+struct hogwild : basic_conf_elt<hogwild_id> {};
+
+/*!
+ * \brief Pretrain the RBM asynchronously on several nodes, with a
+ * parameter server.
+ *
+ * Each node trains on its own shard and pushes the changes of its
+ * weights to the server (on rank 0), pulling the weights of the server
+ * every K batches.
+ *
+ * \tparam K The number of batches between two synchronizations
+ */
+template <size_t K>
+struct parameter_server : value_conf_elt<parameter_server_id, size_t, K> {};
+
+/*!
+ * \brief Split each fine-tuning batch between several threads.
+ *
+ * Each thread forwards and backpropagates its part of the batch in its own
+ * copy of the training contexts and the gradients are summed before the
+ * weights are updated. The layers must not have training state shared
+ * between samples (batch normalization, dropout, ...).
+ *
+ * \tparam T The number of threads
+ */
+template <size_t T>
+struct data_parallel : value_conf_elt<data_parallel_id, size_t, T> {};
+
+/*!
+ * \brief Split the layers of the network between several pipeline stages
+ * during fine-tuning.
+ *
+ * Each stage trains a contiguous range of layers in its own thread, pinned
+ * on its own NUMA node with the weights, the contexts and the state of the
+ * updater of its layers. The parts of the batch of the data-parallel
+ * replicas are the micro-batches flowing through the stages: once the
+ * pipeline is full, each stage alternates between the forward pass of a
+ * micro-batch and the backward pass of an earlier one. This is useful with
+ * very wide layers, limited by the memory bandwidth of one node.
+ *
+ * This must be used with data_parallel, whose number of threads is the
+ * number of micro-batches.
+ *
+ * \tparam S The number of stages
+ */
+template <size_t S>
+struct pipeline_parallel : value_conf_elt<pipeline_parallel_id, size_t, S> {};
+
+/*!
+ * \brief Sets the number of batches between two computations of the error
+ * and loss of the training batches, in verbose mode.
+ *
+ * The other batches report the last computed values. Without verbose
+ * mode, the metrics of the batches are never computed.
+ *
+ * \tparam K The number of batches
+ */
+template <size_t K>
+struct batch_metrics_period : value_conf_elt<batch_metrics_period_id, size_t, K> {};
+
+/*!
+ * \brief Evaluate the batches of a generator in parallel on the thread pool
+ * of the network.
+ *
+ * The batches are copied in groups of one batch per thread, forwarded
+ * concurrently and their metrics are summed.
+ */
+struct parallel_evaluation : basic_conf_elt<parallel_evaluation_id> {};
+
 /*!
  * \brief Make execution as verbose as possible
  */
@@ -348,6 +557,121 @@ struct categorical : basic_conf_elt<categorical_id> {};
  */
 struct threaded : basic_conf_elt<threaded_id> {};
 
+/*!
+ * \brief Sets the number of threads used for data augmentation.
+ * \tparam N The number of augmentation workers
+ */
+template <size_t N>
+struct threaded_workers : value_conf_elt<threaded_workers_id, size_t, N> {};
+
+/*!
+ * \brief Sets the number of spin iterations a generator thread waits
+ * before parking.
+ * \tparam N The number of spin iterations
+ */
+template <size_t N>
+struct spin_wait : value_conf_elt<spin_wait_id, size_t, N> {};
+
+/*!
+ * \brief Store the inputs of the in-memory generator in bfloat16.
+ *
+ * This halves the memory of the input cache. The batches are still
+ * generated in the original precision.
+ */
+struct bf16_cache : basic_conf_elt<bf16_cache_id> {};
+
+/*!
+ * \brief Shuffle a permutation of the indices of the in-memory generator
+ * instead of the samples themselves.
+ *
+ * The batches are gathered through the permutation by the generator
+ * threads.
+ */
+struct index_shuffle : basic_conf_elt<index_shuffle_id> {};
+
+/*!
+ * \brief Sample the training epochs of the in-memory generator by the
+ * losses of the samples (hard example mining).
+ *
+ * The trainer reports the loss of each sample of the batches to the
+ * generator. After the first epoch, each epoch draws a subset of F percent
+ * of the samples, without replacement, with a probability proportional to
+ * the last loss of the samples. The losses are raised to Floor percent of
+ * their mean so that no sample is abandoned. The subsets are drawn when
+ * the generator is shuffled and are deterministic under the seed. This
+ * implies index_shuffle.
+ *
+ * \tparam F The percent of the samples in each epoch
+ * \tparam Floor The minimum weight of a sample, in percent of the mean loss
+ */
+template <size_t F, size_t Floor = 10>
+struct importance_sampling : value_pair_conf_elt<importance_sampling_id, size_t, F, Floor> {};
+
+/*!
+ * \brief Store the raw inputs of the in-memory generator in uint8.
+ *
+ * The inputs must be integers in [0, 255] (8-bit images). The
+ * pre-transformations (scale_pre, normalize_pre, binarize_pre) are
+ * applied when the batches are generated.
+ */
+struct u8_cache : basic_conf_elt<u8_cache_id> {};
+
+/*!
+ * \brief Store the class indices of the categorical labels of the generators
+ * instead of their categorical (one-hot) form.
+ *
+ * The labels are only made categorical for the current batch.
+ */
+struct compact_labels : basic_conf_elt<compact_labels_id> {};
+
+/*!
+ * \brief Prefetch the next batches of the out-of-memory generator in the
+ * background, while the current ones are used.
+ *
+ * Two buffers of batches are used, the size of both buffers is bounded
+ * by the given number of bytes. The loading of one buffer is overlapped
+ * with the use of the other.
+ *
+ * \tparam B The memory budget of the two buffers, in bytes
+ */
+template <size_t B>
+struct prefetch_budget : value_conf_elt<prefetch_budget_id, size_t, B> {};
+
+/*!
+ * \brief Sets the memory budget of the batch cache of the threaded
+ * generators, instead of its number of batches (big_batch_size).
+ *
+ * The number of batches of the cache is computed from the memory of one
+ * batch, when the generator is constructed.
+ *
+ * \tparam B The memory budget of the batch cache, in bytes
+ */
+template <size_t B>
+struct cache_budget : value_conf_elt<cache_budget_id, size_t, B> {};
+
+/*!
+ * \brief Sets the target time of consumption prefetched by the workers of
+ * the threaded generators.
+ *
+ * The number of batches of the cache in use is computed again at each
+ * reset of the generation, from the measured time to produce and to
+ * consume a batch, at most the number of batches of the cache.
+ *
+ * \tparam Ms The target time held in the prefetched batches, in milliseconds
+ */
+template <size_t Ms>
+struct prefetch_time : value_conf_elt<prefetch_time_id, size_t, Ms> {};
+
+/*!
+ * \brief Allocate the batch cache of the threaded generators in page-locked
+ * memory.
+ *
+ * With GPU (ETL_GPU), the batches are then copied directly to the device,
+ * and the upload of the next batch can be started as soon as it is ready
+ * (next_batch_ready), while the current batch is used.
+ */
+struct pinned_cache : basic_conf_elt<pinned_cache_id> {};
+
 /*!
  * \brief Sets the elastic distortion kernel
  * \tparam K The elastic distortion kernel
@@ -362,6 +686,40 @@ struct elastic_distortion : value_conf_elt<elastic_distortion_id, size_t, K> {};
 template <size_t N>
 struct noise : value_conf_elt<noise_id, size_t, N> {};
 
+/*!
+ * \brief Add gaussian noise to each batch of the generator.
+ *
+ * A new noise is drawn each time a batch is generated, the samples of
+ * the generator are not modified.
+ *
+ * \tparam S The standard deviation of the noise, in percent
+ */
+template <size_t S>
+struct gaussian_noise : value_conf_elt<gaussian_noise_id, size_t, S> {};
+
+/*!
+ * \brief Set some of the values of each batch of the generator to zero.
+ *
+ * A new noise is drawn each time a batch is generated, the samples of
+ * the generator are not modified.
+ *
+ * \tparam P The percent of values set to zero
+ */
+template <size_t P>
+struct masking_noise : value_conf_elt<masking_noise_id, size_t, P> {};
+
+/*!
+ * \brief Set some of the values of each batch of the generator to zero
+ * or one (with the same probability).
+ *
+ * A new noise is drawn each time a batch is generated, the samples of
+ * the generator are not modified.
+ *
+ * \tparam P The percent of values modified
+ */
+template <size_t P>
+struct salt_pepper_noise : value_conf_elt<salt_pepper_noise_id, size_t, P> {};
+
 /*!
  * \brief Sets the prescaling factor
  * \tparam S The scaling factor
@@ -381,6 +739,18 @@ struct binarize_pre : value_conf_elt<binarize_pre_id, size_t, B> {};
  */
 struct normalize_pre : basic_conf_elt<normalize_pre_id> {};
 
+/*!
+ * \brief Standardize each feature of the inputs by the mean and the
+ * standard deviation of the feature over the whole dataset
+ */
+struct standardize_pre : basic_conf_elt<standardize_pre_id> {};
+
+/*!
+ * \brief Standardize each channel of the inputs by the mean and the
+ * standard deviation of the channel over the whole dataset
+ */
+struct channel_standardize_pre : basic_conf_elt<channel_standardize_pre_id> {};
+
 /*!
  * \brief Sets the mode to auto-encoder.
  */
@@ -424,6 +794,16 @@ struct clip_gradients : basic_conf_elt<clip_gradients_id> {};
  */
 struct dbn_only : basic_conf_elt<dbn_only_id> {};
 
+/*!
+ * \brief Indicates that the network is only used for inference.
+ *
+ * The state only used by the training (the scratch of the RBM and the
+ * statistics of the last batch of the batch normalization) is removed from
+ * the layers of the network at compile-time, the network cannot be
+ * trained.
+ */
+struct inference_only : basic_conf_elt<inference_only_id> {};
+
 /*!
  * \brief Do nothing (for TMP)
  */
@@ -439,6 +819,15 @@ struct no_bias : basic_conf_elt<no_bias_id> {};
  */
 struct batch_mode : basic_conf_elt<batch_mode_id> {};
 
+/*!
+ * \brief In batch mode, compute the inputs of each pretrained layer only
+ * once and keep them in memory for the following epochs.
+ *
+ * The inputs of a layer are computed from the cached inputs of the
+ * previous pretrained layer, not from the complete dataset.
+ */
+struct pretrain_cache : basic_conf_elt<pretrain_cache_id> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
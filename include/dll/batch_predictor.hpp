@@ -0,0 +1,311 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Micro-batching front-end for online prediction
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+#include "etl/etl.hpp"
+
+#include "dll/transform/transform_layer.hpp" // For inherit_dim
+#include "dll/util/affinity.hpp"
+#include "dll/util/prediction_cache.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Micro-batching front-end for online prediction with a network.
+ *
+ * Single samples are accepted from any thread and are queued. The queued
+ * samples are forward propagated together, as one batch, either when
+ * batch_size samples are waiting or when the oldest waiting sample has
+ * waited for the maximum latency. The results are returned through
+ * futures.
+ *
+ * Optionally, the outputs are kept in a bounded cache, keyed by the hash
+ * of the input and the version of the weights of the network, and the
+ * repeated samples are answered directly from the cache, without being
+ * queued. The cached outputs are invalidated when the network is trained
+ * or loaded.
+ *
+ * The network must outlive the predictor and must not be trained while
+ * the predictor is in use.
+ */
+template <typename DBN>
+struct batch_predictor {
+    using dbn_t        = DBN;                         ///< The network type
+    using weight       = typename dbn_t::weight;      ///< The data type of the network
+    using input_one_t  = typename dbn_t::input_one_t; ///< The type of one input
+    using output_one_t = std::decay_t<decltype(std::declval<const dbn_t&>().forward_one(std::declval<const input_one_t&>()))>; ///< The type of one output
+
+    static constexpr size_t input_dimensions = etl::decay_traits<input_one_t>::dimensions(); ///< The number of dimensions of one input
+
+    using clock         = std::chrono::steady_clock;                    ///< The clock used for the deadlines
+    using input_batch_t = etl::dyn_matrix<weight, input_dimensions + 1>; ///< The type of a batch of input
+    using cache_t       = prediction_cache<output_one_t>;                ///< The type of the cache of the outputs
+
+    /*!
+     * \brief Construct a new batch_predictor and start its flushing thread
+     * \param dbn The network to use for prediction
+     * \param batch_size The maximum number of samples in one batch
+     * \param latency The maximum time a sample can wait for its batch to be complete
+     * \param cache_capacity The maximum number of cached outputs (0 to disable the cache)
+     */
+    batch_predictor(const dbn_t& dbn, size_t batch_size, std::chrono::microseconds latency, size_t cache_capacity = 0)
+            : dbn(dbn), batch_size(batch_size), latency(latency) {
+        cpp_assert(batch_size > 0, "The batch size must be at least one");
+
+        if (cache_capacity) {
+            cache = std::make_unique<cache_t>(cache_capacity);
+        }
+
+        flusher = std::thread([this] { flush_main(); });
+    }
+
+    batch_predictor(const batch_predictor& rhs) = delete;
+    batch_predictor& operator=(const batch_predictor& rhs) = delete;
+
+    batch_predictor(batch_predictor&& rhs) = delete;
+    batch_predictor& operator=(batch_predictor&& rhs) = delete;
+
+    /*!
+     * \brief Stop the predictor, after the remaining samples have been
+     * computed.
+     */
+    ~batch_predictor() {
+        cpp::with_lock(lock, [this] { stop_flag = true; });
+
+        condition.notify_all();
+
+        flusher.join();
+    }
+
+    /*!
+     * \brief Queue a sample for the computation of its output features
+     * \param sample The sample to compute the features for
+     * \return A future to the output features of the network
+     */
+    std::future<output_one_t> features(const input_one_t& sample) {
+        request r(sample, false);
+
+        auto future = r.output.get_future();
+
+        if (!cached(r)) {
+            push(std::move(r));
+        }
+
+        return future;
+    }
+
+    /*!
+     * \brief Queue a sample for the prediction of its label
+     * \param sample The sample to predict the label for
+     * \return A future to the predicted label
+     */
+    std::future<size_t> predict(const input_one_t& sample) {
+        request r(sample, true);
+
+        auto future = r.label.get_future();
+
+        if (!cached(r)) {
+            push(std::move(r));
+        }
+
+        return future;
+    }
+
+    /*!
+     * \brief Return the cache of the outputs, with its hit-rate metrics,
+     * or nullptr if the cache is disabled
+     */
+    const cache_t* output_cache() const {
+        return cache.get();
+    }
+
+private:
+    /*!
+     * \brief A queued sample
+     */
+    struct request {
+        input_one_t sample;                ///< The sample
+        bool label_only;                   ///< Indicates if only the label is requested
+        clock::time_point arrival;         ///< The time at which the sample was queued
+        std::promise<output_one_t> output; ///< The promise for the output features
+        std::promise<size_t> label;        ///< The promise for the label
+        uint64_t key   = 0;                ///< The hash of the sample (cache only)
+        size_t version = 0;                ///< The version of the weights at the time of the request (cache only)
+
+        request(const input_one_t& sample, bool label_only)
+                : sample(sample), label_only(label_only), arrival(clock::now()) {}
+    };
+
+    /*!
+     * \brief Try to fulfill the given request from the cache
+     * \return true if the request was fulfilled, false otherwise
+     */
+    bool cached(request& r) {
+        if (!cache) {
+            return false;
+        }
+
+        r.key     = hash_memory(r.sample.memory_start(), etl::size(r.sample) * sizeof(weight));
+        r.version = dbn.weights_version();
+
+        output_one_t result;
+
+        if (!cache->get(r.key, r.version, result)) {
+            return false;
+        }
+
+        if (r.label_only) {
+            r.label.set_value(label_of(result));
+        } else {
+            r.output.set_value(std::move(result));
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Return the predicted label of the given output
+     */
+    static size_t label_of(const output_one_t& result) {
+        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
+    }
+
+    /*!
+     * \brief Queue a new request
+     */
+    void push(request&& r) {
+        bool full = false;
+
+        cpp::with_lock(lock, [this, &r, &full] {
+            cpp_assert(!stop_flag, "The predictor has been stopped");
+
+            queue.push_back(std::move(r));
+
+            full = queue.size() == 1 || queue.size() >= batch_size;
+        });
+
+        // The flusher only needs to be woken for a new deadline or for a full batch
+        if (full) {
+            condition.notify_one();
+        }
+    }
+
+    /*!
+     * \brief The main function of the flushing thread
+     */
+    void flush_main() {
+        pin_helper();
+
+        std::vector<request> batch;
+        batch.reserve(batch_size);
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                condition.wait(ulock, [this] { return stop_flag || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                // Wait for a full batch, at most until the deadline of the oldest sample
+                auto deadline = queue.front().arrival + latency;
+
+                condition.wait_until(ulock, deadline, [this] { return stop_flag || queue.size() >= batch_size; });
+
+                const size_t n = std::min(batch_size, queue.size());
+
+                std::move(queue.begin(), queue.begin() + n, std::back_inserter(batch));
+                queue.erase(queue.begin(), queue.begin() + n);
+            }
+
+            compute(batch);
+
+            batch.clear();
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch of requests and fulfill their promises
+     */
+    void compute(std::vector<request>& batch) const {
+        auto input = make_batch(batch.size(), batch.front().sample, std::make_index_sequence<input_dimensions>());
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            input(i) = batch[i].sample;
+        }
+
+        auto output = dbn.forward_batch(input);
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            output_one_t result;
+            inherit_dim(result, output(i));
+            result = output(i);
+
+            if (cache) {
+                cache->put(batch[i].key, batch[i].version, result);
+            }
+
+            if (batch[i].label_only) {
+                batch[i].label.set_value(label_of(result));
+            } else {
+                batch[i].output.set_value(std::move(result));
+            }
+        }
+    }
+
+    /*!
+     * \brief Create an empty batch of input with the dimensions of the given sample
+     */
+    template <size_t... I>
+    static input_batch_t make_batch(size_t n, const input_one_t& sample, std::index_sequence<I...>) {
+        return input_batch_t(n, etl::dim<I>(sample)...);
+    }
+
+    const dbn_t& dbn;                        ///< The network
+    const size_t batch_size;                 ///< The maximum number of samples in one batch
+    const std::chrono::microseconds latency; ///< The maximum latency of a sample
+    std::unique_ptr<cache_t> cache;          ///< The cache of the outputs, if enabled
+
+    std::deque<request> queue;         ///< The queued requests
+    bool stop_flag = false;            ///< Indicates if the predictor is stopping
+    std::mutex lock;                   ///< The lock protecting the queue
+    std::condition_variable condition; ///< The condition variable to wake the flusher
+    std::thread flusher;               ///< The flushing thread
+};
+
+/*!
+ * \brief Create a micro-batching predictor for the given network
+ * \param dbn The network to use for prediction
+ * \param batch_size The maximum number of samples in one batch
+ * \param latency The maximum time a sample can wait for its batch to be complete
+ * \param cache_capacity The maximum number of cached outputs (0 to disable the cache)
+ */
+template <typename DBN>
+std::unique_ptr<batch_predictor<DBN>> make_batch_predictor(const DBN& dbn, size_t batch_size, std::chrono::microseconds latency, size_t cache_capacity = 0) {
+    return std::make_unique<batch_predictor<DBN>>(dbn, batch_size, latency, cache_capacity);
+}
+
+} //end of dll namespace
@@ -0,0 +1,607 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bit-packed binary inference of a stack of binary RBMs.
+ *
+ * The inputs of the layers are thresholded to {0, 1} and stored as bit
+ * masks of 64 bits words, 32 times less memory than their floating point
+ * activations. The pre-activations are computed from the set bits only,
+ * by summing the rows of the weights of the active inputs, or, in XNOR
+ * mode, from the weights binarized to {-1, +1} with one scale per hidden
+ * unit (XNOR-Net), with two population counts per hidden unit.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <bitset>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/unit_type.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/direct.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+namespace binary_detail {
+
+/*!
+ * \brief The minimum number of operations of a layer for its batch to be
+ * computed in parallel
+ */
+constexpr size_t parallel_threshold = 256 * 1024;
+
+/*!
+ * \brief Return the number of set bits of the given word
+ */
+inline size_t popcount(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    return std::bitset<64>(x).count();
+#endif
+}
+
+/*!
+ * \brief Return the index of the lowest set bit of the given (non-zero) word
+ */
+inline size_t lowest_bit(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    size_t i = 0;
+
+    while (!(x & 1)) {
+        x >>= 1;
+        ++i;
+    }
+
+    return i;
+#endif
+}
+
+/*!
+ * \brief Compute the pre-activations of a sample of bits with the signs
+ * of the weights
+ *
+ * \param out The pre-activations (H)
+ * \param x The bits of the sample (W words)
+ * \param positive The masks of the positive weights of each output (H x W words)
+ * \param alpha The scale of each output (H)
+ * \param c The biases (H)
+ */
+template <typename T>
+DLL_MULTI_VERSION_POPCNT void xnor_row(T* out, const uint64_t* x, const uint64_t* positive, const T* alpha, const T* c, size_t W, size_t H) {
+    size_t active = 0;
+
+    for (size_t k = 0; k < W; ++k) {
+        active += popcount(x[k]);
+    }
+
+    // The sum of the signs of the active inputs
+    for (size_t j = 0; j < H; ++j) {
+        const uint64_t* p = positive + j * W;
+
+        size_t agree = 0;
+
+        for (size_t k = 0; k < W; ++k) {
+            agree += popcount(x[k] & p[k]);
+        }
+
+        out[j] = c[j] + alpha[j] * (T(2 * agree) - T(active));
+    }
+}
+
+/*!
+ * \brief Compute the pre-activations of a sample of bits by summing the
+ * rows of the weights of its set bits
+ *
+ * \param out The pre-activations (H)
+ * \param x The bits of the sample (W words)
+ * \param w The weights (V x H)
+ * \param c The biases (H)
+ */
+template <typename T>
+DLL_MULTI_VERSION void accumulate_rows(T* out, const uint64_t* x, const T* w, const T* c, size_t W, size_t H) {
+    std::copy(c, c + H, out);
+
+    for (size_t k = 0; k < W; ++k) {
+        uint64_t bits = x[k];
+
+        while (bits) {
+            const T* row = w + (k * 64 + lowest_bit(bits)) * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                out[j] += row[j];
+            }
+
+            bits &= bits - 1;
+        }
+    }
+}
+
+/*!
+ * \brief Return the number of 64 bits words for the given number of bits
+ */
+constexpr size_t words(size_t bits) {
+    return (bits + 63) / 64;
+}
+
+} //end of namespace binary_detail
+
+/*!
+ * \brief A batch of binary activations, one bit per unit
+ */
+struct bit_batch {
+    size_t rows  = 0;            ///< The number of samples
+    size_t bits  = 0;            ///< The number of units per sample
+    size_t words = 0;            ///< The number of words per sample
+    std::vector<uint64_t> data; ///< The words of each sample, the unused bits being zero
+
+    /*!
+     * \brief Resize the batch for the given number of samples and units,
+     * all the bits being cleared
+     */
+    void resize(size_t rows, size_t bits) {
+        this->rows  = rows;
+        this->bits  = bits;
+        this->words = binary_detail::words(bits);
+
+        data.assign(rows * words, 0);
+    }
+
+    /*!
+     * \brief Return the words of the given sample
+     */
+    uint64_t* row(size_t b) {
+        return data.data() + b * words;
+    }
+
+    /*!
+     * \copydoc row
+     */
+    const uint64_t* row(size_t b) const {
+        return data.data() + b * words;
+    }
+
+    /*!
+     * \brief Indicates if the given unit of the given sample is active
+     */
+    bool get(size_t b, size_t i) const {
+        return (row(b)[i / 64] >> (i % 64)) & 1;
+    }
+
+    /*!
+     * \brief Set the bits of the values of the given batch (samples x
+     * units) that are greater than the threshold
+     */
+    template <typename Input, typename T>
+    void pack(const Input& input, T threshold) {
+        decltype(auto) in = direct_memory(input);
+
+        host_read(in);
+
+        const size_t B = etl::dim<0>(in);
+
+        resize(B, etl::size(in) / B);
+
+        const auto* x = in.memory_start();
+
+        for (size_t b = 0; b < B; ++b) {
+            uint64_t* r = row(b);
+
+            for (size_t i = 0; i < bits; ++i) {
+                if (x[b * bits + i] > threshold) {
+                    r[i / 64] |= uint64_t(1) << (i % 64);
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Binary state of a layer that is not supported by the binary
+ * inference
+ */
+template <typename Layer, bool Xnor, typename Enable = void>
+struct binary_layer {
+    static constexpr bool supported = false; ///< Indicates if the layer can be computed on bits
+};
+
+/*!
+ * \brief Binary state of a thresholding layer, that packs the input of
+ * the network to bits
+ */
+template <typename Desc, bool Xnor>
+struct binary_layer<binarize_layer_impl<Desc>, Xnor> {
+    using layer_t = binarize_layer_impl<Desc>; ///< The layer
+
+    static constexpr bool supported = true;  ///< Indicates if the layer can be computed on bits
+    static constexpr bool packing   = true;  ///< Indicates if the layer packs its input to bits
+    static constexpr bool output    = false; ///< Indicates if the layer can compute the output of the network
+
+    /*!
+     * \brief Create the binary state of the given layer
+     */
+    explicit binary_layer(const layer_t& layer) {
+        cpp_unused(layer);
+    }
+
+    /*!
+     * \brief Pack the given batch of input to bits
+     */
+    template <typename Input>
+    void pack(bit_batch& out, const Input& input) const {
+        out.pack(input, layer_t::Threshold);
+    }
+};
+
+/*!
+ * \brief Binary state of the layers with a matrix of weights (visibles x
+ * hiddens) and hidden biases.
+ *
+ * In the default mode, the pre-activation of a sample is the sum of the
+ * biases and of the rows of the weights of its set bits, the weights
+ * staying in floating point. In XNOR mode, the weights are replaced by
+ * their sign times the mean of their absolute values for each hidden
+ * unit, and the sums are computed with population counts of the set
+ * bits of the input and of the positive weights.
+ */
+template <typename Layer, bool Xnor>
+struct binary_weights {
+    using layer_t = Layer;                    ///< The layer
+    using weight  = typename layer_t::weight; ///< The data type of the layer
+
+    static constexpr size_t num_visible = layer_t::num_visible; ///< The number of visible units
+    static constexpr size_t num_hidden  = layer_t::num_hidden;  ///< The number of hidden units
+
+    static constexpr size_t W = binary_detail::words(num_visible); ///< The number of words of an input
+
+    const layer_t& layer;           ///< The layer
+    std::vector<uint64_t> positive; ///< The positive weights of each hidden unit, as bits (XNOR only)
+    std::vector<weight> alpha;      ///< The mean absolute weight of each hidden unit (XNOR only)
+
+    /*!
+     * \brief Create the binary state of the given layer
+     */
+    explicit binary_weights(const layer_t& layer) : layer(layer) {
+        if /*constexpr*/ (Xnor) {
+            positive.assign(num_hidden * W, 0);
+            alpha.assign(num_hidden, weight(0));
+
+            host_read(layer.w);
+
+            for (size_t j = 0; j < num_hidden; ++j) {
+                for (size_t i = 0; i < num_visible; ++i) {
+                    const weight v = layer.w(i, j);
+
+                    alpha[j] += std::abs(v);
+
+                    if (v > weight(0)) {
+                        positive[j * W + i / 64] |= uint64_t(1) << (i % 64);
+                    }
+                }
+
+                alpha[j] /= weight(num_visible);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the pre-activations (samples x hiddens) of the given
+     * batch of bits
+     */
+    void pre_activations(weight* a, const bit_batch& input) const {
+        cpp_assert(input.bits == num_visible, "Invalid number of bits for the layer");
+
+        host_read(layer.w, layer.b);
+
+        const weight* w = layer.w.memory_start();
+        const weight* c = layer.b.memory_start();
+
+        auto functor = [&](size_t b) {
+            weight* out       = a + b * num_hidden;
+            const uint64_t* x = input.row(b);
+
+            if /*constexpr*/ (Xnor) {
+                binary_detail::xnor_row(out, x, positive.data(), alpha.data(), c, W, num_hidden);
+            } else {
+                binary_detail::accumulate_rows(out, x, w, c, W, num_hidden);
+            }
+        };
+
+        if (input.rows * num_visible * num_hidden >= binary_detail::parallel_threshold) {
+            parallel_for_n(input.rows, functor);
+        } else {
+            for (size_t b = 0; b < input.rows; ++b) {
+                functor(b);
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Binary state of an RBM.
+ *
+ * The binary hidden units are active when their probability is greater
+ * than 0.5, i.e. when their pre-activation is positive. The last RBM of
+ * the network can also have softmax hidden units.
+ */
+template <typename Desc, bool Xnor>
+struct binary_layer<rbm_impl<Desc>, Xnor> : binary_weights<rbm_impl<Desc>, Xnor> {
+    using layer_t   = rbm_impl<Desc>;                 ///< The layer
+    using base_type = binary_weights<layer_t, Xnor>; ///< The base type
+    using weight    = typename layer_t::weight;       ///< The data type of the layer
+
+    static constexpr bool supported = true;  ///< Indicates if the layer can be computed on bits
+    static constexpr bool packing   = false; ///< Indicates if the layer packs its input to bits
+    static constexpr bool output    = true;  ///< Indicates if the layer can compute the output of the network
+
+    using base_type::base_type;
+    using base_type::num_hidden;
+
+    /*!
+     * \brief Compute the binary hidden units of the given batch of bits
+     */
+    void forward_bits(bit_batch& out, const bit_batch& input) const {
+        static_assert(layer_t::hidden_unit == unit_type::BINARY, "The binary inference only supports binary hidden units");
+
+        std::vector<weight> a(input.rows * num_hidden);
+
+        this->pre_activations(a.data(), input);
+
+        out.resize(input.rows, num_hidden);
+
+        for (size_t b = 0; b < input.rows; ++b) {
+            uint64_t* r = out.row(b);
+
+            for (size_t j = 0; j < num_hidden; ++j) {
+                if (a[b * num_hidden + j] > weight(0)) {
+                    r[j / 64] |= uint64_t(1) << (j % 64);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the probabilities of the hidden units of the given
+     * batch of bits
+     */
+    etl::dyn_matrix<weight, 2> forward_output(const bit_batch& input) const {
+        static_assert(layer_t::hidden_unit == unit_type::BINARY || layer_t::hidden_unit == unit_type::SOFTMAX,
+                      "The binary inference only supports binary and softmax output units");
+
+        static constexpr auto F = layer_t::hidden_unit == unit_type::BINARY ? function::SIGMOID : function::SOFTMAX;
+
+        etl::dyn_matrix<weight, 2> output(input.rows, num_hidden);
+
+        this->pre_activations(output.memory_start(), input);
+
+        host_written(output);
+
+        activate_inplace<F, false>(output);
+
+        return output;
+    }
+};
+
+/*!
+ * \brief Binary state of a dense layer, computing the output of the
+ * network (a classifier on top of binary RBMs) from bits
+ */
+template <typename Desc, bool Xnor>
+struct binary_layer<dense_layer_impl<Desc>, Xnor> : binary_weights<dense_layer_impl<Desc>, Xnor> {
+    using layer_t   = dense_layer_impl<Desc>;         ///< The layer
+    using base_type = binary_weights<layer_t, Xnor>; ///< The base type
+    using weight    = typename layer_t::weight;       ///< The data type of the layer
+
+    static constexpr bool supported = true;  ///< Indicates if the layer can be computed on bits
+    static constexpr bool packing   = false; ///< Indicates if the layer packs its input to bits
+    static constexpr bool output    = true;  ///< Indicates if the layer can compute the output of the network
+
+    using base_type::base_type;
+    using base_type::num_hidden;
+
+    /*!
+     * \brief Compute the activations of the given batch of bits
+     */
+    etl::dyn_matrix<weight, 2> forward_output(const bit_batch& input) const {
+        etl::dyn_matrix<weight, 2> output(input.rows, num_hidden);
+
+        // The biases are part of the pre-activations, even with no_bias (they stay zero)
+        this->pre_activations(output.memory_start(), input);
+
+        host_written(output);
+
+        activate_inplace<layer_t::activation_function, layer_t::fast_math>(output);
+
+        return output;
+    }
+};
+
+namespace binary_detail {
+
+template <typename DBN, bool Xnor, typename Sequence>
+struct binary_layers;
+
+/*!
+ * \brief Helper to build the binary state of all the layers of a network
+ */
+template <typename DBN, bool Xnor, size_t... I>
+struct binary_layers<DBN, Xnor, std::index_sequence<I...>> {
+    using type = std::tuple<binary_layer<typename DBN::template layer_type<I>, Xnor>...>; ///< The tuple of binary layers
+
+    /*!
+     * \brief Create the binary state of all the layers of the given network
+     */
+    static type make(const DBN& dbn) {
+        return type(binary_layer<typename DBN::template layer_type<I>, Xnor>(dbn.template layer_get<I>())...);
+    }
+};
+
+} //end of namespace binary_detail
+
+/*!
+ * \brief A bit-packed binary view of a trained stack of binary RBMs, for
+ * inference.
+ *
+ * The input of the network is thresholded to bits (at 0.5, or at the
+ * threshold of a first binarize layer), each RBM computes its binary
+ * hidden units from the bits of its input and the last layer, an RBM or
+ * a dense classifier, computes the output of the network in floating
+ * point.
+ *
+ * The hidden units of the intermediate layers are thresholded instead
+ * of being propagated as probabilities, the outputs are therefore an
+ * approximation of the outputs of the network.
+ *
+ * The network must outlive its binary view and the view must be created
+ * again after the network has been trained.
+ *
+ * \tparam Xnor Indicates if the weights are binarized too
+ */
+template <typename DBN, bool Xnor = false>
+struct binary_dbn {
+    using dbn_t     = DBN;                       ///< The network type
+    using weight    = typename dbn_t::weight;    ///< The data type of the network
+    using metrics_t = typename dbn_t::metrics_t; ///< The evaluation metrics
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using binary_layers_t = typename binary_detail::binary_layers<dbn_t, Xnor, std::make_index_sequence<layers>>::type; ///< The binary layers
+
+private:
+    template <size_t L>
+    using binary_layer_t = std::tuple_element_t<L, binary_layers_t>;
+
+    static constexpr bool packing = binary_layer_t<0>::supported && binary_layer_t<0>::packing; ///< Indicates if the first layer packs the input
+
+    dbn_t& dbn;                    ///< The network
+    binary_layers_t binary_layers; ///< The binary state of the layers
+
+public:
+    /*!
+     * \brief Create the binary view of the given network
+     * \param dbn The network
+     */
+    explicit binary_dbn(dbn_t& dbn)
+            : dbn(dbn), binary_layers(binary_detail::binary_layers<dbn_t, Xnor, std::make_index_sequence<layers>>::make(dbn)) {
+        static_assert(layers > (packing ? 1 : 0), "The binary inference needs at least one layer with weights");
+
+        validate_layers<0>();
+    }
+
+    /*!
+     * \brief Return the output of the network for the given input batch.
+     * \param batch The input batch
+     * \return The output batch of the last layer of the network
+     */
+    template <typename Input>
+    etl::dyn_matrix<weight, 2> forward_batch(const Input& batch) const {
+        bit_batch bits;
+
+        cpp::static_if<packing>([&](auto f) {
+            std::get<0>(f(binary_layers)).pack(bits, batch);
+        }).else_([&](auto f) {
+            bits.pack(f(batch), weight(0.5));
+        });
+
+        return forward_bits_impl<packing ? 1 : 0>(bits);
+    }
+
+    /*!
+     * \brief Return the output of the network for the given sample.
+     * \param sample The input sample
+     * \return The output of the last layer of the network
+     */
+    template <typename Sample>
+    etl::dyn_vector<weight> features(const Sample& sample) const {
+        etl::dyn_matrix<weight, 2> batch(1, etl::size(sample));
+
+        decltype(auto) in = direct_memory(sample);
+
+        host_read(in);
+
+        std::copy(in.memory_start(), in.memory_start() + etl::size(sample), batch.memory_start());
+
+        host_written(batch);
+
+        auto output = forward_batch(batch);
+
+        etl::dyn_vector<weight> result(etl::dim<1>(output));
+        result = output(0);
+
+        return result;
+    }
+
+    /*!
+     * \brief Evaluate the binary network on the given classification task
+     * and return the evaluation metrics.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics(Generator& generator) {
+        auto forward_helper = [this](auto&& input_batch) {
+            return this->forward_batch(input_batch);
+        };
+
+        return dbn.evaluate_metrics(generator, forward_helper);
+    }
+
+private:
+    template <size_t L, cpp_enable_iff((L == layers))>
+    void validate_layers() const {}
+
+    template <size_t L, cpp_enable_iff((L < layers))>
+    void validate_layers() const {
+        static_assert(binary_layer_t<L>::supported, "The layer is not supported by the binary inference");
+        static_assert(L == 0 || !binary_layer_t<L>::packing, "Only the first layer can binarize the input");
+        static_assert(L + 1 < layers || binary_layer_t<L>::output, "The last layer must compute the output from bits");
+
+        validate_layers<L + 1>();
+    }
+
+    template <size_t L, cpp_enable_iff((L + 1 == layers))>
+    etl::dyn_matrix<weight, 2> forward_bits_impl(const bit_batch& input) const {
+        return std::get<L>(binary_layers).forward_output(input);
+    }
+
+    template <size_t L, cpp_enable_iff((L + 1 < layers))>
+    etl::dyn_matrix<weight, 2> forward_bits_impl(const bit_batch& input) const {
+        bit_batch next;
+
+        std::get<L>(binary_layers).forward_bits(next, input);
+
+        return forward_bits_impl<L + 1>(next);
+    }
+};
+
+/*!
+ * \brief Create a bit-packed binary view of the given stack of binary RBMs
+ * for inference
+ * \tparam Xnor Indicates if the weights are binarized too
+ * \param dbn The network
+ * \return A binary view of the network
+ */
+template <bool Xnor = false, typename DBN>
+binary_dbn<DBN, Xnor> binarize(DBN& dbn) {
+    return binary_dbn<DBN, Xnor>(dbn);
+}
+
+} //end of dll namespace
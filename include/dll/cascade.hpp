@@ -0,0 +1,264 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference of a cascade of networks of increasing costs.
+ *
+ * All the samples are predicted by the first (cheapest) network of the
+ * cascade, by batches. The samples whose confidence (the maximum output of
+ * the network) is below the threshold of the stage are escalated: they are
+ * compacted into new batches for the next network. The last network
+ * predicts all the samples it receives.
+ *
+ * The cascade only references the networks, which must outlive it.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <numeric>
+#include <iostream>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/chunk.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of one stage of a cascade
+ */
+struct cascade_stage_stats {
+    size_t samples   = 0;   ///< The number of samples predicted by the network of the stage
+    size_t escalated = 0;   ///< The number of samples escalated to the next stage
+    double seconds   = 0.0; ///< The time spent in the stage
+
+    /*!
+     * \brief Return the number of samples computed per second by the stage
+     */
+    double throughput() const {
+        return seconds > 0.0 ? samples / seconds : 0.0;
+    }
+
+    /*!
+     * \brief Return the fraction of the samples of the stage escalated to the next stage
+     */
+    double escalated_fraction() const {
+        return samples ? double(escalated) / samples : 0.0;
+    }
+};
+
+/*!
+ * \brief A cascade of networks, each stage only predicting the samples
+ * the previous stages were not confident about.
+ */
+template <typename... DBN>
+struct cascade {
+    static_assert(sizeof...(DBN) > 1, "A cascade needs at least two networks");
+
+    using first_t = std::tuple_element_t<0, std::tuple<DBN...>>; ///< The type of the first network
+    using weight  = typename first_t::weight;                     ///< The data type of the cascade
+
+    static constexpr size_t stages = sizeof...(DBN); ///< The number of networks
+
+    std::array<double, stages - 1> thresholds;      ///< The confidence from which each stage (but the last) predicts a sample
+    std::array<cascade_stage_stats, stages> stats; ///< The statistics of each stage since the last reset
+
+    /*!
+     * \brief Create a cascade of the given networks, from the cheapest to
+     * the most expensive, with the same threshold for all the stages
+     */
+    explicit cascade(const DBN&... dbn) : networks(dbn...) {
+        thresholds.fill(0.9);
+    }
+
+    /*!
+     * \brief Predict the labels of the given range of samples.
+     *
+     * The samples are staged in batches of the batch size of each network,
+     * the batches of a stage being computed in parallel. The iterators must
+     * be random access.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \return the predicted label of each sample
+     */
+    template <typename Iterator>
+    std::vector<size_t> predict_many(const Iterator& first, const Iterator& last) {
+        dll::auto_timer timer("cascade:predict_many");
+
+        const size_t n = std::distance(first, last);
+
+        std::vector<size_t> predicted(n);
+
+        std::vector<size_t> index(n);
+        std::iota(index.begin(), index.end(), 0);
+
+        run_stage<0>(first, index, predicted);
+
+        return predicted;
+    }
+
+    /*!
+     * \copydoc predict_many
+     */
+    template <typename Samples>
+    std::vector<size_t> predict_many(const Samples& samples) {
+        return predict_many(samples.begin(), samples.end());
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     * \param sample The sample to predict the label for
+     * \return the predicted label
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) {
+        return predict_many(&sample, &sample + 1)[0];
+    }
+
+    /*!
+     * \brief Return the fraction of the samples escalated from the first
+     * stage, since the last reset
+     */
+    double escalated_fraction() const {
+        return stats[0].escalated_fraction();
+    }
+
+    /*!
+     * \brief Reset the statistics of the stages
+     */
+    void reset_stats() {
+        stats.fill(cascade_stage_stats());
+    }
+
+    /*!
+     * \brief Display the statistics of the stages on the given stream
+     */
+    std::ostream& display_stats(std::ostream& stream) const {
+        for (size_t s = 0; s < stages; ++s) {
+            stream << "Stage " << s << ": " << stats[s].samples << " samples, " << stats[s].throughput() << " samples/s";
+
+            if (s + 1 < stages) {
+                stream << ", " << 100.0 * stats[s].escalated_fraction() << "% escalated";
+            }
+
+            stream << std::endl;
+        }
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display the statistics of the stages on the standard output
+     */
+    void display_stats() const {
+        display_stats(std::cout);
+    }
+
+private:
+    std::tuple<const DBN&...> networks; ///< The networks of the cascade
+
+    /*!
+     * \brief Predict the given samples with the network of the stage I and
+     * escalate the unconfident ones to the next stage
+     * \param first Iterator to the first sample of the range
+     * \param index The index of the samples of the stage in the range
+     * \param predicted The predictions
+     */
+    template <size_t I, typename Iterator, cpp_enable_iff((I < stages))>
+    void run_stage(const Iterator& first, const std::vector<size_t>& index, std::vector<size_t>& predicted) {
+        if (index.empty()) {
+            return;
+        }
+
+        auto& network = std::get<I>(networks);
+
+        using network_t = std::decay_t<decltype(network)>;
+        using input_t   = std::decay_t<decltype(*first)>;
+
+        constexpr size_t B = network_t::batch_size;
+
+        const bool last = I + 1 == stages;
+        const double threshold = last ? 0.0 : thresholds[last ? 0 : I];
+
+        const size_t n      = index.size();
+        const size_t chunks = (n + B - 1) / B;
+
+        // The escalated samples of each chunk, merged in order
+        std::vector<std::vector<size_t>> escalated(chunks);
+
+        auto start = std::chrono::steady_clock::now();
+
+        parallel_for_n(chunks, [&](size_t c) {
+            const size_t m = std::min(size_t(B), n - c * B);
+
+            auto input = chunk_detail::make_chunk<weight>(m, *first, std::make_index_sequence<etl::decay_traits<input_t>::dimensions()>());
+
+            for (size_t i = 0; i < m; ++i) {
+                input(i) = *std::next(first, index[c * B + i]);
+            }
+
+            decltype(auto) output = network.forward_batch(input);
+
+            dll::host_read(output);
+
+            const size_t K   = etl::size(output) / m;
+            const auto* data = output.memory_start();
+
+            for (size_t i = 0; i < m; ++i) {
+                const auto* row  = data + i * K;
+                const auto* best = std::max_element(row, row + K);
+
+                if (*best >= threshold) {
+                    predicted[index[c * B + i]] = std::distance(row, best);
+                } else {
+                    escalated[c].push_back(index[c * B + i]);
+                }
+            }
+        });
+
+        std::vector<size_t> next;
+
+        for (auto& part : escalated) {
+            next.insert(next.end(), part.begin(), part.end());
+        }
+
+        auto& stage = stats[I];
+
+        stage.samples += n;
+        stage.escalated += next.size();
+        stage.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        run_stage<I + 1>(first, next, predicted);
+    }
+
+    /*!
+     * \brief Stop after the last stage
+     */
+    template <size_t I, typename Iterator, cpp_enable_iff((I == stages))>
+    void run_stage(const Iterator& /*first*/, const std::vector<size_t>& /*index*/, std::vector<size_t>& /*predicted*/) {}
+};
+
+/*!
+ * \brief Create a cascade of the given networks, from the cheapest to the
+ * most expensive
+ */
+template <typename... DBN>
+cascade<DBN...> make_cascade(const DBN&... dbn) {
+    return cascade<DBN...>(dbn...);
+}
+
+} //end of dll namespace
@@ -0,0 +1,227 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Checkpoints of the fine-tuning, written in the background.
+ *
+ * A checkpoint is a copy of the parameters of the network in the model
+ * file format. The copy is taken on the training thread, in a staging
+ * buffer, and written to the disk by a background task of the scheduler
+ * while the training continues. The file is written under a temporary
+ * name and renamed once complete, then the index file (prefix.latest)
+ * is updated, so that a preempted job always finds a complete
+ * checkpoint. Only the last checkpoints are kept on the disk.
+ *
+ * The state of the training (the state of the updaters, the counter of
+ * iterations and the momentum) is written in a second file (.state), so
+ * that a resumed training continues on the same trajectory.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <deque>
+#include <iterator>
+#include <future>
+
+#include "dll/model_file.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Manager of the checkpoints of a fine-tuning
+ */
+struct checkpoint_manager {
+    size_t epoch_period = 1; ///< The period, in epochs, of the checkpoints (0 to disable)
+    size_t batch_period = 0; ///< The period, in batches, of the checkpoints inside an epoch (0 to disable)
+    size_t keep         = 3; ///< The number of checkpoints kept on the disk
+
+    size_t first_epoch = 0; ///< The first epoch to train, set when resuming from a checkpoint
+    std::string state;      ///< The state of the training read from the checkpoint, consumed by the trainer
+
+    /*!
+     * \brief Create a manager writing its checkpoints with the given prefix
+     * \param prefix The prefix of the path of the checkpoint files
+     */
+    explicit checkpoint_manager(std::string prefix) : prefix(std::move(prefix)) {}
+
+    checkpoint_manager(const checkpoint_manager& rhs) = delete;
+    checkpoint_manager& operator=(const checkpoint_manager& rhs) = delete;
+
+    /*!
+     * \brief Wait for the checkpoint being written, if any
+     */
+    ~checkpoint_manager() {
+        wait();
+    }
+
+    /*!
+     * \brief Take a checkpoint of the network and write it in background.
+     *
+     * The previous checkpoint must have been written before its staging
+     * buffer is reused, the training only waits for it if the writes are
+     * slower than the period of the checkpoints.
+     *
+     * \param dbn The network
+     * \param epoch The epoch to resume from
+     * \param batch The batch of the epoch the checkpoint is taken after (0 at the end of an epoch)
+     * \param training_state The serialized state of the training, if any
+     */
+    template <typename DBN>
+    void snapshot(const DBN& dbn, size_t epoch, size_t batch = 0, std::string training_state = std::string()) {
+        dll::auto_timer timer("checkpoint:snapshot");
+
+        wait();
+
+        std::ostringstream os(std::ostringstream::binary);
+
+        if (!store_model(dbn, os)) {
+            std::cerr << "ERROR: Impossible to take a checkpoint of the network" << std::endl;
+            return;
+        }
+
+        staging       = os.str();
+        staging_state = std::move(training_state);
+
+        const std::string path = prefix + "." + std::to_string(epoch) + "." + std::to_string(batch) + ".dllm";
+
+        writer = scheduler().submit_background([this, path, epoch] {
+            write(path, epoch);
+        });
+    }
+
+    /*!
+     * \brief Wait for the checkpoint being written, if any
+     */
+    void wait() {
+        if (writer.valid()) {
+            writer.get();
+        }
+    }
+
+    /*!
+     * \brief Returns the path of the last complete checkpoint, or an empty
+     * string if there is none
+     */
+    std::string latest() const {
+        size_t epoch;
+        std::string path;
+
+        return read_index(epoch, path) ? path : std::string();
+    }
+
+    /*!
+     * \brief Load the last complete checkpoint into the network and set
+     * the first epoch to train accordingly.
+     *
+     * A checkpoint taken inside an epoch resumes at the beginning of this
+     * epoch.
+     *
+     * \return true if a checkpoint has been loaded, false otherwise
+     */
+    template <typename DBN>
+    bool resume(DBN& dbn) {
+        size_t epoch;
+        std::string path;
+
+        if (!read_index(epoch, path)) {
+            return false;
+        }
+
+        if (!load_model(dbn, path)) {
+            return false;
+        }
+
+        // A checkpoint without state resumes with fresh updaters
+        std::ifstream is(path + ".state", std::ifstream::binary);
+        state.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+
+        first_epoch = epoch;
+
+        return true;
+    }
+
+private:
+    /*!
+     * \brief Read the epoch and the path of the last complete checkpoint
+     * from the index file
+     */
+    bool read_index(size_t& epoch, std::string& path) const {
+        std::ifstream is(prefix + ".latest");
+
+        if (!(is >> epoch) || is.get() != ' ' || !std::getline(is, path)) {
+            return false;
+        }
+
+        return !path.empty();
+    }
+
+    /*!
+     * \brief Write the staging buffer and rotate the checkpoints
+     */
+    void write(const std::string& path, size_t epoch) {
+        const std::string tmp = path + ".tmp";
+
+        {
+            std::ofstream os(tmp, std::ofstream::binary);
+            os.write(staging.data(), staging.size());
+
+            if (!os) {
+                std::cerr << "ERROR: Impossible to write the checkpoint " << path << std::endl;
+                return;
+            }
+        }
+
+        // The state is complete before the parameters are renamed
+        if (!staging_state.empty()) {
+            std::ofstream os(path + ".state", std::ofstream::binary);
+            os.write(staging_state.data(), staging_state.size());
+
+            if (!os) {
+                std::cerr << "ERROR: Impossible to write the state of the checkpoint " << path << std::endl;
+                return;
+            }
+        }
+
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "ERROR: Impossible to rename the checkpoint " << tmp << std::endl;
+            return;
+        }
+
+        // The index only references complete checkpoints
+        {
+            std::ofstream os(prefix + ".latest.tmp");
+            os << epoch << " " << path << std::endl;
+        }
+
+        std::rename((prefix + ".latest.tmp").c_str(), (prefix + ".latest").c_str());
+
+        written.push_back(path);
+
+        while (written.size() > std::max<size_t>(keep, 1)) {
+            std::remove(written.front().c_str());
+            std::remove((written.front() + ".state").c_str());
+            written.pop_front();
+        }
+    }
+
+    const std::string prefix;        ///< The prefix of the checkpoint files
+    std::string staging;             ///< The copy of the network being written
+    std::string staging_state;       ///< The copy of the state of the training being written
+    std::deque<std::string> written; ///< The checkpoints written on the disk, from the oldest
+    std::future<void> writer;        ///< The background task writing the staging buffer
+};
+
+} //end of dll namespace
@@ -0,0 +1,45 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief The compression of the gradients exchanged during distributed
+ * training
+ */
+enum class compression_type {
+    NONE,     ///< The gradients are exchanged uncompressed
+    TOP_K,    ///< Only the largest gradients (in magnitude) are exchanged
+    ONE_BIT,  ///< Only the signs of the gradients are exchanged, with a common scale
+    EIGHT_BIT ///< The gradients are quantized on 8 bits
+};
+
+/*!
+ * \brief Returns a string representation of a compression type
+ * \param c The compression type to transform to string
+ * \return a string representation of a compression type
+ */
+inline std::string to_string(compression_type c) {
+    switch (c) {
+        case compression_type::NONE:
+            return "NONE";
+        case compression_type::TOP_K:
+            return "TOP_K";
+        case compression_type::ONE_BIT:
+            return "ONE_BIT";
+        case compression_type::EIGHT_BIT:
+            return "EIGHT_BIT";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
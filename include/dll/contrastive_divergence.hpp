@@ -27,6 +27,13 @@
 #include "decay_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
+#include "util/sparse.hpp"
+#include "util/block_sparse.hpp"
+#include "util/counter_rng.hpp"
+#include "util/gibbs.hpp"
+#include "util/cd_gradients.hpp"
+#include "util/conv_engine.hpp"
+#include "rbm/crbm_kernels.hpp"
 
 namespace dll {
 
@@ -108,15 +115,17 @@ void update_normal(RBM& rbm, Trainer& t) {
 
         f(t).q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
+        auto q_local_penalty = etl::force_temporary(cost * (t.q_local_t - p));
 
         f(t).b_grad -= q_local_penalty;
 
-        for (size_t i = 0; i < num_hidden(rbm); ++i) {
-            for (size_t j = 0; j < num_visible(rbm); ++j) {
-                f(t).w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
+        // The penalty of each hidden unit is subtracted from its column
+        dll::host_read(q_local_penalty);
+        dll::host_read(t.w_grad);
+
+        subtract_penalty(f(t).w_grad.memory_start(), q_local_penalty.memory_start(), num_visible(rbm), num_hidden(rbm), false);
+
+        dll::host_written(t.w_grad);
     });
 
     //TODO the batch is not necessary full!
@@ -153,6 +162,9 @@ void update_normal(RBM& rbm, Trainer& t) {
         f(rbm).c += eps * t.c_grad;
     });
 
+    // The removed blocks of block-sparse weights stay at zero
+    mask_blocks(rbm);
+
     //Check for NaN
     nan_check_deep_3(rbm.w, rbm.b, rbm.c);
 }
@@ -198,16 +210,17 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
         f(t).q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
+        auto k_penalty = etl::force_temporary(sum_r(cost * (t.q_local_t - p)));
 
-        f(t).b_grad -= sum_r(q_local_penalty);
+        f(t).b_grad -= k_penalty;
 
-        const auto K   = get_k(rbm);
+        // The penalty of each filter is subtracted from all its weights
+        dll::host_read(k_penalty);
+        dll::host_read(t.w_grad);
 
-        auto k_penalty = sum_r(q_local_penalty);
-        for (size_t k = 0; k < K; ++k) {
-            f(t).w_grad(k) = t.w_grad(k) - k_penalty(k);
-        }
+        subtract_penalty(f(t).w_grad.memory_start(), k_penalty.memory_start(), get_k(rbm), etl::size(t.w_grad) / get_k(rbm), true);
+
+        dll::host_written(t.w_grad);
     });
 
     //Honglak Lee's sparsity method
@@ -249,9 +262,12 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
 /*!
  * \brief Compute the gradients for a fully-connected RBM
+ *
+ * \param stats The sums of the squared reconstruction errors and of the
+ * hidden probabilities of the negative phase, or nullptr
  */
 template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
-void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t, double* stats = nullptr) {
     dll::auto_timer timer("cd:gradients:normal:batch");
 
     cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
@@ -286,37 +302,81 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
         t.p_h_s = t.h1_s;
     }
 
-    //CD-1
-    cpp::static_if<Persistent>([&](auto f) {
-        f(rbm).template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        f(rbm).template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    // For CD-k on binary units, the K steps are fused and computed by tiles
+    // of the batch, without materializing the batches at each step
+    constexpr bool fused = K > 1 && RBM::visible_unit == unit_type::BINARY && RBM::hidden_unit == unit_type::BINARY;
+
+    cpp::static_if<fused>([&](auto f) {
+        dll::auto_timer timer("cd:gibbs:fused");
+
+        constexpr bool fast = RBM::desc::parameters::template contains<fast_math>();
+
+        const auto& h_in = Persistent ? f(t).p_h_s : f(t).h1_s;
+
+        fused_gibbs_binary<K, fast>(
+            rbm.w.memory_start(), rbm.b.memory_start(), rbm.c.memory_start(),
+            etl::dim<0>(t.v1), etl::dim<1>(t.v1), etl::dim<1>(t.h1_a),
+            h_in.memory_start(), f(t).v2_a.memory_start(), f(t).h2_a.memory_start(), f(t).h2_s.memory_start(), true);
     }).else_([&](auto f) {
-        f(rbm).template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        f(rbm).template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        //CD-1
+        cpp::static_if<Persistent>([&](auto g) {
+            g(f(rbm)).template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
+            g(f(rbm)).template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }).else_([&](auto g) {
+            g(f(rbm)).template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+            g(f(rbm)).template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        });
+
+        //CD-k
+        for (size_t k = 1; k < K; ++k) {
+            f(rbm).template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+            f(rbm).template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }
     });
 
-    //CD-k
-    for (size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
-
     //Compute the gradients
 
     {
         dll::auto_timer timer("cd:batch_compute_gradients:std");
 
-        t.w_grad = batch_outer(t.vf, t.h1_a);
-        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+        constexpr bool sparse = RBM::desc::parameters::template contains<sparse_input>();
+        constexpr bool relu   = RBM::desc::parameters::template contains<sparse_relu>() && is_relu(RBM::hidden_unit);
+
+        using T = etl::value_t<decltype(t.w_grad)>;
+
+        if (!sparse && !relu && fused_cd_gradients_enabled()) {
+            // Both phases in a single pass
+            fused_cd_gradients(
+                t.w_grad.memory_start(), t.b_grad.memory_start(), t.c_grad.memory_start(),
+                t.vf.memory_start(), t.h1_a.memory_start(), t.v2_a.memory_start(), t.h2_a.memory_start(),
+                B, etl::dim<1>(t.vf), etl::dim<1>(t.h1_a), stats);
+        } else {
+            // The reconstructions are dense, only the positive phase can have
+            // sparse inputs, the activations of the ReLU units of both phases
+            // can be sparse
+            if (!sparse || !sparse_batch_outer(t.w_grad, t.vf, t.h1_a)) {
+                if (!relu || !sparse_errors_outer(t.w_grad, t.vf, t.h1_a)) {
+                    t.w_grad = batch_outer(t.vf, t.h1_a);
+                }
+            }
 
-        t.b_grad = t.h1_a(0) - t.h2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.b_grad += t.h1_a(b) - t.h2_a(b);
-        }
+            if (!relu || !sparse_errors_outer(t.w_grad, t.v2_a, t.h2_a, T(-1), true)) {
+                t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+            }
 
-        t.c_grad = t.vf(0) - t.v2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.c_grad += t.vf(b) - t.v2_a(b);
+            t.b_grad = t.h1_a(0) - t.h2_a(0);
+            for (size_t b = 1; b < B; b++) {
+                t.b_grad += t.h1_a(b) - t.h2_a(b);
+            }
+
+            t.c_grad = t.vf(0) - t.v2_a(0);
+            for (size_t b = 1; b < B; b++) {
+                t.c_grad += t.vf(b) - t.v2_a(b);
+            }
+
+            if (stats) {
+                cd_statistics(t.vf.memory_start(), t.v2_a.memory_start(), t.h2_a.memory_start(), etl::size(t.vf), etl::size(t.h2_a), stats);
+            }
         }
     }
 }
@@ -332,7 +392,13 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
 
-    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
+    // The statistics are accumulated with the gradients, on the sampled
+    // batches and when the global sparsity needs them
+    const bool statistics = context.statistics || rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET;
+
+    double stats[2];
+
+    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t, statistics ? stats : nullptr);
 
     if (Persistent) {
         t.p_h_a = t.h2_a;
@@ -341,19 +407,20 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
         t.init = false;
     }
 
-    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
-
     nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
 
     //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    if (statistics) {
+        t.q_global_batch = stats[1] / etl::size(t.h2_a);
+
+        context.batch_error    = stats[0] / etl::size(t.vf);
+        context.batch_sparsity = t.q_global_batch;
+    }
 
     cpp::static_if<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
         f(t).q_local_batch = mean_l(t.h2_a);
     });
 
-    context.batch_sparsity = t.q_global_batch;
-
     //Update the weights and biases based on the gradients
     t.update(rbm);
 }
@@ -410,8 +477,25 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
     {
         dll::auto_timer timer("cd:batch_compute_gradients_conv");
 
-        t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
-        t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
+        const auto a = resolve_conv_algorithm(RBM::desc::engine, etl::dim<2>(t.w_grad), etl::dim<3>(t.w_grad));
+
+        if (a == conv_algorithm::DIRECT && (fused_cd_gradients_enabled() || RBM::desc::engine == conv_algorithm::AUTO)) {
+            // Both phases in a single pass
+            crbm_detail::weight_gradients(
+                etl::dim<0>(t.vf), etl::dim<1>(t.vf), etl::dim<2>(t.vf), etl::dim<3>(t.vf),
+                etl::dim<1>(t.h1_a), etl::dim<2>(t.h1_a), etl::dim<3>(t.h1_a),
+                t.vf.memory_start(), t.h1_a.memory_start(), t.v2_a.memory_start(), t.h2_a.memory_start(), t.w_grad.memory_start());
+        } else {
+            if (a == conv_algorithm::DIRECT) {
+                t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
+                t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
+            } else {
+                conv_engine_backward_filter(RBM::desc::engine, t.w_pos, t.vf, t.h1_a);
+                conv_engine_backward_filter(RBM::desc::engine, t.w_neg, t.v2_a, t.h2_a);
+            }
+
+            t.w_grad = t.w_pos - t.w_neg;
+        }
     }
 }
 
@@ -434,7 +518,6 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
     }
 
     //Compute the gradients
-    t.w_grad = t.w_pos - t.w_neg;
     t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
     t.c_grad = mean_r(sum_l(t.vf - t.v2_a));
 
@@ -442,8 +525,19 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
     nan_check_deep(t.b_grad);
     nan_check_deep(t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    //Compute the mean activation probabilities and the error in one pass
+    const bool statistics = context.statistics || rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET;
+
+    if (statistics) {
+        double stats[2];
+
+        cd_statistics(t.vf.memory_start(), t.v2_a.memory_start(), t.h2_a.memory_start(), etl::size(t.vf), etl::size(t.h2_a), stats);
+
+        t.q_global_batch = stats[1] / etl::size(t.h2_a);
+
+        context.batch_error    = stats[0] / etl::size(t.vf);
+        context.batch_sparsity = t.q_global_batch;
+    }
 
     cpp::static_if<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
         f(t).q_local_batch = mean_l(t.h2_a);
@@ -456,12 +550,6 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
         f(t).b_bias = mean_r(mean_l(t.h2_a)) - rbm.pbias;
     });
 
-    //Accumulate the sparsity
-    context.batch_sparsity = t.q_global_batch;
-
-    //Accumulate the error
-    context.batch_error = mean(etl::scale((t.vf - t.v2_a), (t.vf - t.v2_a)));
-
     //Update the weights and biases based on the gradients
     t.update(rbm);
 }
@@ -954,4 +1042,373 @@ using cd1_trainer_t = cd_trainer<1, RBM>;
 template <typename RBM>
 using pcd1_trainer_t = persistent_cd_trainer<1, RBM>;
 
+/*!
+ * \brief Copy the given batch into the input and expected batches of the
+ * trainer, padding incomplete batches with zeroes.
+ */
+template <typename InputBatch, typename ExpectedBatch, typename Trainer>
+void copy_normal_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, Trainer& t) {
+    const size_t IB = etl::dim<0>(input_batch);
+
+    if (cpp_likely(IB == etl::dim<0>(t.v1))) {
+        t.v1 = input_batch;
+        t.vf = expected_batch;
+    } else {
+        t.v1 = 0;
+        t.vf = 0;
+
+        etl::slice(t.v1, 0, IB) = input_batch;
+        etl::slice(t.vf, 0, IB) = expected_batch;
+    }
+}
+
+/*!
+ * \brief Compute the gradients from the positive phase of the trainer and
+ * the given negative particles.
+ *
+ * The negative statistics are scaled to the size of the batch, the
+ * number of particles being independent of it.
+ */
+template <typename Trainer, typename NV, typename NH>
+void compute_particles_gradients(Trainer& t, const NV& n_v, const NH& n_h) {
+    using weight = typename Trainer::weight;
+
+    const size_t B = etl::dim<0>(t.v1);
+    const size_t P = etl::dim<0>(n_v);
+
+    const weight ratio = weight(B) / weight(P);
+
+    constexpr bool relu = Trainer::rbm_t::desc::parameters::template contains<sparse_relu>() && is_relu(Trainer::rbm_t::hidden_unit);
+
+    if (!Trainer::rbm_t::desc::parameters::template contains<sparse_input>() || !sparse_batch_outer(t.w_grad, t.vf, t.h1_a)) {
+        if (!relu || !sparse_errors_outer(t.w_grad, t.vf, t.h1_a)) {
+            t.w_grad = batch_outer(t.vf, t.h1_a);
+        }
+    }
+
+    t.w_grad -= ratio * batch_outer(n_v, n_h);
+
+    t.b_grad = t.h1_a(0);
+    t.c_grad = t.vf(0);
+
+    for (size_t b = 1; b < B; ++b) {
+        t.b_grad += t.h1_a(b);
+        t.c_grad += t.vf(b);
+    }
+
+    for (size_t p = 0; p < P; ++p) {
+        t.b_grad -= ratio * n_h(p);
+        t.c_grad -= ratio * n_v(p);
+    }
+}
+
+/*!
+ * \brief Persistent Contrastive Divergence with a number of persistent
+ * chains (fantasy particles) independent of the batch size.
+ *
+ * All the chains are advanced together, as one batch, at each step of the
+ * training, so that the extra chains are spread over the cores by the
+ * parallel kernels instead of growing the minibatch.
+ *
+ * \tparam K The number of Gibbs steps per batch
+ * \tparam Particles The number of persistent chains
+ */
+template <size_t K, size_t Particles, typename RBM>
+struct pcd_chains_trainer : base_cd_trainer<K, RBM, true> {
+    static_assert(Particles > 0, "PCD needs at least one persistent chain");
+    static_assert(!layer_traits<RBM>::is_convolutional_rbm_layer(), "pcd_chains_trainer only supports dense RBM");
+
+    using base_type = base_cd_trainer<K, RBM, true>; ///< The base trainer
+    using rbm_t     = RBM;                          ///< The type of RBM being trained
+    using weight    = typename rbm_t::weight;       ///< The data type for this layer
+
+    etl::dyn_matrix<weight> pv_a; ///< The visible activations of the chains
+    etl::dyn_matrix<weight> pv_s; ///< The visible samples of the chains
+    etl::dyn_matrix<weight> ph_a; ///< The hidden activations of the chains
+    etl::dyn_matrix<weight> ph_s; ///< The hidden samples of the chains
+
+    explicit pcd_chains_trainer(rbm_t& rbm)
+            : base_type(rbm),
+              pv_a(Particles, rbm.num_visible),
+              pv_s(Particles, rbm.num_visible),
+              ph_a(Particles, rbm.num_hidden),
+              ph_s(Particles, rbm.num_hidden) {}
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        dll::auto_timer timer("cd:train:pcd_chains");
+
+        auto& rbm = this->rbm;
+
+        copy_normal_batch(input_batch, expected_batch, *this);
+
+        //Positive phase
+        rbm.template batch_activate_hidden<true, true>(this->h1_a, this->h1_s, this->v1, this->v1);
+
+        //The chains start from the first samples
+        if (this->init) {
+            const size_t B = etl::dim<0>(this->v1);
+
+            for (size_t p = 0; p < Particles; ++p) {
+                pv_a(p) = this->v1(p % B);
+                ph_a(p) = this->h1_a(p % B);
+                ph_s(p) = this->h1_s(p % B);
+            }
+
+            this->init = false;
+        }
+
+        //Negative phase, on the persistent chains
+        for (size_t k = 0; k < K; ++k) {
+            rbm.template batch_activate_visible<true, true>(ph_a, ph_s, pv_a, pv_s);
+            rbm.template batch_activate_hidden<true, true>(ph_a, ph_s, pv_a, pv_s);
+        }
+
+        compute_particles_gradients(*this, pv_a, ph_a);
+
+        //The reconstruction error is computed on the batch
+        rbm.template batch_activate_visible<true, false>(this->h1_a, this->h1_s, this->v2_a, this->v2_s);
+
+        nan_check_deep_3(this->w_grad, this->b_grad, this->c_grad);
+
+        // The error on the batch and the sparsity of the chains in one pass
+        if (context.statistics || rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET) {
+            double stats[2];
+
+            cd_statistics(this->vf.memory_start(), this->v2_a.memory_start(), ph_a.memory_start(), etl::size(this->vf), etl::size(ph_a), stats);
+
+            this->q_global_batch = stats[1] / etl::size(ph_a);
+
+            context.batch_error    = stats[0] / etl::size(this->vf);
+            context.batch_sparsity = this->q_global_batch;
+        }
+
+        cpp::static_if<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
+            f(this)->q_local_batch = etl::mean_l(ph_a);
+        });
+
+        this->update(rbm);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "Persistent Contrastive Divergence (" + std::to_string(Particles) + " chains)";
+    }
+};
+
+/*!
+ * \brief Parallel Tempering trainer for binary RBM.
+ *
+ * Each temperature has its own persistent chains, the inverse
+ * temperatures being 1, 1 - 1/T, ..., 1/T. After each Gibbs step, the
+ * states of the chains of adjacent temperatures are swapped with the
+ * Metropolis acceptance probability, the even and odd pairs of
+ * temperatures alternating between the batches. The negative statistics
+ * are computed from the chains at temperature 1.
+ *
+ * \tparam Particles The number of chains per temperature
+ * \tparam Temperatures The number of temperatures
+ */
+template <size_t Particles, size_t Temperatures, typename RBM>
+struct pt_trainer : base_cd_trainer<1, RBM, true> {
+    static_assert(Particles > 0, "Parallel Tempering needs at least one chain per temperature");
+    static_assert(Temperatures > 1, "Parallel Tempering needs at least two temperatures");
+    static_assert(!layer_traits<RBM>::is_convolutional_rbm_layer(), "pt_trainer only supports dense RBM");
+    static_assert(RBM::visible_unit == unit_type::BINARY && RBM::hidden_unit == unit_type::BINARY, "pt_trainer only supports binary units");
+
+    using base_type = base_cd_trainer<1, RBM, true>; ///< The base trainer
+    using rbm_t     = RBM;                          ///< The type of RBM being trained
+    using weight    = typename rbm_t::weight;       ///< The data type for this layer
+
+    static constexpr size_t chains = Particles * Temperatures; ///< The total number of chains
+
+    etl::dyn_vector<weight> beta; ///< The inverse temperature of each chain
+
+    etl::dyn_matrix<weight> pv_a; ///< The visible activations of the chains
+    etl::dyn_matrix<weight> pv_s; ///< The visible samples of the chains
+    etl::dyn_matrix<weight> ph_a; ///< The hidden activations of the chains
+    etl::dyn_matrix<weight> ph_s; ///< The hidden samples of the chains
+
+    etl::dyn_matrix<weight> n_v; ///< The visible samples of the chains at temperature 1
+    etl::dyn_matrix<weight> n_h; ///< The hidden activations of the chains at temperature 1
+
+    size_t swap_parity = 0; ///< The parity of the pairs of temperatures to swap
+
+    explicit pt_trainer(rbm_t& rbm)
+            : base_type(rbm),
+              beta(chains),
+              pv_a(chains, rbm.num_visible),
+              pv_s(chains, rbm.num_visible),
+              ph_a(chains, rbm.num_hidden),
+              ph_s(chains, rbm.num_hidden),
+              n_v(Particles, rbm.num_visible),
+              n_h(Particles, rbm.num_hidden) {
+        for (size_t c = 0; c < chains; ++c) {
+            beta[c] = weight(1) - weight(c / Particles) / weight(Temperatures);
+        }
+    }
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        dll::auto_timer timer("cd:train:pt");
+
+        auto& rbm = this->rbm;
+
+        copy_normal_batch(input_batch, expected_batch, *this);
+
+        //Positive phase
+        rbm.template batch_activate_hidden<true, true>(this->h1_a, this->h1_s, this->v1, this->v1);
+
+        //All the chains start from the first samples
+        if (this->init) {
+            const size_t B = etl::dim<0>(this->v1);
+
+            for (size_t c = 0; c < chains; ++c) {
+                pv_s(c) = this->v1((c % Particles) % B);
+            }
+
+            tempered_hidden();
+
+            this->init = false;
+        }
+
+        //Tempered Gibbs step
+        tempered_visible();
+        tempered_hidden();
+
+        swap_chains();
+
+        //Negative phase, on the chains at temperature 1
+        n_v = etl::slice(pv_s, 0, Particles);
+        n_h = etl::sigmoid(etl::rep_l(rbm.b, Particles) + n_v * rbm.w);
+
+        compute_particles_gradients(*this, n_v, n_h);
+
+        //The reconstruction error is computed on the batch
+        rbm.template batch_activate_visible<true, false>(this->h1_a, this->h1_s, this->v2_a, this->v2_s);
+
+        nan_check_deep_3(this->w_grad, this->b_grad, this->c_grad);
+
+        // The error on the batch and the sparsity of the chains in one pass
+        if (context.statistics || rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET) {
+            double stats[2];
+
+            cd_statistics(this->vf.memory_start(), this->v2_a.memory_start(), n_h.memory_start(), etl::size(this->vf), etl::size(n_h), stats);
+
+            this->q_global_batch = stats[1] / etl::size(n_h);
+
+            context.batch_error    = stats[0] / etl::size(this->vf);
+            context.batch_sparsity = this->q_global_batch;
+        }
+
+        cpp::static_if<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
+            f(this)->q_local_batch = etl::mean_l(n_h);
+        });
+
+        this->update(rbm);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "Parallel Tempering (" + std::to_string(Temperatures) + " temperatures, " + std::to_string(Particles) + " chains)";
+    }
+
+private:
+    /*!
+     * \brief Sample the hidden units of all the chains at their temperature
+     */
+    void tempered_hidden() {
+        ph_a = etl::rep_l(this->rbm.b, chains) + pv_s * this->rbm.w;
+
+        for (size_t c = 0; c < chains; ++c) {
+            ph_a(c) = etl::sigmoid(beta[c] * ph_a(c));
+        }
+
+        sample_bernoulli(ph_s, ph_a);
+    }
+
+    /*!
+     * \brief Sample the visible units of all the chains at their temperature
+     */
+    void tempered_visible() {
+        pv_a = etl::rep_l(this->rbm.c, chains) + etl::transpose(this->rbm.w * etl::transpose(ph_s));
+
+        for (size_t c = 0; c < chains; ++c) {
+            pv_a(c) = etl::sigmoid(beta[c] * pv_a(c));
+        }
+
+        sample_bernoulli(pv_s, pv_a);
+    }
+
+    /*!
+     * \brief Swap the states of the chains of adjacent temperatures with
+     * the Metropolis acceptance probabilities
+     */
+    void swap_chains() {
+        auto& rbm = this->rbm;
+
+        //E(v,h) = -c.v - b.h - v W h
+        etl::dyn_matrix<weight> vw(chains, rbm.num_hidden);
+        vw = pv_s * rbm.w;
+
+        etl::dyn_vector<weight> energy(chains);
+
+        for (size_t c = 0; c < chains; ++c) {
+            energy[c] = -etl::dot(rbm.c, pv_s(c)) - etl::dot(rbm.b, ph_s(c)) - etl::dot(vw(c), ph_s(c));
+        }
+
+        etl::dyn_vector<weight> u(chains);
+        next_rng().uniform(u.memory_start(), chains);
+
+        for (size_t t = swap_parity; t + 1 < Temperatures; t += 2) {
+            for (size_t p = 0; p < Particles; ++p) {
+                const size_t c1 = t * Particles + p;
+                const size_t c2 = (t + 1) * Particles + p;
+
+                const weight log_accept = (beta[c1] - beta[c2]) * (energy[c1] - energy[c2]);
+
+                if (log_accept >= weight(0) || u[c1] < std::exp(log_accept)) {
+                    swap_rows(pv_a, c1, c2);
+                    swap_rows(pv_s, c1, c2);
+                    swap_rows(ph_s, c1, c2);
+                    swap_rows(ph_a, c1, c2);
+                }
+            }
+        }
+
+        swap_parity = 1 - swap_parity;
+    }
+
+    /*!
+     * \brief Swap two rows of the given matrix
+     */
+    static void swap_rows(etl::dyn_matrix<weight>& m, size_t r1, size_t r2) {
+        const size_t n = etl::dim<1>(m);
+
+        std::swap_ranges(m.memory_start() + r1 * n, m.memory_start() + (r1 + 1) * n, m.memory_start() + r2 * n);
+    }
+};
+
+/*!
+ * \brief PCD-1 trainer for RBM with 100 persistent chains
+ */
+template <typename RBM>
+using pcd1_chains_trainer_t = pcd_chains_trainer<1, 100, RBM>;
+
+/*!
+ * \brief Parallel Tempering trainer for RBM with 10 temperatures of 10 chains
+ */
+template <typename RBM>
+using pt_trainer_t = pt_trainer<10, 10, RBM>;
+
 } //end of dll namespace
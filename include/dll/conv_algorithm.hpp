@@ -0,0 +1,69 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief The algorithm used to compute the convolutions of a layer
+ */
+enum class conv_algorithm {
+    DIRECT,   ///< Let ETL compute the convolutions
+    AUTO,     ///< Select the algorithm from the shape of the kernels
+    IM2COL,   ///< Unroll the input (im2col) and use matrix multiplications
+    WINOGRAD, ///< Winograd F(2x2, 3x3) (only for 3x3 kernels)
+    FFT,      ///< Products in the frequency domain (for large kernels)
+    AUTOTUNE  ///< Benchmark the algorithms once per shape and use the fastest
+};
+
+/*!
+ * \brief Returns a string representation of a convolution algorithm
+ * \param a The convolution algorithm to transform to string
+ * \return a string representation of a convolution algorithm
+ */
+inline std::string to_string(conv_algorithm a) {
+    switch (a) {
+        case conv_algorithm::DIRECT:
+            return "DIRECT";
+        case conv_algorithm::AUTO:
+            return "AUTO";
+        case conv_algorithm::IM2COL:
+            return "IM2COL";
+        case conv_algorithm::WINOGRAD:
+            return "WINOGRAD";
+        case conv_algorithm::FFT:
+            return "FFT";
+        case conv_algorithm::AUTOTUNE:
+            return "AUTOTUNE";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+/*!
+ * \brief Resolve the algorithm to use for kernels of the given size.
+ *
+ * AUTO selects Winograd for 3x3 kernels and FFT for kernels of 7x7 and
+ * more. Winograd falls back to ETL for the other kernels. AUTOTUNE is
+ * only resolved at runtime, by the convolution engine.
+ *
+ * \param a The configured algorithm
+ * \param w1 The first dimension of the kernels
+ * \param w2 The second dimension of the kernels
+ *
+ * \return The algorithm to use
+ */
+constexpr conv_algorithm resolve_conv_algorithm(conv_algorithm a, size_t w1, size_t w2) {
+    return a == conv_algorithm::AUTO
+               ? (w1 == 3 && w2 == 3 ? conv_algorithm::WINOGRAD : (w1 >= 7 && w2 >= 7 ? conv_algorithm::FFT : conv_algorithm::DIRECT))
+               : (a == conv_algorithm::WINOGRAD && !(w1 == 3 && w2 == 3) ? conv_algorithm::DIRECT : a);
+}
+
+} //end of dll namespace
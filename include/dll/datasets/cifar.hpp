@@ -7,10 +7,60 @@
 
 #pragma once
 
-#include "cifar/cifar10_reader.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "dll/util/mapped_file.hpp"
 
 namespace dll {
 
+namespace cifar_detail {
+
+/*!
+ * \brief Read the first n images and labels of the given CIFAR-10 batch
+ * files directly into the given caches
+ * \param images The image cache (at least n images)
+ * \param labels The categorical label cache (at least n labels)
+ * \param folder The folder in which the batch files are
+ * \param files The names of the batch files
+ * \param n The number of images to read
+ * \return true if the images were read, false otherwise
+ */
+template <typename Images, typename Labels>
+bool read_batches(Images& images, Labels& labels, const std::string& folder, const std::vector<std::string>& files, size_t n) {
+    constexpr size_t size   = 3 * 32 * 32; // The size of an image
+    constexpr size_t record = size + 1;    // The size of a record (label + image)
+
+    size_t i = 0;
+
+    for (auto& name : files) {
+        if (i == n) {
+            break;
+        }
+
+        mapped_file file(folder + "/" + name);
+
+        if (!file.valid() || file.size() % record) {
+            return false;
+        }
+
+        const size_t records = std::min(file.size() / record, n - i);
+
+        convert_u8(images.memory_start() + i * size, file.data() + 1, records, size, record);
+
+        for (size_t r = 0; r < records; ++r) {
+            dll::set_label_class(labels, i + r, file.data()[r * record]);
+        }
+
+        i += records;
+    }
+
+    return i == n;
+}
+
+} // end of namespace cifar_detail
+
 /*!
  * \brief Create a data generator around the CIFAR-10 train set
  * \param folder The folder in which the CIFAR-10 train files are
@@ -25,11 +75,9 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
     float label;
 
     size_t n = 50000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
@@ -37,8 +85,11 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
 
     generator->label_cache = 0;
 
-    // Read all the necessary images and labels
-    cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
+    // Read the necessary images and labels, directly into the caches
+    if(!cifar_detail::read_batches(generator->input_cache, generator->label_cache, folder, {"data_batch_1.bin", "data_batch_2.bin", "data_batch_3.bin", "data_batch_4.bin", "data_batch_5.bin"}, n)){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 training images" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
@@ -60,11 +111,9 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
     float label;
 
     size_t n = 10000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
@@ -72,8 +121,11 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
 
     generator->label_cache = 0;
 
-    // Read all the necessary images and labels
-    cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
+    // Read the necessary images and labels, directly into the caches
+    if(!cifar_detail::read_batches(generator->input_cache, generator->label_cache, folder, {"test_batch.bin"}, n)){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 test images" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
@@ -8,20 +8,114 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <utility>
 #include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Only for image loading...
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "dll/util/affinity.hpp"
 
 namespace dll {
 
 namespace imagenet {
 
+/*!
+ * \brief The name of the index file caching the list of files of a folder
+ */
+constexpr const char* index_file = "dll.index";
+
+/*!
+ * \brief Read the list of files from the index file of the given folder
+ * \return true if the index was read, false otherwise
+ */
+inline bool read_index(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+    std::ifstream stream(file_path + "/" + index_file);
+
+    size_t n_labels = 0;
+    if (!(stream >> n_labels)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_labels; ++i) {
+        size_t label;
+        stream >> label;
+        label_map[label] = i;
+    }
+
+    size_t n_files = 0;
+    stream >> n_files;
+
+    files.reserve(n_files);
+
+    for (size_t i = 0; i < n_files; ++i) {
+        size_t label;
+        size_t image;
+        stream >> label >> image;
+        files.emplace_back(label, image);
+    }
+
+    if (!stream) {
+        files.clear();
+        label_map.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write the list of files to the index file of the given folder.
+ *
+ * Failing to write the index (read-only dataset for instance) is not an
+ * error, the folder will simply be listed again the next time.
+ */
+inline void write_index(const std::vector<std::pair<size_t, size_t>>& files, const std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+    std::vector<size_t> labels(label_map.size());
+    for (auto& entry : label_map) {
+        labels[size_t(entry.second)] = entry.first;
+    }
+
+    std::ofstream stream(file_path + "/" + index_file);
+
+    stream << labels.size() << '\n';
+    for (auto label : labels) {
+        stream << label << '\n';
+    }
+
+    stream << files.size() << '\n';
+    for (auto& file : files) {
+        stream << file.first << ' ' << file.second << '\n';
+    }
+}
+
+/*!
+ * \brief List the images of the given folder, one sub folder per label.
+ *
+ * The listing is cached in an index file in the folder, reused by the
+ * next runs.
+ */
 inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
+    if (read_index(files, label_map, file_path)) {
+        return;
+    }
+
     files.reserve(1200000);
 
     struct dirent* entry;
@@ -55,9 +149,430 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
 
             files.emplace_back(label, image);
         }
+
+        closedir(sub_dir);
+    }
+
+    closedir(dir);
+
+    write_index(files, label_map, file_path);
+}
+
+using image_t = etl::fast_dyn_matrix<float, 3, 256, 256>; ///< The type of an image
+
+/*!
+ * \brief Decode the given image file into the given image.
+ *
+ * The images are resized (smaller side to 256) and center-cropped to
+ * 256x256 if necessary.
+ *
+ * \return true if the image was decoded, false otherwise
+ */
+inline bool decode_image(image_t& image, const std::string& image_path){
+    auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+
+    if (!mat.data || mat.empty()) {
+        std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
+        image = 0;
+        return false;
+    }
+
+    if (mat.cols != 256 || mat.rows != 256) {
+        const double ratio = 256.0 / std::min(mat.cols, mat.rows);
+
+        cv::Mat resized;
+        cv::resize(mat, resized, cv::Size(std::max(256, int(mat.cols * ratio + 0.5)), std::max(256, int(mat.rows * ratio + 0.5))), 0, 0, cv::INTER_AREA);
+
+        mat = resized(cv::Rect((resized.cols - 256) / 2, (resized.rows - 256) / 2, 256, 256)).clone();
     }
+
+    // The image is stored as (channel, x, y)
+    float* out = image.memory_start();
+
+    constexpr size_t S  = 256;
+    constexpr size_t SS = 256 * 256;
+
+    if (cpp_likely(mat.channels() == 3)) {
+        for (size_t y = 0; y < S; ++y) {
+            const unsigned char* row = mat.ptr<unsigned char>(y);
+
+            for (size_t x = 0; x < S; ++x) {
+                out[0 * SS + x * S + y] = row[3 * x + 0];
+                out[1 * SS + x * S + y] = row[3 * x + 1];
+                out[2 * SS + x * S + y] = row[3 * x + 2];
+            }
+        }
+    } else {
+        for (size_t y = 0; y < S; ++y) {
+            const unsigned char* row = mat.ptr<unsigned char>(y);
+
+            for (size_t x = 0; x < S; ++x) {
+                out[x * S + y] = row[x];
+            }
+        }
+
+        std::fill(out + SS, out + 3 * SS, 0.0f);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Return the path of the given image file
+ */
+inline std::string image_path(const std::string& imagenet_path, const std::pair<size_t, size_t>& image_file){
+    auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
+
+    return std::string(imagenet_path) + "/train" + label + label + "_" + std::to_string(image_file.second) + ".JPEG";
 }
 
+/*!
+ * \brief The name of the file of the images in a materialization cache
+ */
+constexpr const char* cache_images_file = "images.bin";
+
+/*!
+ * \brief The header of the images of a materialization cache
+ */
+struct image_cache_header {
+    static constexpr uint32_t current_version = 1; ///< The version of the format
+
+    char magic[4];       ///< The magic identifier ("DLLI")
+    uint32_t version;    ///< The version of the format
+    uint64_t n;          ///< The number of images
+    uint64_t complete;   ///< Indicates if all the images were written
+    uint64_t padding[5]; ///< Pad the header to 64 bytes
+};
+
+static_assert(sizeof(image_cache_header) == 64, "The image cache header must be 64 bytes");
+
+/*!
+ * \brief A cache of the decoded images, filled during the first epoch.
+ *
+ * The images are stored, resized and cropped, as bytes in a mapped file,
+ * at the index of the image in the list of files. Each image is decoded
+ * once, when it is first read, and then read from the cache. Once all
+ * the images are written, the cache is marked complete and the next runs
+ * do not decode any image.
+ */
+struct image_cache {
+    static constexpr size_t image_size = 3 * 256 * 256; ///< The number of values of an image
+
+    /*!
+     * \brief Open the cache at the given path, creating it if it is not
+     * complete
+     * \param path The path of the file of the images
+     * \param n The number of images
+     */
+    image_cache(const std::string& path, size_t n) : n(n), written(n, false), remaining(n) {
+        length = sizeof(image_cache_header) + n * image_size;
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open the image cache " << path << std::endl;
+            return;
+        }
+
+        image_cache_header header;
+        std::memset(&header, 0, sizeof(header));
+
+        bool valid = ::pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header))
+                && std::memcmp(header.magic, "DLLI", 4) == 0 && header.version == image_cache_header::current_version && header.n == n;
+
+        if (!(valid && header.complete)) {
+            // Start again from an empty (sparse) cache
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "DLLI", 4);
+            header.version = image_cache_header::current_version;
+            header.n       = n;
+
+            if (::ftruncate(fd, 0) < 0 || ::ftruncate(fd, length) < 0 || ::pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+                std::cerr << "ERROR: Impossible to create the image cache " << path << std::endl;
+                close();
+                return;
+            }
+        }
+
+        auto memory = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (memory == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map the image cache " << path << std::endl;
+            close();
+            return;
+        }
+
+        mapped = static_cast<uint8_t*>(memory);
+        images = mapped + sizeof(image_cache_header);
+
+        if (header.complete) {
+            remaining = 0;
+            done      = true;
+        }
+    }
+
+    image_cache(const image_cache& rhs) = delete;
+    image_cache& operator=(const image_cache& rhs) = delete;
+
+    /*!
+     * \brief Unmap the cache
+     */
+    ~image_cache() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if all the images are in the cache
+     */
+    bool complete() const {
+        return done;
+    }
+
+    /*!
+     * \brief Read the image at the given index from the cache
+     * \return true if the image was in the cache, false otherwise
+     */
+    bool read(image_t& image, size_t index) {
+        cpp_assert(index < n, "Invalid index in the image cache");
+
+        if (!mapped) {
+            return false;
+        }
+
+        if (!done) {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!written[index]) {
+                return false;
+            }
+        }
+
+        const uint8_t* in = images + index * image_size;
+        float* out        = image.memory_start();
+
+        for (size_t i = 0; i < image_size; ++i) {
+            out[i] = in[i];
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Write the given decoded image at the given index of the cache.
+     *
+     * When the last image is written, the cache is marked complete.
+     */
+    void write(const image_t& image, size_t index) {
+        cpp_assert(index < n, "Invalid index in the image cache");
+
+        if (!mapped || done) {
+            return;
+        }
+
+        const float* in = image.memory_start();
+        uint8_t* out    = images + index * image_size;
+
+        // The decoded values are bytes, the conversion is exact
+        for (size_t i = 0; i < image_size; ++i) {
+            out[i] = static_cast<uint8_t>(in[i]);
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+
+        if (written[index]) {
+            return;
+        }
+
+        written[index] = true;
+
+        if (!--remaining) {
+            ::msync(mapped, length, MS_SYNC);
+
+            // The header is only updated once the images are on disk
+            reinterpret_cast<image_cache_header*>(mapped)->complete = 1;
+            ::msync(mapped, sizeof(image_cache_header), MS_SYNC);
+
+            done = true;
+        }
+    }
+
+private:
+    /*!
+     * \brief Unmap and close the file
+     */
+    void close() {
+        if (mapped) {
+            ::munmap(mapped, length);
+            mapped = nullptr;
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    const size_t n;            ///< The number of images
+    int fd          = -1;      ///< The file descriptor of the cache
+    size_t length   = 0;       ///< The length of the mapped file
+    uint8_t* mapped = nullptr; ///< The mapped file
+    uint8_t* images = nullptr; ///< The first image in the mapped file
+
+    std::mutex lock;               ///< The lock protecting the written flags
+    std::vector<bool> written;     ///< Indicates the images already written
+    size_t remaining;              ///< The number of images not yet written
+    std::atomic<bool> done{false}; ///< Indicates that all the images are written
+};
+
+/*!
+ * \brief A pool of threads decoding the images ahead of their use.
+ *
+ * The images are read in order by the generators: the workers decode the
+ * next images into a ring of slots while the previous ones are used. An
+ * access out of the current window (a reset of the generator for
+ * instance) restarts the decoding at the accessed image. When a cache is
+ * given, the images are read from the cache when they are already in it
+ * and written to it otherwise.
+ */
+struct image_decoder {
+    /*!
+     * \brief Create the decoder and start the workers
+     * \param imagenet_path The folder of the dataset
+     * \param files The list of the images
+     * \param ahead The number of images decoded ahead
+     * \param threads The number of decoding threads
+     * \param cache The materialization cache of the images, if any
+     */
+    image_decoder(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, size_t ahead, size_t threads, std::shared_ptr<image_cache> cache = nullptr)
+            : imagenet_path(imagenet_path), files(files), cache(cache), slots(ahead) {
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    image_decoder(const image_decoder& rhs) = delete;
+    image_decoder& operator=(const image_decoder& rhs) = delete;
+
+    /*!
+     * \brief Stop the workers
+     */
+    ~image_decoder() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /*!
+     * \brief Return the image at the given index, waiting for it to be decoded
+     */
+    void get(image_t& image, size_t index) {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (index < first || index >= first + slots.size()) {
+            // Restart the decoding at the given image
+            ++generation;
+            first = index;
+            next  = index;
+
+            for (auto& slot : slots) {
+                slot.ready = false;
+            }
+        } else {
+            first = index;
+        }
+
+        condition.notify_all();
+
+        auto& slot = slots[index % slots.size()];
+
+        condition.wait(l, [&] { return slot.ready && slot.index == index; });
+
+        image = slot.image;
+    }
+
+private:
+    /*!
+     * \brief A decoded image
+     */
+    struct slot_t {
+        size_t index = 0;     ///< The index of the image
+        bool ready   = false; ///< Indicates if the image is decoded
+        image_t image;        ///< The image
+    };
+
+    /*!
+     * \brief The main function of the workers
+     */
+    void work() {
+        pin_helper();
+
+        image_t image;
+
+        while (true) {
+            size_t index;
+            size_t gen;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [&] { return stop || (next < files->size() && next < first + slots.size()); });
+
+                if (stop) {
+                    return;
+                }
+
+                index = next++;
+                gen   = generation;
+            }
+
+            if (!cache || !cache->read(image, index)) {
+                decode_image(image, image_path(imagenet_path, (*files)[index]));
+
+                if (cache) {
+                    cache->write(image, index);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                // The decoding may have been restarted in the meantime
+                if (gen == generation) {
+                    auto& slot = slots[index % slots.size()];
+
+                    slot.image = image;
+                    slot.index = index;
+                    slot.ready = true;
+                }
+            }
+
+            condition.notify_all();
+        }
+    }
+
+    const std::string imagenet_path;                               ///< The folder of the dataset
+    std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files; ///< The list of the images
+    std::shared_ptr<image_cache> cache;                            ///< The materialization cache, if any
+
+    std::vector<slot_t> slots;        ///< The ring of decoded images
+    std::vector<std::thread> workers; ///< The decoding threads
+
+    std::mutex lock;                   ///< The lock protecting the state
+    std::condition_variable condition; ///< Signals new images or new work
+
+    size_t first      = 0;     ///< The first image of the window
+    size_t next       = 0;     ///< The next image to decode
+    size_t generation = 0;     ///< Incremented at each restart
+    bool stop         = false; ///< Indicates that the workers must stop
+};
+
 struct image_iterator : std::iterator<
                                      std::input_iterator_tag,
                                      etl::fast_dyn_matrix<float, 3, 256, 256>,
@@ -71,6 +586,7 @@ struct image_iterator : std::iterator<
     std::string imagenet_path;
     std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files;
     std::shared_ptr<std::unordered_map<size_t, float>> labels;
+    std::shared_ptr<image_decoder> decoder; ///< The decoder working ahead, if any
 
     size_t index;
 
@@ -80,6 +596,12 @@ struct image_iterator : std::iterator<
         // Nothing else to init
     }
 
+    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, std::shared_ptr<image_decoder> decoder, size_t index) :
+        imagenet_path(imagenet_path), files(files), labels(labels), decoder(decoder), index(index)
+    {
+        // Nothing else to init
+    }
+
     image_iterator(image_iterator&& rhs) = default;
     image_iterator(const image_iterator& rhs) = default;
 
@@ -100,49 +622,12 @@ struct image_iterator : std::iterator<
     }
 
     value_type operator*() {
-        auto& image_file = (*files)[index];
-
-        auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
-
-        auto image_path =
-            std::string(imagenet_path) + "/train" + label + label +
-            "_" + std::to_string(image_file.second) + ".JPEG";
-
-        auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
-
         value_type image;
 
-        if (!mat.data || mat.empty()) {
-            std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (mat.cols != 256 || mat.rows != 256) {
-            std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
-
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
-                }
-            }
+        if (decoder) {
+            decoder->get(image, index);
         } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
-                }
-            }
-
-            image(1) = 0;
-            image(2) = 0;
+            decode_image(image, image_path(imagenet_path, (*files)[index]));
         }
 
         return image;
@@ -226,9 +711,12 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     std::default_random_engine engine(rd());
     std::shuffle(train_files->begin(), train_files->end(), engine);
 
+    // The images are decoded ahead by half the cores
+    auto decoder = std::make_shared<imagenet::image_decoder>(folder, train_files, 128, std::max(1u, std::thread::hardware_concurrency() / 2));
+
     // The image iterators
-    imagenet::image_iterator iit(folder, train_files, labels, 0);
-    imagenet::image_iterator iend(folder, train_files, labels, train_files->size());
+    imagenet::image_iterator iit(folder, train_files, labels, decoder, 0);
+    imagenet::image_iterator iend(folder, train_files, labels, decoder, train_files->size());
 
     // The label iterators
     imagenet::label_iterator lit(train_files, labels, 0);
@@ -239,4 +727,105 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
         make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
 }
 
+/*!
+ * \brief Creates a dataset around ImageNet, materializing the decoded
+ * images in a cache during the first epoch.
+ *
+ * The first epoch decodes the images and writes them, resized and
+ * cropped, in the given cache folder, the next epochs (and the next runs)
+ * read them from the cache. The order of the images is stored in the
+ * cache with it. The pre-transformations and the augmentations of the
+ * generator are applied on the images read from the cache, the random
+ * augmentations being therefore different at each epoch.
+ *
+ * \param folder The folder in which the ImageNet files are
+ * \param cache The folder of the cache, created if necessary
+ * \param parameters The parameters of the generator
+ * \return The ImageNet dataset
+ */
+template<typename... Parameters>
+auto make_imagenet_cached_dataset(const std::string& folder, const std::string& cache, Parameters&&... /*parameters*/){
+    auto train_files = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
+    auto labels      = std::make_shared<std::unordered_map<size_t, float>>();
+
+    const auto images_path = cache + "/" + imagenet::cache_images_file;
+
+    // The order of the images of the cache is its index
+    if (!imagenet::read_index(*train_files, *labels, cache)) {
+        imagenet::read_files(*train_files, *labels, std::string(folder) + "train");
+
+        std::random_device rd;
+        std::default_random_engine engine(rd());
+        std::shuffle(train_files->begin(), train_files->end(), engine);
+
+        ::mkdir(cache.c_str(), 0755);
+        std::remove(images_path.c_str());
+
+        imagenet::write_index(*train_files, *labels, cache);
+    }
+
+    auto image_cache = std::make_shared<imagenet::image_cache>(images_path, train_files->size());
+
+    // Once complete, reading the cache does not need many threads
+    const size_t threads = image_cache->complete() ? 2 : std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    auto decoder = std::make_shared<imagenet::image_decoder>(folder, train_files, 128, threads, image_cache);
+
+    imagenet::image_iterator iit(folder, train_files, labels, decoder, 0);
+    imagenet::image_iterator iend(folder, train_files, labels, decoder, train_files->size());
+
+    imagenet::label_iterator lit(train_files, labels, 0);
+    imagenet::label_iterator lend(train_files, labels, train_files->size());
+
+    return make_dataset_holder(
+        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
+        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+}
+
+/*!
+ * \brief Convert the ImageNet training set to a binary dataset file.
+ *
+ * The images are decoded only once, the resulting file can then be used
+ * with make_imagenet_binary_dataset.
+ *
+ * \param folder The folder in which the ImageNet files are
+ * \param path The path of the binary file to create
+ * \return true if the conversion succeeded, false otherwise
+ */
+inline bool convert_imagenet_binary(const std::string& folder, const std::string& path){
+    auto train_files = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
+    auto labels      = std::make_shared<std::unordered_map<size_t, float>>();
+
+    imagenet::read_files(*train_files, *labels, std::string(folder) + "train");
+
+    // Initial shuffle, stored in the file
+    std::random_device rd;
+    std::default_random_engine engine(rd());
+    std::shuffle(train_files->begin(), train_files->end(), engine);
+
+    auto decoder = std::make_shared<imagenet::image_decoder>(folder, train_files, 128, std::max(1u, std::thread::hardware_concurrency()));
+
+    imagenet::image_iterator iit(folder, train_files, labels, decoder, 0);
+    imagenet::image_iterator iend(folder, train_files, labels, decoder, train_files->size());
+
+    imagenet::label_iterator lit(train_files, labels, 0);
+
+    return write_binary_dataset(path, iit, iend, lit);
+}
+
+/*!
+ * \brief Creates a dataset around ImageNet, previously converted to a
+ * binary file with convert_imagenet_binary.
+ *
+ * \param path The path of the binary file
+ * \param parameters The parameters of the generator
+ * \return The ImageNet dataset
+ */
+template<typename... Parameters>
+auto make_imagenet_binary_dataset(const std::string& path, Parameters&&... /*parameters*/){
+    return make_dataset_holder(
+        make_binary_generator<3>(path, 1000, dll::binary_data_generator_desc<Parameters..., dll::categorical>{}),
+        make_binary_generator<3>(path, 1000, dll::binary_data_generator_desc<Parameters..., dll::categorical>{}));
+}
+
 } // end of namespace dll
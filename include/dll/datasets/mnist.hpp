@@ -7,10 +7,72 @@
 
 #pragma once
 
-#include "mnist/mnist_reader.hpp"
+#include "dll/util/mapped_file.hpp"
 
 namespace dll {
 
+namespace mnist_detail {
+
+/*!
+ * \brief Read images of a MNIST image file directly into the given cache
+ * \param cache The cache (at least n images)
+ * \param path The path of the image file
+ * \param start The index of the first image to read
+ * \param n The number of images to read
+ * \return true if the images were read, false otherwise
+ */
+template <typename Cache>
+bool read_images(Cache& cache, const std::string& path, size_t start, size_t n) {
+    mapped_file file(path);
+
+    if (!file.valid() || file.size() < 16 || file.read_be32(0) != 2051) {
+        return false;
+    }
+
+    const size_t count = file.read_be32(4);
+    const size_t size  = size_t(file.read_be32(8)) * file.read_be32(12);
+
+    if (start + n > count || file.size() < 16 + (start + n) * size || size * n != etl::size(cache)) {
+        return false;
+    }
+
+    convert_u8(cache.memory_start(), file.data() + 16 + start * size, n, size, size);
+
+    return true;
+}
+
+/*!
+ * \brief Read labels of a MNIST label file directly into the given
+ * categorical cache
+ * \param cache The cache (at least n labels)
+ * \param path The path of the label file
+ * \param start The index of the first label to read
+ * \param n The number of labels to read
+ * \return true if the labels were read, false otherwise
+ */
+template <typename Cache>
+bool read_labels(Cache& cache, const std::string& path, size_t start, size_t n) {
+    mapped_file file(path);
+
+    if (!file.valid() || file.size() < 8 || file.read_be32(0) != 2049) {
+        return false;
+    }
+
+    const size_t count = file.read_be32(4);
+
+    if (start + n > count || file.size() < 8 + start + n) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        dll::set_label_class(cache, i, file.data()[8 + start + i]);
+    }
+
+    return true;
+}
+
+} // end of namespace mnist_detail
+
 /*!
  * \brief Create a data generator around the MNIST train set
  * \param folder The folder in which the MNIST train files are
@@ -25,25 +87,23 @@ auto make_mnist_generator_train(const std::string& folder, size_t start, size_t
     float label;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // Read the necessary images, directly into the cache
+    if(!mnist_detail::read_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
-    // Read all the labels (categorical)
+    // Read the necessary labels (categorical)
     generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/train-labels-idx1-ubyte", m, start)){
+    if(!mnist_detail::read_labels(generator->label_cache, folder + "/train-labels-idx1-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST training labels" << std::endl;
         return generator;
     }
@@ -68,25 +128,23 @@ auto make_mnist_generator_test(const std::string& folder, size_t start, size_t l
     float label;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // Read the necessary images, directly into the cache
+    if(!mnist_detail::read_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
-    // Read all the labels (categorical)
+    // Read the necessary labels (categorical)
     generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", m, start)){
+    if(!mnist_detail::read_labels(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST test labels" << std::endl;
         return generator;
     }
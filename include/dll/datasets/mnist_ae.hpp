@@ -7,7 +7,7 @@
 
 #pragma once
 
-#include "mnist/mnist_reader.hpp"
+#include "dll/datasets/mnist.hpp" // For the direct readers
 
 namespace dll {
 
@@ -24,18 +24,16 @@ auto make_mnist_ae_generator_train(const std::string& folder, size_t start, size
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // Read the necessary images, directly into the cache
+    if(!mnist_detail::read_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
@@ -61,18 +59,16 @@ auto make_mnist_ae_generator_test(const std::string& folder, size_t start, size_
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // Read the necessary images, directly into the cache
+    if(!mnist_detail::read_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start, n)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
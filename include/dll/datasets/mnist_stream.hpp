@@ -0,0 +1,223 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Streaming of the MNIST files.
+ *
+ * The files are mapped and the samples are only decoded when the iterators
+ * are dereferenced, the out-of-memory generators can then read data sets
+ * that do not fit in memory and start the training before the whole file
+ * is read.
+ */
+
+#pragma once
+
+#include <memory>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/mapped_file.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A random access iterator decoding the records of a mapped MNIST
+ * file.
+ *
+ * \tparam Value The decoded type, a sample for the image files and an
+ * integer for the label files
+ */
+template <typename Value>
+struct mnist_stream_iterator {
+    using iterator_category = std::random_access_iterator_tag; ///< The category of the iterator
+    using value_type        = Value;                           ///< The decoded type
+    using difference_type   = std::ptrdiff_t;                  ///< The type of the distance between two iterators
+    using pointer           = const Value*;                    ///< The pointer type
+    using reference         = Value;                           ///< The records are decoded by value
+
+    std::shared_ptr<const mapped_file> file; ///< The mapped file
+    size_t header = 0;                       ///< The size of the header, in bytes
+    size_t record = 0;                       ///< The size of one record, in bytes
+    size_t index  = 0;                       ///< The index of the current record
+
+    mnist_stream_iterator() = default;
+
+    /*!
+     * \brief Create an iterator on the given record of the file
+     */
+    mnist_stream_iterator(std::shared_ptr<const mapped_file> file, size_t header, size_t record, size_t index)
+            : file(std::move(file)), header(header), record(record), index(index) {}
+
+    /*!
+     * \brief Decode the current record
+     */
+    value_type operator*() const {
+        return decode(std::is_arithmetic<Value>());
+    }
+
+    /*!
+     * \brief Decode the record at the given distance
+     */
+    value_type operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    mnist_stream_iterator& operator++() {
+        ++index;
+        return *this;
+    }
+
+    mnist_stream_iterator operator++(int) {
+        auto copy = *this;
+        ++index;
+        return copy;
+    }
+
+    mnist_stream_iterator& operator--() {
+        --index;
+        return *this;
+    }
+
+    mnist_stream_iterator operator--(int) {
+        auto copy = *this;
+        --index;
+        return copy;
+    }
+
+    mnist_stream_iterator& operator+=(difference_type n) {
+        index += n;
+        return *this;
+    }
+
+    mnist_stream_iterator& operator-=(difference_type n) {
+        index -= n;
+        return *this;
+    }
+
+    mnist_stream_iterator operator+(difference_type n) const {
+        auto copy = *this;
+        return copy += n;
+    }
+
+    mnist_stream_iterator operator-(difference_type n) const {
+        auto copy = *this;
+        return copy -= n;
+    }
+
+    difference_type operator-(const mnist_stream_iterator& rhs) const {
+        return difference_type(index) - difference_type(rhs.index);
+    }
+
+    bool operator==(const mnist_stream_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const mnist_stream_iterator& rhs) const {
+        return index != rhs.index;
+    }
+
+    bool operator<(const mnist_stream_iterator& rhs) const {
+        return index < rhs.index;
+    }
+
+    bool operator>(const mnist_stream_iterator& rhs) const {
+        return index > rhs.index;
+    }
+
+    bool operator<=(const mnist_stream_iterator& rhs) const {
+        return index <= rhs.index;
+    }
+
+    bool operator>=(const mnist_stream_iterator& rhs) const {
+        return index >= rhs.index;
+    }
+
+private:
+    /*!
+     * \brief Decode a label
+     */
+    value_type decode(std::true_type /*label*/) const {
+        return value_type(file->data()[header + index]);
+    }
+
+    /*!
+     * \brief Decode an image
+     */
+    value_type decode(std::false_type /*label*/) const {
+        value_type sample;
+
+        convert_u8(sample.memory_start(), file->data() + header + index * record, 1, record, record);
+
+        return sample;
+    }
+};
+
+/*!
+ * \brief Return the range of the images of the given MNIST image file,
+ * decoded when the iterators are dereferenced.
+ *
+ * \param path The path of the image file
+ * \param limit The maximum number of images (0 = no limit)
+ * \return The range of images, empty if the file is not a valid image file
+ * of samples of the type Sample
+ */
+template <typename Sample>
+std::pair<mnist_stream_iterator<Sample>, mnist_stream_iterator<Sample>> mnist_image_stream(const std::string& path, size_t limit) {
+    auto file = std::make_shared<const mapped_file>(path);
+
+    if (!file->valid() || file->size() < 16 || file->read_be32(0) != 2051) {
+        return {};
+    }
+
+    const size_t size = size_t(file->read_be32(8)) * file->read_be32(12);
+
+    size_t count = file->read_be32(4);
+
+    if (limit > 0 && limit < count) {
+        count = limit;
+    }
+
+    if (file->size() < 16 + count * size || size != etl::size(Sample())) {
+        return {};
+    }
+
+    return {{file, 16, size, 0}, {file, 16, size, count}};
+}
+
+/*!
+ * \brief Return the range of the labels of the given MNIST label file,
+ * decoded when the iterators are dereferenced.
+ *
+ * \param path The path of the label file
+ * \param limit The maximum number of labels (0 = no limit)
+ * \return The range of labels, empty if the file is not a valid label file
+ */
+inline std::pair<mnist_stream_iterator<size_t>, mnist_stream_iterator<size_t>> mnist_label_stream(const std::string& path, size_t limit) {
+    auto file = std::make_shared<const mapped_file>(path);
+
+    if (!file->valid() || file->size() < 8 || file->read_be32(0) != 2049) {
+        return {};
+    }
+
+    size_t count = file->read_be32(4);
+
+    if (limit > 0 && limit < count) {
+        count = limit;
+    }
+
+    if (file->size() < 8 + count) {
+        return {};
+    }
+
+    return {{file, 8, 1, 0}, {file, 8, 1, count}};
+}
+
+} //end of dll namespace
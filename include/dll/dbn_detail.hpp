@@ -102,6 +102,78 @@ size_t fast_distance(Iterator& first, Iterator& last) {
     }
 }
 
+/*!
+ * \brief Indicates if the layer is a view of the given batch: the layer
+ * only describes the shape of its input and the batch already has this
+ * shape, so it can be forwarded to the next layer as is.
+ */
+template <typename Layer, typename Input, typename Enable = void>
+struct is_view_of : std::false_type {};
+
+/*!
+ * \copydoc is_view_of
+ */
+template <typename Layer, typename Input>
+struct is_view_of<Layer, Input, std::enable_if_t<Layer::is_view>> : cpp::bool_constant<etl::dimensions<std::decay_t<Input>>() == Layer::D + 1> {};
+
+/*!
+ * \brief Indicates if the layer can be applied in place on the given
+ * batch: the layer is elementwise and the batch is a temporary owned by
+ * the forward function, so its memory can be reused for the output.
+ */
+template <typename Layer, typename Input, typename Enable = void>
+struct is_inplace_of : std::false_type {};
+
+/*!
+ * \copydoc is_inplace_of
+ */
+template <typename Layer, typename Input>
+struct is_inplace_of<Layer, Input, std::enable_if_t<Layer::is_inplace>> : cpp::bool_constant<!std::is_lvalue_reference<Input>::value && etl::decay_traits<Input>::is_value> {};
+
+/*!
+ * \brief Indicates if the layer L, before the layer LS, is fused with the
+ * layer L + 1 for the test (or train, if Train is true) representation.
+ */
+template <typename Layers, size_t L, size_t LS, bool Train, typename Enable = void>
+struct is_fused : std::false_type {};
+
+/*!
+ * \copydoc is_fused
+ */
+template <typename Layers, size_t L, size_t LS, bool Train>
+struct is_fused<Layers, L, LS, Train, std::enable_if_t<(L < LS)>> {
+    using fusion = layer_fusion<detail::layer_type_t<L, Layers>, detail::layer_type_t<L + 1, Layers>>; ///< The fusion of the two layers
+
+    static constexpr bool value = Train ? fusion::train : fusion::test; ///< Indicates if the layers are fused
+};
+
+// Release the memory of an intermediate representation as soon as it is dead
+
+/*!
+ * \brief Release the memory of an intermediate representation that is
+ * owned by the forward function and not used anymore.
+ *
+ * \tparam Input The deduced type of the forwarded representation
+ * \param value The representation to release
+ */
+template <typename Input, typename T, cpp_disable_if(std::is_lvalue_reference<Input>::value)>
+void release_intermediate(T& value) {
+    std::decay_t<T> dead(std::move(value));
+    cpp_unused(dead);
+}
+
+/*!
+ * \brief Does nothing since the representation is not owned by the
+ * forward function (it belongs to the caller).
+ *
+ * \tparam Input The deduced type of the forwarded representation
+ * \param value The representation
+ */
+template <typename Input, typename T, cpp_enable_iff(std::is_lvalue_reference<Input>::value)>
+void release_intermediate(T& value) {
+    cpp_unused(value);
+}
+
 template <typename D, size_t N, typename T>
 struct for_each_impl;
 
@@ -16,12 +16,19 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <future>
+
 #include "cpp_utils/static_if.hpp"
 #include "cpp_utils/maybe_parallel.hpp"
 
 #include "generators.hpp"
 #include "unit_type.hpp"
+#include "trainer/distillation.hpp"
 #include "trainer/dbn_trainer.hpp"
+#include "checkpoint.hpp"
+#include "lr_schedule.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dbn_common.hpp"
@@ -30,6 +37,13 @@
 #include "util/timers.hpp"
 #include "util/random.hpp"
 #include "util/ready.hpp"
+#include "util/direct.hpp"
+#include "util/affinity.hpp"
+#include "util/scheduler.hpp"
+#include "util/memory_usage.hpp"
+#include "util/roofline.hpp"
+#include "util/pretrain_spill.hpp"
+#include "fusion.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -76,6 +90,12 @@ struct find_rbm_layer<Layer, DBN, std::enable_if_t<(Layer < DBN::layers_t::size)
 
 /*!
  * \brief A Deep Belief Network implementation
+ *
+ * The const inference functions (test_forward_one/batch/many, features,
+ * predict, ...) only read the weights, their buffers being local to the
+ * call (or to the thread), a trained network can be shared between threads
+ * without locking. The state of the units of the RBMs (v1, h1_a, ...) is
+ * only used by the debugging functions (reconstruct, display_units).
  */
 template <typename Desc>
 struct dbn final {
@@ -142,6 +162,23 @@ public:
     weight learning_rate       = 0.1; ///< The learning rate for finetuning
     weight learning_rate_decay = 0.0; ///< The learning rate decay
 
+    lr_schedule learning_rate_schedule = lr_schedule::CONSTANT; ///< The schedule of the learning rate
+    size_t warmup_iterations           = 0;                     ///< The number of iterations of linear warmup of the learning rate
+    size_t learning_rate_horizon       = 0;                     ///< The number of iterations of the schedule (0 for the whole training)
+    size_t learning_rate_step          = 0;                     ///< The number of iterations between two steps of the STEP schedule
+    weight learning_rate_gamma         = 0.1;                   ///< The factor of the learning rate at each step of the STEP schedule
+    weight learning_rate_min           = 0.0;                   ///< The factor of the minimum learning rate of the COSINE and ONE_CYCLE schedules
+
+    bool layer_wise_scaling = false; ///< Indicates if the learning rate is scaled by the trust ratio of each layer (LARS)
+    weight lars_coefficient = 0.001; ///< The trust coefficient of the layer-wise scaling
+
+    size_t sampled_softmax = 0; ///< The number of classes sampled for the softmax of the last layer during training (0 for the full softmax)
+
+    weight distillation_temperature = 4.0; ///< The temperature of the soft targets of the distillation
+    weight distillation_alpha       = 0.9; ///< The weight of the soft targets in the errors of the distillation, the hard labels having the rest
+
+    distillation_teacher<weight>* distillation = nullptr; ///< The teacher of the current distillation (set by fine_tune_distill)
+
     weight initial_momentum     = 0.9; ///< The initial momentum
     weight final_momentum       = 0.9; ///< The final momentum applied after *final_momentum_epoch* epoch
     weight final_momentum_epoch = 6;   ///< The epoch at which momentum change
@@ -158,20 +195,49 @@ public:
 
     weight gradient_clip = 5.0; ///< The gradient clipping
 
+    size_t accumulation_steps = 1; ///< The number of batches whose gradients are accumulated before each update of the weights
+
+    std::array<bool, layers> frozen{}; ///< Indicates if the weights of each layer are frozen during fine-tuning
+
+    size_t dyn_batch_size = 0; ///< The batch size of a dynamic network at runtime, at most batch_size (0 for batch_size)
+
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
+    size_t validation_subsample = 0; ///< The number of validation samples evaluated at each epoch, the full validation set only being evaluated on improvement (0 to always evaluate the full validation set)
+
+    checkpoint_manager* checkpoints = nullptr; ///< The checkpoints of the fine-tuning, if any
+
+    std::string pretrain_directory; ///< The directory where the pretrained weights and the outputs of the layers are persisted (empty to disable)
+
+private:
+    uint64_t pretrain_key = 0; ///< The key of the input of the layer being pretrained, when persisted
+
+    std::atomic<size_t> version{0}; ///< The version of the weights, incremented each time they change
+
+    std::shared_ptr<void> training_state; ///< The trainer kept between the trainings, allocated by the first one
+
+    template <typename DBN>
+    friend struct dbn_trainer;
+
+public:
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
-    svm::model svm_model;    ///< The learned model
-    svm::problem problem;    ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
-    bool svm_loaded = false; ///< Indicates if a SVM model has been loaded (and therefore must be saved)
+    svm::model svm_model;      ///< The learned model
+    svm::problem problem;      ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
+    bool svm_loaded = false;   ///< Indicates if a SVM model has been loaded (and therefore must be saved)
+    svm_batch_model svm_batch; ///< The dense support vectors of the model, for the batch predictions
+
+private:
+    svm_problem_key svm_key; ///< The samples the current problem was built from
+
+public:
 #endif                       //DLL_SVM_SUPPORT
 
     using categorical_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::compact_labels, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::compact_labels, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     using ae_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
@@ -194,7 +260,161 @@ public:
         outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder>>;
 
 private:
-    cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool;
+    mutable cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool; ///< The thread pool, also used by the const functions
+
+    /*!
+     * \brief Indicates if the given containers can be viewed by a generator
+     * instead of being copied in the cache of an in-memory generator.
+     */
+    template <typename Samples, typename Labels, typename Desc>
+    static constexpr bool viewable_containers =
+            !dbn_traits<this_type>::batch_mode()
+        &&  view_detail::is_viewable<Samples>
+        &&  (Desc::AutoEncoder || view_detail::is_label_viewable<Labels>);
+
+    /*!
+     * \brief Create a generator around the given containers, viewing the
+     * samples without copying them.
+     */
+    template <typename Samples, typename Labels, typename Desc, cpp_enable_iff(viewable_containers<Samples, Labels, Desc>)>
+    auto make_container_generator(const Samples& samples, const Labels& labels, const Desc& desc) const {
+        return dll::make_view_generator(samples, labels, output_size(), desc);
+    }
+
+    /*!
+     * \brief Create a generator around the given containers, copying the
+     * samples in its cache.
+     */
+    template <typename Samples, typename Labels, typename Desc, cpp_disable_if(viewable_containers<Samples, Labels, Desc>)>
+    auto make_container_generator(const Samples& samples, const Labels& labels, const Desc& desc) const {
+        return dll::make_generator(samples, labels, samples.size(), output_size(), desc);
+    }
+
+    /*!
+     * \brief The descriptor of the generator caching the outputs of the
+     * frozen layers, the labels being copied as given by the generator
+     */
+    using feature_generator_t = inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>>;
+
+    /*!
+     * \brief Indicates if the outputs of the frozen layers can be cached for
+     * the fine-tuning with the given generator: the generator must not
+     * augment its samples, its labels must be vectors and the trainer must
+     * accept the inputs of any layer.
+     */
+    template <typename Generator>
+    static constexpr bool cacheable_features =
+            layers > 1
+        &&  std::is_same<typename desc::template trainer_t<this_type>, sgd_trainer<this_type>>::value
+        &&  !is_augmented<typename Generator::desc>
+        &&  !is_stage_augmented<Generator>
+        &&  etl::dimensions<std::decay_t<decltype(std::declval<Generator&>().label_batch())>>() == 2;
+
+    /*!
+     * \brief Returns the number of first layers that are frozen
+     */
+    size_t frozen_prefix() const {
+        size_t l = 0;
+
+        while (l < layers && frozen[l]) {
+            ++l;
+        }
+
+        return l;
+    }
+
+    /*!
+     * \brief Fine tune the network on the cached outputs of its frozen
+     * prefix, if any
+     * \param error The final classification error, if fine-tuned
+     * \return true if the network has been fine-tuned, false otherwise
+     */
+    template <typename Generator, cpp_enable_iff(cacheable_features<Generator>)>
+    bool fine_tune_frozen(Generator& generator, size_t max_epochs, weight& error) {
+        const size_t prefix = frozen_prefix();
+
+        if (prefix > 0 && prefix < layers) {
+            error = fine_tune_cached<1>(generator, max_epochs, prefix);
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \copydoc fine_tune_frozen
+     */
+    template <typename Generator, cpp_disable_if(cacheable_features<Generator>)>
+    bool fine_tune_frozen(Generator& generator, size_t max_epochs, weight& error) {
+        cpp_unused(generator);
+        cpp_unused(max_epochs);
+        cpp_unused(error);
+
+        return false;
+    }
+
+    /*!
+     * \brief Fine tune the layers after the frozen prefix, on the cached
+     * outputs of the prefix
+     * \param prefix The number of frozen layers, in [S, layers)
+     */
+    template <size_t S, typename Generator, cpp_enable_iff((S + 1 < layers))>
+    weight fine_tune_cached(Generator& generator, size_t max_epochs, size_t prefix) {
+        if (prefix != S) {
+            return fine_tune_cached<S + 1>(generator, max_epochs, prefix);
+        }
+
+        return fine_tune_features<S>(generator, max_epochs);
+    }
+
+    /*!
+     * \copydoc fine_tune_cached
+     */
+    template <size_t S, typename Generator, cpp_enable_iff((S + 1 == layers))>
+    weight fine_tune_cached(Generator& generator, size_t max_epochs, size_t prefix) {
+        cpp_unused(prefix);
+
+        return fine_tune_features<S>(generator, max_epochs);
+    }
+
+    /*!
+     * \brief Fine tune the layers from S on the outputs of the frozen layers
+     * before S, computed once for the whole generator instead of once per
+     * epoch.
+     */
+    template <size_t S, typename Generator>
+    weight fine_tune_features(Generator& generator, size_t max_epochs) {
+        generator.reset();
+        generator.set_test();
+
+        // Need one output in order to create the generator
+        auto first = etl::force_temporary(this->template forward_batch<S - 1>(generator.data_batch()));
+        auto one   = etl::force_temporary(first(0));
+        auto label = etl::force_temporary(generator.label_batch()(0));
+
+        auto cache = prepare_generator(one, label, generator.size(), output_size(), feature_generator_t{});
+
+        cache->set_safe();
+
+        {
+            dll::auto_timer timer("dbn:train:ft:features");
+
+            size_t i = 0;
+            while (generator.has_next_batch()) {
+                auto features = this->template forward_batch<S - 1>(generator.data_batch());
+
+                cache->set_data_batch(i, features);
+                cache->set_label_batch(i, generator.label_batch());
+
+                i += etl::dim<0>(features);
+
+                generator.next_batch();
+            }
+        }
+
+        dll::dbn_trainer<this_type> trainer;
+        return trainer.template train<S>(*this, *cache, max_epochs);
+    }
 
     template<size_t I, cpp_disable_if(I == layers)>
     void dyn_init(){
@@ -210,6 +430,30 @@ private:
     template<size_t I, cpp_enable_iff(I == layers)>
     void dyn_init(){}
 
+    /*!
+     * \brief Tie the layer I to the weights of the mirrored layer, if it is
+     * a tied layer
+     */
+    template <size_t I, typename L>
+    auto tie_layer(L& layer, int) -> decltype(layer.tie(std::declval<const layer_type<layers - 1 - I>&>()), void()) {
+        layer.tie(layer_get<layers - 1 - I>());
+    }
+
+    template <size_t I, typename L>
+    void tie_layer(L& layer, long) {
+        cpp_unused(layer);
+    }
+
+    template<size_t I, cpp_disable_if(I == layers)>
+    void tie_layers(){
+        tie_layer<I>(layer_get<I>(), 0);
+
+        tie_layers<I+1>();
+    }
+
+    template<size_t I, cpp_enable_iff(I == layers)>
+    void tie_layers(){}
+
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_desc(){
         static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_desc");
@@ -270,13 +514,17 @@ public:
      *
      * This is the only way to create a DBN.
      */
-    dbn() : pool(etl::threads) {
-        //Nothing else to init
+    dbn() : pool(concurrency()) {
+        // Pin the trainer thread, before the allocation of the layers
+        pin_trainer();
 
         cpp::static_if<!std::is_same<typename desc::base_layers, typename desc::layers>::value>([&](auto f){
             f(this)->template dyn_init<0>();
         });
 
+        // The decoder layers of tied autoencoders use the weights of the encoder
+        tie_layers<0>();
+
         // Update defaults for each updater type
 
         if(updater == updater_type::RMSPROP){
@@ -325,6 +573,49 @@ public:
         });
 
         std::cout << "Total parameters: " << parameters << std::endl;
+
+        memory_usage().display(std::cout);
+    }
+
+    /*!
+     * \brief Returns the memory used by the network and by its training.
+     *
+     * The memory of the contexts of the trainers is computed from the
+     * shapes of the layers, see dll/util/memory_usage.hpp.
+     */
+    memory_report memory_usage() const {
+        return dll::memory_usage(*this);
+    }
+
+    /*!
+     * \brief Returns the memory used by the network and by its training
+     * with the given generator.
+     * \param generator The generator of the training
+     */
+    template <typename Generator>
+    memory_report memory_usage(const Generator& generator) const {
+        return dll::memory_usage(*this, generator);
+    }
+
+    /*!
+     * \brief Returns the analytic FLOPs and bytes of the phases of each
+     * layer for one batch, see dll/util/roofline.hpp.
+     */
+    std::vector<layer_cost> costs() const {
+        return dll::compute_costs(*this);
+    }
+
+    /*!
+     * \brief Display the analytic cost of each layer and the performance
+     * measured by the profiler (between start_profiling() and
+     * stop_profiling()), with the roofline bound when the peaks of the
+     * machine are given.
+     *
+     * \param peak_gflops The peak GFLOP/s of the machine (0 if unknown)
+     * \param peak_gbs The peak memory bandwidth of the machine, in GB/s (0 if unknown)
+     */
+    void display_performance(double peak_gflops = 0.0, double peak_gbs = 0.0) const {
+        dll::display_performance(*this, std::cout, peak_gflops, peak_gbs);
     }
 
     /*!
@@ -341,6 +632,22 @@ public:
         });
     }
 
+    /*!
+     * \brief Backup the weights of all the layers into the temporary
+     * storage, swapping the dynamic storages instead of copying them.
+     *
+     * The weights of the network are left with the previous backup, this
+     * can only be used when the weights are overwritten before being used
+     * again (e.g. on a snapshot of the network).
+     */
+    void swap_backup_weights() {
+        for_each_layer([](auto& layer) {
+            cpp::static_if<decay_layer_traits<decltype(layer)>::is_trained()>([&layer](auto f) {
+                f(layer).swap_backup_weights();
+            });
+        });
+    }
+
     /*!
      * \brief Restore the weights previously saved.
      *
@@ -394,6 +701,8 @@ public:
      * \param is The stream to load the network weights from.
      */
     void load(std::istream& is) {
+        weights_changed();
+
         for_each_layer([&is](auto& layer) {
             cpp::static_if<decay_layer_traits<decltype(layer)>::is_neural_layer()>([&](auto f) {
                 f(layer).load(is);
@@ -405,6 +714,45 @@ public:
 #endif //DLL_SVM_SUPPORT
     }
 
+    /*!
+     * \brief Return the version of the weights of the network, that
+     * changes each time the weights of the network are trained or loaded.
+     */
+    size_t weights_version() const {
+        return version.load(std::memory_order_acquire);
+    }
+
+    /*!
+     * \brief Indicates that the weights of the network are about to be
+     * changed, invalidating the results computed with the previous weights.
+     *
+     * This must be called after the weights of the layers have been
+     * modified directly.
+     */
+    void weights_changed() {
+        invalidate_svm_problem();
+
+        version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    /*!
+     * \brief Release the memory kept for the training of the network.
+     *
+     * The contexts of the layers and the state of the updaters are kept
+     * after the fine-tuning, to be reused by the next one. They are
+     * allocated again by the next fine-tuning.
+     */
+    void release_training_memory() {
+        training_state.reset();
+    }
+
+    /*!
+     * \brief Indicates if the network holds memory kept for its training
+     */
+    bool holds_training_memory() const noexcept {
+        return bool(training_state);
+    }
+
     /*!
      * \brief Returns the Nth layer.
      * \return The Nth layer
@@ -454,6 +802,22 @@ public:
         return dll::input_size(layer_get<input_layer_n>());
     }
 
+    /*!
+     * \brief Returns the batch size used at runtime by the network.
+     *
+     * The batch size of the dynamic networks can be reduced at runtime
+     * (dyn_batch_size), without recompilation: the collections are
+     * forwarded by chunks of this size and the SGD trainer sizes its
+     * dynamic contexts for it, splitting the batches of the generators.
+     */
+    size_t runtime_batch_size() const noexcept {
+        if (dbn_traits<this_type>::is_dynamic() && dyn_batch_size) {
+            return std::min<size_t>(dyn_batch_size, batch_size);
+        }
+
+        return batch_size;
+    }
+
     /*!
      * \brief Returns the output size generated by the network
      * \return The output size of the network
@@ -488,11 +852,14 @@ public:
     template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
     void pretrain(Generator& generator, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
         dll::auto_timer timer("dbn:pretrain");
 
+        weights_changed();
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -507,6 +874,10 @@ public:
 
             pretrain_layer_batch<0>(generator, watcher, max_epochs);
         } else {
+            if (!pretrain_directory.empty()) {
+                pretrain_key = spill_input_key(generator);
+            }
+
             pretrain_layer<0>(generator, watcher, max_epochs);
         }
 
@@ -520,6 +891,7 @@ public:
     template <typename Input, cpp_enable_iff(!is_generator<Input>)>
     void pretrain(const Input& training_data, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
@@ -546,6 +918,7 @@ public:
     template <typename Iterator>
     void pretrain(Iterator first, Iterator last, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
@@ -570,11 +943,14 @@ public:
     template <typename Generator>
     void pretrain_denoising(Generator& generator, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
         dll::auto_timer timer("dbn:pretrain:denoising");
 
+        weights_changed();
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -604,6 +980,7 @@ public:
     template <typename Noisy, typename Clean>
     void pretrain_denoising(const Noisy& noisy, const Clean& clean, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
@@ -625,6 +1002,7 @@ public:
     template <typename NIterator, typename CIterator>
     void pretrain_denoising(NIterator nit, NIterator nend, CIterator cit, CIterator cend, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         validate_pretraining();
 
@@ -645,9 +1023,12 @@ public:
     template <typename Iterator, typename LabelIterator>
     void train_with_labels(Iterator&& first, Iterator&& last, LabelIterator&& lfirst, LabelIterator&& llast, size_t labels, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         dll::auto_timer timer("dbn:train:labels");
 
+        weights_changed();
+
         cpp_assert(std::distance(first, last) == std::distance(lfirst, llast), "There must be the same number of values than labels");
         cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
 
@@ -663,6 +1044,7 @@ public:
     template <typename Samples, typename Labels>
     void train_with_labels(const Samples& training_data, const Labels& training_labels, size_t labels, size_t max_epochs) {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         cpp_assert(training_data.size() == training_labels.size(), "There must be the same number of values than labels");
         cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
@@ -670,9 +1052,100 @@ public:
         train_with_labels(training_data.begin(), training_data.end(), training_labels.begin(), training_labels.end(), labels, max_epochs);
     }
 
+    /*!
+     * \brief Predict the labels of the given range of samples (only when
+     * pretrained with labels)
+     *
+     * The samples are computed by batches, in parallel by the thread pool
+     * of the network, the top RBM being activated once for each batch.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \param labels The number of label units
+     *
+     * \return the predicted label of each sample
+     */
+    template <typename Iterator>
+    std::vector<size_t> predict_labels_many(const Iterator& first, const Iterator& last, size_t labels) const {
+        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
+
+        dll::auto_timer timer("dbn:predict_labels_many");
+
+        decltype(auto) top = layer_get<layers - 1>();
+
+        const size_t features = dll::output_size(layer_get<layers - 2>());
+
+        cpp_assert(dll::input_size(top) == features + labels, "There is no room for the labels units");
+
+        const size_t n      = std::distance(first, last);
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
+
+        std::vector<size_t> predicted(n);
+
+        cpp::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            pin_pool_thread();
+
+            auto input = make_many_chunk(first, c, n, B);
+
+            const size_t m = etl::dim<0>(input);
+
+            decltype(auto) next = this->template test_forward_batch<layers - 2, 0>(input);
+
+            // The features and the unknown labels are the visible units of the top RBM
+            etl::dyn_matrix<weight, 2> v1(m, features + labels);
+
+            v1 = weight(0.1);
+
+            for (size_t b = 0; b < m; ++b) {
+                for (size_t j = 0; j < features; ++j) {
+                    v1(b, j) = next(b, j);
+                }
+            }
+
+            etl::dyn_matrix<weight, 2> h_a(m, dll::output_size(top));
+            etl::dyn_matrix<weight, 2> h_s(m, dll::output_size(top));
+            etl::dyn_matrix<weight, 2> v_a(m, features + labels);
+            etl::dyn_matrix<weight, 2> v_s(m, features + labels);
+
+            top.template batch_activate_hidden<true, true>(h_a, h_s, v1, v1);
+            top.template batch_activate_visible<true, true>(h_a, h_s, v_a, v_s);
+
+            for (size_t b = 0; b < m; ++b) {
+                size_t best = 0;
+
+                for (size_t l = 1; l < labels; ++l) {
+                    if (v_a(b, features + l) > v_a(b, features + best)) {
+                        best = l;
+                    }
+                }
+
+                predicted[c * B + b] = best;
+            }
+        });
+
+        return predicted;
+    }
+
+    /*!
+     * \brief Predict the labels of the given samples (only when pretrained
+     * with labels)
+     *
+     * \param samples The samples
+     * \param labels The number of label units
+     *
+     * \return the predicted label of each sample
+     */
+    template <typename Samples>
+    std::vector<size_t> predict_labels_many(const Samples& samples, size_t labels) const {
+        return predict_labels_many(samples.begin(), samples.end(), labels);
+    }
+
     template<typename Input>
     size_t predict_labels(const Input& item, size_t labels) const {
         static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(!dbn_traits<this_type>::inference_only(), "An inference_only network cannot be trained");
 
         cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
 
@@ -748,14 +1221,24 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, false>::value && !dbn_detail::is_view_of<layer_type<L>, Input>::value && !dbn_detail::is_inplace_of<layer_type<L>, Input>::value)>
     decltype(auto) test_forward_batch_impl(Input&& sample) const {
+        dll::profile_layer layer_scope(L);
+
         decltype(auto) next = layer_get<L>().test_forward_batch(sample);
-        return test_forward_batch_impl<LS, L+1>(next);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(sample);
+
+        return test_forward_batch_impl<LS, L+1>(std::forward<decltype(next)>(next));
     }
 
     /*
-     * \brief Return the test representation for the given input batch.
+     * \brief Return the test representation for the given input batch,
+     * through a view layer.
+     *
+     * The batch already has the shape of the view layer L and is directly
+     * given to the next layer, without copy.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
@@ -764,40 +1247,33 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, false>::value && dbn_detail::is_view_of<layer_type<L>, Input>::value)>
     decltype(auto) test_forward_batch_impl(Input&& sample) const {
-        return layer_get<L>().test_forward_batch(sample);
+        return test_forward_batch_impl<LS, L+1>(std::forward<Input>(sample));
     }
 
     /*
-     * \brief Return the train representation for the given input batch.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param sample The input batch to the layer L
+     * \brief Return the test representation for the given input batch,
+     * through an in-place layer.
      *
-     * \return The train representation of the LS layer forwarded from L
-     */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
-    decltype(auto) train_forward_batch_impl(Input&& sample) {
-        decltype(auto) next = layer_get<L>().train_forward_batch(sample);
-        return train_forward_batch_impl<LS, L+1>(next);
-    }
-
-    /*
-     * \brief Return the train representation for the given input batch.
+     * The batch is owned by this function and is dead after the layer L,
+     * its memory is used for the output of the layer.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
      * \param sample The input batch to the layer L
      *
-     * \return The train representation of the LS layer forwarded from L
+     * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
-    decltype(auto) train_forward_batch_impl(Input&& sample) {
-        return layer_get<L>().train_forward_batch(sample);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, false>::value && dbn_detail::is_inplace_of<layer_type<L>, Input>::value)>
+    decltype(auto) test_forward_batch_impl(Input&& sample) const {
+        {
+            dll::profile_layer layer_scope(L);
+            layer_get<L>().test_forward_batch(sample, sample);
+        }
+
+        return test_forward_batch_impl<LS, L+1>(std::forward<Input>(sample));
     }
 
     /*
@@ -810,28 +1286,30 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) test_forward_batch(Input&& sample) const {
-        return test_forward_batch_impl<LS, L>(sample);
-    }
-
     /*
-     * \brief Return the train representation for the given input batch.
+     * \brief Return the test representation for the given input batch,
+     * through the fusion of the layers L and L + 1.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
      * \param sample The input batch to the layer L
      *
-     * \return The train representation of the LS layer forwarded from L
+     * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) train_forward_batch(Input&& sample) {
-        return train_forward_batch_impl<LS, L>(sample);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L + 1 < LS) && dbn_detail::is_fused<layers_t, L, LS, false>::value)>
+    decltype(auto) test_forward_batch_impl(Input&& sample) const {
+        auto next = fused_test_forward_batch<L>(sample);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(sample);
+
+        return test_forward_batch_impl<LS, L+2>(std::move(next));
     }
 
     /*
-     * \brief Return the test representation for the given input batch.
+     * \brief Return the test representation for the given input batch,
+     * through the fusion of the layers L and LS.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
@@ -840,212 +1318,323 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) forward_batch(Input&& sample) const {
-        return test_forward_batch_impl<LS, L>(sample);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L + 1 == LS) && dbn_detail::is_fused<layers_t, L, LS, false>::value)>
+    decltype(auto) test_forward_batch_impl(Input&& sample) const {
+        return fused_test_forward_batch<L>(sample);
     }
 
-    // Forward one sample at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
+    /*
+     * \brief Return the test representation of the layer L + 1 for the
+     * given input batch of the layer L, computed by the fusion of the two layers.
+     */
+    template <size_t L, typename Input>
+    auto fused_test_forward_batch(const Input& sample) const {
+        dll::profile_layer layer_scope(L);
+
+        using fusion = layer_fusion<layer_type<L>, layer_type<L+1>>;
+
+        return fusion::test_forward_batch(layer_get<L>(), layer_get<L+1>(), sample);
+    }
+
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
+    decltype(auto) test_forward_batch_impl(Input&& sample) const {
+        dll::profile_layer layer_scope(L);
+        return layer_get<L>().test_forward_batch(sample);
+    }
 
     /*
-     * \brief Return the test representation for the given input sample.
+     * \brief Return the train representation for the given input batch.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
-     * \return The test representation of the LS layer forwarded from L
+     * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
-    decltype(auto) test_forward_one_impl(Input&& sample) const {
-        decltype(auto) next = layer_get<L>().test_forward_one(sample);
-        return test_forward_one_impl<LS, L+1>(next);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, true>::value && !dbn_detail::is_view_of<layer_type<L>, Input>::value && !dbn_detail::is_inplace_of<layer_type<L>, Input>::value)>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        dll::profile_layer layer_scope(L);
+
+        decltype(auto) next = layer_get<L>().train_forward_batch(sample);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(sample);
+
+        return train_forward_batch_impl<LS, L+1>(std::forward<decltype(next)>(next));
     }
 
     /*
-     * \brief Return the test representation for the given input sample.
+     * \brief Return the train representation for the given input batch,
+     * through a view layer.
+     *
+     * The batch already has the shape of the view layer L and is directly
+     * given to the next layer, without copy.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
-     * \return The test representation of the LS layer forwarded from L
+     * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
-    decltype(auto) test_forward_one_impl(Input&& sample) const {
-        return layer_get<L>().test_forward_one(sample);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, true>::value && dbn_detail::is_view_of<layer_type<L>, Input>::value)>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        return train_forward_batch_impl<LS, L+1>(std::forward<Input>(sample));
     }
 
     /*
-     * \brief Return the train representation for the given input sample.
+     * \brief Return the train representation for the given input batch,
+     * through an in-place layer.
+     *
+     * The batch is owned by this function and is dead after the layer L,
+     * its memory is used for the output of the layer.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
-    decltype(auto) train_forward_one_impl(Input&& sample) {
-        decltype(auto) next = layer_get<L>().train_forward_one(sample);
-        return train_forward_one_impl<LS, L+1>(next);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS) && !dbn_detail::is_fused<layers_t, L, LS, true>::value && dbn_detail::is_inplace_of<layer_type<L>, Input>::value)>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        {
+            dll::profile_layer layer_scope(L);
+            layer_get<L>().train_forward_batch(sample, sample);
+        }
+
+        return train_forward_batch_impl<LS, L+1>(std::forward<Input>(sample));
     }
 
     /*
-     * \brief Return the train representation for the given input sample.
+     * \brief Return the train representation for the given input batch.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
+     *
+     * \return The train representation of the LS layer forwarded from L
+     */
+    /*
+     * \brief Return the train representation for the given input batch,
+     * through the fusion of the layers L and L + 1.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input batch to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L + 1 < LS) && dbn_detail::is_fused<layers_t, L, LS, true>::value)>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        auto next = fused_train_forward_batch<L>(sample);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(sample);
+
+        return train_forward_batch_impl<LS, L+2>(std::move(next));
+    }
+
+    /*
+     * \brief Return the train representation for the given input batch,
+     * through the fusion of the layers L and LS.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input batch to the layer L
+     *
+     * \return The train representation of the LS layer forwarded from L
+     */
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L + 1 == LS) && dbn_detail::is_fused<layers_t, L, LS, true>::value)>
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        return fused_train_forward_batch<L>(sample);
+    }
+
+    /*
+     * \brief Return the train representation of the layer L + 1 for the
+     * given input batch of the layer L, computed by the fusion of the two layers.
+     */
+    template <size_t L, typename Input>
+    auto fused_train_forward_batch(const Input& sample) {
+        dll::profile_layer layer_scope(L);
+
+        using fusion = layer_fusion<layer_type<L>, layer_type<L+1>>;
+
+        return fusion::train_forward_batch(layer_get<L>(), layer_get<L+1>(), sample);
+    }
+
     template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
-    decltype(auto) train_forward_one_impl(Input&& sample) {
-        return layer_get<L>().train_forward_one(sample);
+    decltype(auto) train_forward_batch_impl(Input&& sample) {
+        dll::profile_layer layer_scope(L);
+        return layer_get<L>().train_forward_batch(sample);
     }
 
     /*
-     * \brief Return the test representation for the given input sample.
+     * \brief Return the test representation for the given input batch.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) test_forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+    decltype(auto) test_forward_batch(Input&& sample) const {
+        return test_forward_batch_impl<LS, L>(sample);
     }
 
     /*
-     * \brief Return the train representation for the given input sample.
+     * \brief Return the train representation for the given input batch.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) train_forward_one(Input&& sample) {
-        return train_forward_one_impl<LS, L>(sample);
+    decltype(auto) train_forward_batch(Input&& sample) {
+        return train_forward_batch_impl<LS, L>(sample);
     }
 
     /*
-     * \brief Return the test representation for the given input sample.
+     * \brief Return the test representation for the given input batch.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param sample The input sample to the layer L
+     * \param sample The input batch to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
-    decltype(auto) forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+    decltype(auto) forward_batch(Input&& sample) const {
+        return test_forward_batch_impl<LS, L>(sample);
     }
 
-    // Forward a collection of samples at a time
+    // Forward one sample at a time
     // This is not as fast as it could be, far from it, but supports
     // larger range of input. The rationale being that time should
     // be spent in forward_batch
 
     /*
-     * \brief Return the test representation for the given collection of inputs.
+     * \brief Return the test representation for the given input sample.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param samples The collection of inputs to the layer L
+     * \param sample The input sample to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs, cpp_enable_iff((L != LS))>
-    decltype(auto) test_forward_many_impl(Inputs&& samples) const {
-        decltype(auto) layer = layer_get<L>();
-
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.test_forward_many(next, samples);
-
-        return test_forward_many_impl<LS, L+1>(next);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
+    decltype(auto) test_forward_one_impl(Input&& sample) const {
+        decltype(auto) next = layer_get<L>().test_forward_one(sample);
+        return test_forward_one_impl<LS, L+1>(next);
     }
 
     /*
-     * \brief Return the test representation for the given collection of inputs.
+     * \brief Return the test representation for the given input sample.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param samples The collection of inputs to the layer L
+     * \param sample The input sample to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs, cpp_enable_iff((L == LS))>
-    decltype(auto) test_forward_many_impl(Inputs&& samples) const {
-        decltype(auto) layer = layer_get<L>();
-
-        auto out = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.test_forward_many(out, samples);
-
-        return out;
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
+    decltype(auto) test_forward_one_impl(Input&& sample) const {
+        return layer_get<L>().test_forward_one(sample);
     }
 
     /*
-     * \brief Return the train representation for the given collection of inputs.
+     * \brief Return the train representation for the given input sample.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param samples The collection of inputs to the layer L
+     * \param sample The input sample to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs, cpp_enable_iff((L != LS))>
-    decltype(auto) train_forward_many_impl(Inputs&& samples) {
-        decltype(auto) layer = layer_get<L>();
-
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.train_forward_many(next, samples);
-
-        return train_forward_many_impl<LS, L+1>(next);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
+    decltype(auto) train_forward_one_impl(Input&& sample) {
+        decltype(auto) next = layer_get<L>().train_forward_one(sample);
+        return train_forward_one_impl<LS, L+1>(next);
     }
 
     /*
-     * \brief Return the train representation for the given collection of inputs.
+     * \brief Return the train representation for the given input sample.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
-     * \param samples The collection of inputs to the layer L
+     * \param sample The input sample to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs, cpp_enable_iff((L == LS))>
-    decltype(auto) train_forward_many_impl(Inputs&& samples) {
-        decltype(auto) layer = layer_get<L>();
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
+    decltype(auto) train_forward_one_impl(Input&& sample) {
+        return layer_get<L>().train_forward_one(sample);
+    }
 
-        auto out = prepare_many_ready_output(layer, samples[0], samples.size());
+    /*
+     * \brief Return the test representation for the given input sample.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input sample to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Input>
+    decltype(auto) test_forward_one(Input&& sample) const {
+        return test_forward_one_impl<LS, L>(sample);
+    }
 
-        layer.train_forward_many(out, samples);
+    /*
+     * \brief Return the train representation for the given input sample.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input sample to the layer L
+     *
+     * \return The train representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Input>
+    decltype(auto) train_forward_one(Input&& sample) {
+        return train_forward_one_impl<LS, L>(sample);
+    }
 
-        return out;
+    /*
+     * \brief Return the test representation for the given input sample.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param sample The input sample to the layer L
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Input>
+    decltype(auto) forward_one(Input&& sample) const {
+        return test_forward_one_impl<LS, L>(sample);
     }
 
+    // Forward a collection of samples at a time
+    // The samples are forwarded by chunks of batch_size samples through
+    // the batch functions, the memory of the intermediate representations
+    // being bounded by the chunks being computed
+
     /*
      * \brief Return the test representation for the given collection of inputs.
      *
@@ -1058,7 +1647,7 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Inputs>
     decltype(auto) test_forward_many(Inputs&& samples) const {
-        return test_forward_many_impl<LS, L>(samples);
+        return test_forward_many<LS, L>(std::begin(samples), std::end(samples));
     }
 
     /*
@@ -1073,7 +1662,7 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Inputs>
     decltype(auto) train_forward_many(Inputs&& samples) {
-        return train_forward_many_impl<LS, L>(samples);
+        return train_forward_many<LS, L>(std::begin(samples), std::end(samples));
     }
 
     /*
@@ -1088,17 +1677,17 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Inputs>
     decltype(auto) forward_many(Inputs&& samples) const {
-        return test_forward_many_impl<LS, L>(samples);
+        return test_forward_many<LS, L>(std::begin(samples), std::end(samples));
     }
 
     // Forward a collection of samples (iterators) at a time
-    // This is not as fast as it could be, far from it, but supports
-    // larger range of input. The rationale being that time should
-    // be spent in forward_batch
 
     /*
      * \brief Return the test representation for the given collection of inputs.
      *
+     * The chunks are computed in parallel by the thread pool of the
+     * network.
+     *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
@@ -1107,42 +1696,25 @@ public:
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Iterator, cpp_enable_iff((L != LS))>
-    decltype(auto) test_forward_many_impl(const Iterator& first, const Iterator& last) const {
-        decltype(auto) layer = layer_get<L>();
+    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
+    decltype(auto) test_forward_many(const Iterator& first, const Iterator& last) const {
+        dll::auto_timer timer("dbn:test_forward_many");
 
-        auto n = std::distance(first, last);
+        const size_t n = std::distance(first, last);
 
-        auto next = prepare_many_ready_output(layer, *first, n);
+        auto out = prepare_many_ready_output(layer_get<LS>(), many_input<LS, L>(*first), n);
 
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.test_forward_one(next[i], sample);
-        });
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
 
-        return test_forward_many_impl<LS, L+1>(next);
-    }
-
-    /*
-     * \brief Return the test representation for the given collection of inputs.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
-     *
-     * \return The test representation of the LS layer forwarded from L
-     */
-    template <size_t LS, size_t L, typename Iterator, cpp_enable_iff((L == LS))>
-    decltype(auto) test_forward_many_impl(const Iterator& first, const Iterator& last) const {
-        decltype(auto) layer = layer_get<L>();
+        cpp::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            pin_pool_thread();
 
-        auto n = std::distance(first, last);
+            auto input = make_many_chunk(first, c, n, B);
 
-        auto out = prepare_many_ready_output(layer, *first, n);
+            decltype(auto) output = this->template test_forward_batch<LS, L>(input);
 
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.test_forward_one(out[i], sample);
+            this->copy_many_chunk(out, output, c, B);
         });
 
         return out;
@@ -1151,6 +1723,9 @@ public:
     /*
      * \brief Return the train representation for the given collection of inputs.
      *
+     * The chunks are computed one after the other, the train
+     * representations updating the state of some layers.
+     *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
@@ -1159,43 +1734,24 @@ public:
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Iterator, cpp_enable_iff((L != LS))>
-    decltype(auto) train_forward_many_impl(const Iterator& first, const Iterator& last) {
-        decltype(auto) layer = layer_get<L>();
+    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
+    decltype(auto) train_forward_many(const Iterator& first, const Iterator& last) {
+        dll::auto_timer timer("dbn:train_forward_many");
 
-        auto n = std::distance(first, last);
+        const size_t n = std::distance(first, last);
 
-        auto next = prepare_many_ready_output(layer, *first, n);
+        auto out = prepare_many_ready_output(layer_get<LS>(), many_input<LS, L>(*first), n);
 
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.train_forward_one(next[i], sample);
-        });
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
 
-        return train_forward_many_impl<LS, L+1>(next);
-    }
+        for (size_t c = 0; c < chunks; ++c) {
+            auto input = make_many_chunk(first, c, n, B);
 
-    /*
-     * \brief Return the train representation for the given collection of inputs.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
-     *
-     * \return The train representation of the LS layer forwarded from L
-     */
-    template <size_t LS, size_t L, typename Iterator, cpp_enable_iff((L == LS))>
-    decltype(auto) train_forward_many_impl(const Iterator& first, const Iterator& last) {
-        decltype(auto) layer = layer_get<L>();
-
-        auto n = std::distance(first, last);
+            decltype(auto) output = this->template train_forward_batch<LS, L>(input);
 
-        auto out = prepare_many_ready_output(layer, *first, n);
-
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.train_forward_one(out[i], sample);
-        });
+            copy_many_chunk(out, output, c, B);
+        }
 
         return out;
     }
@@ -1212,42 +1768,73 @@ public:
      * \return The test representation of the LS layer forwarded from L
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) test_forward_many(const Iterator& first, const Iterator& last) const {
-        return test_forward_many_impl<LS, L>(first, last);
+    decltype(auto) forward_many(const Iterator& first, const Iterator& last) const {
+        return test_forward_many<LS, L>(first, last);
     }
 
-    /*
-     * \brief Return the train representation for the given collection of inputs.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
-     *
-     * \return The train representation of the LS layer forwarded from L
+private:
+    /*!
+     * \brief Returns the input of the layer LS for a sample given to the
+     * layer L, to prepare the outputs of a collection (L == LS)
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) train_forward_many(const Iterator& first, const Iterator& last) {
-        return train_forward_many_impl<LS, L>(first, last);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L == LS))>
+    const Input& many_input(const Input& sample) const {
+        return sample;
     }
 
-    /*
-     * \brief Return the test representation for the given collection of inputs.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
-     *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
-     *
-     * \return The test representation of the LS layer forwarded from L
+    /*!
+     * \brief Returns the input of the layer LS for a sample given to the
+     * layer L, to prepare the outputs of a collection (L != LS)
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) forward_many(const Iterator& first, const Iterator& last) const {
-        return test_forward_many_impl<LS, L>(first, last);
+    template <size_t LS, size_t L, typename Input, cpp_enable_iff((L != LS))>
+    auto many_input(const Input& sample) const {
+        return etl::force_temporary(test_forward_one<LS - 1, L>(sample));
     }
 
+    /*!
+     * \brief Create an empty chunk with the dimensions of the given sample
+     */
+    template <typename Input, size_t... I>
+    static etl::dyn_matrix<weight, sizeof...(I) + 1> make_chunk(size_t n, const Input& sample, std::index_sequence<I...> /*seq*/) {
+        return etl::dyn_matrix<weight, sizeof...(I) + 1>(n, etl::dim<I>(sample)...);
+    }
+
+    /*!
+     * \brief Copy the samples of the c-th chunk of a collection in a batch
+     * \param first Iterator to the first element of the collection
+     * \param c The index of the chunk
+     * \param n The number of samples of the collection
+     * \param B The number of samples of a chunk
+     */
+    template <typename Iterator>
+    static auto make_many_chunk(const Iterator& first, size_t c, size_t n, size_t B) {
+        using input_t = std::decay_t<decltype(*first)>;
+
+        const size_t m = std::min(B, n - c * B);
+
+        auto input = make_chunk(m, *first, std::make_index_sequence<etl::decay_traits<input_t>::dimensions()>());
+
+        auto it = std::next(first, c * B);
+
+        for (size_t i = 0; i < m; ++i, ++it) {
+            input(i) = *it;
+        }
+
+        return input;
+    }
+
+    /*!
+     * \brief Copy the output batch of the c-th chunk of a collection into
+     * the collection of outputs
+     */
+    template <typename Outputs, typename Output>
+    static void copy_many_chunk(Outputs& out, const Output& output, size_t c, size_t B) {
+        for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+            out[c * B + i] = output(i);
+        }
+    }
+
+public:
     /*!
      * \brief Save the features generated for the given sample in the given file.
      * \param sample The sample to get features from
@@ -1299,8 +1886,16 @@ public:
     weight fine_tune(Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("dbn:train:ft");
 
+        weights_changed();
+
         validate_generator(generator);
 
+        // The outputs of the frozen layers are computed only once
+        weight error;
+        if (fine_tune_frozen(generator, max_epochs, error)) {
+            return error;
+        }
+
         dll::dbn_trainer<this_type> trainer;
         return trainer.train(*this, generator, max_epochs);
     }
@@ -1318,6 +1913,8 @@ public:
     weight fine_tune_val(Generator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
         dll::auto_timer timer("dbn:train:ft");
 
+        weights_changed();
+
         validate_generator(train_generator);
         validate_generator(val_generator);
 
@@ -1335,9 +1932,7 @@ public:
     template <typename Input, typename Labels>
     weight fine_tune(const Input& training_data, Labels& labels, size_t max_epochs) {
         // Create generator around the containers
-        auto generator = dll::make_generator(
-            training_data, labels,
-            training_data.size(), output_size(), categorical_generator_t{});
+        auto generator = make_container_generator(training_data, labels, categorical_generator_t{});
 
         generator->set_safe();
 
@@ -1366,6 +1961,87 @@ public:
         return fine_tune(*generator, max_epochs);
     }
 
+    // Fine-tune by distillation
+
+    /*!
+     * \brief Fine tune the network for classification by distillation from
+     * the given teacher network.
+     *
+     * The teacher forwards each batch of the generator and the network is
+     * trained on the mix of the hard labels and of the probabilities of the
+     * teacher, softened with distillation_temperature, weighted by
+     * distillation_alpha.
+     *
+     * When the batches are the same at each epoch (no shuffling and no
+     * augmentation), the teacher only forwards each batch during the first
+     * epoch and its soft targets can be cached in the given file.
+     *
+     * \param teacher The trained teacher network, whose last layer is a softmax
+     * \param generator A generator for data and labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     * \param cache The file caching the soft targets of the teacher (empty for no file)
+     *
+     * \return The final classification error
+     */
+    template <typename Teacher, typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    weight fine_tune_distill(Teacher& teacher, Generator& generator, size_t max_epochs, const std::string& cache = "") {
+        dll::auto_timer timer("dbn:train:ft:distill");
+
+        static_assert(loss == loss_function::CATEGORICAL_CROSS_ENTROPY, "The distillation needs the categorical cross entropy loss");
+        static_assert(std::is_same<typename Teacher::weight, weight>::value, "The teacher and the student must have the same weight type");
+        static_assert(std::is_same<typename desc::template trainer_t<this_type>, sgd_trainer<this_type>>::value, "The distillation needs the SGD trainer");
+
+        weights_changed();
+
+        validate_generator(generator);
+
+        cpp_assert(teacher.output_size() == output_size(), "The teacher and the student must have the same outputs");
+
+        // The batches are the same at each epoch
+        static constexpr bool cached = !dbn_traits<this_type>::shuffle() && !is_augmented<typename Generator::desc> && !is_stage_augmented<Generator>;
+
+        generator.reset();
+
+        distillation_teacher<weight> targets(teacher_forward(teacher, generator.data_batch()), output_size(), cached);
+
+        if (cached && !cache.empty()) {
+            targets.load(cache, distillation_temperature);
+        }
+
+        distillation = &targets;
+
+        dll::dbn_trainer<this_type> trainer;
+        auto error = trainer.train(*this, generator, max_epochs);
+
+        distillation = nullptr;
+
+        if (cached && !cache.empty() && targets.computed) {
+            targets.store(cache, distillation_temperature);
+        }
+
+        return error;
+    }
+
+    /*!
+     * \brief Fine tune the network for classification by distillation from
+     * the given teacher network.
+     * \param teacher The trained teacher network, whose last layer is a softmax
+     * \param training_data A container containing all the samples
+     * \param labels A container containing all the labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     * \param cache The file caching the soft targets of the teacher (empty for no file)
+     * \return The final classification error
+     */
+    template <typename Teacher, typename Input, typename Labels, cpp_disable_if(is_generator<Input>)>
+    weight fine_tune_distill(Teacher& teacher, const Input& training_data, Labels& labels, size_t max_epochs, const std::string& cache = "") {
+        // Create generator around the containers
+        auto generator = make_container_generator(training_data, labels, categorical_generator_t{});
+
+        generator->set_safe();
+
+        return fine_tune_distill(teacher, *generator, max_epochs, cache);
+    }
+
     // Fine-tune for auto-encoder
 
     /*!
@@ -1378,6 +2054,8 @@ public:
     weight fine_tune_ae(Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("dbn:train:ft:ae");
 
+        weights_changed();
+
         validate_generator(generator);
 
         cpp_assert(dll::input_size(layer_get<0>()) == dll::output_size(layer_get<layers - 1>()), "The network is not build as an autoencoder");
@@ -1395,9 +2073,7 @@ public:
     template <typename Samples, cpp_disable_if(is_generator<Samples>)>
     weight fine_tune_ae(const Samples& training_data, size_t max_epochs) {
         // Create generator around the containers
-        auto generator = dll::make_generator(
-            training_data, training_data,
-            training_data.size(), output_size(), ae_generator_t{});
+        auto generator = make_container_generator(training_data, training_data, ae_generator_t{});
 
         generator->set_safe();
 
@@ -1468,7 +2144,7 @@ public:
      */
     template <typename Samples, typename Labels>
     void evaluate(const Samples&  samples, const Labels& labels){
-        auto generator = make_generator(samples, labels, samples.size(), output_size(), categorical_generator_t{});
+        auto generator = make_container_generator(samples, labels, categorical_generator_t{});
 
         generator->set_safe();
 
@@ -1518,7 +2194,7 @@ public:
      */
     template <typename Samples, cpp_enable_iff(!is_generator<Samples>)>
     void evaluate_ae(const Samples&  samples){
-        auto generator = make_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
+        auto generator = make_container_generator(samples, samples, ae_generator_t{});
 
         generator->set_safe();
 
@@ -1572,7 +2248,7 @@ public:
      */
     template <typename Samples, typename Labels>
     double evaluate_error(const Samples&  samples, const Labels& labels){
-        auto generator = make_generator(samples, labels, samples.size(), output_size(), categorical_generator_t{});
+        auto generator = make_container_generator(samples, labels, categorical_generator_t{});
 
         generator->set_safe();
 
@@ -1627,7 +2303,7 @@ public:
      */
     template <typename Samples, cpp_enable_iff(!is_generator<Samples>)>
     double evaluate_error_ae(const Samples&  samples){
-        auto generator = make_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
+        auto generator = make_container_generator(samples, samples, ae_generator_t{});
 
         generator->set_safe();
 
@@ -1733,36 +2409,166 @@ public:
     metrics_t evaluate_metrics_batch(Output&& output, Labels&& labels, size_t n, bool normalize){
         const bool full_batch = n == etl::dim<0>(output);
 
-        double s = 1.0;
+        double s = 1.0;
+
+        if(normalize){
+            s = n;
+        }
+
+        // TODO Detect if labels are categorical already or not
+        // And change the way this is done
+
+        // CPP17 Use if constexpr instaed of SFINAE
+        return compute_loss<loss>(n, full_batch, s, output, labels);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task
+     * and return the evaluation metrics.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics(Generator& generator){
+        validate_generator(generator);
+
+        if /*constexpr*/ (dbn_traits<this_type>::parallel_evaluation()) {
+            return evaluate_metrics_parallel(generator);
+        }
+
+        auto forward_helper = [this](auto&& input_batch){
+            return this->forward_batch(input_batch);
+        };
+
+        return evaluate_metrics(generator, forward_helper);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task
+     * and return the evaluation metrics, with the batches evaluated in
+     * parallel.
+     *
+     * The batches are copied in groups of one batch per thread of the
+     * pool, which releases them early in the generator so that it can
+     * prefetch the next ones. Each batch is then forwarded in its own
+     * buffers and the metrics of the batches are summed.
+     *
+     * \param generator The data generator
+     * \param limit The number of samples to evaluate, from the first (0 for all the samples)
+     * \param confusion The confusion matrix to accumulate, if any
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics_parallel(Generator& generator, size_t limit = 0, etl::dyn_matrix<size_t, 2>* confusion = nullptr){
+        validate_generator(generator);
+
+        dll::auto_timer timer("dbn:evaluate_metrics:parallel");
+
+        generator.reset();
+        generator.set_test();
+
+        using input_batch_t = decltype(etl::force_temporary(generator.data_batch()));
+        using label_batch_t = decltype(etl::force_temporary(generator.label_batch()));
+
+        const size_t group = concurrency();
+
+        std::vector<input_batch_t> inputs;
+        std::vector<label_batch_t> labels;
+        std::vector<metrics_t> metrics(group);
+
+        // One confusion matrix per batch of a group, summed at the end
+        std::vector<etl::dyn_matrix<size_t, 2>> confusions(confusion ? group : 0);
+
+        for (auto& c : confusions) {
+            c = etl::dyn_matrix<size_t, 2>(etl::dim<0>(*confusion), etl::dim<1>(*confusion), size_t(0));
+        }
+
+        inputs.reserve(group);
+        labels.reserve(group);
+
+        double error = 0.0;
+        double loss  = 0.0;
+        size_t n     = 0;
+
+        while(generator.has_next_batch() && (!limit || n < limit)){
+            inputs.clear();
+            labels.clear();
+
+            while(inputs.size() < group && generator.has_next_batch() && (!limit || n < limit)){
+                inputs.push_back(etl::force_temporary(generator.data_batch()));
+                labels.push_back(etl::force_temporary(generator.label_batch()));
+
+                n += etl::dim<0>(inputs.back());
+
+                generator.next_batch();
+            }
+
+            cpp::maybe_parallel_foreach_n(pool, 0, inputs.size(), [&](size_t t) {
+                pin_pool_thread();
 
-        if(normalize){
-            s = n;
+                decltype(auto) output = this->forward_batch(inputs[t]);
+
+                metrics[t] = evaluate_metrics_batch(output, labels[t], etl::dim<0>(inputs[t]), false);
+
+                if (confusion) {
+                    accumulate_confusion(output, labels[t], etl::dim<0>(inputs[t]), confusions[t]);
+                }
+            });
+
+            for(size_t t = 0; t < inputs.size(); ++t){
+                error += std::get<0>(metrics[t]);
+                loss += std::get<1>(metrics[t]);
+            }
         }
 
-        // TODO Detect if labels are categorical already or not
-        // And change the way this is done
+        for (auto& c : confusions) {
+            *confusion += c;
+        }
 
-        // CPP17 Use if constexpr instaed of SFINAE
-        return compute_loss<loss>(n, full_batch, s, output, labels);
+        error /= limit ? n : generator.size();
+        loss /= limit ? n : generator.size();
+
+        return std::make_tuple(error, loss);
     }
 
     /*!
-     * \brief Evaluate the network on the given classification task
-     * and return the evaluation metrics.
+     * \brief Evaluate the network on the given classification task, with
+     * the batches evaluated in parallel, and accumulate the confusion
+     * matrix of its predictions.
      *
-     * \param generator The data generator
+     * \param generator The data generator, with categorical labels
+     * \param confusion The confusion matrix (labels x predictions), accumulated
      *
      * \return The evaluation metrics
      */
     template <typename Generator>
-    metrics_t evaluate_metrics(Generator& generator){
-        validate_generator(generator);
+    metrics_t evaluate_metrics(Generator& generator, etl::dyn_matrix<size_t, 2>& confusion){
+        return evaluate_metrics_parallel(generator, 0, &confusion);
+    }
 
-        auto forward_helper = [this](auto&& input_batch){
-            return this->forward_batch(input_batch);
-        };
+    /*!
+     * \brief Accumulate the predictions of the given output batch in the
+     * confusion matrix.
+     *
+     * \param output The output batch of the network
+     * \param labels The categorical labels of the batch
+     * \param n The number of samples of the batch
+     * \param confusion The confusion matrix (labels x predictions)
+     */
+    template <typename Output, typename Labels>
+    static void accumulate_confusion(Output&& output, Labels&& labels, size_t n, etl::dyn_matrix<size_t, 2>& confusion){
+        for (size_t i = 0; i < n; ++i) {
+            auto out = output(i);
+            auto lab = labels(i);
 
-        return evaluate_metrics(generator, forward_helper);
+            const size_t predicted = std::distance(out.begin(), std::max_element(out.begin(), out.end()));
+            const size_t label     = std::distance(lab.begin(), std::max_element(lab.begin(), lab.end()));
+
+            ++confusion(label, predicted);
+        }
     }
 
     /*!
@@ -1771,11 +2577,12 @@ public:
      *
      * \param generator The data generator
      * \param helper The function to use to compute a batch of output
+     * \param limit The number of samples to evaluate, from the first (0 for all the samples)
      *
      * \return The evaluation metrics
      */
     template <typename Generator, typename Helper>
-    metrics_t evaluate_metrics(Generator& generator, Helper&& helper){
+    metrics_t evaluate_metrics(Generator& generator, Helper&& helper, size_t limit = 0){
         validate_generator(generator);
 
         // Starts a new
@@ -1786,8 +2593,9 @@ public:
 
         double error = 0.0;
         double loss  = 0.0;
+        size_t n     = 0;
 
-        while(generator.has_next_batch()){
+        while(generator.has_next_batch() && (!limit || n < limit)){
             auto input_batch = generator.data_batch();
             auto label_batch = generator.label_batch();
 
@@ -1801,11 +2609,13 @@ public:
             error += batch_error;
             loss += batch_loss;
 
+            n += etl::dim<0>(input_batch);
+
             generator.next_batch();
         }
 
-        error /= generator.size();
-        loss /= generator.size();
+        error /= limit ? n : generator.size();
+        loss /= limit ? n : generator.size();
 
         return std::make_tuple(error, loss);
     }
@@ -1841,6 +2651,210 @@ public:
         return result;
     }
 
+    /*!
+     * \brief Copy the output batch of a layer into its columns of the
+     * features and return the column of the next layer.
+     */
+    template <typename Output, typename Result>
+    size_t copy_activation_batch(const Output& output, Result& result, size_t first, size_t offset) const {
+        decltype(auto) out = direct_memory(output);
+
+        const size_t B = etl::dim<0>(out);
+        const size_t S = etl::size(out) / B;
+        const size_t F = etl::dim<1>(result);
+
+        const auto* src = out.memory_start();
+        auto* dst       = result.memory_start() + first * F + offset;
+
+        for (size_t b = 0; b < B; ++b) {
+            std::copy(src + b * S, src + (b + 1) * S, dst + b * F);
+        }
+
+        return offset + S;
+    }
+
+    /*!
+     * \brief Copy the output batch of the layer I into the buffer of the
+     * requested layer L, if they are the same layer.
+     */
+    template <size_t I, size_t L, typename Output, typename Result>
+    static void copy_requested_layer(const Output& output, Result& result) {
+        cpp::static_if<I == L>([&](auto f) {
+            decltype(auto) out = direct_memory(output);
+
+            cpp_assert(etl::size(out) == etl::size(result), "The buffer must have the size of the output batch of the layer");
+
+            host_read(out);
+            std::copy(out.memory_start(), out.memory_start() + etl::size(out), f(result).memory_start());
+            host_written(f(result));
+        });
+    }
+
+    /*!
+     * \brief Forward the input batch of the layer I and copy its output
+     * into the buffers of the requested layers LS, up to the layer S.
+     */
+    template <size_t I, size_t S, size_t... LS, typename Input, typename... Outputs, cpp_enable_iff((I < S))>
+    void test_forward_batch_layers_impl(const Input& input, Outputs&... outputs) const {
+        decltype(auto) output = layer_get<I>().test_forward_batch(input);
+
+        int copies[] = {0, (copy_requested_layer<I, LS>(output, outputs), 0)...};
+        cpp_unused(copies);
+
+        test_forward_batch_layers_impl<I + 1, S, LS...>(output, outputs...);
+    }
+
+    /*!
+     * \copydoc test_forward_batch_layers_impl
+     */
+    template <size_t I, size_t S, size_t... LS, typename Input, typename... Outputs, cpp_enable_iff((I == S))>
+    void test_forward_batch_layers_impl(const Input& input, Outputs&... outputs) const {
+        decltype(auto) output = layer_get<I>().test_forward_batch(input);
+
+        int copies[] = {0, (copy_requested_layer<I, LS>(output, outputs), 0)...};
+        cpp_unused(copies);
+    }
+
+    /*!
+     * \brief Forward the input batch of the layer I and copy its output
+     * into the buffers of the requested layers (given at runtime), up to
+     * the layer last.
+     */
+    template <size_t I, typename Input, cpp_enable_iff((I < layers))>
+    void test_forward_batch_layers_impl(const Input& input, const std::vector<size_t>& requested, std::vector<etl::dyn_matrix<weight, 2>>& outputs, size_t last) const {
+        decltype(auto) output = layer_get<I>().test_forward_batch(input);
+
+        for (size_t k = 0; k < requested.size(); ++k) {
+            if (requested[k] == I) {
+                const size_t B = etl::dim<0>(output);
+                const size_t F = etl::size(output) / B;
+
+                if (etl::dim<0>(outputs[k]) != B || etl::dim<1>(outputs[k]) != F) {
+                    outputs[k] = etl::dyn_matrix<weight, 2>(B, F);
+                }
+
+                copy_activation_batch(output, outputs[k], 0, 0);
+            }
+        }
+
+        if (I < last) {
+            test_forward_batch_layers_impl<I + 1>(output, requested, outputs, last);
+        }
+    }
+
+    /*!
+     * \copydoc test_forward_batch_layers_impl
+     */
+    template <size_t I, typename Input, cpp_enable_iff((I == layers))>
+    void test_forward_batch_layers_impl(const Input& input, const std::vector<size_t>& requested, std::vector<etl::dyn_matrix<weight, 2>>& outputs, size_t last) const {
+        cpp_unused(input);
+        cpp_unused(requested);
+        cpp_unused(outputs);
+        cpp_unused(last);
+    }
+
+    /*!
+     * \brief Compute the concatenated activation probabilities of the layers
+     * I to S for the given batch.
+     *
+     * Each layer forwards the whole batch and its output is copied into
+     * its columns of the rows [first, first + B) of the result.
+     *
+     * \param input The input batch of the layer I
+     * \param result The features (samples x full_output_size()), row-major
+     * \param first The row of the first sample of the batch
+     * \param offset The column of the first feature of the layer I
+     */
+    template <size_t I, size_t S, typename Input, typename Result, cpp_enable_iff(I != S)>
+    void full_activation_probabilities_batch(const Input& input, Result& result, size_t first, size_t offset) const {
+        decltype(auto) output = layer_get<I>().test_forward_batch(input);
+
+        offset = copy_activation_batch(output, result, first, offset);
+
+        full_activation_probabilities_batch<I + 1, S>(output, result, first, offset);
+    }
+
+    /*!
+     * \copydoc full_activation_probabilities_batch
+     */
+    template <size_t I, size_t S, typename Input, typename Result, cpp_enable_iff(I == S)>
+    void full_activation_probabilities_batch(const Input& input, Result& result, size_t first, size_t offset) const {
+        decltype(auto) output = layer_get<I>().test_forward_batch(input);
+
+        copy_activation_batch(output, result, first, offset);
+    }
+
+    /*!
+     * \brief Compute the concatenated activation probabilities of all the
+     * layers for the given batch.
+     *
+     * \param input The input batch
+     * \param result The features (samples x full_output_size()), row-major
+     * \param first The row of the first sample of the batch
+     */
+    template <typename Input, typename Result>
+    void full_activation_probabilities_batch(const Input& input, Result& result, size_t first = 0) const {
+        full_activation_probabilities_batch<0, layers - 1>(input, result, first, 0);
+    }
+
+    /*!
+     * \brief Return the concatenated activation probabilities of all the
+     * layers for the given batch (samples x full_output_size()).
+     */
+    template <typename Input>
+    etl::dyn_matrix<weight, 2> full_activation_probabilities_batch(const Input& input) const {
+        etl::dyn_matrix<weight, 2> result(etl::dim<0>(input), full_output_size());
+        full_activation_probabilities_batch(input, result, 0);
+        return result;
+    }
+
+    /*!
+     * \brief Compute the test representations of several layers for the
+     * given batch, in a single forward pass.
+     *
+     * The network is forwarded up to the last requested layer and the
+     * output of each requested layer is copied into its buffer, that must
+     * have as many elements as the output batch of the layer (for instance
+     * samples x output_size()).
+     *
+     * \tparam LS The layers from which the representations are extracted
+     * \param input The input batch
+     * \param outputs The buffers of the representations of the layers, in the order of LS
+     */
+    template <size_t... LS, typename Input, typename... Outputs>
+    void test_forward_batch_layers(const Input& input, Outputs&... outputs) const {
+        static_assert(sizeof...(LS) > 0, "At least one layer must be requested");
+        static_assert(sizeof...(LS) == sizeof...(Outputs), "There must be one buffer per requested layer");
+        static_assert(std::max({LS...}) < layers, "The requested layers must be in the network");
+
+        test_forward_batch_layers_impl<0, std::max({LS...}), LS...>(input, outputs...);
+    }
+
+    /*!
+     * \brief Compute the test representations of several layers, given at
+     * runtime, for the given batch, in a single forward pass.
+     *
+     * The network is forwarded up to the last requested layer and the
+     * output of each requested layer is copied into its buffer, resized to
+     * samples x features if necessary.
+     *
+     * \param input The input batch
+     * \param requested The layers from which the representations are extracted
+     * \param outputs The buffers of the representations of the layers, in the order of the requested layers
+     */
+    template <typename Input>
+    void test_forward_batch_layers(const Input& input, const std::vector<size_t>& requested, std::vector<etl::dyn_matrix<weight, 2>>& outputs) const {
+        cpp_assert(!requested.empty(), "At least one layer must be requested");
+
+        const size_t last = *std::max_element(requested.begin(), requested.end());
+
+        cpp_assert(last < layers, "The requested layers must be in the network");
+
+        outputs.resize(requested.size());
+
+        test_forward_batch_layers_impl<0>(input, requested, outputs, last);
+    }
+
     template <typename Functor>
     void for_each_layer(Functor&& functor) {
         for_each_impl_t(*this).for_each_layer(std::forward<Functor>(functor));
@@ -1931,6 +2945,7 @@ public:
 
         //Train the SVM
         svm_model = svm::train(problem, parameters);
+        svm_batch.reset();
 
         svm_loaded = true;
 
@@ -1958,6 +2973,7 @@ public:
 
         //Train the SVM
         svm_model = svm::train(problem, parameters);
+        svm_batch.reset();
 
         svm_loaded = true;
 
@@ -1981,7 +2997,7 @@ public:
         }
 
         //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        svm_parallel_grid_search(pool, problem, parameters, n_fold, g);
 
         return true;
     }
@@ -2004,15 +3020,152 @@ public:
         }
 
         //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        svm_parallel_grid_search(pool, problem, parameters, n_fold, g);
+
+        return true;
+    }
+
+    /*!
+     * \brief Train a linear classifier on the features of the given
+     * samples, instead of the SVM of libsvm (see dll/linear_classifier.hpp)
+     *
+     * The classifier is stored as the SVM of the network, with a linear
+     * kernel, it is predicted with svm_predict and svm_predict_many and
+     * saved with the weights of the network.
+     *
+     * \param training_data The samples
+     * \param labels The labels
+     * \param parameters The parameters of the training
+     * \return true if the training succeeded, false otherwise
+     */
+    template <typename Samples, typename Labels>
+    bool linear_train(const Samples& training_data, const Labels& labels, const linear_parameters& parameters = linear_parameters()) {
+        return linear_train(training_data.begin(), training_data.end(), labels.begin(), labels.end(), parameters);
+    }
+
+    /*!
+     * \copydoc linear_train
+     */
+    template <typename Iterator, typename LIterator>
+    bool linear_train(Iterator&& first, Iterator&& last, LIterator&& lfirst, LIterator&& llast, const linear_parameters& parameters = linear_parameters()) {
+        cpp::stop_watch<std::chrono::seconds> watch;
+
+        const size_t n = std::distance(first, last);
+
+        std::vector<double> labels(lfirst, llast);
+
+        if (!n || labels.size() != n) {
+            return false;
+        }
+
+        const size_t F      = dbn_traits<this_type>::concatenate() ? full_output_size() : output_size();
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
+
+        //Get all the features, by batch
+        etl::dyn_matrix<weight, 2> features(n, F);
+
+        cpp::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            pin_pool_thread();
+
+            auto input = make_many_chunk(first, c, n, B);
+            auto batch = this->svm_features_matrix(input);
+
+            dll::host_read(batch);
+
+            std::copy(batch.memory_start(), batch.memory_end(), features.memory_start() + c * B * F);
+        });
+
+        dll::host_written(features);
+
+        auto model = train_linear(pool, features, labels, parameters);
+
+        if (model.classes() < 2) {
+            return false;
+        }
+
+        svm_model = svm_from_linear(model);
+        svm_batch.reset();
+
+        svm_loaded = true;
+
+        std::cout << "Linear training took " << watch.elapsed() << "s" << std::endl;
 
         return true;
     }
 
+    /*!
+     * \brief Predict the given sample with the SVM
+     *
+     * The kernel values are computed with the dense support vectors of the
+     * model (see svm_batch_model), except for the precomputed kernels.
+     *
+     * \param sample The sample
+     * \return the prediction of the SVM
+     */
     template <typename Input>
     double svm_predict(const Input& sample) {
         auto features = get_final_activation_probabilities(sample);
-        return svm::predict(svm_model, features);
+
+        if (!prepare_svm_batch()) {
+            return svm::predict(svm_model, features);
+        }
+
+        double label;
+        svm_batch.predict(etl::reshape(features, 1, etl::size(features)), &label);
+        return label;
+    }
+
+    /*!
+     * \brief Predict the given range of samples with the SVM
+     *
+     * The features of the samples are computed by batches and the kernel
+     * values of each batch with all the support vectors are computed at
+     * once, the batches being predicted in parallel by the thread pool of
+     * the network.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \return the prediction of the SVM for each sample
+     */
+    template <typename Iterator>
+    std::vector<double> svm_predict_many(const Iterator& first, const Iterator& last) {
+        dll::auto_timer timer("dbn:svm:predict_many");
+
+        const size_t n = std::distance(first, last);
+
+        std::vector<double> predicted(n);
+
+        if (!prepare_svm_batch()) {
+            std::transform(first, last, predicted.begin(), [this](const auto& sample) {
+                return svm::predict(svm_model, this->get_final_activation_probabilities(sample));
+            });
+
+            return predicted;
+        }
+
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
+
+        cpp::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            pin_pool_thread();
+
+            auto input = make_many_chunk(first, c, n, B);
+
+            svm_batch.predict(this->svm_features_matrix(input), predicted.data() + c * B);
+        });
+
+        return predicted;
+    }
+
+    /*!
+     * \brief Predict the given samples with the SVM
+     * \param samples The samples
+     * \return the prediction of the SVM for each sample
+     */
+    template <typename Samples>
+    std::vector<double> svm_predict_many(const Samples& samples) {
+        return svm_predict_many(samples.begin(), samples.end());
     }
 
 #endif //DLL_SVM_SUPPORT
@@ -2055,26 +3208,159 @@ private:
 
         next_generator->set_safe();
 
-        // Compute the input of the next layer
-        // using batch activation
+        // Compute the input of the next layer
+        // using batch activation
+
+        size_t i = 0;
+        while(generator.has_next_batch()){
+            auto batch = layer.train_forward_batch(generator.data_batch());
+            auto next_batch = next_layer.train_forward_batch(batch);
+
+            next_generator->set_data_batch(i, next_batch);
+            next_generator->set_label_batch(i, next_batch);
+
+            i += etl::dim<0>(next_batch);
+
+            generator.next_batch();
+        }
+
+        // Release the memory if possible
+        generator.clear();
+
+        // The outputs of the two layers are not persisted, but the key of the
+        // next layer must still depend on the weights of this one
+        if (!pretrain_directory.empty()) {
+            pretrain_key = spill_hash(pretrain_layer_key<I>(), I + 1);
+        }
+
+        pretrain_layer<I + 2>(*next_generator, watcher, max_epochs);
+    }
+
+    /*!
+     * \brief Return the key of the outputs of the layer I, from the key of
+     * its input and its weights
+     */
+    template <size_t I>
+    uint64_t pretrain_layer_key() const {
+        uint64_t key = spill_hash(pretrain_key, I);
+
+        cpp::static_if<layer_traits<layer_type<I>>::is_pretrained()>([&](auto f) {
+            key = spill_layer_key(key, f(this)->template layer_get<I>());
+        });
+
+        return key;
+    }
+
+    /*!
+     * \brief Load the persisted weights of the layer I for its current input
+     * \return true if the weights were loaded, false if the layer must be trained
+     */
+    template <size_t I>
+    bool load_pretrained_layer() {
+        if (pretrain_directory.empty()) {
+            return false;
+        }
+
+        auto path = spill_path(pretrain_directory, I, pretrain_key, "dat");
+
+        if (!spill_exists(path)) {
+            return false;
+        }
+
+        layer_get<I>().load(path);
+
+#ifndef DLL_SILENT
+        std::cout << "DBN: Layer " << I << " loaded from " << path << std::endl;
+#endif
+
+        return true;
+    }
+
+    /*!
+     * \brief Persist the weights of the layer I for its current input
+     */
+    template <size_t I>
+    void store_pretrained_layer() const {
+        if (!pretrain_directory.empty()) {
+            auto path = spill_path(pretrain_directory, I, pretrain_key, "dat");
+
+            layer_get<I>().store(path + ".tmp");
+            std::rename((path + ".tmp").c_str(), path.c_str());
+        }
+    }
+
+    /*!
+     * \brief Compute the outputs of the layer I into the pretraining
+     * directory, unless they are already there, and pretrain the next layers
+     * from them, read out-of-core.
+     *
+     * \return true if the next layers were pretrained, false if the outputs
+     * cannot be persisted
+     */
+    template <size_t I, typename Generator, cpp_enable_iff(std::is_same<weight, float>::value && (I < layers - 1))>
+    bool pretrain_layer_spilled(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        decltype(auto) layer = layer_get<I>();
+
+        using one_t = std::decay_t<decltype(prepare_one_ready_output(layer, generator.data_batch()(0)))>;
+
+        constexpr size_t D = etl::dimensions<one_t>();
+
+        if /*constexpr*/ (D > binary_dataset_header::max_dimensions) {
+            return false;
+        }
+
+        dll::auto_timer timer("dbn:pretrain:spill");
+
+        pretrain_key = pretrain_layer_key<I>();
+
+        auto path = spill_path(pretrain_directory, I, pretrain_key, "dllb");
+
+        if (spill_exists(path)) {
+#ifndef DLL_SILENT
+            std::cout << "DBN: Outputs of layer " << I << " read from " << path << std::endl;
+#endif
+        } else {
+            // Reset correctly the generator
+            generator.reset();
+            generator.set_test();
+
+            auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
 
-        size_t i = 0;
-        while(generator.has_next_batch()){
-            auto batch = layer.train_forward_batch(generator.data_batch());
-            auto next_batch = next_layer.train_forward_batch(batch);
+            binary_dataset_writer writer(path, generator.size(), one);
 
-            next_generator->set_data_batch(i, next_batch);
-            next_generator->set_label_batch(i, next_batch);
+            while (generator.has_next_batch()) {
+                writer.append(layer.train_forward_batch(generator.data_batch()));
 
-            i += etl::dim<0>(next_batch);
+                generator.next_batch();
+            }
 
-            generator.next_batch();
+            if (!writer.finish()) {
+                return false;
+            }
         }
 
         // Release the memory if possible
         generator.clear();
 
-        pretrain_layer<I + 2>(*next_generator, watcher, max_epochs);
+        binary_data_generator<D, binary_data_generator_desc<dll::batch_size<layer_type<rbm_layer_n>::batch_size>, dll::autoencoder>> next_generator(path, 0);
+
+        next_generator.set_safe();
+
+        //Pass the output to the next layer
+        this->template pretrain_layer<I + 1>(next_generator, watcher, max_epochs);
+
+        return true;
+    }
+
+    /*!
+     * \copydoc pretrain_layer_spilled
+     *
+     * The outputs of the last layer are never used and the binary format
+     * only holds single-precision samples.
+     */
+    template <size_t I, typename Generator, cpp_disable_if(std::is_same<weight, float>::value && (I < layers - 1))>
+    bool pretrain_layer_spilled(Generator& /*generator*/, watcher_t& /*watcher*/, size_t /*max_epochs*/) {
+        return false;
     }
 
     template <size_t I, typename Generator, cpp_enable_iff((I < layers))>
@@ -2086,10 +3372,17 @@ private:
         watcher.pretrain_layer(*this, I, layer, generator.size());
 
         cpp::static_if<layer_traits<layer_t>::is_pretrained()>([&](auto f) {
-            // Train the RBM
-            f(layer).template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
-                                    dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
-                (generator, max_epochs);
+            // Resume from the persisted weights, if any
+            if (!f(this)->template load_pretrained_layer<I>()) {
+                // Train the RBM, its events being attributed to the layer
+                dll::profile_layer layer_scope(I);
+
+                f(layer).template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
+                                        dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
+                    (generator, max_epochs);
+
+                f(this)->template store_pretrained_layer<I>();
+            }
         });
 
         //When the next layer is a pooling layer, a lot of memory can be saved by directly computing
@@ -2099,6 +3392,11 @@ private:
         });
 
         if /*constexpr*/ (train_next<I + 1>::value && !inline_next<I + 1>::value) {
+            // The outputs are persisted and read back from the disk
+            if (!pretrain_directory.empty() && pretrain_layer_spilled<I>(generator, watcher, max_epochs)) {
+                return;
+            }
+
             // Reset correctly the generator
             generator.reset();
             generator.set_test();
@@ -2249,6 +3547,12 @@ private:
     void pretrain_layer_batch(Generator& generator, watcher_t& watcher, size_t max_epochs) {
         using layer_t = layer_type<I>;
 
+        // The inputs of this layer and the next ones can be cached
+        if /*constexpr*/ (dbn_traits<this_type>::pretrain_cache()) {
+            pretrain_layer_batch_cached<I, 0>(generator, watcher, max_epochs);
+            return;
+        }
+
         decltype(auto) rbm = layer_get<I>();
 
         watcher.pretrain_layer(*this, I, rbm, 0);
@@ -2260,6 +3564,7 @@ private:
 
         //Init the RBM and training parameters
         r_trainer.init_training(rbm, generator);
+        r_trainer.init_parameter_server(rbm);
 
         //Get the specific trainer (CD)
         auto trainer = rbm_trainer_t::get_trainer(rbm);
@@ -2301,6 +3606,142 @@ private:
     template <size_t I, typename Generator, cpp_enable_iff(I == layers)>
     void pretrain_layer_batch(Generator&, watcher_t&, size_t) {}
 
+    /* Pretrain in batch mode with a cache of the inputs */
+
+    //Special handling for untrained layers
+    template <size_t I, size_t S, typename Generator, cpp_enable_iff((I < layers && batch_layer_ignore<I>::value))>
+    void pretrain_layer_batch_cached(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        //We simply go up one layer on untrained layers
+        pretrain_layer_batch_cached<I + 1, S>(generator, watcher, max_epochs);
+    }
+
+    /*!
+     * \brief Pretrain the layer I from a generator holding the inputs of
+     * the layer S.
+     *
+     * During the first epoch, the inputs of the layer I are computed from
+     * the generator and stored in memory. The computation of the next batch
+     * is done in parallel with the training on the current batch. The next
+     * epochs are directly trained from the cache, which is then used as the
+     * source of the next pretrained layer.
+     */
+    template <size_t I, size_t S, typename Generator, cpp_enable_iff((I < layers && !batch_layer_ignore<I>::value))>
+    void pretrain_layer_batch_cached(Generator& generator, watcher_t& watcher, size_t max_epochs) {
+        using layer_t = layer_type<I>;
+
+        decltype(auto) rbm = layer_get<I>();
+
+        watcher.pretrain_layer(*this, I, rbm, generator.size());
+
+        using rbm_trainer_t = dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>>;
+
+        //Initialize the RBM trainer
+        rbm_trainer_t r_trainer;
+
+        //Init the RBM and training parameters
+        r_trainer.init_training(rbm, generator);
+        r_trainer.init_parameter_server(rbm);
+
+        //Get the specific trainer (CD)
+        auto trainer = rbm_trainer_t::get_trainer(rbm);
+
+        // Compute the inputs of the layer I from the inputs of the layer S
+        auto forward = [this](auto&& input) {
+            return etl::force_temporary(this->template forward_batch<I - 1, S>(input));
+        };
+
+        generator.reset();
+        generator.set_train();
+
+        auto current = forward(etl::force_temporary(generator.data_batch()));
+
+        generator.next_batch();
+
+        // Prepare a generator to hold the inputs of the layer
+        auto one = etl::force_temporary(current(0));
+
+        auto cache = prepare_generator(
+            one, one,
+            generator.size(), output_size(),
+            get_rbm_ingenerator_inner_desc<I>());
+
+        cache->set_safe();
+
+        //Train for max_epochs epoch
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            size_t big_batch = 0;
+
+            //Create a new context for this epoch
+            rbm_training_context context;
+
+            r_trainer.init_epoch();
+
+            if (epoch == 0) {
+                size_t i = 0;
+
+                while (true) {
+                    const bool last = !generator.has_next_batch();
+
+                    // Compute the next inputs while training on the current ones
+                    std::future<decltype(current)> next;
+
+                    if (!last) {
+                        auto input = etl::force_temporary(generator.data_batch());
+
+                        next = std::async(std::launch::async, [&forward](auto input) { return forward(input); }, std::move(input));
+
+                        generator.next_batch();
+                    }
+
+                    cache->set_data_batch(i, current);
+                    cache->set_label_batch(i, current);
+
+                    i += etl::dim<0>(current);
+
+                    r_trainer.train_batch(current, current, trainer, context, rbm);
+
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, big_batch);
+                    }
+
+                    if (last) {
+                        break;
+                    }
+
+                    current = next.get();
+                }
+
+                // Release the memory of the source if possible
+                generator.clear();
+            } else {
+                cache->reset();
+
+                while (cache->has_next_batch()) {
+                    auto batch = cache->data_batch();
+
+                    r_trainer.train_batch(batch, batch, trainer, context, rbm);
+
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, big_batch);
+                    }
+
+                    cache->next_batch();
+                }
+            }
+
+            r_trainer.finalize_epoch(epoch, context, rbm);
+        }
+
+        r_trainer.finalize_training(rbm);
+
+        //train the next layer, if any, from the inputs of this layer
+        pretrain_layer_batch_cached<I + 1, I>(*cache, watcher, max_epochs);
+    }
+
+    //Stop template recursion
+    template <size_t I, size_t S, typename Generator, cpp_enable_iff(I == layers)>
+    void pretrain_layer_batch_cached(Generator&, watcher_t&, size_t) {}
+
     /* Pretrain layer denoising batch  */
 
     //Special handling for the layer 0
@@ -2345,6 +3786,7 @@ private:
 
         //Init the RBM and training parameters
         r_trainer.init_training(rbm, generator);
+        r_trainer.init_parameter_server(rbm);
 
         //Get the specific trainer (CD)
         auto trainer = rbm_trainer_t::get_trainer(rbm);
@@ -2406,37 +3848,73 @@ private:
         });
 
         if (I < layers - 1) {
-            auto next_a = this_type::template forward_many<I, I>(first, last);
-
             //If the next layer is the last layer
             if (I == layers - 2) {
-                using input_t = std::decay_t<decltype(*first)>;
-                auto big_next_a = layer.template prepare_output<input_t>(input_size, true, labels);
+                auto big_next_a = labeled_many<I>(first, last, lit, lend, labels);
 
-                //Cannot use std copy since the sub elements have different size
-                for (size_t i = 0; i < next_a.size(); ++i) {
-                    for (size_t j = 0; j < next_a[i].size(); ++j) {
-                        big_next_a[i][j] = next_a[i][j];
-                    }
-                }
+                train_with_labels<I + 1>(big_next_a.begin(), big_next_a.end(), watcher, lend, lend, labels, max_epochs);
+            } else {
+                auto next_a = this_type::template forward_many<I, I>(first, last);
 
-                size_t i = 0;
-                while (lit != lend) {
-                    decltype(auto) label = *lit;
+                train_with_labels<I + 1>(next_a.begin(), next_a.end(), watcher, lit, lend, labels, max_epochs);
+            }
+        }
+    }
 
-                    for (size_t l = 0; l < labels; ++l) {
-                        big_next_a[i][dll::output_size(layer) + l] = label == l ? 1.0 : 0.0;
-                    }
+    /*!
+     * \brief Return the outputs of the layer I for the given range of
+     * inputs, joined with the label units of the given labels.
+     *
+     * The chunks are computed by batches, in parallel by the thread pool of
+     * the network, directly into the joined outputs.
+     */
+    template <size_t I, typename Iterator, typename LabelIterator>
+    auto labeled_many(const Iterator& first, const Iterator& last, LabelIterator lit, LabelIterator lend, size_t labels) const {
+        dll::auto_timer timer("dbn:labeled_many");
+
+        using input_t = std::decay_t<decltype(*first)>;
+
+        decltype(auto) layer = layer_get<I>();
+
+        const size_t n        = std::distance(first, last);
+        const size_t features = dll::output_size(layer);
+
+        auto out = layer.template prepare_output<input_t>(n, true, labels);
+
+        // The labels are gathered first, to be accessed from the chunks
+        std::vector<size_t> indices;
+        indices.reserve(n);
+
+        for (; lit != lend; ++lit) {
+            indices.push_back(static_cast<size_t>(*lit));
+        }
+
+        cpp_assert(indices.size() == n, "There must be the same number of values than labels");
+
+        const size_t B      = runtime_batch_size();
+        const size_t chunks = (n + B - 1) / B;
+
+        cpp::maybe_parallel_foreach_n(pool, 0, chunks, [&](size_t c) {
+            pin_pool_thread();
 
-                    ++i;
-                    ++lit;
+            auto input = make_many_chunk(first, c, n, B);
+
+            decltype(auto) output = this->template test_forward_batch<I, I>(input);
+
+            for (size_t b = 0; b < etl::dim<0>(output); ++b) {
+                auto& joined = out[c * B + b];
+
+                for (size_t j = 0; j < features; ++j) {
+                    joined[j] = output(b, j);
                 }
 
-                train_with_labels<I + 1>(big_next_a.begin(), big_next_a.end(), watcher, lit, lend, labels, max_epochs);
-            } else {
-                train_with_labels<I + 1>(next_a.begin(), next_a.end(), watcher, lit, lend, labels, max_epochs);
+                for (size_t l = 0; l < labels; ++l) {
+                    joined[features + l] = indices[c * B + b] == l ? 1.0 : 0.0;
+                }
             }
-        }
+        });
+
+        return out;
     }
 
     template <size_t I, typename Iterator, typename LabelIterator>
@@ -2489,17 +3967,128 @@ private:
 
     /* Activation Probabilities */
 
+    /*!
+     * \brief Invalidate the SVM problem built from the features of the
+     * network, since the weights are about to change.
+     */
+    void invalidate_svm_problem() {
+#ifdef DLL_SVM_SUPPORT
+        svm_key = svm_problem_key();
+#endif //DLL_SVM_SUPPORT
+    }
+
 #ifdef DLL_SVM_SUPPORT
 
-    template <typename Samples, typename Input, typename DBN = this_type, cpp_enable_iff(dbn_traits<DBN>::concatenate())>
-    void add_activation_probabilities(Samples& result, const Input& sample) {
-        result.emplace_back(full_output_size());
-        full_activation_probabilities(sample, result.back());
+    template <typename Samples, typename Sample>
+    void prepare_svm_samples(Samples& result, size_t n, const Sample& /*sample*/) {
+        using input_t = typename types_helper<layers - 1, Sample>::input_t;
+
+        result.reserve(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            result.push_back(layer_get<layers - 1>().template prepare_one_output<input_t>());
+        }
+    }
+
+    template <typename Samples, typename Batch, typename DBN = this_type, cpp_enable_iff(dbn_traits<DBN>::concatenate())>
+    void svm_features_batch(Samples& result, const Batch& batch, size_t first) const {
+        full_activation_probabilities_batch(batch, result, first);
+    }
+
+    template <typename Samples, typename Batch, typename DBN = this_type, cpp_disable_if(dbn_traits<DBN>::concatenate())>
+    void svm_features_batch(Samples& result, const Batch& batch, size_t first) const {
+        decltype(auto) output = this->test_forward_batch(batch);
+
+        for (size_t b = 0; b < etl::dim<0>(batch); ++b) {
+            result[first + b] = output(b);
+        }
+    }
+
+    /*!
+     * \brief Compute the features of all the samples of the generator.
+     *
+     * The batches are forwarded in groups of one batch per thread of the
+     * pool, each in its own buffers, directly into the preallocated
+     * features.
+     */
+    template <typename Generator, typename Samples>
+    void svm_features(Generator& generator, Samples& result) {
+        dll::auto_timer timer("dbn:svm:features");
+
+        generator.reset();
+        generator.set_test();
+
+        using input_batch_t = decltype(etl::force_temporary(generator.data_batch()));
+
+        const size_t group = concurrency();
+
+        std::vector<input_batch_t> inputs;
+        std::vector<size_t> firsts;
+
+        inputs.reserve(group);
+        firsts.reserve(group);
+
+        size_t i = 0;
+
+        while (generator.has_next_batch()) {
+            inputs.clear();
+            firsts.clear();
+
+            while (inputs.size() < group && generator.has_next_batch()) {
+                inputs.push_back(etl::force_temporary(generator.data_batch()));
+                firsts.push_back(i);
+
+                i += etl::dim<0>(inputs.back());
+
+                generator.next_batch();
+            }
+
+            cpp::maybe_parallel_foreach_n(pool, 0, inputs.size(), [&](size_t t) {
+                pin_pool_thread();
+
+                this->svm_features_batch(result, inputs[t], firsts[t]);
+            });
+        }
+    }
+
+    /*!
+     * \brief Prepare the dense support vectors of the model, if necessary
+     * \return true if the model can be predicted by batches
+     */
+    bool prepare_svm_batch() {
+        const auto* model = svm_model.get_model();
+
+        if (!model || !svm_batch_model::supported(*model)) {
+            return false;
+        }
+
+        if (!svm_batch.ready()) {
+            svm_batch.prepare(*model, dbn_traits<this_type>::concatenate() ? full_output_size() : output_size());
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Return the features of the given batch (samples x features)
+     */
+    template <typename Batch, typename DBN = this_type, cpp_enable_iff(dbn_traits<DBN>::concatenate())>
+    etl::dyn_matrix<weight, 2> svm_features_matrix(const Batch& batch) const {
+        return full_activation_probabilities_batch(batch);
     }
 
-    template <typename Samples,typename Input, typename DBN = this_type, cpp_disable_if(dbn_traits<DBN>::concatenate())>
-    void add_activation_probabilities(Samples& result, const Input& sample) {
-        result.push_back(forward_one(sample));
+    /*!
+     * \copydoc svm_features_matrix
+     */
+    template <typename Batch, typename DBN = this_type, cpp_disable_if(dbn_traits<DBN>::concatenate())>
+    etl::dyn_matrix<weight, 2> svm_features_matrix(const Batch& batch) const {
+        decltype(auto) output = this->test_forward_batch(batch);
+
+        const size_t m = etl::dim<0>(batch);
+
+        etl::dyn_matrix<weight, 2> features(m, output_size());
+        features = etl::reshape(output, m, output_size());
+        return features;
     }
 
     template <typename Input>
@@ -2513,34 +4102,113 @@ private:
 
     template <typename Samples, typename Labels>
     void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
-        svm_samples_t<safe_value_t<Samples>> svm_samples;
-
-        //Get all the activation probabilities
-        for (auto& sample : training_data) {
-            add_activation_probabilities(svm_samples, sample);
-        }
-
-        //static_cast ensure using the correct overload
-        problem = svm::make_problem(labels, static_cast<const svm_samples_t<safe_value_t<Samples>>&>(svm_samples), scale);
+        make_problem(training_data.begin(), training_data.end(), labels.begin(), labels.end(), scale);
     }
 
     /*!
-     * \brief Create the svm problem for this dbn
+     * \brief Create the svm problem for this dbn.
+     *
+     * The problem is kept as long as the weights do not change, it is
+     * not computed again for the same samples.
      */
     template <typename Iterator, typename LIterator>
     void make_problem(Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
+        const size_t n = std::distance(first, last);
+
+        if (!n) {
+            return;
+        }
+
+        svm_problem_key key;
+        key.samples = &*first;
+        key.labels  = &*lfirst;
+        key.n       = n;
+        key.scale   = scale;
+
+        if (key == svm_key) {
+            return;
+        }
+
+        //Get all the activation probabilities, by batch
+        auto generator = make_generator(
+            first, last, lfirst, llast,
+            n, 1,
+            inmemory_data_generator_desc<dll::batch_size<batch_size>>{});
+
+        build_svm_problem(*generator, first, lfirst, llast, n, scale);
+
+        svm_key = key;
+    }
+
+    template <typename Generator, typename Iterator, typename LIterator, typename DBN = this_type, cpp_disable_if(dbn_traits<DBN>::concatenate())>
+    void build_svm_problem(Generator& generator, Iterator first, LIterator lfirst, LIterator llast, size_t n, bool scale) {
         svm_samples_t<safe_value_t<Iterator>> svm_samples;
 
-        //Get all the activation probabilities
-        std::for_each(first, last, [this, &svm_samples](auto& sample) {
-            this->add_activation_probabilities(svm_samples, sample);
+        prepare_svm_samples(svm_samples, n, *first);
+
+        svm_features(generator, svm_samples);
+
+        problem = svm::make_problem(lfirst, llast, svm_samples.begin(), svm_samples.end(), scale);
+    }
+
+    /*!
+     * \brief Build the SVM problem of the concatenated activation
+     * probabilities.
+     *
+     * The features of all the layers are written by batch into one
+     * row-major matrix and the nodes of libsvm are built directly from its
+     * rows, in parallel.
+     */
+    template <typename Generator, typename Iterator, typename LIterator, typename DBN = this_type, cpp_enable_iff(dbn_traits<DBN>::concatenate())>
+    void build_svm_problem(Generator& generator, Iterator /*first*/, LIterator lfirst, LIterator llast, size_t n, bool scale) {
+        const size_t F = full_output_size();
+
+        etl::dyn_matrix<weight, 2> features(n, F);
+
+        svm_features(generator, features);
+
+        // The scaling is done by libsvm on the samples
+        if (scale) {
+            std::vector<full_output_t> svm_samples(n);
+
+            for (size_t i = 0; i < n; ++i) {
+                svm_samples[i] = features(i);
+            }
+
+            problem = svm::make_problem(lfirst, llast, svm_samples.begin(), svm_samples.end(), scale);
+
+            return;
+        }
+
+        svm::problem result(n, F);
+
+        size_t i = 0;
+        for (auto it = lfirst; it != llast; ++it) {
+            result.label(i++) = *it;
+        }
+
+        constexpr size_t block = 256;
+
+        const weight* x = features.memory_start();
+
+        cpp::maybe_parallel_foreach_n(pool, 0, (n + block - 1) / block, [&](size_t t) {
+            pin_pool_thread();
+
+            for (size_t s = t * block; s < std::min(n, (t + 1) * block); ++s) {
+                auto* nodes = new svm_node[F + 1];
+
+                for (size_t f = 0; f < F; ++f) {
+                    nodes[f].index = int(f + 1);
+                    nodes[f].value = x[s * F + f];
+                }
+
+                nodes[F].index = -1;
+
+                result.sample(s) = nodes;
+            }
         });
 
-        //static_cast ensure using the correct overload
-        problem = svm::make_problem(
-            std::forward<LIterator>(lfirst), std::forward<LIterator>(llast),
-            svm_samples.begin(), svm_samples.end(),
-            scale);
+        problem = std::move(result);
     }
 
 #endif //DLL_SVM_SUPPORT
@@ -41,6 +41,14 @@ struct dbn_traits {
         return desc::Updater;
     }
 
+    /*!
+     * \brief Get the compression of the gradients for distributed
+     * training.
+     */
+    static constexpr compression_type compression() noexcept {
+        return desc::Compression;
+    }
+
     /*!
      * \brief Indicates if the DBN runs in batch mode
      */
@@ -48,6 +56,14 @@ struct dbn_traits {
         return desc::parameters::template contains<dll::batch_mode>();
     }
 
+    /*!
+     * \brief Indicates if the inputs of the layers are cached during batch mode
+     * pretraining.
+     */
+    static constexpr bool pretrain_cache() noexcept {
+        return desc::parameters::template contains<dll::pretrain_cache>();
+    }
+
     /*!
      * \brief Indicates if the DBN computes error on epoch.
      */
@@ -93,6 +109,59 @@ struct dbn_traits {
         return desc::parameters::template contains<serial>();
     }
 
+    /*!
+     * \brief Returns the number of threads used for data-parallel
+     * fine-tuning.
+     */
+    static constexpr size_t data_parallel() noexcept {
+        return desc::DataParallel;
+    }
+
+    /*!
+     * \brief Returns the number of pipeline stages of the fine-tuning.
+     */
+    static constexpr size_t pipeline_parallel() noexcept {
+        return desc::PipelineParallel;
+    }
+
+    /*!
+     * \brief Returns the number of batches between two computations of the
+     * error and loss of the training batches.
+     */
+    static constexpr size_t batch_metrics_period() noexcept {
+        return desc::BatchMetricsPeriod;
+    }
+
+    /*!
+     * \brief Indicates if the DBN evaluates the validation set asynchronously
+     */
+    static constexpr bool async_validation() noexcept {
+        return desc::parameters::template contains<dll::async_validation>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN recomputes its activations during the
+     * backward pass of the fine-tuning
+     */
+    static constexpr bool gradient_checkpointing() noexcept {
+        return desc::parameters::template contains<dll::gradient_checkpointing>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN is only used for inference
+     */
+    static constexpr bool inference_only() noexcept {
+        return desc::parameters::template contains<dll::inference_only>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN evaluates the batches of a generator in
+     * parallel.
+     */
+    static constexpr bool parallel_evaluation() noexcept {
+        return desc::parameters::template contains<dll::parallel_evaluation>() && !is_serial();
+    }
+
     /*!
      * \brief Indicates if the DBN is verbose
      */
@@ -0,0 +1,774 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Network with its layers chosen at runtime.
+ *
+ * The layers of a dyn_network are added at runtime and called through
+ * virtual functions, once per batch, the computations inside a layer being
+ * the same as in the dynamic layers. The activation functions are also
+ * runtime values. Since nothing of the network depends on the types of the
+ * layers, dyn_network<float> and dyn_network<double> are compiled once in
+ * the prebuilt library and the programs using them are not recompiled when
+ * the architecture changes.
+ *
+ * All the samples and outputs are given as batches of flat samples, one
+ * sample per row.
+ */
+
+#pragma once
+
+#include <memory>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/initializer.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/direct.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/conv_engine.hpp"
+
+namespace dll {
+
+namespace dyn_network_detail {
+
+/*!
+ * \brief Apply the activation function f to the batch, in place
+ */
+template <typename T>
+void activate(function f, etl::dyn_matrix<T, 2>& output) {
+    switch (f) {
+        case function::IDENTITY:
+            break;
+        case function::SIGMOID:
+            activate_inplace<function::SIGMOID, false>(output);
+            break;
+        case function::TANH:
+            activate_inplace<function::TANH, false>(output);
+            break;
+        case function::RELU:
+            activate_inplace<function::RELU, false>(output);
+            break;
+        case function::SOFTMAX:
+            activate_inplace<function::SOFTMAX, false>(output);
+            break;
+    }
+}
+
+/*!
+ * \brief Multiply the errors by the derivative of the activation function
+ * f at the given output
+ */
+template <typename T>
+void derivative(function f, etl::dyn_matrix<T, 2>& errors, const etl::dyn_matrix<T, 2>& output) {
+    switch (f) {
+        case function::IDENTITY:
+            break;
+        case function::SIGMOID:
+            errors = f_derivative<function::SIGMOID>(output) >> errors;
+            break;
+        case function::TANH:
+            errors = f_derivative<function::TANH>(output) >> errors;
+            break;
+        case function::RELU:
+            errors = f_derivative<function::RELU>(output) >> errors;
+            break;
+        case function::SOFTMAX:
+            errors = f_derivative<function::SOFTMAX>(output) >> errors;
+            break;
+    }
+}
+
+} //end of namespace dyn_network_detail
+
+/*!
+ * \brief A layer of a dyn_network
+ *
+ * The batches are always B x input_size() and B x output_size() matrices.
+ */
+template <typename T>
+struct dyn_network_layer {
+    using weight = T;                     ///< The data type of the layer
+    using batch  = etl::dyn_matrix<T, 2>; ///< The type of a batch
+
+    virtual ~dyn_network_layer() = default;
+
+    /*!
+     * \brief Return the size of the input of this layer
+     */
+    virtual size_t input_size() const noexcept = 0;
+
+    /*!
+     * \brief Return the size of the output of this layer
+     */
+    virtual size_t output_size() const noexcept = 0;
+
+    /*!
+     * \brief Return the number of trainable parameters of this layer
+     */
+    virtual size_t parameters() const noexcept = 0;
+
+    /*!
+     * \brief Returns a short description of the layer
+     */
+    virtual std::string to_short_string() const = 0;
+
+    /*!
+     * \brief Return the activation function of the layer
+     */
+    virtual function activation() const noexcept {
+        return function::IDENTITY;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param output A batch of output that will be filled
+     * \param input A batch of input
+     */
+    virtual void forward_batch(batch& output, const batch& input) const = 0;
+
+    /*!
+     * \brief Adapt the errors of the output to the activation function
+     * \param errors The errors of the output
+     * \param output The output of the layer
+     */
+    virtual void adapt_errors(batch& errors, const batch& output) const {
+        dyn_network_detail::derivative(activation(), errors, output);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layer
+     *
+     * \param input_errors The errors of the input that will be filled
+     * \param errors The (adapted) errors of the output
+     * \param input The input of the layer
+     * \param output The output of the layer
+     */
+    virtual void backward_batch(batch& input_errors, const batch& errors, const batch& input, const batch& output) const = 0;
+
+    /*!
+     * \brief Compute the gradients of the parameters for the batch
+     * \param input The input of the layer
+     * \param errors The (adapted) errors of the output
+     */
+    virtual void compute_gradients(const batch& input, const batch& errors) {
+        cpp_unused(input);
+        cpp_unused(errors);
+    }
+
+    /*!
+     * \brief Update the parameters from the gradients, with momentum
+     * \param eps The learning rate, already divided by the batch size
+     * \param momentum The momentum
+     */
+    virtual void apply_gradients(T eps, T momentum) {
+        cpp_unused(eps);
+        cpp_unused(momentum);
+    }
+};
+
+/*!
+ * \brief Dense layer of a dyn_network
+ */
+template <typename T>
+struct dyn_network_dense final : dyn_network_layer<T> {
+    using batch = typename dyn_network_layer<T>::batch; ///< The type of a batch
+
+    size_t nv;  ///< The number of inputs
+    size_t nh;  ///< The number of outputs
+    function f; ///< The activation function
+
+    etl::dyn_matrix<T, 2> w; ///< The weights
+    etl::dyn_matrix<T, 1> b; ///< The biases
+
+    etl::dyn_matrix<T, 2> w_grad; ///< The gradients of the weights
+    etl::dyn_matrix<T, 1> b_grad; ///< The gradients of the biases
+    etl::dyn_matrix<T, 2> w_inc;  ///< The increments of the weights
+    etl::dyn_matrix<T, 1> b_inc;  ///< The increments of the biases
+
+    dyn_network_dense(size_t nv, size_t nh, function f)
+            : nv(nv), nh(nh), f(f), w(nv, nh), b(nh), w_grad(nv, nh), b_grad(nh), w_inc(nv, nh, T(0)), b_inc(nh, T(0)) {
+        init_xavier::initialize(w, nv, nh);
+        init_zero::initialize(b, nv, nh);
+    }
+
+    size_t input_size() const noexcept override {
+        return nv;
+    }
+
+    size_t output_size() const noexcept override {
+        return nh;
+    }
+
+    size_t parameters() const noexcept override {
+        return nv * nh;
+    }
+
+    std::string to_short_string() const override {
+        char buffer[512];
+
+        if (f == function::IDENTITY) {
+            snprintf(buffer, 512, "Dense(net): %lu -> %lu", nv, nh);
+        } else {
+            snprintf(buffer, 512, "Dense(net): %lu -> %s -> %lu", nv, to_string(f).c_str(), nh);
+        }
+
+        return {buffer};
+    }
+
+    function activation() const noexcept override {
+        return f;
+    }
+
+    void forward_batch(batch& output, const batch& input) const override {
+        dll::auto_timer timer("net:dense:forward_batch");
+
+        output = input * w;
+        output = bias_add_2d(output, b);
+
+        dyn_network_detail::activate(f, output);
+    }
+
+    void backward_batch(batch& input_errors, const batch& errors, const batch& input, const batch& output) const override {
+        dll::auto_timer timer("net:dense:backward_batch");
+
+        cpp_unused(input);
+        cpp_unused(output);
+
+        input_errors = errors * etl::transpose(w);
+    }
+
+    void compute_gradients(const batch& input, const batch& errors) override {
+        dll::auto_timer timer("net:dense:compute_gradients");
+
+        w_grad = batch_outer(input, errors);
+        b_grad = bias_batch_sum_2d(errors);
+    }
+
+    void apply_gradients(T eps, T momentum) override {
+        w_inc = momentum * w_inc - eps * w_grad;
+        b_inc = momentum * b_inc - eps * b_grad;
+
+        w += w_inc;
+        b += b_inc;
+    }
+};
+
+/*!
+ * \brief Convolutional layer (valid, with stride and padding) of a
+ * dyn_network, computed with the convolution engine
+ */
+template <typename T>
+struct dyn_network_conv final : dyn_network_layer<T> {
+    using batch = typename dyn_network_layer<T>::batch; ///< The type of a batch
+
+    size_t nc;  ///< The number of input channels
+    size_t nv1; ///< The first dimension of the input
+    size_t nv2; ///< The second dimension of the input
+    size_t k;   ///< The number of filters
+    size_t nw1; ///< The first dimension of the filters
+    size_t nw2; ///< The second dimension of the filters
+    size_t s1;  ///< The stride of the first dimension
+    size_t s2;  ///< The stride of the second dimension
+    size_t p1;  ///< The padding of the first dimension
+    size_t p2;  ///< The padding of the second dimension
+    size_t nh1; ///< The first dimension of the output
+    size_t nh2; ///< The second dimension of the output
+    function f; ///< The activation function
+
+    conv_algorithm engine = conv_algorithm::AUTO; ///< The convolution algorithm
+
+    etl::dyn_matrix<T, 4> w; ///< The filters
+    etl::dyn_matrix<T, 1> b; ///< The biases
+
+    etl::dyn_matrix<T, 4> w_grad; ///< The gradients of the filters
+    etl::dyn_matrix<T, 1> b_grad; ///< The gradients of the biases
+    etl::dyn_matrix<T, 4> w_inc;  ///< The increments of the filters
+    etl::dyn_matrix<T, 1> b_inc;  ///< The increments of the biases
+
+    dyn_network_conv(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, function f, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0)
+            : nc(nc), nv1(nv1), nv2(nv2), k(k), nw1(nw1), nw2(nw2), s1(s1), s2(s2), p1(p1), p2(p2),
+              nh1((nv1 + 2 * p1 - nw1) / s1 + 1), nh2((nv2 + 2 * p2 - nw2) / s2 + 1), f(f),
+              w(k, nc, nw1, nw2), b(k), w_grad(k, nc, nw1, nw2), b_grad(k), w_inc(k, nc, nw1, nw2, T(0)), b_inc(k, T(0)) {
+        cpp_assert(s1 > 0 && s2 > 0, "The stride must be at least 1");
+        cpp_assert(nv1 + 2 * p1 >= nw1 && nv2 + 2 * p2 >= nw2, "The filters must fit in the padded input");
+        cpp_assert(f != function::SOFTMAX, "Softmax is only supported by the dense layers");
+
+        init_xavier::initialize(w, nc * nw1 * nw2, k * nw1 * nw2);
+        init_zero::initialize(b, nc * nw1 * nw2, k * nw1 * nw2);
+    }
+
+    size_t input_size() const noexcept override {
+        return nc * nv1 * nv2;
+    }
+
+    size_t output_size() const noexcept override {
+        return k * nh1 * nh2;
+    }
+
+    size_t parameters() const noexcept override {
+        return k * nc * nw1 * nw2;
+    }
+
+    std::string to_short_string() const override {
+        char buffer[512];
+        char filter[128];
+
+        if (s1 == 1 && s2 == 1 && p1 == 0 && p2 == 0) {
+            snprintf(filter, 128, "%lux%lux%lu", k, nw1, nw2);
+        } else {
+            snprintf(filter, 128, "%lux%lux%lu s%lux%lu p%lux%lu", k, nw1, nw2, s1, s2, p1, p2);
+        }
+
+        if (f == function::IDENTITY) {
+            snprintf(buffer, 512, "Conv(net): %lux%lux%lu -> (%s) -> %lux%lux%lu", nc, nv1, nv2, filter, k, nh1, nh2);
+        } else {
+            snprintf(buffer, 512, "Conv(net): %lux%lux%lu -> (%s) -> %s -> %lux%lux%lu", nc, nv1, nv2, filter, to_string(f).c_str(), k, nh1, nh2);
+        }
+
+        return {buffer};
+    }
+
+    function activation() const noexcept override {
+        return f;
+    }
+
+    void forward_batch(batch& output, const batch& input) const override {
+        dll::auto_timer timer("net:conv:forward_batch");
+
+        const size_t B = etl::dim<0>(input);
+
+        auto x = etl::reshape(input, B, nc, nv1, nv2);
+        auto y = etl::reshape(output, B, k, nh1, nh2);
+
+        conv_engine_forward(engine, y, x, w, s1, s2, p1, p2);
+
+        y = bias_add_4d(y, b);
+
+        dyn_network_detail::activate(f, output);
+    }
+
+    void backward_batch(batch& input_errors, const batch& errors, const batch& input, const batch& output) const override {
+        dll::auto_timer timer("net:conv:backward_batch");
+
+        cpp_unused(input);
+        cpp_unused(output);
+
+        const size_t B = etl::dim<0>(errors);
+
+        auto dx = etl::reshape(input_errors, B, nc, nv1, nv2);
+
+        conv_engine_backward(engine, dx, etl::reshape(errors, B, k, nh1, nh2), w, s1, s2, p1, p2);
+    }
+
+    void compute_gradients(const batch& input, const batch& errors) override {
+        dll::auto_timer timer("net:conv:compute_gradients");
+
+        const size_t B = etl::dim<0>(input);
+
+        auto dy = etl::reshape(errors, B, k, nh1, nh2);
+
+        conv_engine_backward_filter(engine, w_grad, etl::reshape(input, B, nc, nv1, nv2), dy, s1, s2, p1, p2);
+
+        b_grad = etl::bias_batch_sum_4d(dy);
+    }
+
+    void apply_gradients(T eps, T momentum) override {
+        w_inc = momentum * w_inc - eps * w_grad;
+        b_inc = momentum * b_inc - eps * b_grad;
+
+        w += w_inc;
+        b += b_inc;
+    }
+};
+
+/*!
+ * \brief Max pooling layer (non-overlapping) of a dyn_network
+ */
+template <typename T>
+struct dyn_network_mp final : dyn_network_layer<T> {
+    using batch = typename dyn_network_layer<T>::batch; ///< The type of a batch
+
+    size_t nc;  ///< The number of channels
+    size_t nv1; ///< The first dimension of the input
+    size_t nv2; ///< The second dimension of the input
+    size_t c1;  ///< The first pooling factor
+    size_t c2;  ///< The second pooling factor
+
+    dyn_network_mp(size_t nc, size_t nv1, size_t nv2, size_t c1, size_t c2)
+            : nc(nc), nv1(nv1), nv2(nv2), c1(c1), c2(c2) {
+        cpp_assert(c1 > 0 && c2 > 0 && nv1 % c1 == 0 && nv2 % c2 == 0, "The pooling factors must divide the input");
+    }
+
+    size_t input_size() const noexcept override {
+        return nc * nv1 * nv2;
+    }
+
+    size_t output_size() const noexcept override {
+        return nc * (nv1 / c1) * (nv2 / c2);
+    }
+
+    size_t parameters() const noexcept override {
+        return 0;
+    }
+
+    std::string to_short_string() const override {
+        char buffer[512];
+        snprintf(buffer, 512, "MP(net): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu", nc, nv1, nv2, c1, c2, nc, nv1 / c1, nv2 / c2);
+        return {buffer};
+    }
+
+    void forward_batch(batch& output, const batch& input) const override {
+        dll::auto_timer timer("net:mp:forward_batch");
+
+        const size_t B   = etl::dim<0>(input);
+        const size_t nh1 = nv1 / c1;
+        const size_t nh2 = nv2 / c2;
+
+        dll::host_read(input);
+
+        const T* x = input.memory_start();
+        T* y       = output.memory_start();
+
+        for (size_t bc = 0; bc < B * nc; ++bc) {
+            const T* xc = x + bc * nv1 * nv2;
+            T* yc       = y + bc * nh1 * nh2;
+
+            for (size_t i = 0; i < nh1; ++i) {
+                for (size_t j = 0; j < nh2; ++j) {
+                    T m = xc[(i * c1) * nv2 + j * c2];
+
+                    for (size_t ii = 0; ii < c1; ++ii) {
+                        for (size_t jj = 0; jj < c2; ++jj) {
+                            m = std::max(m, xc[(i * c1 + ii) * nv2 + j * c2 + jj]);
+                        }
+                    }
+
+                    yc[i * nh2 + j] = m;
+                }
+            }
+        }
+
+        dll::host_written(output);
+    }
+
+    /*!
+     * \brief The adapt_errors of the pooling layer does nothing, there is no
+     * activation function.
+     */
+    void adapt_errors(batch& errors, const batch& output) const override {
+        cpp_unused(errors);
+        cpp_unused(output);
+    }
+
+    /*!
+     * \copydoc dyn_network_layer::backward_batch
+     *
+     * The errors of each window are given to the first input equal to its
+     * maximum.
+     */
+    void backward_batch(batch& input_errors, const batch& errors, const batch& input, const batch& output) const override {
+        dll::auto_timer timer("net:mp:backward_batch");
+
+        const size_t B   = etl::dim<0>(input);
+        const size_t nh1 = nv1 / c1;
+        const size_t nh2 = nv2 / c2;
+
+        dll::host_read(errors, input, output);
+
+        const T* x  = input.memory_start();
+        const T* y  = output.memory_start();
+        const T* dy = errors.memory_start();
+        T* dx       = input_errors.memory_start();
+
+        std::fill(dx, dx + B * nc * nv1 * nv2, T(0));
+
+        for (size_t bc = 0; bc < B * nc; ++bc) {
+            const T* xc  = x + bc * nv1 * nv2;
+            const T* yc  = y + bc * nh1 * nh2;
+            const T* dyc = dy + bc * nh1 * nh2;
+            T* dxc       = dx + bc * nv1 * nv2;
+
+            for (size_t i = 0; i < nh1; ++i) {
+                for (size_t j = 0; j < nh2; ++j) {
+                    bool found = false;
+
+                    for (size_t ii = 0; ii < c1 && !found; ++ii) {
+                        for (size_t jj = 0; jj < c2 && !found; ++jj) {
+                            const size_t index = (i * c1 + ii) * nv2 + j * c2 + jj;
+
+                            if (xc[index] == yc[i * nh2 + j]) {
+                                dxc[index] = dyc[i * nh2 + j];
+                                found      = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        dll::host_written(input_errors);
+    }
+};
+
+/*!
+ * \brief A network whose layers are added at runtime.
+ *
+ * The network is trained with mini-batch gradient descent, with momentum,
+ * on the cross-entropy loss when the last layer is a softmax or sigmoid
+ * layer and on the mean squared error otherwise.
+ */
+template <typename T>
+struct dyn_network {
+    using weight  = T;                       ///< The data type of the network
+    using layer_t = dyn_network_layer<T>;    ///< The type of the layers
+    using batch   = typename layer_t::batch; ///< The type of a batch
+
+    std::vector<std::unique_ptr<layer_t>> layers; ///< The layers of the network
+
+    size_t batch_size = 25;   ///< The size of the mini-batches
+    T learning_rate   = 0.1;  ///< The learning rate
+    T momentum        = 0.9;  ///< The momentum
+    bool shuffle      = true; ///< Shuffle the samples before each epoch
+
+    /*!
+     * \brief Add a dense layer
+     * \return a reference to the added layer
+     */
+    dyn_network_dense<T>& add_dense(size_t nv, size_t nh, function f = function::SIGMOID) {
+        return add(std::make_unique<dyn_network_dense<T>>(nv, nh, f));
+    }
+
+    /*!
+     * \brief Add a convolutional layer with k filters of nc x nw1 x nw2
+     * \return a reference to the added layer
+     */
+    dyn_network_conv<T>& add_conv(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, function f = function::SIGMOID, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+        return add(std::make_unique<dyn_network_conv<T>>(nc, nv1, nv2, k, nw1, nw2, f, s1, s2, p1, p2));
+    }
+
+    /*!
+     * \brief Add a max pooling layer
+     * \return a reference to the added layer
+     */
+    dyn_network_mp<T>& add_mp(size_t nc, size_t nv1, size_t nv2, size_t c1, size_t c2) {
+        return add(std::make_unique<dyn_network_mp<T>>(nc, nv1, nv2, c1, c2));
+    }
+
+    /*!
+     * \brief Returns the number of layers of the network
+     */
+    size_t size() const noexcept {
+        return layers.size();
+    }
+
+    /*!
+     * \brief Return the size of the input of the network
+     */
+    size_t input_size() const noexcept {
+        return layers.front()->input_size();
+    }
+
+    /*!
+     * \brief Return the size of the output of the network
+     */
+    size_t output_size() const noexcept {
+        return layers.back()->output_size();
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of the network
+     */
+    size_t parameters() const noexcept {
+        size_t parameters = 0;
+
+        for (auto& layer : layers) {
+            parameters += layer->parameters();
+        }
+
+        return parameters;
+    }
+
+    /*!
+     * \brief Display the layers of the network
+     */
+    void display() const {
+        std::cout << "Network with " << layers.size() << " layers" << std::endl;
+
+        for (auto& layer : layers) {
+            std::cout << "    " << layer->to_short_string() << std::endl;
+        }
+
+        std::cout << "Total parameters: " << parameters() << std::endl;
+    }
+
+    /*!
+     * \brief Compute the output of the network for a batch of samples
+     * \param input The batch of samples (B x input_size())
+     * \return The batch of outputs (B x output_size())
+     */
+    batch forward_batch(const batch& input) const {
+        cpp_assert(!layers.empty(), "The network has no layers");
+
+        batch current = input;
+
+        for (auto& layer : layers) {
+            batch next(etl::dim<0>(current), layer->output_size());
+            layer->forward_batch(next, current);
+            current = std::move(next);
+        }
+
+        return current;
+    }
+
+    /*!
+     * \brief Predict the labels of a batch of samples
+     * \return the label (the index of the maximum output) of each sample
+     */
+    std::vector<size_t> predict(const batch& samples) const {
+        auto output = forward_batch(samples);
+
+        std::vector<size_t> labels(etl::dim<0>(output));
+
+        for (size_t i = 0; i < labels.size(); ++i) {
+            labels[i] = etl::max_index(output(i));
+        }
+
+        return labels;
+    }
+
+    /*!
+     * \brief Compute the classification error of the network
+     * \param samples The samples (N x input_size())
+     * \param labels The labels of the samples
+     * \return the ratio of misclassified samples
+     */
+    double evaluate_error(const batch& samples, const std::vector<size_t>& labels) const {
+        cpp_assert(etl::dim<0>(samples) == labels.size(), "There must be as many labels as samples");
+
+        auto predicted = predict(samples);
+
+        size_t errors = 0;
+
+        for (size_t i = 0; i < labels.size(); ++i) {
+            errors += predicted[i] != labels[i];
+        }
+
+        return errors / double(labels.size());
+    }
+
+    /*!
+     * \brief Train the network for the given number of epochs
+     * \param samples The samples (N x input_size())
+     * \param labels The labels of the samples
+     * \param epochs The number of epochs
+     * \return the classification error on the samples after training
+     */
+    double fine_tune(const batch& samples, const std::vector<size_t>& labels, size_t epochs) {
+        cpp_assert(!layers.empty(), "The network has no layers");
+        cpp_assert(etl::dim<0>(samples) == labels.size(), "There must be as many labels as samples");
+        cpp_assert(etl::dim<1>(samples) == input_size(), "The samples must be of the input size of the network");
+
+        const size_t n = labels.size();
+        const size_t L = layers.size();
+
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        std::vector<batch> outputs(L + 1);
+        std::vector<batch> errors(L + 1);
+
+        double error = 1.0;
+
+        for (size_t epoch = 0; epoch < epochs; ++epoch) {
+            dll::auto_timer timer("net:epoch");
+
+            if (shuffle) {
+                std::shuffle(order.begin(), order.end(), dll::random_engine());
+            }
+
+            for (size_t start = 0; start < n; start += batch_size) {
+                const size_t B = std::min(batch_size, n - start);
+
+                // Gather the batch, the last one may be smaller
+                if (etl::dim<0>(outputs[0]) != B) {
+                    outputs[0] = batch(B, input_size());
+                    errors[L]  = batch(B, output_size());
+
+                    for (size_t l = 0; l < L; ++l) {
+                        outputs[l + 1] = batch(B, layers[l]->output_size());
+                        errors[l]      = batch(B, layers[l]->input_size());
+                    }
+                }
+
+                for (size_t i = 0; i < B; ++i) {
+                    outputs[0](i) = samples(order[start + i]);
+                }
+
+                for (size_t l = 0; l < L; ++l) {
+                    layers[l]->forward_batch(outputs[l + 1], outputs[l]);
+                }
+
+                // The errors of the output: y - t
+                errors[L] = outputs[L];
+
+                for (size_t i = 0; i < B; ++i) {
+                    errors[L](i, labels[order[start + i]]) -= T(1);
+                }
+
+                // With the cross-entropy, the errors are already those of the
+                // activation of the last layer
+                const auto last = layers.back()->activation();
+                const bool cross_entropy = last == function::SOFTMAX || last == function::SIGMOID;
+
+                for (size_t l = L; l-- > 0;) {
+                    if (l + 1 < L || !cross_entropy) {
+                        layers[l]->adapt_errors(errors[l + 1], outputs[l + 1]);
+                    }
+
+                    layers[l]->compute_gradients(outputs[l], errors[l + 1]);
+
+                    if (l > 0) {
+                        layers[l]->backward_batch(errors[l], errors[l + 1], outputs[l], outputs[l + 1]);
+                    }
+                }
+
+                for (auto& layer : layers) {
+                    layer->apply_gradients(learning_rate / B, momentum);
+                }
+            }
+
+            error = evaluate_error(samples, labels);
+
+            std::cout << "epoch " << epoch << " - Classification error: " << error << std::endl;
+        }
+
+        return error;
+    }
+
+private:
+    /*!
+     * \brief Add the given layer, which must take the output of the
+     * previous layer as input
+     */
+    template <typename Layer>
+    Layer& add(std::unique_ptr<Layer>&& layer) {
+        cpp_assert(layers.empty() || layers.back()->output_size() == layer->input_size(), "The input of the layer must be the output of the previous layer");
+
+        auto& ref = *layer;
+        layers.emplace_back(std::move(layer));
+        return ref;
+    }
+};
+
+} //end of dll namespace
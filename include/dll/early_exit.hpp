@@ -0,0 +1,409 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Early-exit inference with classifier heads after some layers of
+ * a network.
+ *
+ * A head is a linear classifier on the output of a layer, trained after
+ * the network on the features of that layer (see linear_classifier.hpp).
+ * The samples are forwarded one layer at a time and each sample stops at
+ * the first head whose softmax confidence reaches the threshold. In the
+ * batched path, the unresolved samples of a batch are compacted into a
+ * smaller batch before being forwarded to the next layers.
+ *
+ * The early exit only references the network, which must outlive it and
+ * whose heads must be trained again after the network has been trained.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/linear_classifier.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/chunk.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A network with early exits after some of its layers
+ */
+template <typename DBN>
+struct early_exit {
+    using dbn_t  = DBN;                    ///< The type of the network
+    using weight = typename dbn_t::weight; ///< The data type of the network
+
+    static constexpr size_t layers     = dbn_t::layers;     ///< The number of layers of the network
+    static constexpr size_t batch_size = dbn_t::batch_size; ///< The number of samples forwarded at once
+
+    /*!
+     * \brief A classifier head on the output of a layer
+     */
+    struct head {
+        etl::dyn_matrix<weight, 2> w; ///< The weights (classes x features)
+        etl::dyn_matrix<weight, 1> b; ///< The bias of each class
+        std::vector<size_t> labels;   ///< The label of each class
+
+        /*!
+         * \brief Indicates if the head is used
+         */
+        bool active() const {
+            return !labels.empty();
+        }
+    };
+
+    double threshold; ///< The softmax confidence from which a head predicts a sample
+
+    std::array<head, layers> heads; ///< The head after each layer (never after the last layer)
+
+    /*!
+     * \brief Create an early exit for the given network, without any head
+     * \param dbn The network
+     * \param threshold The softmax confidence from which a head predicts a sample
+     */
+    explicit early_exit(const dbn_t& dbn, double threshold = 0.9) : threshold(threshold), dbn(dbn) {
+        reset_exits();
+    }
+
+    /*!
+     * \brief Use the given linear classifier as the head after the layer l
+     * \param l The layer
+     * \param model The classifier of the features of the layer l
+     */
+    void set_head(size_t l, const linear_model& model) {
+        cpp_assert(l + 1 < layers, "There is no head after the last layer");
+
+        auto& h = heads[l];
+
+        h.w = etl::dyn_matrix<weight, 2>(model.classes(), model.features());
+        h.b = etl::dyn_matrix<weight, 1>(model.classes());
+
+        std::copy(model.w.begin(), model.w.end(), h.w.begin());
+        std::copy(model.b.begin(), model.b.end(), h.b.begin());
+
+        h.labels.resize(model.classes());
+
+        for (size_t k = 0; k < model.classes(); ++k) {
+            h.labels[k] = size_t(model.labels[k]);
+        }
+    }
+
+    /*!
+     * \brief Remove the head after the layer l
+     */
+    void remove_head(size_t l) {
+        heads[l] = head();
+    }
+
+    /*!
+     * \brief Train the head after the layer L on the features of the given
+     * samples
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \param lfirst Iterator to the first label
+     * \param llast Iterator to the past-the-end label
+     * \param parameters The parameters of the training of the head
+     * \return true if the head has been trained, false otherwise
+     */
+    template <size_t L, typename Iterator, typename LIterator>
+    bool train_head(Iterator first, Iterator last, LIterator lfirst, LIterator llast, const linear_parameters& parameters = head_parameters()) {
+        static_assert(L + 1 < layers, "There is no head after the last layer");
+
+        dll::auto_timer timer("early_exit:train_head");
+
+        const size_t n      = std::distance(first, last);
+        const size_t chunks = (n + batch_size - 1) / batch_size;
+
+        std::vector<double> labels(lfirst, llast);
+
+        if (!n || labels.size() != n) {
+            return false;
+        }
+
+        std::vector<etl::dyn_matrix<weight, 2>> parts(chunks);
+
+        parallel_for_n(chunks, [&](size_t c) {
+            auto input = stage_chunk<weight>(first, c, n, batch_size);
+
+            parts[c] = flatten(dbn.template test_forward_batch<L>(input));
+        });
+
+        const size_t F = etl::dim<1>(parts[0]);
+
+        etl::dyn_matrix<weight, 2> features(n, F);
+
+        for (size_t c = 0; c < chunks; ++c) {
+            std::copy(parts[c].begin(), parts[c].end(), features.begin() + c * batch_size * F);
+        }
+
+        auto model = train_linear(dbn.pool, features, labels, parameters);
+
+        if (model.classes() < 2) {
+            return false;
+        }
+
+        set_head(L, model);
+
+        return true;
+    }
+
+    /*!
+     * \copydoc train_head
+     */
+    template <size_t L, typename Samples, typename Labels>
+    bool train_head(const Samples& samples, const Labels& labels, const linear_parameters& parameters = head_parameters()) {
+        return train_head<L>(samples.begin(), samples.end(), labels.begin(), labels.end(), parameters);
+    }
+
+    /*!
+     * \brief Return the default parameters of the heads, a softmax
+     * regression whose scores are the confidences of the heads
+     */
+    static linear_parameters head_parameters() {
+        linear_parameters parameters;
+        parameters.type = linear_type::LOGISTIC;
+        return parameters;
+    }
+
+    /*!
+     * \brief Predict the labels of the given batch, the unresolved samples
+     * being compacted after each head
+     * \param batch The input batch
+     * \return the predicted label of each sample
+     */
+    template <typename Input>
+    std::vector<size_t> predict_batch(const Input& batch) const {
+        dll::auto_timer timer("early_exit:predict_batch");
+
+        const size_t n = etl::dim<0>(batch);
+
+        std::vector<size_t> index(n);
+        std::iota(index.begin(), index.end(), 0);
+
+        std::vector<size_t> predicted(n);
+
+        auto input = chunk_detail::make_chunk<weight>(n, batch(0), std::make_index_sequence<etl::decay_traits<Input>::dimensions() - 1>());
+
+        input = batch;
+
+        route_batch<0>(input, index, predicted.data());
+
+        return predicted;
+    }
+
+    /*!
+     * \brief Predict the labels of the given range of samples, the chunks
+     * being computed in parallel
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \return the predicted label of each sample
+     */
+    template <typename Iterator>
+    std::vector<size_t> predict_many(const Iterator& first, const Iterator& last) const {
+        dll::auto_timer timer("early_exit:predict_many");
+
+        const size_t n      = std::distance(first, last);
+        const size_t chunks = (n + batch_size - 1) / batch_size;
+
+        std::vector<size_t> predicted(n);
+
+        parallel_for_n(chunks, [&](size_t c) {
+            auto input = stage_chunk<weight>(first, c, n, batch_size);
+
+            std::vector<size_t> index(etl::dim<0>(input));
+            std::iota(index.begin(), index.end(), 0);
+
+            this->route_batch<0>(input, index, predicted.data() + c * batch_size);
+        });
+
+        return predicted;
+    }
+
+    /*!
+     * \copydoc predict_many
+     */
+    template <typename Samples>
+    std::vector<size_t> predict_many(const Samples& samples) const {
+        return predict_many(samples.begin(), samples.end());
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     * \param sample The sample to predict the label for
+     * \return the predicted label
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) const {
+        auto input = chunk_detail::make_chunk<weight>(1, sample, std::make_index_sequence<etl::decay_traits<Input>::dimensions()>());
+
+        input(0) = sample;
+
+        std::vector<size_t> index{0};
+        size_t predicted = 0;
+
+        route_batch<0>(input, index, &predicted);
+
+        return predicted;
+    }
+
+    /*!
+     * \brief Return the number of samples predicted after each layer since
+     * the last reset, the last layer being the output of the network
+     */
+    std::vector<size_t> exits() const {
+        std::vector<size_t> counts(layers);
+
+        for (size_t l = 0; l < layers; ++l) {
+            counts[l] = exit_counts[l];
+        }
+
+        return counts;
+    }
+
+    /*!
+     * \brief Reset the numbers of samples predicted after each layer
+     */
+    void reset_exits() {
+        for (auto& count : exit_counts) {
+            count = 0;
+        }
+    }
+
+private:
+    const dbn_t& dbn; ///< The network
+
+    mutable std::array<std::atomic<size_t>, layers> exit_counts; ///< The number of samples predicted after each layer
+
+    /*!
+     * \brief Return a batch of outputs as a matrix (samples x features)
+     */
+    template <typename Output>
+    static etl::dyn_matrix<weight, 2> flatten(const Output& output) {
+        const size_t m = etl::dim<0>(output);
+
+        etl::dyn_matrix<weight, 2> matrix(m, etl::size(output) / m);
+
+        dll::host_read(output);
+
+        std::copy(output.memory_start(), output.memory_end(), matrix.memory_start());
+
+        dll::host_written(matrix);
+
+        return matrix;
+    }
+
+    /*!
+     * \brief Forward the batch through the layer L and predict the samples
+     * resolved by its head, the others being forwarded to the next layers.
+     *
+     * \param input The input batch of the layer L
+     * \param index The index of each sample of the batch in the predictions
+     * \param predicted The predictions
+     */
+    template <size_t L, typename Input, cpp_enable_iff((L + 1 < layers))>
+    void route_batch(const Input& input, const std::vector<size_t>& index, size_t* predicted) const {
+        auto output = etl::force_temporary(dbn.template test_forward_batch<L, L>(input));
+
+        const auto& h = heads[L];
+
+        if (!h.active()) {
+            route_batch<L + 1>(output, index, predicted);
+            return;
+        }
+
+        const size_t m = index.size();
+
+        etl::dyn_matrix<weight, 2> scores(m, h.labels.size());
+
+        scores = flatten(output) * etl::transpose(h.w);
+
+        dll::host_read(scores);
+
+        // The rows of the unresolved samples
+        std::vector<size_t> rest;
+
+        for (size_t i = 0; i < m; ++i) {
+            auto row = scores(i);
+
+            for (size_t k = 0; k < h.labels.size(); ++k) {
+                row[k] += h.b[k];
+            }
+
+            const size_t best = std::distance(row.begin(), std::max_element(row.begin(), row.end()));
+
+            // The softmax of the best class is 1 / sum(exp(s - max))
+            double sum = 0.0;
+
+            for (size_t k = 0; k < h.labels.size(); ++k) {
+                sum += std::exp(double(row[k] - row[best]));
+            }
+
+            if (1.0 / sum >= threshold) {
+                predicted[index[i]] = h.labels[best];
+            } else {
+                rest.push_back(i);
+            }
+        }
+
+        exit_counts[L] += m - rest.size();
+
+        if (rest.empty()) {
+            return;
+        }
+
+        if (rest.size() == m) {
+            route_batch<L + 1>(output, index, predicted);
+            return;
+        }
+
+        // Only the unresolved samples are forwarded to the next layers
+        auto next = chunk_detail::make_chunk<weight>(rest.size(), output(0), std::make_index_sequence<etl::decay_traits<decltype(output)>::dimensions() - 1>());
+
+        std::vector<size_t> next_index(rest.size());
+
+        for (size_t i = 0; i < rest.size(); ++i) {
+            next(i)       = output(rest[i]);
+            next_index[i] = index[rest[i]];
+        }
+
+        route_batch<L + 1>(next, next_index, predicted);
+    }
+
+    /*!
+     * \brief Forward the batch through the last layer and predict all its
+     * samples with the output of the network
+     *
+     * \param input The input batch of the last layer
+     * \param index The index of each sample of the batch in the predictions
+     * \param predicted The predictions
+     */
+    template <size_t L, typename Input, cpp_enable_iff((L + 1 == layers))>
+    void route_batch(const Input& input, const std::vector<size_t>& index, size_t* predicted) const {
+        auto output = flatten(dbn.template test_forward_batch<L, L>(input));
+
+        for (size_t i = 0; i < index.size(); ++i) {
+            auto row = output(i);
+
+            predicted[index[i]] = std::distance(row.begin(), std::max_element(row.begin(), row.end()));
+        }
+
+        exit_counts[L] += index.size();
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,223 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference of an ensemble of networks in a single pass over the
+ * data.
+ *
+ * The inputs are staged once per batch and forwarded through all the
+ * networks of the ensemble, in parallel, the weighted average of their
+ * outputs being the output of the ensemble. The networks can be of any
+ * types, as long as they have outputs of the same size.
+ *
+ * The ensemble only references the networks, which must outlive it.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/batch_reshape.hpp"
+#include "dll/util/chunk.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An ensemble of networks, whose prediction is the weighted
+ * average of the predictions of its networks.
+ */
+template <typename... DBN>
+struct ensemble {
+    static_assert(sizeof...(DBN) > 0, "An ensemble needs at least one network");
+
+    using first_t = std::tuple_element_t<0, std::tuple<DBN...>>; ///< The type of the first network
+    using weight  = typename first_t::weight;                     ///< The data type of the ensemble
+
+    static constexpr size_t members    = sizeof...(DBN);       ///< The number of networks
+    static constexpr size_t batch_size = first_t::batch_size;  ///< The number of samples staged at once
+
+    using output_t = etl::dyn_matrix<weight, 2>; ///< The type of the outputs of a batch (samples x outputs)
+
+    std::array<weight, members> weights; ///< The weight of each network in the average
+
+    /*!
+     * \brief Create an ensemble of the given networks, with the same weight
+     * for each of them
+     */
+    explicit ensemble(const DBN&... dbn) : networks(dbn...) {
+        weights.fill(weight(1.0) / weight(members));
+    }
+
+    /*!
+     * \brief Return the average output of the networks for the given batch
+     * \param batch The input batch
+     * \return The averaged output (samples x outputs)
+     */
+    template <typename Input>
+    output_t forward_batch(const Input& batch) const {
+        dll::auto_timer timer("ensemble:forward_batch");
+
+        std::array<output_t, members> outputs;
+
+        forward_members(batch, outputs, std::make_index_sequence<members>());
+
+        return average(outputs);
+    }
+
+    /*!
+     * \brief Return the average outputs of the networks for the given
+     * range of samples.
+     *
+     * Each chunk of samples is staged once for all the networks; the
+     * chunks and the networks are computed in parallel.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \return The averaged outputs (samples x outputs)
+     */
+    template <typename Iterator>
+    output_t forward_many(const Iterator& first, const Iterator& last) const {
+        dll::auto_timer timer("ensemble:forward_many");
+
+        const size_t n      = std::distance(first, last);
+        const size_t chunks = (n + batch_size - 1) / batch_size;
+
+        std::vector<output_t> results(chunks);
+
+        parallel_for_n(chunks, [&](size_t c) {
+            auto input = stage_chunk<weight>(first, c, n, batch_size);
+
+            results[c] = forward_batch(input);
+        });
+
+        const size_t width = chunks ? etl::dim<1>(results[0]) : 0;
+
+        output_t out(n, width);
+
+        for (size_t c = 0; c < chunks; ++c) {
+            std::copy(results[c].begin(), results[c].end(), out.begin() + c * batch_size * width);
+        }
+
+        return out;
+    }
+
+    /*!
+     * \copydoc forward_many
+     */
+    template <typename Samples>
+    output_t forward_many(const Samples& samples) const {
+        return forward_many(samples.begin(), samples.end());
+    }
+
+    /*!
+     * \brief Predict the labels of the given range of samples
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \return the predicted label of each sample
+     */
+    template <typename Iterator>
+    std::vector<size_t> predict_many(const Iterator& first, const Iterator& last) const {
+        auto out = forward_many(first, last);
+
+        std::vector<size_t> predicted(etl::dim<0>(out));
+
+        for (size_t i = 0; i < predicted.size(); ++i) {
+            auto row     = out(i);
+            predicted[i] = std::distance(row.begin(), std::max_element(row.begin(), row.end()));
+        }
+
+        return predicted;
+    }
+
+    /*!
+     * \copydoc predict_many
+     */
+    template <typename Samples>
+    std::vector<size_t> predict_many(const Samples& samples) const {
+        return predict_many(samples.begin(), samples.end());
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     * \param sample The sample to predict the label for
+     * \return the predicted label
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) const {
+        auto out = forward_batch(batch_reshape(sample));
+        auto row = out(0);
+
+        return std::distance(row.begin(), std::max_element(row.begin(), row.end()));
+    }
+
+private:
+    std::tuple<const DBN&...> networks; ///< The networks of the ensemble
+
+    template <typename Input>
+    using member_t = void (ensemble::*)(const Input&, output_t&) const;
+
+    /*!
+     * \brief Compute the output of the network I for the given batch
+     */
+    template <size_t I, typename Input>
+    void forward_member(const Input& batch, output_t& output) const {
+        decltype(auto) out = std::get<I>(networks).forward_batch(batch);
+
+        const size_t B = etl::dim<0>(out);
+
+        output = output_t(B, etl::size(out) / B);
+
+        std::copy(out.begin(), out.end(), output.begin());
+    }
+
+    /*!
+     * \brief Compute the outputs of all the networks, in parallel
+     */
+    template <typename Input, size_t... I>
+    void forward_members(const Input& batch, std::array<output_t, members>& outputs, std::index_sequence<I...> /*seq*/) const {
+        static constexpr member_t<Input> functions[] = {&ensemble::template forward_member<I, Input>...};
+
+        parallel_for_n(members, [&](size_t i) {
+            (this->*functions[i])(batch, outputs[i]);
+        });
+    }
+
+    /*!
+     * \brief Return the weighted average of the given outputs
+     */
+    output_t average(const std::array<output_t, members>& outputs) const {
+        output_t result(etl::dim<0>(outputs[0]), etl::dim<1>(outputs[0]));
+
+        result = weights[0] * outputs[0];
+
+        for (size_t i = 1; i < members; ++i) {
+            cpp_assert(etl::size(outputs[i]) == etl::size(result), "The networks of an ensemble must have outputs of the same size");
+
+            result += weights[i] * outputs[i];
+        }
+
+        return result;
+    }
+};
+
+/*!
+ * \brief Create an ensemble of the given networks
+ */
+template <typename... DBN>
+ensemble<DBN...> make_ensemble(const DBN&... dbn) {
+    return ensemble<DBN...>(dbn...);
+}
+
+} //end of dll namespace
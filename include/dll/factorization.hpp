@@ -0,0 +1,510 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Low-rank factorization of the dense layers of a trained network.
+ *
+ * The weights W (visible x hidden) of a factorized layer are replaced by
+ * the truncated singular value decomposition A * B, with A (visible x rank)
+ * and B (rank x hidden). In the factorized network, the layer is replaced
+ * by two dense layers: a linear layer A without biases (identity activation,
+ * no_bias) and a layer B with the biases and the activation of the original
+ * layer. The cost of the layer goes from visible * hidden to
+ * rank * (visible + hidden). Both layers are standard dense layers, trained
+ * by the SGD trainer like any other layer when the factorized network is
+ * fine-tuned.
+ *
+ * The rank of each factorized layer is either given or the smallest rank
+ * keeping the given ratio of the energy (the sum of the squared singular
+ * values) of the weights.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <tuple>
+#include <vector>
+#include <sstream>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The options of the factorization
+ */
+struct factorization_options {
+    std::vector<size_t> ranks; ///< The rank of each factorized layer, in order (0 or missing to use the energy)
+    double energy = 0.9;       ///< The ratio of the energy of the weights kept when the rank is not given
+};
+
+/*!
+ * \brief The result of a factorization
+ */
+struct factorization_report {
+    std::vector<size_t> ranks; ///< The rank of each factorized layer, in order
+    std::vector<double> energy; ///< The ratio of the energy kept by each factorized layer, in order
+
+    size_t parameters_before = 0; ///< The number of parameters before factorization
+    size_t parameters_after  = 0; ///< The number of parameters after factorization
+
+    std::tuple<double, double> before; ///< The error and the loss of the network before factorization
+    std::tuple<double, double> after;  ///< The error and the loss of the network after factorization
+};
+
+namespace factorize_detail {
+
+/*!
+ * \brief Compute the eigen decomposition of the given symmetric matrix with
+ * the cyclic Jacobi method.
+ *
+ * \param a The n x n symmetric matrix, destroyed
+ * \param n The dimension of the matrix
+ * \param values The eigen values, in decreasing order
+ * \param vectors The eigen vectors, as the columns of a n x n matrix, in the
+ * order of the values
+ */
+inline void symmetric_eigen(std::vector<double>& a, size_t n, std::vector<double>& values, std::vector<double>& vectors) {
+    std::vector<double> v(n * n, 0.0);
+
+    for (size_t i = 0; i < n; ++i) {
+        v[i * n + i] = 1.0;
+    }
+
+    double norm = 0.0;
+
+    for (auto x : a) {
+        norm += x * x;
+    }
+
+    for (size_t sweep = 0; sweep < 64; ++sweep) {
+        double off = 0.0;
+
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                off += a[p * n + q] * a[p * n + q];
+            }
+        }
+
+        if (off <= 1e-22 * norm) {
+            break;
+        }
+
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                const double apq = a[p * n + q];
+
+                if (std::abs(apq) < 1e-300) {
+                    continue;
+                }
+
+                const double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                const double t     = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c     = 1.0 / std::sqrt(t * t + 1.0);
+                const double s     = t * c;
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double akp = a[k * n + p];
+                    const double akq = a[k * n + q];
+
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double apk = a[p * n + k];
+                    const double aqk = a[q * n + k];
+
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double vkp = v[k * n + p];
+                    const double vkq = v[k * n + q];
+
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::sort(order.begin(), order.end(), [&a, n](size_t i, size_t j) { return a[i * n + i] > a[j * n + j]; });
+
+    values.resize(n);
+    vectors.resize(n * n);
+
+    for (size_t k = 0; k < n; ++k) {
+        values[k] = std::max(0.0, a[order[k] * n + order[k]]);
+
+        for (size_t i = 0; i < n; ++i) {
+            vectors[i * n + k] = v[i * n + order[k]];
+        }
+    }
+}
+
+/*!
+ * \brief Returns the rank keeping the given ratio of the energy
+ * \param values The squared singular values, in decreasing order
+ * \param energy The ratio of energy to keep
+ */
+inline size_t energy_rank(const std::vector<double>& values, double energy) {
+    const double total = std::accumulate(values.begin(), values.end(), 0.0);
+
+    double kept = 0.0;
+
+    for (size_t r = 0; r < values.size(); ++r) {
+        kept += values[r];
+
+        if (kept >= energy * total) {
+            return r + 1;
+        }
+    }
+
+    return values.size();
+}
+
+/*!
+ * \brief Factorize the given weights into A * B of the given rank, or of
+ * the rank keeping the given energy if the rank is zero.
+ *
+ * The decomposition is computed from the Gram matrix of the smallest
+ * dimension of the weights.
+ *
+ * \param w The visible x hidden weights
+ * \param rank The rank of the factorization (0 to use the energy)
+ * \param energy The ratio of the energy to keep
+ * \param a The visible x rank factor
+ * \param b The rank x hidden factor
+ * \param kept The ratio of the energy kept by the factorization
+ *
+ * \return The rank of the factorization
+ */
+template <typename W>
+size_t factorize_weights(const W& w, size_t rank, double energy, std::vector<double>& a, std::vector<double>& b, double& kept) {
+    const size_t nv = etl::dim<0>(w);
+    const size_t nh = etl::dim<1>(w);
+
+    const bool left = nv <= nh;
+    const size_t n  = left ? nv : nh;
+
+    // The Gram matrix W * W^T (left) or W^T * W
+    std::vector<double> gram(n * n, 0.0);
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i; j < n; ++j) {
+            double sum = 0.0;
+
+            if (left) {
+                for (size_t k = 0; k < nh; ++k) {
+                    sum += double(w(i, k)) * double(w(j, k));
+                }
+            } else {
+                for (size_t k = 0; k < nv; ++k) {
+                    sum += double(w(k, i)) * double(w(k, j));
+                }
+            }
+
+            gram[i * n + j] = sum;
+            gram[j * n + i] = sum;
+        }
+    }
+
+    std::vector<double> values;
+    std::vector<double> vectors;
+    symmetric_eigen(gram, n, values, vectors);
+
+    const size_t r = rank ? std::min(rank, n) : energy_rank(values, energy);
+
+    const double total = std::accumulate(values.begin(), values.end(), 0.0);
+    kept = total > 0.0 ? std::accumulate(values.begin(), values.begin() + r, 0.0) / total : 1.0;
+
+    a.assign(nv * r, 0.0);
+    b.assign(r * nh, 0.0);
+
+    if (left) {
+        // A = U_r, B = U_r^T * W
+        for (size_t i = 0; i < nv; ++i) {
+            for (size_t k = 0; k < r; ++k) {
+                a[i * r + k] = vectors[i * n + k];
+            }
+        }
+
+        for (size_t k = 0; k < r; ++k) {
+            for (size_t i = 0; i < nv; ++i) {
+                const double u = vectors[i * n + k];
+
+                for (size_t j = 0; j < nh; ++j) {
+                    b[k * nh + j] += u * double(w(i, j));
+                }
+            }
+        }
+    } else {
+        // A = W * V_r, B = V_r^T
+        for (size_t i = 0; i < nv; ++i) {
+            for (size_t j = 0; j < nh; ++j) {
+                const double x = w(i, j);
+
+                for (size_t k = 0; k < r; ++k) {
+                    a[i * r + k] += x * vectors[j * n + k];
+                }
+            }
+        }
+
+        for (size_t k = 0; k < r; ++k) {
+            for (size_t j = 0; j < nh; ++j) {
+                b[k * nh + j] = vectors[j * n + k];
+            }
+        }
+    }
+
+    return r;
+}
+
+/*!
+ * \brief Returns the number of factorized layers before the layer I
+ */
+template <size_t I, size_t... F>
+constexpr size_t factorized_before() {
+    const size_t factorized[] = {F..., size_t(-1)};
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < sizeof...(F); ++i) {
+        if (factorized[i] < I) {
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+/*!
+ * \brief Indicates if the layer I is factorized
+ */
+template <size_t I, size_t... F>
+constexpr bool is_factorized() {
+    const size_t factorized[] = {F..., size_t(-1)};
+
+    for (size_t i = 0; i < sizeof...(F); ++i) {
+        if (factorized[i] == I) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Initialize a dynamic convolutional layer with the shape of the
+ * given layer
+ */
+template <typename Target, typename Layer>
+void init_conv_layer(Target& target, const Layer& layer) {
+    const auto& w = layer.w;
+    target.init_layer(etl::dim<1>(w), dll::get_nv1(layer), dll::get_nv2(layer), etl::dim<0>(w), etl::dim<2>(w), etl::dim<3>(w));
+}
+
+/*!
+ * \brief Initialize a dynamic convolutional layer with the shape, the
+ * stride and the padding of the given convolutional layer
+ */
+template <typename Target, typename Desc>
+void init_conv_layer(Target& target, const conv_layer_impl<Desc>& layer) {
+    cpp_unused(layer);
+    conv_layer_impl<Desc>::dyn_init(target);
+}
+
+/*!
+ * \brief Initialize a dynamic convolutional layer with the shape, the
+ * stride and the padding of the given dynamic convolutional layer
+ */
+template <typename Target, typename Desc>
+void init_conv_layer(Target& target, const dyn_conv_layer_impl<Desc>& layer) {
+    target.init_layer(layer.nc, layer.nv1, layer.nv2, layer.k, layer.nw1, layer.nw2, layer.s1, layer.s2, layer.p1, layer.p2);
+}
+
+/*!
+ * \brief Copy a layer into the corresponding layer of the factorized
+ * network, the dynamic dense and convolutional layers being initialized
+ * with the shape of the layer first
+ */
+template <typename Layer, typename Target>
+void copy_layer(const Layer& layer, Target& target) {
+    cpp::static_if<decay_layer_traits<Target>::is_dense_layer() && decay_layer_traits<Target>::is_dynamic()>([&](auto f) {
+        f(target).init_layer(etl::dim<0>(f(layer).w), etl::dim<1>(f(layer).w));
+    });
+
+    cpp::static_if<std::is_same<Target, dyn_conv_layer_impl<typename Target::desc>>::value>([&](auto f) {
+        init_conv_layer(f(target), f(layer));
+    });
+
+    cpp::static_if<decay_layer_traits<Layer>::is_neural_layer()>([&](auto f) {
+        std::stringstream weights;
+        f(layer).store(weights);
+        f(target).load(weights);
+    });
+}
+
+/*!
+ * \brief Factorize the dense layer into the two given dynamic dense layers
+ * \return The rank of the factorization
+ */
+template <typename Layer, typename First, typename Second>
+size_t factorize_dense(const Layer& layer, First& first, Second& second, size_t rank, double energy, double& kept) {
+    static_assert(decay_layer_traits<Layer>::is_dense_layer(), "Only the dense layers can be factorized");
+    static_assert(decay_layer_traits<First>::is_dense_layer() && decay_layer_traits<First>::is_dynamic(), "A factorized layer must be replaced by two dynamic dense layers");
+    static_assert(decay_layer_traits<Second>::is_dense_layer() && decay_layer_traits<Second>::is_dynamic(), "A factorized layer must be replaced by two dynamic dense layers");
+    static_assert(First::activation_function == function::IDENTITY, "The first layer of a factorized layer must be linear");
+
+    const size_t nv = etl::dim<0>(layer.w);
+    const size_t nh = etl::dim<1>(layer.w);
+
+    std::vector<double> a;
+    std::vector<double> b;
+
+    const size_t r = factorize_weights(layer.w, rank, energy, a, b, kept);
+
+    first.init_layer(nv, r);
+    second.init_layer(r, nh);
+
+    for (size_t i = 0; i < nv; ++i) {
+        for (size_t k = 0; k < r; ++k) {
+            first.w(i, k) = a[i * r + k];
+        }
+    }
+
+    first.b = 0;
+
+    for (size_t k = 0; k < r; ++k) {
+        for (size_t j = 0; j < nh; ++j) {
+            second.w(k, j) = b[k * nh + j];
+        }
+    }
+
+    second.b = layer.b;
+
+    return r;
+}
+
+/*!
+ * \brief Copy the layer I of the source network into the factorized network
+ */
+template <size_t I, size_t... F, typename Source, typename Target, cpp_disable_if(is_factorized<I, F...>())>
+void factorize_layer(Source& source, Target& target, const factorization_options& options, factorization_report& report) {
+    cpp_unused(options);
+    cpp_unused(report);
+
+    copy_layer(source.template layer_get<I>(), target.template layer_get<I + factorized_before<I, F...>()>());
+}
+
+/*!
+ * \brief Factorize the layer I of the source network into two layers of
+ * the factorized network
+ */
+template <size_t I, size_t... F, typename Source, typename Target, cpp_enable_iff(is_factorized<I, F...>())>
+void factorize_layer(Source& source, Target& target, const factorization_options& options, factorization_report& report) {
+    constexpr size_t N = factorized_before<I, F...>();
+    constexpr size_t T = I + N;
+
+    const size_t rank = N < options.ranks.size() ? options.ranks[N] : 0;
+
+    double kept = 0.0;
+
+    auto r = factorize_dense(source.template layer_get<I>(), target.template layer_get<T>(), target.template layer_get<T + 1>(), rank, options.energy, kept);
+
+    report.ranks.push_back(r);
+    report.energy.push_back(kept);
+}
+
+/*!
+ * \brief Factorize all the layers of the source network into the factorized
+ * network
+ */
+template <typename Source, typename Target, size_t... F, size_t... I>
+void factorize_layers(Source& source, Target& target, const factorization_options& options, factorization_report& report, std::index_sequence<F...>, std::index_sequence<I...>) {
+    int unused[] = {(factorize_layer<I, F...>(source, target, options, report), 0)...};
+    cpp_unused(unused);
+}
+
+/*!
+ * \brief Returns the number of parameters of the given network
+ */
+template <typename DBN>
+size_t parameters(const DBN& dbn) {
+    size_t parameters = 0;
+
+    dbn.for_each_layer([&parameters](auto& layer) {
+        cpp::static_if<decay_layer_traits<decltype(layer)>::is_neural_layer()>([&](auto f) {
+            parameters += f(layer).parameters();
+        });
+    });
+
+    return parameters;
+}
+
+} //end of namespace factorize_detail
+
+/*!
+ * \brief Factorize the given layers of a trained network into the given
+ * network and report the accuracy before and after factorization.
+ *
+ * Each factorized layer F of the source network is replaced by two
+ * dynamic dense layers of the target network (see the description of the
+ * file), the other layers being copied, into the same layer or the dynamic
+ * version of the same layer. The factorized network can be fine-tuned.
+ *
+ * \tparam F The indices of the factorized layers of the source network, in
+ * increasing order
+ *
+ * \param source The trained network
+ * \param target The factorized network
+ * \param generator The generator used for the evaluation
+ * \param options The options of the factorization
+ *
+ * \return The report of the factorization
+ */
+template <size_t... F, typename Source, typename Target, typename Generator>
+factorization_report factorize(Source& source, Target& target, Generator& generator, const factorization_options& options = factorization_options()) {
+    static_assert(sizeof...(F) > 0, "At least one layer must be factorized");
+    static_assert(Target::layers == Source::layers + sizeof...(F), "Each factorized layer must be replaced by two layers");
+
+    cpp_assert(options.energy > 0.0 && options.energy <= 1.0, "The ratio of the energy must be in (0, 1]");
+
+    factorization_report report;
+
+    factorize_detail::factorize_layers(source, target, options, report, std::index_sequence<F...>(), std::make_index_sequence<Source::layers>());
+
+    report.parameters_before = factorize_detail::parameters(source);
+    report.parameters_after  = factorize_detail::parameters(target);
+
+    report.before = source.evaluate_metrics(generator);
+    report.after  = target.evaluate_metrics(generator);
+
+    for (size_t i = 0; i < report.ranks.size(); ++i) {
+        printf("   layer %lu: rank %lu (energy: %.5f) \n", i, report.ranks[i], report.energy[i]);
+    }
+
+    printf("parameters: %lu (factorized: %lu) \n", report.parameters_before, report.parameters_after);
+    printf("     error: %.5f (factorized: %.5f, drift: %+.5f) \n", std::get<0>(report.before), std::get<0>(report.after), std::get<0>(report.after) - std::get<0>(report.before));
+    printf("      loss: %.5f (factorized: %.5f, drift: %+.5f) \n", std::get<1>(report.before), std::get<1>(report.after), std::get<1>(report.after) - std::get<1>(report.before));
+
+    return report;
+}
+
+} //end of dll namespace
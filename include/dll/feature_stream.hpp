@@ -0,0 +1,403 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Streaming extraction of features to a binary file.
+ *
+ * The features are computed one batch at a time from a generator and
+ * written by a background thread, so that the memory stays bounded and
+ * the writes overlap with the computation.
+ *
+ * The file is made of a fixed 32 bytes header followed by the features
+ * of each sample, one after another, in the encoding of the header. The
+ * CSV files have no header, only one line of features per sample.
+ *
+ * The features of binary units can be bit-packed, each sample taking
+ * one bit per feature, rounded up to a whole number of bytes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/bf16.hpp"
+#include "dll/util/affinity.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The encoding of the features in a feature file
+ */
+enum class feature_encoding : uint32_t {
+    FLOAT = 0, ///< Single-precision floating point
+    BF16  = 1, ///< bfloat16 (half the size, 8 bits of mantissa)
+    CSV   = 2, ///< Text, one line of comma-separated features per sample, without header
+    BITS  = 3  ///< One bit per feature, set when the feature is greater than 0.5 (binary units)
+};
+
+/*!
+ * \brief The header of a feature file
+ */
+struct feature_file_header {
+    static constexpr uint32_t current_version = 1; ///< The version of the format
+
+    char magic[4];             ///< The magic identifier ("DLLF")
+    uint32_t version;          ///< The version of the format
+    feature_encoding encoding; ///< The encoding of the features
+    uint32_t reserved;         ///< Unused, kept for alignment
+    uint64_t features;         ///< The number of features per sample
+    uint64_t samples;          ///< The number of samples
+
+    /*!
+     * \brief Indicates if the header is a valid feature file header
+     */
+    bool valid() const {
+        return std::memcmp(magic, "DLLF", 4) == 0 && version == current_version;
+    }
+
+    /*!
+     * \brief Return the size of the encoded features of one sample, in bytes
+     */
+    size_t sample_size() const {
+        if (encoding == feature_encoding::BITS) {
+            return (features + 7) / 8;
+        }
+
+        return features * (encoding == feature_encoding::BF16 ? sizeof(bf16_t) : sizeof(float));
+    }
+};
+
+static_assert(sizeof(feature_file_header) == 32, "The feature file header must be 32 bytes");
+
+/*!
+ * \brief A writer of feature files with a background thread.
+ *
+ * At most a given number of chunks are waiting to be written, push()
+ * blocks when the queue is full.
+ */
+struct feature_writer {
+    /*!
+     * \brief Open the file and start the writer thread
+     * \param path The path of the file to write
+     * \param features The number of features per sample
+     * \param encoding The encoding of the features
+     * \param max_chunks The maximum number of chunks waiting to be written
+     */
+    feature_writer(const std::string& path, size_t features, feature_encoding encoding, size_t max_chunks)
+            : os(path, std::ofstream::binary), max_chunks(std::max(size_t(1), max_chunks)) {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "DLLF", 4);
+        header.version  = feature_file_header::current_version;
+        header.encoding = encoding;
+        header.features = features;
+
+        if (os) {
+            if (encoding != feature_encoding::CSV) {
+                os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            } else {
+                os.precision(std::numeric_limits<float>::max_digits10);
+            }
+
+            thread = std::thread([this] { run(); });
+        }
+    }
+
+    feature_writer(const feature_writer& rhs) = delete;
+    feature_writer& operator=(const feature_writer& rhs) = delete;
+
+    /*!
+     * \brief Finish the writing if this was not done
+     */
+    ~feature_writer() {
+        finish();
+    }
+
+    /*!
+     * \brief Indicates if the file could be opened
+     */
+    bool opened() const {
+        return thread.joinable() || finished;
+    }
+
+    /*!
+     * \brief Push a chunk of features to be written
+     * \param chunk The features of several samples, one after another
+     */
+    void push(std::vector<float>&& chunk) {
+        std::unique_lock<std::mutex> l(lock);
+
+        not_full.wait(l, [this] { return chunks.size() < max_chunks; });
+
+        chunks.push_back(std::move(chunk));
+
+        not_empty.notify_one();
+    }
+
+    /*!
+     * \brief Write all the remaining chunks, complete the header and
+     * close the file.
+     *
+     * \return true if everything was written, false otherwise
+     */
+    bool finish() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                stop = true;
+            }
+
+            not_empty.notify_one();
+            thread.join();
+
+            // The number of samples is only known at the end
+            if (header.encoding != feature_encoding::CSV) {
+                os.seekp(0);
+                os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            }
+
+            os.close();
+
+            finished = true;
+        }
+
+        return finished && !os.fail();
+    }
+
+private:
+    void run() {
+        pin_helper();
+
+        std::vector<bf16_t> encoded;
+        std::vector<uint8_t> packed;
+
+        while (true) {
+            std::vector<float> chunk;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                not_empty.wait(l, [this] { return stop || !chunks.empty(); });
+
+                if (chunks.empty()) {
+                    return;
+                }
+
+                chunk = std::move(chunks.front());
+                chunks.pop_front();
+            }
+
+            not_full.notify_one();
+
+            if (header.encoding == feature_encoding::BF16) {
+                encoded.resize(chunk.size());
+
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    encoded[i] = to_bf16(chunk[i]);
+                }
+
+                os.write(reinterpret_cast<const char*>(encoded.data()), encoded.size() * sizeof(bf16_t));
+            } else if (header.encoding == feature_encoding::BITS) {
+                const size_t n    = header.features ? chunk.size() / header.features : 0;
+                const size_t size = header.sample_size();
+
+                packed.assign(n * size, 0);
+
+                for (size_t s = 0; s < n; ++s) {
+                    for (size_t i = 0; i < header.features; ++i) {
+                        if (chunk[s * header.features + i] > 0.5f) {
+                            packed[s * size + i / 8] |= uint8_t(1) << (i % 8);
+                        }
+                    }
+                }
+
+                os.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+            } else if (header.encoding == feature_encoding::CSV) {
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    os << chunk[i] << ((i + 1) % header.features ? ',' : '\n');
+                }
+            } else {
+                os.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(float));
+            }
+
+            header.samples += header.features ? chunk.size() / header.features : 0;
+        }
+    }
+
+    std::ofstream os;                     ///< The output file
+    feature_file_header header;           ///< The header (completed at the end)
+    const size_t max_chunks;              ///< The maximum number of waiting chunks
+    std::deque<std::vector<float>> chunks; ///< The chunks waiting to be written
+    std::mutex lock;                      ///< The lock protecting the queue
+    std::condition_variable not_empty;    ///< Signaled when a chunk is pushed
+    std::condition_variable not_full;     ///< Signaled when a chunk is popped
+    bool stop     = false;                ///< Indicates that no more chunks will be pushed
+    bool finished = false;                ///< Indicates that the file is complete
+    std::thread thread;                   ///< The writer thread
+};
+
+/*!
+ * \brief Compute the features of all the samples of the generator and
+ * write them to a feature file.
+ *
+ * The features are computed with test_forward_batch, one batch at a
+ * time. Only max_chunks batches of features are kept in memory while
+ * they wait to be written.
+ *
+ * \tparam LS The layer from which the features are extracted
+ * \param dbn The network
+ * \param generator The generator of the inputs
+ * \param path The path of the feature file
+ * \param encoding The encoding of the features in the file
+ * \param max_chunks The maximum number of batches waiting to be written
+ *
+ * \return true if all the features were written, false otherwise
+ */
+template <size_t LS = size_t(-1), typename DBN, typename Generator>
+bool stream_features(DBN& dbn, Generator& generator, const std::string& path, feature_encoding encoding = feature_encoding::FLOAT, size_t max_chunks = 4) {
+    static constexpr size_t L = LS == size_t(-1) ? DBN::layers - 1 : LS;
+
+    generator.reset();
+    generator.set_test();
+
+    std::unique_ptr<feature_writer> writer;
+
+    while (generator.has_next_batch()) {
+        auto input_batch = generator.data_batch();
+
+        decltype(auto) output = dbn.template test_forward_batch<L>(input_batch);
+
+        const size_t n        = etl::dim<0>(input_batch);
+        const size_t features = etl::size(output) / etl::dim<0>(output);
+
+        // The number of features is only known after the first batch
+        if (!writer) {
+            writer = std::make_unique<feature_writer>(path, features, encoding, max_chunks);
+
+            if (!writer->opened()) {
+                std::cerr << "ERROR: Impossible to open " << path << " for writing" << std::endl;
+                return false;
+            }
+        }
+
+        std::vector<float> chunk(n * features);
+
+        for (size_t i = 0; i < n * features; ++i) {
+            chunk[i] = output[i];
+        }
+
+        writer->push(std::move(chunk));
+
+        generator.next_batch();
+    }
+
+    if (!writer) {
+        std::cerr << "ERROR: No features to write to " << path << std::endl;
+        return false;
+    }
+
+    return writer->finish();
+}
+
+/*!
+ * \brief Load all the features of a feature file
+ * \param path The path of the feature file
+ * \param features The matrix of features (samples x features), resized
+ * \return true if the features were read, false otherwise
+ */
+inline bool load_features(const std::string& path, etl::dyn_matrix<float, 2>& features) {
+    std::ifstream is(path, std::ifstream::binary);
+
+    if (!is) {
+        std::cerr << "ERROR: Impossible to open " << path << " for reading" << std::endl;
+        return false;
+    }
+
+    feature_file_header header;
+
+    if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) || !header.valid()) {
+        std::cerr << "ERROR: Invalid feature file" << std::endl;
+        return false;
+    }
+
+    features = etl::dyn_matrix<float, 2>(header.samples, header.features);
+
+    if (header.encoding == feature_encoding::BF16) {
+        std::vector<bf16_t> encoded(header.samples * header.features);
+
+        is.read(reinterpret_cast<char*>(encoded.data()), encoded.size() * sizeof(bf16_t));
+
+        for (size_t i = 0; i < encoded.size(); ++i) {
+            features[i] = from_bf16(encoded[i]);
+        }
+    } else if (header.encoding == feature_encoding::BITS) {
+        const size_t size = header.sample_size();
+
+        std::vector<uint8_t> packed(header.samples * size);
+
+        is.read(reinterpret_cast<char*>(packed.data()), packed.size());
+
+        for (size_t s = 0; s < header.samples; ++s) {
+            for (size_t i = 0; i < header.features; ++i) {
+                features(s, i) = (packed[s * size + i / 8] >> (i % 8)) & 1 ? 1.0f : 0.0f;
+            }
+        }
+    } else {
+        is.read(reinterpret_cast<char*>(features.memory_start()), etl::size(features) * sizeof(float));
+    }
+
+    if (!is) {
+        std::cerr << "ERROR: Truncated feature file" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Load all the features of a feature file as a container of
+ * samples, that can be given directly to a data generator
+ * \param path The path of the feature file
+ * \param samples The container of samples, replaced by the samples of the file
+ * \return true if the features were read, false otherwise
+ */
+inline bool load_features(const std::string& path, std::vector<etl::dyn_vector<float>>& samples) {
+    etl::dyn_matrix<float, 2> features;
+
+    if (!load_features(path, features)) {
+        return false;
+    }
+
+    const size_t n = etl::dim<0>(features);
+    const size_t f = etl::dim<1>(features);
+
+    samples.clear();
+    samples.reserve(n);
+
+    for (size_t s = 0; s < n; ++s) {
+        samples.emplace_back(f);
+
+        std::copy(features.memory_start() + s * f, features.memory_start() + (s + 1) * f, samples.back().memory_start());
+    }
+
+    return true;
+}
+
+} //end of dll namespace
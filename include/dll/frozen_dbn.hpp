@@ -0,0 +1,516 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference-only view of a trained network.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/dbn_detail.hpp"
+#include "dll/util/ready.hpp"
+#include "dll/util/batch_extend.hpp"
+#include "dll/util/batch_reshape.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/packed_dense.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Frozen state of a layer that is computed normally.
+ */
+template <typename Layer>
+struct frozen_layer {
+    static constexpr bool inplace = false; ///< Indicates if the layer is applied in place on the previous output
+    static constexpr bool packed  = false; ///< Indicates if the layer is computed by its frozen state
+
+    /*!
+     * \brief Freeze the given layer
+     * \param layer The layer to freeze
+     */
+    explicit frozen_layer(const Layer& layer) {
+        cpp_unused(layer);
+    }
+};
+
+/*!
+ * \brief Frozen state of an elementwise layer, applied in place on the
+ * output of the previous layer instead of creating a new output.
+ */
+template <typename Layer>
+struct frozen_elementwise_layer {
+    static constexpr bool inplace = true;  ///< Indicates if the layer is applied in place on the previous output
+    static constexpr bool packed  = false; ///< Indicates if the layer is computed by its frozen state
+
+    const Layer& layer; ///< The frozen layer
+
+    /*!
+     * \brief Freeze the given layer
+     * \param layer The layer to freeze
+     */
+    explicit frozen_elementwise_layer(const Layer& layer) : layer(layer) {}
+
+    /*!
+     * \brief Apply the layer in place on a batch of output
+     * \param output The batch of output of the previous layer
+     */
+    template <typename Output>
+    void apply_batch(Output& output) const {
+        layer.test_forward_batch(output, output);
+    }
+
+    /*!
+     * \brief Apply the layer in place on one output
+     * \param output The output of the previous layer
+     */
+    template <typename Output>
+    void apply_one(Output& output) const {
+        layer.test_forward_one(output, output);
+    }
+};
+
+/*!
+ * \brief Frozen state of a layer that is the identity at test time.
+ */
+template <typename Layer>
+struct frozen_identity_layer {
+    static constexpr bool inplace = true;  ///< Indicates if the layer is applied in place on the previous output
+    static constexpr bool packed  = false; ///< Indicates if the layer is computed by its frozen state
+
+    /*!
+     * \brief Freeze the given layer
+     * \param layer The layer to freeze
+     */
+    explicit frozen_identity_layer(const Layer& layer) {
+        cpp_unused(layer);
+    }
+
+    /*!
+     * \brief Does nothing, the layer is the identity
+     * \param output The batch of output of the previous layer
+     */
+    template <typename Output>
+    void apply_batch(Output& output) const {
+        cpp_unused(output);
+    }
+
+    /*!
+     * \brief Does nothing, the layer is the identity
+     * \param output The output of the previous layer
+     */
+    template <typename Output>
+    void apply_one(Output& output) const {
+        cpp_unused(output);
+    }
+};
+
+/*!
+ * \brief Frozen state of a batch normalization layer.
+ *
+ * The normalization is folded into a single scale and shift per feature
+ * (or per channel) that are computed once, when the network is frozen,
+ * and then applied in place on the output of the previous layer.
+ */
+template <typename Layer>
+struct frozen_batch_normalization_layer {
+    using weight = typename Layer::weight; ///< The data type of the layer
+
+    static constexpr bool inplace = true;  ///< Indicates if the layer is applied in place on the previous output
+    static constexpr bool packed  = false; ///< Indicates if the layer is computed by its frozen state
+
+    etl::dyn_matrix<weight, 1> scale; ///< gamma / sqrt(var + e)
+    etl::dyn_matrix<weight, 1> shift; ///< beta - mean * scale
+
+    /*!
+     * \brief Freeze the given layer
+     * \param layer The layer to freeze
+     */
+    explicit frozen_batch_normalization_layer(const Layer& layer) : scale(etl::size(layer.gamma)), shift(etl::size(layer.gamma)) {
+        const weight e = Layer::e;
+
+        scale = layer.gamma >> (1.0 / etl::sqrt(layer.var + e));
+        shift = layer.beta - (layer.mean >> scale);
+    }
+
+    /*!
+     * \brief Apply the layer in place on a batch of output
+     * \param output The batch of output of the previous layer
+     */
+    template <typename Output>
+    void apply_batch(Output& output) const {
+        for (size_t b = 0; b < etl::dim<0>(output); ++b) {
+            apply_one(output(b));
+        }
+    }
+
+    /*!
+     * \brief Apply the layer in place on one output of a dense layer
+     * \param output The output of the previous layer
+     */
+    template <typename Output, cpp_enable_iff(etl::decay_traits<Output>::dimensions() == 1)>
+    void apply_one(Output&& output) const {
+        output = (output >> scale) + shift;
+    }
+
+    /*!
+     * \brief Apply the layer in place on one output of a convolutional layer
+     * \param output The output of the previous layer
+     */
+    template <typename Output, cpp_enable_iff(etl::decay_traits<Output>::dimensions() == 3)>
+    void apply_one(Output&& output) const {
+        for (size_t k = 0; k < etl::dim<0>(output); ++k) {
+            output(k) = (output(k) * scale(k)) + shift(k);
+        }
+    }
+};
+
+/*!
+ * \copydoc frozen_elementwise_layer
+ */
+template <typename Desc>
+struct frozen_layer<activation_layer_impl<Desc>> : frozen_elementwise_layer<activation_layer_impl<Desc>> {
+    using frozen_elementwise_layer<activation_layer_impl<Desc>>::frozen_elementwise_layer;
+};
+
+/*!
+ * \copydoc frozen_elementwise_layer
+ */
+template <typename Desc>
+struct frozen_layer<scale_layer_impl<Desc>> : frozen_elementwise_layer<scale_layer_impl<Desc>> {
+    using frozen_elementwise_layer<scale_layer_impl<Desc>>::frozen_elementwise_layer;
+};
+
+/*!
+ * \copydoc frozen_elementwise_layer
+ */
+template <typename Desc>
+struct frozen_layer<binarize_layer_impl<Desc>> : frozen_elementwise_layer<binarize_layer_impl<Desc>> {
+    using frozen_elementwise_layer<binarize_layer_impl<Desc>>::frozen_elementwise_layer;
+};
+
+/*!
+ * \copydoc frozen_elementwise_layer
+ */
+template <typename Desc>
+struct frozen_layer<rectifier_layer_impl<Desc>> : frozen_elementwise_layer<rectifier_layer_impl<Desc>> {
+    using frozen_elementwise_layer<rectifier_layer_impl<Desc>>::frozen_elementwise_layer;
+};
+
+/*!
+ * \copydoc frozen_identity_layer
+ */
+template <typename Desc>
+struct frozen_layer<dropout_layer_impl<Desc>> : frozen_identity_layer<dropout_layer_impl<Desc>> {
+    using frozen_identity_layer<dropout_layer_impl<Desc>>::frozen_identity_layer;
+};
+
+/*!
+ * \copydoc frozen_batch_normalization_layer
+ */
+template <typename Desc>
+struct frozen_layer<batch_normalization_2d_layer_impl<Desc>> : frozen_batch_normalization_layer<batch_normalization_2d_layer_impl<Desc>> {
+    using frozen_batch_normalization_layer<batch_normalization_2d_layer_impl<Desc>>::frozen_batch_normalization_layer;
+};
+
+/*!
+ * \copydoc frozen_batch_normalization_layer
+ */
+template <typename Desc>
+struct frozen_layer<dyn_batch_normalization_2d_layer_impl<Desc>> : frozen_batch_normalization_layer<dyn_batch_normalization_2d_layer_impl<Desc>> {
+    using frozen_batch_normalization_layer<dyn_batch_normalization_2d_layer_impl<Desc>>::frozen_batch_normalization_layer;
+};
+
+/*!
+ * \copydoc frozen_batch_normalization_layer
+ */
+template <typename Desc>
+struct frozen_layer<batch_normalization_4d_layer_impl<Desc>> : frozen_batch_normalization_layer<batch_normalization_4d_layer_impl<Desc>> {
+    using frozen_batch_normalization_layer<batch_normalization_4d_layer_impl<Desc>>::frozen_batch_normalization_layer;
+};
+
+/*!
+ * \copydoc frozen_batch_normalization_layer
+ */
+template <typename Desc>
+struct frozen_layer<dyn_batch_normalization_4d_layer_impl<Desc>> : frozen_batch_normalization_layer<dyn_batch_normalization_4d_layer_impl<Desc>> {
+    using frozen_batch_normalization_layer<dyn_batch_normalization_4d_layer_impl<Desc>>::frozen_batch_normalization_layer;
+};
+
+/*!
+ * \brief Frozen state of a dense layer, with its weights packed for the
+ * small batches (see packed_dense.hpp).
+ *
+ * The batches of at most packed_max_batch samples are computed with the
+ * packed weights, the larger ones by the layer itself.
+ */
+template <typename Layer>
+struct frozen_dense_layer {
+    using weight = typename Layer::weight; ///< The data type of the layer
+
+    static constexpr bool inplace = false; ///< Indicates if the layer is applied in place on the previous output
+    static constexpr bool packed  = true;  ///< Indicates if the layer is computed by its frozen state
+
+    const Layer& layer;                   ///< The frozen layer
+    packed_dense_weights<weight> weights; ///< The packed weights
+
+    /*!
+     * \brief Freeze the given layer
+     * \param layer The layer to freeze
+     */
+    explicit frozen_dense_layer(const Layer& layer) : layer(layer), weights(layer.w) {}
+
+    /*!
+     * \brief Compute the test representation of a batch of input
+     * \param output The batch of output to fill
+     * \param input The batch of input
+     */
+    template <typename Output, typename Input>
+    void compute(Output&& output, const Input& input) const {
+        if (!weights.mul(output, input)) {
+            layer.test_forward_batch(output, input);
+            return;
+        }
+
+        if /*constexpr*/ (!Layer::no_bias) {
+            output = bias_add_2d(output, layer.b);
+        }
+
+        activate_inplace<Layer::activation_function, Layer::fast_math>(output);
+    }
+
+    /*!
+     * \brief Return the test representation of a batch of input
+     * \param input The batch of input
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) const {
+        auto one    = prepare_one_ready_output(layer, input(0));
+        auto output = batch_extend(input, one);
+
+        compute(output, input);
+
+        return output;
+    }
+
+    /*!
+     * \brief Return the test representation of one input
+     * \param input The input
+     */
+    template <typename Input>
+    auto forward_one(const Input& input) const {
+        auto output = prepare_one_ready_output(layer, input);
+
+        compute(batch_reshape(output), batch_reshape(input));
+
+        return output;
+    }
+};
+
+/*!
+ * \copydoc frozen_dense_layer
+ */
+template <typename Desc>
+struct frozen_layer<dense_layer_impl<Desc>> : frozen_dense_layer<dense_layer_impl<Desc>> {
+    using frozen_dense_layer<dense_layer_impl<Desc>>::frozen_dense_layer;
+};
+
+/*!
+ * \copydoc frozen_dense_layer
+ */
+template <typename Desc>
+struct frozen_layer<dyn_dense_layer_impl<Desc>> : frozen_dense_layer<dyn_dense_layer_impl<Desc>> {
+    using frozen_dense_layer<dyn_dense_layer_impl<Desc>>::frozen_dense_layer;
+};
+
+namespace frozen_detail {
+
+template <typename DBN, typename Sequence>
+struct frozen_layers;
+
+/*!
+ * \brief Helper to build the frozen state of all the layers of a network
+ */
+template <typename DBN, size_t... I>
+struct frozen_layers<DBN, std::index_sequence<I...>> {
+    using type = std::tuple<frozen_layer<typename DBN::template layer_type<I>>...>; ///< The tuple of frozen layers
+
+    /*!
+     * \brief Freeze all the layers of the given network
+     */
+    static type make(const DBN& dbn) {
+        return type(frozen_layer<typename DBN::template layer_type<I>>(dbn.template layer_get<I>())...);
+    }
+};
+
+} //end of namespace frozen_detail
+
+/*!
+ * \brief An inference-only view of a trained network.
+ *
+ * The layers that are elementwise at test time (activation, scale,
+ * binarize, rectifier, dropout and batch normalization) are applied in
+ * place on the output of the previous layer instead of creating their
+ * own output. The batch normalization is folded into a scale and a shift
+ * and the weights of the dense layers are packed for the small batches
+ * when the network is frozen. No training state is touched, so a frozen
+ * network can be used concurrently from several threads.
+ *
+ * The network must outlive its frozen view and must be frozen again
+ * after having been trained.
+ */
+template <typename DBN>
+struct frozen_dbn {
+    using dbn_t  = DBN;                   ///< The network type
+    using weight = typename dbn_t::weight; ///< The data type of the network
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using frozen_layers_t = typename frozen_detail::frozen_layers<dbn_t, std::make_index_sequence<layers>>::type; ///< The frozen layers
+
+private:
+    template <size_t L>
+    using frozen_layer_t = std::tuple_element_t<L, frozen_layers_t>;
+
+    const dbn_t& dbn;              ///< The frozen network
+    frozen_layers_t frozen_layers; ///< The frozen state of the layers
+
+public:
+    /*!
+     * \brief Freeze the given network
+     * \param dbn The network to freeze
+     */
+    explicit frozen_dbn(const dbn_t& dbn)
+            : dbn(dbn), frozen_layers(frozen_detail::frozen_layers<dbn_t, std::make_index_sequence<layers>>::make(dbn)) {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Return the test representation of the network for the given input batch.
+     * \param batch The input batch
+     * \return The output batch of the last layer of the network
+     */
+    template <typename Input>
+    auto forward_batch(const Input& batch) const {
+        auto next = compute_batch<0>(batch);
+        return forward_batch_impl<1>(std::move(next));
+    }
+
+    /*!
+     * \brief Return the test representation of the network for the given input sample.
+     * \param sample The input sample
+     * \return The output of the last layer of the network
+     */
+    template <typename Input>
+    auto forward_one(const Input& sample) const {
+        auto next = compute_one<0>(sample);
+        return forward_one_impl<1>(std::move(next));
+    }
+
+    /*!
+     * \brief Returns the output features for the given sample
+     * \param sample The sample to get features from
+     * \return the output features of the last layer of the network
+     */
+    template <typename Input>
+    auto features(const Input& sample) const {
+        return forward_one(sample);
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     * \param sample The sample to predict the label for
+     * \return the predicted label
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) const {
+        auto result = forward_one(sample);
+        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
+    }
+
+private:
+    template <size_t L, typename Input, cpp_enable_iff(!frozen_layer_t<L>::packed)>
+    auto compute_batch(const Input& input) const {
+        return dbn.template layer_get<L>().test_forward_batch(input);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff(frozen_layer_t<L>::packed)>
+    auto compute_batch(const Input& input) const {
+        return std::get<L>(frozen_layers).forward_batch(input);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff(!frozen_layer_t<L>::packed)>
+    auto compute_one(const Input& input) const {
+        return dbn.template layer_get<L>().test_forward_one(input);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff(frozen_layer_t<L>::packed)>
+    auto compute_one(const Input& input) const {
+        return std::get<L>(frozen_layers).forward_one(input);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L == layers))>
+    auto forward_batch_impl(Input&& output) const {
+        return std::move(output);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && !frozen_layer_t<L>::inplace))>
+    auto forward_batch_impl(Input&& input) const {
+        auto next = compute_batch<L>(input);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(input);
+
+        return forward_batch_impl<L + 1>(std::move(next));
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && frozen_layer_t<L>::inplace))>
+    auto forward_batch_impl(Input&& input) const {
+        std::get<L>(frozen_layers).apply_batch(input);
+        return forward_batch_impl<L + 1>(std::move(input));
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L == layers))>
+    auto forward_one_impl(Input&& output) const {
+        return std::move(output);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && !frozen_layer_t<L>::inplace))>
+    auto forward_one_impl(Input&& input) const {
+        auto next = compute_one<L>(input);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(input);
+
+        return forward_one_impl<L + 1>(std::move(next));
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && frozen_layer_t<L>::inplace))>
+    auto forward_one_impl(Input&& input) const {
+        std::get<L>(frozen_layers).apply_one(input);
+        return forward_one_impl<L + 1>(std::move(input));
+    }
+};
+
+/*!
+ * \brief Freeze the given network for inference
+ * \param dbn The network to freeze
+ * \return A frozen view of the network
+ */
+template <typename DBN>
+frozen_dbn<DBN> freeze(const DBN& dbn) {
+    return frozen_dbn<DBN>(dbn);
+}
+
+} //end of dll namespace
@@ -0,0 +1,227 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fusions of consecutive layers of a network.
+ *
+ * The networks look for the fusions of their consecutive layers, at
+ * compile time, from the first layer to the last (see layer_fusion). A
+ * pair of fusible layers is computed by its fusion and the network
+ * continues after the second layer, the other layers being computed one
+ * by one, as usual.
+ *
+ * The following layers are fused:
+ *  - A convolutional layer followed by a max pooling layer is computed by
+ *    the fused convolution and pooling kernel, the output of the
+ *    convolution is never written to memory. The activation, which must
+ *    be non-decreasing, is applied to the pooled output.
+ *  - A dense or convolutional layer, without activation, followed by an
+ *    activation layer is activated in place.
+ *  - A neural layer followed by a dropout layer is computed by the neural
+ *    layer only, for the test representation.
+ */
+
+#pragma once
+
+#include "dll/layer_traits.hpp"
+#include "dll/conv_algorithm.hpp"
+#include "dll/util/timers.hpp"               // for auto_timer
+#include "dll/util/batch_extend.hpp"         // for batch_extend
+#include "dll/util/direct.hpp"               // for direct_memory
+#include "dll/util/fast_math.hpp"            // for activate_inplace
+#include "dll/neural/conv_mp_kernels.hpp"    // for conv_mp_detail::forward
+
+namespace dll {
+
+namespace fusion_detail {
+
+/*!
+ * \brief Indicates if the maximum of the activations is the activation of
+ * the maximum
+ */
+constexpr bool is_non_decreasing(function f) {
+    return f != function::SOFTMAX;
+}
+
+/*!
+ * \brief Indicates if the convolutional layer can be fused with the max
+ * pooling of its output, by windows of P1 x P2
+ */
+template <typename Conv, size_t I1, size_t I2, size_t I3>
+constexpr bool is_conv_mp_fusible() {
+    return Conv::K == I1 && Conv::NH1 == I2 && Conv::NH2 == I3
+        && Conv::S1 == 1 && Conv::S2 == 1 && Conv::P1 == 0 && Conv::P2 == 0
+        && is_non_decreasing(Conv::activation_function)
+        && (Conv::desc::engine == conv_algorithm::DIRECT || Conv::desc::engine == conv_algorithm::AUTO);
+}
+
+/*!
+ * \brief Fusion of a convolutional layer and of the max pooling of its
+ * output by windows of P1 x P2
+ */
+template <typename First, typename Second, size_t P1, size_t P2>
+struct conv_mp_fusion {
+    static constexpr bool test  = true; ///< Indicates if the test representation is fused
+    static constexpr bool train = true; ///< Indicates if the train representation is fused
+
+    /*!
+     * \brief Return the test representation of the pooling layer for the
+     * given input batch of the convolutional layer
+     */
+    template <typename Input>
+    static auto test_forward_batch(const First& first, const Second& second, const Input& input) {
+        dll::auto_timer timer("fusion:conv_mp:forward_batch");
+
+        auto output = batch_extend(input, second.template prepare_one_output<typename First::output_one_t>());
+
+        decltype(auto) x = direct_memory(input);
+
+        conv_mp_detail::forward(etl::dim<0>(input), First::NC, First::NV1, First::NV2, First::K, First::NW1, First::NW2, P1, P2,
+                                x.memory_start(), first.w.memory_start(), First::no_bias ? nullptr : first.b.memory_start(),
+                                output.memory_start(), static_cast<size_t*>(nullptr));
+
+        if /*constexpr*/ (First::activation_function != function::IDENTITY) {
+            activate_inplace<First::activation_function, First::fast_math>(output);
+        }
+
+        return output;
+    }
+
+    /*!
+     * \brief Return the train representation of the pooling layer for the
+     * given input batch of the convolutional layer, the same as the test
+     * representation
+     */
+    template <typename Input>
+    static auto train_forward_batch(const First& first, const Second& second, const Input& input) {
+        return test_forward_batch(first, second, input);
+    }
+};
+
+/*!
+ * \brief Fusion of a layer without activation and of the activation layer
+ * that follows it
+ */
+template <typename First, typename Second>
+struct activation_fusion {
+    static constexpr bool test  = true; ///< Indicates if the test representation is fused
+    static constexpr bool train = true; ///< Indicates if the train representation is fused
+
+    /*!
+     * \brief Return the test representation of the activation layer for
+     * the given input batch of the first layer
+     */
+    template <typename Input>
+    static auto test_forward_batch(const First& first, const Second& second, const Input& input) {
+        cpp_unused(second);
+
+        auto output = first.test_forward_batch(input);
+
+        activate_inplace<Second::activation_function, Second::fast_math>(output);
+
+        return output;
+    }
+
+    /*!
+     * \brief Return the train representation of the activation layer for
+     * the given input batch of the first layer
+     */
+    template <typename Input>
+    static auto train_forward_batch(const First& first, const Second& second, const Input& input) {
+        cpp_unused(second);
+
+        auto output = first.train_forward_batch(input);
+
+        activate_inplace<Second::activation_function, Second::fast_math>(output);
+
+        return output;
+    }
+};
+
+/*!
+ * \brief Fusion of a layer and of the dropout layer that follows it, only
+ * for the test representation, the same as the one of the first layer
+ */
+template <typename First, typename Second>
+struct dropout_fusion {
+    static constexpr bool test  = true;  ///< Indicates if the test representation is fused
+    static constexpr bool train = false; ///< Indicates if the train representation is fused
+
+    /*!
+     * \brief Return the test representation of the dropout layer for the
+     * given input batch of the first layer
+     */
+    template <typename Input>
+    static auto test_forward_batch(const First& first, const Second& second, const Input& input) {
+        cpp_unused(second);
+
+        return first.test_forward_batch(input);
+    }
+};
+
+} //end of namespace fusion_detail
+
+/*!
+ * \brief A convolutional layer is fused with the max pooling of each of
+ * its channels
+ */
+template <typename D1, typename D2>
+struct layer_fusion<conv_layer_impl<D1>, mp_2d_layer_impl<D2>,
+                    std::enable_if_t<fusion_detail::is_conv_mp_fusible<conv_layer_impl<D1>, D2::I1, D2::I2, D2::I3>()>>
+        : fusion_detail::conv_mp_fusion<conv_layer_impl<D1>, mp_2d_layer_impl<D2>, D2::C1, D2::C2> {};
+
+/*!
+ * \brief A convolutional layer is fused with the max pooling of each of
+ * its channels
+ */
+template <typename D1, typename D2>
+struct layer_fusion<conv_layer_impl<D1>, mp_3d_layer_impl<D2>,
+                    std::enable_if_t<D2::C1 == 1 && fusion_detail::is_conv_mp_fusible<conv_layer_impl<D1>, D2::I1, D2::I2, D2::I3>()>>
+        : fusion_detail::conv_mp_fusion<conv_layer_impl<D1>, mp_3d_layer_impl<D2>, D2::C2, D2::C3> {};
+
+/*!
+ * \brief A dense layer without activation is fused with the activation
+ * layer that follows it
+ */
+template <typename D1, typename D2>
+struct layer_fusion<dense_layer_impl<D1>, activation_layer_impl<D2>, std::enable_if_t<D1::activation_function == function::IDENTITY>>
+        : fusion_detail::activation_fusion<dense_layer_impl<D1>, activation_layer_impl<D2>> {};
+
+/*!
+ * \brief A dynamic dense layer without activation is fused with the
+ * activation layer that follows it
+ */
+template <typename D1, typename D2>
+struct layer_fusion<dyn_dense_layer_impl<D1>, activation_layer_impl<D2>, std::enable_if_t<D1::activation_function == function::IDENTITY>>
+        : fusion_detail::activation_fusion<dyn_dense_layer_impl<D1>, activation_layer_impl<D2>> {};
+
+/*!
+ * \brief A convolutional layer without activation is fused with the
+ * activation layer that follows it
+ */
+template <typename D1, typename D2>
+struct layer_fusion<conv_layer_impl<D1>, activation_layer_impl<D2>, std::enable_if_t<D1::activation_function == function::IDENTITY>>
+        : fusion_detail::activation_fusion<conv_layer_impl<D1>, activation_layer_impl<D2>> {};
+
+/*!
+ * \brief A dynamic convolutional layer without activation is fused with
+ * the activation layer that follows it
+ */
+template <typename D1, typename D2>
+struct layer_fusion<dyn_conv_layer_impl<D1>, activation_layer_impl<D2>, std::enable_if_t<D1::activation_function == function::IDENTITY>>
+        : fusion_detail::activation_fusion<dyn_conv_layer_impl<D1>, activation_layer_impl<D2>> {};
+
+/*!
+ * \brief A neural layer is fused with the dropout layer that follows it,
+ * for the test representation
+ */
+template <typename First, typename D2>
+struct layer_fusion<First, dropout_layer_impl<D2>, std::enable_if_t<decay_layer_traits<First>::is_neural_layer()>>
+        : fusion_detail::dropout_fusion<First, dropout_layer_impl<D2>> {};
+
+} //end of dll namespace
@@ -11,12 +11,18 @@
 
 #include "dll/util/tmp.hpp"
 #include "dll/base_conf.hpp"
+#include "dll/util/bf16.hpp"
+#include "dll/util/u8.hpp"
+#include "dll/util/pinned.hpp"
 
 // Common helpers
 #include "dll/generators/cache_helper.hpp"
 #include "dll/generators/label_cache_helper.hpp"
 #include "dll/generators/augmenters.hpp"
 #include "dll/generators/transformers.hpp"
+#include "dll/generators/batch_ring.hpp"
+#include "dll/generators/batch_noise.hpp"
+#include "dll/generators/batch_standardizer.hpp"
 
 namespace dll {
 
@@ -38,6 +44,26 @@ struct is_generator_impl<T, decltype((void)T::dll_generator, 0)> : std::true_typ
 template <typename T>
 constexpr bool is_generator = is_generator_impl<T>::value;
 
+/*!
+ * \brief Traits to test if a generator may augment its samples at runtime,
+ * independently of its descriptor
+ */
+template <typename T, typename = int>
+struct is_stage_augmented_impl : std::false_type {};
+
+/*!
+ * \copydoc is_stage_augmented_impl
+ */
+template <typename T>
+struct is_stage_augmented_impl<T, decltype((void)T::stage_augmentation, 0)> : std::integral_constant<bool, T::stage_augmentation> {};
+
+/*!
+ * \brief Indicates if a generator may augment its samples at runtime,
+ * independently of its descriptor
+ */
+template <typename T>
+constexpr bool is_stage_augmented = is_stage_augmented_impl<T>::value;
+
 /*!
  * \brief Helper to tell from the generator description if it is
  * augmenting the data
@@ -54,7 +80,32 @@ constexpr bool is_augmented =
 template<typename Desc>
 static constexpr bool is_threaded = Desc::Threaded;
 
+/*!
+ * \brief Helper to tell from the generator description if it shuffles a
+ * permutation of indices instead of the samples.
+ */
+template<typename Desc>
+static constexpr bool is_index_shuffle = Desc::IndexShuffle;
+
+/*!
+ * \brief Helper to tell from the generator description if its input
+ * cache is stored in a compact type (bfloat16 or uint8).
+ */
+template<typename Desc>
+static constexpr bool is_compact_cache = Desc::Bf16Cache || Desc::U8Cache;
+
+/*!
+ * \brief Helper to tell from the generator description if it prefetches
+ * the batches in the background.
+ */
+template<typename Desc>
+static constexpr bool is_prefetched = Desc::PrefetchBudget > 0;
+
 } // end of namespace dll
 
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/binary_data_generator.hpp"
+#include "dll/generators/compressed_data_generator.hpp"
+#include "dll/generators/view_data_generator.hpp"
+#include "dll/generators/pipeline_data_generator.hpp"
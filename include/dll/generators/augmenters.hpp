@@ -7,13 +7,42 @@
 
 #pragma once
 
+#include <cmath>
 #include <atomic>
 #include <thread>
+#include <vector>
+#include <algorithm>
 
 #include "dll/util/random.hpp"
+#include "dll/util/counter_rng.hpp"
+#include "dll/util/parallel.hpp"
 
 namespace dll {
 
+namespace augment_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of values of a batch to be augmented in parallel
+
+/*!
+ * \brief Call the functor for each sample of a batch, in parallel if the
+ * batch is large enough
+ *
+ * \param n The number of samples of the batch
+ * \param size The number of values of the batch
+ */
+template <typename Functor>
+void for_each_sample(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+} //end of namespace augment_detail
+
 /*!
  * \brief Randomly extract crops of a certain size from images
  */
@@ -64,11 +93,12 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
      */
-    template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
-        const size_t y_offset = dist_y(dll::rand_engine());
-        const size_t x_offset = dist_x(dll::rand_engine());
+    template <typename O, typename T, typename G>
+    void transform_first(O&& target, const T& image, G& g) {
+        const size_t y_offset = dist_y(g);
+        const size_t x_offset = dist_x(g);
 
         for (size_t c = 0; c < etl::dim<0>(image); ++c) {
             for (size_t y = 0; y < random_crop_y; ++y) {
@@ -131,10 +161,13 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
      */
-    template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
+    template <typename O, typename T, typename G>
+    void transform_first(O&& target, const T& image, G& g) {
         target = image;
+
+        cpp_unused(g);
     }
 
     /*!
@@ -167,6 +200,8 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
 
     std::uniform_int_distribution<size_t> dist; ///< The random distribution
 
+    std::vector<size_t> choices; ///< The choices of the samples of the batch
+
     /*!
      * \brief Initialize the random_mirrorer
      * \param image The image to crop from
@@ -199,32 +234,84 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    void transform(O&& target) {
-        auto choice = dist(dll::rand_engine());
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
+        auto choice = dist(g);
 
-        if (horizontal && vertical && choice == 1) {
+        if (flip_vertical(choice)) {
             for (size_t c = 0; c < etl::dim<0>(target); ++c) {
                 target(c) = vflip(target(c));
             }
-        } else if (horizontal && vertical && choice == 2) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = hflip(target(c));
-            }
         }
 
-        if (horizontal && choice == 1) {
+        if (flip_horizontal(choice)) {
             for (size_t c = 0; c < etl::dim<0>(target); ++c) {
                 target(c) = hflip(target(c));
             }
         }
+    }
 
-        if (vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = vflip(target(c));
-            }
+    /*!
+     * \brief Apply the transform on the first n samples of a batch, in
+     * place.
+     *
+     * The choices of all the samples are drawn first, the images are then
+     * flipped in parallel.
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples of the batch
+     * \param g The random engine
+     */
+    template <typename B, typename G>
+    void transform_batch(B&& batch, size_t n, G& g) {
+        const size_t C = etl::dim<1>(batch);
+        const size_t H = etl::dim<2>(batch);
+        const size_t W = etl::dim<3>(batch);
+
+        auto* x = batch.memory_start();
+
+        choices.resize(n);
+
+        for (auto& choice : choices) {
+            choice = dist(g);
         }
+
+        augment_detail::for_each_sample(n, n * C * H * W, [&](size_t i) {
+            const size_t choice = choices[i];
+
+            for (size_t c = 0; c < C; ++c) {
+                auto* plane = x + (i * C + c) * H * W;
+
+                if (flip_vertical(choice)) {
+                    for (size_t y = 0; y < H / 2; ++y) {
+                        std::swap_ranges(plane + y * W, plane + (y + 1) * W, plane + (H - 1 - y) * W);
+                    }
+                }
+
+                if (flip_horizontal(choice)) {
+                    for (size_t y = 0; y < H; ++y) {
+                        std::reverse(plane + y * W, plane + (y + 1) * W);
+                    }
+                }
+            }
+        });
+    }
+
+private:
+    /*!
+     * \brief Indicates if the given choice flips the image vertically
+     */
+    static bool flip_vertical(size_t choice) {
+        return vertical && choice == 1;
+    }
+
+    /*!
+     * \brief Indicates if the given choice flips the image horizontally
+     */
+    static bool flip_horizontal(size_t choice) {
+        return horizontal && choice == (vertical ? 2 : 1);
     }
 };
 
@@ -253,10 +340,25 @@ struct random_mirrorer<Desc, std::enable_if_t<!Desc::HorizontalMirroring && !Des
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    static void transform(O&& target) {
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples of the batch
+     * \param g The random engine
+     */
+    template <typename B, typename G>
+    static void transform_batch(B&& batch, size_t n, G& g) {
+        cpp_unused(batch);
+        cpp_unused(n);
+        cpp_unused(g);
     }
 };
 
@@ -295,15 +397,39 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    void transform(O&& target) {
-        auto& g = dll::rand_engine();
-
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
         for (auto& v : target) {
             v *= dist(g) < N * 10 ? 0.0 : 1.0;
         }
     }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch, in
+     * place, with a counter-based stream seeded by the random engine.
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples of the batch
+     * \param g The random engine
+     */
+    template <typename B, typename G>
+    void transform_batch(B&& batch, size_t n, G& g) {
+        using T = etl::value_t<std::decay_t<B>>;
+
+        auto* x = batch.memory_start();
+
+        const T p = T(N) / T(100);
+
+        const counter_rng rng(g(), g());
+
+        rng.for_each_uniform<T>(n * (etl::size(batch) / etl::dim<0>(batch)), [x, p](size_t i, T u) {
+            if (u < p) {
+                x[i] = T(0);
+            }
+        });
+    }
 };
 
 /*!
@@ -331,10 +457,25 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    static void transform(O&& target) {
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Apply the transform on the first n samples of a batch
+     * \param batch The batch to transform
+     * \param n The number of samples of the batch
+     * \param g The random engine
+     */
+    template <typename B, typename G>
+    static void transform_batch(B&& batch, size_t n, G& g) {
+        cpp_unused(batch);
+        cpp_unused(n);
+        cpp_unused(g);
     }
 };
 
@@ -344,20 +485,38 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
 template <typename Desc, typename Enable = void>
 struct elastic_distorter;
 
-// TODO This needs to be made MUCH faster
-
 /*!
  * \copydoc elastic_distorter
+ *
+ * The buffers of the displacement fields and of the remapping are kept
+ * between the images, they are only allocated again when the size of
+ * the images changes. Since each augmentation worker has its own
+ * distorter, there is no sharing between the workers.
+ *
+ * The gaussian kernel is separable, the blur is done with two passes of
+ * a 1-D kernel (2K operations per value instead of K * K). The
+ * coordinates and the weights of the bilinear interpolation are computed
+ * once per image and reused for each channel, the remapping of one
+ * channel is then a branch-free loop over the pixels.
  */
 template <typename Desc>
 struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
-    using weight = typename Desc::weight; ///< The data type
+    using weight = float; ///< The type of the displacement fields
 
     static constexpr size_t K     = Desc::ElasticDistortion;         ///< size of elastic distortion kernel
     static constexpr size_t mid   = K / 2;                           ///< Half of the kernel
     static constexpr double sigma = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
 
-    etl::fast_dyn_matrix<weight, K, K> kernel; ///< The precomputed kernel
+    etl::fast_dyn_matrix<weight, K> kernel; ///< The precomputed 1-D kernel
+
+    etl::dyn_matrix<weight, 2> d_x;     ///< The displacement field in x
+    etl::dyn_matrix<weight, 2> d_y;     ///< The displacement field in y
+    etl::dyn_matrix<weight, 2> blurred; ///< The first pass of the blur
+    etl::dyn_matrix<weight, 2> source;  ///< The copy of the channel being remapped
+    etl::dyn_matrix<weight, 2> remapped; ///< The remapped channel
+
+    std::vector<size_t> offsets; ///< The offsets of the four neighbours of each pixel
+    std::vector<weight> weights; ///< The weights of the four neighbours of each pixel
 
     static_assert(K % 2 == 1, "The kernel size must be odd");
 
@@ -371,17 +530,14 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
 
         cpp_unused(image);
 
-        // Precompute the gaussian kernel
+        // Precompute the gaussian kernel, the 2-D kernel being kernel(i) * kernel(j)
 
-        auto gaussian = [](double x, double y) {
-            auto Z = 2.0 * M_PI * sigma * sigma;
-            return (1.0 / Z) * std::exp(-((x * x + y * y) / (2.0 * sigma * sigma)));
+        auto gaussian = [](double x) {
+            return (1.0 / std::sqrt(2.0 * M_PI * sigma * sigma)) * std::exp(-(x * x) / (2.0 * sigma * sigma));
         };
 
         for (size_t i = 0; i < K; ++i) {
-            for (size_t j = 0; j < K; ++j) {
-                kernel(i, j) = gaussian(double(i) - mid, double(j) - mid);
-            }
+            kernel(i) = gaussian(double(i) - mid);
         }
     }
 
@@ -396,90 +552,150 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    void transform(O&& target) {
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
         const size_t width  = etl::dim<1>(target);
         const size_t height = etl::dim<2>(target);
 
-        // 0. Generate random displacement fields
+        if (etl::dim<0>(d_x) != width || etl::dim<1>(d_x) != height) {
+            d_x      = etl::dyn_matrix<weight, 2>(width, height);
+            d_y      = etl::dyn_matrix<weight, 2>(width, height);
+            blurred  = etl::dyn_matrix<weight, 2>(width, height);
+            source   = etl::dyn_matrix<weight, 2>(width, height);
+            remapped = etl::dyn_matrix<weight, 2>(width, height);
+
+            offsets.resize(4 * width * height);
+            weights.resize(4 * width * height);
+        }
 
-        etl::dyn_matrix<weight> d_x(width, height);
-        etl::dyn_matrix<weight> d_y(width, height);
+        // 0. Generate random displacement fields
 
-        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+        d_x = etl::uniform_generator(g, -1.0, 1.0);
+        d_y = etl::uniform_generator(g, -1.0, 1.0);
 
         // 1. Gaussian blur the displacement fields
 
-        etl::dyn_matrix<weight> d_x_blur(width, height);
-        etl::dyn_matrix<weight> d_y_blur(width, height);
-
-        gaussian_blur(d_x, d_x_blur);
-        gaussian_blur(d_y, d_y_blur);
+        gaussian_blur(d_x);
+        gaussian_blur(d_y);
 
         // 2. Normalize and scale the displacement field
 
-        d_x_blur *= (weight(8) / sum(d_x_blur));
-        d_y_blur *= (weight(8) / sum(d_y_blur));
+        d_x *= (weight(8) / sum(d_x));
+        d_y *= (weight(8) / sum(d_y));
+
+        // 3. Compute the neighbours of the displaced pixels, the pixels outside of the image are replaced by the first pixel
+
+        const size_t n = width * height;
+
+        for (size_t x = 0; x < width; ++x) {
+            for (size_t y = 0; y < height; ++y) {
+                const size_t i = x * height + y;
+
+                const weight px = x + d_x(x, y);
+                const weight py = y + d_y(x, y);
+
+                const weight fx = std::floor(px);
+                const weight fy = std::floor(py);
+
+                const weight ax = px - fx;
+                const weight ay = py - fy;
+
+                auto offset = [&](weight cx, weight cy) -> size_t {
+                    if (cx < 0 || cy < 0 || cx > width - 1 || cy > height - 1) {
+                        return 0;
+                    } else {
+                        return size_t(cx) * height + size_t(cy);
+                    }
+                };
 
-        // 3. Apply the displacement field (using bilinear interpolation)
+                offsets[0 * n + i] = offset(fx, fy);
+                offsets[1 * n + i] = offset(fx + 1, fy);
+                offsets[2 * n + i] = offset(fx, fy + 1);
+                offsets[3 * n + i] = offset(fx + 1, fy + 1);
 
-        auto safe = [&](size_t channel, weight x, weight y) {
-            if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
-                return target(channel, 0UL, 0UL);
-            } else {
-                return target(channel, size_t(x), size_t(y));
+                weights[0 * n + i] = (1 - ax) * (1 - ay);
+                weights[1 * n + i] = ax * (1 - ay);
+                weights[2 * n + i] = (1 - ax) * ay;
+                weights[3 * n + i] = ax * ay;
             }
-        };
+        }
 
-        for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
-            for (int x = 0; x < int(width); ++x) {
-                for (int y = 0; y < int(height); ++y) {
-                    auto dx = d_x_blur(x, y);
-                    auto dy = d_y_blur(x, y);
+        // 4. Apply the displacement field (using bilinear interpolation)
 
-                    weight px = x + dx;
-                    weight py = y + dy;
+        const weight* src = source.memory_start();
+        weight* dst       = remapped.memory_start();
 
-                    weight a = safe(channel, std::floor(px), std::floor(py));
-                    weight b = safe(channel, std::ceil(px), std::floor(py));
-                    weight c = safe(channel, std::ceil(px), std::ceil(py));
-                    weight d = safe(channel, std::floor(px), std::ceil(py));
+        const size_t* o0 = offsets.data();
+        const size_t* o1 = o0 + n;
+        const size_t* o2 = o1 + n;
+        const size_t* o3 = o2 + n;
 
-                    auto e = a * (1.0 - (px - std::floor(px))) + d * (px - std::floor(px));
-                    auto f = b * (1.0 - (px - std::floor(px))) + c * (px - std::floor(px));
+        const weight* w0 = weights.data();
+        const weight* w1 = w0 + n;
+        const weight* w2 = w1 + n;
+        const weight* w3 = w2 + n;
 
-                    auto value = e * (1.0 - (py - std::floor(py))) + f * (py - std::floor(py));
+        for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
+            source = target(channel);
 
-                    target(channel, x, y) = value;
-                }
+            for (size_t i = 0; i < n; ++i) {
+                dst[i] = w0[i] * src[o0[i]] + w1[i] * src[o1[i]] + w2[i] * src[o2[i]] + w3[i] * src[o3[i]];
             }
+
+            target(channel) = remapped;
         }
     }
 
     /*!
-     * \brief Apply a gaussian blur on the distortion matrix
+     * \brief Apply a gaussian blur on the distortion matrix, in place
+     *
+     * The values outside of the matrix are considered to be zero, the
+     * blurred sum is subtracted from the matrix.
      */
-    void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
+    void gaussian_blur(etl::dyn_matrix<weight, 2>& d) {
         const size_t width  = etl::dim<0>(d);
         const size_t height = etl::dim<1>(d);
 
+        // First pass, along the rows
+
         for (size_t j = 0; j < width; ++j) {
-            for (size_t k = 0; k < height; ++k) {
-                weight sum(0.0);
-
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - mid >= 0 && long(j) + p - mid < width) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - mid >= 0 && long(k) + q - mid < height) {
-                                sum += kernel(p, q) * d(j + p - mid, k + q - mid);
-                            }
-                        }
-                    }
+            const weight* in = d.memory_start() + j * height;
+            weight* out      = blurred.memory_start() + j * height;
+
+            std::fill(out, out + height, weight(0));
+
+            for (size_t q = 0; q < K; ++q) {
+                // The values of out[k] reading in[k + q - mid] inside the row
+                const size_t first = q < mid ? mid - q : 0;
+                const size_t last  = q > mid ? (height > q - mid ? height - (q - mid) : 0) : height;
+
+                const weight kq = kernel(q);
+
+                for (size_t k = first; k < last; ++k) {
+                    out[k] += kq * in[k + q - mid];
                 }
+            }
+        }
+
+        // Second pass, along the columns, subtracted from the matrix
+
+        constexpr weight scale = weight(1) / (K * K);
+
+        for (size_t j = 0; j < width; ++j) {
+            weight* out = d.memory_start() + j * height;
+
+            const size_t first = j < mid ? mid - j : 0;
+            const size_t last  = std::min(size_t(K), width + mid - j);
 
-                d_blur(j, k) = d(j, k) - (sum / (K * K));
+            for (size_t p = first; p < last; ++p) {
+                const weight* in = blurred.memory_start() + (j + p - mid) * height;
+                const weight kp  = scale * kernel(p);
+
+                for (size_t k = 0; k < height; ++k) {
+                    out[k] -= kp * in[k];
+                }
             }
         }
     }
@@ -510,10 +726,105 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
-    template <typename O>
-    static void transform(O&& target) {
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+};
+
+/*!
+ * \brief The set of augmenters used by one augmentation worker.
+ *
+ * Each worker has its own random engine so that several workers can
+ * augment different batches concurrently.
+ */
+template <typename Desc>
+struct augmentation_worker {
+    random_engine engine; ///< The random engine of the worker
+
+    random_cropper<Desc> cropper;      ///< The random cropper
+    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
+    elastic_distorter<Desc> distorter; ///< The elastic distorter
+    random_noise<Desc> noiser;         ///< The random noiser
+
+    /*!
+     * \brief Initialize the augmenters of the worker
+     * \param image An example image
+     * \param seed The seed of the random engine of the worker
+     */
+    template <typename T>
+    augmentation_worker(const T& image, size_t seed) : engine(seed), cropper(image), mirrorer(image), distorter(image), noiser(image) {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief The number of generated images from one input image
+     * \return The augmentation factor
+     */
+    size_t scaling() const {
+        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling();
+    }
+
+    /*!
+     * \brief Apply the first transform (crop) from the image to the target
+     * \param target The target output
+     * \param image The input image
+     * \param train Indicates if the generator is in train mode
+     */
+    template <typename O, typename T>
+    void transform_first(O&& target, const T& image, bool train) {
+        if (train) {
+            // Random crop the image
+            cropper.transform_first(target, image, engine);
+        } else {
+            // Center crop the image
+            cropper.transform_first_test(target, image);
+        }
+    }
+
+    /*!
+     * \brief Apply the random transforms on the target
+     * \param target The target to transform
+     */
+    template <typename O>
+    void transform(O&& target) {
+        // Mirror the image
+        mirrorer.transform(target, engine);
+
+        // Distort the image
+        distorter.transform(target, engine);
+
+        // Noise the image
+        noiser.transform(target, engine);
+    }
+
+    /*!
+     * \brief Apply the random transforms on the first n samples of a
+     * batch, in place.
+     *
+     * The mirroring and the noise are applied to the whole batch at once,
+     * the elastic distortion to each image.
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples of the batch
+     */
+    template <typename B>
+    void transform_batch(B&& batch, size_t n) {
+        // Mirror the images
+        mirrorer.transform_batch(batch, n, engine);
+
+        // Distort the images
+        if (Desc::ElasticDistortion) {
+            for (size_t i = 0; i < n; ++i) {
+                distorter.transform(batch(i), engine);
+            }
+        }
+
+        // Noise the images
+        noiser.transform_batch(batch, n, engine);
     }
 };
 
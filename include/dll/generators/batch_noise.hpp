@@ -0,0 +1,161 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/counter_rng.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Helper to tell from the generator description if noise is added
+ * to its batches.
+ */
+template <typename Desc>
+constexpr bool is_batch_noised = Desc::GaussianNoise || Desc::MaskingNoise || Desc::SaltPepperNoise;
+
+/*!
+ * \brief Add noise to the batches of a generator.
+ *
+ * The noisy batch is computed in its own buffer from the clean batch
+ * each time a new batch is generated, with the counter-based random
+ * numbers, in parallel. The samples of the generator are never modified
+ * and a new noise pattern is drawn for each epoch.
+ */
+template <typename Desc, typename Cache, typename Enable = void>
+struct batch_noiser;
+
+/*!
+ * \copydoc batch_noiser
+ */
+template <typename Desc, typename Cache>
+struct batch_noiser<Desc, Cache, std::enable_if_t<is_batch_noised<Desc>>> {
+    using weight = etl::value_t<Cache>; ///< The data type
+
+    static constexpr size_t D = etl::decay_traits<Cache>::dimensions(); ///< The number of dimensions of the cache
+
+    using batch_t = etl::dyn_matrix<weight, D>; ///< The type of the noisy batch
+
+    batch_t noisy;            ///< The noisy batch
+    std::vector<weight> gauss; ///< The gaussian noise of the batch
+
+    size_t generated = size_t(-1); ///< The index of the generated batch
+
+    /*!
+     * \brief Allocate the noisy batch for the given cache
+     */
+    void init(const Cache& cache, size_t batch_size) {
+        init(cache, batch_size, std::make_index_sequence<D - 1>());
+    }
+
+    /*!
+     * \brief Indicates that the next batch must be generated again, at the
+     * start of an epoch
+     */
+    void invalidate() {
+        generated = size_t(-1);
+    }
+
+    /*!
+     * \brief Return the noisy version of the given batch
+     * \param batch The clean batch
+     * \param index The index of the first sample of the batch
+     */
+    template <typename B>
+    auto apply(const B& batch, size_t index) {
+        const size_t n = etl::dim<0>(batch);
+
+        auto target = etl::slice(noisy, 0, n);
+
+        if (generated != index) {
+            target = batch;
+
+            add_noise(target.memory_start(), etl::size(target));
+
+            generated = index;
+        }
+
+        return target;
+    }
+
+private:
+    template <size_t... I>
+    void init(const Cache& cache, size_t batch_size, std::index_sequence<I...> /*seq*/) {
+        noisy = batch_t(batch_size, etl::dim<I + 1>(cache)...);
+    }
+
+    /*!
+     * \brief Add the noise of the descriptor to the given values
+     */
+    void add_noise(weight* x, size_t n) {
+        if /*constexpr*/ (Desc::GaussianNoise) {
+            gauss.resize(n);
+
+            next_rng().normal(gauss.data(), n, weight(0), weight(Desc::GaussianNoise) / weight(100));
+
+            for (size_t i = 0; i < n; ++i) {
+                x[i] += gauss[i];
+            }
+        }
+
+        if /*constexpr*/ (Desc::MaskingNoise) {
+            const weight p = weight(Desc::MaskingNoise) / weight(100);
+
+            next_rng().for_each_uniform<weight>(n, [x, p](size_t i, weight u) {
+                if (u < p) {
+                    x[i] = weight(0);
+                }
+            });
+        }
+
+        if /*constexpr*/ (Desc::SaltPepperNoise) {
+            const weight p = weight(Desc::SaltPepperNoise) / weight(100);
+
+            // The half of the corrupted values are set to zero, the other half to one
+            next_rng().for_each_uniform<weight>(n, [x, p](size_t i, weight u) {
+                if (u < p) {
+                    x[i] = u < p / weight(2) ? weight(0) : weight(1);
+                }
+            });
+        }
+    }
+};
+
+/*!
+ * \copydoc batch_noiser
+ */
+template <typename Desc, typename Cache>
+struct batch_noiser<Desc, Cache, std::enable_if_t<!is_batch_noised<Desc>>> {
+    /*!
+     * \brief Allocate the noisy batch for the given cache
+     */
+    void init(const Cache& cache, size_t batch_size) {
+        cpp_unused(cache);
+        cpp_unused(batch_size);
+    }
+
+    /*!
+     * \brief Indicates that the next batch must be generated again
+     */
+    void invalidate() {}
+
+    /*!
+     * \brief Return the given batch, unchanged
+     */
+    template <typename B>
+    B apply(B batch, size_t index) {
+        cpp_unused(index);
+        return batch;
+    }
+};
+
+} //end of dll namespace
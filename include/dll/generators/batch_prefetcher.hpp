@@ -0,0 +1,224 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Prefetching of the batches of a generator by the trainers.
+ *
+ * While a trainer works on the batch n, the batch n + 1 is prepared by a
+ * background task of the scheduler (move of the generator, transforms,
+ * noise, refill of the caches) and copied in a second buffer. The
+ * generators already preparing their batches in the background are used
+ * directly.
+ */
+
+#pragma once
+
+#include <future>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/scheduler.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a generator draws its epochs by the losses of
+ * the samples reported by the trainer
+ */
+template <typename T, typename = int>
+struct is_importance_sampled_impl : std::false_type {};
+
+/*!
+ * \copydoc is_importance_sampled_impl
+ */
+template <typename T>
+struct is_importance_sampled_impl<T, decltype((void)T::importance_sampling, 0)> : std::integral_constant<bool, T::importance_sampling> {};
+
+/*!
+ * \copydoc is_importance_sampled_impl
+ */
+template <typename T>
+constexpr bool is_importance_sampled = is_importance_sampled_impl<T>::value;
+
+/*!
+ * \brief Prefetch the batches of a generator, from its current batch.
+ *
+ * The generator must not be used while the prefetcher is alive.
+ */
+template <typename Generator, typename Enable = void>
+struct batch_prefetcher {
+    using data_t  = decltype(etl::force_temporary(std::declval<const Generator&>().data_batch()));  ///< The type of a data batch
+    using label_t = decltype(etl::force_temporary(std::declval<const Generator&>().label_batch())); ///< The type of a label batch
+
+    /*!
+     * \brief Start prefetching the batches of the given generator
+     */
+    explicit batch_prefetcher(Generator& generator) : generator(generator), current(generator.current_batch()) {
+        valid[front] = generator.has_next_batch();
+
+        if (valid[front]) {
+            load(front);
+            start_loader();
+        }
+    }
+
+    batch_prefetcher(const batch_prefetcher& rhs) = delete;
+    batch_prefetcher& operator=(const batch_prefetcher& rhs) = delete;
+
+    /*!
+     * \brief Wait for the background task, if any
+     */
+    ~batch_prefetcher() {
+        wait_loader();
+    }
+
+    /*!
+     * \brief Indicates if there is a current batch
+     */
+    bool has_next_batch() const {
+        return valid[front];
+    }
+
+    /*!
+     * \brief Moves to the next batch, prepared while the current one was used
+     */
+    void next_batch() {
+        wait_loader();
+
+        valid[front] = false;
+        front        = 1 - front;
+
+        ++current;
+
+        if (valid[front]) {
+            start_loader();
+        }
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     */
+    const data_t& data_batch() const {
+        return data[front];
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     */
+    const label_t& label_batch() const {
+        return labels[front];
+    }
+
+    /*!
+     * \brief Returns the index of the current batch in the generator
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+private:
+    /*!
+     * \brief Copy the current batch of the generator into the given buffer
+     */
+    void load(size_t buffer) {
+        data[buffer]   = etl::force_temporary(generator.data_batch());
+        labels[buffer] = etl::force_temporary(generator.label_batch());
+    }
+
+    /*!
+     * \brief Start preparing the next batch in the back buffer
+     */
+    void start_loader() {
+        const size_t back = 1 - front;
+
+        loader = scheduler().submit_background([this, back] {
+            generator.next_batch();
+
+            valid[back] = generator.has_next_batch();
+
+            if (valid[back]) {
+                load(back);
+            }
+        });
+    }
+
+    /*!
+     * \brief Wait for the back buffer to be prepared
+     */
+    void wait_loader() {
+        if (loader.valid()) {
+            dll::auto_timer timer("prefetcher::wait");
+
+            loader.get();
+        }
+    }
+
+    Generator& generator;           ///< The prefetched generator
+    data_t data[2];                 ///< The data batch buffers
+    label_t labels[2];              ///< The label batch buffers
+    bool valid[2] = {false, false}; ///< Indicates if each buffer holds a batch
+    size_t front   = 0;             ///< The buffer of the current batch
+    size_t current = 0;             ///< The index of the current batch
+    std::future<void> loader;       ///< The background task preparing the back buffer
+};
+
+/*!
+ * \copydoc batch_prefetcher
+ *
+ * The generator already prepares its batches in the background, it is used
+ * directly.
+ */
+template <typename Generator>
+struct batch_prefetcher<Generator, std::enable_if_t<Generator::background_batches>> {
+    /*!
+     * \brief Use the batches of the given generator
+     */
+    explicit batch_prefetcher(Generator& generator) : generator(generator) {}
+
+    /*!
+     * \brief Indicates if there is a current batch
+     */
+    bool has_next_batch() const {
+        return generator.has_next_batch();
+    }
+
+    /*!
+     * \brief Moves to the next batch
+     */
+    void next_batch() {
+        generator.next_batch();
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     */
+    decltype(auto) data_batch() const {
+        return generator.data_batch();
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     */
+    decltype(auto) label_batch() const {
+        return generator.label_batch();
+    }
+
+    /*!
+     * \brief Returns the index of the current batch in the generator
+     */
+    size_t current_batch() const {
+        return generator.current_batch();
+    }
+
+private:
+    Generator& generator; ///< The generator
+};
+
+} //end of dll namespace
@@ -0,0 +1,463 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Ring of batches shared between the augmentation workers and the
+ * consumer of a threaded generator.
+ *
+ * The number of slots of the ring (its capacity) is chosen when the
+ * generator is constructed, from big_batch_size or from the memory budget
+ * of the batch cache. The number of slots in use (the depth) can be
+ * reduced at each reset of the generation, from the measured time to
+ * produce and to consume a batch, so that the ready batches are consumed
+ * while they are still in cache.
+ *
+ * The ring also accounts the stalls of the generation: the time the
+ * consumer waited for a ready batch, the time the workers waited for a
+ * free slot and the time spent transforming and augmenting the batches.
+ * The clock is only read when a thread actually waits, and twice per
+ * batch by the workers.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the number of slots of the ring of a generator
+ *
+ * \param budget The memory budget of the batch cache, in bytes (0 to use big_batch_size)
+ * \param batch_bytes The memory of one batch of the cache, in bytes
+ * \param big_batch_size The number of slots without budget
+ * \param batches The number of batches of the generator
+ */
+inline size_t ring_capacity(size_t budget, size_t batch_bytes, size_t big_batch_size, size_t batches) {
+    if (!budget) {
+        return big_batch_size;
+    }
+
+    // More slots than batches would never be used
+    return std::max<size_t>(1, std::min(budget / std::max<size_t>(1, batch_bytes), batches));
+}
+
+/*!
+ * \brief The stalls of the generation of a generator, since its last reset
+ */
+struct generator_stall_stats {
+    size_t batches          = 0;   ///< The number of batches produced
+    double consumer_wait_ms = 0.0; ///< The total time the consumer waited for a batch
+    double producer_wait_ms = 0.0; ///< The total time the workers waited for a free slot
+    double transform_ms     = 0.0; ///< The total time spent reading and pre-transforming the samples
+    double augment_ms       = 0.0; ///< The total time spent augmenting the batches
+};
+
+/*!
+ * \brief A ring of batch slots exchanged between the producer threads
+ * of a generator and its (single) consumer.
+ *
+ * The state of each slot is handled with atomics. A thread that must wait
+ * first spins for Spin iterations and is only then parked on a condition
+ * variable. The lock is only ever taken to park or to wake a parked thread.
+ *
+ * \tparam Spin The number of spin iterations before parking
+ */
+template <size_t Spin>
+struct batch_ring {
+    using clock      = std::chrono::steady_clock; ///< The clock of the measurements
+    using time_point = clock::time_point;         ///< A point in time of the measurements
+
+    static constexpr size_t slot_free    = 0; ///< The slot must be generated
+    static constexpr size_t slot_working = 1; ///< The slot is being generated by a worker
+    static constexpr size_t slot_ready   = 2; ///< The slot is ready to be consumed
+
+    const size_t N;            ///< The number of slots of the ring
+    std::atomic<size_t> depth; ///< The number of slots in use
+
+    std::unique_ptr<std::atomic<size_t>[]> status;  ///< The status of each slot
+    std::unique_ptr<std::atomic<size_t>[]> indices; ///< The index of the batch held in each slot
+    std::unique_ptr<time_point[]> claimed;          ///< The time each slot has been claimed by its worker
+
+    std::atomic<size_t> produce_ns{0}; ///< The total time spent by the workers producing batches
+    std::atomic<size_t> produced{0};   ///< The number of batches produced
+    size_t consume_ns = 0;             ///< The total time between two releases of the consumer
+    size_t consumed   = 0;             ///< The number of consumer intervals measured
+    time_point last_release;           ///< The time of the last release, if consume_started
+    bool consume_started = false;      ///< Indicates if a release has been done since the last reset
+
+    std::atomic<size_t> consumer_wait_ns{0}; ///< The total time the consumer waited for a ready slot
+    std::atomic<size_t> producer_wait_ns{0}; ///< The total time the workers waited for a free slot
+    std::atomic<size_t> transform_ns{0};     ///< The total time the workers spent transforming the samples
+    std::atomic<size_t> augment_ns{0};       ///< The total time the workers spent augmenting the batches
+    std::atomic<size_t> stall_batches{0};    ///< The number of batches produced since the last reset
+
+    std::atomic<bool> stop_flag;          ///< Boolean flag indicating to the workers to stop
+    std::atomic<size_t> parked_producers; ///< The number of parked workers
+    std::atomic<bool> parked_consumer;    ///< Indicates if the consumer is parked
+
+    std::mutex lock;                            ///< The lock used for parking
+    std::condition_variable producer_condition; ///< The condition variable for the workers to wait for some space
+    std::condition_variable consumer_condition; ///< The condition variable for the consumer to wait for ready data
+
+    /*!
+     * \brief Construct a new ring of n slots, all in use and free
+     * \param n The number of slots
+     */
+    explicit batch_ring(size_t n)
+            : N(n), depth(n), status(new std::atomic<size_t>[n]), indices(new std::atomic<size_t>[n]), claimed(new time_point[n]),
+              stop_flag(false), parked_producers(0), parked_consumer(false) {
+        for (size_t b = 0; b < N; ++b) {
+            status[b]  = slot_free;
+            indices[b] = b;
+        }
+    }
+
+    /*!
+     * \brief Returns the slot holding the given batch
+     */
+    size_t slot(size_t batch) const {
+        return batch % depth;
+    }
+
+    /*!
+     * \brief Reset the ring to the first batches, with the given number of
+     * slots in use.
+     *
+     * \param d The number of slots in use, at most the number of slots
+     */
+    void reset(size_t d) {
+        depth = std::max<size_t>(1, std::min(d, N));
+
+        for (size_t b = 0; b < N; ++b) {
+            indices[b] = b;
+            status[b]  = slot_free;
+        }
+
+        consume_started = false;
+
+        consumer_wait_ns = 0;
+        producer_wait_ns = 0;
+        transform_ns     = 0;
+        augment_ns       = 0;
+        stall_batches    = 0;
+
+        wake_producers(true);
+    }
+
+    /*!
+     * \brief Reset the ring to the first batches, with the same depth.
+     */
+    void reset() {
+        reset(depth);
+    }
+
+    /*!
+     * \brief Returns the average time to produce a batch by one worker, in
+     * milliseconds, or zero if nothing has been measured
+     */
+    double produce_ms() const {
+        return produced ? 1e-6 * double(produce_ns) / double(produced) : 0.0;
+    }
+
+    /*!
+     * \brief Returns the average time between two batches consumed, in
+     * milliseconds, or zero if nothing has been measured
+     */
+    double consume_ms() const {
+        return consumed ? 1e-6 * double(consume_ns) / double(consumed) : 0.0;
+    }
+
+    /*!
+     * \brief Compute the depth holding the given time of consumption.
+     *
+     * When the workers produce faster than the consumer, the ready batches
+     * cover ms milliseconds of consumption, to absorb the stalls of the
+     * workers. Otherwise, the ring is never full and one slot per worker
+     * (and the consumed one) is enough. The measurements are restarted.
+     *
+     * \param ms The target time of consumption held in the ready batches
+     * \param workers The number of workers
+     * \return The depth of the ring, at most its number of slots, or its
+     * current depth if nothing has been measured
+     */
+    size_t prefetch_depth(size_t ms, size_t workers) {
+        const double produce = produce_ms() / double(workers);
+        const double consume = consume_ms();
+
+        produce_ns = 0;
+        produced   = 0;
+        consume_ns = 0;
+        consumed   = 0;
+
+        if (!produce || !consume) {
+            return depth.load();
+        }
+
+        size_t d = workers + 1;
+
+        if (produce < consume) {
+            d = std::max<size_t>(d, size_t(std::ceil(double(ms) / consume)) + 1);
+        }
+
+        return std::min(d, N);
+    }
+
+    /*!
+     * \brief Returns the stalls of the generation since the last reset
+     */
+    generator_stall_stats stalls() const {
+        generator_stall_stats stats;
+
+        stats.batches          = stall_batches;
+        stats.consumer_wait_ms = 1e-6 * consumer_wait_ns;
+        stats.producer_wait_ms = 1e-6 * producer_wait_ns;
+        stats.transform_ms     = 1e-6 * transform_ns;
+        stats.augment_ms       = 1e-6 * augment_ns;
+
+        return stats;
+    }
+
+    /*!
+     * \brief Returns the current time, for the accounting of the workers
+     */
+    static time_point now() {
+        return clock::now();
+    }
+
+    /*!
+     * \brief Add the time elapsed since the given point to the given
+     * counter and restart the measurement
+     * \param counter The counter of the time (transform_ns or augment_ns)
+     * \param since The start of the measurement, set to the current time
+     */
+    static void account(std::atomic<size_t>& counter, time_point& since) {
+        const auto t = clock::now();
+
+        counter += std::chrono::duration_cast<std::chrono::nanoseconds>(t - since).count();
+        since = t;
+    }
+
+    /*!
+     * \brief Stop the workers waiting on the ring
+     */
+    void stop() {
+        stop_flag = true;
+
+        wake_producers(true);
+    }
+
+    /*!
+     * \brief Returns the index of the batch held in the given slot
+     * \param b The slot
+     * \return The index of the batch
+     */
+    size_t batch(size_t b) const {
+        return indices[b].load(std::memory_order_acquire);
+    }
+
+    /*!
+     * \brief Wait for a slot to generate and claim it.
+     *
+     * \param index The claimed slot
+     * \param batches The number of batches in the generator
+     * \param lowest Indicates if the slot holding the lowest batch must be claimed (for in-order producers)
+     *
+     * \return true if a slot was claimed, false if the ring was stopped
+     */
+    bool acquire(size_t& index, size_t batches, bool lowest) {
+        if (stop_flag) {
+            return false;
+        }
+
+        if (try_claim(index, batches, lowest)) {
+            claimed[index] = clock::now();
+            return true;
+        }
+
+        // The worker is waiting for a free slot
+        auto start = clock::now();
+
+        for (size_t s = 0; s < Spin; ++s) {
+            if (stop_flag) {
+                return false;
+            }
+
+            if (try_claim(index, batches, lowest)) {
+                account(producer_wait_ns, start);
+                claimed[index] = start;
+                return true;
+            }
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        ++parked_producers;
+
+        producer_condition.wait(ulock, [this, &index, batches, lowest] { return stop_flag || try_claim(index, batches, lowest); });
+
+        --parked_producers;
+
+        if (!stop_flag) {
+            account(producer_wait_ns, start);
+            claimed[index] = start;
+        }
+
+        return !stop_flag;
+    }
+
+    /*!
+     * \brief Publish a generated slot to the consumer
+     * \param b The generated slot
+     */
+    void publish(size_t b) {
+        produce_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - claimed[b]).count();
+        ++produced;
+        ++stall_batches;
+
+        status[b] = slot_ready;
+
+        if (parked_consumer) {
+            // Taking the lock guarantees the consumer is either waiting or will see the new status
+            { std::lock_guard<std::mutex> l(lock); }
+
+            consumer_condition.notify_all();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the given slot holds the given batch, ready to be
+     * consumed, without waiting
+     * \param b The slot
+     * \param index The index of the batch
+     */
+    bool ready(size_t b, size_t index) const {
+        return status[b].load(std::memory_order_acquire) == slot_ready && batch(b) == index;
+    }
+
+    /*!
+     * \brief Wait for the given slot to be ready
+     * \param b The slot to wait for
+     */
+    void wait_ready(size_t b) {
+        if (status[b].load(std::memory_order_acquire) == slot_ready) {
+            return;
+        }
+
+        // The consumer is waiting for the batch
+        auto start = clock::now();
+
+        for (size_t s = 0; s < Spin; ++s) {
+            if (status[b].load(std::memory_order_acquire) == slot_ready) {
+                account(consumer_wait_ns, start);
+                return;
+            }
+        }
+
+        if (status[b] == slot_ready) {
+            account(consumer_wait_ns, start);
+            return;
+        }
+
+        dll::auto_timer timer("generator::wait");
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        parked_consumer = true;
+
+        consumer_condition.wait(ulock, [this, b] { return status[b] == slot_ready; });
+
+        parked_consumer = false;
+
+        account(consumer_wait_ns, start);
+    }
+
+    /*!
+     * \brief Release a consumed slot so that it can hold the batch depth
+     * batches further.
+     *
+     * \param b The consumed slot
+     */
+    void release(size_t b) {
+        const auto now = clock::now();
+
+        if (consume_started) {
+            consume_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_release).count();
+            ++consumed;
+        }
+
+        last_release    = now;
+        consume_started = true;
+
+        indices[b] += depth;
+        status[b] = slot_free;
+
+        wake_producers(false);
+    }
+
+private:
+    /*!
+     * \brief Try to claim a free slot
+     */
+    bool try_claim(size_t& index, size_t batches, bool lowest) {
+        bool found     = false;
+        size_t claimed = 0;
+
+        for (size_t b = 0; b < depth; ++b) {
+            if (status[b] == slot_free && indices[b] < batches) {
+                if (!lowest) {
+                    size_t expected = slot_free;
+                    if (status[b].compare_exchange_strong(expected, slot_working)) {
+                        index = b;
+                        return true;
+                    }
+                } else if (!found || indices[b] < indices[claimed]) {
+                    claimed = b;
+                    found   = true;
+                }
+            }
+        }
+
+        if (found) {
+            size_t expected = slot_free;
+            if (status[claimed].compare_exchange_strong(expected, slot_working)) {
+                index = claimed;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Wake the parked workers, if any
+     * \param all Indicates if all the workers must be woken up
+     */
+    void wake_producers(bool all) {
+        if (parked_producers) {
+            // Taking the lock guarantees the workers are either waiting or will see the new status
+            { std::lock_guard<std::mutex> l(lock); }
+
+            if (all) {
+                producer_condition.notify_all();
+            } else {
+                producer_condition.notify_one();
+            }
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,180 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/standardization.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Helper to tell from the generator description if its inputs
+ * are standardized over the dataset.
+ */
+template <typename Desc>
+constexpr bool is_standardized = Desc::StandardizePre || Desc::ChannelStandardizePre;
+
+/*!
+ * \brief Standardize the batches of a generator.
+ *
+ * The statistics are computed once from the samples of the cache. The
+ * standardized batch is computed in its own buffer from the batch of the
+ * cache each time a new batch is generated, in the same pass as the copy,
+ * the samples of the generator are never modified.
+ */
+template <bool Enabled, typename Cache, typename Enable = void>
+struct batch_standardizer;
+
+/*!
+ * \copydoc batch_standardizer
+ */
+template <bool Enabled, typename Cache>
+struct batch_standardizer<Enabled, Cache, std::enable_if_t<Enabled>> {
+    using weight = etl::value_t<Cache>; ///< The data type
+
+    static constexpr size_t D                  = etl::decay_traits<Cache>::dimensions(); ///< The number of dimensions of the cache
+    static constexpr size_t parallel_threshold = 64 * 1024;                              ///< The minimum number of values of a batch to be standardized in parallel
+
+    using batch_t = etl::dyn_matrix<weight, D>; ///< The type of the standardized batch
+
+    dll::standardization<weight> stats; ///< The statistics of the dataset
+    batch_t standardized;               ///< The standardized batch
+
+    size_t generated = size_t(-1); ///< The index of the generated batch
+
+    /*!
+     * \brief Allocate the standardized batch for the given cache
+     */
+    void init(const Cache& cache, size_t batch_size) {
+        init(cache, batch_size, std::make_index_sequence<D - 1>());
+    }
+
+    /*!
+     * \brief Compute the statistics of the first n samples of the cache
+     * \param cache The cache of the samples
+     * \param n The number of samples
+     * \param channels Indicates if the statistics are computed for each channel instead of each feature
+     */
+    void compute(const Cache& cache, size_t n, bool channels) {
+        const size_t size = etl::size(cache) / std::max<size_t>(1, etl::dim<0>(cache));
+        const weight* x   = cache.memory_start();
+
+        stats.compute(n, size, channels ? etl::dim<1>(cache) : 0, [x, size](size_t i) { return x + i * size; });
+
+        invalidate();
+    }
+
+    /*!
+     * \brief Use the given statistics, computed on another dataset
+     */
+    void set(const dll::standardization<weight>& statistics) {
+        stats = statistics;
+
+        invalidate();
+    }
+
+    /*!
+     * \brief Indicates that the next batch must be generated again
+     */
+    void invalidate() {
+        generated = size_t(-1);
+    }
+
+    /*!
+     * \brief Return the standardized version of the given batch
+     * \param batch The batch of the cache
+     * \param index The index of the first sample of the batch
+     */
+    template <typename B>
+    auto apply(const B& batch, size_t index) {
+        const size_t n = etl::dim<0>(batch);
+
+        auto target = etl::slice(standardized, 0, n);
+
+        if (generated != index) {
+            const size_t S = stats.sample_size();
+
+            const weight* in = batch.memory_start();
+            weight* out      = target.memory_start();
+
+            auto functor = [this, in, out, S](size_t i) {
+                stats.apply(out + i * S, in + i * S);
+            };
+
+            if (n * S >= parallel_threshold && n > 1) {
+                parallel_for_n(n, functor);
+            } else {
+                for (size_t i = 0; i < n; ++i) {
+                    functor(i);
+                }
+            }
+
+            target.invalidate_gpu();
+
+            generated = index;
+        }
+
+        return target;
+    }
+
+private:
+    template <size_t... I>
+    void init(const Cache& cache, size_t batch_size, std::index_sequence<I...> /*seq*/) {
+        standardized = batch_t(batch_size, etl::dim<I + 1>(cache)...);
+    }
+};
+
+/*!
+ * \copydoc batch_standardizer
+ */
+template <bool Enabled, typename Cache>
+struct batch_standardizer<Enabled, Cache, std::enable_if_t<!Enabled>> {
+    /*!
+     * \brief Allocate the standardized batch for the given cache
+     */
+    void init(const Cache& cache, size_t batch_size) {
+        cpp_unused(cache);
+        cpp_unused(batch_size);
+    }
+
+    /*!
+     * \brief Compute the statistics of the first n samples of the cache
+     */
+    void compute(const Cache& cache, size_t n, bool channels) {
+        cpp_unused(cache);
+        cpp_unused(n);
+        cpp_unused(channels);
+    }
+
+    /*!
+     * \brief Use the given statistics, computed on another dataset
+     */
+    template <typename S>
+    void set(const S& statistics) {
+        cpp_unused(statistics);
+    }
+
+    /*!
+     * \brief Indicates that the next batch must be generated again
+     */
+    void invalidate() {}
+
+    /*!
+     * \brief Return the given batch, unchanged
+     */
+    template <typename B>
+    B apply(B batch, size_t index) {
+        cpp_unused(index);
+        return batch;
+    }
+};
+
+} //end of dll namespace
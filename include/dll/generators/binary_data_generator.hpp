@@ -0,0 +1,700 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator reading from a memory-mapped
+ * binary dataset file.
+ *
+ * The binary format is made of a fixed 64 bytes header, followed by all the
+ * samples as contiguous single-precision floats, followed by one float label
+ * per sample. Since the samples are already decoded, a batch is simply a
+ * memcpy from the mapped file and the kernel can read-ahead the file.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The header of a binary dataset file
+ */
+struct binary_dataset_header {
+    static constexpr uint32_t current_version = 1; ///< The version of the format
+    static constexpr size_t max_dimensions    = 4; ///< The maximum number of dimensions of a sample
+
+    char magic[4];                    ///< The magic identifier ("DLLB")
+    uint32_t version;                 ///< The version of the format
+    uint32_t n_dims;                  ///< The number of dimensions of one sample
+    uint32_t reserved;                ///< Unused, kept for alignment
+    uint64_t n;                       ///< The number of samples
+    uint64_t dims[max_dimensions];    ///< The dimensions of one sample
+    uint64_t padding;                 ///< Pad the header to 64 bytes
+
+    /*!
+     * \brief Return the number of floats of one sample
+     */
+    size_t sample_size() const {
+        size_t s = 1;
+
+        for (size_t d = 0; d < n_dims; ++d) {
+            s *= dims[d];
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Indicates if the header is a valid binary dataset header
+     */
+    bool valid() const {
+        return std::memcmp(magic, "DLLB", 4) == 0 && version == current_version && n_dims > 0 && n_dims <= max_dimensions;
+    }
+};
+
+static_assert(sizeof(binary_dataset_header) == 64, "The binary dataset header must be 64 bytes");
+
+/*!
+ * \brief Convert a dataset to the binary format used by the
+ * binary_data_generator.
+ *
+ * The samples are read once from the iterators, this can be used to
+ * convert a dataset that is expensive to decode (images on disk for
+ * instance) once and for all.
+ *
+ * \param path The path of the file to write
+ * \param first The iterator on the beginning on data
+ * \param last The iterator on the end  on data
+ * \param lfirst The iterator on the beginning on labels
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Iterator, typename LIterator>
+bool write_binary_dataset(const std::string& path, Iterator first, Iterator last, LIterator lfirst) {
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream) {
+        std::cerr << "ERROR: Impossible to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    binary_dataset_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "DLLB", 4);
+    header.version = binary_dataset_header::current_version;
+
+    // The header is written again once the number of samples is known
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<float> labels;
+    std::vector<float> buffer;
+
+    for (; first != last; ++first, ++lfirst) {
+        auto sample = *first;
+
+        if (header.n == 0) {
+            header.n_dims = etl::dimensions(sample);
+
+            if (header.n_dims > binary_dataset_header::max_dimensions) {
+                std::cerr << "ERROR: Binary datasets only support samples with at most " << binary_dataset_header::max_dimensions << " dimensions" << std::endl;
+                return false;
+            }
+
+            for (size_t d = 0; d < header.n_dims; ++d) {
+                header.dims[d] = etl::dim(sample, d);
+            }
+
+            buffer.resize(header.sample_size());
+        }
+
+        cpp_assert(etl::size(sample) == buffer.size(), "All the samples must have the same size");
+
+        std::copy(sample.begin(), sample.end(), buffer.begin());
+
+        stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(float));
+        labels.push_back(*lfirst);
+
+        ++header.n;
+    }
+
+    stream.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(float));
+
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Convert a dataset to the binary format used by the
+ * binary_data_generator.
+ *
+ * \param path The path of the file to write
+ * \param container The container of samples
+ * \param lcontainer The container of labels
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_binary_dataset(const std::string& path, const Container& container, const LContainer& lcontainer) {
+    return write_binary_dataset(path, container.begin(), container.end(), lcontainer.begin());
+}
+
+/*!
+ * \brief Write a dataset in the binary format batch by batch, without
+ * keeping it in memory.
+ *
+ * The file is written to a temporary file renamed once complete, so an
+ * interrupted writer never leaves a truncated dataset at the final path.
+ * The labels are not written by batch, they are all zero.
+ */
+struct binary_dataset_writer {
+    /*!
+     * \brief Start writing a dataset of n samples of the dimensions of the
+     * given sample
+     */
+    template <typename Sample>
+    binary_dataset_writer(const std::string& path, size_t n, const Sample& sample)
+            : path(path), tmp_path(path + ".tmp"), stream(tmp_path, std::ios::binary) {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "DLLB", 4);
+        header.version = binary_dataset_header::current_version;
+        header.n_dims  = etl::dimensions(sample);
+        header.n       = n;
+
+        cpp_assert(header.n_dims <= binary_dataset_header::max_dimensions, "Binary datasets only support samples with at most 4 dimensions");
+
+        for (size_t d = 0; d < header.n_dims; ++d) {
+            header.dims[d] = etl::dim(sample, d);
+        }
+
+        if (!stream) {
+            std::cerr << "ERROR: Impossible to open " << tmp_path << " for writing" << std::endl;
+        }
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    /*!
+     * \brief Append a batch of samples to the dataset
+     */
+    template <typename Batch>
+    void append(const Batch& batch) {
+        buffer.resize(etl::size(batch));
+
+        std::copy(batch.begin(), batch.end(), buffer.begin());
+
+        stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(float));
+
+        written += etl::dim<0>(batch);
+    }
+
+    /*!
+     * \brief Write the labels and move the dataset to its final path
+     * \return true if the dataset was written, false otherwise
+     */
+    bool finish() {
+        cpp_assert(written == header.n, "The number of samples written must be the announced number of samples");
+
+        std::vector<float> labels(header.n, 0.0f);
+        stream.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(float));
+        stream.close();
+
+        if (!stream || std::rename(tmp_path.c_str(), path.c_str())) {
+            std::cerr << "ERROR: Impossible to write binary dataset " << path << std::endl;
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    std::string path;             ///< The final path of the dataset
+    std::string tmp_path;         ///< The path of the file being written
+    std::ofstream stream;         ///< The stream to the temporary file
+    binary_dataset_header header; ///< The header of the dataset
+    size_t written = 0;           ///< The number of samples written
+    std::vector<float> buffer;    ///< The conversion buffer of a batch
+};
+
+/*!
+ * \brief A data generator reading batches from a memory-mapped binary
+ * dataset file.
+ *
+ * \tparam D The number of dimensions of each sample
+ * \tparam Desc The generator descriptor
+ */
+template <size_t D, typename Desc>
+struct binary_data_generator {
+    using desc   = Desc;  ///< The generator descriptor
+    using weight = float; ///< The data type
+
+    using data_cache_type  = etl::dyn_matrix<weight, D + 1>;                                                          ///< The type of the data batch cache
+    using label_cache_type = std::conditional_t<desc::Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of the label batch cache
+
+    static constexpr bool dll_generator = true;            ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = false;      ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr size_t batch_size  = desc::BatchSize; ///< The size of the batch
+
+    data_cache_type batch_cache;  ///< The data batch cache
+    label_cache_type label_cache; ///< The label batch cache
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    int fd               = -1;      ///< The file descriptor of the mapped file
+    void* mapped         = nullptr; ///< The mapped memory
+    size_t mapped_length = 0;       ///< The length of the mapped memory
+
+    const float* data   = nullptr; ///< Pointer to the first sample in the mapped memory
+    const float* labels = nullptr; ///< Pointer to the first label in the mapped memory
+
+    binary_dataset_header header; ///< The header of the file
+    size_t _size       = 0;       ///< The size of the dataset
+    size_t sample_size = 0;       ///< The number of floats of one sample
+    size_t n_classes   = 0;       ///< The number of classes
+
+    std::vector<size_t> order; ///< The order of the samples (empty when not shuffled)
+
+    /*!
+     * \brief Construct a binary_data_generator around the given file
+     * \param path The path to the binary dataset file
+     * \param n_classes The number of classes
+     */
+    binary_data_generator(const std::string& path, size_t n_classes) : n_classes(n_classes) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open binary dataset " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header) || ::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || !header.valid()) {
+            std::cerr << "ERROR: Invalid binary dataset " << path << std::endl;
+            return;
+        }
+
+        if (header.n_dims != D) {
+            std::cerr << "ERROR: The binary dataset " << path << " has " << header.n_dims << " dimensions, expected " << D << std::endl;
+            return;
+        }
+
+        sample_size = header.sample_size();
+
+        if (size_t(st.st_size) < sizeof(header) + header.n * (sample_size + 1) * sizeof(float)) {
+            std::cerr << "ERROR: Truncated binary dataset " << path << std::endl;
+            return;
+        }
+
+        mapped_length = st.st_size;
+        mapped        = ::mmap(nullptr, mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map binary dataset " << path << std::endl;
+            mapped = nullptr;
+            return;
+        }
+
+        ::madvise(mapped, mapped_length, MADV_SEQUENTIAL);
+
+        data   = reinterpret_cast<const float*>(static_cast<const char*>(mapped) + sizeof(header));
+        labels = data + header.n * sample_size;
+        _size  = header.n;
+
+        init_caches(std::make_index_sequence<D>());
+
+        reset();
+    }
+
+    binary_data_generator(const binary_data_generator& rhs) = delete;
+    binary_data_generator operator=(const binary_data_generator& rhs) = delete;
+
+    binary_data_generator(binary_data_generator&& rhs) = delete;
+    binary_data_generator operator=(binary_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~binary_data_generator() {
+        if (mapped) {
+            ::munmap(mapped, mapped_length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Binary Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "    Augmented Size: " << augmented_size() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe it is safe.
+     * The mapped file is kept since it is backed by the page cache.
+     */
+    void clear() {
+        if (is_safe) {
+            batch_cache.clear();
+            label_cache.clear();
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+
+        fetch();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+        fetch();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        if (order.empty()) {
+            order.resize(_size);
+            std::iota(order.begin(), order.end(), 0);
+
+            // Samples are not read sequentially anymore
+            if (mapped) {
+                ::madvise(mapped, mapped_length, MADV_RANDOM);
+            }
+        }
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        fetch();
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        return etl::slice(batch_cache, 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    template <bool AE = desc::AutoEncoder, cpp_disable_if(AE)>
+    auto label_batch() const {
+        return etl::slice(label_cache, 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch.
+     *
+     * In auto-encoder mode, the labels are the inputs themselves.
+     *
+     * \return a a batch of label.
+     */
+    template <bool AE = desc::AutoEncoder, cpp_enable_iff(AE)>
+    auto label_batch() const {
+        return data_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Initialize the batch caches from the dimensions of the file
+     */
+    template <size_t... I>
+    void init_caches(std::index_sequence<I...> /*seq*/) {
+        batch_cache = data_cache_type(batch_size, size_t(header.dims[I])...);
+
+        // CPP17 Replace with if constexpr
+        cpp::static_if<desc::Categorical>([&](auto f) {
+            f(label_cache) = label_cache_type(batch_size, n_classes);
+        }).else_([&](auto f) {
+            f(label_cache) = label_cache_type(batch_size);
+        });
+    }
+
+    /*!
+     * \brief Copy the current batch out of the mapped file
+     */
+    void fetch() {
+        if (current >= _size) {
+            return;
+        }
+
+        const size_t n = std::min(batch_size, _size - current);
+
+        if (order.empty()) {
+            // The batch is contiguous in the file
+            std::memcpy(batch_cache.memory_start(), data + current * sample_size, n * sample_size * sizeof(float));
+
+            for (size_t i = 0; i < n; ++i) {
+                set_label(i, labels[current + i]);
+            }
+
+            // Let the kernel start reading the next batch
+            if (current + n < _size) {
+                const size_t next_n = std::min(batch_size, _size - current - n);
+                advise_will_need(data + (current + n) * sample_size, next_n * sample_size * sizeof(float));
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                const size_t s = order[current + i];
+
+                std::memcpy(batch_cache.memory_start() + i * sample_size, data + s * sample_size, sample_size * sizeof(float));
+                set_label(i, labels[s]);
+            }
+        }
+
+        pre_transformer<desc>::transform_batch(batch_cache, n);
+    }
+
+    /*!
+     * \brief Set the label of the given sample of the batch
+     */
+    void set_label(size_t i, float label) {
+        // CPP17 Replace with if constexpr
+        cpp::static_if<desc::Categorical>([&](auto f) {
+            f(label_cache)(i)                = weight(0);
+            f(label_cache)(i, size_t(label)) = weight(1);
+        }).else_([&](auto f) {
+            f(label_cache)(i) = label;
+        });
+    }
+
+    /*!
+     * \brief Advise the kernel that the given range will be needed soon
+     */
+    void advise_will_need(const float* start, size_t length) {
+        static const size_t page = ::sysconf(_SC_PAGESIZE);
+
+        auto address = reinterpret_cast<uintptr_t>(start);
+        auto aligned = address & ~(uintptr_t(page) - 1);
+
+        ::madvise(reinterpret_cast<void*>(aligned), length + (address - aligned), MADV_WILLNEED);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, binary_data_generator<D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a binary_data_generator
+ */
+template <typename... Parameters>
+struct binary_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief The number of batch in cache
+     */
+    static constexpr size_t BigBatchSize = 1;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    /*!
+     * \brief The scaling
+     */
+    static constexpr size_t ScalePre = detail::get_value_v<scale_pre<0>, Parameters...>;
+
+    /*!
+     * \brief The binarization threshold
+     */
+    static constexpr size_t BinarizePre = detail::get_value_v<binarize_pre<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if input are normalized
+     */
+    static constexpr bool NormalizePre = parameters::template contains<normalize_pre>();
+
+    /*!
+     * \brief Indicates if this is an auto-encoder task
+     */
+    static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<
+            cpp::type_list<batch_size_id, categorical_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+            Parameters...>,
+        "Invalid parameters type for binary_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <size_t D>
+    using generator_t = binary_data_generator<D, binary_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a data generator around a binary dataset file
+ * \tparam D The number of dimensions of each sample
+ * \param path The path to the binary dataset file
+ * \param n_classes The number of classes
+ */
+template <size_t D, typename... Parameters>
+auto make_binary_generator(const std::string& path, size_t n_classes, const binary_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename binary_data_generator_desc<Parameters...>::template generator_t<D>;
+    return std::make_unique<generator_t>(path, n_classes);
+}
+
+} //end of dll namespace
@@ -0,0 +1,111 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Shuffling by blocks of out-of-memory data sets
+ */
+
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include <iterator>
+#include <type_traits>
+#include <algorithm>
+
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The shuffled order of the samples of an out-of-memory data set.
+ *
+ * The data set is read by chunks of samples, each chunk filling the cache
+ * of the generator. The order of the chunks is shuffled and then the order
+ * of the samples in the cache: the samples of a chunk are still read
+ * sequentially, only the start of each chunk is random. When the last
+ * chunk is partial, it stays the last one, so that only the last batch of
+ * the epoch can be partial.
+ */
+struct block_shuffler {
+    bool shuffled = false;      ///< Indicates if the order is shuffled
+    std::vector<size_t> chunks; ///< The shuffled order of the full chunks
+    std::vector<size_t> slots;  ///< The position in the cache of each sample of the chunk being read
+
+    /*!
+     * \brief Indicates if the data set can be shuffled: the chunks can
+     * only be reached directly with random access iterators
+     */
+    template <typename Iterator, typename LIterator>
+    static constexpr bool is_shufflable() {
+        return std::is_same<typename std::iterator_traits<Iterator>::iterator_category, std::random_access_iterator_tag>::value
+            && std::is_same<typename std::iterator_traits<LIterator>::iterator_category, std::random_access_iterator_tag>::value;
+    }
+
+    /*!
+     * \brief Go back to the order of the data set
+     */
+    void reset() {
+        shuffled = false;
+    }
+
+    /*!
+     * \brief Shuffle the order of the chunks of the data set
+     * \param size The number of samples of the data set
+     * \param chunk_size The number of samples of one chunk
+     */
+    void shuffle(size_t size, size_t chunk_size) {
+        shuffled = true;
+
+        chunks.resize(size / chunk_size);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::shuffle(chunks.begin(), chunks.end(), dll::random_engine());
+    }
+
+    /*!
+     * \brief Prepare the reading of the next chunk and position the
+     * iterators at its first sample
+     *
+     * \param read The number of samples already read in the epoch
+     * \param n The number of samples of the chunk
+     * \param chunk_size The number of samples of a full chunk
+     * \param it The iterator on the data
+     * \param lit The iterator on the labels
+     * \param orig_it The first iterator on the data
+     * \param orig_lit The first iterator on the labels
+     */
+    template <typename Iterator, typename LIterator>
+    void seek(size_t read, size_t n, size_t chunk_size, Iterator& it, LIterator& lit, const Iterator& orig_it, const LIterator& orig_lit) {
+        if (!shuffled) {
+            return;
+        }
+
+        const size_t c     = read / chunk_size;
+        const size_t first = c < chunks.size() ? chunks[c] * chunk_size : read;
+
+        it  = orig_it;
+        lit = orig_lit;
+
+        std::advance(it, first);
+        std::advance(lit, first);
+
+        slots.resize(n);
+        std::iota(slots.begin(), slots.end(), 0);
+        std::shuffle(slots.begin(), slots.end(), dll::random_engine());
+    }
+
+    /*!
+     * \brief Return the position in the cache of the k-th sample read from
+     * the chunk
+     */
+    size_t slot(size_t k) const {
+        return shuffled ? slots[k] : k;
+    }
+};
+
+} //end of dll namespace
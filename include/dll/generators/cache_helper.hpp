@@ -10,6 +10,8 @@
 #include <atomic>
 #include <thread>
 
+#include "dll/util/huge_pages.hpp"
+
 namespace dll {
 
 /*!
@@ -17,6 +19,7 @@ namespace dll {
  *
  * The cache is for putting all the inputs inside.
  * The big cache is for storing several batches.
+ * The large caches are backed by huge pages (see huge_pages.hpp).
  */
 template <typename Desc, typename Iterator, typename Enable = void>
 struct cache_helper;
@@ -28,8 +31,10 @@ template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
 
-    using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
-    using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
+    using cache_type      = etl::dyn_matrix<T, 2>;      ///< The type of the cache
+    using bf16_cache_type = etl::dyn_matrix<bf16_t, 2>; ///< The type of the cache, in bfloat16
+    using u8_cache_type   = etl::dyn_matrix<uint8_t, 2>; ///< The type of the cache, in uint8
+    using big_cache_type  = etl::dyn_matrix<T, 3>;      ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
@@ -40,19 +45,25 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::it
      * \param it An iterator to an element
      * \param cache The cache to initialize
      */
-    static void init(size_t n, const Iterator& it, cache_type& cache) {
+    template <typename C>
+    static void init(size_t n, const Iterator& it, C& cache) {
         auto one = *it;
-        cache    = cache_type(n, etl::dim<0>(one));
+        cache    = C(n, etl::dim<0>(one));
+
+        advise_huge_pages(cache);
     }
 
     /*!
      * \brief Init the big cache
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(Iterator& it, big_cache_type& cache) {
+    static void init_big(Iterator& it, big_cache_type& cache, size_t n = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one));
+        cache    = big_cache_type(n, batch_size, etl::dim<0>(one));
+
+        advise_huge_pages(cache);
     }
 };
 
@@ -63,8 +74,10 @@ template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
 
-    using cache_type     = etl::dyn_matrix<T, 4>; ///< The type of the cache
-    using big_cache_type = etl::dyn_matrix<T, 5>; ///< The type of the big cache
+    using cache_type      = etl::dyn_matrix<T, 4>;      ///< The type of the cache
+    using bf16_cache_type = etl::dyn_matrix<bf16_t, 4>; ///< The type of the cache, in bfloat16
+    using u8_cache_type   = etl::dyn_matrix<uint8_t, 4>; ///< The type of the cache, in uint8
+    using big_cache_type  = etl::dyn_matrix<T, 5>;      ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
@@ -75,24 +88,30 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::it
      * \param it An iterator to an element
      * \param cache The cache to initialize
      */
-    static void init(size_t n, const Iterator& it, cache_type& cache) {
+    template <typename C>
+    static void init(size_t n, const Iterator& it, C& cache) {
         auto one = *it;
-        cache    = cache_type(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+        cache    = C(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+
+        advise_huge_pages(cache);
     }
 
     /*!
      * \brief Init the big cache
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(Iterator& it, big_cache_type& cache) {
+    static void init_big(Iterator& it, big_cache_type& cache, size_t n = big_batch_size) {
         auto one = *it;
 
         if (Desc::random_crop_x && Desc::random_crop_y) {
-            cache = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), Desc::random_crop_y, Desc::random_crop_x);
+            cache = big_cache_type(n, batch_size, etl::dim<0>(one), Desc::random_crop_y, Desc::random_crop_x);
         } else {
-            cache = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+            cache = big_cache_type(n, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
         }
+
+        advise_huge_pages(cache);
     }
 };
 
@@ -0,0 +1,831 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator reading from a memory-mapped
+ * dataset file compressed by chunks.
+ *
+ * The samples are stored as in the binary format (single-precision floats,
+ * one float label per sample), but grouped in chunks of chunk_size samples
+ * compressed independently, followed by the index of the offsets of the
+ * chunks. Before compression, the bytes of the floats of a chunk are
+ * shuffled (all the first bytes, then all the second bytes, ...), which
+ * groups the signs and exponents and makes the floats much more
+ * compressible.
+ *
+ * The chunks are compressed with LZ4 when DLL_LZ4_SUPPORT is defined (and
+ * liblz4 linked), otherwise they are stored. The generator decompresses a
+ * window of chunks at once, one chunk per thread, and lets the kernel read
+ * the compressed bytes of the next window in the meantime. When the reads
+ * are the bottleneck, the denser file gives more samples per second.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef DLL_LZ4_SUPPORT
+#include <lz4.h>
+#endif
+
+#include "dll/util/random.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/generators/binary_data_generator.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The compression of the chunks of a compressed dataset
+ */
+enum class chunk_codec : uint32_t {
+    STORED = 0, ///< The chunks are not compressed
+    LZ4    = 1  ///< The chunks are compressed with LZ4
+};
+
+#ifdef DLL_LZ4_SUPPORT
+constexpr chunk_codec default_chunk_codec = chunk_codec::LZ4; ///< The codec used to write the datasets
+#else
+constexpr chunk_codec default_chunk_codec = chunk_codec::STORED; ///< The codec used to write the datasets
+#endif
+
+/*!
+ * \brief The header of a compressed dataset file
+ */
+struct compressed_dataset_header {
+    static constexpr uint32_t current_version = 1; ///< The version of the format
+    static constexpr size_t max_dimensions    = 4; ///< The maximum number of dimensions of a sample
+
+    char magic[4];                 ///< The magic identifier ("DLLZ")
+    uint32_t version;              ///< The version of the format
+    uint32_t n_dims;               ///< The number of dimensions of one sample
+    uint32_t codec;                ///< The codec of the chunks
+    uint64_t n;                    ///< The number of samples
+    uint64_t dims[max_dimensions]; ///< The dimensions of one sample
+    uint64_t chunk_size;           ///< The number of samples of a chunk
+    uint64_t index_offset;         ///< The offset of the index of the chunks
+    uint64_t padding[7];           ///< Pad the header to 128 bytes
+
+    /*!
+     * \brief Return the number of floats of one sample
+     */
+    size_t sample_size() const {
+        size_t s = 1;
+
+        for (size_t d = 0; d < n_dims; ++d) {
+            s *= dims[d];
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Return the number of chunks
+     */
+    size_t chunks() const {
+        return (n + chunk_size - 1) / chunk_size;
+    }
+
+    /*!
+     * \brief Indicates if the header is a valid compressed dataset header
+     */
+    bool valid() const {
+        return std::memcmp(magic, "DLLZ", 4) == 0 && version == current_version && n_dims > 0 && n_dims <= max_dimensions && chunk_size > 0;
+    }
+};
+
+static_assert(sizeof(compressed_dataset_header) == 128, "The compressed dataset header must be 128 bytes");
+
+namespace compressed_detail {
+
+/*!
+ * \brief Indicates if the given codec can be decoded
+ */
+inline bool supported(chunk_codec codec) {
+#ifdef DLL_LZ4_SUPPORT
+    return codec == chunk_codec::STORED || codec == chunk_codec::LZ4;
+#else
+    return codec == chunk_codec::STORED;
+#endif
+}
+
+/*!
+ * \brief Shuffle the bytes of n floats: all the first bytes, then all the
+ * second bytes, ...
+ */
+inline void shuffle_bytes(char* dst, const char* src, size_t n) {
+    for (size_t e = 0; e < n; ++e) {
+        for (size_t b = 0; b < sizeof(float); ++b) {
+            dst[b * n + e] = src[e * sizeof(float) + b];
+        }
+    }
+}
+
+/*!
+ * \brief Gather the bytes of the floats [first, last) of n shuffled floats
+ */
+inline void unshuffle_bytes(char* dst, const char* src, size_t n, size_t first, size_t last) {
+    for (size_t e = first; e < last; ++e) {
+        for (size_t b = 0; b < sizeof(float); ++b) {
+            dst[(e - first) * sizeof(float) + b] = src[b * n + e];
+        }
+    }
+}
+
+/*!
+ * \brief Compress n floats with the given codec
+ * \return the compressed bytes, empty on failure
+ */
+inline std::vector<char> compress(chunk_codec codec, const float* src, size_t n) {
+    const size_t bytes = n * sizeof(float);
+
+    std::vector<char> out;
+
+    if (codec == chunk_codec::STORED) {
+        out.resize(bytes);
+        std::memcpy(out.data(), src, bytes);
+        return out;
+    }
+
+#ifdef DLL_LZ4_SUPPORT
+    std::vector<char> shuffled(bytes);
+    shuffle_bytes(shuffled.data(), reinterpret_cast<const char*>(src), n);
+
+    out.resize(LZ4_compressBound(int(bytes)));
+
+    const int written = LZ4_compress_default(shuffled.data(), out.data(), int(bytes), int(out.size()));
+
+    out.resize(written > 0 ? written : 0);
+#endif
+
+    return out;
+}
+
+/*!
+ * \brief Decompress a chunk of n floats, the first s ones being written to
+ * data and the others to labels
+ *
+ * \param scratch A buffer for the decompressed bytes
+ * \return true if the chunk was decompressed, false otherwise
+ */
+inline bool decompress(chunk_codec codec, const char* src, size_t bytes, size_t n, size_t s, float* data, float* labels, std::vector<char>& scratch) {
+    const size_t raw = n * sizeof(float);
+
+    if (codec == chunk_codec::STORED) {
+        if (bytes != raw) {
+            return false;
+        }
+
+        std::memcpy(data, src, s * sizeof(float));
+        std::memcpy(labels, src + s * sizeof(float), (n - s) * sizeof(float));
+
+        return true;
+    }
+
+#ifdef DLL_LZ4_SUPPORT
+    scratch.resize(raw);
+
+    if (LZ4_decompress_safe(src, scratch.data(), int(bytes), int(raw)) != int(raw)) {
+        return false;
+    }
+
+    unshuffle_bytes(reinterpret_cast<char*>(data), scratch.data(), n, 0, s);
+    unshuffle_bytes(reinterpret_cast<char*>(labels), scratch.data(), n, s, n);
+
+    return true;
+#else
+    cpp_unused(src);
+    cpp_unused(bytes);
+    cpp_unused(s);
+    cpp_unused(data);
+    cpp_unused(labels);
+    cpp_unused(scratch);
+
+    return false;
+#endif
+}
+
+} //end of namespace compressed_detail
+
+/*!
+ * \brief Convert a dataset to the compressed format used by the
+ * compressed_data_generator.
+ *
+ * \param path The path of the file to write
+ * \param first The iterator on the beginning on data
+ * \param last The iterator on the end  on data
+ * \param lfirst The iterator on the beginning on labels
+ * \param chunk_size The number of samples of each chunk
+ * \param codec The compression of the chunks
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Iterator, typename LIterator>
+bool write_compressed_dataset(const std::string& path, Iterator first, Iterator last, LIterator lfirst, size_t chunk_size = 1024, chunk_codec codec = default_chunk_codec) {
+    if (!compressed_detail::supported(codec)) {
+        std::cerr << "ERROR: The codec of the compressed dataset is not supported" << std::endl;
+        return false;
+    }
+
+    std::ofstream stream(path, std::ios::binary);
+
+    if (!stream) {
+        std::cerr << "ERROR: Impossible to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    compressed_dataset_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "DLLZ", 4);
+    header.version    = compressed_dataset_header::current_version;
+    header.codec      = uint32_t(codec);
+    header.chunk_size = chunk_size;
+
+    // The header is written again once the number of samples is known
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<uint64_t> index{sizeof(header)};
+    std::vector<float> samples;
+    std::vector<float> labels;
+    size_t sample_size = 0;
+
+    // Compress the chunk: the samples then their labels
+    auto flush = [&]() {
+        samples.insert(samples.end(), labels.begin(), labels.end());
+
+        auto compressed = compressed_detail::compress(codec, samples.data(), samples.size());
+
+        if (compressed.empty()) {
+            return false;
+        }
+
+        stream.write(compressed.data(), compressed.size());
+        index.push_back(index.back() + compressed.size());
+
+        samples.clear();
+        labels.clear();
+
+        return true;
+    };
+
+    for (; first != last; ++first, ++lfirst) {
+        auto sample = *first;
+
+        if (header.n == 0) {
+            header.n_dims = etl::dimensions(sample);
+
+            if (header.n_dims > compressed_dataset_header::max_dimensions) {
+                std::cerr << "ERROR: Compressed datasets only support samples with at most " << compressed_dataset_header::max_dimensions << " dimensions" << std::endl;
+                return false;
+            }
+
+            for (size_t d = 0; d < header.n_dims; ++d) {
+                header.dims[d] = etl::dim(sample, d);
+            }
+
+            sample_size = header.sample_size();
+        }
+
+        cpp_assert(etl::size(sample) == sample_size, "All the samples must have the same size");
+
+        samples.insert(samples.end(), sample.begin(), sample.end());
+        labels.push_back(*lfirst);
+
+        ++header.n;
+
+        if (labels.size() == chunk_size && !flush()) {
+            return false;
+        }
+    }
+
+    if (!labels.empty() && !flush()) {
+        return false;
+    }
+
+    header.index_offset = index.back();
+
+    stream.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t));
+
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Convert a dataset to the compressed format used by the
+ * compressed_data_generator.
+ *
+ * \param path The path of the file to write
+ * \param container The container of samples
+ * \param lcontainer The container of labels
+ * \param chunk_size The number of samples of each chunk
+ * \param codec The compression of the chunks
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_compressed_dataset(const std::string& path, const Container& container, const LContainer& lcontainer, size_t chunk_size = 1024, chunk_codec codec = default_chunk_codec) {
+    return write_compressed_dataset(path, container.begin(), container.end(), lcontainer.begin(), chunk_size, codec);
+}
+
+/*!
+ * \brief A data generator reading batches from a memory-mapped compressed
+ * dataset file.
+ *
+ * The chunks are decompressed by windows of at least concurrency() chunks,
+ * in parallel. When shuffled, the order of the chunks is shuffled (the
+ * last partial chunk staying the last one) and the samples are taken in a
+ * random order inside each window.
+ *
+ * \tparam D The number of dimensions of each sample
+ * \tparam Desc The generator descriptor (binary_data_generator_desc)
+ */
+template <size_t D, typename Desc>
+struct compressed_data_generator {
+    using desc   = Desc;  ///< The generator descriptor
+    using weight = float; ///< The data type
+
+    using data_cache_type  = etl::dyn_matrix<weight, D + 1>;                                                          ///< The type of the data batch cache
+    using label_cache_type = std::conditional_t<desc::Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of the label batch cache
+
+    static constexpr bool dll_generator = true;            ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = false;      ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr size_t batch_size  = desc::BatchSize; ///< The size of the batch
+
+    data_cache_type batch_cache;  ///< The data batch cache
+    label_cache_type label_cache; ///< The label batch cache
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    int fd               = -1;      ///< The file descriptor of the mapped file
+    void* mapped         = nullptr; ///< The mapped memory
+    size_t mapped_length = 0;       ///< The length of the mapped memory
+
+    const char* base      = nullptr; ///< The start of the mapped memory
+    const uint64_t* index = nullptr; ///< The offsets of the chunks in the mapped memory
+
+    compressed_dataset_header header; ///< The header of the file
+    size_t _size       = 0;           ///< The size of the dataset
+    size_t sample_size = 0;           ///< The number of floats of one sample
+    size_t n_classes   = 0;           ///< The number of classes
+    size_t n_chunks    = 0;           ///< The number of chunks
+
+    size_t window_chunks = 0;               ///< The number of chunks decompressed at once
+    std::vector<float> window;              ///< The samples of the decompressed chunks
+    std::vector<float> window_labels;       ///< The labels of the decompressed chunks
+    std::vector<std::vector<char>> scratch; ///< The decompression buffer of each chunk of the window
+    size_t window_first = 0;                ///< The position in the epoch of the first sample of the window
+    size_t window_n     = 0;                ///< The number of samples in the window
+
+    bool shuffled = false;     ///< Indicates if the epoch is shuffled
+    std::vector<size_t> order; ///< The order of the chunks in the epoch
+    std::vector<size_t> slots; ///< The order of the samples in the window, when shuffled
+
+    /*!
+     * \brief Construct a compressed_data_generator around the given file
+     * \param path The path to the compressed dataset file
+     * \param n_classes The number of classes
+     */
+    compressed_data_generator(const std::string& path, size_t n_classes) : n_classes(n_classes) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open compressed dataset " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header) || ::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || !header.valid()) {
+            std::cerr << "ERROR: Invalid compressed dataset " << path << std::endl;
+            return;
+        }
+
+        if (header.n_dims != D) {
+            std::cerr << "ERROR: The compressed dataset " << path << " has " << header.n_dims << " dimensions, expected " << D << std::endl;
+            return;
+        }
+
+        if (!compressed_detail::supported(chunk_codec(header.codec))) {
+            std::cerr << "ERROR: The codec of the compressed dataset " << path << " is not supported (DLL_LZ4_SUPPORT)" << std::endl;
+            return;
+        }
+
+        n_chunks = header.chunks();
+
+        if (size_t(st.st_size) < header.index_offset + (n_chunks + 1) * sizeof(uint64_t)) {
+            std::cerr << "ERROR: Truncated compressed dataset " << path << std::endl;
+            return;
+        }
+
+        mapped_length = st.st_size;
+        mapped        = ::mmap(nullptr, mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED) {
+            std::cerr << "ERROR: Impossible to map compressed dataset " << path << std::endl;
+            mapped = nullptr;
+            return;
+        }
+
+        base  = static_cast<const char*>(mapped);
+        index = reinterpret_cast<const uint64_t*>(base + header.index_offset);
+
+        sample_size = header.sample_size();
+        _size       = header.n;
+
+        // Enough chunks for all the threads and at least one batch
+        window_chunks = std::min(n_chunks, std::max(concurrency(), (batch_size + header.chunk_size - 1) / header.chunk_size));
+
+        window.resize(window_chunks * header.chunk_size * sample_size);
+        window_labels.resize(window_chunks * header.chunk_size);
+        scratch.resize(window_chunks);
+
+        order.resize(n_chunks);
+        std::iota(order.begin(), order.end(), 0);
+
+        init_caches(std::make_index_sequence<D>());
+
+        reset();
+    }
+
+    compressed_data_generator(const compressed_data_generator& rhs) = delete;
+    compressed_data_generator operator=(const compressed_data_generator& rhs) = delete;
+
+    compressed_data_generator(compressed_data_generator&& rhs) = delete;
+    compressed_data_generator operator=(compressed_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~compressed_data_generator() {
+        if (mapped) {
+            ::munmap(mapped, mapped_length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Compressed Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "    Augmented Size: " << augmented_size() << std::endl;
+        stream << "            Chunks: " << n_chunks << " x " << header.chunk_size << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe it is safe.
+     * The mapped file is kept since it is backed by the page cache.
+     */
+    void clear() {
+        if (is_safe) {
+            batch_cache.clear();
+            label_cache.clear();
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current  = 0;
+        shuffled = false;
+
+        std::iota(order.begin(), order.end(), 0);
+
+        restart();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+        restart();
+    }
+
+    /*!
+     * \brief Shuffle the order of the chunks and of the samples inside
+     * the windows.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        shuffled = true;
+
+        // The last chunk may be partial, it stays the last one
+        const size_t full = _size % header.chunk_size ? n_chunks - 1 : n_chunks;
+
+        std::shuffle(order.begin(), order.begin() + full, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        fetch();
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        return etl::slice(batch_cache, 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    template <bool AE = desc::AutoEncoder, cpp_disable_if(AE)>
+    auto label_batch() const {
+        return etl::slice(label_cache, 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch.
+     *
+     * In auto-encoder mode, the labels are the inputs themselves.
+     *
+     * \return a a batch of label.
+     */
+    template <bool AE = desc::AutoEncoder, cpp_enable_iff(AE)>
+    auto label_batch() const {
+        return data_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Initialize the batch caches from the dimensions of the file
+     */
+    template <size_t... I>
+    void init_caches(std::index_sequence<I...> /*seq*/) {
+        batch_cache = data_cache_type(batch_size, size_t(header.dims[I])...);
+
+        // CPP17 Replace with if constexpr
+        cpp::static_if<desc::Categorical>([&](auto f) {
+            f(label_cache) = label_cache_type(batch_size, n_classes);
+        }).else_([&](auto f) {
+            f(label_cache) = label_cache_type(batch_size);
+        });
+    }
+
+    /*!
+     * \brief Start a new epoch, from the first window
+     */
+    void restart() {
+        window_first = 0;
+        window_n     = 0;
+
+        if (mapped) {
+            fetch();
+        }
+    }
+
+    /*!
+     * \brief Decompress the window starting at the given position of the
+     * epoch, which is the first sample of a chunk
+     */
+    void decode_window(size_t position) {
+        dll::auto_timer timer("compressed_generator:decode");
+
+        const size_t chunk_size = header.chunk_size;
+        const size_t first      = position / chunk_size;
+        const size_t chunks     = std::min(window_chunks, n_chunks - first);
+        const auto codec        = chunk_codec(header.codec);
+
+        std::vector<size_t> counts(chunks);
+
+        parallel_for_n(chunks, [&](size_t j) {
+            const size_t c = order[first + j];
+            const size_t n = std::min(chunk_size, _size - c * chunk_size);
+
+            counts[j] = n;
+
+            const bool ok = compressed_detail::decompress(codec, base + index[c], index[c + 1] - index[c], n * (sample_size + 1), n * sample_size,
+                                                          window.data() + j * chunk_size * sample_size, window_labels.data() + j * chunk_size, scratch[j]);
+
+            cpp_assert(ok, "Corrupted chunk in the compressed dataset");
+            cpp_unused(ok);
+
+            // The samples are transformed while they are in cache
+            for (size_t s = 0; s < n; ++s) {
+                pre_transformer<desc>::transform(window.data() + (j * chunk_size + s) * sample_size, sample_size);
+            }
+        });
+
+        // Only the last chunk may be partial, the window is contiguous
+        window_first = position;
+        window_n     = std::accumulate(counts.begin(), counts.end(), size_t(0));
+
+        if (shuffled) {
+            slots.resize(window_n);
+            std::iota(slots.begin(), slots.end(), 0);
+            std::shuffle(slots.begin(), slots.end(), dll::rand_engine());
+        }
+
+        // Let the kernel start reading the next window
+        for (size_t c = first + chunks; c < std::min(n_chunks, first + 2 * chunks); ++c) {
+            advise_will_need(base + index[order[c]], index[order[c] + 1] - index[order[c]]);
+        }
+    }
+
+    /*!
+     * \brief Copy the current batch out of the windows
+     */
+    void fetch() {
+        if (current >= _size) {
+            return;
+        }
+
+        const size_t n = std::min(batch_size, _size - current);
+
+        for (size_t i = 0; i < n;) {
+            const size_t position = current + i;
+
+            if (position >= window_first + window_n) {
+                decode_window(window_first + window_n);
+            }
+
+            const size_t offset = position - window_first;
+            const size_t run    = std::min(n - i, window_n - offset);
+
+            for (size_t k = 0; k < run; ++k) {
+                const size_t s = shuffled ? slots[offset + k] : offset + k;
+
+                std::memcpy(batch_cache.memory_start() + (i + k) * sample_size, window.data() + s * sample_size, sample_size * sizeof(float));
+                set_label(i + k, window_labels[s]);
+            }
+
+            i += run;
+        }
+    }
+
+    /*!
+     * \brief Set the label of the given sample of the batch
+     */
+    void set_label(size_t i, float label) {
+        // CPP17 Replace with if constexpr
+        cpp::static_if<desc::Categorical>([&](auto f) {
+            f(label_cache)(i)                = weight(0);
+            f(label_cache)(i, size_t(label)) = weight(1);
+        }).else_([&](auto f) {
+            f(label_cache)(i) = label;
+        });
+    }
+
+    /*!
+     * \brief Advise the kernel that the given range will be needed soon
+     */
+    void advise_will_need(const char* start, size_t length) {
+        static const size_t page = ::sysconf(_SC_PAGESIZE);
+
+        auto address = reinterpret_cast<uintptr_t>(start);
+        auto aligned = address & ~(uintptr_t(page) - 1);
+
+        ::madvise(reinterpret_cast<void*>(aligned), length + (address - aligned), MADV_WILLNEED);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, compressed_data_generator<D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Make a data generator around a compressed dataset file
+ * \tparam D The number of dimensions of each sample
+ * \param path The path to the compressed dataset file
+ * \param n_classes The number of classes
+ */
+template <size_t D, typename... Parameters>
+auto make_compressed_generator(const std::string& path, size_t n_classes, const binary_data_generator_desc<Parameters...>& /*desc*/) {
+    return std::make_unique<compressed_data_generator<D, binary_data_generator_desc<Parameters...>>>(path, n_classes);
+}
+
+} //end of dll namespace
@@ -14,6 +14,14 @@
 
 #include <atomic>
 #include <thread>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "dll/util/affinity.hpp"
+#include "dll/util/memory_usage.hpp"
 
 namespace dll {
 
@@ -27,7 +35,7 @@ struct inmemory_data_generator;
  * \copydoc inmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>> {
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_compact_cache<Desc> && !is_index_shuffle<Desc>>> {
     using desc                 = Desc;                                                              ///< The generator descriptor
     using weight               = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
@@ -37,12 +45,20 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     using label_cache_type = typename label_cache_helper_t::cache_type; ///< The type of the label cache
 
     static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = false; ///< Indicates if the batches are prepared in the background by the generator
 
     static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
 
     data_cache_type input_cache;  ///< The input cache
     label_cache_type label_cache; ///< The label cache
 
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The categorical labels of the current batch (compact labels only)
+
+    mutable batch_noiser<Desc, data_cache_type> noiser; ///< The noise of the batches
+
+    mutable batch_standardizer<is_standardized<Desc>, data_cache_type> standardizer;                           ///< The standardization of the batches
+    mutable batch_standardizer<is_standardized<Desc> && Desc::AutoEncoder, label_cache_type> label_standardizer; ///< The standardization of the labels of an auto-encoder
+
     size_t current = 0;     ///< The current index
     bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
@@ -51,6 +67,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         // Initialize both caches for enough elements
         data_cache_helper_t::init(n, &input, input_cache);
         label_cache_helper_t::init(n, n_classes, &label, label_cache);
+        init_label_batch<desc>(n_classes, label_batch_cache);
+
+        noiser.init(input_cache, batch_size);
+        standardizer.init(input_cache, batch_size);
+        label_standardizer.init(label_cache, batch_size);
     }
 
     /*!
@@ -61,22 +82,23 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
 
         data_cache_helper_t::init(n, first, input_cache);
         label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        init_label_batch<desc>(n_classes, label_batch_cache);
+
+        noiser.init(input_cache, batch_size);
+        standardizer.init(input_cache, batch_size);
+        label_standardizer.init(label_cache, batch_size);
 
         size_t i = 0;
         while (first != last) {
             input_cache(i) = *first;
 
-            pre_scaler<desc>::transform(input_cache(i));
-            pre_normalizer<desc>::transform(input_cache(i));
-            pre_binarizer<desc>::transform(input_cache(i));
+            pre_transformer<desc>::transform(input_cache(i));
 
             label_cache_helper_t::set(i, lfirst, label_cache);
 
             // In case of auto-encoders, the label images also need to be transformed
             cpp::static_if<desc::AutoEncoder>([&](auto f) {
-                pre_scaler<desc>::transform(f(label_cache)(i));
-                pre_normalizer<desc>::transform(f(label_cache)(i));
-                pre_binarizer<desc>::transform(f(label_cache)(i));
+                pre_transformer<desc>::transform(f(label_cache)(i));
             });
 
             ++i;
@@ -84,6 +106,8 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
             ++lfirst;
         }
 
+        compute_standardization();
+
         cpp_unused(llast);
     }
 
@@ -114,6 +138,13 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         display(std::cout);
     }
 
+    /*!
+     * \brief Returns the memory of the caches of the generator, in bytes
+     */
+    size_t memory() const {
+        return container_bytes(input_cache) + container_bytes(label_cache) + container_bytes(label_batch_cache);
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -153,13 +184,16 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     void reset() {
         current = 0;
+        noiser.invalidate();
+        standardizer.invalidate();
+        label_standardizer.invalidate();
     }
 
     /*!
      * \brief Reset the generator and shuffle the order of samples
      */
     void reset_shuffle() {
-        current = 0;
+        reset();
         shuffle();
     }
 
@@ -240,7 +274,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        return noiser.apply(standardizer.apply(etl::slice(input_cache, current, std::min(current + batch_size, size())), current), current);
     }
 
     /*!
@@ -248,7 +282,26 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        return label_standardizer.apply(expand_label_batch<desc>(etl::slice(label_cache, current, std::min(current + batch_size, size())), label_batch_cache), current);
+    }
+
+    /*!
+     * \brief Returns the statistics of the standardization of the inputs,
+     * to be stored with the model
+     */
+    const dll::standardization<weight>& input_standardization() const {
+        return standardizer.stats;
+    }
+
+    /*!
+     * \brief Standardize the inputs with the given statistics, computed on
+     * another dataset (the training set for a test generator)
+     */
+    void set_input_standardization(const dll::standardization<weight>& stats) {
+        cpp_assert(stats.sample_size() == etl::size(input_cache) / std::max<size_t>(1, size()), "Invalid size of the statistics");
+
+        standardizer.set(stats);
+        label_standardizer.set(stats);
     }
 
     /*!
@@ -259,6 +312,8 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     template <typename Input>
     void set_data_batch(size_t i, Input&& input_batch) {
         etl::slice(input_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        noiser.invalidate();
+        standardizer.invalidate();
     }
 
     /*!
@@ -276,17 +331,15 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     void finalize_prepared_data() {
         for (size_t i = 0; i < size(); ++i) {
-            pre_scaler<desc>::transform(input_cache(i));
-            pre_normalizer<desc>::transform(input_cache(i));
-            pre_binarizer<desc>::transform(input_cache(i));
+            pre_transformer<desc>::transform(input_cache(i));
 
             // In case of auto-encoders, the label images also need to be transformed
             cpp::static_if<desc::AutoEncoder>([&](auto f) {
-                pre_scaler<desc>::transform(f(label_cache)(i));
-                pre_normalizer<desc>::transform(f(label_cache)(i));
-                pre_binarizer<desc>::transform(f(label_cache)(i));
+                pre_transformer<desc>::transform(f(label_cache)(i));
             });
         }
+
+        compute_standardization();
     }
 
     /*!
@@ -296,13 +349,25 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Compute the statistics of the standardization from the cache
+     */
+    void compute_standardization() {
+        standardizer.compute(input_cache, size(), desc::ChannelStandardizePre);
+
+        cpp::static_if<is_standardized<desc> && desc::AutoEncoder>([&](auto f) {
+            f(label_standardizer).set(standardizer.stats);
+        });
+    }
 };
 
 /*!
  * \copydoc inmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>> {
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_compact_cache<Desc> || is_index_shuffle<Desc>>> {
     using desc                 = Desc;                                        ///< The generator descriptor
     using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<desc, Iterator>;                ///< The helper for the data cache
@@ -311,64 +376,105 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     using data_cache_type  = typename data_cache_helper_t::cache_type;     ///< The type of the data cache
     using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
     using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
+    using sample_type      = typename std::iterator_traits<Iterator>::value_type; ///< The type of one sample
 
-    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    /*!
+     * \brief The type of the input cache, as stored
+     */
+    using input_cache_type = std::conditional_t<
+        desc::Bf16Cache,
+        typename data_cache_helper_t::bf16_cache_type,
+        std::conditional_t<desc::U8Cache, typename data_cache_helper_t::u8_cache_type, data_cache_type>>;
 
-    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
-    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
+    static constexpr bool dll_generator    = true;                  ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = true;                ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr bool importance_sampling = desc::ImportanceSampling > 0; ///< Indicates if the epochs are drawn by the losses of the samples
 
-    data_cache_type input_cache;  ///< The data cache
-    big_cache_type batch_cache;   ///< The data batch cache
-    label_cache_type label_cache; ///< The label cache
+    static constexpr size_t batch_size     = desc::BatchSize;       ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize;    ///< The number of batches kept in cache
+    static constexpr size_t workers        = desc::ThreadedWorkers; ///< The number of augmentation workers
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    input_cache_type input_cache;   ///< The data cache
+    big_cache_type batch_cache;     ///< The data batch cache
+    label_cache_type label_cache;   ///< The label cache
+    label_cache_type label_batches; ///< The gathered labels of the batches of the batch cache (index shuffle only)
 
+    pinned_memory data_pin;  ///< The page-locking of the batch cache (pinned cache only)
+    pinned_memory label_pin; ///< The page-locking of the gathered labels (pinned cache only)
 
-    size_t current = 0;     ///< The current index
-    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The categorical labels of the current batch (compact labels only)
+
+    std::vector<size_t> order; ///< The order of the samples (index shuffle only)
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    std::vector<float> losses; ///< The last reported loss of each sample (importance sampling only)
+    bool has_losses = false;   ///< Indicates if losses have been reported (importance sampling only)
+    size_t sampled  = 0;       ///< The number of samples of the drawn epoch (importance sampling only, 0 = all the samples)
+    size_t draws    = 0;       ///< The number of epochs drawn (importance sampling only)
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    std::vector<augmentation_worker<Desc>> augmenters; ///< The augmenters of each worker
+    std::vector<sample_type> samples;                  ///< The decoded sample of each worker (compact caches only)
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    const size_t batch_bytes;                ///< The memory of one batch of the cache
+    mutable batch_ring<desc::SpinWait> ring; ///< The ring of batches shared with the workers
+
+    std::vector<std::thread> threads;    ///< The augmentation threads
+    std::atomic<bool> train_mode{false}; ///< The train mode status
 
     /*!
      * \brief Construct an inmemory data generator
      */
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes)
-            : cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : batch_bytes(cache_batch_bytes(first, lfirst, n_classes)),
+              ring(ring_capacity(desc::CacheBudget, batch_bytes, big_batch_size, (size_t(std::distance(first, last)) + batch_size - 1) / batch_size)) {
         const size_t n = std::distance(first, last);
 
         data_cache_helper_t::init(n, first, input_cache);
-        data_cache_helper_t::init_big(first, batch_cache);
+        data_cache_helper_t::init_big(first, batch_cache, ring.N);
 
         label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        init_label_batch<desc>(n_classes, label_batch_cache);
+
+        if (desc::IndexShuffle) {
+            label_cache_helper_t::init(ring.N * batch_size, n_classes, lfirst, label_batches);
+
+            order.resize(n);
+            std::iota(order.begin(), order.end(), 0);
+        }
+
+        if (importance_sampling) {
+            losses.resize(n, 1.0f);
+        }
+
+        if (desc::PinnedCache) {
+            data_pin.pin(batch_cache);
+
+            if (desc::IndexShuffle) {
+                label_pin.pin(label_batches);
+            }
+        }
+
+        // Each worker gets its own augmenters and random engine
+        augmenters.reserve(workers);
+        for (size_t w = 0; w < workers; ++w) {
+            augmenters.emplace_back(*first, dll::rand_engine()());
+        }
+
+        if (desc::Bf16Cache || desc::U8Cache) {
+            samples.resize(workers, *first);
+        }
 
         size_t i = 0;
         while (first != last) {
-            input_cache(i) = *first;
-
-            pre_scaler<desc>::transform(input_cache(i));
-            pre_normalizer<desc>::transform(input_cache(i));
-            pre_binarizer<desc>::transform(input_cache(i));
+            store_sample(i, *first);
 
             label_cache_helper_t::set(i, lfirst, label_cache);
 
             // In case of auto-encoders, the label images also need to be transformed
             cpp::static_if<desc::AutoEncoder>([&](auto f) {
-                pre_scaler<desc>::transform(f(label_cache)(i));
-                pre_normalizer<desc>::transform(f(label_cache)(i));
-                pre_binarizer<desc>::transform(f(label_cache)(i));
+                pre_transformer<desc>::transform(f(label_cache)(i));
             });
 
             ++i;
@@ -376,94 +482,154 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             ++lfirst;
         }
 
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+        cpp_unused(llast);
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { worker_main(augmenters[w], w); });
         }
+    }
 
-        cpp_unused(llast);
+    /*!
+     * \brief Returns the memory of one batch of the cache (data and gathered labels)
+     */
+    static size_t cache_batch_bytes(Iterator first, LIterator lfirst, size_t n_classes) {
+        big_cache_type data_one;
+        label_cache_type label_one;
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
-
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
+        data_cache_helper_t::init_big(first, data_one, 1);
+
+        if (desc::IndexShuffle) {
+            label_cache_helper_t::init(batch_size, n_classes, lfirst, label_one);
+        }
 
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
+        return etl::size(data_one) * sizeof(etl::value_t<big_cache_type>) + etl::size(label_one) * sizeof(etl::value_t<label_cache_type>);
+    }
 
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
+    /*!
+     * \brief The main function of each augmentation worker
+     * \param augmenter The augmenters of the worker
+     * \param w The index of the worker
+     */
+    void worker_main(augmentation_worker<Desc>& augmenter, size_t w) {
+        pin_helper(w);
 
-                for (size_t i = 0; i < batch_size && input_n < size(); ++i) {
-                    if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
+        while (true) {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
 
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
+            // Wait for the end or for some work
+            if (!ring.acquire(index, batches(), false)) {
+                return;
+            }
 
-                        // Distort the image
-                        distorter.transform(batch_cache(index)(i));
+            // Get the batch that needs to be read
+            const size_t batch = ring.batch(index);
 
-                        // Noise the image
-                        noiser.transform(batch_cache(index)(i));
-                    } else {
-                        // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
-                    }
-                }
+            // Get the index from where to read inside the input cache
+            const size_t input_n = batch * batch_size;
+
+            // The number of samples of the batch
+            const size_t n = std::min(batch_size, size() - input_n);
 
-                // Notify a waiter that one batch is ready
+            auto start = ring.now();
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+            for (size_t i = 0; i < n; ++i) {
+                const size_t s = sample_index(input_n + i);
 
-                    status[index] = true;
+                augmenter.transform_first(batch_cache(index)(i), load_sample(w, s), train_mode);
 
-                    ready_condition.notify_one();
+                if (desc::IndexShuffle) {
+                    label_batches(index * batch_size + i) = label_cache(s);
                 }
             }
-        });
+
+            ring.account(ring.transform_ns, start);
+
+            if (train_mode) {
+                augmenter.transform_batch(batch_cache(index), n);
+
+                ring.account(ring.augment_ns, start);
+            }
+
+            // Notify a waiter that one batch is ready
+            ring.publish(index);
+        }
+    }
+
+    /*!
+     * \brief Store the given sample in the input cache, in bfloat16.
+     *
+     * The pre-transformations are done in full precision.
+     */
+    template <typename D = desc, cpp_enable_iff(D::Bf16Cache)>
+    void store_sample(size_t i, const sample_type& input) {
+        sample_type sample = input;
+
+        pre_transformer<desc>::transform(sample);
+
+        bf16_encode(input_cache(i), sample);
+    }
+
+    /*!
+     * \brief Store the given sample in the input cache, in uint8.
+     *
+     * The raw values are stored, the pre-transformations are done when
+     * the batches are generated.
+     */
+    template <typename D = desc, cpp_enable_iff(D::U8Cache)>
+    void store_sample(size_t i, const sample_type& input) {
+        u8_encode(input_cache(i), input);
+    }
+
+    /*!
+     * \brief Store the given sample in the input cache
+     */
+    template <typename D = desc, cpp_enable_iff(!D::Bf16Cache && !D::U8Cache)>
+    void store_sample(size_t i, const sample_type& input) {
+        input_cache(i) = input;
+
+        pre_transformer<desc>::transform(input_cache(i));
+    }
+
+    /*!
+     * \brief Load the sample s of the input cache, in the buffer of the
+     * worker w
+     */
+    template <typename D = desc, cpp_enable_iff(D::Bf16Cache)>
+    const sample_type& load_sample(size_t w, size_t s) {
+        bf16_decode(samples[w], input_cache(s));
+        return samples[w];
+    }
+
+    /*!
+     * \brief Load the sample s of the input cache, in the buffer of the
+     * worker w, and apply the pre-transformations
+     */
+    template <typename D = desc, cpp_enable_iff(D::U8Cache)>
+    const sample_type& load_sample(size_t w, size_t s) {
+        auto& sample = samples[w];
+
+        u8_decode(sample, input_cache(s));
+
+        pre_transformer<desc>::transform(sample);
+
+        return sample;
+    }
+
+    /*!
+     * \brief Return the sample s of the input cache
+     */
+    template <typename D = desc, cpp_enable_iff(!D::Bf16Cache && !D::U8Cache)>
+    auto load_sample(size_t /*w*/, size_t s) {
+        return input_cache(s);
+    }
+
+    /*!
+     * \brief Return the index in the caches of the ith sample of the
+     * generation
+     */
+    size_t sample_index(size_t i) const {
+        return desc::IndexShuffle ? order[i] : i;
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -482,6 +648,16 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
         stream << "    Augmented Size: " << augmented_size() << std::endl;
+        stream << "     Cache Batches: " << ring.N << std::endl;
+        stream << "    Prefetch Depth: " << ring.depth.load() << std::endl;
+        stream << "      Cache Memory: " << ring.N * batch_bytes << " bytes" << (data_pin.pinned() ? " (pinned)" : "") << std::endl;
+
+        const auto stats = stalls();
+
+        stream << "     Consumer Wait: " << stats.consumer_wait_ms << "ms" << std::endl;
+        stream << "     Producer Wait: " << stats.producer_wait_ms << "ms" << std::endl;
+        stream << "    Transform Time: " << stats.transform_ms << "ms" << std::endl;
+        stream << "      Augment Time: " << stats.augment_ms << "ms" << std::endl;
 
         return stream;
     }
@@ -493,6 +669,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         display(std::cout);
     }
 
+    /*!
+     * \brief Returns the memory of the caches of the generator, in bytes
+     */
+    size_t memory() const {
+        return container_bytes(input_cache) + container_bytes(batch_cache) + container_bytes(label_cache) + container_bytes(label_batches)
+            + container_bytes(label_batch_cache);
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -511,6 +695,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             input_cache.clear();
             batch_cache.clear();
             label_cache.clear();
+            label_batches.clear();
         }
     }
 
@@ -532,25 +717,22 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \brief Destructs the inmemory_data_generator
      */
     ~inmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        ring.stop();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
      * \brief Reset the generation to its beginning
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+        if (desc::PrefetchTime) {
+            ring.reset(ring.prefetch_depth(desc::PrefetchTime, workers));
+        } else {
+            ring.reset();
         }
-
-        condition.notify_one();
     }
 
     /*!
@@ -558,6 +740,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      */
     void reset() {
         current = 0;
+        sampled = 0;
         reset_generation();
     }
 
@@ -578,7 +761,63 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        if (importance_sampling) {
+            draw_epoch();
+        } else if (desc::IndexShuffle) {
+            std::shuffle(order.begin(), order.end(), dll::random_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
+    }
+
+    /*!
+     * \brief Draw the order of the samples by their losses, the samples of
+     * the epoch being the first ones.
+     *
+     * The weighted sampling without replacement orders the samples by the
+     * keys -log(u) / w (Efraimidis and Spirakis, 2006), with u uniform. The
+     * first epoch, before any loss is reported, uses all the samples.
+     */
+    void draw_epoch() {
+        const size_t n = etl::dim<0>(input_cache);
+
+        std::mt19937_64 engine(dll::seed() + draws++);
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        if (!has_losses) {
+            sampled = 0;
+            std::shuffle(order.begin(), order.end(), engine);
+            return;
+        }
+
+        const double mean  = std::accumulate(losses.begin(), losses.end(), 0.0) / n;
+        const double floor = std::max(mean * desc::ImportanceFloor / 100.0, std::numeric_limits<double>::min());
+
+        std::vector<double> keys(n);
+
+        for (size_t s = 0; s < n; ++s) {
+            keys[s] = -std::log(1.0 - dist(engine)) / std::max(double(losses[s]), floor);
+        }
+
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b] || (keys[a] == keys[b] && a < b); });
+
+        sampled = std::max<size_t>(1, n * desc::ImportanceSampling / 100);
+    }
+
+    /*!
+     * \brief Report the losses of the samples of the current batch, for the
+     * epochs drawn by importance sampling
+     * \param batch_losses The loss of each sample of the current batch
+     * \param n The number of samples of the current batch
+     */
+    template <typename T>
+    void report_losses(const T* batch_losses, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            losses[sample_index(current + i)] = float(batch_losses[i]);
+        }
+
+        has_losses = true;
     }
 
     /*!
@@ -601,7 +840,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The number of elements in the generator
      */
     size_t size() const {
-        return etl::dim<0>(input_cache);
+        return sampled ? sampled : etl::dim<0>(input_cache);
     }
 
     /*!
@@ -613,7 +852,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * etl::dim<0>(input_cache);
+        return augmenters.front().scaling() * etl::dim<0>(input_cache);
     }
 
     /*!
@@ -640,18 +879,35 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     void next_batch() {
         // Get information from batch that has been consumed
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
+        const auto b     = ring.slot(batch);
 
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
+        ring.release(b);
 
-            status[b] = false;
-            indices[b] += big_batch_size;
+        current += batch_size;
+    }
 
-            condition.notify_one();
-        }
+    /*!
+     * \brief Returns the stalls of the generation since the last reset.
+     *
+     * A large consumer wait means the training is bound by the generation
+     * of the batches, a large producer wait that the workers are waiting
+     * for the training.
+     */
+    generator_stall_stats stalls() const {
+        return ring.stalls();
+    }
 
-        current += batch_size;
+    /*!
+     * \brief Indicates if the batch after the current one has been
+     * generated, without waiting for it.
+     *
+     * Its upload to the device can then be started while the current batch
+     * is used.
+     */
+    bool next_batch_ready() const {
+        const auto batch = current / batch_size + 1;
+
+        return batch * batch_size < size() && ring.ready(ring.slot(batch), batch);
     }
 
     /*!
@@ -659,26 +915,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
-
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
-        }
+        const auto b     = ring.slot(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.wait_ready(b);
 
-        const auto input_n = indices[b] * batch_size + batch_size;
+        const auto input_n = ring.batch(b) * batch_size + batch_size;
 
         if (input_n > size()) {
             return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
@@ -692,7 +934,19 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        if (desc::IndexShuffle) {
+            const auto batch = current / batch_size;
+            const auto b     = ring.slot(batch);
+
+            // The labels are gathered by the workers with the data
+            ring.wait_ready(b);
+
+            const auto n = std::min(current + batch_size, size()) - current;
+
+            return expand_label_batch<desc>(etl::slice(label_batches, b * batch_size, b * batch_size + n), label_batch_cache);
+        } else {
+            return expand_label_batch<desc>(etl::slice(label_cache, current, std::min(current + batch_size, size())), label_batch_cache);
+        }
     }
 
     /*!
@@ -770,6 +1024,21 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The standard deviation of the gaussian noise of the batches, in percent
+     */
+    static constexpr size_t GaussianNoise = detail::get_value_v<gaussian_noise<0>, Parameters...>;
+
+    /*!
+     * \brief The percent of values of the batches set to zero
+     */
+    static constexpr size_t MaskingNoise = detail::get_value_v<masking_noise<0>, Parameters...>;
+
+    /*!
+     * \brief The percent of values of the batches set to zero or one
+     */
+    static constexpr size_t SaltPepperNoise = detail::get_value_v<salt_pepper_noise<0>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -785,21 +1054,100 @@ struct inmemory_data_generator_desc {
      */
     static constexpr bool NormalizePre = parameters::template contains<normalize_pre>();
 
+    /*!
+     * \brief Indicates if each feature of the inputs is standardized over the dataset
+     */
+    static constexpr bool StandardizePre = parameters::template contains<standardize_pre>();
+
+    /*!
+     * \brief Indicates if each channel of the inputs is standardized over the dataset
+     */
+    static constexpr bool ChannelStandardizePre = parameters::template contains<channel_standardize_pre>();
+
     /*!
      * \brief Indicates if this is an auto-encoder task
      */
     static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
 
+    /*!
+     * \brief The number of threads used for data augmentation
+     */
+    static constexpr size_t ThreadedWorkers = detail::get_value_v<threaded_workers<1>, Parameters...>;
+
+    /*!
+     * \brief The number of spin iterations before a generator thread parks
+     */
+    static constexpr size_t SpinWait = detail::get_value_v<spin_wait<0>, Parameters...>;
+
+    /*!
+     * \brief The memory budget of the batch cache, in bytes (0 = big_batch_size batches)
+     */
+    static constexpr size_t CacheBudget = detail::get_value_v<cache_budget<0>, Parameters...>;
+
+    /*!
+     * \brief The target time of consumption of the prefetched batches, in milliseconds (0 = the whole cache)
+     */
+    static constexpr size_t PrefetchTime = detail::get_value_v<prefetch_time<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the batch cache is page-locked
+     */
+    static constexpr bool PinnedCache = parameters::template contains<pinned_cache>();
+
+    /*!
+     * \brief Indicates if the input cache is stored in bfloat16
+     */
+    static constexpr bool Bf16Cache = parameters::template contains<bf16_cache>();
+
+    /*!
+     * \brief The percent of the samples drawn by their loss in each epoch (0 = no importance sampling)
+     */
+    static constexpr size_t ImportanceSampling = detail::get_value_1<importance_sampling<0, 0>, Parameters...>::value;
+
+    /*!
+     * \brief The minimum weight of a sample drawn by its loss, in percent of the mean loss
+     */
+    static constexpr size_t ImportanceFloor = detail::get_value_2<importance_sampling<0, 0>, Parameters...>::value;
+
+    /*!
+     * \brief Indicates if a permutation of indices is shuffled instead of the samples
+     */
+    static constexpr bool IndexShuffle = parameters::template contains<index_shuffle>() || ImportanceSampling > 0;
+
+    /*!
+     * \brief Indicates if the input cache is stored in uint8
+     */
+    static constexpr bool U8Cache = parameters::template contains<u8_cache>();
+
+    /*!
+     * \brief Indicates if the label cache stores the class indices of the categorical labels
+     */
+    static constexpr bool CompactLabels = parameters::template contains<compact_labels>();
+
     static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(!CompactLabels || Categorical, "compact_labels is only supported for categorical labels");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(ThreadedWorkers > 0, "There must be at least one augmentation worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
+    static_assert(!(Bf16Cache && U8Cache), "Only one compact cache can be used");
+    static_assert(ImportanceSampling <= 100, "importance_sampling draws at most all the samples");
+    static_assert(!(StandardizePre && ChannelStandardizePre), "Only one standardization can be used");
+    static_assert(!(StandardizePre || ChannelStandardizePre) || !NormalizePre, "standardize_pre is not compatible with normalize_pre");
+    static_assert(!(StandardizePre || ChannelStandardizePre) || !(Noise || HorizontalMirroring || VerticalMirroring || ElasticDistortion || random_crop_x || random_crop_y || Bf16Cache || U8Cache || IndexShuffle),
+                  "The standardization is only supported by the in-memory generator without augmentation nor compact cache");
+    static_assert(!(GaussianNoise || MaskingNoise || SaltPepperNoise) || !(Noise || HorizontalMirroring || VerticalMirroring || ElasticDistortion || random_crop_x || random_crop_y),
+                  "The noise of the batches is not compatible with augmentation");
+    static_assert(!(GaussianNoise || MaskingNoise || SaltPepperNoise) || !(Bf16Cache || U8Cache || IndexShuffle),
+                  "The noise of the batches is not compatible with compact caches and index shuffle");
+    static_assert(!(CacheBudget || PrefetchTime || PinnedCache) || HorizontalMirroring || VerticalMirroring || Noise || ElasticDistortion || (random_crop_x && random_crop_y) || Bf16Cache || U8Cache || IndexShuffle,
+                  "cache_budget, prefetch_time and pinned_cache are only supported by the threaded generator");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                categorical_id, noise_id, gaussian_noise_id, masking_noise_id, salt_pepper_noise_id, threaded_workers_id, spin_wait_id, cache_budget_id, prefetch_time_id, pinned_cache_id, bf16_cache_id, u8_cache_id, index_shuffle_id, importance_sampling_id, compact_labels_id, nop_id, normalize_pre_id, standardize_pre_id, channel_standardize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
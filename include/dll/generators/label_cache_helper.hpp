@@ -9,6 +9,8 @@
 
 namespace dll {
 
+using label_index_t = uint32_t; ///< The type of the class indices of the compact label caches
+
 /*!
  * \brief Helper to create and initialize a cache for labels
  */
@@ -21,7 +23,7 @@ struct label_cache_helper;
  * This version makes the label categorical.
  */
 template <typename Desc, typename T, typename LIterator>
-struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !Desc::CompactLabels && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
     using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
@@ -47,9 +49,10 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
-        cache = big_cache_type(big_batch_size, batch_size, n_classes);
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t n = big_batch_size) {
+        cache = big_cache_type(n, batch_size, n_classes);
 
         cpp_unused(it);
     }
@@ -67,6 +70,61 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
     }
 };
 
+/*!
+ * \brief Helper to create and initialize a cache for labels.
+ *
+ * This version stores the class indices of categorical labels, they are
+ * only made categorical for the current batch (expand_label_batch).
+ */
+template <typename Desc, typename T, typename LIterator>
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && Desc::CompactLabels && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+    using cache_type     = etl::dyn_matrix<label_index_t, 1>; ///< The type of the cache
+    using big_cache_type = etl::dyn_matrix<label_index_t, 2>; ///< The type of the big cache
+
+    static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
+
+    /*!
+     * \brief Init the cache
+     * \param n The size of the cache
+     * \param n_classes The number of classes
+     * \param it An iterator to an element
+     * \param cache The cache to initialize
+     */
+    static void init(size_t n, size_t n_classes, const LIterator& it, cache_type& cache) {
+        cache = cache_type(n);
+        cache = label_index_t(0);
+
+        cpp_unused(it);
+        cpp_unused(n_classes);
+    }
+
+    /*!
+     * \brief Init the big cache
+     * \param n_classes The number of classes
+     * \param it An iterator to an element
+     * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
+     */
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t n = big_batch_size) {
+        cache = big_cache_type(n, batch_size);
+
+        cpp_unused(it);
+        cpp_unused(n_classes);
+    }
+
+    /*!
+     * \brief Set the value of a label in the cache from the iterator
+     * \param i The index of the label in the cache
+     * \param it The label iterator
+     * \param cache The label cache
+     */
+    template <typename E>
+    static void set(size_t i, const LIterator& it, E&& cache) {
+        cache[i] = static_cast<label_index_t>(*it);
+    }
+};
+
 /*!
  * \brief Helper to create and initialize a cache for labels.
  *
@@ -99,9 +157,10 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorica
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
-        cache = big_cache_type(big_batch_size, batch_size);
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t n = big_batch_size) {
+        cache = big_cache_type(n, batch_size);
 
         cpp_unused(it);
         cpp_unused(n_classes);
@@ -154,10 +213,11 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_1d<typena
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t n = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one));
+        cache    = big_cache_type(n, batch_size, etl::dim<0>(one));
 
         cpp_unused(it);
         cpp_unused(n_classes);
@@ -210,10 +270,11 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_3d<typena
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param n The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t n = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+        cache    = big_cache_type(n, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
 
         cpp_unused(it);
         cpp_unused(n_classes);
@@ -231,4 +292,76 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_3d<typena
     }
 };
 
+/*!
+ * \brief Initialize the buffer of the categorical labels of one batch.
+ *
+ * This version does not need a buffer, the labels of the cache are
+ * already categorical.
+ */
+template <typename Desc, typename Buffer, cpp_enable_iff(!Desc::CompactLabels)>
+void init_label_batch(size_t n_classes, Buffer& buffer) {
+    cpp_unused(n_classes);
+    cpp_unused(buffer);
+}
+
+/*!
+ * \brief Initialize the buffer of the categorical labels of one batch.
+ *
+ * This version allocates a buffer for the labels made categorical from
+ * the class indices of the cache.
+ */
+template <typename Desc, typename Buffer, cpp_enable_iff(Desc::CompactLabels)>
+void init_label_batch(size_t n_classes, Buffer& buffer) {
+    buffer = Buffer(Desc::BatchSize, n_classes);
+}
+
+/*!
+ * \brief Returns the batch of labels given to the trainers from a batch of
+ * the label cache.
+ *
+ * This version returns the labels of the cache as such.
+ */
+template <typename Desc, typename Labels, typename Buffer, cpp_enable_iff(!Desc::CompactLabels)>
+Labels expand_label_batch(Labels labels, Buffer& buffer) {
+    cpp_unused(buffer);
+
+    return labels;
+}
+
+/*!
+ * \brief Returns the batch of labels given to the trainers from a batch of
+ * the label cache.
+ *
+ * This version makes the class indices of the batch categorical in the
+ * buffer of the batch.
+ */
+template <typename Desc, typename Labels, typename Buffer, cpp_enable_iff(Desc::CompactLabels)>
+auto expand_label_batch(Labels labels, Buffer& buffer) {
+    const size_t n = etl::dim<0>(labels);
+
+    for (size_t i = 0; i < n; ++i) {
+        buffer(i) = 0;
+        buffer(i, labels[i]) = 1;
+    }
+
+    return etl::slice(buffer, 0, n);
+}
+
+/*!
+ * \brief Set the class of the i-th label of a categorical cache, the
+ * label must have been cleared before.
+ */
+template <typename Cache, cpp_enable_iff(etl::dimensions<Cache>() == 2)>
+void set_label_class(Cache& cache, size_t i, size_t c) {
+    cache(i, c) = 1;
+}
+
+/*!
+ * \brief Set the class of the i-th label of a compact categorical cache
+ */
+template <typename Cache, cpp_enable_iff(etl::dimensions<Cache>() == 1)>
+void set_label_class(Cache& cache, size_t i, size_t c) {
+    cache[i] = c;
+}
+
 } //end of dll namespace
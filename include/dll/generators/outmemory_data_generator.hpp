@@ -14,6 +14,12 @@
 
 #include <atomic>
 #include <thread>
+#include <future>
+
+#include "dll/util/affinity.hpp"
+#include "dll/util/memory_usage.hpp"
+#include "dll/util/scheduler.hpp"
+#include "dll/generators/block_shuffler.hpp"
 
 namespace dll {
 
@@ -27,7 +33,7 @@ struct outmemory_data_generator;
  * \copydoc outmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc>>> {
+struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && !is_prefetched<Desc>>> {
     using desc                 = Desc;                                        ///< The generator descriptor
     using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                ///< The helper for the data cache
@@ -37,17 +43,22 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
     static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = false;            ///< Indicates if the batches are prepared in the background by the generator
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the batch
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The categorical labels of the current batch (compact labels only)
+
     size_t current      = 0;     ///< The current index
     size_t current_real = 0;     ///< The current real index
     size_t current_b    = 0;     ///< The current batch
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
+    block_shuffler order; ///< The order of the samples
+
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
     LIterator orig_lit; ///< The original first iterator on label
@@ -68,6 +79,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
             : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
+        init_label_batch<desc>(n_classes, label_batch_cache);
 
         reset();
 
@@ -102,6 +114,13 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         display(std::cout);
     }
 
+    /*!
+     * \brief Returns the memory of the caches of the generator, in bytes
+     */
+    size_t memory() const {
+        return container_bytes(batch_cache) + container_bytes(label_cache) + container_bytes(label_batch_cache);
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -142,37 +161,41 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     void fetch_next() {
         current_b = 0;
 
-        for (size_t b = 0; b < big_batch_size && current_real < _size; ++b) {
-            for (size_t i = 0; i < batch_size && current_real < _size;) {
-                auto sub = batch_cache(b)(i);
+        constexpr size_t chunk_size = big_batch_size * batch_size;
 
-                sub = *it;
+        const size_t n = std::min(chunk_size, _size - current_real);
 
-                pre_scaler<desc>::transform(sub);
-                pre_normalizer<desc>::transform(sub);
-                pre_binarizer<desc>::transform(sub);
+        order.seek(current_real, n, chunk_size, it, lit, orig_it, orig_lit);
 
-                label_cache_helper_t::set(i, lit, label_cache(b));
+        for (size_t k = 0; k < n; ++k) {
+            const size_t s = order.slot(k);
+            const size_t b = s / batch_size;
+            const size_t i = s % batch_size;
 
-                // In case of auto-encoders, the label images also need to be transformed
-                cpp::static_if<desc::AutoEncoder>([&](auto f) {
-                    pre_scaler<desc>::transform(f(label_cache)(b)(i));
-                    pre_normalizer<desc>::transform(f(label_cache)(b)(i));
-                    pre_binarizer<desc>::transform(f(label_cache)(b)(i));
-                });
+            auto sub = batch_cache(b)(i);
 
-                ++i;
-                ++current_real;
-                ++it;
-                ++lit;
-            }
+            sub = *it;
+
+            pre_transformer<desc>::transform(sub);
+
+            label_cache_helper_t::set(i, lit, label_cache(b));
+
+            // In case of auto-encoders, the label images also need to be transformed
+            cpp::static_if<desc::AutoEncoder>([&](auto f) {
+                pre_transformer<desc>::transform(f(label_cache)(b)(i));
+            });
+
+            ++it;
+            ++lit;
         }
+
+        current_real += n;
     }
 
     /*!
-     * \brief Reset the generator to the beginning
+     * \brief Reset the generation
      */
-    void reset() {
+    void reset_generation() {
         current      = 0;
         current_real = 0;
 
@@ -182,20 +205,40 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         fetch_next();
     }
 
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        order.reset();
+
+        reset_generation();
+    }
+
     /*!
      * \brief Reset the generator and shuffle the order of samples
      */
     void reset_shuffle() {
-        cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        current = 0;
+        shuffle();
     }
 
     /*!
-     * \brief Shuffle the order of the samples.
+     * \brief Shuffle the order of the samples, by blocks: the order of the
+     * chunks of big_batch_size batches and then the order of the samples
+     * in each chunk.
      *
      * This should only be done when the generator is at the beginning.
      */
     void shuffle() {
-        cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        if (!block_shuffler::is_shufflable<Iterator, LIterator>()) {
+            cpp_unreachable("Impossible to shuffle out-of-memory data set without random access");
+        }
+
+        order.shuffle(_size, big_batch_size * batch_size);
+
+        reset_generation();
     }
 
     /*!
@@ -277,7 +320,300 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache(current_b), 0, std::min(batch_size, current_real - current));
+        return expand_label_batch<desc>(etl::slice(label_cache(current_b), 0, std::min(batch_size, current_real - current)), label_batch_cache);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<big_data_cache_type>() - 2;
+    }
+};
+
+/*!
+ * \copydoc outmemory_data_generator
+ *
+ * The batches are loaded in two buffers: a thread fills one buffer
+ * while the batches of the other are used. The number of batches of
+ * each buffer is computed from the memory budget.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && is_prefetched<Desc>>> {
+    using desc                 = Desc;                                        ///< The generator descriptor
+    using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
+    using data_cache_helper_t  = cache_helper<Desc, Iterator>;                ///< The helper for the data cache
+    using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>; ///< The helper for the label cache
+
+    using big_data_cache_type  = typename data_cache_helper_t::big_cache_type;  ///< The type of the big data cache
+    using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
+
+    static constexpr bool dll_generator = true;            ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = true;       ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr size_t batch_size  = desc::BatchSize; ///< The size of the batch
+
+    big_data_cache_type batch_cache[2];  ///< The data batch buffers
+    big_label_cache_type label_cache[2]; ///< The label batch buffers
+    size_t end[2] = {0, 0};              ///< The index after the last sample of each buffer
+
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The categorical labels of the current batch (compact labels only)
+
+    size_t big_batches  = 1;     ///< The number of batches per buffer
+    size_t front        = 0;     ///< The buffer being used
+    size_t current      = 0;     ///< The current index
+    size_t current_b    = 0;     ///< The current batch in the front buffer
+    size_t current_real = 0;     ///< The number of samples read from the iterators
+    bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    std::future<void> loader; ///< The background task filling the back buffer
+
+    block_shuffler order; ///< The order of the samples
+
+    const size_t _size; ///< The size of the dataset
+    Iterator orig_it;   ///< The original first iterator on data
+    LIterator orig_lit; ///< The original first iterator on label
+    Iterator it;        ///< The current iterator on data
+    LIterator lit;      ///< The current iterator on label
+
+    /*!
+     * \brief Construct an outmemory_data_generator
+     * \param first The iterator on the beginning on data
+     * \param last The iterator on the end  on data
+     * \param lfirst The iterator on the beginning on labels
+     * \param llast The iterator on the end  on labels
+     * \param n_classes The number of classes
+     * \param size The size of the entire dataset
+     */
+    outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
+            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
+        big_data_cache_type data_one;
+        big_label_cache_type label_one;
+
+        data_cache_helper_t::init_big(first, data_one);
+        label_cache_helper_t::init_big(n_classes, lfirst, label_one);
+        init_label_batch<desc>(n_classes, label_batch_cache);
+
+        // The memory of one batch (data and labels)
+        const size_t batch_bytes = (etl::size(data_one) + etl::size(label_one)) / etl::dim<0>(data_one) * sizeof(weight);
+
+        big_batches = std::max<size_t>(1, desc::PrefetchBudget / (2 * batch_bytes));
+
+        for (size_t i = 0; i < 2; ++i) {
+            batch_cache[i] = resize_big(data_one, std::make_index_sequence<etl::dimensions<big_data_cache_type>() - 1>());
+            label_cache[i] = resize_big(label_one, std::make_index_sequence<etl::dimensions<big_label_cache_type>() - 1>());
+        }
+
+        reset();
+
+        cpp_unused(last);
+        cpp_unused(llast);
+    }
+
+    outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
+    outmemory_data_generator operator=(const outmemory_data_generator& rhs) = delete;
+
+    outmemory_data_generator(outmemory_data_generator&& rhs) = delete;
+    outmemory_data_generator operator=(outmemory_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Wait for the loader
+     */
+    ~outmemory_data_generator() {
+        wait_loader();
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Out-Of-Memory Data Generator (prefetched)" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "    Augmented Size: " << augmented_size() << std::endl;
+        stream << "  Buffered Batches: " << big_batches << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Returns the memory of the caches of the generator, in bytes
+     */
+    size_t memory() const {
+        return container_bytes(batch_cache[0]) + container_bytes(batch_cache[1]) + container_bytes(label_cache[0]) + container_bytes(label_cache[1])
+            + container_bytes(label_batch_cache);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe it is safe.
+     */
+    void clear() {
+        if (is_safe) {
+            wait_loader();
+
+            for (size_t i = 0; i < 2; ++i) {
+                batch_cache[i].clear();
+                label_cache[i].clear();
+            }
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        wait_loader();
+
+        order.reset();
+
+        restart();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples, by blocks: the order of the
+     * chunks of one buffer and then the order of the samples in each
+     * buffer.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        if (!block_shuffler::is_shufflable<Iterator, LIterator>()) {
+            cpp_unreachable("Impossible to shuffle out-of-memory data set without random access");
+        }
+
+        // The loader must not read while the order changes
+        wait_loader();
+
+        order.shuffle(_size, big_batches * batch_size);
+
+        restart();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        ++current_b;
+
+        current += batch_size;
+
+        if (current_b == big_batches) {
+            // Switch to the prefetched buffer and start filling the other
+            wait_loader();
+
+            front     = 1 - front;
+            current_b = 0;
+
+            start_loader();
+        }
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        return etl::slice(batch_cache[front](current_b), 0, std::min(batch_size, end[front] - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        return expand_label_batch<desc>(etl::slice(label_cache[front](current_b), 0, std::min(batch_size, end[front] - current)), label_batch_cache);
     }
 
     /*!
@@ -287,6 +623,101 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     static constexpr size_t dimensions() {
         return etl::dimensions<big_data_cache_type>() - 2;
     }
+
+private:
+    /*!
+     * \brief Return a cache of big_batches batches with the dimensions of
+     * the given cache
+     */
+    template <typename C, size_t... I>
+    C resize_big(const C& like, std::index_sequence<I...>) const {
+        return C(big_batches, etl::dim<I + 1>(like)...);
+    }
+
+    /*!
+     * \brief Position the iterators at the next samples to read and return
+     * the number of samples of the next buffer.
+     *
+     * This is done by the main thread, before the buffer is filled, since
+     * the random engine cannot be shared with the loader.
+     */
+    size_t seek_next() {
+        const size_t chunk_size = big_batches * batch_size;
+        const size_t n          = std::min(chunk_size, _size - current_real);
+
+        order.seek(current_real, n, chunk_size, it, lit, orig_it, orig_lit);
+
+        return n;
+    }
+
+    /*!
+     * \brief Fill the given buffer with the next n samples
+     */
+    void fill(size_t buffer, size_t n) {
+        auto& data   = batch_cache[buffer];
+        auto& labels = label_cache[buffer];
+
+        for (size_t k = 0; k < n; ++k) {
+            const size_t s = order.slot(k);
+            const size_t b = s / batch_size;
+            const size_t i = s % batch_size;
+
+            auto sub = data(b)(i);
+
+            sub = *it;
+
+            pre_transformer<desc>::transform(sub);
+
+            label_cache_helper_t::set(i, lit, labels(b));
+
+            // In case of auto-encoders, the label images also need to be transformed
+            cpp::static_if<desc::AutoEncoder>([&](auto f) {
+                pre_transformer<desc>::transform(f(labels)(b)(i));
+            });
+
+            ++it;
+            ++lit;
+        }
+
+        current_real += n;
+        end[buffer] = current_real;
+    }
+
+    /*!
+     * \brief Start filling the back buffer, if there are samples left
+     */
+    void start_loader() {
+        if (current_real < _size) {
+            const size_t back = 1 - front;
+            const size_t n    = seek_next();
+            loader = scheduler().submit_background([this, back, n] { fill(back, n); });
+        }
+    }
+
+    /*!
+     * \brief Restart the generation from the first sample
+     */
+    void restart() {
+        current      = 0;
+        current_b    = 0;
+        current_real = 0;
+        front        = 0;
+
+        it  = orig_it;
+        lit = orig_lit;
+
+        fill(front, seek_next());
+        start_loader();
+    }
+
+    /*!
+     * \brief Wait for the back buffer to be filled
+     */
+    void wait_loader() {
+        if (loader.valid()) {
+            loader.get();
+        }
+    }
 };
 
 /*!
@@ -302,28 +733,32 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     using big_data_cache_type  = typename data_cache_helper_t::big_cache_type;  ///< The type of the big data cache
     using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
-    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
-    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
-    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
+    static constexpr bool dll_generator    = true;                  ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = true;                ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr size_t batch_size     = desc::BatchSize;       ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize;    ///< The number of batches kept in cache
+    static constexpr size_t workers        = desc::ThreadedWorkers; ///< The number of augmentation workers
 
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
+    pinned_memory data_pin;  ///< The page-locking of the data batch cache (pinned cache only)
+    pinned_memory label_pin; ///< The page-locking of the label batch cache (pinned cache only)
+
+    mutable etl::dyn_matrix<weight, 2> label_batch_cache; ///< The categorical labels of the current batch (compact labels only)
+
     size_t current      = 0;     ///< The current index
     size_t current_read = 0;     ///< The current index read
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    const size_t batch_bytes;                ///< The memory of one batch of the cache (data and labels)
+    mutable batch_ring<desc::SpinWait> ring; ///< The ring of batches shared with the workers
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    std::mutex read_lock;               ///< The lock protecting the reading of the iterators
+    std::atomic<bool> reset_flag{true}; ///< Indicates that the iterators must be reset before the next read
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
-
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> threads;    ///< The augmentation threads
+    std::atomic<bool> train_mode{false}; ///< The train mode status
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
@@ -331,10 +766,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     Iterator it;        ///< The current iterator on data
     LIterator lit;      ///< The current iterator on label
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    std::vector<augmentation_worker<Desc>> augmenters; ///< The augmenters of each worker
 
     /*!
      * \brief Construct an outmemory_data_generator
@@ -346,113 +778,115 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \param size The size of the entire dataset
      */
     outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
-            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
-        data_cache_helper_t::init_big(first, batch_cache);
-        label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
+            : batch_bytes(cache_batch_bytes(first, lfirst, n_classes)),
+              ring(ring_capacity(desc::CacheBudget, batch_bytes, big_batch_size, size / batch_size + (size % batch_size == 0 ? 0 : 1))),
+              _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
+        data_cache_helper_t::init_big(first, batch_cache, ring.N);
+        label_cache_helper_t::init_big(n_classes, lfirst, label_cache, ring.N);
+        init_label_batch<desc>(n_classes, label_batch_cache);
+
+        if (desc::PinnedCache) {
+            data_pin.pin(batch_cache);
+            label_pin.pin(label_cache);
+        }
 
         cpp_unused(last);
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        // Each worker gets its own augmenters and random engine
+        augmenters.reserve(workers);
+        for (size_t w = 0; w < workers; ++w) {
+            augmenters.emplace_back(*first, dll::rand_engine()());
+        }
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { worker_main(augmenters[w]); });
+        }
+    }
 
-                    bool found = false;
+    /*!
+     * \brief Returns the memory of one batch of the cache (data and labels)
+     */
+    static size_t cache_batch_bytes(Iterator first, LIterator lfirst, size_t n_classes) {
+        big_data_cache_type data_one;
+        big_label_cache_type label_one;
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+        data_cache_helper_t::init_big(first, data_one, 1);
+        label_cache_helper_t::init_big(n_classes, lfirst, label_one, 1);
 
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
+        return etl::size(data_one) * sizeof(etl::value_t<big_data_cache_type>) + etl::size(label_one) * sizeof(etl::value_t<big_label_cache_type>);
+    }
 
-                SERIAL_SECTION {
-                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
-                        auto sub = batch_cache(index)(i);
+    /*!
+     * \brief The main function of each augmentation worker
+     * \param augmenter The augmenters of the worker
+     */
+    void worker_main(augmentation_worker<Desc>& augmenter) {
+        pin_helper();
 
-                        if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
+        while (true) {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+            // The number of samples read in the batch
+            size_t n = 0;
 
-                            // Mirror the image
-                            mirrorer.transform(sub);
+            // The start of the transformation of the batch
+            typename batch_ring<desc::SpinWait>::time_point start;
 
-                            // Distort the image
-                            distorter.transform(sub);
+            {
+                // The batches must be read from the iterators in order
+                std::unique_lock<std::mutex> rlock(read_lock);
 
-                            // Noise the image
-                            noiser.transform(sub);
-                        } else {
-                            // Center crop the image
-                            cropper.transform_first_test(sub, *it);
+                // Wait for the end or for some work, the iterators can only be read in order
+                if (!ring.acquire(index, batches(), true)) {
+                    return;
+                }
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-                        }
+                start = ring.now();
 
-                        label_cache_helper_t::set(i, lit, label_cache(index));
+                if (reset_flag.exchange(false)) {
+                    current_read = 0;
+                    it           = orig_it;
+                    lit          = orig_lit;
+                }
+
+                SERIAL_SECTION {
+                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
+                        augmenter.transform_first(batch_cache(index)(i), *it, train_mode);
 
-                        // In case of auto-encoders, the label images also need to be transformed
-                        cpp::static_if<desc::AutoEncoder>([&](auto f) {
-                            pre_scaler<desc>::transform(f(label_cache)(index)(i));
-                            pre_normalizer<desc>::transform(f(label_cache)(index)(i));
-                            pre_binarizer<desc>::transform(f(label_cache)(index)(i));
-                        });
+                        label_cache_helper_t::set(i, lit, label_cache(index));
 
                         ++it;
                         ++lit;
                         ++current_read;
+                        ++n;
                     }
                 }
+            }
 
-                // Notify a waiter that one batch is ready
+            // The rest of the augmentation does not need the iterators
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+            SERIAL_SECTION {
+                pre_transformer<desc>::transform_batch(batch_cache(index), n);
 
-                    status[index] = true;
+                // In case of auto-encoders, the label images also need to be transformed
+                cpp::static_if<desc::AutoEncoder>([&](auto f) {
+                    pre_transformer<desc>::transform_batch(f(label_cache)(index), n);
+                });
 
-                    ready_condition.notify_one();
+                ring.account(ring.transform_ns, start);
+
+                if (train_mode) {
+                    augmenter.transform_batch(batch_cache(index), n);
+
+                    ring.account(ring.augment_ns, start);
                 }
             }
-        });
+
+            // Notify a waiter that one batch is ready
+            ring.publish(index);
+        }
     }
 
     outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
@@ -465,11 +899,11 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Destructs the outmemory_data_generator
      */
     ~outmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        ring.stop();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
@@ -482,6 +916,16 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
         stream << "    Augmented Size: " << augmented_size() << std::endl;
+        stream << "     Cache Batches: " << ring.N << std::endl;
+        stream << "    Prefetch Depth: " << ring.depth.load() << std::endl;
+        stream << "      Cache Memory: " << ring.N * batch_bytes << " bytes" << (data_pin.pinned() ? " (pinned)" : "") << std::endl;
+
+        const auto stats = stalls();
+
+        stream << "     Consumer Wait: " << stats.consumer_wait_ms << "ms" << std::endl;
+        stream << "     Producer Wait: " << stats.producer_wait_ms << "ms" << std::endl;
+        stream << "    Transform Time: " << stats.transform_ms << "ms" << std::endl;
+        stream << "      Augment Time: " << stats.augment_ms << "ms" << std::endl;
 
         return stream;
     }
@@ -493,6 +937,13 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         display(std::cout);
     }
 
+    /*!
+     * \brief Returns the memory of the caches of the generator, in bytes
+     */
+    size_t memory() const {
+        return container_bytes(batch_cache) + container_bytes(label_cache) + container_bytes(label_batch_cache);
+    }
+
     /*!
      * \brief Indicates that it is safe to destroy the memory of the generator
      * when not used by the pretraining phase
@@ -531,18 +982,14 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Reset the generation
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        current_read = 0;
-        it           = orig_it;
-        lit          = orig_lit;
+        // The iterators are reset by the next reader
+        reset_flag = true;
 
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+        if (desc::PrefetchTime) {
+            ring.reset(ring.prefetch_depth(desc::PrefetchTime, workers));
+        } else {
+            ring.reset();
         }
-
-        condition.notify_one();
     }
 
     /*!
@@ -601,7 +1048,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * size();
+        return augmenters.front().scaling() * size();
     }
 
     /*!
@@ -628,18 +1075,35 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     void next_batch() {
         // Get information from batch that has been consumed
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
+        const auto b     = ring.slot(batch);
 
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
+        ring.release(b);
 
-            status[b] = false;
-            indices[b] += big_batch_size;
+        current += batch_size;
+    }
 
-            condition.notify_one();
-        }
+    /*!
+     * \brief Returns the stalls of the generation since the last reset.
+     *
+     * A large consumer wait means the training is bound by the generation
+     * of the batches, a large producer wait that the workers are waiting
+     * for the training.
+     */
+    generator_stall_stats stalls() const {
+        return ring.stalls();
+    }
 
-        current += batch_size;
+    /*!
+     * \brief Indicates if the batch after the current one has been
+     * generated, without waiting for it.
+     *
+     * Its upload to the device can then be started while the current batch
+     * is used.
+     */
+    bool next_batch_ready() const {
+        const auto batch = current / batch_size + 1;
+
+        return batch * batch_size < size() && ring.ready(ring.slot(batch), batch);
     }
 
     /*!
@@ -647,18 +1111,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
-        }
+        const auto b     = ring.slot(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.wait_ready(b);
 
         return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -668,20 +1124,12 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
-        }
+        const auto b     = ring.slot(batch);
 
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.wait_ready(b);
 
-        return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
+        return expand_label_batch<desc>(etl::slice(label_cache(b), 0, std::min(batch_size, _size - current)), label_batch_cache);
     }
 
     /*!
@@ -742,7 +1190,7 @@ struct outmemory_data_generator_desc {
     /*!
      * \brief Indicates if the generator is threaded
      */
-    static constexpr bool Threaded = parameters::template contains<threaded>();
+    static constexpr bool Threaded = parameters::template contains<threaded>() || detail::get_value_v<threaded_workers<1>, Parameters...> > 1;
 
     /*!
      * \brief The random cropping X
@@ -779,21 +1227,71 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool NormalizePre = parameters::template contains<normalize_pre>();
 
+    /*!
+     * \brief Indicates if each feature of the inputs is standardized over the dataset
+     */
+    static constexpr bool StandardizePre = parameters::template contains<standardize_pre>();
+
+    /*!
+     * \brief Indicates if each channel of the inputs is standardized over the dataset
+     */
+    static constexpr bool ChannelStandardizePre = parameters::template contains<channel_standardize_pre>();
+
     /*!
      * \brief Indicates if this is an auto-encoder task
      */
     static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
 
+    /*!
+     * \brief The number of threads used for data augmentation
+     */
+    static constexpr size_t ThreadedWorkers = detail::get_value_v<threaded_workers<1>, Parameters...>;
+
+    /*!
+     * \brief The number of spin iterations before a generator thread parks
+     */
+    static constexpr size_t SpinWait = detail::get_value_v<spin_wait<0>, Parameters...>;
+
+    /*!
+     * \brief The memory budget of the prefetched batches, in bytes (0 = no prefetching)
+     */
+    static constexpr size_t PrefetchBudget = detail::get_value_v<prefetch_budget<0>, Parameters...>;
+
+    /*!
+     * \brief The memory budget of the batch cache, in bytes (0 = big_batch_size batches)
+     */
+    static constexpr size_t CacheBudget = detail::get_value_v<cache_budget<0>, Parameters...>;
+
+    /*!
+     * \brief The target time of consumption of the prefetched batches, in milliseconds (0 = the whole cache)
+     */
+    static constexpr size_t PrefetchTime = detail::get_value_v<prefetch_time<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the batch cache is page-locked
+     */
+    static constexpr bool PinnedCache = parameters::template contains<pinned_cache>();
+
+    /*!
+     * \brief Indicates if the label cache stores the class indices of the categorical labels
+     */
+    static constexpr bool CompactLabels = parameters::template contains<compact_labels>();
+
     static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(!CompactLabels || Categorical, "compact_labels is only supported for categorical labels");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(ThreadedWorkers > 0, "There must be at least one augmentation worker");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
+    static_assert(!PrefetchBudget || !(Threaded || HorizontalMirroring || VerticalMirroring || Noise || ElasticDistortion || (random_crop_x && random_crop_y)), "prefetch_budget is only supported by the non-threaded generator");
+    static_assert(!(CacheBudget || PrefetchTime || PinnedCache) || Threaded || HorizontalMirroring || VerticalMirroring || Noise || ElasticDistortion || (random_crop_x && random_crop_y),
+                  "cache_budget, prefetch_time and pinned_cache are only supported by the threaded generator");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
                 batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                elastic_distortion_id, categorical_id, noise_id, threaded_id, threaded_workers_id, spin_wait_id, prefetch_budget_id, cache_budget_id, prefetch_time_id, pinned_cache_id, compact_labels_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
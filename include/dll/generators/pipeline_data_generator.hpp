@@ -0,0 +1,803 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator composed of stages.
+ *
+ * Contrary to the in-memory and out-of-memory generators, the steps of the
+ * generation are not selected by the descriptor but composed at runtime:
+ *
+ *  - a source stage, reading each sample and its label;
+ *  - any number of map stages, transforming each sample;
+ *  - any number of augment stages, transforming each sample with a random
+ *    engine, only in train mode;
+ *  - a batch stage, gathering the samples in batches;
+ *  - a prefetch stage, the bounded queue of the ready batches.
+ *
+ * Each stage has its own number of workers and its own bounded output
+ * queue. A stage only takes a sample from its input when it has some space
+ * in its output, the backpressure of a slow stage propagates up to the
+ * source.
+ *
+ * The workers are tasks of the background priority of the shared
+ * scheduler. A task never blocks: it processes samples as long as the
+ * stage has some work and then finishes, a new task being started as soon
+ * as some work becomes available. A stalled stage therefore never holds a
+ * thread of the scheduler.
+ *
+ * When a stage has several workers, the samples of the batches are not in
+ * the order of the source.
+ */
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "dll/util/scheduler.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+namespace pipeline_detail {
+
+/*!
+ * \brief Create a sample of the given shape
+ */
+template <typename T, size_t D, size_t... I>
+etl::dyn_matrix<T, D> make_sample(const std::array<size_t, D>& shape, std::index_sequence<I...> /*seq*/) {
+    return etl::dyn_matrix<T, D>(shape[I]...);
+}
+
+} //end of namespace pipeline_detail
+
+/*!
+ * \brief A data generator composed of stages running on the scheduler
+ *
+ * \tparam T The type of the values of the samples
+ * \tparam D The number of dimensions of one sample
+ */
+template <typename T, size_t D, typename Desc>
+struct pipeline_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    using this_type        = pipeline_data_generator<T, D, Desc>;           ///< The type of this generator
+    using sample_type      = etl::dyn_matrix<T, D>;                         ///< The type of a sample
+    using data_batch_type  = etl::dyn_matrix<T, D + 1>;                     ///< The type of a batch
+    using label_batch_type = etl::dyn_matrix<T, Desc::Categorical ? 2 : 1>; ///< The type of the labels of a batch
+
+    using source_t  = std::function<void(size_t, sample_type&, T&)>;          ///< The function reading a sample and its label
+    using map_t     = std::function<void(sample_type&)>;                      ///< The function of a map stage
+    using augment_t = std::function<void(sample_type&, dll::random_engine&)>; ///< The function of an augment stage
+
+    static constexpr bool dll_generator      = true; ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = true; ///< Indicates if the batches are prepared in the background by the generator
+    static constexpr bool stage_augmentation = true; ///< Indicates that the samples may be augmented by the stages
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    static_assert(!is_augmented<Desc> && !is_compact_cache<Desc> && !is_index_shuffle<Desc>,
+                  "The augmentations of the pipeline generator are stages, not parameters of the descriptor");
+    static_assert(!(Desc::GaussianNoise || Desc::MaskingNoise || Desc::SaltPepperNoise),
+                  "The pipeline generator does not support the noise of the batches");
+    static_assert(!is_standardized<Desc>, "The standardization of the pipeline generator must be done by a map stage");
+
+    /*!
+     * \brief Construct a pipeline generator, the source must then be set
+     * \param n The number of samples
+     * \param shape The shape of one sample
+     * \param n_classes The number of classes
+     */
+    pipeline_data_generator(size_t n, const std::array<size_t, D>& shape, size_t n_classes)
+            : n(n), shape(shape), n_classes(n_classes), stages(1) {
+        sample_size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+    }
+
+    pipeline_data_generator(const pipeline_data_generator& rhs) = delete;
+    pipeline_data_generator operator=(const pipeline_data_generator& rhs) = delete;
+
+    pipeline_data_generator(pipeline_data_generator&& rhs) = delete;
+    pipeline_data_generator operator=(pipeline_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Stop the generation and wait for the workers
+     */
+    ~pipeline_data_generator() {
+        stop();
+    }
+
+    /*!
+     * \brief Set the source stage.
+     *
+     * With several workers, the function is called concurrently for
+     * different samples.
+     *
+     * \param function The function reading the sample of the given index and its label
+     * \param workers The number of workers of the stage
+     * \param capacity The number of samples of the output queue of the stage
+     * \return the generator
+     */
+    this_type& source(source_t function, size_t workers = 1, size_t capacity = 2 * batch_size) {
+        source_function = std::move(function);
+
+        return source(workers, capacity);
+    }
+
+    /*!
+     * \brief Set the parallelism of the source stage
+     * \param workers The number of workers of the stage
+     * \param capacity The number of samples of the output queue of the stage
+     * \return the generator
+     */
+    this_type& source(size_t workers, size_t capacity) {
+        cpp_assert(!started, "The stages must be configured before the generation");
+
+        stages.front().workers  = std::max<size_t>(1, workers);
+        stages.front().capacity = std::max<size_t>(1, capacity);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Add a map stage, transforming each sample
+     * \param function The function transforming a sample
+     * \param workers The number of workers of the stage
+     * \param capacity The number of samples of the output queue of the stage
+     * \return the generator
+     */
+    this_type& map(map_t function, size_t workers = 1, size_t capacity = 2 * batch_size) {
+        return add_stage([f = std::move(function)](sample_type& sample, dll::random_engine& /*g*/) { f(sample); }, false, workers, capacity);
+    }
+
+    /*!
+     * \brief Add an augment stage, transforming each sample with a random
+     * engine in train mode and leaving it untouched in test mode
+     * \param function The function transforming a sample
+     * \param workers The number of workers of the stage
+     * \param capacity The number of samples of the output queue of the stage
+     * \return the generator
+     */
+    this_type& augment(augment_t function, size_t workers = 1, size_t capacity = 2 * batch_size) {
+        return add_stage(std::move(function), true, workers, capacity);
+    }
+
+    /*!
+     * \brief Set the number of workers of the batch stage
+     * \return the generator
+     */
+    this_type& batch(size_t workers) {
+        cpp_assert(!started, "The stages must be configured before the generation");
+
+        batch_workers = std::max<size_t>(1, workers);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Set the number of ready batches of the prefetch stage
+     * \return the generator
+     */
+    this_type& prefetch(size_t batches) {
+        cpp_assert(!started, "The stages must be configured before the generation");
+
+        prefetch_depth = std::max<size_t>(1, batches);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Pipeline Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "            Source: " << stages.front().workers << " workers, " << stages.front().capacity << " samples" << std::endl;
+
+        for (size_t s = 1; s < stages.size(); ++s) {
+            stream << (stages[s].augment ? "           Augment: " : "               Map: ") << stages[s].workers << " workers, " << stages[s].capacity
+                   << " samples" << std::endl;
+        }
+
+        stream << "             Batch: " << batch_workers << " workers" << std::endl;
+        stream << "          Prefetch: " << prefetch_depth << " batches" << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the samples are read by the source
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        stop();
+
+        std::lock_guard<std::mutex> l(lock);
+
+        free_items.clear();
+        free_batches.clear();
+    }
+
+    /*!
+     * brief Sets the generator in test mode, the augment stages are
+     * disabled from the next reset
+     */
+    void set_test() {
+        train_mode = false;
+    }
+
+    /*!
+     * brief Sets the generator in train mode, the augment stages are
+     * enabled from the next reset
+     */
+    void set_train() {
+        train_mode = true;
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning.
+     *
+     * The stages are restarted and the first batch is waited for.
+     */
+    void reset() {
+        stop();
+        start();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        stop();
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        start();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing to do, the samples are read by the source
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return started && current < batches();
+    }
+
+    /*!
+     * \brief Moves to the next batch, waiting for it to be ready.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (current_batch_ptr) {
+            free_batches.push_back(std::move(current_batch_ptr));
+        }
+
+        ++current;
+
+        pump();
+
+        wait_batch(l);
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        cpp_assert(current_batch_ptr, "The generator must be reset after the configuration of its stages");
+
+        return etl::slice(current_batch_ptr->data, 0, current_batch_ptr->n);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     *
+     * The labels of an auto-encoder are the samples themselves.
+     *
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        cpp_assert(current_batch_ptr, "The generator must be reset after the configuration of its stages");
+
+        return etl::slice(labels(*current_batch_ptr, std::integral_constant<bool, Desc::AutoEncoder>()), 0, current_batch_ptr->n);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief A sample in the pipeline
+     */
+    struct item {
+        sample_type data; ///< The sample
+        T label;          ///< The label of the sample
+    };
+
+    /*!
+     * \brief A batch of the prefetch stage
+     */
+    struct batch_t {
+        data_batch_type data;    ///< The samples
+        label_batch_type labels; ///< The labels
+        size_t n = 0;            ///< The number of samples of the batch
+    };
+
+    /*!
+     * \brief A stage of samples (the source, a map or an augment stage)
+     */
+    struct stage {
+        augment_t function;                      ///< The function of the stage (none for the source)
+        bool augment    = false;                 ///< Indicates if the stage is only active in train mode
+        size_t workers  = 1;                     ///< The maximum number of tasks of the stage
+        size_t capacity = 2 * batch_size;        ///< The capacity of the output queue
+        size_t running  = 0;                     ///< The number of tasks of the stage
+        size_t reserved = 0;                     ///< The number of samples being processed
+        std::deque<std::unique_ptr<item>> queue; ///< The output queue
+    };
+
+    /*!
+     * \brief Add a map or augment stage
+     */
+    this_type& add_stage(augment_t function, bool augment, size_t workers, size_t capacity) {
+        cpp_assert(!started, "The stages must be configured before the generation");
+
+        stages.emplace_back();
+
+        auto& s    = stages.back();
+        s.function = std::move(function);
+        s.augment  = augment;
+        s.workers  = std::max<size_t>(1, workers);
+        s.capacity = std::max<size_t>(1, capacity);
+
+        return *this;
+    }
+
+    /*!
+     * \brief Returns the labels of an auto-encoder
+     */
+    static const data_batch_type& labels(const batch_t& b, std::true_type /*ae*/) {
+        return b.data;
+    }
+
+    /*!
+     * \brief Returns the labels
+     */
+    static const label_batch_type& labels(const batch_t& b, std::false_type /*ae*/) {
+        return b.labels;
+    }
+
+    /*!
+     * \brief Returns the number of samples of the given batch
+     */
+    size_t batch_samples(size_t b) const {
+        return std::min(batch_size, n - b * batch_size);
+    }
+
+    /*!
+     * \brief Returns the capacity of the output queue of the given stage.
+     *
+     * The queue of the last stage holds at least the samples of a batch for
+     * each worker of the batch stage.
+     */
+    size_t capacity(size_t s) const {
+        return s + 1 == stages.size() ? std::max(stages[s].capacity, batch_size * batch_workers) : stages[s].capacity;
+    }
+
+    /*!
+     * \brief Indicates if the given stage has a sample to process and some
+     * space for its result
+     */
+    bool has_work(size_t s) const {
+        const bool input = s == 0 ? next_sample < n : !stages[s - 1].queue.empty();
+
+        return input && stages[s].queue.size() + stages[s].reserved < capacity(s);
+    }
+
+    /*!
+     * \brief Indicates if the batch stage has the samples of a batch and
+     * some space for it
+     */
+    bool batch_has_work() const {
+        return next_assembled < batches() && stages.back().queue.size() >= batch_samples(next_assembled) && ready.size() + ready_reserved < prefetch_depth;
+    }
+
+    /*!
+     * \brief Start the tasks of the stages that have some work, within their
+     * number of workers. The lock must be held.
+     */
+    void pump() {
+        if (stopping) {
+            return;
+        }
+
+        for (size_t s = 0; s < stages.size(); ++s) {
+            while (stages[s].running < stages[s].workers && has_work(s)) {
+                ++stages[s].running;
+                ++tasks;
+
+                dll::scheduler().push([this, s] { run_stage(s); }, task_priority::BACKGROUND);
+            }
+        }
+
+        while (batch_running < batch_workers && batch_has_work()) {
+            ++batch_running;
+            ++tasks;
+
+            dll::scheduler().push([this] { run_batch(); }, task_priority::BACKGROUND);
+        }
+    }
+
+    /*!
+     * \brief Indicates the end of a task. The lock must be held.
+     */
+    void finished() {
+        if (!--tasks) {
+            idle_condition.notify_all();
+        }
+    }
+
+    /*!
+     * \brief The task of a stage of samples
+     */
+    void run_stage(size_t s) {
+        auto& st = stages[s];
+
+        dll::random_engine g(dll::seed() + draws++);
+
+        std::unique_lock<std::mutex> l(lock);
+
+        while (!stopping && has_work(s)) {
+            std::unique_ptr<item> it;
+            size_t index = 0;
+
+            if (s == 0) {
+                index = order[next_sample++];
+
+                if (!free_items.empty()) {
+                    it = std::move(free_items.back());
+                    free_items.pop_back();
+                }
+            } else {
+                it = std::move(stages[s - 1].queue.front());
+                stages[s - 1].queue.pop_front();
+            }
+
+            ++st.reserved;
+
+            // The input has some space for the previous stage
+            pump();
+
+            const bool active = !st.augment || augmenting;
+
+            l.unlock();
+
+            if (s == 0) {
+                if (!it) {
+                    it = std::make_unique<item>(item{pipeline_detail::make_sample<T>(shape, std::make_index_sequence<D>()), T(0)});
+                }
+
+                source_function(index, it->data, it->label);
+
+                pre_transformer<desc>::transform(it->data);
+            } else if (active) {
+                st.function(it->data, g);
+            }
+
+            l.lock();
+
+            --st.reserved;
+            st.queue.push_back(std::move(it));
+
+            pump();
+        }
+
+        --st.running;
+        finished();
+    }
+
+    /*!
+     * \brief The task of the batch stage
+     */
+    void run_batch() {
+        std::vector<std::unique_ptr<item>> items;
+
+        std::unique_lock<std::mutex> l(lock);
+
+        while (!stopping && batch_has_work()) {
+            const size_t m = batch_samples(next_assembled++);
+
+            auto& input = stages.back().queue;
+
+            for (size_t i = 0; i < m; ++i) {
+                items.push_back(std::move(input.front()));
+                input.pop_front();
+            }
+
+            std::unique_ptr<batch_t> b;
+
+            if (!free_batches.empty()) {
+                b = std::move(free_batches.back());
+                free_batches.pop_back();
+            }
+
+            ++ready_reserved;
+
+            pump();
+
+            l.unlock();
+
+            if (!b) {
+                b = std::make_unique<batch_t>();
+
+                b->data = view_detail::make_batch<T>(batch_size, shape, std::make_index_sequence<D>());
+
+                cpp::static_if<Desc::Categorical>([&](auto f) {
+                    f(b->labels) = label_batch_type(batch_size, n_classes);
+                }).else_([&](auto f) {
+                    f(b->labels) = label_batch_type(batch_size);
+                });
+            }
+
+            b->n = m;
+
+            for (size_t i = 0; i < m; ++i) {
+                std::copy(items[i]->data.memory_start(), items[i]->data.memory_end(), b->data.memory_start() + i * sample_size);
+
+                cpp::static_if<Desc::Categorical && !Desc::AutoEncoder>([&](auto f) {
+                    f(b->labels)(i) = T(0);
+                    f(b->labels)(i, size_t(items[i]->label)) = T(1);
+                });
+
+                cpp::static_if<!Desc::Categorical && !Desc::AutoEncoder>([&](auto f) {
+                    f(b->labels)[i] = items[i]->label;
+                });
+            }
+
+            b->data.invalidate_gpu();
+            b->labels.invalidate_gpu();
+
+            l.lock();
+
+            for (auto& it : items) {
+                free_items.push_back(std::move(it));
+            }
+
+            items.clear();
+
+            --ready_reserved;
+            ready.push_back(std::move(b));
+
+            ready_condition.notify_one();
+
+            pump();
+        }
+
+        --batch_running;
+        finished();
+    }
+
+    /*!
+     * \brief Wait for the current batch, if any. The lock must be held.
+     */
+    void wait_batch(std::unique_lock<std::mutex>& l) {
+        if (current >= batches()) {
+            return;
+        }
+
+        ready_condition.wait(l, [this] { return !ready.empty(); });
+
+        current_batch_ptr = std::move(ready.front());
+        ready.pop_front();
+
+        pump();
+    }
+
+    /*!
+     * \brief Start the generation from the first sample and wait for the
+     * first batch
+     */
+    void start() {
+        cpp_assert(source_function, "The pipeline generator needs a source");
+
+        std::unique_lock<std::mutex> l(lock);
+
+        stopping   = false;
+        started    = true;
+        augmenting = train_mode;
+
+        next_sample    = 0;
+        next_assembled = 0;
+        current        = 0;
+
+        pump();
+
+        wait_batch(l);
+    }
+
+    /*!
+     * \brief Stop the generation and wait for the end of the tasks, the
+     * samples and batches being kept for the next generation
+     */
+    void stop() {
+        std::unique_lock<std::mutex> l(lock);
+
+        stopping = true;
+
+        idle_condition.wait(l, [this] { return tasks == 0; });
+
+        for (auto& s : stages) {
+            for (auto& it : s.queue) {
+                free_items.push_back(std::move(it));
+            }
+
+            s.queue.clear();
+        }
+
+        for (auto& b : ready) {
+            free_batches.push_back(std::move(b));
+        }
+
+        ready.clear();
+
+        if (current_batch_ptr) {
+            free_batches.push_back(std::move(current_batch_ptr));
+        }
+    }
+
+    const size_t n;                    ///< The number of samples
+    const std::array<size_t, D> shape; ///< The shape of one sample
+    const size_t n_classes;            ///< The number of classes
+    size_t sample_size = 0;            ///< The number of values of one sample
+
+    source_t source_function;  ///< The function reading the samples
+    std::vector<stage> stages; ///< The stages of samples, the source first
+    size_t batch_workers  = 1; ///< The maximum number of tasks of the batch stage
+    size_t prefetch_depth = 2; ///< The maximum number of ready batches
+    std::vector<size_t> order; ///< The order of the samples
+
+    std::mutex lock;                            ///< The lock of the queues and of the counters
+    std::condition_variable ready_condition;    ///< Signals a ready batch
+    std::condition_variable idle_condition;     ///< Signals the end of the last task
+    std::deque<std::unique_ptr<batch_t>> ready; ///< The ready batches
+    std::unique_ptr<batch_t> current_batch_ptr; ///< The current batch
+
+    std::vector<std::unique_ptr<item>> free_items;      ///< The samples to reuse
+    std::vector<std::unique_ptr<batch_t>> free_batches; ///< The batches to reuse
+
+    size_t next_sample    = 0; ///< The next sample to read by the source
+    size_t next_assembled = 0; ///< The next batch to assemble
+    size_t ready_reserved = 0; ///< The number of batches being assembled
+    size_t batch_running  = 0; ///< The number of tasks of the batch stage
+    size_t tasks          = 0; ///< The number of tasks of all the stages
+    size_t current        = 0; ///< The index of the current batch
+
+    bool stopping   = false; ///< Indicates that the tasks must stop
+    bool started    = false; ///< Indicates if the generation has been started once
+    bool augmenting = true;  ///< Indicates if the augment stages are active in the current generation
+
+    std::atomic<bool> train_mode{true}; ///< Indicates if the generator is in train mode
+    std::atomic<size_t> draws{0};       ///< The number of random engines created by the tasks
+};
+
+/*!
+ * \brief Make a pipeline generator of n samples of the given shape, the
+ * source and the other stages must then be set
+ */
+template <typename T, size_t D, typename Desc>
+auto make_pipeline_generator(size_t n, const std::array<size_t, D>& shape, size_t n_classes, const Desc& /*desc*/) {
+    return std::make_unique<pipeline_data_generator<T, D, Desc>>(n, shape, n_classes);
+}
+
+/*!
+ * \brief Make a pipeline generator from a container of samples and a
+ * container of labels, the source copying the samples and the labels.
+ *
+ * The containers are not copied, they must outlive the generator.
+ */
+template <typename Container, typename LContainer, typename Desc>
+auto make_pipeline_generator(const Container& container, const LContainer& lcontainer, size_t n_classes, const Desc& desc, size_t workers = 1) {
+    using traits = view_detail::sample_traits<typename Container::value_type>;
+    using T      = typename traits::value_type;
+
+    cpp_assert(container.size(), "The pipeline generator needs at least one sample");
+
+    auto generator = make_pipeline_generator<T>(container.size(), traits::shape(*container.begin()), n_classes, desc);
+
+    auto first  = container.begin();
+    auto lfirst = lcontainer.begin();
+
+    generator->source([first, lfirst](size_t i, auto& sample, T& label) {
+        const auto& input = *std::next(first, i);
+
+        std::copy(traits::memory(input), traits::memory(input) + etl::size(sample), sample.memory_start());
+
+        cpp::static_if<!Desc::AutoEncoder>([&](auto f) {
+            f(label) = T(*std::next(lfirst, i));
+        });
+    }, workers);
+
+    return generator;
+}
+
+} //end of dll namespace
@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <cmath>
 #include <atomic>
 #include <thread>
 
 #include "cpp_utils/data.hpp"
 
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 
 /*!
@@ -128,4 +131,106 @@ struct pre_normalizer <Desc, std::enable_if_t<!Desc::NormalizePre>> {
     }
 };
 
+/*!
+ * \brief The pre-transformations of the descriptor (scaling, normalization
+ * and binarization) fused in a single pass over the values.
+ *
+ * The inputs are normalized with their mean and standard deviation
+ * computed in a single pass (Welford). Since the normalization cancels
+ * the scaling, the scaling is only applied to the inputs that are not
+ * normalized. The result is the same as applying pre_scaler,
+ * pre_normalizer and pre_binarizer in order, except for the constant
+ * inputs that are normalized to zero instead of NaN.
+ */
+template <typename Desc>
+struct pre_transformer {
+    static constexpr size_t S = Desc::ScalePre;     ///< The scaling factor
+    static constexpr size_t B = Desc::BinarizePre;  ///< The binarization threshold
+    static constexpr bool N   = Desc::NormalizePre; ///< Indicates if the inputs are normalized
+
+    static constexpr bool enabled = S || B || N;              ///< Indicates if any pre-transformation is enabled
+    static constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of values of a batch to be transformed in parallel
+
+    /*!
+     * \brief Apply the transforms on the n values
+     */
+    template <typename T>
+    static void transform(T* x, size_t n) {
+        if (!enabled || !n) {
+            return;
+        }
+
+        T shift = T(0);
+        T scale = S ? T(1) / T(S) : T(1);
+
+        if (N) {
+            // Single-pass mean and variance
+            double mean = 0.0;
+            double m2   = 0.0;
+
+            for (size_t i = 0; i < n; ++i) {
+                const double delta = x[i] - mean;
+                mean += delta / double(i + 1);
+                m2 += delta * (x[i] - mean);
+            }
+
+            const double stddev = std::sqrt(m2 / double(n));
+
+            shift = T(mean);
+            scale = stddev > 0.0 ? T(1.0 / stddev) : T(0);
+        }
+
+        if (B) {
+            for (size_t i = 0; i < n; ++i) {
+                x[i] = (x[i] - shift) * scale > T(B) ? T(1) : T(0);
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                x[i] = (x[i] - shift) * scale;
+            }
+        }
+    }
+
+    /*!
+     * \brief Apply the transforms on the input
+     * \param target The input to transform
+     */
+    template <typename O>
+    static void transform(O&& target) {
+        if (enabled) {
+            transform(target.memory_start(), etl::size(target));
+        }
+    }
+
+    /*!
+     * \brief Apply the transforms on each of the first n samples of the
+     * batch, in parallel if the batch is large enough
+     *
+     * \param batch The batch to transform
+     * \param n The number of samples to transform
+     */
+    template <typename O>
+    static void transform_batch(O&& batch, size_t n) {
+        if (!enabled || !n) {
+            return;
+        }
+
+        const size_t sample = etl::size(batch) / etl::dim<0>(batch);
+
+        auto* x = batch.memory_start();
+
+        auto functor = [x, sample](size_t i) {
+            transform(x + i * sample, sample);
+        };
+
+        if (n * sample >= parallel_threshold && n > 1) {
+            parallel_for_n(n, functor);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                functor(i);
+            }
+        }
+    }
+};
+
 } //end of dll namespace
@@ -0,0 +1,506 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator viewing the storage of the user.
+ *
+ * Contrary to the in-memory data generator, the samples are not copied in
+ * a cache covering the whole dataset. The generator only keeps a pointer
+ * to the contiguous memory of each sample and gathers the samples of the
+ * current batch, applying the pre-transforms, in a buffer of one batch.
+ * The shuffle permutes the indices of the samples, the storage of the user
+ * is never modified and must outlive the generator.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <numeric>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+namespace dll {
+
+namespace view_detail {
+
+/*!
+ * \brief Traits to access the contiguous memory of one sample
+ */
+template <typename V, typename Enable = void>
+struct sample_traits {
+    static constexpr bool viewable = false; ///< Indicates if the sample can be viewed
+};
+
+/*!
+ * \copydoc sample_traits
+ *
+ * The rows of a std::vector are viewed as 1D samples.
+ */
+template <typename T, typename A>
+struct sample_traits<std::vector<T, A>, std::enable_if_t<std::is_arithmetic<T>::value>> {
+    static constexpr bool viewable = true; ///< Indicates if the sample can be viewed
+    static constexpr size_t D      = 1;    ///< The number of dimensions of the sample
+
+    using value_type = T; ///< The type of the values
+
+    static const T* memory(const std::vector<T, A>& sample) {
+        return sample.data();
+    }
+
+    static std::array<size_t, D> shape(const std::vector<T, A>& sample) {
+        return {{sample.size()}};
+    }
+};
+
+/*!
+ * \copydoc sample_traits
+ *
+ * The ETL containers with direct memory access are viewed with their
+ * dimensions.
+ */
+template <typename V>
+struct sample_traits<V, std::enable_if_t<etl::is_etl_expr<V> && etl::is_dma<V>>> {
+    static constexpr bool viewable = true;                  ///< Indicates if the sample can be viewed
+    static constexpr size_t D      = etl::dimensions<V>(); ///< The number of dimensions of the sample
+
+    using value_type = etl::value_t<V>; ///< The type of the values
+
+    static const value_type* memory(const V& sample) {
+        return sample.memory_start();
+    }
+
+    static std::array<size_t, D> shape(const V& sample) {
+        std::array<size_t, D> dims;
+
+        for (size_t d = 0; d < D; ++d) {
+            dims[d] = etl::dim(sample, d);
+        }
+
+        return dims;
+    }
+};
+
+/*!
+ * \brief Traits to test if the container of samples can be viewed by a
+ * generator
+ */
+template <typename Container, typename = int>
+struct is_viewable_impl : std::false_type {};
+
+/*!
+ * \copydoc is_viewable_impl
+ */
+template <typename Container>
+struct is_viewable_impl<Container, decltype((void)std::declval<const Container&>().begin(), 0)>
+        : std::integral_constant<bool, sample_traits<typename Container::value_type>::viewable> {};
+
+/*!
+ * \brief Indicates if the container of samples can be viewed by a
+ * generator.
+ */
+template <typename Container>
+constexpr bool is_viewable = is_viewable_impl<Container>::value;
+
+/*!
+ * \brief Traits to test if the container of labels can be accessed directly
+ * by a generator (random access to class indices or flat values)
+ */
+template <typename LContainer, typename = int>
+struct is_label_viewable_impl : std::false_type {};
+
+/*!
+ * \copydoc is_label_viewable_impl
+ */
+template <typename LContainer>
+struct is_label_viewable_impl<LContainer, decltype((void)std::declval<const LContainer&>().begin(), 0)>
+        : std::integral_constant<bool,
+                                 std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<typename LContainer::const_iterator>::iterator_category>::value
+                              && std::is_arithmetic<typename LContainer::value_type>::value> {};
+
+/*!
+ * \brief Indicates if the container of labels can be accessed directly by
+ * a generator.
+ */
+template <typename LContainer>
+constexpr bool is_label_viewable = is_label_viewable_impl<LContainer>::value;
+
+/*!
+ * \brief Create a batch of n samples of the given shape
+ */
+template <typename T, size_t D, size_t... I>
+etl::dyn_matrix<T, D + 1> make_batch(size_t n, const std::array<size_t, D>& shape, std::index_sequence<I...> /*seq*/) {
+    return etl::dyn_matrix<T, D + 1>(n, shape[I]...);
+}
+
+} //end of namespace view_detail
+
+/*!
+ * \brief A data generator viewing the storage of the user
+ *
+ * \tparam T The type of the values of the samples
+ * \tparam D The number of dimensions of one sample
+ * \tparam LIterator The random access iterator to the labels
+ */
+template <typename T, size_t D, typename LIterator, typename Desc>
+struct view_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    using data_batch_type  = etl::dyn_matrix<T, D + 1>;                     ///< The type of the gathered batch
+    using label_batch_type = etl::dyn_matrix<T, Desc::Categorical ? 2 : 1>; ///< The type of the gathered labels
+
+    static constexpr bool dll_generator      = true;  ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool background_batches = false; ///< Indicates if the batches are prepared in the background by the generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    static_assert(!is_augmented<Desc> && !is_compact_cache<Desc> && !is_index_shuffle<Desc>,
+                  "The view generator does not support augmentation nor compact caches");
+    static_assert(!(Desc::GaussianNoise || Desc::MaskingNoise || Desc::SaltPepperNoise),
+                  "The view generator does not support the noise of the batches");
+
+    /*!
+     * \brief Construct a view generator
+     * \param samples The pointers to the memory of each sample
+     * \param shape The shape of one sample
+     * \param lfirst Iterator to the first label (unused for an auto-encoder)
+     * \param n_classes The number of classes
+     */
+    view_data_generator(std::vector<const T*> samples, const std::array<size_t, D>& shape, LIterator lfirst, size_t n_classes)
+            : samples(std::move(samples)), lfirst(lfirst) {
+        sample_size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+
+        order.resize(this->samples.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        data_buffer = view_detail::make_batch<T>(batch_size, shape, std::make_index_sequence<D>());
+
+        cpp::static_if<Desc::Categorical>([&](auto f) {
+            f(label_buffer) = label_batch_type(batch_size, n_classes);
+        }).else_([&](auto f) {
+            f(label_buffer) = label_batch_type(batch_size);
+        });
+
+        if (is_standardized<Desc>) {
+            const auto& s = this->samples;
+
+            stats.compute(s.size(), sample_size, Desc::ChannelStandardizePre ? shape[0] : 0, [&s](size_t i) { return s[i]; });
+        }
+    }
+
+    view_data_generator(const view_data_generator& rhs) = delete;
+    view_data_generator operator=(const view_data_generator& rhs) = delete;
+
+    view_data_generator(view_data_generator&& rhs) = delete;
+    view_data_generator operator=(view_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "View Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the generator does not own the samples
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the generator does not own the samples
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current  = 0;
+        gathered = false;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        reset();
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::random_engine());
+
+        gathered = false;
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing to do, the batches are gathered on demand
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return samples.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+        gathered = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        gather();
+
+        return etl::slice(data_buffer, 0, std::min(batch_size, size() - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     *
+     * The labels of an auto-encoder are the gathered samples themselves.
+     *
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        gather();
+
+        return etl::slice(labels(std::integral_constant<bool, Desc::AutoEncoder>()), 0, std::min(batch_size, size() - current));
+    }
+
+    /*!
+     * \brief Returns the statistics of the standardization of the inputs,
+     * to be stored with the model
+     */
+    const dll::standardization<T>& input_standardization() const {
+        return stats;
+    }
+
+    /*!
+     * \brief Standardize the inputs with the given statistics, computed on
+     * another dataset (the training set for a test generator)
+     */
+    void set_input_standardization(const dll::standardization<T>& statistics) {
+        cpp_assert(statistics.sample_size() == sample_size, "Invalid size of the statistics");
+
+        stats    = statistics;
+        gathered = false;
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Returns the buffer of the labels of an auto-encoder
+     */
+    const data_batch_type& labels(std::true_type /*ae*/) const {
+        return data_buffer;
+    }
+
+    /*!
+     * \brief Returns the buffer of the labels
+     */
+    const label_batch_type& labels(std::false_type /*ae*/) const {
+        return label_buffer;
+    }
+
+    /*!
+     * \brief Gather the samples, and the labels, of the current batch in the
+     * buffers, if not already done
+     */
+    void gather() const {
+        if (gathered) {
+            return;
+        }
+
+        const size_t n = std::min(batch_size, size() - current);
+
+        for (size_t b = 0; b < n; ++b) {
+            const size_t i = order[current + b];
+
+            // The standardization is done during the copy
+            if (is_standardized<Desc>) {
+                stats.apply(data_buffer.memory_start() + b * sample_size, samples[i]);
+            } else {
+                std::copy(samples[i], samples[i] + sample_size, data_buffer.memory_start() + b * sample_size);
+            }
+
+            pre_transformer<desc>::transform(data_buffer(b));
+
+            cpp::static_if<Desc::Categorical && !Desc::AutoEncoder>([&](auto f) {
+                f(label_buffer)(b) = T(0);
+                f(label_buffer)(b, *(f(lfirst) + i)) = T(1);
+            });
+
+            cpp::static_if<!Desc::Categorical && !Desc::AutoEncoder>([&](auto f) {
+                f(label_buffer)[b] = *(f(lfirst) + i);
+            });
+        }
+
+        data_buffer.invalidate_gpu();
+        label_buffer.invalidate_gpu();
+
+        gathered = true;
+    }
+
+    const std::vector<const T*> samples; ///< The memory of each sample
+    std::vector<size_t> order;           ///< The order of the samples
+    LIterator lfirst;                    ///< The first label
+    size_t sample_size = 0;              ///< The number of values of one sample
+    dll::standardization<T> stats;       ///< The statistics of the standardization (standardize_pre only)
+
+    mutable data_batch_type data_buffer;   ///< The gathered samples of the current batch
+    mutable label_batch_type label_buffer; ///< The gathered labels of the current batch
+    mutable bool gathered = false;         ///< Indicates if the current batch has been gathered
+
+    size_t current = 0; ///< The current index
+};
+
+/*!
+ * \brief Make a view generator from a container of samples and a
+ * container of labels.
+ *
+ * The samples (std::vector rows or ETL containers) are not copied, the
+ * containers must outlive the generator.
+ */
+template <typename Container, typename LContainer, typename Desc>
+auto make_view_generator(const Container& container, const LContainer& lcontainer, size_t n_classes, const Desc& /*desc*/) {
+    using traits      = view_detail::sample_traits<typename Container::value_type>;
+    using T           = typename traits::value_type;
+    using generator_t = view_data_generator<T, traits::D, typename LContainer::const_iterator, Desc>;
+
+    cpp_assert(container.size(), "The view generator needs at least one sample");
+
+    const auto shape = traits::shape(*container.begin());
+
+    std::vector<const T*> samples;
+    samples.reserve(container.size());
+
+    for (auto& sample : container) {
+        cpp_assert(traits::shape(sample) == shape, "All the samples of a view generator must have the same shape");
+
+        samples.push_back(traits::memory(sample));
+    }
+
+    return std::make_unique<generator_t>(std::move(samples), shape, lcontainer.begin(), n_classes);
+}
+
+/*!
+ * \brief Make a view generator from raw contiguous storage of n samples of
+ * the given shape, and a random access iterator to the labels.
+ *
+ * The storage is not copied, it must outlive the generator.
+ */
+template <typename T, size_t D, typename LIterator, typename Desc>
+auto make_view_generator(const T* data, size_t n, const std::array<size_t, D>& shape, LIterator lfirst, size_t n_classes, const Desc& /*desc*/) {
+    using generator_t = view_data_generator<T, D, LIterator, Desc>;
+
+    const size_t sample_size = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+
+    std::vector<const T*> samples(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        samples[i] = data + i * sample_size;
+    }
+
+    return std::make_unique<generator_t>(std::move(samples), shape, lfirst, n_classes);
+}
+
+} //end of dll namespace
@@ -22,6 +22,48 @@ struct sgd_trainer;
 template <typename DBN>
 using default_dbn_trainer_t = sgd_trainer<DBN>;
 
+namespace detail {
+
+template <bool Labels, typename... Layers>
+struct layers;
+
+/*!
+ * \brief Gives the inference version of a layer, the layer itself if its
+ * descriptor does not have one
+ */
+template <typename Layer, typename Enable = void>
+struct inference_layer {
+    using type = Layer; ///< The inference layer type
+};
+
+/*!
+ * \brief Gives the inference version of a layer whose descriptor has an
+ * inference layer type
+ */
+template <typename Layer>
+struct inference_layer<Layer, std::enable_if_t<std::is_class<typename Layer::desc::inference_layer_t>::value>> {
+    using type = typename Layer::desc::inference_layer_t; ///< The inference layer type
+};
+
+/*!
+ * \brief Replace the layers by their inference version, if Inference is
+ * set
+ */
+template <bool Inference, typename Layers>
+struct inference_layers {
+    using type = Layers; ///< The layers type
+};
+
+/*!
+ * \copydoc inference_layers
+ */
+template <bool Labels, typename... Layers>
+struct inference_layers<true, layers<Labels, Layers...>> {
+    using type = layers<Labels, typename inference_layer<Layers>::type...>; ///< The layers type
+};
+
+} //end of namespace detail
+
 /*!
  * \brief Describe a DBN *
  *
@@ -30,14 +72,20 @@ using default_dbn_trainer_t = sgd_trainer<DBN>;
  */
 template <template <typename> class DBN_T, typename Layers, typename... Parameters>
 struct generic_dbn_desc {
-    using layers      = Layers; ///< The network layers
-    using base_layers = Layers; ///< The network layers before transformation
-
     /*!
      * \brief A list of all the parameters of the descriptor
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    /*!
+     * \brief Indicates if the network is only used for inference, its
+     * layers being replaced by their inference version
+     */
+    static constexpr bool InferenceOnly = parameters::template contains<inference_only>();
+
+    using layers      = typename detail::inference_layers<InferenceOnly, Layers>::type; ///< The network layers
+    using base_layers = layers;                                                          ///< The network layers before transformation
+
     /*!
      * \brief The batch size for training this layer
      */
@@ -73,11 +121,31 @@ struct generic_dbn_desc {
      */
     static constexpr auto Updater = detail::get_value_v<updater<updater_type::SGD>, Parameters...>;
 
+    /*!
+     * \brief The compression of the gradients for distributed training
+     */
+    static constexpr auto Compression = detail::get_value_v<gradient_compression<compression_type::NONE>, Parameters...>;
+
     /*!
      * \brief The type of strategy for early stopping
      */
     static constexpr auto Early = detail::get_value_v<early_stopping<strategy::ERROR_GOAL>, Parameters...>;
 
+    /*!
+     * \brief The number of threads used for data-parallel fine-tuning
+     */
+    static constexpr size_t DataParallel = detail::get_value_v<data_parallel<1>, Parameters...>;
+
+    /*!
+     * \brief The number of pipeline stages of the fine-tuning
+     */
+    static constexpr size_t PipelineParallel = detail::get_value_v<pipeline_parallel<1>, Parameters...>;
+
+    /*!
+     * \brief The number of batches between two computations of the metrics of the batches
+     */
+    static constexpr size_t BatchMetricsPeriod = detail::get_value_v<batch_metrics_period<1>, Parameters...>;
+
     /*! The type of the trainer to use to train the DBN */
     template <typename DBN>
     using trainer_t = typename detail::get_template_type<trainer<default_dbn_trainer_t>, Parameters...>::template value<DBN>;
@@ -99,6 +167,13 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(DataParallel > 0, "Data parallel needs at least one thread");
+    static_assert(BatchMetricsPeriod > 0, "The period of the batch metrics must be at least 1");
+    static_assert(BatchSize % DataParallel == 0, "The batch size must be divisible by the number of data parallel threads");
+    static_assert(PipelineParallel > 0, "Pipeline parallel needs at least one stage");
+    static_assert(PipelineParallel == 1 || DataParallel > 1, "Pipeline parallel needs data_parallel micro-batches");
+    static_assert(PipelineParallel <= Layers::size, "Pipeline parallel needs at least one layer per stage");
+    static_assert(!parameters::template contains<pretrain_cache>() || parameters::template contains<batch_mode>(), "pretrain_cache is only useful in batch mode");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
@@ -106,8 +181,8 @@ struct generic_dbn_desc {
             cpp::type_list<
                 trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id,
                 batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
-                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id>,
+                normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, updater_id, gradient_compression_id,
+                early_stopping_id, early_training_id, clip_gradients_id, data_parallel_id, pipeline_parallel_id, batch_metrics_period_id, parallel_evaluation_id, async_validation_id, pretrain_cache_id, gradient_checkpointing_id, inference_only_id>,
             Parameters...>,
         "Invalid parameters type");
 };
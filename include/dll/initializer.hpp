@@ -6,9 +6,15 @@
 //=======================================================================
 
 #include "dll/util/random.hpp"
+#include "dll/util/counter_rng.hpp"
 
 /*!
  * \brief Initialization methods
+ *
+ * The random initializers fill the weights with counter-based random
+ * numbers (see counter_rng.hpp): large layers are filled in parallel and
+ * the weights only depend on the seed and on the order of construction of
+ * the layers, not on the number of threads.
  */
 
 #pragma once
@@ -77,7 +83,7 @@ struct init_normal {
         constexpr auto mean   = etl::value_t<B>(Mean::num) / etl::value_t<B>(Mean::den);
         constexpr auto stddev = etl::value_t<B>(Std::num) / etl::value_t<B>(Std::den);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), mean, stddev);
+        fill_normal(b, mean, stddev);
     }
 };
 
@@ -98,10 +104,10 @@ struct init_uniform {
         cpp_unused(nin);
         cpp_unused(nout);
 
-        constexpr auto a = etl::value_t<B>(A::num) / etl::value_t<B>(A::den);
-        constexpr auto b = etl::value_t<B>(B::num) / etl::value_t<B>(B::den);
+        constexpr auto a = etl::value_t<W>(A::num) / etl::value_t<W>(A::den);
+        constexpr auto b = etl::value_t<W>(B::num) / etl::value_t<W>(B::den);
 
-        w = etl::uniform_generator<etl::value_t<B>>(dll::rand_engine(), a, b);
+        fill_uniform(w, a, b);
     }
 };
 
@@ -122,7 +128,7 @@ struct init_lecun {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) / sqrt(double(nin));
+        fill_normal(b, 0.0, 1.0 / sqrt(double(nin)));
     }
 };
 
@@ -141,7 +147,7 @@ struct init_xavier {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(1.0 / nin);
+        fill_normal(b, 0.0, sqrt(1.0 / nin));
     }
 };
 
@@ -158,7 +164,7 @@ struct init_xavier_full {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / (nin + nout));
+        fill_normal(b, 0.0, sqrt(2.0 / (nin + nout)));
     }
 };
 
@@ -177,7 +183,7 @@ struct init_he {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / nin);
+        fill_normal(b, 0.0, sqrt(2.0 / nin));
     }
 };
 
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <memory>
+#include <utility>
 
 #include "etl/etl.hpp" // Every layer needs ETL
 
@@ -29,6 +30,26 @@ T& unique_safe_get(std::unique_ptr<T>& ptr) {
     return *ptr;
 }
 
+/*!
+ * \brief Save the given value into its backup, swapping their storages
+ * when the value is dynamic and the backup has the same size.
+ *
+ * The storage of fast matrices cannot be swapped, they are copied. After
+ * a swap, the value holds the previous backup.
+ *
+ * \param value The value to save
+ * \param backup The backup of the value
+ */
+template <typename T>
+void swap_backup(T& value, std::unique_ptr<T>& backup) {
+    if (etl::decay_traits<T>::is_fast || !backup || etl::size(*backup) != etl::size(value)) {
+        unique_safe_get(backup) = value;
+    } else {
+        using std::swap;
+        swap(value, *backup);
+    }
+}
+
 /*!
  * \brief A layer in a neural network
  */
@@ -356,6 +377,20 @@ struct layer {
         test_forward_batch(output, input);
     }
 
+    /*!
+     * \brief Compute the train presentation of the batch of inputs of the
+     * given SGD context into its batch of outputs.
+     *
+     * The layers that need to keep some state of the forward pass for the
+     * backpropagation store it in their context.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) {
+        as_derived().train_forward_batch(context.output, context.input);
+    }
+
     // Prepare function
 
     template <typename Input>
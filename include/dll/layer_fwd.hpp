@@ -29,12 +29,24 @@ struct conv_rbm_mp_impl;
 template <typename Desc>
 struct dyn_conv_rbm_mp_impl;
 
+template <typename Desc>
+struct mp_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_mp_2d_layer_impl;
+
 template <typename Desc>
 struct mp_3d_layer_impl;
 
 template <typename Desc>
 struct dyn_mp_3d_layer_impl;
 
+template <typename Desc>
+struct avgp_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_avgp_2d_layer_impl;
+
 template <typename Desc>
 struct avgp_3d_layer_impl;
 
@@ -74,12 +86,27 @@ struct dense_layer_impl;
 template <typename Desc>
 struct dyn_dense_layer_impl;
 
+template <typename Desc>
+struct tied_dense_layer_impl;
+
+template <typename Desc>
+struct dyn_tied_dense_layer_impl;
+
 template <typename Desc>
 struct conv_layer_impl;
 
 template <typename Desc>
 struct dyn_conv_layer_impl;
 
+template <typename Desc>
+struct depthwise_conv_layer_impl;
+
+template <typename Desc>
+struct dyn_depthwise_conv_layer_impl;
+
+template <typename Desc>
+struct conv_mp_layer_impl;
+
 template <typename Desc>
 struct deconv_layer_impl;
 
@@ -89,4 +116,19 @@ struct dyn_deconv_layer_impl;
 template <typename Desc>
 struct activation_layer_impl;
 
+template <typename Desc>
+struct dropout_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_4d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_4d_layer_impl;
+
 } //end of dll namespace
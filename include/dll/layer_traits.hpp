@@ -179,6 +179,23 @@ struct rbm_layer_traits {
         return base_traits::is_verbose;
     }
 
+    /*!
+     * \brief Indicates if the RBM is trained with several threads
+     * updating the weights without locking.
+     */
+    static constexpr bool is_hogwild() {
+        return base_traits::is_hogwild;
+    }
+
+    /*!
+     * \brief Return the number of batches between two synchronizations
+     * with the parameter server, 0 if the RBM is not pretrained with a
+     * parameter server.
+     */
+    static constexpr size_t parameter_server_period() {
+        return base_traits::ps_period;
+    }
+
     /*!
      * \brief Indicates if the RBM must be trained with shuffle or not
      */
@@ -239,6 +256,30 @@ struct rbm_layer_traits {
 template <typename T>
 using decay_layer_traits = layer_traits<std::decay_t<T>>;
 
+/*!
+ * \brief Indicates if the layer Tied uses the transposed weights of the
+ * layer Layer (tied autoencoders)
+ */
+template <typename Tied, typename Layer>
+struct is_tied_layer : std::false_type {};
+
+/*!
+ * \brief The fusion of the layer First with the layer Second that follows
+ * it in a network.
+ *
+ * When test (respectively train) is true, the fusion computes the test
+ * (respectively train) representation of Second from the input batch of
+ * First with its static test_forward_batch(first, second, input)
+ * (respectively train_forward_batch) function and the networks use it
+ * instead of the two layers. The layers opt in by specializing it (see
+ * dll/fusion.hpp).
+ */
+template <typename First, typename Second, typename Enable = void>
+struct layer_fusion {
+    static constexpr bool test  = false; ///< Indicates if the test representation is fused
+    static constexpr bool train = false; ///< Indicates if the train representation is fused
+};
+
 /*!
  * \brief Return the number of input channels of the given CRBM
  */
@@ -0,0 +1,320 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Linear classifiers trained on the features of a network.
+ *
+ * The classifiers are trained on a dense matrix of features, one row per
+ * sample, in the manner of liblinear:
+ *  - L2-regularized L2-loss linear SVM, one-vs-rest, solved by dual
+ *    coordinate descent (Hsieh et al., 2008), the classes being trained
+ *    in parallel.
+ *  - L2-regularized multinomial logistic regression, trained by batched
+ *    gradient descent, the gradient of each batch being computed with
+ *    matrix multiplications.
+ *
+ * Both give one weight vector and one bias per class and predict the
+ * class with the maximum score.
+ */
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "etl/etl.hpp"
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/random.hpp"
+#include "dll/util/affinity.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The type of linear classifier
+ */
+enum class linear_type {
+    SVM,     ///< L2-regularized L2-loss SVM (dual coordinate descent)
+    LOGISTIC ///< L2-regularized logistic regression (batched gradient descent)
+};
+
+/*!
+ * \brief The parameters of the training of a linear classifier
+ */
+struct linear_parameters {
+    linear_type type      = linear_type::SVM; ///< The type of classifier
+    double C              = 1.0;              ///< The cost of the errors (the inverse of the regularization)
+    double eps            = 0.1;              ///< The tolerance of the stopping criterion (SVM)
+    size_t max_iterations = 1000;             ///< The maximum number of passes over the samples (SVM)
+    size_t epochs         = 50;               ///< The number of passes over the samples (logistic regression)
+    double learning_rate  = 0.1;              ///< The learning rate (logistic regression)
+    size_t batch_size     = 256;              ///< The number of samples of a batch (logistic regression)
+};
+
+/*!
+ * \brief A trained linear classifier, the score of the class c is w(c) * x + b[c]
+ */
+struct linear_model {
+    etl::dyn_matrix<double, 2> w; ///< The weights (classes x features)
+    std::vector<double> b;        ///< The bias of each class
+    std::vector<double> labels;   ///< The label of each class
+
+    /*!
+     * \brief Return the number of classes
+     */
+    size_t classes() const {
+        return labels.size();
+    }
+
+    /*!
+     * \brief Return the number of features
+     */
+    size_t features() const {
+        return etl::dim<1>(w);
+    }
+};
+
+namespace linear_detail {
+
+/*!
+ * \brief Return the dot product of the weights and of one sample
+ */
+template <typename T>
+double dot(const double* w, const T* x, size_t F) {
+    double sum = 0.0;
+
+    for (size_t f = 0; f < F; ++f) {
+        sum += w[f] * x[f];
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Train the one-vs-rest SVM of one class by dual coordinate
+ * descent, the bias being a constant feature of the samples
+ * \param x The samples (n x F), row-major
+ * \param classes The class of each sample
+ * \param c The class to train
+ * \param n The number of samples
+ * \param F The number of features
+ * \param qd The squared norms of the samples, with the bias
+ * \param p The parameters
+ * \param w The output weights of the class
+ * \param b The output bias of the class
+ */
+template <typename T>
+void train_svm_class(const T* x, const std::vector<size_t>& classes, size_t c, size_t n, size_t F,
+                     const std::vector<double>& qd, const linear_parameters& p, double* w, double& b) {
+    // The diagonal of the L2-loss
+    const double d = 0.5 / p.C;
+
+    std::vector<double> alpha(n, 0.0);
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::mt19937_64 engine(dll::seed() + c);
+
+    std::fill(w, w + F, 0.0);
+    b = 0.0;
+
+    for (size_t it = 0; it < p.max_iterations; ++it) {
+        std::shuffle(order.begin(), order.end(), engine);
+
+        double pg_max = -std::numeric_limits<double>::infinity();
+        double pg_min = std::numeric_limits<double>::infinity();
+
+        for (auto i : order) {
+            const T* xi    = x + i * F;
+            const double y = classes[i] == c ? 1.0 : -1.0;
+
+            const double g = y * (dot(w, xi, F) + b) - 1.0 + d * alpha[i];
+
+            // The gradient projected on the bound alpha >= 0
+            const double pg = alpha[i] == 0.0 ? std::min(g, 0.0) : g;
+
+            pg_max = std::max(pg_max, pg);
+            pg_min = std::min(pg_min, pg);
+
+            if (std::abs(pg) > 1e-12) {
+                const double old = alpha[i];
+
+                alpha[i] = std::max(alpha[i] - g / (qd[i] + d), 0.0);
+
+                const double delta = (alpha[i] - old) * y;
+
+                for (size_t f = 0; f < F; ++f) {
+                    w[f] += delta * xi[f];
+                }
+
+                b += delta;
+            }
+        }
+
+        if (pg_max - pg_min <= p.eps) {
+            break;
+        }
+    }
+}
+
+/*!
+ * \brief Train the one-vs-rest SVMs of all the classes, in parallel
+ */
+template <typename Pool, typename T>
+void train_svm(Pool& pool, const T* x, const std::vector<size_t>& classes, size_t n, size_t F, const linear_parameters& p, linear_model& model) {
+    const size_t K = model.classes();
+
+    // The squared norms of the samples, the bias is a feature of value 1
+    std::vector<double> qd(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        qd[i] = 1.0;
+
+        for (size_t f = 0; f < F; ++f) {
+            qd[i] += double(x[i * F + f]) * x[i * F + f];
+        }
+    }
+
+    cpp::maybe_parallel_foreach_n(pool, 0, K, [&](size_t c) {
+        pin_pool_thread();
+
+        train_svm_class(x, classes, c, n, F, qd, p, model.w.memory_start() + c * F, model.b[c]);
+    });
+
+    dll::host_written(model.w);
+}
+
+/*!
+ * \brief Train the multinomial logistic regression by batched gradient
+ * descent
+ */
+template <typename T>
+void train_logistic(const T* x, const std::vector<size_t>& classes, size_t n, size_t F, const linear_parameters& p, linear_model& model) {
+    const size_t K = model.classes();
+    const size_t B = std::min(n, p.batch_size);
+
+    // The regularization of the weights, for the whole data set
+    const double lambda = 1.0 / (p.C * n);
+
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::mt19937_64 engine(dll::seed());
+
+    etl::dyn_matrix<double, 2> xb(B, F);
+    etl::dyn_matrix<double, 2> s(B, K);
+    etl::dyn_matrix<double, 2> gw(K, F);
+
+    model.w = 0.0;
+
+    for (size_t epoch = 0; epoch < p.epochs; ++epoch) {
+        std::shuffle(order.begin(), order.end(), engine);
+
+        for (size_t first = 0; first + B <= n; first += B) {
+            for (size_t i = 0; i < B; ++i) {
+                for (size_t f = 0; f < F; ++f) {
+                    xb(i, f) = x[order[first + i] * F + f];
+                }
+            }
+
+            s = xb * etl::transpose(model.w);
+
+            // The gradient of the loss with respect to the scores is the
+            // softmax of the scores minus the expected classes
+            for (size_t i = 0; i < B; ++i) {
+                double max = -std::numeric_limits<double>::infinity();
+
+                for (size_t k = 0; k < K; ++k) {
+                    s(i, k) += model.b[k];
+                    max = std::max(max, s(i, k));
+                }
+
+                double sum = 0.0;
+
+                for (size_t k = 0; k < K; ++k) {
+                    s(i, k) = std::exp(s(i, k) - max);
+                    sum += s(i, k);
+                }
+
+                for (size_t k = 0; k < K; ++k) {
+                    s(i, k) = s(i, k) / sum - (classes[order[first + i]] == k ? 1.0 : 0.0);
+                }
+            }
+
+            gw = etl::transpose(s) * xb;
+
+            model.w = model.w - p.learning_rate * ((gw / double(B)) + lambda * model.w);
+
+            for (size_t k = 0; k < K; ++k) {
+                double gb = 0.0;
+
+                for (size_t i = 0; i < B; ++i) {
+                    gb += s(i, k);
+                }
+
+                model.b[k] -= p.learning_rate * gb / double(B);
+            }
+        }
+    }
+}
+
+} //end of namespace linear_detail
+
+/*!
+ * \brief Train a linear classifier on the given features
+ *
+ * \param pool The thread pool, the SVM of the classes are trained in parallel
+ * \param features The features (samples x features)
+ * \param labels The label of each sample
+ * \param p The parameters of the training
+ *
+ * \return the trained classifier
+ */
+template <typename Pool, typename Features>
+linear_model train_linear(Pool& pool, const Features& features, const std::vector<double>& labels, const linear_parameters& p) {
+    const size_t n = etl::dim<0>(features);
+    const size_t F = etl::dim<1>(features);
+
+    cpp_assert(labels.size() == n, "There must be one label per sample");
+
+    linear_model model;
+
+    model.labels = labels;
+    std::sort(model.labels.begin(), model.labels.end());
+    model.labels.erase(std::unique(model.labels.begin(), model.labels.end()), model.labels.end());
+
+    const size_t K = model.classes();
+
+    std::vector<size_t> classes(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        classes[i] = std::distance(model.labels.begin(), std::lower_bound(model.labels.begin(), model.labels.end(), labels[i]));
+    }
+
+    model.w = etl::dyn_matrix<double, 2>(K, F);
+    model.b.assign(K, 0.0);
+
+    dll::host_read(features);
+
+    if (p.type == linear_type::SVM) {
+        linear_detail::train_svm(pool, features.memory_start(), classes, n, F, p, model);
+    } else {
+        linear_detail::train_logistic(features.memory_start(), classes, n, F, p, model);
+    }
+
+    return model;
+}
+
+} //end of dll namespace
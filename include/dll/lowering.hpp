@@ -0,0 +1,236 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Lowering of the RBMs of a trained network into standard neural
+ * layers, for inference.
+ *
+ * At test time, the hidden units of an RBM are computed from their
+ * activation probabilities, which are the output of the equivalent neural
+ * layer: a dense RBM is a dense layer and a convolutional RBM is a
+ * convolutional layer, with the activation function of their hidden units
+ * (sigmoid for binary units, rectifier for rectified units and softmax for
+ * softmax units). The lowered network has the same layers as the trained
+ * network with its RBMs replaced by their equivalent layers; the layers
+ * then use the inference paths of the neural layers, including the fusion
+ * of the convolutions with the max pooling layers (see dll/fusion.hpp).
+ *
+ * The RBMs with other hidden units (capped rectifiers, gaussian) and the
+ * convolutional RBMs with probabilistic max pooling, which do not have an
+ * equivalent neural layer, are kept as they are. Only the networks with
+ * static layers can be lowered.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <memory>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/dbn_traits.hpp"
+#include "dll/generic_dbn_desc.hpp"
+#include "dll/unit_type.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+
+namespace dll {
+
+namespace lowering_detail {
+
+/*!
+ * \brief Indicates if the given hidden unit has an equivalent activation
+ * function
+ */
+constexpr bool is_lowerable(unit_type hidden_unit) {
+    return hidden_unit == unit_type::BINARY || hidden_unit == unit_type::RELU || hidden_unit == unit_type::SOFTMAX;
+}
+
+/*!
+ * \brief Return the activation function equivalent to the given hidden unit
+ */
+constexpr function lowered_activation(unit_type hidden_unit) {
+    return hidden_unit == unit_type::BINARY
+               ? function::SIGMOID
+               : (hidden_unit == unit_type::SOFTMAX ? function::SOFTMAX : function::RELU);
+}
+
+/*!
+ * \brief Return the factor of the inputs of the binary hidden units of a
+ * convolutional RBM, 1 / (0.1 * 0.1) for gaussian visible units
+ */
+template <typename Layer>
+constexpr double input_factor() {
+    return Layer::hidden_unit == unit_type::BINARY && Layer::visible_unit == unit_type::GAUSSIAN ? 1.0 / (0.1 * 0.1) : 1.0;
+}
+
+/*!
+ * \brief The equivalent dense layer of a dense RBM
+ */
+template <typename Layer, bool Fast = Layer::desc::parameters::template contains<dll::fast_math>()>
+struct lowered_dense {
+    using type = typename dense_layer_desc<Layer::num_visible, Layer::num_hidden,
+        weight_type<typename Layer::weight>, activation<lowered_activation(Layer::hidden_unit)>>::layer_t; ///< The lowered layer
+};
+
+/*!
+ * \copydoc lowered_dense
+ */
+template <typename Layer>
+struct lowered_dense<Layer, true> {
+    using type = typename dense_layer_desc<Layer::num_visible, Layer::num_hidden,
+        weight_type<typename Layer::weight>, activation<lowered_activation(Layer::hidden_unit)>, dll::fast_math>::layer_t; ///< The lowered layer
+};
+
+/*!
+ * \brief The lowered type of a layer, the layer itself when it has no
+ * equivalent neural layer
+ */
+template <typename Layer, typename Enable = void>
+struct lowered_layer {
+    using type = Layer; ///< The lowered layer
+};
+
+/*!
+ * \brief A dense RBM is lowered to a dense layer
+ */
+template <typename Desc>
+struct lowered_layer<rbm_impl<Desc>, std::enable_if_t<is_lowerable(Desc::hidden_unit)>> {
+    using type = typename lowered_dense<rbm_impl<Desc>>::type; ///< The lowered layer
+};
+
+/*!
+ * \brief A convolutional RBM is lowered to a convolutional layer
+ */
+template <typename Desc>
+struct lowered_layer<conv_rbm_impl<Desc>, std::enable_if_t<is_lowerable(Desc::hidden_unit)>> {
+    using layer_t = conv_rbm_impl<Desc>; ///< The lowered RBM
+
+    using type = typename conv_layer_desc<layer_t::NC, layer_t::NV1, layer_t::NV2, layer_t::K, layer_t::NW1, layer_t::NW2,
+        weight_type<typename layer_t::weight>, activation<lowered_activation(Desc::hidden_unit)>, conv_engine<Desc::engine>>::layer_t; ///< The lowered layer
+};
+
+/*!
+ * \brief The lowered type of a layer
+ */
+template <typename Layer>
+using lowered_layer_t = typename lowered_layer<Layer>::type;
+
+/*!
+ * \brief The descriptor of the lowered network
+ */
+template <typename Desc>
+struct lowered_desc;
+
+/*!
+ * \copydoc lowered_desc
+ */
+template <template <typename> class DBN_T, typename... Layers, typename... Parameters>
+struct lowered_desc<generic_dbn_desc<DBN_T, detail::layers<false, Layers...>, Parameters...>> {
+    using type = generic_dbn_desc<DBN_T, detail::layers<false, lowered_layer_t<Layers>...>, Parameters...>; ///< The lowered descriptor
+};
+
+/*!
+ * \brief Copy the tensors of the given tuple of references into the
+ * tensors of the other tuple of references.
+ */
+template <typename From, typename To, size_t... I>
+void copy_parameters(const From& from, To& to, std::index_sequence<I...> /*seq*/) {
+    int wormhole[] = {(std::get<I>(to).get() = std::get<I>(from).get(), 0)...};
+    cpp_unused(wormhole);
+}
+
+/*!
+ * \brief Copy the parameters of a layer that is not lowered
+ */
+template <typename Layer, cpp_enable_iff(decay_layer_traits<Layer>::is_neural_layer())>
+void lower_layer(const Layer& layer, Layer& lowered) {
+    auto from = layer.stored_parameters();
+    auto to   = lowered.stored_parameters();
+
+    copy_parameters(from, to, std::make_index_sequence<std::tuple_size<decltype(from)>::value>());
+}
+
+/*!
+ * \brief A layer without parameters has nothing to copy
+ */
+template <typename Layer, cpp_disable_if(decay_layer_traits<Layer>::is_neural_layer())>
+void lower_layer(const Layer& layer, Layer& lowered) {
+    cpp_unused(layer);
+    cpp_unused(lowered);
+}
+
+/*!
+ * \brief Lower a dense RBM to a dense layer, with the same weights and
+ * the hidden biases
+ */
+template <typename Desc, typename LDesc>
+void lower_layer(const rbm_impl<Desc>& rbm, dense_layer_impl<LDesc>& lowered) {
+    lowered.w = rbm.w;
+    lowered.b = rbm.b;
+}
+
+/*!
+ * \brief Lower a convolutional RBM to a convolutional layer, with the same
+ * filters and the hidden biases, scaled as the inputs of the hidden units
+ */
+template <typename Desc, typename LDesc>
+void lower_layer(const conv_rbm_impl<Desc>& rbm, conv_layer_impl<LDesc>& lowered) {
+    using weight = typename conv_rbm_impl<Desc>::weight;
+
+    static_assert(LDesc::S1 == 1 && LDesc::S2 == 1 && LDesc::P1 == 0 && LDesc::P2 == 0, "A convolutional RBM is lowered to a convolutional layer without stride nor padding");
+
+    const weight factor(input_factor<conv_rbm_impl<Desc>>());
+
+    lowered.w = factor * rbm.w;
+    lowered.b = factor * rbm.b;
+}
+
+/*!
+ * \brief Lower all the layers of the network into the layers of the
+ * lowered network
+ */
+template <typename DBN, typename Lowered, size_t... I>
+void lower_layers(const DBN& dbn, Lowered& lowered, std::index_sequence<I...> /*seq*/) {
+    int wormhole[] = {(lower_layer(dbn.template layer_get<I>(), lowered.template layer_get<I>()), 0)...};
+    cpp_unused(wormhole);
+}
+
+} //end of namespace lowering_detail
+
+/*!
+ * \brief The type of the network with the RBMs of the network DBN lowered
+ * to their equivalent neural layers
+ */
+template <typename DBN>
+using lowered_dbn_t = typename lowering_detail::lowered_desc<typename DBN::desc>::type::dbn_t;
+
+/*!
+ * \brief Lower the RBMs of the given trained network to their equivalent
+ * neural layers, for inference.
+ *
+ * The layers that are not lowered are copied as they are.
+ *
+ * \param dbn The trained network
+ * \return The lowered network, computing the same test representation
+ */
+template <typename DBN>
+std::unique_ptr<lowered_dbn_t<DBN>> lower(const DBN& dbn) {
+    static_assert(!dbn_traits<DBN>::is_dynamic(), "Only the networks with static layers can be lowered");
+
+    auto lowered = std::make_unique<lowered_dbn_t<DBN>>();
+
+    lowering_detail::lower_layers(dbn, *lowered, std::make_index_sequence<DBN::layers>());
+
+    return lowered;
+}
+
+} //end of dll namespace
@@ -0,0 +1,117 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Schedules of the learning rate of the fine-tuning.
+ *
+ * The schedule gives the factor of the learning rate at each iteration,
+ * after an optional linear warmup. It is computed once per step by the
+ * SGD trainer, for all the layers.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+namespace dll {
+
+/*!
+ * \brief The schedule of the learning rate
+ */
+enum class lr_schedule {
+    CONSTANT, ///< Constant learning rate
+    STEP,     ///< Learning rate multiplied by a factor every fixed number of iterations
+    COSINE,   ///< Cosine annealing down to a minimum learning rate
+    ONE_CYCLE ///< Linear increase up to the learning rate, followed by a cosine annealing
+};
+
+/*!
+ * \brief Returns a string representation of a learning rate schedule
+ * \param s The learning rate schedule to transform to string
+ * \return a string representation of a learning rate schedule
+ */
+inline std::string to_string(lr_schedule s) {
+    switch (s) {
+        case lr_schedule::CONSTANT:
+            return "Constant";
+        case lr_schedule::STEP:
+            return "Step";
+        case lr_schedule::COSINE:
+            return "Cosine";
+        case lr_schedule::ONE_CYCLE:
+            return "OneCycle";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+/*!
+ * \brief The parameters of a learning rate schedule
+ */
+struct lr_schedule_params {
+    lr_schedule schedule = lr_schedule::CONSTANT; ///< The schedule
+    size_t warmup        = 0;                     ///< The number of iterations of linear warmup
+    size_t horizon       = 0;                     ///< The total number of iterations (COSINE and ONE_CYCLE)
+    size_t step          = 0;                     ///< The number of iterations between two steps (STEP)
+    double gamma         = 0.1;                   ///< The factor applied at each step (STEP)
+    double min_factor    = 0.0;                   ///< The factor of the minimum learning rate (COSINE and ONE_CYCLE)
+};
+
+constexpr double one_cycle_start    = 1.0 / 25.0; ///< The factor of the initial learning rate of ONE_CYCLE
+constexpr double one_cycle_increase = 0.3;        ///< The fraction of the iterations of ONE_CYCLE with an increasing learning rate
+
+/*!
+ * \brief Returns the factor of the learning rate at the given iteration
+ * \param p The parameters of the schedule
+ * \param t The iteration, from zero
+ */
+inline double lr_schedule_factor(const lr_schedule_params& p, size_t t) {
+    // Linear warmup from the first iteration
+    if (t < p.warmup) {
+        return double(t + 1) / double(p.warmup);
+    }
+
+    t -= p.warmup;
+
+    const size_t horizon = p.horizon > p.warmup ? p.horizon - p.warmup : 0;
+
+    // The position in the horizon, in [0, 1]
+    const double x = horizon ? std::min(1.0, double(t) / double(horizon)) : 0.0;
+
+    auto cosine = [&p](double y) {
+        return p.min_factor + (1.0 - p.min_factor) * 0.5 * (1.0 + std::cos(M_PI * y));
+    };
+
+    switch (p.schedule) {
+        case lr_schedule::CONSTANT:
+            return 1.0;
+
+        case lr_schedule::STEP:
+            return p.step ? std::pow(p.gamma, double(t / p.step)) : 1.0;
+
+        case lr_schedule::COSINE:
+            return horizon ? cosine(x) : 1.0;
+
+        case lr_schedule::ONE_CYCLE:
+            if (!horizon) {
+                return 1.0;
+            } else if (x < one_cycle_increase) {
+                return one_cycle_start + (1.0 - one_cycle_start) * (x / one_cycle_increase);
+            } else {
+                return cosine((x - one_cycle_increase) / (1.0 - one_cycle_increase));
+            }
+    }
+
+    return 1.0;
+}
+
+} //end of dll namespace
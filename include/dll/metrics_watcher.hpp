@@ -0,0 +1,166 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Watcher exporting the metrics of the fine-tuning to StatsD or to
+ * a Prometheus text file.
+ *
+ * In addition to the output of the default watcher, this watcher gathers
+ * the throughput, the latencies of the batches (including the time waiting
+ * for the data), the errors and the losses, and exports them with the
+ * totals of the timers from the thread of a metrics_exporter. The export is
+ * configured by the environment (see dll/util/metrics.hpp). The stalls of
+ * the threaded generators (time waiting for the batches, for free slots,
+ * transforming and augmenting) are exported for each epoch.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "dll/watcher.hpp"
+#include "dll/util/metrics.hpp"
+#include "dll/generators/batch_ring.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A DBN watcher that also exports the metrics of the training
+ */
+template <typename DBN>
+struct metrics_dbn_watcher : default_dbn_watcher<DBN> {
+    using base_type = default_dbn_watcher<DBN>;  ///< The default watcher
+    using clock     = std::chrono::steady_clock; ///< The clock of the measurements
+
+    metrics_exporter exporter;    ///< The exporter of the metrics
+    clock::time_point epoch_time; ///< The start of the current epoch
+    clock::time_point batch_time; ///< The end of the last batch
+    size_t samples = 0;           ///< The number of samples of the current epoch
+
+    /*!
+     * \brief Create a watcher exporting its metrics with the configuration
+     * of the environment
+     */
+    metrics_dbn_watcher() : exporter(metrics_config::from_env()) {}
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_start
+     */
+    void ft_epoch_start(size_t epoch, const DBN& dbn) {
+        base_type::ft_epoch_start(epoch, dbn);
+
+        samples    = 0;
+        epoch_time = clock::now();
+        batch_time = epoch_time;
+
+        exporter.update([epoch](training_metrics& m) { m.epoch = epoch; });
+    }
+
+    /*!
+     * \brief Add the samples of a batch to the current epoch
+     * \param n The number of samples
+     */
+    void epoch_samples(size_t n) {
+        const auto now = clock::now();
+        const double ms = std::chrono::duration_cast<std::chrono::microseconds>(now - batch_time).count() / 1000.0;
+
+        batch_time = now;
+        samples += n;
+
+        exporter.update([n, ms](training_metrics& m) {
+            ++m.batches;
+            m.samples += n;
+            m.add_latency(ms);
+        });
+    }
+
+    /*!
+     * \brief Set the stalls of the generator for the current epoch
+     * \param stats The stalls of the generator
+     */
+    void epoch_stalls(const generator_stall_stats& stats) {
+        exporter.update([stats](training_metrics& m) {
+            m.data_wait_ms     = stats.consumer_wait_ms;
+            m.producer_wait_ms = stats.producer_wait_ms;
+            m.transform_ms     = stats.transform_ms;
+            m.augment_ms       = stats.augment_ms;
+        });
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_batch_end(size_t, size_t, size_t, double, double, const DBN&)
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        base_type::ft_batch_end(epoch, batch, batches, batch_error, batch_loss, dbn);
+        batch_metrics(batch_error, batch_loss);
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_batch_end(size_t, double, double, const DBN&)
+     */
+    void ft_batch_end(size_t epoch, double batch_error, double batch_loss, const DBN& dbn) {
+        base_type::ft_batch_end(epoch, batch_error, batch_loss, dbn);
+        batch_metrics(batch_error, batch_loss);
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_end(size_t, double, double, const DBN&)
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        base_type::ft_epoch_end(epoch, error, loss, dbn);
+        epoch_metrics(error, loss, -1.0, -1.0);
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_end(size_t, double, double, double, double, const DBN&)
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        base_type::ft_epoch_end(epoch, train_error, train_loss, val_error, val_loss, dbn);
+        epoch_metrics(train_error, train_loss, val_error, val_loss);
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::fine_tuning_end
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        base_type::fine_tuning_end(dbn);
+        exporter.export_metrics();
+    }
+
+private:
+    /*!
+     * \brief Update the metrics of the last batch, the metrics not
+     * computed for the batch being negative
+     */
+    void batch_metrics(double error, double loss) {
+        if (error >= 0.0 || loss >= 0.0) {
+            exporter.update([error, loss](training_metrics& m) {
+                m.error = error;
+                m.loss  = loss;
+            });
+        }
+    }
+
+    /*!
+     * \brief Update the metrics of the epoch that just finished
+     */
+    void epoch_metrics(double error, double loss, double val_error, double val_loss) {
+        const double seconds    = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - epoch_time).count() / 1e6;
+        const double throughput = seconds > 0.0 ? samples / seconds : 0.0;
+
+        exporter.update([=](training_metrics& m) {
+            m.throughput = throughput;
+            m.error      = error;
+            m.loss       = loss;
+            m.val_error  = val_error;
+            m.val_loss   = val_loss;
+        });
+    }
+};
+
+} //end of dll namespace
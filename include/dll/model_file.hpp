@@ -0,0 +1,293 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Versioned binary container for the parameters of a network.
+ *
+ * The format is made of a fixed 16 bytes header, followed by a directory
+ * with one 64 bytes entry per tensor, followed by the payloads of the
+ * tensors. Each payload starts on a 64 bytes boundary and is the raw
+ * memory of the tensor, so that loading a tensor is a single bulk read
+ * straight into its storage, without any parsing.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <tuple>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The header of a model file
+ */
+struct model_file_header {
+    static constexpr uint32_t current_version = 1;  ///< The version of the format
+    static constexpr size_t alignment         = 64; ///< The alignment of the payloads
+
+    char magic[4];    ///< The magic identifier ("DLLM")
+    uint32_t version; ///< The version of the format
+    uint32_t tensors; ///< The number of tensors in the directory
+    uint32_t reserved; ///< Unused, kept for alignment
+
+    /*!
+     * \brief Indicates if the header is a valid model file header
+     */
+    bool valid() const {
+        return std::memcmp(magic, "DLLM", 4) == 0 && version == current_version;
+    }
+};
+
+static_assert(sizeof(model_file_header) == 16, "The model file header must be 16 bytes");
+
+/*!
+ * \brief An entry of the tensor directory of a model file
+ */
+struct model_file_entry {
+    static constexpr size_t max_dimensions = 4; ///< The maximum number of dimensions of a tensor
+
+    uint32_t layer;                 ///< The index of the layer in the network
+    uint32_t index;                 ///< The index of the tensor in the layer
+    uint32_t element_size;          ///< The size of one element, in bytes
+    uint32_t dimensions;            ///< The number of dimensions of the tensor
+    uint64_t dims[max_dimensions];  ///< The dimensions of the tensor
+    uint64_t offset;                ///< The offset of the payload in the file
+    uint64_t bytes;                 ///< The size of the payload, in bytes
+};
+
+static_assert(sizeof(model_file_entry) == 64, "The model file entries must be 64 bytes");
+
+namespace model_detail {
+
+/*!
+ * \brief Call the functor on each tensor of the given tuple of
+ * references, with its index.
+ */
+template <typename Tuple, typename Functor, size_t... I>
+void for_each_parameter(Tuple& parameters, Functor&& functor, std::index_sequence<I...>) {
+    int wormhole[] = {(functor(I, std::get<I>(parameters).get()), 0)...};
+    cpp_unused(wormhole);
+}
+
+/*!
+ * \brief Call the functor on each stored tensor of the network, with
+ * the index of its layer and its index in the layer.
+ */
+template <typename DBN, typename Functor>
+void for_each_tensor(DBN& dbn, Functor&& functor) {
+    size_t l = 0;
+
+    dbn.for_each_layer([&](auto& layer) {
+        cpp::static_if<decay_layer_traits<decltype(layer)>::is_neural_layer()>([&](auto f) {
+            auto parameters = f(layer).stored_parameters();
+
+            for_each_parameter(parameters, [&](size_t i, auto& tensor) {
+                functor(l, i, tensor);
+            }, std::make_index_sequence<std::tuple_size<decltype(parameters)>::value>());
+        });
+
+        ++l;
+    });
+}
+
+/*!
+ * \brief Create the directory entry of the given tensor
+ */
+template <typename T>
+model_file_entry make_entry(size_t l, size_t i, const T& tensor, uint64_t offset) {
+    static_assert(etl::decay_traits<T>::dimensions() <= model_file_entry::max_dimensions, "Too many dimensions for a model file tensor");
+
+    model_file_entry entry;
+    std::memset(&entry, 0, sizeof(entry));
+
+    entry.layer        = l;
+    entry.index        = i;
+    entry.element_size = sizeof(etl::value_t<T>);
+    entry.dimensions   = etl::dimensions(tensor);
+    entry.offset       = offset;
+    entry.bytes        = etl::size(tensor) * sizeof(etl::value_t<T>);
+
+    for (size_t d = 0; d < entry.dimensions; ++d) {
+        entry.dims[d] = etl::dim(tensor, d);
+    }
+
+    return entry;
+}
+
+/*!
+ * \brief Align the given offset on the payload alignment
+ */
+inline uint64_t align(uint64_t offset) {
+    const uint64_t a = model_file_header::alignment;
+    return (offset + a - 1) / a * a;
+}
+
+} //end of namespace model_detail
+
+/*!
+ * \brief Store the parameters of the network in the model file format
+ * \param dbn The network to store
+ * \param os The stream to write to (must be binary)
+ * \return true if the network was written, false otherwise
+ */
+template <typename DBN>
+bool store_model(const DBN& dbn, std::ostream& os) {
+    std::vector<model_file_entry> directory;
+
+    // Compute the directory with aligned offsets for all the payloads
+
+    size_t n = 0;
+    model_detail::for_each_tensor(dbn, [&n](size_t, size_t, auto&) { ++n; });
+
+    uint64_t offset = model_detail::align(sizeof(model_file_header) + n * sizeof(model_file_entry));
+
+    model_detail::for_each_tensor(dbn, [&](size_t l, size_t i, auto& tensor) {
+        directory.push_back(model_detail::make_entry(l, i, tensor, offset));
+        offset = model_detail::align(offset + directory.back().bytes);
+    });
+
+    model_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "DLLM", 4);
+    header.version = model_file_header::current_version;
+    header.tensors = n;
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(model_file_entry));
+
+    uint64_t position = sizeof(model_file_header) + n * sizeof(model_file_entry);
+    size_t t = 0;
+
+    const char zeroes[model_file_header::alignment] = {};
+
+    model_detail::for_each_tensor(dbn, [&](size_t, size_t, auto& tensor) {
+        const auto& entry = directory[t++];
+
+        // Pad up to the aligned offset of the payload
+        os.write(zeroes, entry.offset - position);
+
+        os.write(reinterpret_cast<const char*>(tensor.memory_start()), entry.bytes);
+
+        position = entry.offset + entry.bytes;
+    });
+
+    return bool(os);
+}
+
+/*!
+ * \brief Store the parameters of the network in a model file
+ * \param dbn The network to store
+ * \param path The path of the file to write
+ * \return true if the network was written, false otherwise
+ */
+template <typename DBN>
+bool store_model(const DBN& dbn, const std::string& path) {
+    std::ofstream os(path, std::ofstream::binary);
+
+    if (!os) {
+        std::cerr << "ERROR: Impossible to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    return store_model(dbn, os);
+}
+
+/*!
+ * \brief Load the parameters of the network from the model file format.
+ *
+ * The directory is validated against the network before any tensor is
+ * read. Each tensor is then read with a single read directly into its
+ * storage.
+ *
+ * \param dbn The network to load
+ * \param is The stream to read from (must be binary and seekable)
+ * \return true if the network was loaded, false otherwise
+ */
+template <typename DBN>
+bool load_model(DBN& dbn, std::istream& is) {
+    model_file_header header;
+
+    if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) || !header.valid()) {
+        std::cerr << "ERROR: Invalid model file" << std::endl;
+        return false;
+    }
+
+    std::vector<model_file_entry> directory(header.tensors);
+
+    if (!is.read(reinterpret_cast<char*>(directory.data()), directory.size() * sizeof(model_file_entry))) {
+        std::cerr << "ERROR: Invalid model file directory" << std::endl;
+        return false;
+    }
+
+    // Validate the directory against the network
+
+    bool valid = true;
+    size_t t   = 0;
+
+    model_detail::for_each_tensor(dbn, [&](size_t l, size_t i, auto& tensor) {
+        if (t >= directory.size()) {
+            valid = false;
+            return;
+        }
+
+        auto expected     = model_detail::make_entry(l, i, tensor, 0);
+        const auto& entry = directory[t++];
+
+        if (entry.layer != expected.layer || entry.index != expected.index || entry.element_size != expected.element_size || entry.bytes != expected.bytes) {
+            valid = false;
+        }
+    });
+
+    if (!valid || t != directory.size()) {
+        std::cerr << "ERROR: The model file does not match the network" << std::endl;
+        return false;
+    }
+
+    t = 0;
+
+    model_detail::for_each_tensor(dbn, [&](size_t, size_t, auto& tensor) {
+        const auto& entry = directory[t++];
+
+        is.seekg(entry.offset);
+        is.read(reinterpret_cast<char*>(tensor.memory_start()), entry.bytes);
+    });
+
+    if (!is) {
+        std::cerr << "ERROR: Truncated model file" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Load the parameters of the network from a model file
+ * \param dbn The network to load
+ * \param path The path of the file to read
+ * \return true if the network was loaded, false otherwise
+ */
+template <typename DBN>
+bool load_model(DBN& dbn, const std::string& path) {
+    std::ifstream is(path, std::ifstream::binary);
+
+    if (!is) {
+        std::cerr << "ERROR: Impossible to open " << path << " for reading" << std::endl;
+        return false;
+    }
+
+    return load_model(dbn, is);
+}
+
+} //end of dll namespace
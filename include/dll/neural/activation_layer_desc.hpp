@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
 namespace dll {
 
 /*!
@@ -15,22 +18,32 @@ namespace dll {
  * Such a layer only applies an activation function to its inputs
  * and has no weights.
  */
-template <dll::function F = dll::function::SIGMOID>
+template <dll::function F = dll::function::SIGMOID, typename... Parameters>
 struct activation_layer_desc {
     /*!
      * \brief The layer's activation function
      */
     static constexpr function activation_function = F;
 
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
     /*!
      * The layer type
      */
-    using layer_t = activation_layer_impl<activation_layer_desc<F>>;
+    using layer_t = activation_layer_impl<activation_layer_desc<F, Parameters...>>;
 
     /*!
      * The dynamic layer type
      */
-    using dyn_layer_t = activation_layer_impl<activation_layer_desc<F>>;
+    using dyn_layer_t = activation_layer_impl<activation_layer_desc<F, Parameters...>>;
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<fast_math_id>, Parameters...>,
+        "Invalid parameters type for activation_layer_desc");
 };
 
 /*!
@@ -39,7 +52,7 @@ struct activation_layer_desc {
  * Such a layer only applies an activation function to its inputs
  * and has no weights.
  */
-template <dll::function F = dll::function::SIGMOID>
-using activation_layer = typename activation_layer_desc<F>::layer_t;
+template <dll::function F = dll::function::SIGMOID, typename... Parameters>
+using activation_layer = typename activation_layer_desc<F, Parameters...>::layer_t;
 
 } //end of dll namespace
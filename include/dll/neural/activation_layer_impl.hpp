@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/fast_math.hpp"
 
 namespace dll {
 
@@ -22,6 +23,7 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
     using base_type = transform_layer<activation_layer_impl<Desc>>; ///< The base type
 
     static constexpr function activation_function = desc::activation_function;
+    static constexpr bool fast_math               = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
 
     activation_layer_impl() = default;
 
@@ -41,7 +43,12 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = f_activate<activation_function>(input);
+        if /*constexpr*/ (fast_math) {
+            output = input;
+            fast_activate<activation_function>(output);
+        } else {
+            output = f_activate<activation_function>(input);
+        }
     }
 
     /*!
@@ -104,7 +111,7 @@ struct sgd_context<DBN, activation_layer_impl<Desc>, L> {
     using layer_t          = activation_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
 
     inputs_t input;  ///< A batch of input
     inputs_t output; ///< A batch of output
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/neural/batch_normalization_kernels.hpp"
 
 namespace dll {
 
@@ -23,6 +24,8 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     static constexpr size_t Input = desc::Input; ///< The input size
     static constexpr weight e     = 1e-8;        ///< Epsilon for numerical stability
 
+    static constexpr bool inference_only = desc::parameters::template contains<dll::inference_only>(); ///< Indicates if the statistics of the last batch are removed
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Input>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, Input>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;            ///< The type of the input
@@ -34,9 +37,9 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     etl::fast_matrix<weight, Input> mean;
     etl::fast_matrix<weight, Input> var;
 
-    etl::fast_matrix<weight, Input> last_mean;
-    etl::fast_matrix<weight, Input> last_var;
-    etl::fast_matrix<weight, Input> inv_var;
+    conditional_fast_matrix_t<!inference_only, weight, Input> last_mean;
+    conditional_fast_matrix_t<!inference_only, weight, Input> last_var;
+    conditional_fast_matrix_t<!inference_only, weight, Input> inv_var;
 
     etl::dyn_matrix<weight, 2> input_pre; /// B x Input
 
@@ -119,19 +122,18 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
         const auto B = etl::dim<0>(input);
+        const auto K = etl::dim<1>(input);
 
-        last_mean          = etl::mean_l(input);
-        auto last_mean_rep = etl::rep_l(last_mean, B);
+        if (etl::size(input_pre) != etl::size(input)) {
+            input_pre = etl::dyn_matrix<weight, 2>(B, K);
+        }
 
-        last_var = etl::mean_l((input - last_mean_rep) >> (input - last_mean_rep));
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
+        decltype(auto) x = direct_memory(input);
 
-        input_pre.inherit_if_null(input);
-
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (gamma >> input_pre(b)) + beta;
-        }
+        // Statistics, normalization, scale and shift in one pass
+        bn_detail::train_forward(B, K, 1, x.memory_start(), input_pre.memory_start(), output.memory_start(),
+                                 gamma.memory_start(), beta.memory_start(),
+                                 last_mean.memory_start(), last_var.memory_start(), inv_var.memory_start(), e);
 
         // Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -159,13 +161,15 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     void backward_batch(H&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
 
-        auto dxhat        = etl::force_temporary(context.errors >> etl::rep_l(gamma, B));
-        auto dxhat_l      = etl::force_temporary(etl::sum_l(dxhat));
-        auto dxhat_xhat_l = etl::force_temporary(etl::sum_l(dxhat >> input_pre));
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> (B * dxhat(b) - dxhat_l - (input_pre(b) >> dxhat_xhat_l));
-        }
+        // The gradients of gamma and beta are computed in the same pass
+        bn_detail::backward(B, Input, 1, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            output.memory_start(), dgamma.memory_start(), dbeta.memory_start());
+
+        context.gradients_ready = true;
     }
 
     /*!
@@ -174,11 +178,20 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::sum_l(input_pre >> context.errors);
+        // Already computed by backward_batch
+        if (context.gradients_ready) {
+            context.gradients_ready = false;
+            return;
+        }
+
+        const auto B = etl::dim<0>(context.input);
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::sum_l(context.errors);
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
+
+        bn_detail::backward(B, Input, 1, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            static_cast<weight*>(nullptr), dgamma.memory_start(), dbeta.memory_start());
     }
 
     /*!
@@ -220,6 +233,22 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         return std::make_tuple(std::ref(gamma), std::ref(beta));
     }
 
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::make_tuple(std::ref(gamma), std::ref(beta), std::ref(mean), std::ref(var));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::make_tuple(std::cref(gamma), std::cref(beta), std::cref(mean), std::cref(var));
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -235,6 +264,16 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         gamma = *bak_gamma;
         beta  = *bak_beta;
     }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(gamma, bak_gamma);
+        swap_backup(beta, bak_beta);
+    }
 };
 
 // Declare the traits for the layer
@@ -269,6 +308,8 @@ struct sgd_context<DBN, batch_normalization_2d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, Desc::Input> output; ///< A batch of output
     etl::fast_matrix<weight, batch_size, Desc::Input> errors; ///< A batch of errors
 
+    bool gradients_ready = false; ///< Indicates that the gradients were computed by backward_batch
+
     sgd_context(layer_t& /*layer*/){}
 };
 
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/neural/batch_normalization_kernels.hpp"
 
 namespace dll {
 
@@ -25,6 +26,8 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     static constexpr size_t H       = desc::Height;  ///< The height of feature maps
     static constexpr weight e        = 1e-8;          ///< Epsilon for numerical stability
 
+    static constexpr bool inference_only = desc::parameters::template contains<dll::inference_only>(); ///< Indicates if the statistics of the last batch are removed
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Kernels, W, H>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, Kernels, W, H>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;                    ///< The type of the input
@@ -36,9 +39,9 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     etl::fast_matrix<weight, Kernels> mean;
     etl::fast_matrix<weight, Kernels> var;
 
-    etl::fast_matrix<weight, Kernels> last_mean;
-    etl::fast_matrix<weight, Kernels> last_var;
-    etl::fast_matrix<weight, Kernels> inv_var;
+    conditional_fast_matrix_t<!inference_only, weight, Kernels> last_mean;
+    conditional_fast_matrix_t<!inference_only, weight, Kernels> last_var;
+    conditional_fast_matrix_t<!inference_only, weight, Kernels> inv_var;
 
     etl::dyn_matrix<weight, 4> input_pre; /// B x K x W x H
 
@@ -122,35 +125,19 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        cpp_unused(output);
-
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
-
-        // Compute the variance of the mini-batch
-        last_var  = 0;
-
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
+        if (etl::size(input_pre) != etl::size(input)) {
+            input_pre = etl::dyn_matrix<weight, 4>(B, Kernels, W, H);
         }
 
-        last_var /= S;
-
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
+        decltype(auto) x = direct_memory(input);
 
-        input_pre.inherit_if_null(input);
-
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
-            }
-        }
+        // Statistics, normalization, scale and shift in one pass per channel
+        bn_detail::train_forward(B, Kernels, W * H, x.memory_start(), input_pre.memory_start(), output.memory_start(),
+                                 gamma.memory_start(), beta.memory_start(),
+                                 last_mean.memory_start(), last_var.memory_start(), inv_var.memory_start(), e);
 
         //// Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -177,27 +164,16 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
-
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
-
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
-            }
-        }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        *dxhat_l;
-        *dxhat_xhat_l;
+        // The gradients of gamma and beta are computed in the same pass
+        bn_detail::backward(B, Kernels, W * H, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            output.memory_start(), dgamma.memory_start(), dbeta.memory_start());
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
-            }
-        }
+        context.gradients_ready = true;
     }
 
     /*!
@@ -206,11 +182,20 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        // Already computed by backward_batch
+        if (context.gradients_ready) {
+            context.gradients_ready = false;
+            return;
+        }
+
+        const auto B = etl::dim<0>(context.input);
+
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        bn_detail::backward(B, Kernels, W * H, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            static_cast<weight*>(nullptr), dgamma.memory_start(), dbeta.memory_start());
     }
 
     /*!
@@ -252,6 +237,22 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
         return std::make_tuple(std::ref(gamma), std::ref(beta));
     }
 
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::make_tuple(std::ref(gamma), std::ref(beta), std::ref(mean), std::ref(var));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::make_tuple(std::cref(gamma), std::cref(beta), std::cref(mean), std::cref(var));
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -267,6 +268,16 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
         gamma = *bak_gamma;
         beta  = *bak_beta;
     }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(gamma, bak_gamma);
+        swap_backup(beta, bak_beta);
+    }
 };
 
 // Declare the traits for the layer
@@ -301,6 +312,8 @@ struct sgd_context<DBN, batch_normalization_4d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> output; ///< A batch of output
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> errors; ///< A batch of errors
 
+    bool gradients_ready = false; ///< Indicates that the gradients were computed by backward_batch
+
     sgd_context(layer_t& /*layer*/){}
 };
 
@@ -0,0 +1,242 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the training of the batch normalization layers.
+ *
+ * The data is seen as B x K x S, with B the number of samples, K the
+ * number of normalized features (the inputs in 2D, the channels in 4D)
+ * and S the spatial size of one feature (1 for 2D).
+ *
+ * For S > 1, each channel is computed by one task, the inner loops being
+ * over the contiguous spatial dimensions. For S == 1, the features are
+ * split in blocks and the inner loops are over the contiguous features
+ * of a block.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+namespace bn_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+constexpr size_t feature_block      = 64;        ///< The number of features of a block (S == 1)
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Compute the statistics of the batch and normalize it, in a
+ * single pass over the input.
+ *
+ * The statistics are computed with the Welford algorithm (S == 1) or by
+ * merging the statistics of each spatial row with Chan's formula (S > 1).
+ *
+ * \param B The number of samples
+ * \param K The number of features
+ * \param S The spatial size of each feature
+ * \param x The input (B x K x S)
+ * \param xhat The normalized input (B x K x S)
+ * \param y The output (B x K x S)
+ * \param gamma The scale (K)
+ * \param beta The shift (K)
+ * \param mean The mean of the batch (K)
+ * \param var The (biased) variance of the batch (K)
+ * \param inv_var The inverse standard deviation of the batch (K)
+ * \param e Epsilon for numerical stability
+ */
+template <typename T>
+void train_forward(size_t B, size_t K, size_t S, const T* x, T* xhat, T* y,
+                   const T* gamma, const T* beta, T* mean, T* var, T* inv_var, T e) {
+    if (S == 1) {
+        for_each_task((K + feature_block - 1) / feature_block, B * K, [&](size_t block) {
+            const size_t first = block * feature_block;
+            const size_t last  = std::min(K, first + feature_block);
+
+            for (size_t k = first; k < last; ++k) {
+                mean[k] = 0;
+                var[k]  = 0;
+            }
+
+            for (size_t b = 0; b < B; ++b) {
+                const T* xb  = x + b * K;
+                const T inv_n = T(1) / T(b + 1);
+
+                for (size_t k = first; k < last; ++k) {
+                    const T d = xb[k] - mean[k];
+                    mean[k] += d * inv_n;
+                    var[k] += d * (xb[k] - mean[k]);
+                }
+            }
+
+            for (size_t k = first; k < last; ++k) {
+                var[k] /= T(B);
+                inv_var[k] = T(1) / std::sqrt(var[k] + e);
+            }
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = first; k < last; ++k) {
+                    const size_t i = b * K + k;
+
+                    xhat[i] = (x[i] - mean[k]) * inv_var[k];
+                    y[i]    = gamma[k] * xhat[i] + beta[k];
+                }
+            }
+        });
+    } else {
+        for_each_task(K, B * K * S, [&](size_t k) {
+            T m  = 0;
+            T m2 = 0;
+            T n  = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                const T* row = x + (b * K + k) * S;
+
+                T sum = 0;
+                for (size_t s = 0; s < S; ++s) {
+                    sum += row[s];
+                }
+
+                const T row_mean = sum / T(S);
+
+                T row_m2 = 0;
+                for (size_t s = 0; s < S; ++s) {
+                    row_m2 += (row[s] - row_mean) * (row[s] - row_mean);
+                }
+
+                const T delta = row_mean - m;
+                const T nn    = n + T(S);
+
+                m += delta * (T(S) / nn);
+                m2 += row_m2 + delta * delta * (n * T(S) / nn);
+                n = nn;
+            }
+
+            mean[k]    = m;
+            var[k]     = m2 / n;
+            inv_var[k] = T(1) / std::sqrt(var[k] + e);
+
+            const T g = gamma[k];
+            const T h = beta[k];
+            const T r = inv_var[k];
+
+            for (size_t b = 0; b < B; ++b) {
+                const size_t offset = (b * K + k) * S;
+
+                for (size_t s = 0; s < S; ++s) {
+                    xhat[offset + s] = (x[offset + s] - m) * r;
+                    y[offset + s]    = g * xhat[offset + s] + h;
+                }
+            }
+        });
+    }
+}
+
+/*!
+ * \brief Compute the gradients of gamma and beta and, if dx is not null,
+ * backpropagate the errors, in a single pass over the errors.
+ *
+ * \param B The number of samples
+ * \param K The number of features
+ * \param S The spatial size of each feature
+ * \param dy The errors of the output (B x K x S)
+ * \param xhat The normalized input of the forward pass (B x K x S)
+ * \param gamma The scale (K)
+ * \param inv_var The inverse standard deviation of the batch (K)
+ * \param dx The errors of the input (B x K x S), may be null
+ * \param dgamma The gradients of gamma (K)
+ * \param dbeta The gradients of beta (K)
+ */
+template <typename T>
+void backward(size_t B, size_t K, size_t S, const T* dy, const T* xhat, const T* gamma, const T* inv_var,
+              T* dx, T* dgamma, T* dbeta) {
+    const T N = T(B * S);
+
+    if (S == 1) {
+        for_each_task((K + feature_block - 1) / feature_block, B * K, [&](size_t block) {
+            const size_t first = block * feature_block;
+            const size_t last  = std::min(K, first + feature_block);
+
+            for (size_t k = first; k < last; ++k) {
+                dgamma[k] = 0;
+                dbeta[k]  = 0;
+            }
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = first; k < last; ++k) {
+                    const size_t i = b * K + k;
+
+                    dbeta[k] += dy[i];
+                    dgamma[k] += dy[i] * xhat[i];
+                }
+            }
+
+            if (dx) {
+                for (size_t b = 0; b < B; ++b) {
+                    for (size_t k = first; k < last; ++k) {
+                        const size_t i = b * K + k;
+
+                        dx[i] = (gamma[k] * inv_var[k] / N) * (N * dy[i] - dbeta[k] - xhat[i] * dgamma[k]);
+                    }
+                }
+            }
+        });
+    } else {
+        for_each_task(K, B * K * S, [&](size_t k) {
+            T db = 0;
+            T dg = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                const size_t offset = (b * K + k) * S;
+
+                for (size_t s = 0; s < S; ++s) {
+                    db += dy[offset + s];
+                    dg += dy[offset + s] * xhat[offset + s];
+                }
+            }
+
+            dbeta[k]  = db;
+            dgamma[k] = dg;
+
+            if (dx) {
+                const T c = gamma[k] * inv_var[k] / N;
+
+                for (size_t b = 0; b < B; ++b) {
+                    const size_t offset = (b * K + k) * S;
+
+                    for (size_t s = 0; s < S; ++s) {
+                        dx[offset + s] = c * (N * dy[offset + s] - db - xhat[offset + s] * dg);
+                    }
+                }
+            }
+        });
+    }
+}
+
+} //end of namespace bn_detail
+
+} //end of namespace dll
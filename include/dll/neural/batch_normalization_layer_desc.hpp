@@ -19,6 +19,11 @@ struct batch_normalization_2d_layer_desc {
      */
     static constexpr size_t Input  = I;
 
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
     /*!
      * The type used to store the weights
      */
@@ -29,6 +34,11 @@ struct batch_normalization_2d_layer_desc {
      */
     using layer_t = batch_normalization_2d_layer_impl<batch_normalization_2d_layer_desc<Input, Parameters...>>;
 
+    /*!
+     * The layer type, without the state only used by the training
+     */
+    using inference_layer_t = batch_normalization_2d_layer_impl<batch_normalization_2d_layer_desc<Input, Parameters..., inference_only>>;
+
     /*!
      * The dynamic layer type
      */
@@ -36,7 +46,7 @@ struct batch_normalization_2d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, inference_only_id>, Parameters...>,
         "Invalid parameters type for batch_normalization_2d_desc");
 };
 
@@ -62,7 +72,7 @@ struct dyn_batch_normalization_2d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, inference_only_id>, Parameters...>,
         "Invalid parameters type for batch_normalization_2d_desc");
 };
 
@@ -86,6 +96,11 @@ struct batch_normalization_4d_layer_desc {
      */
     static constexpr size_t Height = H;
 
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
     /*!
      * The type used to store the weights
      */
@@ -96,6 +111,11 @@ struct batch_normalization_4d_layer_desc {
      */
     using layer_t = batch_normalization_4d_layer_impl<batch_normalization_4d_layer_desc<K, W, H, Parameters...>>;
 
+    /*!
+     * The layer type, without the state only used by the training
+     */
+    using inference_layer_t = batch_normalization_4d_layer_impl<batch_normalization_4d_layer_desc<K, W, H, Parameters..., inference_only>>;
+
     /*!
      * The dynamic layer type
      */
@@ -103,7 +123,7 @@ struct batch_normalization_4d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, inference_only_id>, Parameters...>,
         "Invalid parameters type for batch_normalization_4d_desc");
 };
 
@@ -129,7 +149,7 @@ struct dyn_batch_normalization_4d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, inference_only_id>, Parameters...>,
         "Invalid parameters type for batch_normalization_4d_desc");
 };
 
@@ -24,12 +24,18 @@ struct conv_layer_desc {
     static constexpr size_t NC  = NC_T; ///< The number of input channels
     static constexpr size_t K   = K_T;  ///< The number of filters
 
+    static constexpr size_t S1 = detail::get_value_1<stride<1, 1>, Parameters...>::value;  ///< The stride of the first dimension
+    static constexpr size_t S2 = detail::get_value_2<stride<1, 1>, Parameters...>::value;  ///< The stride of the second dimension
+    static constexpr size_t P1 = detail::get_value_1<padding<0, 0>, Parameters...>::value; ///< The padding of the first dimension
+    static constexpr size_t P2 = detail::get_value_2<padding<0, 0>, Parameters...>::value; ///< The padding of the second dimension
+
     /*!
      * \brief A list of all the parameters of the descriptor
      */
     using parameters = cpp::type_list<Parameters...>;
 
     static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr conv_algorithm engine = detail::get_value_v<conv_engine<conv_algorithm::DIRECT>, Parameters...>; ///< The convolution algorithm
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -49,10 +55,12 @@ struct conv_layer_desc {
     static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
     static_assert(NC > 0, "At least one channel is necessary");
     static_assert(K > 0, "At least one group is necessary");
+    static_assert(S1 > 0 && S2 > 0, "The stride must be at least 1");
+    static_assert(NV1 + 2 * P1 >= NW1 && NV2 + 2 * P2 >= NW2, "The filters must fit in the padded input");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, conv_engine_id, fast_math_id, quantization_aware_id, stride_id, padding_id>, Parameters...>,
         "Invalid parameters type for rbm_desc");
 };
 
@@ -62,4 +70,18 @@ struct conv_layer_desc {
 template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, typename... Parameters>
 using conv_layer = typename conv_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, Parameters...>::layer_t;
 
+/*!
+ * \brief Describe a pointwise (1x1) convolutional layer, computed with
+ * one matrix multiplication per sample. After a depthwise convolutional
+ * layer, this is a depthwise separable convolution.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, typename... Parameters>
+using pointwise_conv_layer_desc = conv_layer_desc<NC_T, NV_1, NV_2, K_T, 1, 1, Parameters...>;
+
+/*!
+ * \brief Describe a pointwise (1x1) convolutional layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, typename... Parameters>
+using pointwise_conv_layer = typename pointwise_conv_layer_desc<NC_T, NV_1, NV_2, K_T, Parameters...>::layer_t;
+
 } //end of dll namespace
@@ -9,7 +9,10 @@
 
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"      // for auto_timer
+#include "dll/util/conv_engine.hpp" // for conv_engine_forward
+#include "dll/util/fast_math.hpp"   // for activate_inplace
+#include "dll/neural/fake_quantization.hpp" // for fake_quantization
 
 namespace dll {
 
@@ -29,12 +32,20 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the filter
     static constexpr size_t NC  = desc::NC;  ///< The number of input channels
     static constexpr size_t K   = desc::K;   ///< The number of filters
+    static constexpr size_t S1  = desc::S1;  ///< The stride of the first dimension
+    static constexpr size_t S2  = desc::S2;  ///< The stride of the second dimension
+    static constexpr size_t P1  = desc::P1;  ///< The padding of the first dimension
+    static constexpr size_t P2  = desc::P2;  ///< The padding of the second dimension
 
-    static constexpr size_t NH1 = NV1 - NW1 + 1; //By definition
-    static constexpr size_t NH2 = NV2 - NW2 + 1; //By definition
+    static constexpr size_t NH1 = (NV1 + 2 * P1 - NW1) / S1 + 1; //By definition
+    static constexpr size_t NH2 = (NV2 + 2 * P2 - NW2) / S2 + 1; //By definition
 
-    static constexpr auto activation_function = desc::activation_function; ///< The activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool lowered = conv_engine_lowered(desc::engine, NW1, NW2, S1, S2, P1, P2); ///< Indicates if the input is kept lowered for the gradients
+
+    static constexpr auto activation_function = desc::activation_function;                             ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
+    static constexpr auto quantization_aware  = desc::parameters::template contains<dll::quantization_aware>(); ///< Fake-quantize the weights and the input during training
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -55,6 +66,8 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    fake_quantization<weight, K, NC * NW1 * NW2, NC * NW1 * NW2, 1> quantization; ///< The learned scales of the int8 quantization (quantization_aware only)
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -93,11 +106,18 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     static std::string to_short_string() {
         char buffer[512];
+        char filter[128];
+
+        if /*constexpr*/ (S1 == 1 && S2 == 1 && P1 == 0 && P2 == 0) {
+            snprintf(filter, 128, "%lux%lux%lu", K, NW1, NW2);
+        } else {
+            snprintf(filter, 128, "%lux%lux%lu s%lux%lu p%lux%lu", K, NW1, NW2, S1, S2, P1, P2);
+        }
 
         if /*constexpr*/ (activation_function == function::IDENTITY) {
-            snprintf(buffer, 512, "Conv: %lux%lux%lu -> (%lux%lux%lu) -> %lux%lux%lu", NC, NV1, NV2, K, NW1, NW2, K, NH1, NH2);
+            snprintf(buffer, 512, "Conv: %lux%lux%lu -> (%s) -> %lux%lux%lu", NC, NV1, NV2, filter, K, NH1, NH2);
         } else {
-            snprintf(buffer, 512, "Conv: %lux%lux%lu -> (%lux%lux%lu) -> %s -> %lux%lux%lu", NC, NV1, NV2, K, NW1, NW2, to_string(activation_function).c_str(), K, NH1, NH2);
+            snprintf(buffer, 512, "Conv: %lux%lux%lu -> (%s) -> %s -> %lux%lux%lu", NC, NV1, NV2, filter, to_string(activation_function).c_str(), K, NH1, NH2);
         }
 
         return {buffer};
@@ -113,14 +133,14 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        output = etl::ml::convolution_forward(v, w);
+        conv_engine_forward(desc::engine, output, v, w, S1, S2, P1, P2);
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_4d(output, b);
         }
 
         if /*constexpr*/ (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            activate_inplace<activation_function, fast_math>(output);
         }
     }
 
@@ -134,14 +154,66 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
+        conv_engine_forward(desc::engine, output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w, S1, S2, P1, P2);
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_4d(output, b);
         }
 
         if /*constexpr*/ (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            activate_inplace<activation_function, fast_math>(output);
+        }
+    }
+
+    /*!
+     * \brief Compute the train presentation of the batch of inputs of the
+     * given SGD context into its batch of outputs.
+     *
+     * With im2col, the input is lowered into the workspace of the context,
+     * to be reused for the gradients of the kernels.
+     *
+     * When the layer is quantization-aware, the weights and the input are
+     * fake-quantized into the context first.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) {
+        cpp::static_if<quantization_aware>([&](auto f) {
+            auto& q = f(context).quantized;
+
+            quantization.init(w);
+            quantization.quantize_weights(q.w, w);
+            quantization.quantize_input(q.x, context.input);
+
+            this->forward_context(context, q.x, q.w);
+        }).else_([&](auto f) {
+            this->forward_context(f(context), context.input, w);
+        });
+    }
+
+    /*!
+     * \brief Compute the train presentation of the given batch of inputs
+     * with the given weights into the batch of outputs of the context.
+     */
+    template <typename C, typename I, typename W>
+    void forward_context(C& context, const I& input, const W& weights) const {
+        if /*constexpr*/ (!lowered) {
+            conv_engine_forward(desc::engine, context.output, input, weights, S1, S2, P1, P2);
+        } else {
+            dll::auto_timer timer("conv:train_forward_batch");
+
+            conv_engine_forward_lowered(context.output, input, weights, context.cols, S1, S2, P1, P2);
+
+            context.lowered = true;
+        }
+
+        if /*constexpr*/ (!no_bias) {
+            context.output = bias_add_4d(context.output, b);
+        }
+
+        if /*constexpr*/ (activation_function != function::IDENTITY) {
+            activate_inplace<activation_function, fast_math>(context.output);
         }
     }
 
@@ -172,7 +244,7 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
      */
     template<typename DRBM>
     static void dyn_init(DRBM& dyn){
-        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2);
+        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2, S1, S2, P1, P2);
     }
 
     /*!
@@ -200,7 +272,17 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        output = etl::ml::convolution_backward(context.errors, w);
+        cpp::static_if<quantization_aware>([&](auto f) {
+            auto& q = f(context).quantized;
+
+            conv_engine_backward(desc::engine, q.dx, context.errors, q.w, S1, S2, P1, P2);
+
+            q.backward = true;
+
+            quantization.input_errors(output, q.dx, context.input);
+        }).else_([&](auto f) {
+            conv_engine_backward(desc::engine, output, f(context).errors, w, S1, S2, P1, P2);
+        });
     }
 
     /*!
@@ -211,12 +293,46 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        cpp::static_if<quantization_aware>([&](auto f) {
+            auto& q = f(context).quantized;
+
+            auto& w_grad = std::get<0>(f(context).up.context)->grad;
+
+            // The gradients of the fake-quantized weights go to the weights and their scales
+            this->filter_gradients(w_grad, context, q.x);
+            quantization.weights_gradients(w_grad, std::get<2>(f(context).up.context)->grad, w);
+
+            // The first layer does not backpropagate its errors
+            if (!q.backward) {
+                conv_engine_backward(desc::engine, q.dx, context.errors, q.w, S1, S2, P1, P2);
+            }
+
+            quantization.input_gradients(std::get<3>(f(context).up.context)->grad, q.dx, context.input);
+
+            q.backward = false;
+        }).else_([&](auto f) {
+            this->filter_gradients(std::get<0>(f(context).up.context)->grad, context, context.input);
+        });
 
         if /*constexpr*/ (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
         }
     }
+
+    /*!
+     * \brief Compute the gradients of the filters from the given input of
+     * the forward pass of the context
+     */
+    template <typename G, typename C, typename I>
+    void filter_gradients(G& w_grad, C& context, const I& input) const {
+        // The workspace is only valid for the forward pass it was lowered by
+        if (context.lowered) {
+            conv_engine_backward_filter_lowered(w_grad, context.cols, context.errors);
+            context.lowered = false;
+        } else {
+            conv_engine_backward_filter(desc::engine, w_grad, input, context.errors, S1, S2, P1, P2);
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -245,6 +361,21 @@ const size_t conv_layer_impl<Desc>::NW2;
 template <typename Desc>
 const size_t conv_layer_impl<Desc>::K;
 
+template <typename Desc>
+const size_t conv_layer_impl<Desc>::S1;
+
+template <typename Desc>
+const size_t conv_layer_impl<Desc>::S2;
+
+template <typename Desc>
+const size_t conv_layer_impl<Desc>::P1;
+
+template <typename Desc>
+const size_t conv_layer_impl<Desc>::P2;
+
+template <typename Desc>
+const bool conv_layer_impl<Desc>::lowered;
+
 // Declare the traits for the Layer
 
 template<typename Desc>
@@ -286,8 +417,13 @@ struct sgd_context<DBN, conv_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, K, NH1, NH2> output;
     etl::fast_matrix<weight, batch_size, K, NH1, NH2> errors;
 
+    etl::dyn_matrix<weight, 3> cols; ///< The lowered input, only allocated when the layer uses im2col
+    bool lowered = false;            ///< Indicates if cols holds the lowered input of the last forward pass
+
+    fake_quantization_context<layer_t::quantization_aware, etl::fast_matrix<weight, K, NC, NW1, NW2>, etl::fast_matrix<weight, batch_size, NC, NV1, NV2>> quantized; ///< The fake-quantized weights and input (quantization_aware only)
+
     sgd_context(conv_layer_impl<Desc>& /* layer */)
-            : output(0.0), errors(0.0) {}
+            : output(0.0), errors(0.0), cols(layer_t::lowered ? batch_size : 0, NC * NW1 * NW2, NH1 * NH2) {}
 };
 
 } //end of dll namespace
@@ -0,0 +1,126 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused convolution and max pooling kernel.
+ *
+ * The valid correlation of B samples (C x V1 x V2) with K kernels
+ * (C x W1 x W2) is computed P1 rows at a time, in a tile of P1 x H2 output
+ * values, which is pooled with windows of P1 x P2 before the next rows
+ * are computed. Only the pooled output, and the position of each maximum
+ * in its window, are written to memory.
+ *
+ * The activation is not applied by the kernel: for a non-decreasing
+ * activation, the maximum of the activations is the activation of the
+ * maximum and it can be applied on the pooled output only.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace conv_mp_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Convolution, bias and max pooling of a batch, recording the
+ * position of each maximum in its window (r * P2 + s for the row r and
+ * the column s of the window).
+ *
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param bias The biases (K), or nullptr
+ * \param y The pooled output (B x K x (H1 / P1) x (H2 / P2))
+ * \param indices The position of the maximums, or nullptr
+ */
+template <typename T, typename I>
+void forward(size_t B, size_t C, size_t V1, size_t V2, size_t K, size_t W1, size_t W2, size_t P1, size_t P2,
+             const T* x, const T* w, const T* bias, T* y, I* indices) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+    const size_t O1 = H1 / P1;
+    const size_t O2 = H2 / P2;
+
+    // One task per output channel of each sample
+    for_each_task(B * K, B * K * H1 * H2 * C * W1 * W2, [=](size_t t) {
+        const size_t b = t / K;
+        const size_t k = t % K;
+
+        const T* xb = x + b * C * V1 * V2;
+        const T* wk = w + k * C * W1 * W2;
+        T* yk       = y + t * O1 * O2;
+
+        std::vector<T> tile(P1 * H2);
+
+        for (size_t i = 0; i < O1; ++i) {
+            std::fill(tile.begin(), tile.end(), bias ? bias[k] : T(0));
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t p = 0; p < W1; ++p) {
+                    for (size_t q = 0; q < W2; ++q) {
+                        const T wv = wk[(c * W1 + p) * W2 + q];
+
+                        for (size_t r = 0; r < P1; ++r) {
+                            const T* src = xb + (c * V1 + i * P1 + r + p) * V2 + q;
+                            T* dst       = tile.data() + r * H2;
+
+                            for (size_t j = 0; j < H2; ++j) {
+                                dst[j] += wv * src[j];
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < O2; ++j) {
+                T max      = tile[j * P2];
+                size_t pos = 0;
+
+                for (size_t r = 0; r < P1; ++r) {
+                    for (size_t s = 0; s < P2; ++s) {
+                        if (tile[r * H2 + j * P2 + s] > max) {
+                            max = tile[r * H2 + j * P2 + s];
+                            pos = r * P2 + s;
+                        }
+                    }
+                }
+
+                yk[i * O2 + j] = max;
+
+                if (indices) {
+                    indices[t * O1 * O2 + i * O2 + j] = I(pos);
+                }
+            }
+        }
+    });
+}
+
+} //end of namespace conv_mp_detail
+
+} //end of dll namespace
@@ -0,0 +1,75 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a convolutional layer followed by a max pooling layer,
+ * computed as a single layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t C_1, size_t C_2, typename... Parameters>
+struct conv_mp_layer_desc {
+    static constexpr size_t NV1 = NV_1; ///< The first dimension of the input
+    static constexpr size_t NV2 = NV_2; ///< The second dimension of the input
+    static constexpr size_t NW1 = NW_1; ///< The first dimension of the output
+    static constexpr size_t NW2 = NW_2; ///< The second dimension of the output
+    static constexpr size_t NC  = NC_T; ///< The number of input channels
+    static constexpr size_t K   = K_T;  ///< The number of filters
+    static constexpr size_t C1  = C_1;  ///< The first dimension of the pooling
+    static constexpr size_t C2  = C_2;  ///< The second dimension of the pooling
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr conv_algorithm engine = detail::get_value_v<conv_engine<conv_algorithm::DIRECT>, Parameters...>; ///< The convolution algorithm of the backpropagation
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The conv type */
+    using layer_t = conv_mp_layer_impl<conv_mp_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_1, C_2, Parameters...>>;
+
+    /*! The conv type (there is no dynamic version of this layer) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(NV1 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NV2 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NW1 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NC > 0, "At least one channel is necessary");
+    static_assert(K > 0, "At least one group is necessary");
+    static_assert(C1 > 0 && C2 > 0, "The pooling ratios must be at least 1");
+    static_assert(C1 <= NV1 - NW1 + 1 && C2 <= NV2 - NW2 + 1, "The pooling window must fit in the output of the convolution");
+
+    // The activation is applied after the pooling
+    static_assert(activation_function != function::SOFTMAX, "The activation function must be non-decreasing");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, conv_engine_id, fast_math_id>, Parameters...>,
+        "Invalid parameters type for conv_mp_layer_desc");
+};
+
+/*!
+ * \brief Describe a convolutional layer followed by a max pooling layer,
+ * computed as a single layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t C_1, size_t C_2, typename... Parameters>
+using conv_mp_layer = typename conv_mp_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_1, C_2, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,360 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"         // for auto_timer
+#include "dll/util/direct.hpp"         // for direct_memory
+#include "dll/util/conv_engine.hpp"    // for conv_engine_backward
+#include "dll/util/fast_math.hpp"      // for activate_inplace
+#include "dll/neural/conv_mp_kernels.hpp"
+#include "dll/pooling/mp_kernels.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Convolutional layer of neural network followed by a max pooling
+ * layer.
+ *
+ * The convolution, the biases and the pooling are computed by a single
+ * kernel and only the pooled output is written to memory. The activation
+ * is applied to the pooled output.
+ */
+template <typename Desc>
+struct conv_mp_layer_impl final : neural_layer<conv_mp_layer_impl<Desc>, Desc> {
+    using desc      = Desc;                          ///< The descriptor of the layer
+    using weight    = typename desc::weight;         ///< The data type of the layer
+    using this_type = conv_mp_layer_impl<desc>;      ///< The type of this layer
+    using base_type = neural_layer<this_type, desc>; ///< The base type of the layer
+
+    static constexpr size_t NV1 = desc::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = desc::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = desc::NW1; ///< The first dimension of the filter
+    static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the filter
+    static constexpr size_t NC  = desc::NC;  ///< The number of input channels
+    static constexpr size_t K   = desc::K;   ///< The number of filters
+    static constexpr size_t C1  = desc::C1;  ///< The first dimension of the pooling
+    static constexpr size_t C2  = desc::C2;  ///< The second dimension of the pooling
+
+    static constexpr size_t NH1 = NV1 - NW1 + 1; //By definition
+    static constexpr size_t NH2 = NV2 - NW2 + 1; //By definition
+
+    static constexpr size_t NP1 = NH1 / C1; ///< The first dimension of the pooled output
+    static constexpr size_t NP2 = NH2 / C2; ///< The second dimension of the pooled output
+
+    static constexpr auto activation_function = desc::activation_function;                             ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, K, NP1, NP2>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>; ///< The type of the input
+    using output_t     = std::vector<output_one_t>; ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, K, NC, NW1, NW2>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, K>; ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a conv layer with basic weights.
+     */
+    conv_mp_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), NH1 * NH2 * K);
+        b_initializer::initialize(b, input_size(), NH1 * NH2 * K);
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NC * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return K * NP1 * NP2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return K * NW1 * NW2;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string() {
+        char buffer[512];
+
+        if /*constexpr*/ (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Conv+MP: %lux%lux%lu -> (%lux%lux%lu) -> (%lux%lu) -> %lux%lux%lu", NC, NV1, NV2, K, NW1, NW2, C1, C2, K, NP1, NP2);
+        } else {
+            snprintf(buffer, 512, "Conv+MP: %lux%lux%lu -> (%lux%lux%lu) -> (%lux%lu) -> %s -> %lux%lux%lu", NC, NV1, NV2, K, NW1, NW2, C1, C2, to_string(activation_function).c_str(), K, NP1, NP2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 4)>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv_mp:forward_batch");
+
+        forward_impl(output, v, static_cast<mp_detail::index_t<C1 * C2>*>(nullptr));
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 2)>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("conv_mp:forward_batch");
+
+        forward_impl(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), static_cast<mp_detail::index_t<C1 * C2>*>(nullptr));
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context,
+     * recording the position of each maximum for the backpropagation
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        dll::auto_timer timer("conv_mp:train_forward_batch");
+
+        forward_impl(context.output, context.input, context.indices.data());
+
+        context.scattered = false;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("conv_mp:adapt_errors");
+
+        // The derivative at the maximum only depends on the pooled output
+        if /*constexpr*/ (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("conv_mp:backward_batch");
+
+        conv_engine_backward(desc::engine, output, conv_errors(context), w);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("conv_mp:compute_gradients");
+
+        conv_engine_backward_filter(desc::engine, std::get<0>(context.up.context)->grad, context.input, conv_errors(context));
+
+        if /*constexpr*/ (!no_bias) {
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.conv_errors);
+        }
+    }
+
+private:
+    /*!
+     * \brief Compute the pooled output of the given batch, and the position
+     * of the maximums if indices is not null
+     */
+    template <typename H1, typename V, typename I>
+    void forward_impl(H1&& output, const V& v, I* indices) const {
+        decltype(auto) x = direct_memory(v);
+
+        conv_mp_detail::forward(etl::dim<0>(x), NC, NV1, NV2, K, NW1, NW2, C1, C2,
+                                x.memory_start(), w.memory_start(), no_bias ? nullptr : b.memory_start(), output.memory_start(), indices);
+
+        if /*constexpr*/ (activation_function != function::IDENTITY) {
+            activate_inplace<activation_function, fast_math>(output);
+        }
+    }
+
+    /*!
+     * \brief Return the errors of the output of the convolution, the errors
+     * of the pooled output at the position of the maximums, computed once
+     * per batch
+     */
+    template <typename C>
+    static auto& conv_errors(C& context) {
+        if (!context.scattered) {
+            mp_detail::backward(etl::dim<0>(context.input), K, NH1, NH2, 1, C1, C2,
+                                context.errors.memory_start(), context.indices.data(), context.conv_errors.memory_start());
+
+            context.scattered = true;
+        }
+
+        return context.conv_errors;
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NV1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NV2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NH1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NH2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NP1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NP2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NW1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::NW2;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::C1;
+
+template <typename Desc>
+const size_t conv_mp_layer_impl<Desc>::C2;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<conv_mp_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false;  ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false;  ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for conv_mp_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, conv_mp_layer_impl<Desc>, L> {
+    using layer_t = conv_mp_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV1 = layer_t::NV1;
+    static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NH1 = layer_t::NH1;
+    static constexpr size_t NH2 = layer_t::NH2;
+    static constexpr size_t NP1 = layer_t::NP1;
+    static constexpr size_t NP2 = layer_t::NP2;
+    static constexpr size_t NC  = layer_t::NC;
+    static constexpr size_t K   = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
+    etl::fast_matrix<weight, batch_size, K, NP1, NP2> output;
+    etl::fast_matrix<weight, batch_size, K, NP1, NP2> errors;
+
+    etl::fast_matrix<weight, batch_size, K, NH1, NH2> conv_errors; ///< The errors of the output of the convolution
+
+    std::vector<mp_detail::index_t<layer_t::C1 * layer_t::C2>> indices; ///< The position of the maximum of each output
+
+    bool scattered = false; ///< Indicates if the errors of the convolution are computed
+
+    sgd_context(conv_mp_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0), indices(batch_size * K * NP1 * NP2) {}
+};
+
+} //end of dll namespace
@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_engine.hpp" // for deconv_engine_forward
+
 namespace dll {
 
 /*!
@@ -102,7 +104,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V, cpp_enable_iff(etl::decay_traits<H1>::is_fast)>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        deconv_engine_forward(desc::engine, output, v, w);
 
         static constexpr auto batch_size = etl::decay_traits<H1>::template dim<0>();
 
@@ -119,7 +121,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V, cpp_disable_if(etl::decay_traits<H1>::is_fast)>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        deconv_engine_forward(desc::engine, output, v, w);
 
         auto batch_size = etl::dim<0>(output);
 
@@ -182,7 +184,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() == 4)>
     void backward_batch(H&& output, C& context) const {
-        output = etl::conv_4d_valid_flipped(context.errors, w);
+        conv_engine_forward(desc::engine, output, context.errors, w);
     }
 
     /*!
@@ -193,7 +195,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
     template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() != 4)>
     void backward_batch(H&& output, C& context) const {
         static constexpr auto B = etl::decay_traits<H>::template dim<0>();
-        etl::reshape<B, NC, NV1, NV2>(output) = etl::conv_4d_valid_flipped(context.errors, w);
+        conv_engine_forward(desc::engine, etl::reshape<B, NC, NV1, NV2>(output), context.errors, w);
     }
 
     /*!
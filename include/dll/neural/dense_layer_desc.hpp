@@ -45,7 +45,7 @@ struct dense_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>,
+            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, sparse_input_id, fast_math_id, quantization_aware_id, sparse_relu_id>,
             Parameters...>,
         "Invalid parameters type for dense_layer_desc");
 };
@@ -10,7 +10,11 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"    // for auto_timer
+#include "dll/util/sparse.hpp"    // for sparse_mul
+#include "dll/util/block_sparse.hpp" // for block_sparse_mul
+#include "dll/util/fast_math.hpp" // for activate_inplace
+#include "dll/neural/fake_quantization.hpp" // for fake_quantization
 
 namespace dll {
 
@@ -27,8 +31,15 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
     static constexpr size_t num_hidden  = desc::num_hidden;  ///< The number of hidden units
 
-    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto activation_function = desc::activation_function;                                ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();      ///< Disable the biases
+    static constexpr auto sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Use sparse products for the inputs
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>();    ///< Use the fast activation functions
+    static constexpr auto quantization_aware  = desc::parameters::template contains<dll::quantization_aware>(); ///< Fake-quantize the weights and the input during training
+    static constexpr auto sparse_relu         = desc::parameters::template contains<dll::sparse_relu>();  ///< Use sparse products for the errors of the ReLU units
+
+    static_assert(!(quantization_aware && sparse_input), "The quantization-aware dense layer does not support sparse inputs");
+    static_assert(!(quantization_aware && sparse_relu), "The quantization-aware dense layer does not support sparse errors");
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -49,6 +60,10 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    block_sparsity w_blocks; ///< The kept blocks of the weights, if they are block-sparse
+
+    fake_quantization<weight, num_hidden, num_visible, 1, num_hidden> quantization; ///< The learned scales of the int8 quantization (quantization_aware only)
+
     /*!
      * \brief Initialize a dense layer with basic weights.
      *
@@ -114,13 +129,51 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
+        if (w_blocks.enabled()) {
+            block_sparse_mul(output, input, w, w_blocks);
+        } else if (!sparse_input || !sparse_mul(output, input, w)) {
+            output = etl::reshape(input, Batch, num_visible) * w;
+        }
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_2d(output, b);
         }
 
-        output = f_activate<activation_function>(output);
+        activate_inplace<activation_function, fast_math>(output);
+    }
+
+    /*!
+     * \brief Compute the train presentation of the batch of inputs of the
+     * given SGD context into its batch of outputs.
+     *
+     * When the layer is quantization-aware, the weights and the input are
+     * fake-quantized into the context first.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) {
+        cpp::static_if<quantization_aware>([&](auto f) {
+            dll::auto_timer timer("dense:train_forward_batch:qat");
+
+            cpp_assert(!w_blocks.enabled(), "The quantization-aware dense layer does not support block-sparse weights");
+
+            auto& q = f(context).quantized;
+
+            quantization.init(w);
+            quantization.quantize_weights(q.w, w);
+            quantization.quantize_input(q.x, context.input);
+
+            context.output = q.x * q.w;
+
+            if /*constexpr*/ (!no_bias) {
+                context.output = bias_add_2d(context.output, b);
+            }
+
+            activate_inplace<activation_function, fast_math>(context.output);
+        }).else_([&](auto f) {
+            this->forward_batch(f(context).output, context.input);
+        });
     }
 
     /*!
@@ -183,7 +236,21 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
-        etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
+
+        cpp::static_if<quantization_aware>([&](auto f) {
+            auto& q = f(context).quantized;
+
+            q.dx       = context.errors * etl::transpose(q.w);
+            q.backward = true;
+
+            auto reshaped = etl::reshape<Batch, num_visible>(output);
+            quantization.input_errors(reshaped, q.dx, context.input);
+        }).else_([&](auto f) {
+            // The errors of the inactive ReLU units are zero
+            if (!sparse_relu || !sparse_mul_transposed(etl::reshape<Batch, num_visible>(output), f(context).errors, w)) {
+                etl::reshape<Batch, num_visible>(output) = f(context).errors * etl::transpose(w);
+            }
+        });
     }
 
     /*!
@@ -194,11 +261,40 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::auto_timer timer("dense:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
-
         if /*constexpr*/ (!no_bias) {
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
         }
+
+        cpp::static_if<quantization_aware>([&](auto f) {
+            auto& q = f(context).quantized;
+
+            auto& w_grad = std::get<0>(f(context).up.context)->grad;
+
+            // The gradients of the fake-quantized weights go to the weights and their scales
+            w_grad = batch_outer(q.x, context.errors);
+            quantization.weights_gradients(w_grad, std::get<2>(f(context).up.context)->grad, w);
+
+            // The first layer does not backpropagate its errors
+            if (!q.backward) {
+                q.dx = context.errors * etl::transpose(q.w);
+            }
+
+            quantization.input_gradients(std::get<3>(f(context).up.context)->grad, q.dx, context.input);
+
+            q.backward = false;
+        }).else_([&](auto f) {
+            auto& w_grad = std::get<0>(f(context).up.context)->grad;
+
+            if (sparse_input && sparse_batch_outer(w_grad, context.input, context.errors)) {
+                return;
+            }
+
+            if (sparse_relu && sparse_errors_outer(w_grad, context.input, context.errors)) {
+                return;
+            }
+
+            w_grad = batch_outer(context.input, context.errors);
+        });
     }
 };
 
@@ -245,6 +341,8 @@ struct sgd_context<DBN, dense_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, num_hidden> output;
     etl::fast_matrix<weight, batch_size, num_hidden> errors;
 
+    fake_quantization_context<layer_t::quantization_aware, etl::fast_matrix<weight, num_visible, num_hidden>, etl::fast_matrix<weight, batch_size, num_visible>> quantized; ///< The fake-quantized weights and input (quantization_aware only)
+
     sgd_context(const dense_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
@@ -0,0 +1,282 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Direct kernels of the depthwise convolutions.
+ *
+ * Each channel c of B samples (C x V1 x V2) is correlated with its own
+ * kernel (W1 x W2), zero-padded by P1 x P2 and with a stride of S1 x S2,
+ * giving B outputs (C x H1 x H2). The kernels are accumulated one weight
+ * at a time over the columns of an output row. For the columns whose
+ * input is inside the sample the inner loop has no branch, and with a
+ * stride of 1 it is contiguous, so it is vectorized across the width.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+namespace depthwise_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of operations of a batch to be computed in parallel
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Return the first output column j whose input column
+ * j * S + q - P is not in the left padding
+ */
+inline size_t first_column(size_t S, size_t P, size_t q) {
+    return q >= P ? 0 : (P - q + S - 1) / S;
+}
+
+/*!
+ * \brief Return the past-the-end output column j whose input column
+ * j * S + q - P is not in the right padding
+ */
+inline size_t last_column(size_t H, size_t V, size_t S, size_t P, size_t q) {
+    return V + P <= q ? 0 : std::min(H, (V + P - q + S - 1) / S);
+}
+
+/*!
+ * \brief Depthwise correlation of a batch
+ *
+ * \param y The output (B x C x H1 x H2)
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (C x W1 x W2)
+ */
+template <typename T>
+void forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    for_each_task(B * C, B * C * H1 * H2 * W1 * W2, [&](size_t bc) {
+        const T* xc = x + bc * V1 * V2;
+        const T* wc = w + (bc % C) * W1 * W2;
+        T* yc       = y + bc * H1 * H2;
+
+        std::fill(yc, yc + H1 * H2, T(0));
+
+        for (size_t i = 0; i < H1; ++i) {
+            T* yr = yc + i * H2;
+
+            for (size_t p = 0; p < W1; ++p) {
+                // Unsigned wrap-around makes the padding rows out of range
+                const size_t ii = i * S1 + p - P1;
+
+                if (ii >= V1) {
+                    continue;
+                }
+
+                const T* xr = xc + ii * V2;
+
+                for (size_t q = 0; q < W2; ++q) {
+                    const T wv     = wc[p * W2 + q];
+                    const size_t f = first_column(S2, P2, q);
+                    const size_t l = last_column(H2, V2, S2, P2, q);
+
+                    if (S2 == 1) {
+                        const T* xs = xr + f + q - P2;
+
+                        for (size_t j = f; j < l; ++j) {
+                            yr[j] += wv * xs[j - f];
+                        }
+                    } else {
+                        for (size_t j = f; j < l; ++j) {
+                            yr[j] += wv * xr[j * S2 + q - P2];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Errors of the input of a depthwise correlation
+ *
+ * \param dx The output errors (B x C x V1 x V2)
+ * \param dy The errors of the output (B x C x H1 x H2)
+ * \param w The kernels (C x W1 x W2)
+ */
+template <typename T>
+void backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    for_each_task(B * C, B * C * H1 * H2 * W1 * W2, [&](size_t bc) {
+        const T* dyc = dy + bc * H1 * H2;
+        const T* wc  = w + (bc % C) * W1 * W2;
+        T* dxc       = dx + bc * V1 * V2;
+
+        std::fill(dxc, dxc + V1 * V2, T(0));
+
+        for (size_t i = 0; i < H1; ++i) {
+            const T* dyr = dyc + i * H2;
+
+            for (size_t p = 0; p < W1; ++p) {
+                const size_t ii = i * S1 + p - P1;
+
+                if (ii >= V1) {
+                    continue;
+                }
+
+                T* dxr = dxc + ii * V2;
+
+                for (size_t q = 0; q < W2; ++q) {
+                    const T wv     = wc[p * W2 + q];
+                    const size_t f = first_column(S2, P2, q);
+                    const size_t l = last_column(H2, V2, S2, P2, q);
+
+                    if (S2 == 1) {
+                        T* dxs = dxr + f + q - P2;
+
+                        for (size_t j = f; j < l; ++j) {
+                            dxs[j - f] += wv * dyr[j];
+                        }
+                    } else {
+                        for (size_t j = f; j < l; ++j) {
+                            dxr[j * S2 + q - P2] += wv * dyr[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Gradients of the kernels of a depthwise correlation, the
+ * channels being computed in parallel
+ *
+ * \param dw The gradients (C x W1 x W2)
+ * \param x The input (B x C x V1 x V2)
+ * \param dy The errors of the output (B x C x H1 x H2)
+ */
+template <typename T>
+void backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    for_each_task(C, B * C * H1 * H2 * W1 * W2, [&](size_t c) {
+        T* dwc = dw + c * W1 * W2;
+
+        for (size_t p = 0; p < W1; ++p) {
+            for (size_t q = 0; q < W2; ++q) {
+                const size_t f = first_column(S2, P2, q);
+                const size_t l = last_column(H2, V2, S2, P2, q);
+
+                T acc(0);
+
+                for (size_t b = 0; b < B; ++b) {
+                    const T* xc  = x + (b * C + c) * V1 * V2;
+                    const T* dyc = dy + (b * C + c) * H1 * H2;
+
+                    for (size_t i = 0; i < H1; ++i) {
+                        const size_t ii = i * S1 + p - P1;
+
+                        if (ii >= V1) {
+                            continue;
+                        }
+
+                        const T* xr  = xc + ii * V2;
+                        const T* dyr = dyc + i * H2;
+
+                        for (size_t j = f; j < l; ++j) {
+                            acc += dyr[j] * xr[j * S2 + q - P2];
+                        }
+                    }
+                }
+
+                dwc[p * W2 + q] = acc;
+            }
+        }
+    });
+}
+
+} //end of namespace depthwise_detail
+
+/*!
+ * \brief Compute y[b][c] = valid_correlation(x[b][c], w[c]), strided and
+ * zero-padded
+ * \param y The output (B x C x H1 x H2)
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (C x W1 x W2)
+ */
+template <typename Y, typename X, typename W>
+void depthwise_forward(Y&& y, const X& x, const W& w, size_t s1, size_t s2, size_t p1, size_t p2) {
+    decltype(auto) xd = direct_memory(x);
+    decltype(auto) wd = direct_memory(w);
+
+    dll::host_read(xd, wd);
+
+    depthwise_detail::forward(y.memory_start(), xd.memory_start(), wd.memory_start(),
+                              etl::dim<0>(x), etl::dim<1>(x), etl::dim<2>(x), etl::dim<3>(x), etl::dim<1>(w), etl::dim<2>(w), s1, s2, p1, p2);
+
+    dll::host_written(y);
+}
+
+/*!
+ * \brief Compute the errors dx of the input of a depthwise correlation
+ * \param dx The output errors (B x C x V1 x V2)
+ * \param dy The errors of the output (B x C x H1 x H2)
+ * \param w The kernels (C x W1 x W2)
+ */
+template <typename DX, typename DY, typename W>
+void depthwise_backward(DX&& dx, const DY& dy, const W& w, size_t s1, size_t s2, size_t p1, size_t p2) {
+    decltype(auto) dyd = direct_memory(dy);
+    decltype(auto) wd  = direct_memory(w);
+
+    dll::host_read(dyd, wd);
+
+    depthwise_detail::backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(),
+                               etl::dim<0>(dx), etl::dim<1>(dx), etl::dim<2>(dx), etl::dim<3>(dx), etl::dim<1>(w), etl::dim<2>(w), s1, s2, p1, p2);
+
+    dll::host_written(dx);
+}
+
+/*!
+ * \brief Compute the gradients dw of the kernels of a depthwise correlation
+ * \param dw The gradients (C x W1 x W2)
+ * \param x The input (B x C x V1 x V2)
+ * \param dy The errors of the output (B x C x H1 x H2)
+ */
+template <typename DW, typename X, typename DY>
+void depthwise_backward_filter(DW&& dw, const X& x, const DY& dy, size_t s1, size_t s2, size_t p1, size_t p2) {
+    decltype(auto) xd  = direct_memory(x);
+    decltype(auto) dyd = direct_memory(dy);
+
+    dll::host_read(xd, dyd);
+
+    depthwise_detail::backward_filter(dw.memory_start(), xd.memory_start(), dyd.memory_start(),
+                                      etl::dim<0>(x), etl::dim<1>(x), etl::dim<2>(x), etl::dim<3>(x), etl::dim<1>(dw), etl::dim<2>(dw), s1, s2, p1, p2);
+
+    dll::host_written(dw);
+}
+
+} //end of dll namespace
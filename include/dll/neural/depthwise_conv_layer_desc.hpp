@@ -0,0 +1,71 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a depthwise convolutional layer, each input channel
+ * being convolved with its own filter.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t NW_1, size_t NW_2, typename... Parameters>
+struct depthwise_conv_layer_desc {
+    static constexpr size_t NV1 = NV_1; ///< The first dimension of the input
+    static constexpr size_t NV2 = NV_2; ///< The second dimension of the input
+    static constexpr size_t NW1 = NW_1; ///< The first dimension of the filters
+    static constexpr size_t NW2 = NW_2; ///< The second dimension of the filters
+    static constexpr size_t NC  = NC_T; ///< The number of channels
+
+    static constexpr size_t S1 = detail::get_value_1<stride<1, 1>, Parameters...>::value;  ///< The stride of the first dimension
+    static constexpr size_t S2 = detail::get_value_2<stride<1, 1>, Parameters...>::value;  ///< The stride of the second dimension
+    static constexpr size_t P1 = detail::get_value_1<padding<0, 0>, Parameters...>::value; ///< The padding of the first dimension
+    static constexpr size_t P2 = detail::get_value_2<padding<0, 0>, Parameters...>::value; ///< The padding of the second dimension
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The depthwise conv type */
+    using layer_t = depthwise_conv_layer_impl<depthwise_conv_layer_desc<NC_T, NV_1, NV_2, NW_1, NW_2, Parameters...>>;
+
+    /*! The dynamic depthwise conv type */
+    using dyn_layer_t = dyn_depthwise_conv_layer_impl<dyn_depthwise_conv_layer_desc<Parameters...>>;
+
+    static_assert(NV1 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NV2 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NW1 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NW2 > 0, "A matrix of at least 1x1 is necessary for the weights");
+    static_assert(NC > 0, "At least one channel is necessary");
+    static_assert(S1 > 0 && S2 > 0, "The stride must be at least 1");
+    static_assert(NV1 + 2 * P1 >= NW1 && NV2 + 2 * P2 >= NW2, "The filters must fit in the padded input");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, fast_math_id, stride_id, padding_id>, Parameters...>,
+        "Invalid parameters type for depthwise_conv_layer_desc");
+};
+
+/*!
+ * \brief Describe a depthwise convolutional layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t NW_1, size_t NW_2, typename... Parameters>
+using depthwise_conv_layer = typename depthwise_conv_layer_desc<NC_T, NV_1, NV_2, NW_1, NW_2, Parameters...>::layer_t;
+
+} //end of dll namespace
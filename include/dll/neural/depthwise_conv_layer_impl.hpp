@@ -0,0 +1,312 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"                   // for auto_timer
+#include "dll/util/fast_math.hpp"                // for activate_inplace
+#include "dll/neural/depthwise_conv_kernels.hpp" // for depthwise_forward
+
+namespace dll {
+
+/*!
+ * \brief Depthwise convolutional layer of neural network.
+ *
+ * Each input channel is convolved with its own filter, there are as many
+ * outputs as inputs channels. Followed by a pointwise (1x1) convolutional
+ * layer, this is a depthwise separable convolution.
+ */
+template <typename Desc>
+struct depthwise_conv_layer_impl final : neural_layer<depthwise_conv_layer_impl<Desc>, Desc> {
+    using desc      = Desc;                            ///< The descriptor of the layer
+    using weight    = typename desc::weight;           ///< The data type of the layer
+    using this_type = depthwise_conv_layer_impl<desc>; ///< The type of this layer
+    using base_type = neural_layer<this_type, desc>;   ///< The base type of the layer
+
+    static constexpr size_t NV1 = desc::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = desc::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = desc::NW1; ///< The first dimension of the filter
+    static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the filter
+    static constexpr size_t NC  = desc::NC;  ///< The number of channels
+    static constexpr size_t K   = desc::NC;  ///< The number of filters
+    static constexpr size_t S1  = desc::S1;  ///< The stride of the first dimension
+    static constexpr size_t S2  = desc::S2;  ///< The stride of the second dimension
+    static constexpr size_t P1  = desc::P1;  ///< The padding of the first dimension
+    static constexpr size_t P2  = desc::P2;  ///< The padding of the second dimension
+
+    static constexpr size_t NH1 = (NV1 + 2 * P1 - NW1) / S1 + 1; //By definition
+    static constexpr size_t NH2 = (NV2 + 2 * P2 - NW2) / S2 + 1; //By definition
+
+    static constexpr auto activation_function = desc::activation_function;                             ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, NC, NH1, NH2>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                   ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                  ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, NC, NW1, NW2>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, NC>;           ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a depthwise conv layer with basic weights.
+     *
+     * The fan-in of a filter is the size of one filter.
+     */
+    depthwise_conv_layer_impl() : base_type() {
+        w_initializer::initialize(w, NW1 * NW2, NH1 * NH2);
+        b_initializer::initialize(b, NW1 * NW2, NH1 * NH2);
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NC * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return NC * NH1 * NH2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return NC * NW1 * NW2;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string() {
+        char buffer[512];
+        char filter[128];
+
+        if /*constexpr*/ (S1 == 1 && S2 == 1 && P1 == 0 && P2 == 0) {
+            snprintf(filter, 128, "%lux%lux%lu", NC, NW1, NW2);
+        } else {
+            snprintf(filter, 128, "%lux%lux%lu s%lux%lu p%lux%lu", NC, NW1, NW2, S1, S2, P1, P2);
+        }
+
+        if /*constexpr*/ (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "DepthwiseConv: %lux%lux%lu -> (%s) -> %lux%lux%lu", NC, NV1, NV2, filter, NC, NH1, NH2);
+        } else {
+            snprintf(buffer, 512, "DepthwiseConv: %lux%lux%lu -> (%s) -> %s -> %lux%lux%lu", NC, NV1, NV2, filter, to_string(activation_function).c_str(), NC, NH1, NH2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 4)>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("depthwise_conv:forward_batch");
+
+        depthwise_forward(output, v, w, S1, S2, P1, P2);
+
+        if /*constexpr*/ (!no_bias) {
+            output = bias_add_4d(output, b);
+        }
+
+        if /*constexpr*/ (activation_function != function::IDENTITY) {
+            activate_inplace<activation_function, fast_math>(output);
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 2)>
+    void forward_batch(H1&& output, const V& v) const {
+        forward_batch(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2));
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        dyn.init_layer(NC, NV1, NV2, NW1, NW2, S1, S2, P1, P2);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("depthwise_conv:adapt_errors");
+
+        if /*constexpr*/ (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("depthwise_conv:backward_batch");
+
+        depthwise_backward(output, context.errors, w, S1, S2, P1, P2);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("depthwise_conv:compute_gradients");
+
+        depthwise_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors, S1, S2, P1, P2);
+
+        if /*constexpr*/ (!no_bias) {
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NV1;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NV2;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NH1;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NH2;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NW1;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::NW2;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::S1;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::S2;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::P1;
+
+template <typename Desc>
+const size_t depthwise_conv_layer_impl<Desc>::P2;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<depthwise_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for depthwise_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, depthwise_conv_layer_impl<Desc>, L> {
+    using layer_t = depthwise_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV1 = layer_t::NV1;
+    static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NH1 = layer_t::NH1;
+    static constexpr size_t NH2 = layer_t::NH2;
+    static constexpr size_t NC  = layer_t::NC;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
+    etl::fast_matrix<weight, batch_size, NC, NH1, NH2> output;
+    etl::fast_matrix<weight, batch_size, NC, NH1, NH2> errors;
+
+    sgd_context(layer_t& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
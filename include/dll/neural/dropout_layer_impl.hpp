@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <vector>
+#include <cstdint>
+
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/counter_rng.hpp"
 
 namespace dll {
 
@@ -61,14 +65,53 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void train_forward_batch(Output& output, const Input& input) {
-        std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-        auto& g = dll::rand_engine();
+        using T = etl::value_t<Output>;
 
-        output = input;
+        decltype(auto) in = direct_memory(input);
+        const T* x        = in.memory_start();
 
-        for(size_t i = 0; i < etl::size(output); ++i){
-            output[i] = dist(g) < p ? 0.0 : (input[i] / p);
-        }
+        next_rng().for_each_uniform<float>(etl::size(output), [&](size_t i, float u) {
+            output[i] = u < p ? T(0) : T(x[i] / p);
+        });
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context.
+     *
+     * The mask of the kept values is stored in the context, one bit per
+     * value, for the backpropagation.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        using T = etl::value_t<decltype(context.output)>;
+
+        const size_t n = etl::size(context.output);
+
+        context.mask.resize((n + 63) / 64);
+
+        decltype(auto) in = direct_memory(context.input);
+        const T* x        = in.memory_start();
+        T* y              = context.output.memory_start();
+        uint64_t* mask    = context.mask.data();
+
+        // The parallel blocks of the generator are multiples of 64 values,
+        // each word of the mask is written by a single task
+        static_assert(counter_rng::parallel_block % 64 == 0, "Invalid block size for the mask");
+
+        next_rng().for_each_uniform<float>(n, [x, y, mask](size_t i, float u) {
+            if (!(i & 63)) {
+                mask[i / 64] = 0;
+            }
+
+            if (u < p) {
+                y[i] = T(0);
+            } else {
+                y[i] = T(x[i] / p);
+                mask[i / 64] |= uint64_t(1) << (i & 63);
+            }
+        });
     }
 
     /*!
@@ -90,7 +133,33 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        output = context.errors;
+        using T = etl::value_t<decltype(context.errors)>;
+
+        const size_t n = etl::size(context.errors);
+
+        const T* e           = context.errors.memory_start();
+        T* y                 = output.memory_start();
+        const uint64_t* mask = context.mask.data();
+
+        // Same scaling as the forward pass, the dropped values have no gradient
+        auto task = [=](size_t t) {
+            const size_t first = t * counter_rng::parallel_block;
+            const size_t last  = std::min(n, first + counter_rng::parallel_block);
+
+            for (size_t i = first; i < last; ++i) {
+                y[i] = (mask[i / 64] >> (i & 63)) & 1 ? T(e[i] / p) : T(0);
+            }
+        };
+
+        const size_t tasks = (n + counter_rng::parallel_block - 1) / counter_rng::parallel_block;
+
+        if (n >= counter_rng::parallel_threshold && tasks > 1) {
+            parallel_for_n(tasks, task);
+        } else {
+            for (size_t t = 0; t < tasks; ++t) {
+                task(t);
+            }
+        }
     }
 
     /*!
@@ -129,12 +198,14 @@ struct sgd_context<DBN, dropout_layer_impl<Desc>, L> {
     using layer_t          = dropout_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
 
     inputs_t input;  ///< A batch of input
     inputs_t output; ///< A batch of output
     inputs_t errors; ///< A batch of errors
 
+    std::vector<uint64_t> mask; ///< The mask of the kept values, one bit per value
+
     sgd_context(layer_t& /*layer*/){}
 };
 
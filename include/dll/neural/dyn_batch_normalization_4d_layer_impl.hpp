@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/neural/batch_normalization_kernels.hpp"
 
 namespace dll {
 
@@ -142,35 +143,19 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        cpp_unused(output);
-
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
-
-        // Compute the variance of the mini-batch
-        last_var  = 0;
-
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
+        if (etl::size(input_pre) != etl::size(input)) {
+            input_pre = etl::dyn_matrix<weight, 4>(B, Kernels, W, H);
         }
 
-        last_var /= S;
-
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
-
-        input_pre.inherit_if_null(input);
+        decltype(auto) x = direct_memory(input);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
-            }
-        }
+        // Statistics, normalization, scale and shift in one pass per channel
+        bn_detail::train_forward(B, Kernels, W * H, x.memory_start(), input_pre.memory_start(), output.memory_start(),
+                                 gamma.memory_start(), beta.memory_start(),
+                                 last_mean.memory_start(), last_var.memory_start(), inv_var.memory_start(), e);
 
         //// Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -197,27 +182,16 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
-
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
-
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
-            }
-        }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        *dxhat_l;
-        *dxhat_xhat_l;
+        // The gradients of gamma and beta are computed in the same pass
+        bn_detail::backward(B, Kernels, W * H, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            output.memory_start(), dgamma.memory_start(), dbeta.memory_start());
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
-            }
-        }
+        context.gradients_ready = true;
     }
 
     /*!
@@ -226,11 +200,20 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        // Already computed by backward_batch
+        if (context.gradients_ready) {
+            context.gradients_ready = false;
+            return;
+        }
+
+        const auto B = etl::dim<0>(context.input);
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
+
+        bn_detail::backward(B, Kernels, W * H, context.errors.memory_start(), input_pre.memory_start(),
+                            gamma.memory_start(), inv_var.memory_start(),
+                            static_cast<weight*>(nullptr), dgamma.memory_start(), dbeta.memory_start());
     }
 
     /*!
@@ -277,6 +260,22 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         return std::make_tuple(std::ref(gamma), std::ref(beta));
     }
 
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::make_tuple(std::ref(gamma), std::ref(beta), std::ref(mean), std::ref(var));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::make_tuple(std::cref(gamma), std::cref(beta), std::cref(mean), std::cref(var));
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -292,6 +291,16 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         gamma = *bak_gamma;
         beta  = *bak_beta;
     }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(gamma, bak_gamma);
+        swap_backup(beta, bak_beta);
+    }
 };
 
 // Declare the traits for the layer
@@ -326,6 +335,8 @@ struct sgd_context<DBN, dyn_batch_normalization_4d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output; ///< A batch of output
     etl::dyn_matrix<weight, 4> errors; ///< A batch of errors
 
+    bool gradients_ready = false; ///< Indicates that the gradients were computed by backward_batch
+
     sgd_context(layer_t& layer)
             : input(batch_size, layer.Kernels, layer.W, layer.H), output(batch_size, layer.Kernels, layer.W, layer.H), errors(batch_size, layer.Kernels, layer.W, layer.H) {}
 };
@@ -10,7 +10,9 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"      // for auto_timer
+#include "dll/util/conv_engine.hpp" // for conv_engine_forward
+#include "dll/util/fast_math.hpp"   // for activate_inplace
 
 namespace dll {
 
@@ -24,8 +26,9 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     using this_type = dyn_conv_layer_impl<desc>;  ///< This type
     using base_type = neural_layer<this_type, desc>;
 
-    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto activation_function = desc::activation_function;                             ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -56,6 +59,11 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     size_t nw1; ///< The first dimension of the filters
     size_t nw2; ///< The second dimension of the filters
 
+    size_t s1; ///< The stride of the first dimension
+    size_t s2; ///< The stride of the second dimension
+    size_t p1; ///< The padding of the first dimension
+    size_t p2; ///< The padding of the second dimension
+
     dyn_conv_layer_impl(): base_type() {
         // Nothing else to init
     }
@@ -63,7 +71,10 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     /*!
      * \brief Initialize the dynamic layer
      */
-    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2){
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0){
+        cpp_assert(s1 > 0 && s2 > 0, "The stride must be at least 1");
+        cpp_assert(nv1 + 2 * p1 >= nw1 && nv2 + 2 * p2 >= nw2, "The filters must fit in the padded input");
+
         this->nv1 = nv1;
         this->nv2 = nv2;
         this->nw1 = nw1;
@@ -71,8 +82,13 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         this->nc = nc;
         this->k = k;
 
-        this->nh1 = nv1 - nw1 + 1;
-        this->nh2 = nv2 - nw2 + 1;
+        this->s1 = s1;
+        this->s2 = s2;
+        this->p1 = p1;
+        this->p2 = p2;
+
+        this->nh1 = (nv1 + 2 * p1 - nw1) / s1 + 1;
+        this->nh2 = (nv2 + 2 * p2 - nw2) / s2 + 1;
 
         w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
 
@@ -112,11 +128,18 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     std::string to_short_string() const {
         char buffer[512];
+        char filter[128];
+
+        if (s1 == 1 && s2 == 1 && p1 == 0 && p2 == 0) {
+            snprintf(filter, 128, "%lux%lux%lu", k, nw1, nw2);
+        } else {
+            snprintf(filter, 128, "%lux%lux%lu s%lux%lu p%lux%lu", k, nw1, nw2, s1, s2, p1, p2);
+        }
 
         if /*constexpr*/ (activation_function == function::IDENTITY) {
-            snprintf(buffer, 512, "Conv(dyn): %lux%lux%lu -> (%lux%lux%lu) -> %lux%lux%lu", nc, nv1, nv2, k, nw1, nw2, k, nh1, nh2);
+            snprintf(buffer, 512, "Conv(dyn): %lux%lux%lu -> (%s) -> %lux%lux%lu", nc, nv1, nv2, filter, k, nh1, nh2);
         } else {
-            snprintf(buffer, 512, "Conv(dyn): %lux%lux%lu -> (%lux%lux%lu) -> %s -> %lux%lux%lu", nc, nv1, nv2, k, nw1, nw2, to_string(activation_function).c_str(), k, nh1, nh2);
+            snprintf(buffer, 512, "Conv(dyn): %lux%lux%lu -> (%s) -> %s -> %lux%lux%lu", nc, nv1, nv2, filter, to_string(activation_function).c_str(), k, nh1, nh2);
         }
 
         return {buffer};
@@ -132,14 +155,14 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        output = etl::ml::convolution_forward(v, w);
+        conv_engine_forward(desc::engine, output, v, w, s1, s2, p1, p2);
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_4d(output, b);
         }
 
         if /*constexpr*/ (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            activate_inplace<activation_function, fast_math>(output);
         }
     }
 
@@ -153,14 +176,52 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
+        conv_engine_forward(desc::engine, output, etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, s1, s2, p1, p2);
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_4d(output, b);
         }
 
         if /*constexpr*/ (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            activate_inplace<activation_function, fast_math>(output);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the input is kept lowered for the gradients
+     */
+    bool lowered() const noexcept {
+        return conv_engine_lowered(desc::engine, nw1, nw2, s1, s2, p1, p2);
+    }
+
+    /*!
+     * \brief Compute the train presentation of the batch of inputs of the
+     * given SGD context into its batch of outputs.
+     *
+     * With im2col, the input is lowered into the workspace of the context,
+     * to be reused for the gradients of the kernels.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        if (!lowered()) {
+            forward_batch(context.output, context.input);
+            return;
+        }
+
+        dll::auto_timer timer("conv:train_forward_batch");
+
+        conv_engine_forward_lowered(context.output, context.input, w, context.cols, s1, s2, p1, p2);
+
+        context.lowered = true;
+
+        if /*constexpr*/ (!no_bias) {
+            context.output = bias_add_4d(context.output, b);
+        }
+
+        if /*constexpr*/ (activation_function != function::IDENTITY) {
+            activate_inplace<activation_function, fast_math>(context.output);
         }
     }
 
@@ -231,7 +292,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        output = etl::ml::convolution_backward(context.errors, w);
+        conv_engine_backward(desc::engine, output, context.errors, w, s1, s2, p1, p2);
     }
 
     /*!
@@ -242,7 +303,13 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        // The workspace is only valid for the forward pass it was lowered by
+        if (context.lowered) {
+            conv_engine_backward_filter_lowered(std::get<0>(context.up.context)->grad, context.cols, context.errors);
+            context.lowered = false;
+        } else {
+            conv_engine_backward_filter(desc::engine, std::get<0>(context.up.context)->grad, context.input, context.errors, s1, s2, p1, p2);
+        }
 
         if /*constexpr*/ (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
@@ -282,9 +349,13 @@ struct sgd_context<DBN, dyn_conv_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    etl::dyn_matrix<weight, 3> cols; ///< The lowered input, only allocated when the layer uses im2col
+    bool lowered = false;            ///< Indicates if cols holds the lowered input of the last forward pass
+
     sgd_context(layer_t& layer)
             : input(batch_size, layer.nc, layer.nv1, layer.nv2),
-              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
+              output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2),
+              cols(layer.lowered() ? batch_size : 0, layer.nc * layer.nw1 * layer.nw2, layer.nh1 * layer.nh2) {}
 };
 
 } //end of dll namespace
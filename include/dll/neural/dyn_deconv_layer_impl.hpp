@@ -10,6 +10,8 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_engine.hpp" // for deconv_engine_forward
+
 namespace dll {
 
 /*!
@@ -124,7 +126,7 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        deconv_engine_forward(desc::engine, output, v, w);
 
         const auto batch_size = etl::dim<0>(output);
 
@@ -196,7 +198,7 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() == 4)>
     void backward_batch(H&& output, C& context) const {
-        output = etl::conv_4d_valid_flipped(context.errors, w);
+        conv_engine_forward(desc::engine, output, context.errors, w);
     }
 
     /*!
@@ -207,7 +209,7 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
     template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() != 4)>
     void backward_batch(H&& output, C& context) const {
         const auto B = etl::dim<0>(output);
-        etl::reshape(output, B, nc, nv1, nv2) = etl::conv_4d_valid_flipped(context.errors, w);
+        conv_engine_forward(desc::engine, etl::reshape(output, B, nc, nv1, nv2), context.errors, w);
     }
 
     /*!
@@ -7,9 +7,14 @@
 
 #pragma once
 
-#include "dll/base_traits.hpp"  // The traits
-#include "dll/neural_layer.hpp" // The base class
-#include "dll/util/timers.hpp"  // For auto_timer
+#include "dll/base_traits.hpp"    // The traits
+#include "dll/neural_layer.hpp"   // The base class
+#include "dll/util/timers.hpp"    // For auto_timer
+#include "dll/util/sparse.hpp"    // For sparse_mul
+#include "dll/util/fast_math.hpp" // For activate_inplace
+#include "dll/util/direct.hpp"    // For direct_memory
+#include "dll/util/shape_kernels.hpp" // For select_dense_kernel
+#include "dll/util/huge_pages.hpp"    // For advise_huge_pages
 
 namespace dll {
 
@@ -23,8 +28,10 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     using this_type = dyn_dense_layer_impl<desc>;    ///< The type of this layer
     using base_type = neural_layer<this_type, desc>; ///< The type of the base type
 
-    static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
-    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto activation_function = desc::activation_function;                                ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();      ///< Disable the biases
+    static constexpr auto sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Use sparse products for the inputs
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>();    ///< Use the fast activation functions
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -48,6 +55,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     size_t num_visible; ///< The number of visible units
     size_t num_hidden;  ///< The number of hidden units
 
+    dense_kernel<weight> kernel = nullptr; ///< The specialized kernel for the sizes of the layer, if any
+
     dyn_dense_layer_impl() : base_type() {}
 
     /*!
@@ -60,8 +69,12 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         w = etl::dyn_matrix<weight, 2>(num_visible, num_hidden);
         b = etl::dyn_matrix<weight, 1>(num_hidden);
 
+        advise_huge_pages(w);
+
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        kernel = select_dense_kernel<weight>(num_visible, num_hidden);
     }
 
     /*!
@@ -116,13 +129,20 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
+        if (!sparse_input || !sparse_mul(output, input, w)) {
+            if (kernel) {
+                decltype(auto) x = direct_memory(input);
+                kernel(output.memory_start(), x.memory_start(), w.memory_start(), Batch);
+            } else {
+                output = etl::reshape(input, Batch, num_visible) * w;
+            }
+        }
 
         if /*constexpr*/ (!no_bias) {
             output = bias_add_2d(output, b);
         }
 
-        output = f_activate<activation_function>(output);
+        activate_inplace<activation_function, fast_math>(output);
     }
 
     /*!
@@ -199,7 +219,9 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     void compute_gradients(C& context) const {
         dll::auto_timer timer("dyn_dense:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        if (!sparse_input || !sparse_batch_outer(std::get<0>(context.up.context)->grad, context.input, context.errors)) {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        }
 
         if /*constexpr*/ (!no_bias) {
             std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
@@ -0,0 +1,302 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_traits.hpp"
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"                   // for auto_timer
+#include "dll/util/fast_math.hpp"                // for activate_inplace
+#include "dll/neural/depthwise_conv_kernels.hpp" // for depthwise_forward
+
+namespace dll {
+
+/*!
+ * \brief Dynamic depthwise convolutional layer of neural network.
+ */
+template <typename Desc>
+struct dyn_depthwise_conv_layer_impl final : neural_layer<dyn_depthwise_conv_layer_impl<Desc>, Desc> {
+    using desc      = Desc;                                ///< The descriptor type
+    using weight    = typename desc::weight;               ///< The weight type
+    using this_type = dyn_depthwise_conv_layer_impl<desc>; ///< This type
+    using base_type = neural_layer<this_type, desc>;
+
+    static constexpr auto activation_function = desc::activation_function;                             ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The type for one input
+    using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type for one output
+    using input_t      = std::vector<input_one_t>;   ///< The type for many input
+    using output_t     = std::vector<output_one_t>;  ///< The type for many output
+
+    using w_type = etl::dyn_matrix<weight, 3>; ///< The type of the weights
+    using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    size_t nv1; ///< The first visible dimension
+    size_t nv2; ///< The second visible dimension
+    size_t nh1; ///< The first output dimension
+    size_t nh2; ///< The second output dimension
+    size_t nc;  ///< The number of channels
+
+    size_t nw1; ///< The first dimension of the filters
+    size_t nw2; ///< The second dimension of the filters
+
+    size_t s1; ///< The stride of the first dimension
+    size_t s2; ///< The stride of the second dimension
+    size_t p1; ///< The padding of the first dimension
+    size_t p2; ///< The padding of the second dimension
+
+    dyn_depthwise_conv_layer_impl(): base_type() {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t nw1, size_t nw2, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0){
+        cpp_assert(s1 > 0 && s2 > 0, "The stride must be at least 1");
+        cpp_assert(nv1 + 2 * p1 >= nw1 && nv2 + 2 * p2 >= nw2, "The filters must fit in the padded input");
+
+        this->nv1 = nv1;
+        this->nv2 = nv2;
+        this->nw1 = nw1;
+        this->nw2 = nw2;
+        this->nc = nc;
+
+        this->s1 = s1;
+        this->s2 = s2;
+        this->p1 = p1;
+        this->p2 = p2;
+
+        this->nh1 = (nv1 + 2 * p1 - nw1) / s1 + 1;
+        this->nh2 = (nv2 + 2 * p2 - nw2) / s2 + 1;
+
+        w = etl::dyn_matrix<weight, 3>(nc, nw1, nw2);
+
+        b = etl::dyn_vector<weight>(nc);
+
+        // The fan-in of a filter is the size of one filter
+        w_initializer::initialize(w, nw1 * nw2, nh1 * nh2);
+        b_initializer::initialize(b, nw1 * nw2, nh1 * nh2);
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    size_t input_size() const noexcept {
+        return nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    size_t output_size() const noexcept {
+        return nc * nh1 * nh2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    size_t parameters() const noexcept {
+        return nc * nw1 * nw2;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_short_string() const {
+        char buffer[512];
+        char filter[128];
+
+        if (s1 == 1 && s2 == 1 && p1 == 0 && p2 == 0) {
+            snprintf(filter, 128, "%lux%lux%lu", nc, nw1, nw2);
+        } else {
+            snprintf(filter, 128, "%lux%lux%lu s%lux%lu p%lux%lu", nc, nw1, nw2, s1, s2, p1, p2);
+        }
+
+        if /*constexpr*/ (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "DepthwiseConv(dyn): %lux%lux%lu -> (%s) -> %lux%lux%lu", nc, nv1, nv2, filter, nc, nh1, nh2);
+        } else {
+            snprintf(buffer, 512, "DepthwiseConv(dyn): %lux%lux%lu -> (%s) -> %s -> %lux%lux%lu", nc, nv1, nv2, filter, to_string(activation_function).c_str(), nc, nh1, nh2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 4)>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("depthwise_conv:forward_batch");
+
+        depthwise_forward(output, v, w, s1, s2, p1, p2);
+
+        if /*constexpr*/ (!no_bias) {
+            output = bias_add_4d(output, b);
+        }
+
+        if /*constexpr*/ (activation_function != function::IDENTITY) {
+            activate_inplace<activation_function, fast_math>(output);
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V, cpp_enable_iff(etl::dimensions<V>() == 2)>
+    void forward_batch(H1&& output, const V& v) const {
+        forward_batch(output, etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2));
+    }
+
+    void prepare_input(input_one_t& input) const {
+        input = input_one_t(nc, nv1, nv2);
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(nc, nh1, nh2);
+        }
+        return output;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(nc, nh1, nh2);
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("depthwise_conv:adapt_errors");
+
+        if /*constexpr*/ (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("depthwise_conv:backward_batch");
+
+        depthwise_backward(output, context.errors, w, s1, s2, p1, p2);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("depthwise_conv:compute_gradients");
+
+        depthwise_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors, s1, s2, p1, p2);
+
+        if /*constexpr*/ (!no_bias) {
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_depthwise_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_depthwise_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_depthwise_conv_layer_impl<Desc>, L> {
+    using layer_t = dyn_depthwise_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 4> input;
+    etl::dyn_matrix<weight, 4> output;
+    etl::dyn_matrix<weight, 4> errors;
+
+    sgd_context(layer_t& layer)
+            : input(batch_size, layer.nc, layer.nv1, layer.nv2),
+              output(batch_size, layer.nc, layer.nh1, layer.nh2), errors(batch_size, layer.nc, layer.nh1, layer.nh2) {}
+};
+
+} //end of dll namespace
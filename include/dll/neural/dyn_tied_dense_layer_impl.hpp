@@ -0,0 +1,352 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_traits.hpp"    // The traits
+#include "dll/neural_layer.hpp"   // The base class
+#include "dll/util/timers.hpp"    // For auto_timer
+#include "dll/util/fast_math.hpp" // For activate_inplace
+
+namespace dll {
+
+/*!
+ * \brief Dynamic dense layer of the decoder of an autoencoder, whose
+ * weights are the transposed weights of the mirrored dense layer of the
+ * encoder.
+ *
+ * \see tied_dense_layer_impl
+ */
+template <typename Desc>
+struct dyn_tied_dense_layer_impl final : neural_layer<dyn_tied_dense_layer_impl<Desc>, Desc> {
+    using desc      = Desc;                            ///< The descriptor of the layer
+    using weight    = typename desc::weight;           ///< The data type for this layer
+    using this_type = dyn_tied_dense_layer_impl<desc>; ///< The type of this layer
+    using base_type = neural_layer<this_type, desc>;   ///< The type of the base type
+
+    static constexpr auto activation_function = desc::activation_function;                             ///< The layer's activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>();   ///< Disable the biases
+    static constexpr auto fast_math           = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast activation functions
+
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The type of one input
+    using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;   ///< The type of the input
+    using output_t     = std::vector<output_one_t>;  ///< The type of the output
+
+    using w_type = etl::dyn_matrix<weight, 2>; ///< The type of the tied weights (the weights of the encoder)
+    using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
+
+    const w_type* tied_w = nullptr; ///< The weights of the encoder
+    b_type b;                       ///< Hidden biases
+
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    size_t num_visible; ///< The number of visible units
+    size_t num_hidden;  ///< The number of hidden units
+
+    dyn_tied_dense_layer_impl() : base_type() {}
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t nv, size_t nh) {
+        num_visible = nv;
+        num_hidden  = nh;
+
+        b = etl::dyn_matrix<weight, 1>(num_hidden);
+
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Tie the layer to the weights of the given encoder layer
+     * \param encoder The mirrored layer of the encoder
+     */
+    template <typename Encoder>
+    void tie(const Encoder& encoder) {
+        static_assert(is_tied_layer<this_type, Encoder>::value, "A tied dense layer must mirror a dense layer");
+
+        cpp_assert(etl::dim<0>(encoder.w) == num_hidden && etl::dim<1>(encoder.w) == num_visible, "A tied dense layer must mirror a dense layer of the same size");
+
+        tied_w = &encoder.w;
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    size_t input_size() const noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    size_t output_size() const noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer, the weights
+     * being the ones of the encoder
+     */
+    size_t parameters() const noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_short_string() const {
+        char buffer[512];
+
+        if /*constexpr*/ (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Dense(dyn,tied): %lu -> %lu", num_visible, num_hidden);
+        } else {
+            snprintf(buffer, 512, "Dense(dyn,tied): %lu -> %s -> %lu", num_visible, to_string(activation_function).c_str(), num_hidden);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Backup the biases in the secondary biases matrix
+     */
+    void backup_weights() {
+        unique_safe_get(bak_b) = b;
+    }
+
+    /*!
+     * \brief Restore the biases from the secondary biases matrix
+     */
+    void restore_weights() {
+        b = *bak_b;
+    }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(b, bak_b);
+    }
+
+    /*!
+     * \brief Store the biases into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the biases from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, b);
+    }
+
+    /*!
+     * \brief Store the biases into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the biases from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters(){
+        return std::make_tuple(std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::make_tuple(std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::make_tuple(std::cref(b));
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        dll::auto_timer timer("dyn_tied_dense:forward_batch");
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+        cpp_assert(tied_w, "The tied dense layer is not tied to an encoder");
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(*tied_w);
+
+        if /*constexpr*/ (!no_bias) {
+            output = bias_add_2d(output, b);
+        }
+
+        activate_inplace<activation_function, fast_math>(output);
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(num_hidden);
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(num_hidden);
+        }
+        return output;
+    }
+
+    void prepare_input(input_one_t& input) const {
+        input = input_one_t(num_visible);
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     *
+     * The gradients of the tied weights are computed here, before the
+     * backpropagation reaches the encoder, to which they are added.
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        // The reshape has no overhead, so better than SFINAE for nothing
+        auto batch_size = etl::dim<0>(output);
+        etl::reshape(output, batch_size, num_visible) = context.errors * *tied_w;
+
+        context.w_grad = batch_outer(context.input, context.errors);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("dyn_tied_dense:compute_gradients");
+
+        if /*constexpr*/ (!no_bias) {
+            std::get<0>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+        }
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_tied_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = true;  ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_dynamic    = true;  ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief A dynamic tied dense layer mirrors a dynamic dense layer
+ */
+template <typename TDesc, typename Desc>
+struct is_tied_layer<dyn_tied_dense_layer_impl<TDesc>, dyn_dense_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_tied_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_tied_dense_layer_impl<Desc>, L> {
+    using layer_t = dyn_tied_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 2> input;
+    etl::dyn_matrix<weight, 2> output;
+    etl::dyn_matrix<weight, 2> errors;
+
+    etl::dyn_matrix<weight, 2> w_grad; ///< The gradients of the tied weights (transposed)
+
+    sgd_context(layer_t& layer)
+            : input(batch_size, layer.num_visible, 0.0),
+              output(batch_size, layer.num_hidden, 0.0),
+              errors(batch_size, layer.num_hidden, 0.0),
+              w_grad(layer.num_visible, layer.num_hidden, 0.0) {}
+};
+
+} //end of dll namespace
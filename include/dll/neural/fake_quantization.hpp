@@ -0,0 +1,355 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fake quantization of the layers trained for int8 inference.
+ *
+ * During the training of a quantization-aware layer, its weights and its
+ * input are rounded to the int8 grid of their scales before the forward
+ * pass, the same way as the int8 runtime (quantized_dbn) computes them.
+ * The rounding is bypassed by the gradients (straight-through estimator),
+ * except for the values clipped to the range, and the scales, one per
+ * output channel for the weights and one for the input, are learned with
+ * the gradients of the step size of LSQ (Esser et al.).
+ */
+
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a layer is quantization-aware
+ */
+template <typename Layer, typename Enable = void>
+struct is_quantization_aware : std::false_type {};
+
+/*!
+ * \copydoc is_quantization_aware
+ */
+template <typename Layer>
+struct is_quantization_aware<Layer, std::enable_if_t<std::decay_t<Layer>::quantization_aware>> : std::true_type {};
+
+namespace qat_detail {
+
+/*!
+ * \brief The largest absolute value of the int8 grid
+ */
+constexpr float levels = 127.0f;
+
+/*!
+ * \brief Return the scale that is used for the given learned scale
+ */
+template <typename T>
+T effective_scale(T scale) {
+    return std::max(std::abs(scale), T(1e-8));
+}
+
+/*!
+ * \brief Round the given value to the int8 grid of the given scale
+ */
+template <typename T>
+T fake_quantize(T value, T scale) {
+    return scale * std::max(T(-levels), std::min(T(levels), std::round(value / scale)));
+}
+
+/*!
+ * \brief Indicates if the given value is clipped by the fake quantization
+ * with the given scale
+ */
+template <typename T>
+bool clipped(T value, T scale) {
+    return std::abs(std::round(value / scale)) > T(levels);
+}
+
+/*!
+ * \brief Return the derivative of the fake quantization of the given
+ * value with respect to its scale
+ */
+template <typename T>
+T scale_derivative(T value, T scale) {
+    const T v = value / scale;
+    const T q = std::round(v);
+
+    if (q < -levels) {
+        return T(-levels);
+    } else if (q > levels) {
+        return T(levels);
+    }
+
+    return q - v;
+}
+
+/*!
+ * \brief Return the factor of the gradient of a scale shared by n values
+ */
+template <typename T>
+T gradient_factor(size_t n) {
+    return T(1) / std::sqrt(T(n) * T(levels));
+}
+
+} //end of namespace qat_detail
+
+/*!
+ * \brief The learned scales of a quantization-aware layer.
+ *
+ * The values of the weights of output channel c are at c * cs + i * is.
+ *
+ * \tparam T The data type
+ * \tparam C The number of output channels
+ * \tparam N The number of weights of each output channel
+ * \tparam CS The stride between two output channels in the weights
+ * \tparam IS The stride between two weights of an output channel
+ */
+template <typename T, size_t C, size_t N, size_t CS, size_t IS>
+struct fake_quantization {
+    etl::fast_matrix<T, C> w_scale; ///< The scale of the weights of each output channel
+    etl::fast_matrix<T, 1> x_scale; ///< The scale of the input
+
+    bool initialized = false; ///< Indicates if the scales of the weights have been checked for initialization
+    std::mutex lock;          ///< The lock protecting the initialization
+
+    /*!
+     * \brief Create the scales, the input being initially in [-1, 1]
+     */
+    fake_quantization() : w_scale(0.0), x_scale(T(1) / T(qat_detail::levels)) {}
+
+    /*!
+     * \brief Indicates if the scales have been trained or loaded
+     */
+    bool trained() const {
+        host_read(w_scale);
+
+        for (size_t c = 0; c < C; ++c) {
+            if (w_scale[c] != T(0)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Initialize the scales of the weights from their range, if
+     * they have not been trained or loaded (they are all zero)
+     */
+    template <typename W>
+    void init(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (initialized) {
+            return;
+        }
+
+        initialized = true;
+
+        if (trained()) {
+            return;
+        }
+
+        host_read(w);
+
+        const T* x = w.memory_start();
+
+        for (size_t c = 0; c < C; ++c) {
+            T range = 0;
+
+            for (size_t i = 0; i < N; ++i) {
+                range = std::max(range, std::abs(x[c * CS + i * IS]));
+            }
+
+            w_scale[c] = range > T(0) ? range / T(qat_detail::levels) : T(1);
+        }
+
+        host_written(w_scale);
+    }
+
+    /*!
+     * \brief Round the weights to the int8 grid of their scales
+     * \param out The fake-quantized weights
+     * \param w The weights
+     */
+    template <typename W>
+    void quantize_weights(W& out, const W& w) const {
+        host_read(w, w_scale);
+
+        const T* x = w.memory_start();
+        T* y       = out.memory_start();
+
+        for (size_t c = 0; c < C; ++c) {
+            const T s = qat_detail::effective_scale(w_scale[c]);
+
+            for (size_t i = 0; i < N; ++i) {
+                y[c * CS + i * IS] = qat_detail::fake_quantize(x[c * CS + i * IS], s);
+            }
+        }
+
+        host_written(out);
+    }
+
+    /*!
+     * \brief Round the input to the int8 grid of its scale
+     * \param out The fake-quantized input
+     * \param input The input
+     */
+    template <typename O, typename I>
+    void quantize_input(O& out, const I& input) const {
+        host_read(input, x_scale);
+
+        const T s = qat_detail::effective_scale(x_scale[0]);
+
+        const T* x = input.memory_start();
+        T* y       = out.memory_start();
+
+        for (size_t i = 0; i < etl::size(input); ++i) {
+            y[i] = qat_detail::fake_quantize(x[i], s);
+        }
+
+        host_written(out);
+    }
+
+    /*!
+     * \brief Compute the gradients of the weights and of their scales
+     * from the gradients of the fake-quantized weights
+     * \param w_grad The gradients of the fake-quantized weights, replaced by the gradients of the weights
+     * \param s_grad The gradients of the scales of the weights
+     * \param w The weights
+     */
+    template <typename W, typename S>
+    void weights_gradients(W& w_grad, S& s_grad, const W& w) const {
+        host_read(w_grad, w, w_scale);
+
+        const T factor = qat_detail::gradient_factor<T>(N);
+
+        const T* x = w.memory_start();
+        T* g       = w_grad.memory_start();
+
+        for (size_t c = 0; c < C; ++c) {
+            const T s = qat_detail::effective_scale(w_scale[c]);
+
+            T sum = 0;
+
+            for (size_t i = 0; i < N; ++i) {
+                const size_t j = c * CS + i * IS;
+
+                sum += g[j] * qat_detail::scale_derivative(x[j], s);
+
+                // The clipped weights have no gradient
+                if (qat_detail::clipped(x[j], s)) {
+                    g[j] = 0;
+                }
+            }
+
+            s_grad[c] = factor * sum;
+        }
+
+        host_written(w_grad, s_grad);
+    }
+
+    /*!
+     * \brief Compute the gradients of the scale of the input from the
+     * gradients of the fake-quantized input
+     * \param s_grad The gradients of the scale of the input
+     * \param dx The gradients of the fake-quantized input
+     * \param input The input
+     */
+    template <typename S, typename D, typename I>
+    void input_gradients(S& s_grad, const D& dx, const I& input) const {
+        host_read(dx, input, x_scale);
+
+        const size_t n = etl::size(input);
+        const T s      = qat_detail::effective_scale(x_scale[0]);
+
+        const T* x = input.memory_start();
+        const T* g = dx.memory_start();
+
+        T sum = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            sum += g[i] * qat_detail::scale_derivative(x[i], s);
+        }
+
+        s_grad[0] = qat_detail::gradient_factor<T>(n / std::max<size_t>(1, etl::dim<0>(input))) * sum;
+
+        host_written(s_grad);
+    }
+
+    /*!
+     * \brief Backpropagate the gradients of the fake-quantized input to
+     * the input, the clipped values having no gradient
+     * \param output The gradients of the input
+     * \param dx The gradients of the fake-quantized input
+     * \param input The input
+     */
+    template <typename O, typename D, typename I>
+    void input_errors(O& output, const D& dx, const I& input) const {
+        host_read(dx, input, x_scale);
+
+        const T s = qat_detail::effective_scale(x_scale[0]);
+
+        const T* x = input.memory_start();
+        const T* g = dx.memory_start();
+        T* y       = output.memory_start();
+
+        for (size_t i = 0; i < etl::size(input); ++i) {
+            y[i] = qat_detail::clipped(x[i], s) ? T(0) : g[i];
+        }
+
+        host_written(output);
+    }
+};
+
+/*!
+ * \brief The buffers of the fake quantization in the training context of
+ * a quantization-aware layer
+ */
+template <bool Q, typename W, typename X>
+struct fake_quantization_context {
+    W w;  ///< The fake-quantized weights
+    X x;  ///< The fake-quantized input
+    X dx; ///< The gradients of the fake-quantized input
+
+    bool backward = false; ///< Indicates if dx has been computed by the backpropagation
+};
+
+/*!
+ * \copydoc fake_quantization_context
+ */
+template <typename W, typename X>
+struct fake_quantization_context<false, W, X> {};
+
+/*!
+ * \brief Return the learned scales of the given layer, that are trained
+ * and stored with its weights and biases
+ */
+template <typename Layer, cpp_enable_iff(is_quantization_aware<Layer>::value)>
+auto quantization_parameters(Layer& layer) {
+    return std::make_tuple(std::ref(layer.quantization.w_scale), std::ref(layer.quantization.x_scale));
+}
+
+/*!
+ * \brief Return the learned scales of the given layer, none if the layer
+ * is not quantization-aware
+ */
+template <typename Layer, cpp_disable_if(is_quantization_aware<Layer>::value)>
+std::tuple<> quantization_parameters(Layer& layer) {
+    cpp_unused(layer);
+    return {};
+}
+
+} //end of dll namespace
@@ -17,6 +17,7 @@
 #include "layer.hpp"
 #include "util/tmp.hpp"
 #include "layer_traits.hpp"
+#include "neural/fake_quantization.hpp"
 
 namespace dll {
 
@@ -60,12 +61,27 @@ struct neural_layer : layer<Derived> {
         as_derived().b = *as_derived().bak_b;
     }
 
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(as_derived().w, as_derived().bak_w);
+        swap_backup(as_derived().b, as_derived().bak_b);
+    }
+
     /*!
      * \brief Load the weigts into the given stream
      */
     void store(std::ostream& os) const {
         cpp::binary_write_all(os, as_derived().w);
         cpp::binary_write_all(os, as_derived().b);
+
+        cpp::static_if<is_quantization_aware<derived_t>::value>([&](auto f) {
+            cpp::binary_write_all(os, f(as_derived()).quantization.w_scale);
+            cpp::binary_write_all(os, f(as_derived()).quantization.x_scale);
+        });
     }
 
     /*!
@@ -74,6 +90,11 @@ struct neural_layer : layer<Derived> {
     void load(std::istream& is) {
         cpp::binary_load_all(is, as_derived().w);
         cpp::binary_load_all(is, as_derived().b);
+
+        cpp::static_if<is_quantization_aware<derived_t>::value>([&](auto f) {
+            cpp::binary_load_all(is, f(as_derived()).quantization.w_scale);
+            cpp::binary_load_all(is, f(as_derived()).quantization.x_scale);
+        });
     }
 
     /*!
@@ -97,7 +118,23 @@ struct neural_layer : layer<Derived> {
      * \return a tuple containing references to the variables of this layer
      */
     decltype(auto) trainable_parameters(){
-        return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b));
+        return std::tuple_cat(std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b)), quantization_parameters(as_derived()));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::tuple_cat(std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b)), quantization_parameters(as_derived()));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::tuple_cat(std::make_tuple(std::cref(as_derived().w), std::cref(as_derived().b)), quantization_parameters(as_derived()));
     }
 
 private:
@@ -11,6 +11,7 @@
 
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
+#include "dll/util/reporter.hpp"
 
 #ifndef DLL_DETAIL_ONLY
 #include <opencv2/opencv.hpp>
@@ -186,6 +187,8 @@ struct base_ocv_rbm_visualizer {
      * \param rbm The RBM stopped training
      */
     void training_end(const RBM& rbm) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window..." << std::endl;
@@ -202,8 +205,14 @@ struct base_ocv_rbm_visualizer {
      * \param batches The total number of batches
      */
     void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
-        printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
-               context.batch_error, context.batch_sparsity);
+        progress_record record;
+        record.kind    = progress_record::kind_t::RBM_BATCH;
+        record.batch   = batch;
+        record.batches = batches;
+        record.error   = context.batch_error;
+        record.value   = context.batch_sparsity;
+
+        reporter().push(record);
 
         cpp_unused(rbm);
     }
@@ -213,7 +222,7 @@ struct base_ocv_rbm_visualizer {
      */
     void refresh() {
         cv::imshow("RBM Training", buffer_image);
-        cv::waitKey(30);
+        cv::waitKey(1);
     }
 };
 
@@ -302,6 +311,8 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
      * \param rbm The RBM being trained
      */
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
@@ -385,6 +396,8 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
      * \param rbm The RBM being trained
      */
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
@@ -502,6 +515,8 @@ struct opencv_dbn_visualizer {
      */
     template <typename RBM>
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
@@ -575,8 +590,14 @@ struct opencv_dbn_visualizer {
      */
     template <typename RBM>
     void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
-        printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
-               context.batch_error, context.batch_sparsity);
+        progress_record record;
+        record.kind    = progress_record::kind_t::RBM_BATCH;
+        record.batch   = batch;
+        record.batches = batches;
+        record.error   = context.batch_error;
+        record.value   = context.batch_sparsity;
+
+        reporter().push(record);
     }
 
     /*!
@@ -585,6 +606,8 @@ struct opencv_dbn_visualizer {
      */
     template <typename RBM>
     void training_end(const RBM&) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
@@ -632,6 +655,8 @@ struct opencv_dbn_visualizer {
      * \param dbn The network being trained
      */
     void ft_epoch_end(size_t epoch, double error, const DBN& dbn) {
+        reporter().flush();
+
         printf("epoch %ld - Classification error: %.5f \n", epoch, error);
 
         cpp_unused(dbn);
@@ -644,6 +669,8 @@ struct opencv_dbn_visualizer {
      * \param dbn The DBN that is being trained
      */
     void fine_tuning_end(const DBN&) {
+        reporter().flush();
+
         std::cout << "Total training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window" << std::endl;
@@ -657,7 +684,7 @@ struct opencv_dbn_visualizer {
      */
     void refresh() {
         cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        cv::waitKey(1);
     }
 };
 
@@ -758,6 +785,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
 
     template <typename RBM>
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
@@ -829,8 +858,14 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
      */
     template <typename RBM>
     void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
-        printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
-               context.batch_error, context.batch_sparsity);
+        progress_record record;
+        record.kind    = progress_record::kind_t::RBM_BATCH;
+        record.batch   = batch;
+        record.batches = batches;
+        record.error   = context.batch_error;
+        record.value   = context.batch_sparsity;
+
+        reporter().push(record);
     }
 
     /*!
@@ -839,6 +874,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
      */
     template <typename RBM>
     void training_end(const RBM&) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
@@ -868,7 +905,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
      */
     void refresh() {
         cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        cv::waitKey(1);
     }
 };
 
@@ -973,6 +1010,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
     template <typename RBM>
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
@@ -1039,8 +1078,14 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
      */
     template <typename RBM>
     void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
-        printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
-               context.batch_error, context.batch_sparsity);
+        progress_record record;
+        record.kind    = progress_record::kind_t::RBM_BATCH;
+        record.batch   = batch;
+        record.batches = batches;
+        record.error   = context.batch_error;
+        record.value   = context.batch_sparsity;
+
+        reporter().push(record);
     }
 
     /*!
@@ -1049,6 +1094,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
      */
     template <typename RBM>
     void training_end(const RBM&) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
@@ -1066,7 +1113,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
     void refresh() {
         cv::imshow("CDBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        cv::waitKey(1);
     }
 };
 
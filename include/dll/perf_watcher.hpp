@@ -0,0 +1,319 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Watchers reporting the hardware performance counters of the
+ * training epochs.
+ *
+ * In addition to the output of the default watchers, these watchers
+ * report, for each epoch and for each layer, the cycles, the
+ * instructions per cycle, the LLC misses, the estimated memory traffic
+ * per sample (64 bytes per LLC miss) and the GFLOP/s when a FLOPS event
+ * is configured with dll::perf_flops_event().
+ *
+ * Only the training thread is counted: the work done by other threads
+ * (parallel ETL, hogwild, ...) is not included.
+ */
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+
+#include "dll/watcher.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/profiler.hpp"
+#include "dll/util/perf_counters.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The hardware counters and the time gathered for one part of
+ * the training
+ */
+struct perf_sample {
+    perf_values values{}; ///< The values of the counters
+    uint64_t duration = 0; ///< The wall time (ns)
+
+    /*!
+     * \brief Add the difference between the two readings
+     */
+    void add(const perf_values& begin, const perf_values& end, uint64_t ns) {
+        for (size_t i = 0; i < perf_counters_n; ++i) {
+            values[i] += end[i] - begin[i];
+        }
+
+        duration += ns;
+    }
+};
+
+/*!
+ * \brief Print one line of report for the given sample
+ * \param counters The counters (to know which are available)
+ * \param name The name of the line
+ * \param sample The gathered values
+ * \param samples The number of samples processed
+ */
+inline void print_perf_sample(const perf_counters& counters, const std::string& name, const perf_sample& sample, size_t samples) {
+    const auto& v = sample.values;
+
+    const double cycles  = v[size_t(perf_counter::CYCLES)];
+    const double seconds = sample.duration / 1e9;
+
+    printf("%12s - time: %9.3fms", name.c_str(), sample.duration / 1e6);
+
+    if (counters.available(perf_counter::CYCLES)) {
+        printf(" cycles: %.3e", cycles);
+    }
+
+    if (counters.available(perf_counter::INSTRUCTIONS) && counters.available(perf_counter::CYCLES) && cycles > 0) {
+        printf(" IPC: %.2f", v[size_t(perf_counter::INSTRUCTIONS)] / cycles);
+    }
+
+    if (counters.available(perf_counter::LLC_MISSES)) {
+        printf(" LLC misses: %.3e", double(v[size_t(perf_counter::LLC_MISSES)]));
+
+        if (samples) {
+            printf(" bytes/sample: %.1f", 64.0 * v[size_t(perf_counter::LLC_MISSES)] / samples);
+        }
+    }
+
+    if (counters.available(perf_counter::FLOPS) && seconds > 0) {
+        printf(" GFLOP/s: %.3f", v[size_t(perf_counter::FLOPS)] / seconds / 1e9);
+    }
+
+    printf("\n");
+}
+
+/*!
+ * \brief Attribute the hardware counters of the training thread to the
+ * layers of the network.
+ *
+ * Nested layers are attributed exclusively: the time spent in an inner
+ * layer is not counted in the outer one.
+ */
+struct perf_layer_accounting : layer_listener {
+    const perf_counters& counters;                     ///< The counters to read
+    perf_values last;                                 ///< The last reading
+    std::chrono::steady_clock::time_point last_time; ///< The time of the last reading
+    perf_sample outside;                              ///< The values outside of any layer
+    std::vector<perf_sample> layers;                 ///< The values of each layer
+
+    /*!
+     * \brief Create the accounting for the given counters
+     */
+    explicit perf_layer_accounting(const perf_counters& counters) : counters(counters) {
+        reset();
+    }
+
+    /*!
+     * \brief Discard all the accumulated values
+     */
+    void reset() {
+        outside = perf_sample();
+        layers.clear();
+
+        last      = counters.read();
+        last_time = std::chrono::steady_clock::now();
+    }
+
+    /*!
+     * \brief Charge the counters since the last reading to the given layer
+     * \param layer The index of the layer (-1 for outside of any layer)
+     */
+    void charge(int layer) {
+        auto now      = counters.read();
+        auto now_time = std::chrono::steady_clock::now();
+
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now_time - last_time).count();
+
+        if (layer < 0) {
+            outside.add(last, now, ns);
+        } else {
+            if (size_t(layer) >= layers.size()) {
+                layers.resize(layer + 1);
+            }
+
+            layers[layer].add(last, now, ns);
+        }
+
+        last      = now;
+        last_time = now_time;
+    }
+
+    /*!
+     * \copydoc layer_listener::switch_layer
+     */
+    void switch_layer(int from, int to) override {
+        cpp_unused(to);
+        charge(from);
+    }
+
+    /*!
+     * \brief Compute the total over the layers and outside
+     */
+    perf_sample total() const {
+        perf_sample sum = outside;
+
+        for (auto& layer : layers) {
+            for (size_t i = 0; i < perf_counters_n; ++i) {
+                sum.values[i] += layer.values[i];
+            }
+
+            sum.duration += layer.duration;
+        }
+
+        return sum;
+    }
+};
+
+/*!
+ * \brief A DBN watcher that also reports the hardware counters of each
+ * epoch, for each layer.
+ *
+ * The counters are read when the layers are entered and left, which
+ * costs a few system calls per layer and per batch.
+ */
+template <typename DBN>
+struct perf_dbn_watcher : default_dbn_watcher<DBN> {
+    using base_type = default_dbn_watcher<DBN>; ///< The default watcher
+
+    perf_counters counters;           ///< The hardware counters
+    perf_layer_accounting accounting; ///< The accounting per layer
+    size_t samples = 0;               ///< The number of samples of the current epoch
+
+    perf_dbn_watcher() : accounting(counters) {}
+
+    /*!
+     * \copydoc default_dbn_watcher::fine_tuning_begin
+     */
+    void fine_tuning_begin(const DBN& dbn, size_t max_epochs) {
+        base_type::fine_tuning_begin(dbn, max_epochs);
+
+        if (!counters.any_available()) {
+            std::cout << "WARNING: The hardware performance counters are not available" << std::endl;
+        }
+
+        current_layer_listener() = &accounting;
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_start
+     */
+    void ft_epoch_start(size_t epoch, const DBN& dbn) {
+        base_type::ft_epoch_start(epoch, dbn);
+
+        samples = 0;
+        accounting.reset();
+    }
+
+    /*!
+     * \brief Add processed samples to the current epoch
+     * \param n The number of samples
+     */
+    void epoch_samples(size_t n) {
+        samples += n;
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_end(size_t, double, double, const DBN&)
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        base_type::ft_epoch_end(epoch, error, loss, dbn);
+        report();
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::ft_epoch_end(size_t, double, double, double, double, const DBN&)
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        base_type::ft_epoch_end(epoch, train_error, train_loss, val_error, val_loss, dbn);
+        report();
+    }
+
+    /*!
+     * \copydoc default_dbn_watcher::fine_tuning_end
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        if (current_layer_listener() == &accounting) {
+            current_layer_listener() = nullptr;
+        }
+
+        base_type::fine_tuning_end(dbn);
+    }
+
+private:
+    void report() {
+        accounting.charge(-1);
+
+        for (size_t l = 0; l < accounting.layers.size(); ++l) {
+            print_perf_sample(counters, "layer " + std::to_string(l), accounting.layers[l], samples);
+        }
+
+        print_perf_sample(counters, "other", accounting.outside, samples);
+        print_perf_sample(counters, "epoch", accounting.total(), samples);
+
+        std::cout.flush();
+    }
+};
+
+/*!
+ * \brief An RBM watcher that also reports the hardware counters of each
+ * epoch.
+ */
+template <typename R>
+struct perf_rbm_watcher : default_rbm_watcher<R> {
+    using base_type = default_rbm_watcher<R>; ///< The default watcher
+
+    perf_counters counters;           ///< The hardware counters
+    perf_layer_accounting accounting; ///< The accounting
+    size_t samples = 0;               ///< The number of samples of the current epoch
+
+    perf_rbm_watcher() : accounting(counters) {}
+
+    /*!
+     * \copydoc default_rbm_watcher::training_begin
+     */
+    template <typename RBM = R>
+    void training_begin(const RBM& rbm) {
+        base_type::training_begin(rbm);
+
+        if (!counters.any_available()) {
+            std::cout << "WARNING: The hardware performance counters are not available" << std::endl;
+        }
+
+        samples = 0;
+        accounting.reset();
+    }
+
+    /*!
+     * \brief Add processed samples to the current epoch
+     * \param n The number of samples
+     */
+    void epoch_samples(size_t n) {
+        samples += n;
+    }
+
+    /*!
+     * \copydoc default_rbm_watcher::epoch_end
+     */
+    template <typename RBM = R>
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        base_type::epoch_end(epoch, context, rbm);
+
+        accounting.charge(-1);
+
+        print_perf_sample(counters, "epoch", accounting.outside, samples);
+        std::cout.flush();
+
+        samples = 0;
+        accounting.reset();
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,185 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Average pooling kernels.
+ *
+ * The forward pass first sums the rows of each row of windows into a
+ * contiguous buffer, which is done with unit-stride (vectorized) additions
+ * whatever the size of the windows, and then reduces each window of the
+ * buffer, with the scaling by the size of the window fused in the
+ * reduction. The backward pass writes each input error once, the scaled
+ * error of its window, the inputs after the last complete window having
+ * no error.
+ *
+ * The input of each sample is seen as D1 x D2 x D3, pooled with windows of
+ * K1 x K2 x K3 (the 2D pooling is a 3D pooling with K1 = 1).
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+namespace avgp_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Average pooling of the output plane i of a sample
+ *
+ * \param x The input of the sample (D1 x D2 x D3)
+ * \param y The output plane (O2 x O3)
+ * \param acc A buffer of O3 * K3 values
+ */
+template <typename T>
+DLL_MULTI_VERSION void forward_plane(size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, size_t O2, size_t O3, size_t i, const T* x, T* y, T* acc) {
+    const size_t W = O3 * K3;
+    const T scale  = T(1) / T(K1 * K2 * K3);
+
+    for (size_t j = 0; j < O2; ++j) {
+        std::fill(acc, acc + W, T(0));
+
+        // Vertical sums of the rows of the windows
+        for (size_t c1 = 0; c1 < K1; ++c1) {
+            for (size_t c2 = 0; c2 < K2; ++c2) {
+                const T* row = x + ((i * K1 + c1) * D2 + j * K2 + c2) * D3;
+
+                for (size_t w = 0; w < W; ++w) {
+                    acc[w] += row[w];
+                }
+            }
+        }
+
+        // Horizontal sums of the windows, scaled
+        for (size_t k = 0; k < O3; ++k) {
+            T sum = T(0);
+
+            for (size_t c3 = 0; c3 < K3; ++c3) {
+                sum += acc[k * K3 + c3];
+            }
+
+            y[j * O3 + k] = scale * sum;
+        }
+    }
+}
+
+/*!
+ * \brief Average pooling of a batch
+ *
+ * \param B The number of samples
+ * \param in The input (B x D1 x D2 x D3)
+ * \param out The output (B x D1 / K1 x D2 / K2 x D3 / K3)
+ */
+template <typename T>
+void forward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* in, T* out) {
+    const size_t O1 = D1 / K1;
+    const size_t O2 = D2 / K2;
+    const size_t O3 = D3 / K3;
+
+    // One task per output plane of each sample
+    for_each_task(B * O1, B * D1 * D2 * D3, [=](size_t t) {
+        const size_t b = t / O1;
+        const size_t i = t % O1;
+
+        std::vector<T> acc(O3 * K3);
+
+        forward_plane(D2, D3, K1, K2, K3, O2, O3, i, in + b * D1 * D2 * D3, out + t * O2 * O3, acc.data());
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors of the output plane i of a sample to
+ * its input planes
+ *
+ * \param e The errors of the output plane (O2 x O3)
+ * \param dx The errors of the input of the sample
+ */
+template <typename T>
+DLL_MULTI_VERSION void backward_plane(size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, size_t O2, size_t O3, size_t i, const T* e, T* dx) {
+    const T scale = T(1) / T(K1 * K2 * K3);
+
+    for (size_t j = 0; j < O2; ++j) {
+        // The first row of the windows is computed, the others are copies
+        T* first = dx + ((i * K1) * D2 + j * K2) * D3;
+
+        for (size_t k = 0; k < O3; ++k) {
+            const T v = scale * e[j * O3 + k];
+
+            for (size_t c3 = 0; c3 < K3; ++c3) {
+                first[k * K3 + c3] = v;
+            }
+        }
+
+        // The inputs after the last complete window
+        std::fill(first + O3 * K3, first + D3, T(0));
+
+        for (size_t c1 = 0; c1 < K1; ++c1) {
+            for (size_t c2 = c1 ? 0 : 1; c2 < K2; ++c2) {
+                std::copy(first, first + D3, dx + ((i * K1 + c1) * D2 + j * K2 + c2) * D3);
+            }
+        }
+    }
+
+    for (size_t c1 = 0; c1 < K1; ++c1) {
+        std::fill(dx + ((i * K1 + c1) * D2 + O2 * K2) * D3, dx + (i * K1 + c1 + 1) * D2 * D3, T(0));
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of an average pooling layer, each input
+ * receiving the error of its window divided by the size of the window.
+ *
+ * \param B The number of samples
+ * \param errors The errors of the output (B x D1 / K1 x D2 / K2 x D3 / K3)
+ * \param in_errors The errors of the input (B x D1 x D2 x D3)
+ */
+template <typename T>
+void backward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* errors, T* in_errors) {
+    const size_t O1 = D1 / K1;
+    const size_t O2 = D2 / K2;
+    const size_t O3 = D3 / K3;
+
+    for_each_task(B * O1, B * D1 * D2 * D3, [=](size_t t) {
+        const size_t b = t / O1;
+        const size_t i = t % O1;
+
+        backward_plane(D2, D3, K1, K2, K3, O2, O3, i, errors + t * O2 * O3, in_errors + b * D1 * D2 * D3);
+    });
+
+    // The planes after the last complete window
+    if (O1 * K1 < D1) {
+        for (size_t b = 0; b < B; ++b) {
+            std::fill(in_errors + (b * D1 + O1 * K1) * D2 * D3, in_errors + (b + 1) * D1 * D2 * D3, T(0));
+        }
+    }
+}
+
+} //end of namespace avgp_detail
+
+} //end of dll namespace
@@ -8,6 +8,10 @@
 #pragma once
 
 #include "pooling_layer.hpp"
+#include "avgp_kernels.hpp"
+
+#include "dll/util/direct.hpp" // for direct_memory
+#include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
 
@@ -44,7 +48,11 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        dll::auto_timer timer("avgp:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        avgp_detail::forward(etl::dim<0>(x), base::I1, base::I2, base::I3, 1, base::C1, base::C2, x.memory_start(), output.memory_start());
     }
 
     /*!
@@ -77,11 +85,11 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling second dimension
+        dll::auto_timer timer("avgp:backward_batch");
 
-        output = etl::ml::avg_pool_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        // Each input receives the scaled error of its window
+        avgp_detail::backward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, 1, base::C1, base::C2,
+                              context.errors.memory_start(), output.memory_start());
     }
 
     /*!
@@ -170,7 +178,11 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::ml::avg_pool_3d_forward<base::C1, base::C2, base::C3>(input);
+        dll::auto_timer timer("avgp:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        avgp_detail::forward(etl::dim<0>(x), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3, x.memory_start(), output.memory_start());
     }
 
     /*!
@@ -203,11 +215,11 @@ struct avgp_3d_layer_impl final : pooling_3d_layer<avgp_3d_layer_impl<Desc>, Des
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling third dimension
+        dll::auto_timer timer("avgp:backward_batch");
 
-        output = etl::ml::avg_pool_3d_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        // Each input receives the scaled error of its window
+        avgp_detail::backward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3,
+                              context.errors.memory_start(), output.memory_start());
     }
 
     /*!
@@ -8,6 +8,10 @@
 #pragma once
 
 #include "pooling_layer.hpp"
+#include "avgp_kernels.hpp"
+
+#include "dll/util/direct.hpp" // for direct_memory
+#include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
 
@@ -45,7 +49,11 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
+        dll::auto_timer timer("avgp:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        avgp_detail::forward(etl::dim<0>(x), base::i1, base::i2, base::i3, 1, base::c1, base::c2, x.memory_start(), output.memory_start());
     }
 
     /*!
@@ -78,10 +86,11 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
+        dll::auto_timer timer("avgp:backward_batch");
 
-        output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
+        // Each input receives the scaled error of its window
+        avgp_detail::backward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, 1, base::c1, base::c2,
+                              context.errors.memory_start(), output.memory_start());
     }
 
     /*!
@@ -166,7 +175,11 @@ struct dyn_avgp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_avgp_3d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::ml::avg_pool_3d_forward(input, base::c1, base::c2, base::c3);
+        dll::auto_timer timer("avgp:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        avgp_detail::forward(etl::dim<0>(x), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3, x.memory_start(), output.memory_start());
     }
 
     /*!
@@ -199,11 +212,11 @@ struct dyn_avgp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_avgp_3d_layer_imp
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
-        size_t c3 = base::c3;
+        dll::auto_timer timer("avgp:backward_batch");
 
-        output = etl::ml::avg_pool_3d_backward(context.input, context.output, context.errors, c1, c2, c3);
+        // Each input receives the scaled error of its window
+        avgp_detail::backward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3,
+                              context.errors.memory_start(), output.memory_start());
     }
 
     /*!
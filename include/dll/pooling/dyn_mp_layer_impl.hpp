@@ -8,6 +8,9 @@
 #pragma once
 
 #include "pooling_layer.hpp"
+#include "mp_kernels.hpp"
+
+#include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
 
@@ -48,6 +51,19 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         output = etl::ml::max_pool_forward(input, base::c1, base::c2);
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context,
+     * recording the position of each maximum for the backpropagation
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        dll::auto_timer timer("mp:train_forward_batch");
+
+        mp_detail::forward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, 1, base::c1, base::c2,
+                           context.input.memory_start(), context.output.memory_start(), context.indices.data());
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -78,10 +94,11 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
+        dll::auto_timer timer("mp:backward_batch");
 
-        output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
+        // Only the maximums recorded in the forward pass receive the errors
+        mp_detail::backward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, 1, base::c1, base::c2,
+                            context.errors.memory_start(), context.indices.data(), output.memory_start());
     }
 
     /*!
@@ -126,10 +143,15 @@ struct sgd_context<DBN, dyn_mp_2d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    std::vector<uint16_t> indices; ///< The position of the maximum of each output
+
     sgd_context(layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2),
-              errors(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2) {}
+              errors(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2),
+              indices(etl::size(output)) {
+        cpp_assert(layer.c1 * layer.c2 <= 65536, "The pooling window is too large");
+    }
 };
 
 /*!
@@ -187,6 +209,19 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
         output = etl::ml::max_pool_3d_forward(input, base::c1, base::c2, base::c3);
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context,
+     * recording the position of each maximum for the backpropagation
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        dll::auto_timer timer("mp:train_forward_batch");
+
+        mp_detail::forward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3,
+                           context.input.memory_start(), context.output.memory_start(), context.indices.data());
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -217,11 +252,11 @@ struct dyn_mp_3d_layer_impl final : dyn_pooling_3d_layer<dyn_mp_3d_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        size_t c1 = base::c1;
-        size_t c2 = base::c2;
-        size_t c3 = base::c3;
+        dll::auto_timer timer("mp:backward_batch");
 
-        output = etl::ml::max_pool_3d_backward(context.input, context.output, context.errors, c1, c2, c3);
+        // Only the maximums recorded in the forward pass receive the errors
+        mp_detail::backward(etl::dim<0>(context.input), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3,
+                            context.errors.memory_start(), context.indices.data(), output.memory_start());
     }
 
     /*!
@@ -266,10 +301,15 @@ struct sgd_context<DBN, dyn_mp_3d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    std::vector<uint16_t> indices; ///< The position of the maximum of each output
+
     sgd_context(layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1 / layer.c1, layer.i2 / layer.c2, layer.i3 / layer.c3),
-              errors(batch_size, layer.i1 / layer.c1, layer.i2 / layer.c2, layer.i3 / layer.c3) {}
+              errors(batch_size, layer.i1 / layer.c1, layer.i2 / layer.c2, layer.i3 / layer.c3),
+              indices(etl::size(output)) {
+        cpp_assert(layer.c1 * layer.c2 * layer.c3 <= 65536, "The pooling window is too large");
+    }
 };
 
 } //end of dll namespace
@@ -8,6 +8,11 @@
 #pragma once
 
 #include "unpooling_layer.hpp"
+#include "upsample_kernels.hpp"
+#include "mp_kernels.hpp"
+
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/direct.hpp" // for direct_memory
 
 namespace dll {
 
@@ -45,7 +50,33 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::upsample_3d(input, base::c1, base::c2, base::c3);
+        dll::auto_timer timer("upsample:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        upsample_detail::forward(etl::dim<0>(x), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3, x.memory_start(), output.memory_start());
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context.
+     *
+     * With max unpooling, each value is written at the position of the
+     * maximum recorded by the max pooling layer, the other outputs are
+     * zero.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        if /*constexpr*/ (desc::max_unpooling) {
+            dll::auto_timer timer("upsample:unpool:forward_batch");
+
+            // This is the scatter of the backpropagation of the max pooling
+            mp_detail::backward(etl::dim<0>(context.input), base::o1, base::o2, base::o3, base::c1, base::c2, base::c3,
+                                context.input.memory_start(), context.pool_indices->data(), context.output.memory_start());
+        } else {
+            forward_batch(context.output, context.input);
+        }
     }
 
     /*!
@@ -76,28 +107,17 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
-    template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() == 4)>
-    void backward_batch(H&& output, C& context) const {
-        const size_t c1 = base::c1;
-        const size_t c2 = base::c2;
-        const size_t c3 = base::c3;
-
-        output = etl::max_pool_3d(context.errors, c1, c2, c3);
-    }
-
-    /*!
-     * \brief Backpropagate the errors to the previous layers
-     * \param output The ETL expression into which write the output
-     * \param context The training context
-     */
-    template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() != 4)>
+    template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        const size_t c1 = base::c1;
-        const size_t c2 = base::c2;
-        const size_t c3 = base::c3;
-        const size_t B = etl::dim<0>(output);
-
-        etl::reshape(output, B, base::i1, base::i2, base::i3) = etl::max_pool_3d(context.errors, c1, c2, c3);
+        dll::auto_timer timer("upsample:backward_batch");
+
+        if /*constexpr*/ (desc::max_unpooling) {
+            // Only the positions of the maximums have been written
+            mp_detail::gather(etl::dim<0>(context.errors), base::o1, base::o2, base::o3, base::c1, base::c2, base::c3,
+                              context.errors.memory_start(), context.pool_indices->data(), output.memory_start());
+        } else {
+            upsample_detail::backward(etl::dim<0>(context.errors), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3, context.errors.memory_start(), output.memory_start());
+        }
     }
 
     /*!
@@ -142,6 +162,10 @@ struct sgd_context<DBN, dyn_upsample_3d_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    using index_t = typename unpooling_detail::pool_index<DBN, layer_t>::type; ///< The type of the positions of the maximums
+
+    const std::vector<index_t>* pool_indices = nullptr; ///< The positions of the maximums of the max pooling layer (max unpooling only)
+
     sgd_context(layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
               output(batch_size, layer.i1 * layer.c1, layer.i2 * layer.c2, layer.i3 * layer.c3),
@@ -0,0 +1,218 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Max pooling kernels recording the position of the maximum.
+ *
+ * The training forward pass stores, for each output, the position of the
+ * maximum inside its pooling window, in the smallest integer type able
+ * to hold the size of the window. The backward pass is then a scatter of
+ * the errors at these positions, without reading the input and the
+ * output again.
+ *
+ * The input of each sample is seen as D1 x D2 x D3, pooled with windows of
+ * K1 x K2 x K3 (the 2D pooling is a 3D pooling with K1 = 1).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <type_traits>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+namespace mp_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
+/*!
+ * \brief The type of the indices of the maximums for a window of the
+ * given size
+ */
+template <size_t S>
+using index_t = std::conditional_t<S <= 256, uint8_t, std::conditional_t<S <= 65536, uint16_t, uint32_t>>;
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Max pooling of a batch, recording the position of each maximum
+ *
+ * \param B The number of samples
+ * \param in The input (B x D1 x D2 x D3)
+ * \param out The output (B x D1 / K1 x D2 / K2 x D3 / K3)
+ * \param indices The position of the maximum of each output in its window
+ */
+template <typename T, typename I>
+void forward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* in, T* out, I* indices) {
+    const size_t O1 = D1 / K1;
+    const size_t O2 = D2 / K2;
+    const size_t O3 = D3 / K3;
+
+    // One task per output plane of each sample
+    for_each_task(B * O1, B * D1 * D2 * D3, [=](size_t t) {
+        const size_t b = t / O1;
+        const size_t i = t % O1;
+
+        const T* x = in + b * D1 * D2 * D3;
+        T* y       = out + t * O2 * O3;
+        I* m       = indices + t * O2 * O3;
+
+        for (size_t j = 0; j < O2; ++j) {
+            for (size_t k = 0; k < O3; ++k) {
+                T max      = x[((i * K1) * D2 + j * K2) * D3 + k * K3];
+                size_t pos = 0;
+
+                for (size_t c1 = 0; c1 < K1; ++c1) {
+                    for (size_t c2 = 0; c2 < K2; ++c2) {
+                        const T* row = x + ((i * K1 + c1) * D2 + j * K2 + c2) * D3 + k * K3;
+
+                        for (size_t c3 = 0; c3 < K3; ++c3) {
+                            if (row[c3] > max) {
+                                max = row[c3];
+                                pos = (c1 * K2 + c2) * K3 + c3;
+                            }
+                        }
+                    }
+                }
+
+                y[j * O3 + k] = max;
+                m[j * O3 + k] = I(pos);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors of the output plane i of a sample to
+ * its input planes
+ *
+ * \param e The errors of the output plane (O2 x O3)
+ * \param m The positions of the maximums of the output plane
+ * \param dx The errors of the input of the sample
+ */
+template <typename T, typename I>
+DLL_MULTI_VERSION void backward_plane(size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, size_t O2, size_t O3, size_t i, const T* e, const I* m, T* dx) {
+    // Each window is written once, the maximum receives the error
+    for (size_t c1 = 0; c1 < K1; ++c1) {
+        for (size_t j = 0; j < O2; ++j) {
+            for (size_t c2 = 0; c2 < K2; ++c2) {
+                T* row = dx + ((i * K1 + c1) * D2 + j * K2 + c2) * D3;
+
+                for (size_t k = 0; k < O3; ++k) {
+                    const size_t base = (c1 * K2 + c2) * K3;
+                    const size_t pos  = m[j * O3 + k];
+
+                    for (size_t c3 = 0; c3 < K3; ++c3) {
+                        row[k * K3 + c3] = base + c3 == pos ? e[j * O3 + k] : T(0);
+                    }
+                }
+
+                // The inputs after the last complete window
+                for (size_t c3 = O3 * K3; c3 < D3; ++c3) {
+                    row[c3] = T(0);
+                }
+            }
+        }
+
+        for (size_t j = O2 * K2; j < D2; ++j) {
+            std::fill(dx + ((i * K1 + c1) * D2 + j) * D3, dx + ((i * K1 + c1) * D2 + j + 1) * D3, T(0));
+        }
+    }
+}
+
+/*!
+ * \brief Backpropagate the errors of a max pooling layer to the positions
+ * of the maximums, the other inputs having no errors.
+ *
+ * \param B The number of samples
+ * \param errors The errors of the output (B x D1 / K1 x D2 / K2 x D3 / K3)
+ * \param indices The position of the maximum of each output in its window
+ * \param in_errors The errors of the input (B x D1 x D2 x D3)
+ */
+template <typename T, typename I>
+void backward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* errors, const I* indices, T* in_errors) {
+    const size_t O1 = D1 / K1;
+    const size_t O2 = D2 / K2;
+    const size_t O3 = D3 / K3;
+
+    for_each_task(B * O1, B * D1 * D2 * D3, [=](size_t t) {
+        const size_t b = t / O1;
+        const size_t i = t % O1;
+
+        backward_plane(D2, D3, K1, K2, K3, O2, O3, i, errors + t * O2 * O3, indices + t * O2 * O3, in_errors + b * D1 * D2 * D3);
+    });
+
+    // The planes after the last complete window
+    if (O1 * K1 < D1) {
+        for (size_t b = 0; b < B; ++b) {
+            std::fill(in_errors + (b * D1 + O1 * K1) * D2 * D3, in_errors + (b + 1) * D1 * D2 * D3, T(0));
+        }
+    }
+}
+
+/*!
+ * \brief Gather the values of a batch at the positions of the maximums of
+ * its windows.
+ *
+ * This is the backpropagation of the errors of a max unpooling layer,
+ * whose forward pass is the scatter of the backward of the max pooling.
+ *
+ * \param B The number of samples
+ * \param in The values (B x D1 x D2 x D3)
+ * \param indices The position of the maximum of each output in its window
+ * \param out The gathered values (B x D1 / K1 x D2 / K2 x D3 / K3)
+ */
+template <typename T, typename I>
+void gather(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* in, const I* indices, T* out) {
+    const size_t O1 = D1 / K1;
+    const size_t O2 = D2 / K2;
+    const size_t O3 = D3 / K3;
+
+    for_each_task(B * O1, B * O1 * O2 * O3, [=](size_t t) {
+        const size_t b = t / O1;
+        const size_t i = t % O1;
+
+        const T* x = in + b * D1 * D2 * D3;
+        const I* m = indices + t * O2 * O3;
+        T* y       = out + t * O2 * O3;
+
+        for (size_t j = 0; j < O2; ++j) {
+            for (size_t k = 0; k < O3; ++k) {
+                const size_t pos = m[j * O3 + k];
+
+                const size_t c1 = pos / (K2 * K3);
+                const size_t c2 = (pos / K3) % K2;
+                const size_t c3 = pos % K3;
+
+                y[j * O3 + k] = x[((i * K1 + c1) * D2 + j * K2 + c2) * D3 + k * K3 + c3];
+            }
+        }
+    });
+}
+
+} //end of namespace mp_detail
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "pooling_layer.hpp"
+#include "mp_kernels.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -51,6 +52,19 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
         output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context,
+     * recording the position of each maximum for the backpropagation
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        dll::auto_timer timer("mp:train_forward_batch");
+
+        mp_detail::forward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, 1, base::C1, base::C2,
+                           context.input.memory_start(), context.output.memory_start(), context.indices.data());
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -83,10 +97,9 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("mp:backward_batch");
 
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-
-        output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        // Only the maximums recorded in the forward pass receive the errors
+        mp_detail::backward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, 1, base::C1, base::C2,
+                            context.errors.memory_start(), context.indices.data(), output.memory_start());
     }
 
     /*!
@@ -139,7 +152,9 @@ struct sgd_context<DBN, mp_2d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
 
-    sgd_context(mp_2d_layer_impl<Desc>& /*layer*/){}
+    std::vector<mp_detail::index_t<layer_t::C1 * layer_t::C2>> indices; ///< The position of the maximum of each output
+
+    sgd_context(mp_2d_layer_impl<Desc>& /*layer*/) : indices(batch_size * O1 * O2 * O3) {}
 };
 
 /*!
@@ -180,6 +195,19 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
         output = etl::ml::max_pool_3d_forward<base::C1, base::C2, base::C3>(input);
     }
 
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context,
+     * recording the position of each maximum for the backpropagation
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        dll::auto_timer timer("mp:train_forward_batch");
+
+        mp_detail::forward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3,
+                           context.input.memory_start(), context.output.memory_start(), context.indices.data());
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -212,11 +240,9 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("mp:backward_batch");
 
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling third dimension
-
-        output = etl::ml::max_pool_3d_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        // Only the maximums recorded in the forward pass receive the errors
+        mp_detail::backward(etl::dim<0>(context.input), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3,
+                            context.errors.memory_start(), context.indices.data(), output.memory_start());
     }
 
     /*!
@@ -269,7 +295,9 @@ struct sgd_context<DBN, mp_3d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
 
-    sgd_context(mp_3d_layer_impl<Desc>& /*layer*/){}
+    std::vector<mp_detail::index_t<layer_t::C1 * layer_t::C2 * layer_t::C3>> indices; ///< The position of the maximum of each output
+
+    sgd_context(mp_3d_layer_impl<Desc>& /*layer*/) : indices(batch_size * O1 * O2 * O3) {}
 };
 
 } //end of dll namespace
@@ -7,12 +7,40 @@
 
 #pragma once
 
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
 #include "etl/etl.hpp"
 
 #include "dll/layer.hpp"
 
 namespace dll {
 
+namespace unpooling_detail {
+
+/*!
+ * \brief The type of the positions of the maximums of the max pooling
+ * layer of an unpooling layer, in the SGD context of the network
+ */
+template <typename DBN, typename Layer, typename Enable = void>
+struct pool_index {
+    using type = uint8_t; ///< Not used without max unpooling
+};
+
+/*!
+ * \copydoc pool_index
+ */
+template <typename DBN, typename Layer>
+struct pool_index<DBN, Layer, std::enable_if_t<Layer::desc::max_unpooling>> {
+    static constexpr size_t L = Layer::desc::pool_layer; ///< The index of the max pooling layer
+
+    using pool_t = typename DBN::template layer_type<L>;                             ///< The max pooling layer
+    using type   = typename decltype(sgd_context<DBN, pool_t, L>::indices)::value_type; ///< The type of its positions
+};
+
+} //end of namespace unpooling_detail
+
 /*!
  * \brief Standard unpooling layer (base class).
  */
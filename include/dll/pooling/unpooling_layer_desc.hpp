@@ -24,13 +24,19 @@ struct unpooling_3d_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The index of the max pooling layer whose maximums are unpooled (only with max_unpooling) */
+    static constexpr size_t pool_layer = detail::get_value_v<unpool_indices<0>, Parameters...>;
+
+    /*! Indicates if the values are unpooled at the maximums of pool_layer (the value is the same for both defaults only when it is set) */
+    static constexpr bool max_unpooling = pool_layer == detail::get_value_v<unpool_indices<1>, Parameters...>;
+
     static_assert(C1 > 0, "Cannot shrink a layer by less than 1");
     static_assert(C2 > 0, "Cannot shrink a layer by less than 1");
     static_assert(C3 > 0, "Cannot shrink a layer by less than 1");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, unpool_indices_id>, Parameters...>,
         "Invalid parameters type for unpooling_layer");
 };
 
@@ -42,9 +48,15 @@ struct dyn_unpooling_3d_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The index of the max pooling layer whose maximums are unpooled (only with max_unpooling) */
+    static constexpr size_t pool_layer = detail::get_value_v<unpool_indices<0>, Parameters...>;
+
+    /*! Indicates if the values are unpooled at the maximums of pool_layer (the value is the same for both defaults only when it is set) */
+    static constexpr bool max_unpooling = pool_layer == detail::get_value_v<unpool_indices<1>, Parameters...>;
+
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, unpool_indices_id>, Parameters...>,
         "Invalid parameters type for dyn_unpooling_layer");
 };
 
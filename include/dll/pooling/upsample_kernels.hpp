@@ -0,0 +1,124 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Nearest-neighbor upsampling kernels.
+ *
+ * The input of each sample is seen as D1 x D2 x D3, upsampled by K1 x K2 x
+ * K3. The forward pass expands each row of the input once and copies the
+ * expanded row to the K1 x K2 output rows of its window. The backward
+ * pass reduces each window of the errors, row by row.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace upsample_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Upsample a batch
+ *
+ * \param B The number of samples
+ * \param in The input (B x D1 x D2 x D3)
+ * \param out The output (B x D1 * K1 x D2 * K2 x D3 * K3)
+ */
+template <typename T>
+void forward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* in, T* out) {
+    const size_t O2 = D2 * K2;
+    const size_t O3 = D3 * K3;
+
+    // One task per input plane of each sample
+    for_each_task(B * D1, B * D1 * D2 * D3 * K1 * K2 * K3, [=](size_t t) {
+        const T* x = in + t * D2 * D3;
+        T* y       = out + t * K1 * O2 * O3;
+
+        for (size_t j = 0; j < D2; ++j) {
+            T* row = y + j * K2 * O3;
+
+            for (size_t k = 0; k < D3; ++k) {
+                std::fill(row + k * K3, row + (k + 1) * K3, x[j * D3 + k]);
+            }
+
+            for (size_t c2 = 1; c2 < K2; ++c2) {
+                std::copy(row, row + O3, row + c2 * O3);
+            }
+        }
+
+        for (size_t c1 = 1; c1 < K1; ++c1) {
+            std::copy(y, y + O2 * O3, y + c1 * O2 * O3);
+        }
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors of an upsampling layer: the error of each
+ * input is the maximum of the errors of its window.
+ *
+ * \param B The number of samples
+ * \param errors The errors of the output (B x D1 * K1 x D2 * K2 x D3 * K3)
+ * \param in_errors The errors of the input (B x D1 x D2 x D3)
+ */
+template <typename T>
+void backward(size_t B, size_t D1, size_t D2, size_t D3, size_t K1, size_t K2, size_t K3, const T* errors, T* in_errors) {
+    const size_t O2 = D2 * K2;
+    const size_t O3 = D3 * K3;
+
+    for_each_task(B * D1, B * D1 * D2 * D3 * K1 * K2 * K3, [=](size_t t) {
+        const T* e = errors + t * K1 * O2 * O3;
+        T* dx      = in_errors + t * D2 * D3;
+
+        for (size_t j = 0; j < D2; ++j) {
+            T* dst = dx + j * D3;
+
+            // The first row of the window initializes the maximums
+            const T* first = e + j * K2 * O3;
+
+            for (size_t k = 0; k < D3; ++k) {
+                dst[k] = *std::max_element(first + k * K3, first + (k + 1) * K3);
+            }
+
+            for (size_t c1 = 0; c1 < K1; ++c1) {
+                for (size_t c2 = c1 == 0 ? 1 : 0; c2 < K2; ++c2) {
+                    const T* row = e + (c1 * O2 + j * K2 + c2) * O3;
+
+                    for (size_t k = 0; k < D3; ++k) {
+                        for (size_t c3 = 0; c3 < K3; ++c3) {
+                            dst[k] = std::max(dst[k], row[k * K3 + c3]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+} //end of namespace upsample_detail
+
+} //end of dll namespace
@@ -9,6 +9,11 @@
 
 #include "dll/base_traits.hpp"
 #include "unpooling_layer.hpp"
+#include "upsample_kernels.hpp"
+#include "mp_kernels.hpp"
+
+#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/direct.hpp" // for direct_memory
 
 namespace dll {
 
@@ -46,7 +51,33 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::upsample_3d<base::C1, base::C2, base::C3>(input);
+        dll::auto_timer timer("upsample:forward_batch");
+
+        decltype(auto) x = direct_memory(input);
+
+        upsample_detail::forward(etl::dim<0>(x), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3, x.memory_start(), output.memory_start());
+    }
+
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context.
+     *
+     * With max unpooling, each value is written at the position of the
+     * maximum recorded by the max pooling layer, the other outputs are
+     * zero.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        if /*constexpr*/ (desc::max_unpooling) {
+            dll::auto_timer timer("upsample:unpool:forward_batch");
+
+            // This is the scatter of the backpropagation of the max pooling
+            mp_detail::backward(etl::dim<0>(context.input), base::O1, base::O2, base::O3, base::C1, base::C2, base::C3,
+                                context.input.memory_start(), context.pool_indices->data(), context.output.memory_start());
+        } else {
+            forward_batch(context.output, context.input);
+        }
     }
 
     /*!
@@ -77,29 +108,17 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
-    template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() == 4)>
+    template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling third dimension
-
-        output = etl::max_pool_3d<C1, C2, C3>(context.errors);
-    }
-
-    /*!
-     * \brief Backpropagate the errors to the previous layers
-     * \param output The ETL expression into which write the output
-     * \param context The training context
-     */
-    template<typename H, typename C, cpp_enable_iff(etl::decay_traits<H>::dimensions() != 4)>
-    void backward_batch(H&& output, C& context) const {
-        static constexpr size_t C1 = base::C1; ///< The pooling first dimension
-        static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling third dimension
-
-        constexpr auto B = etl::decay_traits<H>::template dim<0>();
-
-        etl::reshape<B, base::I1, base::I2, base::I3>(output) = etl::max_pool_3d<C1, C2, C3>(context.errors);
+        dll::auto_timer timer("upsample:backward_batch");
+
+        if /*constexpr*/ (desc::max_unpooling) {
+            // Only the positions of the maximums have been written
+            mp_detail::gather(etl::dim<0>(context.errors), base::O1, base::O2, base::O3, base::C1, base::C2, base::C3,
+                              context.errors.memory_start(), context.pool_indices->data(), output.memory_start());
+        } else {
+            upsample_detail::backward(etl::dim<0>(context.errors), base::I1, base::I2, base::I3, base::C1, base::C2, base::C3, context.errors.memory_start(), output.memory_start());
+        }
     }
 
     /*!
@@ -152,6 +171,10 @@ struct sgd_context<DBN, upsample_3d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, O1, O2, O3> output;
     etl::fast_matrix<weight, batch_size, O1, O2, O3> errors;
 
+    using index_t = typename unpooling_detail::pool_index<DBN, layer_t>::type; ///< The type of the positions of the maximums
+
+    const std::vector<index_t>* pool_indices = nullptr; ///< The positions of the maximums of the max pooling layer (max unpooling only)
+
     sgd_context(layer_t& /*layer*/) {}
 };
 
@@ -0,0 +1,83 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Explicit instantiations of the common dynamic layers.
+ *
+ * The layers listed here are instantiated once in the prebuilt library
+ * (lib/src/prebuilt.cpp, libdll_prebuilt.a). When DLL_PREBUILT is
+ * defined, this header declares them as extern templates and the
+ * translation units including it do not instantiate them again. Their
+ * objects must then be linked with the prebuilt library, built with the
+ * same flags.
+ *
+ * Only the members that are not templates are part of the library, the
+ * members templated on the input types are still instantiated in the
+ * translation unit using them.
+ */
+
+#pragma once
+
+#include "dll/rbm/dyn_rbm.hpp"
+#include "dll/rbm/dyn_conv_rbm.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/contrastive_divergence.hpp"
+#include "dll/dyn_network.hpp"
+
+/*!
+ * \brief Call the given macro with each of the prebuilt layer types
+ */
+#define DLL_PREBUILT_LAYERS(M)                                                              \
+    M(dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>)                                               \
+    M(dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>)                                  \
+    M(dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::weight_type<double>>>)                       \
+    M(dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum, dll::weight_type<double>>>)        \
+    M(dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<>>)                                     \
+    M(dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<dll::momentum>>)                        \
+    M(dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<dll::weight_type<double>>>)             \
+    M(dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<>>)                               \
+    M(dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::weight_type<double>>>)       \
+    M(dll::dyn_conv_layer_impl<dll::dyn_conv_layer_desc<>>)                                 \
+    M(dll::dyn_conv_layer_impl<dll::dyn_conv_layer_desc<dll::weight_type<double>>>)
+
+/*!
+ * \brief Call the given macro with each of the prebuilt trainer types
+ */
+#define DLL_PREBUILT_TRAINERS(M)                                                                 \
+    M(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>, false>)                    \
+    M(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>, false>)       \
+    M(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::weight_type<double>>>, false>) \
+    M(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>, true>)                     \
+    M(dll::base_cd_trainer<1, dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<>>, false>)          \
+    M(dll::base_cd_trainer<1, dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<dll::momentum>>, false>)
+
+/*!
+ * \brief Call the given macro with each of the prebuilt runtime network types
+ */
+#define DLL_PREBUILT_NETWORKS(M)         \
+    M(dll::dyn_network_dense<float>)     \
+    M(dll::dyn_network_dense<double>)    \
+    M(dll::dyn_network_conv<float>)      \
+    M(dll::dyn_network_conv<double>)     \
+    M(dll::dyn_network_mp<float>)        \
+    M(dll::dyn_network_mp<double>)       \
+    M(dll::dyn_network<float>)           \
+    M(dll::dyn_network<double>)
+
+#ifdef DLL_PREBUILT
+
+#define DLL_EXTERN_TEMPLATE(...) extern template struct __VA_ARGS__;
+
+DLL_PREBUILT_LAYERS(DLL_EXTERN_TEMPLATE)
+DLL_PREBUILT_TRAINERS(DLL_EXTERN_TEMPLATE)
+DLL_PREBUILT_NETWORKS(DLL_EXTERN_TEMPLATE)
+
+#undef DLL_EXTERN_TEMPLATE
+
+#endif
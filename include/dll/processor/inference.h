@@ -0,0 +1,63 @@
+/*=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================*/
+
+/*!
+ * \file inference.h
+ * \brief C interface of the inference libraries compiled by dllp (--library).
+ *
+ * The samples are given as n contiguous samples of dllp_input_size()
+ * floats, in the order of the input of the network. The outputs are
+ * written in the buffers of the caller, which must hold n labels or n
+ * samples of dllp_output_size() floats. The functions return 0 on
+ * success and the calls must not be concurrent.
+ */
+
+#ifndef DLLP_INFERENCE_H
+#define DLLP_INFERENCE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Load the weights of the network from the given file (stored by
+ * the save action)
+ */
+int dllp_load(const char* model_file);
+
+/*!
+ * \brief Release the loaded network
+ */
+void dllp_unload(void);
+
+/*!
+ * \brief Return the number of floats of one input sample (0 if no network is loaded)
+ */
+size_t dllp_input_size(void);
+
+/*!
+ * \brief Return the number of floats of one output sample (0 if no network is loaded)
+ */
+size_t dllp_output_size(void);
+
+/*!
+ * \brief Predict the labels (the maximum output) of n samples
+ */
+int dllp_predict_batch(const float* input, size_t n, size_t* labels);
+
+/*!
+ * \brief Compute the outputs of the network for n samples
+ */
+int dllp_features_batch(const float* input, size_t n, float* features);
+
+#ifdef __cplusplus
+} // end of extern "C"
+#endif
+
+#endif
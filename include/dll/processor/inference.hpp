@@ -0,0 +1,145 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+/*!
+ * \file inference.hpp
+ * \brief The network of the inference libraries generated by dllp.
+ *
+ * The network is loaded once and frozen (see dll/frozen_dbn.hpp), the
+ * samples of the caller are staged into a batch of the network allocated
+ * at load time and the outputs are written directly into the buffers of
+ * the caller. The last batch of a call is always computed as a full
+ * batch, only its first samples are written.
+ */
+
+#include <memory>
+#include <fstream>
+#include <algorithm>
+
+#include "dll/frozen_dbn.hpp"
+#include "dll/util/chunk.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+namespace processor {
+
+/*!
+ * \brief A loaded network, for the inference functions of the libraries
+ */
+template <typename DBN>
+struct inference_model {
+    using dbn_t       = DBN;                         ///< The type of the network
+    using weight      = typename dbn_t::weight;      ///< The data type of the network
+    using input_one_t = typename dbn_t::input_one_t; ///< The type of one input
+
+    static constexpr size_t batch_size = dbn_t::batch_size; ///< The number of samples of the staged batch
+
+    using batch_t = etl::dyn_matrix<weight, etl::decay_traits<input_one_t>::dimensions() + 1>; ///< The type of the staged batch
+
+    std::unique_ptr<dbn_t> dbn;    ///< The network
+    dll::frozen_dbn<dbn_t> frozen; ///< The frozen view of the network
+    batch_t input;                 ///< The staged batch
+
+    const size_t input_size;  ///< The size of one input sample
+    const size_t output_size; ///< The size of one output sample
+
+    /*!
+     * \brief Load the network from the given file
+     * \param file The weights stored by the network
+     * \return the loaded network, nullptr if the file cannot be read
+     */
+    static std::unique_ptr<inference_model> load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+
+        if (!is) {
+            return nullptr;
+        }
+
+        auto dbn = std::make_unique<dbn_t>();
+
+        dbn->load(is);
+
+        if (!is) {
+            return nullptr;
+        }
+
+        return std::make_unique<inference_model>(std::move(dbn));
+    }
+
+    /*!
+     * \brief Freeze the given network and allocate its staged batch
+     */
+    explicit inference_model(std::unique_ptr<dbn_t> network)
+            : dbn(std::move(network)),
+              frozen(*dbn),
+              input(make_batch(dbn->template layer_get<0>().prepare_one_input())),
+              input_size(etl::size(input) / batch_size),
+              output_size(dbn->output_size()) {
+        input = 0;
+    }
+
+    /*!
+     * \brief Predict the labels of the given samples
+     * \param samples The n samples
+     * \param n The number of samples
+     * \param labels The output labels
+     */
+    void predict_batch(const float* samples, size_t n, size_t* labels) {
+        forward(samples, n, [this, labels](const weight* output, size_t first, size_t m) {
+            for (size_t i = 0; i < m; ++i) {
+                const weight* row = output + i * output_size;
+
+                labels[first + i] = std::distance(row, std::max_element(row, row + output_size));
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the outputs of the network for the given samples
+     * \param samples The n samples
+     * \param n The number of samples
+     * \param features The output features
+     */
+    void features_batch(const float* samples, size_t n, float* features) {
+        forward(samples, n, [this, features](const weight* output, size_t first, size_t m) {
+            std::copy(output, output + m * output_size, features + first * output_size);
+        });
+    }
+
+private:
+    template <typename Input>
+    static batch_t make_batch(const Input& sample) {
+        return chunk_detail::make_chunk<weight>(batch_size, sample, std::make_index_sequence<etl::decay_traits<Input>::dimensions()>());
+    }
+
+    /*!
+     * \brief Compute the given samples by batches and pass the memory of
+     * each output batch to the given functor
+     */
+    template <typename Functor>
+    void forward(const float* samples, size_t n, Functor&& functor) {
+        for (size_t first = 0; first < n; first += batch_size) {
+            const size_t m = std::min(n - first, size_t(batch_size));
+
+            std::copy(samples + first * input_size, samples + (first + m) * input_size, input.memory_start());
+            dll::host_written(input);
+
+            auto output = frozen.forward_batch(input);
+
+            dll::host_read(output);
+
+            functor(output.memory_start(), first, m);
+        }
+    }
+};
+
+} //end of namespace processor
+
+} //end of namespace dll
@@ -12,6 +12,7 @@
  * \brief This file is made to be included by the dllp generated file only.
  */
 
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -23,6 +24,10 @@
 #include "dll/neural/conv_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/text_reader.hpp"
+#include "dll/util/counter_rng.hpp"
+#include "dll/generators/binary_data_generator.hpp"
+#include "dll/datasets/mnist_stream.hpp"
+#include "dll/feature_stream.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -32,11 +37,18 @@ namespace dll {
 namespace processor {
 
 struct options {
-    bool quiet  = false;
-    bool mkl    = false;
-    bool cublas = false;
-    bool cufft  = false;
-    bool cache  = false;
+    bool quiet       = false;
+    bool mkl         = false;
+    bool cublas      = false;
+    bool cufft       = false;
+    bool gpu         = false; ///< Keep the data and the parameters on the device between the batches (GPU mode of ETL)
+    bool cache       = false;
+    bool build_cache = true;  ///< Reuse the executables compiled from the same preprocessed source and flags
+    bool pch         = false; ///< Precompile the headers of the generated program
+    bool library     = false; ///< Also compile the inference library of the network (see dll/processor/inference.h)
+    size_t threads   = 0;     ///< The number of threads of the generated program (0 for the default of ETL)
+
+    std::string output = ".dbn"; ///< The prefix of the generated files
 };
 
 template <typename LastLayer, typename Enable = void>
@@ -52,6 +64,7 @@ struct sgd_possible<LastLayer, std::enable_if_t<decay_layer_traits<LastLayer>::b
 //These functions are only exposed to be able to unit-test the program
 int process_file(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
 std::string process_file_result(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
+int process_sweep(const options& opt, const std::vector<std::string>& actions, const std::vector<std::string>& source_files, size_t jobs);
 
 constexpr double stupid_default = -666.0;
 
@@ -70,6 +83,13 @@ struct datasource {
 
     long limit = -1;
 
+    bool out_of_memory        = false; ///< Stream the samples from the file, through an out-of-memory generator
+    bool threaded             = false; ///< Read the streamed batches with worker threads
+    size_t big_batch_size     = 1;     ///< The number of batches read at once from the stream
+    size_t noise              = 0;     ///< The percentage of noise added to the streamed samples
+    bool mirroring            = false; ///< Mirror horizontally the streamed samples
+    size_t elastic_distortion = 0;     ///< The kernel of the elastic distortions of the streamed samples (0 = none)
+
     datasource() {}
     datasource(std::string source_file, std::string reader)
             : source_file(std::move(source_file)), reader(std::move(reader)) {}
@@ -77,6 +97,14 @@ struct datasource {
     bool empty() const {
         return source_file.empty();
     }
+
+    /*!
+     * \brief Indicates if the samples are streamed by a generator instead of
+     * being read at once
+     */
+    bool streamed() const {
+        return out_of_memory || reader == "binary";
+    }
 };
 
 struct datasource_pack {
@@ -87,6 +115,12 @@ struct datasource_pack {
 struct general_desc {
     bool batch_mode       = false;
     size_t big_batch = 1;
+
+    std::string optimization = "O2";   ///< The optimization level of the generated program
+    bool native              = false;  ///< Compile for the native architecture (-march=native)
+    bool lto                 = false;  ///< Use Link Time Optimization
+    bool pgo                 = false;  ///< Use Profile Guided Optimization, with a warm-up run
+    std::string vectorize    = "full"; ///< The vectorization mode of ETL (full, expr, impl or none)
 };
 
 struct pretraining_desc {
@@ -113,6 +147,33 @@ struct weights_desc {
     std::string file = "weights.dat";
 };
 
+struct prediction_desc {
+    std::string file   = "predictions.csv"; ///< The file of the predicted outputs
+    std::string format = "csv";             ///< The format of the file (csv, float, bf16 or bits)
+
+    /*!
+     * \brief Indicates if the format is valid
+     */
+    bool valid() const {
+        return format == "csv" || format == "float" || format == "bf16" || format == "bits";
+    }
+
+    /*!
+     * \brief Return the encoding of the outputs in the file
+     */
+    dll::feature_encoding encoding() const {
+        if (format == "csv") {
+            return dll::feature_encoding::CSV;
+        } else if (format == "bf16") {
+            return dll::feature_encoding::BF16;
+        } else if (format == "bits") {
+            return dll::feature_encoding::BITS;
+        }
+
+        return dll::feature_encoding::FLOAT;
+    }
+};
+
 struct task {
     std::vector<std::string> default_actions;
 
@@ -120,10 +181,12 @@ struct task {
     dll::processor::datasource_pack pretraining_clean;
     dll::processor::datasource_pack training;
     dll::processor::datasource_pack testing;
+    dll::processor::datasource_pack predicting;
 
     dll::processor::pretraining_desc pt_desc;
     dll::processor::training_desc ft_desc;
     dll::processor::weights_desc w_desc;
+    dll::processor::prediction_desc p_desc;
     dll::processor::general_desc general_desc;
 };
 
@@ -171,14 +234,15 @@ bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
     if (ds.normal_noise) {
         mnist::normalize_each(samples);
 
-        std::random_device rd;
-        std::default_random_engine rand_engine(rd());
-        std::normal_distribution<float> normal_distribution(0.0, ds.normal_noise_d);
-        auto noise = std::bind(normal_distribution, rand_engine);
+        std::vector<float> noise;
 
         for (auto& vec : samples) {
+            noise.resize(etl::size(vec));
+            dll::next_rng().normal(noise.data(), noise.size(), 0.0f, float(ds.normal_noise_d));
+
+            size_t i = 0;
             for (auto& noisy_x : vec) {
-                noisy_x += noise();
+                noisy_x += noise[i++];
             }
         }
 
@@ -208,6 +272,115 @@ bool read_labels(const datasource& ds, std::vector<Label>& labels) {
     return !labels.empty();
 }
 
+/*!
+ * \brief The descriptors of the generators of the streamed data sources,
+ * without options.
+ *
+ * The dllp generated programs define their own descriptors, with the
+ * options of their data sources.
+ */
+struct default_streams {
+    template <typename... Parameters>
+    using pretraining = dll::outmemory_data_generator_desc<Parameters...>; ///< The generator of the pretraining samples
+
+    template <typename... Parameters>
+    using training = dll::outmemory_data_generator_desc<Parameters...>; ///< The generator of the training samples
+
+    template <typename... Parameters>
+    using testing = dll::outmemory_data_generator_desc<Parameters...>; ///< The generator of the testing samples
+
+    template <typename... Parameters>
+    using predicting = dll::outmemory_data_generator_desc<Parameters...>; ///< The generator of the samples to predict
+};
+
+/*!
+ * \brief Create an out-of-memory generator around the given streamed
+ * images, for an autoencoder
+ */
+template <typename Iterator, typename Desc>
+auto make_mnist_stream(const std::pair<Iterator, Iterator>& images, const datasource& labels, size_t limit, size_t n_classes, const Desc& desc, std::true_type /*autoencoder*/) {
+    cpp_unused(labels);
+    cpp_unused(limit);
+
+    return dll::make_generator(images.first, images.second, images.first, images.second, std::distance(images.first, images.second), n_classes, desc);
+}
+
+/*!
+ * \brief Create an out-of-memory generator around the given streamed
+ * images and the labels of the given data source
+ */
+template <typename Iterator, typename Desc>
+auto make_mnist_stream(const std::pair<Iterator, Iterator>& images, const datasource& labels, size_t limit, size_t n_classes, const Desc& desc, std::false_type /*autoencoder*/) {
+    using lit_t       = dll::mnist_stream_iterator<size_t>;
+    using generator_t = typename Desc::template generator_t<Iterator, lit_t>;
+
+    auto classes = dll::mnist_label_stream(labels.source_file, limit);
+
+    const size_t n = std::distance(images.first, images.second);
+
+    if (size_t(std::distance(classes.first, classes.second)) != n) {
+        std::cout << "dllp: error: the streamed samples and labels do not match" << std::endl;
+        return std::unique_ptr<generator_t>();
+    }
+
+    return dll::make_generator(images.first, images.second, classes.first, classes.second, n, n_classes, desc);
+}
+
+/*!
+ * \brief Create an out-of-memory generator streaming the MNIST files of the
+ * given data sources.
+ *
+ * \param samples The data source of the samples
+ * \param labels The data source of the labels, ignored for autoencoders
+ * \param n_classes The number of classes
+ * \return The generator, nullptr if the files cannot be streamed
+ */
+template <typename Sample, typename... Parameters>
+auto make_stream(const datasource& samples, const datasource& labels, size_t n_classes, const dll::outmemory_data_generator_desc<Parameters...>& desc) {
+    using desc_t = dll::outmemory_data_generator_desc<Parameters...>;
+    using it_t   = dll::mnist_stream_iterator<Sample>;
+
+    using autoencoder = std::integral_constant<bool, desc_t::AutoEncoder>;
+    using stream_t = decltype(make_mnist_stream(std::declval<std::pair<it_t, it_t>>(), labels, 0, n_classes, desc, autoencoder()));
+
+    const size_t limit = samples.limit > 0 ? samples.limit : 0;
+
+    if (samples.reader != "mnist") {
+        std::cout << "dllp: error: only the mnist reader can be read out of memory" << std::endl;
+        return stream_t();
+    }
+
+    auto images = dll::mnist_image_stream<Sample>(samples.source_file, limit);
+
+    if (images.first == images.second) {
+        return stream_t();
+    }
+
+    return make_mnist_stream(images, labels, limit, n_classes, desc, autoencoder());
+}
+
+/*!
+ * \brief Create a generator reading the samples and labels of the binary
+ * file of the given data source, by mapping the file.
+ *
+ * \param samples The data source of the samples
+ * \param labels Unused, the labels are in the binary file
+ * \param n_classes The number of classes
+ * \return The generator, nullptr if the file cannot be mapped
+ */
+template <typename Sample, typename... Parameters>
+auto make_stream(const datasource& samples, const datasource& labels, size_t n_classes, const dll::binary_data_generator_desc<Parameters...>& desc) {
+    cpp_unused(labels);
+
+    auto generator = dll::make_binary_generator<etl::dimensions<Sample>()>(samples.source_file, n_classes, desc);
+
+    if (!generator->size()) {
+        generator.reset();
+    }
+
+    return generator;
+}
+
 inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
     std::cout << std::string(25, '*') << std::endl;
@@ -216,15 +389,93 @@ inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
 }
 
-template <typename Container, bool Three, typename DBN>
+/*!
+ * \brief Evaluate the network on the batches of the given generator, in
+ * parallel, and print its error rates and its confusion matrix
+ */
+template <typename DBN, typename Generator>
+void test_network(DBN& dbn, Generator& generator) {
+    auto classes = dbn.output_size();
+
+    etl::dyn_matrix<size_t, 2> conf(classes, classes, size_t(0));
+
+    dbn.evaluate_metrics(generator, conf);
+
+    size_t n  = generator.size();
+    size_t tp = 0;
+
+    for (size_t l = 0; l < classes; ++l) {
+        tp += conf(l, l);
+    }
+
+    double test_error = (n - tp) / double(n);
+
+    std::cout << "Error rate: " << test_error << std::endl;
+    std::cout << "Accuracy: " << (1.0 - test_error) << std::endl
+              << std::endl;
+
+    std::cout << "Results per class" << std::endl;
+
+    double overall = 0.0;
+
+    std::cout << "   | Accuracy | Error rate |" << std::endl;
+
+    for (size_t l = 0; l < classes; ++l) {
+        size_t total = etl::sum(conf(l));
+        double acc = (total - conf(l, l)) / double(total);
+        std::cout << std::setw(3) << l;
+        std::cout << "|" << std::setw(10) << (1.0 - acc) << "|" << std::setw(12) << acc << "|" << std::endl;
+        overall += acc;
+    }
+
+    std::cout << std::endl;
+
+    std::cout << "Overall Error rate: " << overall / classes << std::endl;
+    std::cout << "Overall Accuracy: " << 1.0 - (overall / classes) << std::endl
+              << std::endl;
+
+    std::cout << "Confusion Matrix (%)" << std::endl
+              << std::endl;
+
+    std::cout << "    ";
+    for (size_t l = 0; l < classes; ++l) {
+        std::cout << std::setw(5) << l << " ";
+    }
+    std::cout << std::endl;
+
+    for (size_t l = 0; l < classes; ++l) {
+        size_t total = etl::sum(conf(l));
+        std::cout << std::setw(3) << l << "|";
+        for (size_t p = 0; p < classes; ++p) {
+            std::cout << std::setw(5) << std::setprecision(2) << 100.0 * (conf(l, p) / double(total)) << "|";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+template <typename Container, bool Three, typename Streams = default_streams, typename DBN>
 void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
     print_title("Network");
     dbn.display();
 
     using dbn_t = std::decay_t<DBN>;
 
+    // The warm-up run of profile guided optimization only trains one
+    // epoch and does not touch the weights file
+    const bool warmup = std::getenv("DLLP_WARMUP") != nullptr;
+
+    if (warmup) {
+        task.pt_desc.epochs = 1;
+        task.ft_desc.epochs = 1;
+    }
+
     //Execute all the actions sequentially
     for (auto& action : actions) {
+        if (warmup && action != "pretrain" && action != "train" && action != "test") {
+            continue;
+        }
+
         if (action == "pretrain") {
             print_title("Pretraining");
 
@@ -233,6 +484,30 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
+            if (task.pretraining.samples.streamed()) {
+                if (task.pt_desc.denoising) {
+                    std::cout << "dllp: error: denoising pretraining is not possible with streamed samples" << std::endl;
+                    return;
+                }
+
+                cpp::static_if<dbn_t::pretrain_possible>([&](auto f) {
+                    using net_t  = std::decay_t<decltype(f(dbn))>;
+                    using desc_t = typename Streams::template pretraining<dll::batch_size<net_t::template layer_type<net_t::rbm_layer_n>::batch_size>, dll::autoencoder>;
+
+                    auto generator = make_stream<Container>(task.pretraining.samples, task.pretraining.samples, dbn.output_size(), desc_t{});
+
+                    if (!generator) {
+                        std::cout << "dllp: error: failed to stream the pretraining samples" << std::endl;
+                        return;
+                    }
+
+                    //Pretrain the network
+                    f(dbn).pretrain(*generator, task.pt_desc.epochs);
+                });
+
+                continue;
+            }
+
             std::vector<Container> pt_samples;
 
             //Try to read the samples
@@ -263,11 +538,37 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "train") {
             print_title("Training");
 
-            if (task.training.samples.empty() || task.training.labels.empty()) {
+            if (task.training.samples.empty() || (task.training.labels.empty() && task.training.samples.reader != "binary")) {
                 std::cout << "dllp: error: train is not possible without samples and labels" << std::endl;
                 return;
             }
 
+            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+            if(!sgd_possible<last_layer>::value){
+                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
+                return;
+            }
+
+            if (task.training.samples.streamed()) {
+                using desc_t = typename Streams::template training<dll::batch_size<dbn_t::batch_size>, dll::categorical>;
+
+                auto generator = make_stream<Container>(task.training.samples, task.training.labels, dbn.output_size(), desc_t{});
+
+                if (!generator) {
+                    std::cout << "dllp: error: failed to stream the training samples" << std::endl;
+                    return;
+                }
+
+                //Train the network
+                cpp::static_if<sgd_possible<last_layer>::value>([&](auto f) {
+                    auto ft_error = f(dbn).fine_tune(*generator, task.ft_desc.epochs);
+                    std::cout << "Train Classification Error:" << ft_error << std::endl;
+                });
+
+                continue;
+            }
+
             std::vector<Container> ft_samples;
             std::vector<size_t> ft_labels;
 
@@ -283,13 +584,6 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
-            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
-
-            if(!sgd_possible<last_layer>::value){
-                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
-                return;
-            }
-
             //Train the network
             cpp::static_if<sgd_possible<last_layer>::value>([&](auto f) {
                 auto ft_error = f(dbn).fine_tune(ft_samples, ft_labels, task.ft_desc.epochs);
@@ -299,11 +593,26 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "test") {
             print_title("Testing");
 
-            if (task.testing.samples.empty() || task.testing.labels.empty()) {
+            if (task.testing.samples.empty() || (task.testing.labels.empty() && task.testing.samples.reader != "binary")) {
                 std::cout << "dllp: error: test is not possible without samples and labels" << std::endl;
                 return;
             }
 
+            using desc_t = typename Streams::template testing<dll::batch_size<dbn_t::batch_size>, dll::categorical>;
+
+            if (task.testing.samples.streamed()) {
+                auto generator = make_stream<Container>(task.testing.samples, task.testing.labels, dbn.output_size(), desc_t{});
+
+                if (!generator) {
+                    std::cout << "dllp: error: failed to stream the test samples" << std::endl;
+                    return;
+                }
+
+                test_network(dbn, *generator);
+
+                continue;
+            }
+
             std::vector<Container> test_samples;
             std::vector<size_t> test_labels;
 
@@ -319,70 +628,63 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
-            auto classes = dbn.output_size();
+            auto generator = dll::make_generator(
+                test_samples, test_labels,
+                test_samples.size(), dbn.output_size(),
+                dll::inmemory_data_generator_desc<dll::batch_size<dbn_t::batch_size>, dll::categorical>{});
 
-            etl::dyn_matrix<size_t, 2> conf(classes, classes, 0.0);
+            test_network(dbn, *generator);
+        } else if (action == "predict") {
+            print_title("Prediction");
 
-            size_t n  = test_samples.size();
-            size_t tp = 0;
-
-            for (size_t i = 0; i < test_samples.size(); ++i) {
-                auto sample = test_samples[i];
-                auto label  = test_labels[i];
-
-                auto predicted = dbn.predict(sample);
-
-                if (predicted == label) {
-                    ++tp;
-                }
-
-                ++conf(label, predicted);
+            if (task.predicting.samples.empty()) {
+                std::cout << "dllp: error: predict is not possible without a prediction input" << std::endl;
+                return;
             }
 
-            double test_error = (n - tp) / double(n);
+            if (!task.p_desc.valid()) {
+                std::cout << "dllp: error: invalid prediction format: " << task.p_desc.format << std::endl;
+                return;
+            }
 
-            std::cout << "Error rate: " << test_error << std::endl;
-            std::cout << "Accuracy: " << (1.0 - test_error) << std::endl
-                      << std::endl;
+            const auto encoding = task.p_desc.encoding();
 
-            std::cout << "Results per class" << std::endl;
+            bool written;
 
-            double overall = 0.0;
+            if (task.predicting.samples.streamed()) {
+                using desc_t = typename Streams::template predicting<dll::batch_size<dbn_t::batch_size>, dll::autoencoder>;
 
-            std::cout << "   | Accuracy | Error rate |" << std::endl;
+                auto generator = make_stream<Container>(task.predicting.samples, task.predicting.samples, dbn.output_size(), desc_t{});
 
-            for (size_t l = 0; l < classes; ++l) {
-                size_t total = etl::sum(conf(l));
-                double acc = (total - conf(l, l)) / double(total);
-                std::cout << std::setw(3) << l;
-                std::cout << "|" << std::setw(10) << (1.0 - acc) << "|" << std::setw(12) << acc << "|" << std::endl;
-                overall += acc;
-            }
+                if (!generator) {
+                    std::cout << "dllp: error: failed to stream the prediction samples" << std::endl;
+                    return;
+                }
 
-            std::cout << std::endl;
+                written = dll::stream_features(dbn, *generator, task.p_desc.file, encoding);
+            } else {
+                std::vector<Container> samples;
 
-            std::cout << "Overall Error rate: " << overall / classes << std::endl;
-            std::cout << "Overall Accuracy: " << 1.0 - (overall / classes) << std::endl
-                      << std::endl;
+                //Try to read the samples
+                if (!read_samples<Three>(task.predicting.samples, samples)) {
+                    std::cout << "dllp: error: failed to read the prediction samples" << std::endl;
+                    return;
+                }
 
-            std::cout << "Confusion Matrix (%)" << std::endl
-                      << std::endl;
+                auto generator = dll::make_generator(
+                    samples, samples,
+                    samples.size(), dbn.output_size(),
+                    dll::inmemory_data_generator_desc<dll::batch_size<dbn_t::batch_size>, dll::autoencoder>{});
 
-            std::cout << "    ";
-            for (size_t l = 0; l < classes; ++l) {
-                std::cout << std::setw(5) << l << " ";
+                written = dll::stream_features(dbn, *generator, task.p_desc.file, encoding);
             }
-            std::cout << std::endl;
 
-            for (size_t l = 0; l < classes; ++l) {
-                size_t total = etl::sum(conf(l));
-                std::cout << std::setw(3) << l << "|";
-                for (size_t p = 0; p < classes; ++p) {
-                    std::cout << std::setw(5) << std::setprecision(2) << 100.0 * (conf(l, p) / double(total)) << "|";
-                }
-                std::cout << std::endl;
+            if (!written) {
+                std::cout << "dllp: error: failed to write the predictions" << std::endl;
+                return;
             }
-            std::cout << std::endl;
+
+            std::cout << "Predictions written to " << task.p_desc.file << std::endl;
         } else if (action == "save") {
             print_title("Save Weights");
 
@@ -0,0 +1,538 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Structured pruning of a trained network into a smaller dynamic
+ * network.
+ *
+ * Whole hidden units of the dense layers and of the RBMs, and whole filters
+ * of the convolutional layers, are removed. The weights of the pruned
+ * network are compacted: the removed units are gone from the outputs of
+ * their layer and from the inputs of the next layer, the cost of the
+ * inference dropping with the number of removed units.
+ *
+ * The pruned network has the same layers as the trained network, as dynamic
+ * layers (dyn_dense_layer, dyn_rbm, dyn_conv_layer, dyn_mp_2d_layer and
+ * dyn_avgp_2d_layer). The layers without parameters nor shape (activation,
+ * dropout, transform layers) are kept as they are. The units of the last
+ * layer and of the layers followed by another kind of neural layer are never
+ * removed.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <array>
+#include <tuple>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The score of the units to remove
+ */
+enum class pruning_criterion {
+    MAGNITUDE, ///< The norm of the weights of the unit (or filter)
+    ACTIVATION ///< The mean absolute activation of the unit (or feature map) on the generator
+};
+
+/*!
+ * \brief The options of the pruning
+ */
+struct pruning_options {
+    double ratio                = 0.5;                          ///< The ratio of units removed from each pruned layer
+    pruning_criterion criterion = pruning_criterion::MAGNITUDE; ///< The score of the units
+};
+
+/*!
+ * \brief The result of a pruning
+ */
+struct pruning_report {
+    std::vector<size_t> units_before; ///< The number of output units (or filters) of each layer before pruning
+    std::vector<size_t> units_after;  ///< The number of output units (or filters) of each layer after pruning
+
+    size_t parameters_before = 0; ///< The number of parameters before pruning
+    size_t parameters_after  = 0; ///< The number of parameters after pruning
+
+    std::tuple<double, double> before; ///< The error and the loss of the network before pruning
+    std::tuple<double, double> after;  ///< The error and the loss of the network after pruning
+};
+
+namespace prune_detail {
+
+/*!
+ * \brief The units kept from the output of a layer
+ */
+struct kept_units {
+    bool all = true;           ///< Indicates if all the units are kept (before the first pruned layer)
+    std::vector<size_t> units; ///< The kept units (or channels), in order
+    size_t group = 1;          ///< The number of values of each unit (the size of a feature map)
+
+    /*!
+     * \brief Returns the kept channels of an input of the given number of
+     * channels
+     */
+    std::vector<size_t> channels(size_t n) const {
+        if (all) {
+            std::vector<size_t> result(n);
+            std::iota(result.begin(), result.end(), 0);
+            return result;
+        }
+
+        return units;
+    }
+
+    /*!
+     * \brief Returns the indices of the kept values of a flattened input of
+     * the given size
+     */
+    std::vector<size_t> values(size_t n) const {
+        if (all) {
+            return channels(n);
+        }
+
+        std::vector<size_t> result;
+        result.reserve(units.size() * group);
+
+        for (auto u : units) {
+            for (size_t s = 0; s < group; ++s) {
+                result.push_back(u * group + s);
+            }
+        }
+
+        return result;
+    }
+};
+
+/*!
+ * \brief Returns the units with the highest scores, in order
+ * \param scores The score of each unit
+ * \param ratio The ratio of units to remove
+ */
+inline std::vector<size_t> select_units(const std::vector<double>& scores, double ratio) {
+    const size_t n      = scores.size();
+    const size_t remove = std::min(n - 1, size_t(ratio * n));
+
+    std::vector<size_t> units(n);
+    std::iota(units.begin(), units.end(), 0);
+
+    std::stable_sort(units.begin(), units.end(), [&scores](size_t a, size_t b) { return scores[a] > scores[b]; });
+
+    units.resize(n - remove);
+
+    std::sort(units.begin(), units.end());
+
+    return units;
+}
+
+/*!
+ * \brief Accumulate the mean absolute activation of each unit of the given
+ * batch of output (batch x units x ...)
+ */
+template <typename Output>
+void accumulate_activations(std::vector<double>& scores, const Output& output) {
+    const size_t B     = etl::dim<0>(output);
+    const size_t units = etl::dim<1>(output);
+    const size_t group = etl::size(output) / (B * units);
+
+    scores.resize(units, 0.0);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t u = 0; u < units; ++u) {
+            const size_t start = (b * units + u) * group;
+
+            for (size_t s = 0; s < group; ++s) {
+                scores[u] += std::abs(double(output[start + s])) / group;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Pruning of a layer without parameters nor shape, kept as it is
+ */
+template <typename Layer, typename Enable = void>
+struct pruned_layer {
+    static_assert(!decay_layer_traits<Layer>::is_neural_layer(), "This layer cannot be pruned");
+
+    static constexpr bool neural   = false; ///< Indicates if the layer has parameters
+    static constexpr bool prunable = false; ///< Indicates if the units of the layer can be removed
+
+    /*!
+     * \brief Returns the number of output units of the layer
+     */
+    static size_t units(const Layer& layer) {
+        cpp_unused(layer);
+        return 0;
+    }
+
+    /*!
+     * \brief Initialize the pruned layer from the layer, the given inputs
+     * and outputs being kept, and return the units kept from its output
+     */
+    template <typename Target>
+    static kept_units apply(const Layer& layer, Target& target, const kept_units& in, const std::vector<size_t>& out) {
+        cpp_unused(layer);
+        cpp_unused(target);
+        cpp_unused(out);
+        return in;
+    }
+};
+
+/*!
+ * \brief Returns the dimensions (i2, i3, c1, c2) of a static pooling layer
+ */
+template <typename Layer, cpp_disable_if(decay_layer_traits<Layer>::is_dynamic())>
+std::array<size_t, 4> pooling_dims(const Layer&) {
+    return {{Layer::I2, Layer::I3, Layer::C1, Layer::C2}};
+}
+
+/*!
+ * \brief Returns the dimensions (i2, i3, c1, c2) of a dynamic pooling layer
+ */
+template <typename Layer, cpp_enable_iff(decay_layer_traits<Layer>::is_dynamic())>
+std::array<size_t, 4> pooling_dims(const Layer& layer) {
+    return {{layer.i2, layer.i3, layer.c1, layer.c2}};
+}
+
+/*!
+ * \brief Pruning of a pooling layer of each feature map, its channels being
+ * the kept channels of the previous layer
+ */
+template <typename Layer>
+struct pruned_layer<Layer, std::enable_if_t<
+                                  std::is_same<Layer, mp_2d_layer_impl<typename Layer::desc>>::value
+                               || std::is_same<Layer, dyn_mp_2d_layer_impl<typename Layer::desc>>::value
+                               || std::is_same<Layer, avgp_2d_layer_impl<typename Layer::desc>>::value
+                               || std::is_same<Layer, dyn_avgp_2d_layer_impl<typename Layer::desc>>::value>> {
+    static constexpr bool neural   = false; ///< Indicates if the layer has parameters
+    static constexpr bool prunable = false; ///< Indicates if the units of the layer can be removed
+
+    /*!
+     * \copydoc pruned_layer::units
+     */
+    static size_t units(const Layer& layer) {
+        cpp_unused(layer);
+        return 0;
+    }
+
+    /*!
+     * \copydoc pruned_layer::apply
+     */
+    template <typename Target>
+    static kept_units apply(const Layer& layer, Target& target, const kept_units& in, const std::vector<size_t>& out) {
+        cpp_unused(out);
+
+        const auto dims = pooling_dims(layer);
+
+        cpp_assert(in.all || in.group == dims[0] * dims[1], "The input of a pooling layer must be the feature maps of a convolutional layer");
+
+        kept_units kept;
+        kept.units = in.channels(dll::input_size(layer) / (dims[0] * dims[1]));
+        kept.group = (dims[0] / dims[2]) * (dims[1] / dims[3]);
+        kept.all   = in.all;
+
+        target.init_layer(kept.units.size(), dims[0], dims[1], dims[2], dims[3]);
+
+        return kept;
+    }
+};
+
+/*!
+ * \brief Pruning of a dense layer or of a dense RBM
+ */
+template <typename Layer>
+struct pruned_layer<Layer, std::enable_if_t<decay_layer_traits<Layer>::is_dense_layer()>> {
+    static constexpr bool neural   = true; ///< Indicates if the layer has parameters
+    static constexpr bool prunable = true; ///< Indicates if the units of the layer can be removed
+
+    /*!
+     * \copydoc pruned_layer::units
+     */
+    static size_t units(const Layer& layer) {
+        return etl::dim<1>(layer.w);
+    }
+
+    /*!
+     * \brief Returns the norm of the weights of each hidden unit
+     */
+    static std::vector<double> magnitudes(const Layer& layer) {
+        std::vector<double> norms(etl::dim<1>(layer.w), 0.0);
+
+        for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+            for (size_t j = 0; j < etl::dim<1>(layer.w); ++j) {
+                norms[j] += double(layer.w(i, j)) * double(layer.w(i, j));
+            }
+        }
+
+        for (auto& n : norms) {
+            n = std::sqrt(n);
+        }
+
+        return norms;
+    }
+
+    /*!
+     * \copydoc pruned_layer::apply
+     */
+    template <typename Target>
+    static kept_units apply(const Layer& layer, Target& target, const kept_units& in, const std::vector<size_t>& out) {
+        const auto rows = in.values(etl::dim<0>(layer.w));
+
+        cpp_assert(rows.size() <= etl::dim<0>(layer.w), "Invalid kept inputs for a dense layer");
+
+        target.init_layer(rows.size(), out.size());
+
+        for (size_t i = 0; i < rows.size(); ++i) {
+            for (size_t j = 0; j < out.size(); ++j) {
+                target.w(i, j) = layer.w(rows[i], out[j]);
+            }
+        }
+
+        for (size_t j = 0; j < out.size(); ++j) {
+            target.b(j) = layer.b(out[j]);
+        }
+
+        // The visible biases of the RBMs
+        cpp::static_if<decay_layer_traits<Layer>::is_rbm_layer()>([&](auto f) {
+            for (size_t i = 0; i < rows.size(); ++i) {
+                f(target).c(i) = f(layer).c(rows[i]);
+            }
+        });
+
+        kept_units kept;
+        kept.all   = false;
+        kept.units = out;
+
+        return kept;
+    }
+};
+
+/*!
+ * \brief Pruning of a convolutional layer
+ */
+template <typename Layer>
+struct pruned_layer<Layer, std::enable_if_t<
+                                  std::is_same<Layer, conv_layer_impl<typename Layer::desc>>::value
+                               || std::is_same<Layer, dyn_conv_layer_impl<typename Layer::desc>>::value>> {
+    static constexpr bool neural   = true; ///< Indicates if the layer has parameters
+    static constexpr bool prunable = true; ///< Indicates if the units of the layer can be removed
+
+    /*!
+     * \copydoc pruned_layer::units
+     */
+    static size_t units(const Layer& layer) {
+        return etl::dim<0>(layer.w);
+    }
+
+    /*!
+     * \brief Returns the norm of the weights of each filter
+     */
+    static std::vector<double> magnitudes(const Layer& layer) {
+        std::vector<double> norms(etl::dim<0>(layer.w));
+
+        for (size_t k = 0; k < norms.size(); ++k) {
+            norms[k] = std::sqrt(double(etl::sum(layer.w(k) >> layer.w(k))));
+        }
+
+        return norms;
+    }
+
+    /*!
+     * \copydoc pruned_layer::apply
+     */
+    template <typename Target>
+    static kept_units apply(const Layer& layer, Target& target, const kept_units& in, const std::vector<size_t>& out) {
+        const size_t nv1 = dll::get_nv1(layer);
+        const size_t nv2 = dll::get_nv2(layer);
+        const size_t nw1 = etl::dim<2>(layer.w);
+        const size_t nw2 = etl::dim<3>(layer.w);
+
+        cpp_assert(in.all || in.group == nv1 * nv2, "The input of a convolutional layer must be feature maps");
+
+        const auto channels = in.channels(etl::dim<1>(layer.w));
+
+        target.init_layer(channels.size(), nv1, nv2, out.size(), nw1, nw2);
+
+        for (size_t k = 0; k < out.size(); ++k) {
+            for (size_t c = 0; c < channels.size(); ++c) {
+                target.w(k)(c) = layer.w(out[k])(channels[c]);
+            }
+
+            target.b(k) = layer.b(out[k]);
+        }
+
+        kept_units kept;
+        kept.all   = false;
+        kept.units = out;
+        kept.group = (nv1 - nw1 + 1) * (nv2 - nw2 + 1);
+
+        return kept;
+    }
+};
+
+/*!
+ * \brief Returns the scores of the units of the layer I of the given network
+ */
+template <size_t I, typename Source, typename Generator, cpp_enable_iff(pruned_layer<typename Source::template layer_type<I>>::prunable)>
+std::vector<double> layer_scores(Source& source, Generator& generator, const pruning_options& options) {
+    using pruner_t = pruned_layer<typename Source::template layer_type<I>>;
+
+    if (options.criterion == pruning_criterion::MAGNITUDE) {
+        return pruner_t::magnitudes(source.template layer_get<I>());
+    }
+
+    std::vector<double> scores;
+
+    generator.reset();
+    generator.set_test();
+
+    while (generator.has_next_batch()) {
+        auto input_batch = generator.data_batch();
+
+        accumulate_activations(scores, source.template test_forward_batch<I>(input_batch));
+
+        generator.next_batch();
+    }
+
+    return scores;
+}
+
+/*!
+ * \brief Returns the scores of the units of a layer that cannot be pruned
+ */
+template <size_t I, typename Source, typename Generator, cpp_disable_if(pruned_layer<typename Source::template layer_type<I>>::prunable)>
+std::vector<double> layer_scores(Source& source, Generator& generator, const pruning_options& options) {
+    cpp_unused(source);
+    cpp_unused(generator);
+    cpp_unused(options);
+    return {};
+}
+
+/*!
+ * \brief Prune the layer I of the source network into the layer I of the
+ * target network
+ * \param kept The units kept from the output of the previous layer, updated
+ * with the units kept from the output of this layer
+ * \param prune Indicates if the units of the layer are removed
+ */
+template <size_t I, typename Source, typename Target, typename Generator>
+void prune_layer(Source& source, Target& target, Generator& generator, const pruning_options& options, pruning_report& report, kept_units& kept, bool prune) {
+    using pruner_t = pruned_layer<typename Source::template layer_type<I>>;
+
+    auto& layer = source.template layer_get<I>();
+
+    const size_t n = pruner_t::units(layer);
+
+    std::vector<size_t> out(n);
+    std::iota(out.begin(), out.end(), 0);
+
+    if (prune) {
+        out = select_units(layer_scores<I>(source, generator, options), options.ratio);
+    }
+
+    kept = pruner_t::apply(layer, target.template layer_get<I>(), kept, out);
+
+    report.units_before.push_back(n);
+    report.units_after.push_back(pruner_t::neural ? out.size() : 0);
+}
+
+/*!
+ * \brief Prune all the layers of the source network into the target network
+ */
+template <typename Source, typename Target, typename Generator, size_t... I>
+void prune_layers(Source& source, Target& target, Generator& generator, const pruning_options& options, pruning_report& report, std::index_sequence<I...>) {
+    constexpr size_t L = sizeof...(I);
+
+    const bool neural[]   = {pruned_layer<typename Source::template layer_type<I>>::neural...};
+    const bool prunable[] = {pruned_layer<typename Source::template layer_type<I>>::prunable...};
+
+    // The units of a layer are removed if the next neural layer can remove
+    // its inputs
+    bool prune_out[L];
+
+    for (size_t i = 0; i < L; ++i) {
+        size_t next = i + 1;
+
+        while (next < L && !neural[next]) {
+            ++next;
+        }
+
+        prune_out[i] = prunable[i] && next < L && prunable[next];
+    }
+
+    kept_units kept;
+
+    int unused[] = {(prune_layer<I>(source, target, generator, options, report, kept, prune_out[I]), 0)...};
+    cpp_unused(unused);
+}
+
+/*!
+ * \brief Returns the number of parameters of the given network
+ */
+template <typename DBN>
+size_t parameters(const DBN& dbn) {
+    size_t parameters = 0;
+
+    dbn.for_each_layer([&parameters](auto& layer) {
+        cpp::static_if<decay_layer_traits<decltype(layer)>::is_neural_layer()>([&](auto f) {
+            parameters += f(layer).parameters();
+        });
+    });
+
+    return parameters;
+}
+
+} //end of namespace prune_detail
+
+/*!
+ * \brief Prune the units of the given trained network into the given
+ * dynamic network and report the accuracy before and after pruning.
+ *
+ * The target network is initialized with the compacted weights of the
+ * source network, it can be fine-tuned once pruned.
+ *
+ * \param source The trained network
+ * \param target The pruned network, with the dynamic version of each layer
+ * \param generator The generator used for the activations and the evaluation
+ * \param options The options of the pruning
+ *
+ * \return The report of the pruning
+ */
+template <typename Source, typename Target, typename Generator>
+pruning_report prune(Source& source, Target& target, Generator& generator, const pruning_options& options = pruning_options()) {
+    static_assert(Source::layers == Target::layers, "The pruned network must have the same layers as the trained network");
+
+    cpp_assert(options.ratio >= 0.0 && options.ratio < 1.0, "The ratio of pruned units must be in [0, 1)");
+
+    pruning_report report;
+
+    prune_detail::prune_layers(source, target, generator, options, report, std::make_index_sequence<Source::layers>());
+
+    report.parameters_before = prune_detail::parameters(source);
+    report.parameters_after  = prune_detail::parameters(target);
+
+    report.before = source.evaluate_metrics(generator);
+    report.after  = target.evaluate_metrics(generator);
+
+    printf("parameters: %lu (pruned: %lu) \n", report.parameters_before, report.parameters_after);
+    printf("     error: %.5f (pruned: %.5f, drift: %+.5f) \n", std::get<0>(report.before), std::get<0>(report.after), std::get<0>(report.after) - std::get<0>(report.before));
+    printf("      loss: %.5f (pruned: %.5f, drift: %+.5f) \n", std::get<1>(report.before), std::get<1>(report.after), std::get<1>(report.after) - std::get<1>(report.before));
+
+    return report;
+}
+
+} //end of dll namespace
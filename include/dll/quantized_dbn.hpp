@@ -0,0 +1,547 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Post-training int8 quantization of a trained network.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/function.hpp"
+#include "dll/dbn_detail.hpp"
+#include "dll/neural/fake_quantization.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+namespace quantize_detail {
+
+/*!
+ * \brief Compute the scale to quantize values in [-range, range] to int8
+ * \param range The maximum absolute value
+ * \return The quantization scale
+ */
+inline float scale(float range) {
+    return range > 0.0f ? range / 127.0f : 1.0f;
+}
+
+/*!
+ * \brief Quantize a value to int8 with the given scale
+ * \param value The value to quantize
+ * \param scale The quantization scale
+ * \return the quantized value
+ */
+inline int8_t quantize(float value, float scale) {
+    return int8_t(std::max(-127L, std::min(127L, std::lround(value / scale))));
+}
+
+/*!
+ * \brief Compute the dot product of two int8 vectors, accumulated in int32
+ * \param a The first vector
+ * \param b The second vector
+ * \param n The size of the vectors
+ * \return the dot product
+ */
+DLL_MULTI_VERSION inline int32_t int8_dot(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t acc = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        acc += int32_t(a[i]) * int32_t(b[i]);
+    }
+
+    return acc;
+}
+
+/*!
+ * \brief Quantize a batch of input with the given scale
+ * \param out The quantized values
+ * \param input The batch of input, in floating point
+ * \param scale The quantization scale
+ */
+template <typename Input>
+void quantize_batch(std::vector<int8_t>& out, const Input& input, float scale) {
+    out.resize(etl::size(input));
+
+    for (size_t i = 0; i < etl::size(input); ++i) {
+        out[i] = quantize(float(input[i]), scale);
+    }
+}
+
+/*!
+ * \brief Return the maximum absolute value of the given expression
+ */
+template <typename E>
+float max_abs(const E& e) {
+    float m = 0.0f;
+
+    for (size_t i = 0; i < etl::size(e); ++i) {
+        m = std::max(m, std::abs(float(e[i])));
+    }
+
+    return m;
+}
+
+} //end of namespace quantize_detail
+
+/*!
+ * \brief Quantized state of a layer that is computed normally, in
+ * floating point.
+ */
+template <typename Layer>
+struct quantized_layer {
+    static constexpr bool quantized = false; ///< Indicates if the layer is computed in int8
+
+    /*!
+     * \brief Quantize the given layer
+     * \param layer The layer to quantize
+     */
+    explicit quantized_layer(const Layer& layer) {
+        cpp_unused(layer);
+    }
+
+    /*!
+     * \brief Does nothing, the layer is not quantized
+     * \param input A batch of input of the layer
+     */
+    template <typename Input>
+    void calibrate(const Input& input) {
+        cpp_unused(input);
+    }
+};
+
+/*!
+ * \brief Quantized state of a dense layer.
+ *
+ * The weights are quantized with one scale per output neuron and the
+ * input with one scale calibrated from the range of its activations.
+ * The products are accumulated in 32 bits and dequantized before the
+ * biases and the activation function.
+ */
+template <typename Desc>
+struct quantized_layer<dense_layer_impl<Desc>> {
+    using layer_t = dense_layer_impl<Desc>;   ///< The quantized layer
+    using weight  = typename layer_t::weight; ///< The data type of the layer
+
+    static constexpr bool quantized = true; ///< Indicates if the layer is computed in int8
+
+    static constexpr size_t num_visible = layer_t::num_visible; ///< The number of visible units
+    static constexpr size_t num_hidden  = layer_t::num_hidden;  ///< The number of hidden units
+
+    const layer_t& layer;        ///< The quantized layer
+    std::vector<int8_t> w;       ///< The quantized weights (num_hidden x num_visible)
+    std::vector<float> w_scale;  ///< The scale of the weights of each output
+    bool trained;                ///< Indicates if the scales have been learned by quantization-aware training
+    float input_range = 0.0f;    ///< The calibrated range of the input
+
+    /*!
+     * \brief Quantize the given layer
+     * \param layer The layer to quantize
+     */
+    explicit quantized_layer(const layer_t& layer) : layer(layer), w(num_hidden * num_visible), w_scale(num_hidden), trained(layer_t::quantization_aware && layer.quantization.trained()) {
+        // The scales learned by quantization-aware training are used directly
+        if (trained) {
+            input_range = float(qat_detail::levels) * float(qat_detail::effective_scale(layer.quantization.x_scale[0]));
+        }
+
+        for (size_t j = 0; j < num_hidden; ++j) {
+            if (trained) {
+                w_scale[j] = float(qat_detail::effective_scale(layer.quantization.w_scale[j]));
+            } else {
+                float range = 0.0f;
+
+                for (size_t i = 0; i < num_visible; ++i) {
+                    range = std::max(range, std::abs(float(layer.w(i, j))));
+                }
+
+                w_scale[j] = quantize_detail::scale(range);
+            }
+
+            // The weights of each output are contiguous for the accumulation
+            for (size_t i = 0; i < num_visible; ++i) {
+                w[j * num_visible + i] = quantize_detail::quantize(layer.w(i, j), w_scale[j]);
+            }
+        }
+    }
+
+    /*!
+     * \brief Update the range of the input with the given batch, unless
+     * it has been learned
+     * \param input A batch of input of the layer
+     */
+    template <typename Input>
+    void calibrate(const Input& input) {
+        if (!trained) {
+            input_range = std::max(input_range, quantize_detail::max_abs(input));
+        }
+    }
+
+    /*!
+     * \brief Compute the output of the layer for the given batch of input
+     * \param input A batch of input
+     * \return the batch of output
+     */
+    template <typename Input>
+    etl::dyn_matrix<weight, 2> forward_batch(const Input& input) const {
+        const size_t Batch = etl::dim<0>(input);
+        const float s      = quantize_detail::scale(input_range);
+
+        std::vector<int8_t> x;
+        quantize_detail::quantize_batch(x, input, s);
+
+        etl::dyn_matrix<weight, 2> output(Batch, num_hidden);
+
+        parallel_for_n(Batch, [&](size_t b) {
+            const int8_t* xb = x.data() + b * num_visible;
+
+            for (size_t j = 0; j < num_hidden; ++j) {
+                const int8_t* wj = w.data() + j * num_visible;
+
+                const int32_t acc = quantize_detail::int8_dot(xb, wj, num_visible);
+
+                output(b, j) = weight(acc) * (s * w_scale[j]);
+            }
+        });
+
+        if /*constexpr*/ (!layer_t::no_bias) {
+            output = bias_add_2d(output, layer.b);
+        }
+
+        output = f_activate<layer_t::activation_function>(output);
+
+        return output;
+    }
+};
+
+/*!
+ * \brief Quantized state of a convolutional layer.
+ *
+ * The weights are quantized with one scale per filter and the input
+ * with one scale calibrated from the range of its activations. The
+ * products are accumulated in 32 bits and dequantized before the
+ * biases and the activation function.
+ */
+template <typename Desc>
+struct quantized_layer<conv_layer_impl<Desc>> {
+    using layer_t = conv_layer_impl<Desc>;    ///< The quantized layer
+    using weight  = typename layer_t::weight; ///< The data type of the layer
+
+    static constexpr bool quantized = true; ///< Indicates if the layer is computed in int8
+
+    static constexpr size_t NV1 = layer_t::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = layer_t::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = layer_t::NW1; ///< The first dimension of the filter
+    static constexpr size_t NW2 = layer_t::NW2; ///< The second dimension of the filter
+    static constexpr size_t NC  = layer_t::NC;  ///< The number of input channels
+    static constexpr size_t K   = layer_t::K;   ///< The number of filters
+    static constexpr size_t NH1 = layer_t::NH1; ///< The first dimension of the output
+    static constexpr size_t NH2 = layer_t::NH2; ///< The second dimension of the output
+    static constexpr size_t S1  = layer_t::S1;  ///< The stride of the first dimension
+    static constexpr size_t S2  = layer_t::S2;  ///< The stride of the second dimension
+    static constexpr size_t P1  = layer_t::P1;  ///< The padding of the first dimension
+    static constexpr size_t P2  = layer_t::P2;  ///< The padding of the second dimension
+
+    static constexpr size_t filter_size = NC * NW1 * NW2; ///< The number of weights of one filter
+
+    const layer_t& layer;        ///< The quantized layer
+    std::vector<int8_t> w;       ///< The quantized weights (K x NC x NW1 x NW2)
+    std::vector<float> w_scale;  ///< The scale of the weights of each filter
+    bool trained;                ///< Indicates if the scales have been learned by quantization-aware training
+    float input_range = 0.0f;    ///< The calibrated range of the input
+
+    /*!
+     * \brief Quantize the given layer
+     * \param layer The layer to quantize
+     */
+    explicit quantized_layer(const layer_t& layer) : layer(layer), w(K * filter_size), w_scale(K), trained(layer_t::quantization_aware && layer.quantization.trained()) {
+        // The scales learned by quantization-aware training are used directly
+        if (trained) {
+            input_range = float(qat_detail::levels) * float(qat_detail::effective_scale(layer.quantization.x_scale[0]));
+        }
+
+        for (size_t k = 0; k < K; ++k) {
+            if (trained) {
+                w_scale[k] = float(qat_detail::effective_scale(layer.quantization.w_scale[k]));
+            } else {
+                w_scale[k] = quantize_detail::scale(quantize_detail::max_abs(layer.w(k)));
+            }
+
+            for (size_t i = 0; i < filter_size; ++i) {
+                w[k * filter_size + i] = quantize_detail::quantize(layer.w(k)[i], w_scale[k]);
+            }
+        }
+    }
+
+    /*!
+     * \brief Update the range of the input with the given batch, unless
+     * it has been learned
+     * \param input A batch of input of the layer
+     */
+    template <typename Input>
+    void calibrate(const Input& input) {
+        if (!trained) {
+            input_range = std::max(input_range, quantize_detail::max_abs(input));
+        }
+    }
+
+    /*!
+     * \brief Compute the output of the layer for the given batch of input
+     * \param input A batch of input
+     * \return the batch of output
+     */
+    template <typename Input>
+    etl::dyn_matrix<weight, 4> forward_batch(const Input& input) const {
+        const size_t Batch = etl::dim<0>(input);
+        const float s      = quantize_detail::scale(input_range);
+
+        std::vector<int8_t> x;
+        quantize_detail::quantize_batch(x, input, s);
+
+        etl::dyn_matrix<weight, 4> output(Batch, K, NH1, NH2);
+
+        parallel_for_n(Batch * K, [&](size_t bk) {
+            const size_t b = bk / K;
+            const size_t k = bk % K;
+
+            const int8_t* xb = x.data() + b * NC * NV1 * NV2;
+            const int8_t* wk = w.data() + k * filter_size;
+
+            const float ds = s * w_scale[k];
+
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    int32_t acc = 0;
+
+                    for (size_t c = 0; c < NC; ++c) {
+                        for (size_t p = 0; p < NW1; ++p) {
+                            const int8_t* wr = wk + (c * NW1 + p) * NW2;
+
+                            if /*constexpr*/ (S1 == 1 && S2 == 1 && P1 == 0 && P2 == 0) {
+                                const int8_t* xr = xb + (c * NV1 + i + p) * NV2 + j;
+
+                                for (size_t q = 0; q < NW2; ++q) {
+                                    acc += int32_t(xr[q]) * int32_t(wr[q]);
+                                }
+                            } else {
+                                // Unsigned wrap-around makes the padding out of range
+                                const size_t ii = i * S1 + p - P1;
+
+                                if (ii >= NV1) {
+                                    continue;
+                                }
+
+                                const int8_t* xr = xb + (c * NV1 + ii) * NV2;
+
+                                for (size_t q = 0; q < NW2; ++q) {
+                                    const size_t jj = j * S2 + q - P2;
+
+                                    if (jj < NV2) {
+                                        acc += int32_t(xr[jj]) * int32_t(wr[q]);
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    output(b, k, i, j) = weight(acc) * ds;
+                }
+            }
+        });
+
+        if /*constexpr*/ (!layer_t::no_bias) {
+            output = bias_add_4d(output, layer.b);
+        }
+
+        if /*constexpr*/ (layer_t::activation_function != function::IDENTITY) {
+            output = f_activate<layer_t::activation_function>(output);
+        }
+
+        return output;
+    }
+};
+
+namespace quantize_detail {
+
+template <typename DBN, typename Sequence>
+struct quantized_layers;
+
+/*!
+ * \brief Helper to build the quantized state of all the layers of a network
+ */
+template <typename DBN, size_t... I>
+struct quantized_layers<DBN, std::index_sequence<I...>> {
+    using type = std::tuple<quantized_layer<typename DBN::template layer_type<I>>...>; ///< The tuple of quantized layers
+
+    /*!
+     * \brief Quantize all the layers of the given network
+     */
+    static type make(const DBN& dbn) {
+        return type(quantized_layer<typename DBN::template layer_type<I>>(dbn.template layer_get<I>())...);
+    }
+};
+
+} //end of namespace quantize_detail
+
+/*!
+ * \brief An int8 quantized view of a trained network, for inference.
+ *
+ * The dense and convolutional layers are computed with int8 weights
+ * (one scale per output) and int8 inputs (one scale per layer,
+ * calibrated on a sample generator), with 32 bits accumulation. The
+ * other layers are computed normally.
+ *
+ * The quantization-aware layers (dll::quantization_aware) use the scales
+ * learned during their training instead.
+ *
+ * The network must outlive its quantized view and must be quantized
+ * again after having been trained.
+ */
+template <typename DBN>
+struct quantized_dbn {
+    using dbn_t     = DBN;                      ///< The network type
+    using weight    = typename dbn_t::weight;   ///< The data type of the network
+    using metrics_t = typename dbn_t::metrics_t; ///< The evaluation metrics
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using quantized_layers_t = typename quantize_detail::quantized_layers<dbn_t, std::make_index_sequence<layers>>::type; ///< The quantized layers
+
+private:
+    template <size_t L>
+    using quantized_layer_t = std::tuple_element_t<L, quantized_layers_t>;
+
+    dbn_t& dbn;                          ///< The quantized network
+    quantized_layers_t quantized_layers; ///< The quantized state of the layers
+
+public:
+    /*!
+     * \brief Quantize the given network, calibrating the ranges of the
+     * inputs of the quantized layers on the given generator.
+     *
+     * \param dbn The network to quantize
+     * \param generator The generator of calibration samples
+     */
+    template <typename Generator>
+    quantized_dbn(dbn_t& dbn, Generator& generator)
+            : dbn(dbn), quantized_layers(quantize_detail::quantized_layers<dbn_t, std::make_index_sequence<layers>>::make(dbn)) {
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            calibrate_impl<0>(generator.data_batch());
+
+            generator.next_batch();
+        }
+    }
+
+    /*!
+     * \brief Return the test representation of the network for the given input batch.
+     * \param batch The input batch
+     * \return The output batch of the last layer of the network
+     */
+    template <typename Input>
+    auto forward_batch(const Input& batch) const {
+        return forward_batch_impl<0>(batch);
+    }
+
+    /*!
+     * \brief Evaluate the quantized network on the given classification
+     * task and return the evaluation metrics.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics(Generator& generator) {
+        auto forward_helper = [this](auto&& input_batch) {
+            return this->forward_batch(input_batch);
+        };
+
+        return dbn.evaluate_metrics(generator, forward_helper);
+    }
+
+    /*!
+     * \brief Evaluate both the network and its quantized view on the
+     * given classification task and print the accuracy drift.
+     *
+     * \param generator The data generator
+     *
+     * \return The metrics of the network and of the quantized network
+     */
+    template <typename Generator>
+    std::pair<metrics_t, metrics_t> evaluate_drift(Generator& generator) {
+        auto reference = dbn.evaluate_metrics(generator);
+        auto quantized = evaluate_metrics(generator);
+
+        printf("     error: %.5f (int8: %.5f, drift: %+.5f) \n", std::get<0>(reference), std::get<0>(quantized), std::get<0>(quantized) - std::get<0>(reference));
+        printf("      loss: %.5f (int8: %.5f, drift: %+.5f) \n", std::get<1>(reference), std::get<1>(quantized), std::get<1>(quantized) - std::get<1>(reference));
+
+        return std::make_pair(reference, quantized);
+    }
+
+private:
+    template <size_t L, typename Input, cpp_enable_iff((L == layers))>
+    void calibrate_impl(const Input& input) {
+        cpp_unused(input);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers))>
+    void calibrate_impl(const Input& input) {
+        std::get<L>(quantized_layers).calibrate(input);
+        calibrate_impl<L + 1>(dbn.template layer_get<L>().test_forward_batch(input));
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L == layers))>
+    auto forward_batch_impl(Input&& output) const {
+        return std::forward<Input>(output);
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && !quantized_layer_t<L>::quantized))>
+    auto forward_batch_impl(Input&& input) const {
+        auto next = dbn.template layer_get<L>().test_forward_batch(input);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(input);
+
+        return forward_batch_impl<L + 1>(std::move(next));
+    }
+
+    template <size_t L, typename Input, cpp_enable_iff((L < layers && quantized_layer_t<L>::quantized))>
+    auto forward_batch_impl(Input&& input) const {
+        auto next = std::get<L>(quantized_layers).forward_batch(input);
+
+        // The input is dead once the next representation is computed
+        dbn_detail::release_intermediate<Input>(input);
+
+        return forward_batch_impl<L + 1>(std::move(next));
+    }
+};
+
+/*!
+ * \brief Quantize the given network to int8 for inference
+ * \param dbn The network to quantize
+ * \param generator The generator of calibration samples
+ * \return A quantized view of the network
+ */
+template <typename DBN, typename Generator>
+quantized_dbn<DBN> quantize(DBN& dbn, Generator& generator) {
+    return quantized_dbn<DBN>(dbn, generator);
+}
+
+} //end of dll namespace
@@ -75,15 +75,10 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h2_s; ///< Sampled values of reconstructed hidden units
 
     conv_rbm_impl() : base_type() {
-        if (is_relu(hidden_unit)) {
-            w = etl::normal_generator(0.0, 0.01);
-            b = 0.0;
-            c = 0.0;
-        } else {
-            w = 0.01 * etl::normal_generator();
-            b = -0.1;
-            c = 0.0;
-        }
+        fill_normal(w, 0.0, 0.01);
+
+        b = is_relu(hidden_unit) ? 0.0 : -0.1;
+        c = 0.0;
     }
 
     /*!
@@ -339,8 +334,10 @@ struct rbm_layer_base_traits<conv_rbm_impl<Desc>> {
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
+    static constexpr bool is_hogwild         = param::template contains<hogwild>();                       ///< Does the RBM use lock-free parallel training
+    static constexpr size_t ps_period        = get_value_l_v<parameter_server<0>, param>;                  ///< The period of the synchronizations with the parameter server
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
-    static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
+    static constexpr bool is_dbn_only        = param::template contains<dbn_only>() || param::template contains<inference_only>(); ///< Does the RBM is only used inside a DBN (or only for inference)
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
@@ -66,6 +66,11 @@ struct conv_rbm_mp_desc {
      */
     static constexpr bias_mode Bias           = detail::get_value_v<bias<bias_mode::SIMPLE>, Parameters...>;
 
+    /*!
+     * \brief The algorithm used to compute the convolutions
+     */
+    static constexpr conv_algorithm engine = detail::get_value_v<conv_engine<conv_algorithm::DIRECT>, Parameters...>;
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
@@ -80,6 +85,9 @@ struct conv_rbm_mp_desc {
     /*! The layer type */
     using layer_t = conv_rbm_mp_impl<conv_rbm_mp_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_T, Parameters...>>;
 
+    /*! The layer type, without the state only used by the training */
+    using inference_layer_t = conv_rbm_mp_impl<conv_rbm_mp_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, C_T, Parameters..., inference_only>>;
+
 private:
     template <typename... Args>
     struct dyn_layer_t_impl {
@@ -107,9 +115,9 @@ public:
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-                             momentum_id, batch_size_id, visible_id, hidden_id, pooling_id, dbn_only_id,
+                             momentum_id, batch_size_id, visible_id, hidden_id, pooling_id, dbn_only_id, inference_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, bias_id, clip_gradients_id,
-                             weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             weight_type_id, shuffle_id, verbose_id, hogwild_id, nop_id, conv_engine_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -88,7 +88,7 @@ struct conv_rbm_mp_impl final : public standard_crbm_mp<conv_rbm_mp_impl<Desc>,
 
     conv_rbm_mp_impl() : base_type() {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = 0.01 * etl::normal_generator();
+        fill_normal(w, 0.0, 0.01);
         b = -0.1;
         c = 0.0;
     }
@@ -297,8 +297,10 @@ struct rbm_layer_base_traits<conv_rbm_mp_impl<Desc>> {
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
+    static constexpr bool is_hogwild         = param::template contains<hogwild>();                       ///< Does the RBM use lock-free parallel training
+    static constexpr size_t ps_period        = get_value_l_v<parameter_server<0>, param>;                  ///< The period of the synchronizations with the parameter server
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
-    static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
+    static constexpr bool is_dbn_only        = param::template contains<dbn_only>() || param::template contains<inference_only>(); ///< Does the RBM is only used inside a DBN (or only for inference)
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
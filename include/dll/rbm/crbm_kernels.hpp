@@ -0,0 +1,292 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Activation kernels of the binary units of the convolutional RBM.
+ *
+ * The bias, the sigmoid and the sampling of the units are applied in a
+ * single pass over the output of the convolution (the epilogue), instead
+ * of one pass for each of them. The tiled kernels also compute the
+ * convolution itself, a block of rows of one output plane at a time, and
+ * the epilogue is applied while the block is still in cache.
+ *
+ * The samples are drawn from the same counter-based random numbers as
+ * sample_bernoulli, they do not depend on the tiles nor on the number of
+ * threads.
+ *
+ * The gradients of the weights of CD are computed in a single pass over
+ * the positive and the negative phases, the samples of the batch being
+ * split in parts reduced in order when there are few kernels.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "dll/util/counter_rng.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace crbm_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+constexpr size_t block_rows         = 4;         ///< The number of output rows of a tile
+
+/*!
+ * \brief Call the functor for each index in [0, n), in parallel if the
+ * batch is large enough
+ */
+template <typename Functor>
+void for_each_task(size_t n, size_t size, Functor&& functor) {
+    if (size >= parallel_threshold && n > 1) {
+        parallel_for_n(n, functor);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            functor(i);
+        }
+    }
+}
+
+/*!
+ * \brief Activate the n values of a batch starting at first: y = sigmoid(
+ * scale * (bias + x)), and sample them if s is not nullptr
+ *
+ * \param x The n pre-activations
+ * \param y The probabilities of the batch
+ * \param s The samples of the batch, or nullptr
+ */
+template <typename T>
+void epilogue(const counter_rng& rng, const T* x, T* y, T* s, size_t first, size_t n, T bias, T scale) {
+    for (size_t i = 0; i < n; ++i) {
+        y[first + i] = T(1) / (T(1) + std::exp(-scale * (bias + x[i])));
+    }
+
+    if (s) {
+        // Each block of the generator gives the numbers of four values
+        for (size_t i = first; i < first + n;) {
+            auto u = rng.block(i / 4);
+
+            for (size_t l = i % 4; l < 4 && i < first + n; ++l, ++i) {
+                s[i] = counter_rng::to_uniform<T>(u[l]) < y[i] ? T(1) : T(0);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Activate the output of a convolution, in place
+ *
+ * \param y The pre-activations and then the probabilities (B x K x N)
+ * \param s The samples (B x K x N), or nullptr
+ * \param bias The bias of each of the K planes
+ */
+template <typename T>
+void activate(size_t B, size_t K, size_t N, T* y, T* s, const T* bias, T scale) {
+    const auto rng = s ? next_rng() : counter_rng(0, 0);
+
+    // One task per output plane of each sample
+    for_each_task(B * K, B * K * N, [&](size_t t) {
+        epilogue(rng, y + t * N, y, s, t * N, N, bias[t % K], scale);
+    });
+}
+
+/*!
+ * \brief Compute the probabilities, and the samples, of the binary hidden
+ * units from the visible units, by tiles of the output planes
+ *
+ * \param x The visible units (B x C x V1 x V2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param b The hidden biases (K)
+ * \param h_a The hidden probabilities (B x K x H1 x H2)
+ * \param h_s The hidden samples (B x K x H1 x H2), or nullptr
+ */
+template <typename T>
+void hidden_forward(size_t B, size_t C, size_t V1, size_t V2, size_t K, size_t W1, size_t W2,
+                    const T* x, const T* w, const T* b, T scale, T* h_a, T* h_s) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    const auto rng = h_s ? next_rng() : counter_rng(0, 0);
+
+    for_each_task(B * K, B * K * H1 * H2 * C * W1 * W2, [&](size_t t) {
+        const size_t k = t % K;
+
+        const T* xb = x + (t / K) * C * V1 * V2;
+        const T* wk = w + k * C * W1 * W2;
+
+        std::vector<T> tile(block_rows * H2);
+
+        for (size_t i = 0; i < H1; i += block_rows) {
+            const size_t rows = std::min(block_rows, H1 - i);
+
+            std::fill(tile.begin(), tile.end(), T(0));
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t p = 0; p < W1; ++p) {
+                    for (size_t q = 0; q < W2; ++q) {
+                        const T wv = wk[(c * W1 + p) * W2 + q];
+
+                        for (size_t r = 0; r < rows; ++r) {
+                            const T* src = xb + (c * V1 + i + r + p) * V2 + q;
+                            T* dst       = tile.data() + r * H2;
+
+                            for (size_t j = 0; j < H2; ++j) {
+                                dst[j] += wv * src[j];
+                            }
+                        }
+                    }
+                }
+            }
+
+            epilogue(rng, tile.data(), h_a, h_s, (t * H1 + i) * H2, rows * H2, b[k], scale);
+        }
+    });
+}
+
+/*!
+ * \brief Compute the probabilities, and the samples, of the binary visible
+ * units from the hidden units, by tiles of the output planes
+ *
+ * \param h The hidden units (B x K x H1 x H2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param c The visible biases (C)
+ * \param v_a The visible probabilities (B x C x H1 + W1 - 1 x H2 + W2 - 1)
+ * \param v_s The visible samples (same size as v_a), or nullptr
+ */
+template <typename T>
+void visible_backward(size_t B, size_t C, size_t H1, size_t H2, size_t K, size_t W1, size_t W2,
+                      const T* h, const T* w, const T* c, T* v_a, T* v_s) {
+    const size_t V1 = H1 + W1 - 1;
+    const size_t V2 = H2 + W2 - 1;
+
+    const auto rng = v_s ? next_rng() : counter_rng(0, 0);
+
+    for_each_task(B * C, B * C * H1 * H2 * K * W1 * W2, [&](size_t t) {
+        const size_t ch = t % C;
+
+        const T* hb = h + (t / C) * K * H1 * H2;
+
+        std::vector<T> tile(block_rows * V2);
+
+        for (size_t i = 0; i < V1; i += block_rows) {
+            const size_t rows = std::min(block_rows, V1 - i);
+
+            std::fill(tile.begin(), tile.end(), T(0));
+
+            for (size_t k = 0; k < K; ++k) {
+                const T* wk = w + (k * C + ch) * W1 * W2;
+
+                for (size_t r = 0; r < rows; ++r) {
+                    T* dst = tile.data() + r * V2;
+
+                    // Only the rows of the kernel overlapping the hidden plane
+                    const size_t row = i + r;
+                    const size_t p0  = row >= H1 ? row - H1 + 1 : 0;
+                    const size_t p1  = std::min(W1, row + 1);
+
+                    for (size_t p = p0; p < p1; ++p) {
+                        const T* src = hb + (k * H1 + row - p) * H2;
+
+                        for (size_t q = 0; q < W2; ++q) {
+                            const T wv = wk[p * W2 + q];
+
+                            for (size_t j = 0; j < H2; ++j) {
+                                dst[j + q] += wv * src[j];
+                            }
+                        }
+                    }
+                }
+            }
+
+            epilogue(rng, tile.data(), v_a, v_s, (t * V1 + i) * V2, rows * V2, c[ch], T(1));
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the weights of CD for a batch:
+ * dw[k][c] = sum_b valid_correlation(v1[b][c], h1[b][k]) -
+ * valid_correlation(v2[b][c], h2[b][k])
+ *
+ * \param v1 The visible units of the positive phase (B x C x V1 x V2)
+ * \param h1 The hidden probabilities of the positive phase (B x K x H1 x H2)
+ * \param v2 The visible probabilities of the negative phase (B x C x V1 x V2)
+ * \param h2 The hidden probabilities of the negative phase (B x K x H1 x H2)
+ * \param dw The gradients of the weights (K x C x W1 x W2)
+ */
+template <typename T>
+void weight_gradients(size_t B, size_t C, size_t V1, size_t V2, size_t K, size_t H1, size_t H2,
+                      const T* v1, const T* h1, const T* v2, const T* h2, T* dw) {
+    const size_t W1 = V1 - H1 + 1;
+    const size_t W2 = V2 - H2 + 1;
+    const size_t W  = W1 * W2;
+
+    const size_t KC   = K * C;
+    const size_t size = B * KC * H1 * H2 * W;
+
+    // With few kernels, the samples are split in parts
+    const size_t P = size >= parallel_threshold && KC < concurrency() ? std::min(B, (concurrency() + KC - 1) / KC) : 1;
+
+    std::vector<T> parts(P > 1 ? P * KC * W : 0);
+
+    for_each_task(P * KC, size, [&](size_t t) {
+        const size_t part = t / KC;
+        const size_t k    = (t % KC) / C;
+        const size_t c    = t % C;
+
+        T* acc = P > 1 ? parts.data() + t * W : dw + (k * C + c) * W;
+
+        std::fill(acc, acc + W, T(0));
+
+        for (size_t b = (part * B) / P; b < ((part + 1) * B) / P; ++b) {
+            for (size_t i = 0; i < H1; ++i) {
+                const T* h1_row = h1 + ((b * K + k) * H1 + i) * H2;
+                const T* h2_row = h2 + ((b * K + k) * H1 + i) * H2;
+
+                for (size_t p = 0; p < W1; ++p) {
+                    const T* v1_row = v1 + ((b * C + c) * V1 + i + p) * V2;
+                    const T* v2_row = v2 + ((b * C + c) * V1 + i + p) * V2;
+
+                    for (size_t q = 0; q < W2; ++q) {
+                        T sum = 0;
+
+                        for (size_t j = 0; j < H2; ++j) {
+                            sum += v1_row[q + j] * h1_row[j] - v2_row[q + j] * h2_row[j];
+                        }
+
+                        acc[p * W2 + q] += sum;
+                    }
+                }
+            }
+        }
+    });
+
+    if (P > 1) {
+        // The parts are summed in order
+        for (size_t kc = 0; kc < KC; ++kc) {
+            T* out = dw + kc * W;
+
+            std::copy(parts.data() + kc * W, parts.data() + (kc + 1) * W, out);
+
+            for (size_t part = 1; part < P; ++part) {
+                const T* in = parts.data() + (part * KC + kc) * W;
+
+                for (size_t i = 0; i < W; ++i) {
+                    out[i] += in[i];
+                }
+            }
+        }
+    }
+}
+
+} //end of namespace crbm_detail
+
+} //end of dll namespace
@@ -56,6 +56,11 @@ struct dyn_conv_rbm_mp_desc {
      */
     static constexpr bias_mode Bias           = detail::get_value_v<bias<bias_mode::SIMPLE>, Parameters...>;
 
+    /*!
+     * \brief The algorithm used to compute the convolutions
+     */
+    static constexpr conv_algorithm engine = detail::get_value_v<conv_engine<conv_algorithm::DIRECT>, Parameters...>;
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
@@ -76,9 +81,9 @@ struct dyn_conv_rbm_mp_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-                             batch_size_id, momentum_id, visible_id, hidden_id, pooling_id, dbn_only_id,
+                             batch_size_id, momentum_id, visible_id, hidden_id, pooling_id, dbn_only_id, inference_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, clip_gradients_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, hogwild_id, nop_id, conv_engine_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -126,15 +126,10 @@ struct dyn_conv_rbm_mp_impl final : public standard_crbm_mp<dyn_conv_rbm_mp_impl
         p2_a = etl::dyn_matrix<weight, 3>(k, np1, np2);
         p2_s = etl::dyn_matrix<weight, 3>(k, np1, np2);
 
-        if (is_relu(hidden_unit)) {
-            w = etl::normal_generator(0.0, 0.01);
-            b = 0.0;
-            c = 0.0;
-        } else {
-            w = 0.01 * etl::normal_generator();
-            b = -0.1;
-            c = 0.0;
-        }
+        fill_normal(w, 0.0, 0.01);
+
+        b = is_relu(hidden_unit) ? 0.0 : -0.1;
+        c = 0.0;
     }
 
     /*!
@@ -312,8 +307,10 @@ struct rbm_layer_base_traits<dyn_conv_rbm_mp_impl<Desc>> {
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
+    static constexpr bool is_hogwild         = param::template contains<hogwild>();                       ///< Does the RBM use lock-free parallel training
+    static constexpr size_t ps_period        = get_value_l_v<parameter_server<0>, param>;                  ///< The period of the synchronizations with the parameter server
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
-    static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
+    static constexpr bool is_dbn_only        = param::template contains<dbn_only>() || param::template contains<inference_only>(); ///< Does the RBM is only used inside a DBN (or only for inference)
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
@@ -67,7 +67,7 @@ struct dyn_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<batch_size_id, momentum_id, visible_id, hidden_id, weight_decay_id, verbose_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id>,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, inference_only_id, free_energy_id, clip_gradients_id, hogwild_id, parameter_server_id, sparse_input_id, sparse_relu_id, fast_math_id>,
                          Parameters...>,
         "Invalid parameters type");
 
@@ -11,6 +11,8 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/rbm/standard_rbm.hpp"
+#include "dll/util/direct.hpp"
+#include "dll/util/shape_kernels.hpp"
 
 namespace dll {
 
@@ -64,6 +66,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
     size_t num_visible;
     size_t num_hidden;
 
+    dense_kernel<weight> kernel = nullptr; ///< The specialized kernel for the sizes of the RBM, if any
+
     dyn_rbm_impl() : base_type() {}
 
     /*!
@@ -85,9 +89,10 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
               h2_a(num_hidden),
               h2_s(num_hidden),
               num_visible(num_visible),
-              num_hidden(num_hidden) {
+              num_hidden(num_hidden),
+              kernel(select_dense_kernel<weight>(num_visible, num_hidden)) {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = etl::normal_generator<weight>() * 0.1;
+        fill_normal(w, 0.0, 0.1);
     }
 
     /*!
@@ -109,7 +114,9 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
         h2_s = etl::dyn_vector<weight>(num_hidden);
 
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
-        w = etl::normal_generator<weight>() * 0.1;
+        fill_normal(w, 0.0, 0.1);
+
+        kernel = select_dense_kernel<weight>(num_visible, num_hidden);
     }
 
     /*!
@@ -155,7 +162,16 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        this->batch_activate_hidden(output, input);
+        if (hidden_unit == unit_type::BINARY && kernel) {
+            decltype(auto) x = direct_memory(input);
+            kernel(output.memory_start(), x.memory_start(), w.memory_start(), etl::dim<0>(output));
+
+            output = bias_add_2d(output, b);
+
+            activate_inplace<function::SIGMOID, base_type::fast_math>(output);
+        } else {
+            this->batch_activate_hidden(output, input);
+        }
     }
 
     // This is specific to dyn because of the nv/nh
@@ -264,8 +280,10 @@ struct rbm_layer_base_traits<dyn_rbm_impl<Desc>> {
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
+    static constexpr bool is_hogwild         = param::template contains<hogwild>();                       ///< Does the RBM use lock-free parallel training
+    static constexpr size_t ps_period        = get_value_l_v<parameter_server<0>, param>;                  ///< The period of the synchronizations with the parameter server
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
-    static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
+    static constexpr bool is_dbn_only        = param::template contains<dbn_only>() || param::template contains<inference_only>(); ///< Does the RBM is only used inside a DBN (or only for inference)
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
@@ -323,8 +341,10 @@ struct cg_context<dyn_rbm_impl<Desc>> {
     etl::dyn_matrix<weight, 2> gr_w_tmp;
     etl::dyn_matrix<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    // The batch buffers (one sample per row), allocated by the trainer
+    etl::dyn_matrix<weight, 2> gr_probs_a;
+    etl::dyn_matrix<weight, 2> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_diffs;
 
     cg_context(size_t num_visible, size_t num_hidden) :
         gr_w_incs(num_visible, num_hidden), gr_b_incs(num_hidden),
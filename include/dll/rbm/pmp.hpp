@@ -0,0 +1,153 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for Probabilistic Max Pooling
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace pmp_detail {
+
+/*!
+ * \brief Compute the maximum of s * (h + bias) over one block, including
+ * the "off" state (zero).
+ *
+ * This is used to shift the exponentials of the block for numerical
+ * stability.
+ */
+template <typename H, typename T>
+T block_max(const H& h, T bias, T s, size_t ii, size_t jj, size_t C) {
+    T m(0);
+
+    for (size_t p = 0; p < C; ++p) {
+        for (size_t q = 0; q < C; ++q) {
+            m = std::max(m, s * (h(ii + p, jj + q) + bias));
+        }
+    }
+
+    return m;
+}
+
+} //end of namespace pmp_detail
+
+/*!
+ * \brief Compute the hidden probabilities of Probabilistic Max Pooling,
+ * in place.
+ *
+ * For each block of C x C units of a channel, with x = s * (h + b):
+ * h = exp(x) / (1 + sum(exp(x))).
+ *
+ * The computation is done in parallel over batch x channel and in a
+ * without any temporary.
+ *
+ * \param h The batch of convolution outputs (B x K x NH1 x NH2), replaced by the probabilities
+ * \param b The hidden biases (K)
+ * \param C The pooling factor
+ * \param s The scale of the activations
+ */
+template <typename H, typename B>
+void pmp_batch_hidden(H&& h, const B& b, size_t C, double s) {
+    using T = etl::value_t<H>;
+
+    const size_t K   = etl::dim<1>(h);
+    const size_t NH1 = etl::dim<2>(h);
+    const size_t NH2 = etl::dim<3>(h);
+
+    parallel_for_n(etl::dim<0>(h) * K, [&](size_t bk) {
+        const size_t k = bk % K;
+
+        auto h_k = h(bk / K)(k);
+
+        for (size_t ii = 0; ii < NH1; ii += C) {
+            for (size_t jj = 0; jj < NH2; jj += C) {
+                const T bias = b(k);
+                const T m    = pmp_detail::block_max(h_k, bias, T(s), ii, jj, C);
+
+                T sum = std::exp(-m);
+
+                for (size_t p = 0; p < C; ++p) {
+                    for (size_t q = 0; q < C; ++q) {
+                        const T e = std::exp(T(s) * (h_k(ii + p, jj + q) + bias) - m);
+
+                        h_k(ii + p, jj + q) = e;
+                        sum += e;
+                    }
+                }
+
+                const T inv = T(1) / sum;
+
+                for (size_t p = 0; p < C; ++p) {
+                    for (size_t q = 0; q < C; ++q) {
+                        h_k(ii + p, jj + q) *= inv;
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the pooling probabilities of Probabilistic Max Pooling.
+ *
+ * For each block of C x C units of a channel, with x = s * (h + b):
+ * p = sum(exp(x)) / (1 + sum(exp(x))).
+ *
+ * The computation is done in parallel over batch x channel and without
+ * any temporary.
+ *
+ * \param p The batch of pooling probabilities (B x K x NH1 / C x NH2 / C)
+ * \param h The batch of convolution outputs (B x K x NH1 x NH2)
+ * \param b The hidden biases (K)
+ * \param C The pooling factor
+ * \param s The scale of the activations
+ */
+template <typename P, typename H, typename B>
+void pmp_batch_pooling(P&& p, const H& h, const B& b, size_t C, double s) {
+    using T = etl::value_t<H>;
+
+    const size_t K   = etl::dim<1>(h);
+    const size_t NH1 = etl::dim<2>(h);
+    const size_t NH2 = etl::dim<3>(h);
+
+    parallel_for_n(etl::dim<0>(h) * K, [&](size_t bk) {
+        const size_t k = bk % K;
+
+        auto h_k = h(bk / K)(k);
+        auto p_k = p(bk / K)(k);
+
+        for (size_t ii = 0; ii < NH1; ii += C) {
+            for (size_t jj = 0; jj < NH2; jj += C) {
+                const T bias = b(k);
+                const T m    = pmp_detail::block_max(h_k, bias, T(s), ii, jj, C);
+                const T off  = std::exp(-m);
+
+                T sum = off;
+
+                for (size_t p = 0; p < C; ++p) {
+                    for (size_t q = 0; q < C; ++q) {
+                        sum += std::exp(T(s) * (h_k(ii + p, jj + q) + bias) - m);
+                    }
+                }
+
+                p_k(ii / C, jj / C) = T(1) - off / sum;
+            }
+        }
+    });
+}
+
+} //end of dll namespace
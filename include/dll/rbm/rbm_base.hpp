@@ -66,6 +66,9 @@ struct rbm_base : layer<Parent> {
 
     weight gradient_clip = 5.0; ///< The default gradient clipping value
 
+    size_t free_energy_period = 1; ///< The period, in batches, of the computation of the free energy (with dll::free_energy)
+    size_t statistics_period  = 1; ///< The period, in batches, of the computation of the reconstruction error and the sparsity
+
     /*!
      * \brief Construct an empty rbm_base
      */
@@ -91,11 +94,25 @@ struct rbm_base : layer<Parent> {
         as_derived().c = *as_derived().bak_c;
     }
 
+    /*!
+     * \brief Backup the weights in the secondary weights matrix, swapping
+     * the storages when they are dynamic. The weights are left with the
+     * previous backup and must be overwritten before being used.
+     */
+    void swap_backup_weights() {
+        swap_backup(as_derived().w, as_derived().bak_w);
+        swap_backup(as_derived().b, as_derived().bak_b);
+        swap_backup(as_derived().c, as_derived().bak_c);
+    }
+
     /*!
      * \brief Compute the reconstruction error for the given input
+     *
+     * The state of the units of the RBM is not used, this can be called
+     * concurrently on a shared RBM.
      */
     template<typename Input>
-    double reconstruction_error(const Input& item) {
+    double reconstruction_error(const Input& item) const {
         return parent_t::reconstruction_error_impl(item, as_derived());
     }
 
@@ -107,6 +124,22 @@ struct rbm_base : layer<Parent> {
         return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b));
     }
 
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters(){
+        return std::make_tuple(std::ref(as_derived().w), std::ref(as_derived().b), std::ref(as_derived().c));
+    }
+
+    /*!
+     * \brief Returns the stored variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) stored_parameters() const {
+        return std::make_tuple(std::cref(as_derived().w), std::cref(as_derived().b), std::cref(as_derived().c));
+    }
+
     //Normal Train functions
 
     /*!
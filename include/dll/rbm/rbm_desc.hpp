@@ -74,7 +74,7 @@ struct rbm_desc {
     static_assert(
         detail::is_valid_v<cpp::type_list<momentum_id, verbose_id, batch_size_id, visible_id,
                                         hidden_id, weight_decay_id, init_weights_id, sparsity_id, trainer_rbm_id, watcher_id,
-                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id>,
+                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, inference_only_id, nop_id, clip_gradients_id, hogwild_id, parameter_server_id, sparse_input_id, sparse_relu_id, fast_math_id>,
                          Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -88,6 +88,11 @@ struct rbm_desc {
      */
     using layer_t = rbm_impl<rbm_desc<visibles, hiddens, Parameters...>>;
 
+    /*!
+     * The layer type, without the state only used by the training
+     */
+    using inference_layer_t = rbm_impl<rbm_desc<visibles, hiddens, Parameters..., inference_only>>;
+
 private:
     template <typename... Args>
     struct dyn_layer_t_impl {
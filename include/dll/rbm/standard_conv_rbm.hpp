@@ -147,6 +147,19 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
         return free_energy(as_derived().v1);
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the n first samples of
+     * the given batch
+     *
+     * \param v The batch of inputs
+     * \param h_a The hidden activation probabilities of the batch
+     * \param n The number of samples of the batch
+     */
+    template <typename V, typename H>
+    weight batch_free_energy(const V& v, const H& h_a, size_t n) const {
+        return as_derived().batch_free_energy_impl(v, h_a, n);
+    }
+
     friend base_type;
 
 private:
@@ -158,16 +171,22 @@ private:
      * \brief Compute the reconstruction for the given input and RBM
      */
     template<typename Input>
-    static double reconstruction_error_impl(const Input& items, parent_t& rbm) {
+    static double reconstruction_error_impl(const Input& items, const parent_t& rbm) {
         cpp_assert(items.size() == input_size(rbm), "The size of the training sample must match visible units");
 
-        //Set the state of the visible units
-        rbm.v1 = items;
+        // The units are local copies, the RBM can be shared between threads
+        auto v1   = rbm.v1;
+        auto h1_a = rbm.h1_a;
+        auto h1_s = rbm.h1_s;
+        auto v2_a = rbm.v2_a;
+        auto v2_s = rbm.v2_s;
 
-        rbm.activate_hidden(rbm.h1_a, rbm.h1_s, rbm.v1, rbm.v1);
-        rbm.activate_visible(rbm.h1_a, rbm.h1_s, rbm.v2_a, rbm.v2_s);
+        v1 = items;
+
+        rbm.activate_hidden(h1_a, h1_s, v1, v1);
+        rbm.activate_visible(h1_a, h1_s, v2_a, v2_s);
 
-        return etl::mean((rbm.v1 - rbm.v2_a) >> (rbm.v1 - rbm.v2_a));
+        return etl::mean((v1 - v2_a) >> (v1 - v2_a));
     }
 
     /*!
@@ -15,6 +15,7 @@
 #include <cstddef>
 #include <ctime>
 #include <random>
+#include <limits>
 
 #include "cpp_utils/assert.hpp"     //Assertions
 #include "cpp_utils/stop_watch.hpp" //Performance counter
@@ -26,6 +27,10 @@
 #include "standard_conv_rbm.hpp" //The base class
 #include "rbm_tmp.hpp"           // static_if macros
 
+#include "dll/util/conv_engine.hpp"
+#include "dll/util/counter_rng.hpp"
+#include "dll/rbm/crbm_kernels.hpp"
+
 namespace dll {
 
 /*!
@@ -68,12 +73,12 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         auto b_rep = as_derived().get_b_rep();
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        conv_engine_forward(desc::engine, as_derived().reshape_h_a(h_a), as_derived().reshape_v_a(v_a), as_derived().w);
 
         // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), b_rep + h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), b_rep + h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), b_rep + h_a, 1.0));
 
         H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = etl::sigmoid(b_rep + h_a));
         H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = etl::sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + h_a)));
@@ -81,7 +86,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
 
         nan_check_deep(h_a);
 
@@ -106,7 +111,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        as_derived().reshape_v_a(v_a) = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
+        conv_engine_backward(desc::engine, as_derived().reshape_v_a(v_a), as_derived().reshape_h_a(h_s), as_derived().w);
 
         auto c_rep = as_derived().get_c_rep();
 
@@ -115,8 +120,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(v_s), v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(f(v_s), v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -132,16 +137,102 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         as_derived().template validate_outputs<H1, H2, 1>();
 
+        // The binary units are activated and sampled by the CRBM kernels
+        constexpr bool fused = hidden_unit == unit_type::BINARY && etl::decay_traits<H1>::is_direct && etl::decay_traits<H2>::is_direct;
+
+        cpp::static_if<fused>([&](auto f) {
+            f(this)->template batch_activate_hidden_binary<S>(h_a, h_s, v_a);
+        }).else_([&](auto f) {
+            f(this)->template batch_activate_hidden_etl<S>(h_a, h_s, v_a);
+        });
+    }
+
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
+    void batch_activate_visible(const H1& /*h_a*/, const H2& h_s, V1&& v_a, V2&& v_s) const {
+        dll::auto_timer timer("crbm:batch_activate_visible");
+
+        static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
+        static_assert(P, "Computing S without P is not implemented");
+
+        as_derived().template validate_outputs<H1, H2, 1>();
+
+        // The binary units are activated and sampled by the CRBM kernels
+        constexpr bool fused = visible_unit == unit_type::BINARY && etl::decay_traits<V1>::is_direct && etl::decay_traits<V2>::is_direct;
+
+        cpp::static_if<fused>([&](auto f) {
+            f(this)->template batch_activate_visible_binary<S>(h_s, v_a, v_s);
+        }).else_([&](auto f) {
+            f(this)->template batch_activate_visible_etl<S>(h_s, v_a, v_s);
+        });
+    }
+
+    friend base_type;
+
+private:
+    /*!
+     * \brief Indicates if the tiled kernels compute the convolutions, for
+     * the kernels \p W1 x \p W2. They replace the ETL convolutions selected
+     * by conv_algorithm::AUTO, except for the single-channel kernels of
+     * type W, computed by the convolution engine.
+     */
+    template <typename W>
+    static constexpr bool tiled_kernels(size_t W1, size_t W2) {
+        return desc::engine == conv_algorithm::AUTO && resolve_conv_algorithm(desc::engine, W1, W2) == conv_algorithm::DIRECT
+            && !single_channel_kernels<W>::value;
+    }
+
+    /*!
+     * \brief Compute the probabilities, and the samples, of binary hidden
+     * units, with the bias, the sigmoid and the sampling in the epilogue
+     * of the convolution.
+     */
+    template <bool S, typename H1, typename H2, typename V1>
+    void batch_activate_hidden_binary(H1&& h_a, H2&& h_s, const V1& v_a) const {
+        const auto& w = as_derived().w;
+        const auto& b = as_derived().b;
+
+        const size_t B  = etl::dim<0>(v_a);
+        const size_t K  = etl::dim<0>(w);
+        const size_t W1 = etl::dim<2>(w);
+        const size_t W2 = etl::dim<3>(w);
+
+        // The hidden units of gaussian visible units see (b + W * v) / sigma^2
+        const weight scale = visible_unit == unit_type::GAUSSIAN ? weight(1.0 / (0.1 * 0.1)) : weight(1.0);
+
+        weight* samples = S ? h_s.memory_start() : nullptr;
+
+        if (tiled_kernels<std::decay_t<decltype(w)>>(W1, W2)) {
+            decltype(auto) x = direct_memory(v_a);
+
+            crbm_detail::hidden_forward(B, etl::dim<1>(v_a), etl::dim<2>(v_a), etl::dim<3>(v_a), K, W1, W2,
+                                        x.memory_start(), w.memory_start(), b.memory_start(), scale, h_a.memory_start(), samples);
+        } else {
+            conv_engine_forward(desc::engine, h_a, v_a, w);
+
+            crbm_detail::activate(B, K, etl::dim<2>(h_a) * etl::dim<3>(h_a), h_a.memory_start(), samples, b.memory_start(), scale);
+        }
+
+        nan_check_deep(h_a);
+
+        if (S) {
+            nan_check_deep(h_s);
+        }
+    }
+
+    template <bool S, typename H1, typename H2, typename V1>
+    void batch_activate_hidden_etl(H1&& h_a, H2&& h_s, const V1& v_a) const {
+        constexpr bool P = true;
+
         using namespace etl;
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        conv_engine_forward(desc::engine, h_a, v_a, as_derived().w);
 
         auto b_rep = as_derived().get_batch_b_rep(v_a);
 
         // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), b_rep + h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), b_rep + h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), b_rep + h_a, 1.0));
 
         H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = etl::sigmoid(b_rep + h_a));
         H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = etl::sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + h_a)));
@@ -151,23 +242,53 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(h_a);
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
 
         if (S) {
             nan_check_deep(h_s);
         }
     }
 
-    template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
-    void batch_activate_visible(const H1& /*h_a*/, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        dll::auto_timer timer("crbm:batch_activate_visible");
+    /*!
+     * \brief Compute the probabilities, and the samples, of binary visible
+     * units, with the bias, the sigmoid and the sampling in the epilogue
+     * of the convolution.
+     */
+    template <bool S, typename H2, typename V1, typename V2>
+    void batch_activate_visible_binary(const H2& h_s, V1&& v_a, V2&& v_s) const {
+        const auto& w = as_derived().w;
+        const auto& c = as_derived().c;
 
-        static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
-        static_assert(P, "Computing S without P is not implemented");
+        const size_t B  = etl::dim<0>(h_s);
+        const size_t C  = etl::dim<1>(w);
+        const size_t W1 = etl::dim<2>(w);
+        const size_t W2 = etl::dim<3>(w);
 
-        as_derived().template validate_outputs<H1, H2, 1>();
+        weight* samples = S ? v_s.memory_start() : nullptr;
+
+        if (tiled_kernels<std::decay_t<decltype(w)>>(W1, W2)) {
+            decltype(auto) h = direct_memory(h_s);
+
+            crbm_detail::visible_backward(B, C, etl::dim<2>(h_s), etl::dim<3>(h_s), etl::dim<1>(h_s), W1, W2,
+                                          h.memory_start(), w.memory_start(), c.memory_start(), v_a.memory_start(), samples);
+        } else {
+            conv_engine_backward(desc::engine, v_a, h_s, w);
+
+            crbm_detail::activate(B, C, etl::dim<2>(v_a) * etl::dim<3>(v_a), v_a.memory_start(), samples, c.memory_start(), weight(1.0));
+        }
+
+        nan_check_deep(v_a);
+
+        if (S) {
+            nan_check_deep(v_s);
+        }
+    }
+
+    template <bool S, typename H2, typename V1, typename V2>
+    void batch_activate_visible_etl(const H2& h_s, V1&& v_a, V2&& v_s) const {
+        constexpr bool P = true;
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
+        conv_engine_backward(desc::engine, v_a, h_s, as_derived().w);
 
         auto c_rep = as_derived().get_batch_c_rep(h_s);
 
@@ -176,24 +297,21 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(v_s), v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(f(v_s), v_a));
 
         if (S) {
             nan_check_deep(v_s);
         }
     }
 
-    friend base_type;
-
-private:
     template<typename Input, typename Out>
     weight energy_impl(const Input& v, const Out& h) const {
         static_assert(etl::is_etl_expr<Out>, "energy_impl works with ETL expressions only");
 
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        conv_engine_forward(desc::engine, tmp, rv, as_derived().w);
 
         if /*constexpr*/ (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee
@@ -215,7 +333,7 @@ private:
     weight free_energy_impl(const Input& v) const {
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        conv_engine_forward(desc::engine, tmp, rv, as_derived().w);
 
         if /*constexpr*/ (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
@@ -235,6 +353,33 @@ private:
         }
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the n first samples of
+     * the given batch.
+     *
+     * The hidden pre-activations are not computed again, they are recovered
+     * from the activation probabilities of the positive phase:
+     * log(1 + e^x) = -log(1 - sigmoid(x)).
+     */
+    template <typename V, typename H>
+    weight batch_free_energy_impl(const V& v, const H& h_a, size_t n) const {
+        // The saturated units are clamped, their contribution is underestimated
+        const weight e = std::numeric_limits<weight>::epsilon();
+
+        weight energy = 0.0;
+
+        for (size_t b = 0; b < n; ++b) {
+            if /*constexpr*/ (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
+                energy += -etl::sum(as_derived().c >> etl::sum_r(v(b))) + etl::sum(etl::log(etl::max(1.0 - h_a(b), e)));
+            } else if /*constexpr*/ (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
+                auto c_rep = as_derived().get_c_rep();
+                energy += -sum(etl::pow(v(b) - c_rep, 2) / 2.0) + etl::sum(etl::log(etl::max(1.0 - h_a(b), e)));
+            }
+        }
+
+        return energy;
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
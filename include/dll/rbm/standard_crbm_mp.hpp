@@ -25,6 +25,9 @@
 #include "dll/rbm/standard_conv_rbm.hpp" //The base class
 #include "dll/base_conf.hpp"             //The configuration helpers
 #include "dll/rbm/rbm_tmp.hpp"           // static_if macros
+#include "dll/rbm/pmp.hpp"               // Fused probabilistic max pooling
+#include "dll/util/conv_engine.hpp"      // Selectable convolution algorithms
+#include "dll/util/counter_rng.hpp"      // Counter-based sampling
 
 namespace dll {
 
@@ -67,14 +70,14 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         auto b_rep = as_derived().get_b_rep();
 
-        as_derived().reshape_h_a(h_a) = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        conv_engine_forward(desc::engine, as_derived().reshape_h_a(h_a), as_derived().reshape_v_a(v_a), as_derived().w);
 
         // Note: this is wrong because of PMP
 
         // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), b_rep + h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), b_rep + h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), b_rep + h_a, 1.0));
 
         H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
         H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
@@ -82,7 +85,7 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
 
         nan_check_etl(h_a);
 
@@ -100,7 +103,7 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        as_derived().reshape_v_a(v_a) = etl::conv_4d_full(as_derived().reshape_h_a(h_s), as_derived().w);
+        conv_engine_backward(desc::engine, as_derived().reshape_v_a(v_a), as_derived().reshape_h_a(h_s), as_derived().w);
 
         auto c_rep = as_derived().get_c_rep();
 
@@ -109,8 +112,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(v_s), v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(f(v_s), v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -127,7 +130,7 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         auto b_rep = as_derived().get_b_rep();
 
         auto v_cv = as_derived().energy_tmp();
-        v_cv = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
+        conv_engine_forward(desc::engine, v_cv, as_derived().reshape_v_a(v_a), as_derived().w);
 
         if (pooling_unit == unit_type::BINARY) {
             p_a = etl::p_max_pool_p(b_rep + v_cv(0), C(), C());
@@ -157,24 +160,28 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        conv_engine_forward(desc::engine, h_a, v_a, as_derived().w);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
+        // The biases are added directly by the fused PMP kernel
+        H_PROBS2(unit_type::BINARY, unit_type::BINARY, pmp_batch_hidden(f(h_a), as_derived().b, this->C(), 1.0));
+        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, pmp_batch_hidden(f(h_a), as_derived().b, this->C(), 1.0 / (0.1 * 0.1)));
 
-        // Note: this is wrong because of PMP
+        if /*constexpr*/ (is_relu(hidden_unit)) {
+            auto b_rep = as_derived().get_batch_b_rep(v_a);
 
-        // Need to be done before h_a is computed!
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + h_a), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
+            // Note: this is wrong because of PMP
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
-        H_PROBS(unit_type::RELU, f(h_a) = max(b_rep + h_a, 0.0));
-        H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + h_a, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
+            // Need to be done before h_a is computed!
+            H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), b_rep + h_a));
+            H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), b_rep + h_a, 6.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), b_rep + h_a, 1.0));
+
+            H_PROBS(unit_type::RELU, f(h_a) = max(b_rep + h_a, 0.0));
+            H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + h_a, 0.0), 6.0));
+            H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
+        }
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
 
         nan_check_deep(h_a);
 
@@ -196,12 +203,10 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
-
         auto h_a = etl::force_temporary(etl::conv_4d_valid_flipped(v_a, as_derived().w));
 
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + h_a, C(), C());
+            pmp_batch_pooling(p_a, h_a, as_derived().b, C(), 1.0);
         }
 
         nan_check_etl(p_a);
@@ -222,7 +227,7 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
+        conv_engine_backward(desc::engine, v_a, h_s, as_derived().w);
 
         auto c_rep = as_derived().get_batch_c_rep(h_s);
 
@@ -235,8 +240,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         V_PROBS(unit_type::BINARY, f(v_a) = etl::sigmoid(c_rep + v_a));
         V_PROBS(unit_type::GAUSSIAN, f(v_a) = c_rep + v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(v_s), v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(f(v_s), v_a));
 
         nan_check_deep(v_a);
 
@@ -307,7 +312,7 @@ private:
 
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(rv), as_derived().w);
+        conv_engine_forward(desc::engine, tmp, as_derived().reshape_v_a(rv), as_derived().w);
 
         if  /*constexpr*/ (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee
@@ -329,7 +334,7 @@ private:
     weight free_energy_impl(const Input& v) const {
         auto rv = as_derived().reshape_v_a(v);
         auto tmp = as_derived().energy_tmp();
-        tmp = etl::conv_4d_valid_flipped(rv, as_derived().w);
+        conv_engine_forward(desc::engine, tmp, rv, as_derived().w);
 
         if  /*constexpr*/ (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
@@ -351,6 +356,26 @@ private:
         }
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the n first samples of
+     * the given batch.
+     *
+     * The probabilistic max pooling does not give the pre-activations from
+     * the activation probabilities, the free energies are computed again.
+     */
+    template <typename V, typename H>
+    weight batch_free_energy_impl(const V& v, const H& h_a, size_t n) const {
+        cpp_unused(h_a);
+
+        weight energy = 0.0;
+
+        for (size_t b = 0; b < n; ++b) {
+            energy += free_energy_impl(v(b));
+        }
+
+        return energy;
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
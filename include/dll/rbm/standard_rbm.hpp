@@ -12,6 +12,7 @@
 #include <random>
 #include <functional>
 #include <ctime>
+#include <limits>
 
 #include "cpp_utils/stop_watch.hpp" //Performance counter
 #include "cpp_utils/assert.hpp"
@@ -24,6 +25,9 @@
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
 #include "dll/rbm/rbm_tmp.hpp"        // static_if macros
+#include "dll/util/fast_math.hpp"     // fast_activate
+#include "dll/util/counter_rng.hpp"   // sample_bernoulli, sample_normal
+#include "dll/util/block_sparse.hpp"  // block_sparse_mul
 
 namespace dll {
 
@@ -49,9 +53,13 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
     static constexpr unit_type visible_unit = desc::visible_unit; ///< The type of visible unit
     static constexpr unit_type hidden_unit  = desc::hidden_unit;  ///< The type of hidden unit
 
+    static constexpr bool fast_math = desc::parameters::template contains<dll::fast_math>(); ///< Use the fast approximation of the sigmoid
+
     static_assert(visible_unit != unit_type::SOFTMAX, "Softmax Visible units are not support");
     static_assert(hidden_unit != unit_type::GAUSSIAN, "Gaussian hidden units are not supported");
 
+    block_sparsity w_blocks; ///< The kept blocks of the weights, if they are block-sparse
+
     /*!
      * \brief Construct empty standard_rbm
      */
@@ -92,6 +100,52 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         return free_energy(rbm, rbm.v1);
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the n first samples of
+     * the given batch.
+     *
+     * The hidden pre-activations are not computed again, they are recovered
+     * from the activation probabilities of the positive phase:
+     * log(1 + e^x) = -log(1 - sigmoid(x)).
+     *
+     * \param v The batch of inputs
+     * \param h_a The hidden activation probabilities of the batch
+     * \param n The number of samples of the batch
+     */
+    template <typename V, typename H>
+    weight batch_free_energy(const V& v, const H& h_a, size_t n) const {
+        weight energy = 0.0;
+
+        for (size_t b = 0; b < n; ++b) {
+            energy += free_energy_hidden(v(b), h_a(b));
+        }
+
+        return energy;
+    }
+
+    /*!
+     * \brief Return the free energy of one sample from its hidden activation
+     * probabilities (see batch_free_energy)
+     *
+     * \param v The input
+     * \param h_a The hidden activation probabilities of the input
+     */
+    template <typename V, typename H>
+    weight free_energy_hidden(const V& v, const H& h_a) const {
+        auto& rbm = as_derived();
+
+        // The saturated units are clamped, their contribution is underestimated
+        const weight e = std::numeric_limits<weight>::epsilon();
+
+        if /*constexpr*/ (visible_unit == unit_type::BINARY && hidden_unit == unit_type::BINARY) {
+            return -etl::dot(rbm.c, v) + etl::sum(etl::log(etl::max(1.0 - h_a, e)));
+        } else if /*constexpr*/ (visible_unit == unit_type::GAUSSIAN && hidden_unit == unit_type::BINARY) {
+            return etl::sum(etl::pow(v - rbm.c, 2) / 2.0) + etl::sum(etl::log(etl::max(1.0 - h_a, e)));
+        } else {
+            return 0.0;
+        }
+    }
+
     //Various functions
 
     /*!
@@ -176,6 +230,24 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
 
     // batch_activate_hidden
 
+    /*!
+     * \brief Compute the hidden representation from the given batch of
+     * input.
+     *
+     * Special functions to be used by optimizer.
+     *
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v_a The batch input activation probabilities of the visible representation
+     * \param v_s The batch input the activation samples of the visible representation
+     * \param b The biases
+     * \param w The weights
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w) const {
+        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w);
+    }
+
     /*!
      * \brief Compute the hidden representation from the given input
      * \param h_a The batch output to set the activation probabilities of the hidden representation
@@ -185,7 +257,11 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
      */
     template <bool P = true, bool S = true, typename H1, typename H2, typename V>
     void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) const {
-        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
+        if (P && hidden_unit == unit_type::BINARY && w_blocks.enabled()) {
+            batch_block_activate_hidden<S>(h_a, h_s, v_a);
+        } else {
+            batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
+        }
     }
 
     /*!
@@ -196,7 +272,11 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
      */
     template <typename H, typename V, cpp_enable_iff(etl::decay_traits<V>::dimensions() == 2)>
     void batch_activate_hidden(H&& h_a, const V& v_a) const {
-        batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, as_derived().b, as_derived().w);
+        if (hidden_unit == unit_type::BINARY && w_blocks.enabled()) {
+            batch_block_activate_hidden<false>(h_a, h_a, v_a);
+        } else {
+            batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, as_derived().b, as_derived().w);
+        }
     }
 
     /*!
@@ -291,17 +371,28 @@ private:
     //to put the fields in standard_rbm, therefore, it is necessary to use template
     //functions to implement the details
 
+    /*!
+     * \brief Compute the reconstruction error of the given input.
+     *
+     * The units are local to the call and not the state of the RBM, the
+     * RBM can be shared between threads.
+     */
     template<typename V>
-    static double reconstruction_error_impl(const V& items, parent_t& rbm) {
+    static double reconstruction_error_impl(const V& items, const parent_t& rbm) {
         cpp_assert(items.size() == num_visible(rbm), "The size of the training sample must match visible units");
 
-        //Set the state of the visible units
-        rbm.v1 = items;
+        auto v1   = rbm.prepare_one_input();
+        auto v2_a = rbm.prepare_one_input();
+        auto v2_s = rbm.prepare_one_input();
+        auto h1_a = rbm.template prepare_one_output<V>();
+        auto h1_s = rbm.template prepare_one_output<V>();
 
-        rbm.activate_hidden(rbm.h1_a, rbm.h1_s, rbm.v1, rbm.v1);
-        rbm.activate_visible(rbm.h1_a, rbm.h1_s, rbm.v2_a, rbm.v2_s);
+        v1 = items;
 
-        return etl::mean((rbm.v1 - rbm.v2_a) >> (rbm.v1 - rbm.v2_a));
+        rbm.activate_hidden(h1_a, h1_s, v1, v1);
+        rbm.activate_visible(h1_a, h1_s, v2_a, v2_s);
+
+        return etl::mean((v1 - v2_a) >> (v1 - v2_a));
     }
 
     /*!
@@ -507,21 +598,31 @@ private:
         H_PROBS(unit_type::RELU, f(h_a) = max(b + (v_a * w), 0.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b + (v_a * w), 0.0), 1.0));
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(b + (v_a * w), 0.0), 6.0));
-        H_PROBS(unit_type::SOFTMAX, f(h_a) = stable_softmax(b + (v_a * w)));
+        H_PROBS_MULTI(unit_type::SOFTMAX)
+        ([&](auto f) {
+            f(h_a) = b + (v_a * w);
+            softmax_sample_rows<true, S>(f(h_a).memory_start(), f(h_s).memory_start(), 1, etl::size(h_a));
+            dll::host_written(f(h_a));
+            dll::host_written(f(h_s));
+        });
 
         //Sample values from input
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b + (v_a * w)), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS(unit_type::SOFTMAX, f(h_s) = one_if_max(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
+        H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), b + (v_a * w)));
+        H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), b + (v_a * w), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), b + (v_a * w), 6.0));
 
         //Sample values from probs
         H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = bernoulli(etl::sigmoid(b + (v_a * w))));
-        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(logistic_noise(b + (v_a * w)), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
-        H_SAMPLE_INPUT(unit_type::SOFTMAX, f(h_s) = one_if_max(stable_softmax(b + (v_a * w))));
+        H_SAMPLE_INPUT(unit_type::RELU, sample_noisy_relu(f(h_s), b + (v_a * w)));
+        H_SAMPLE_INPUT(unit_type::RELU1, sample_capped_relu(f(h_s), b + (v_a * w), 1.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, sample_capped_relu(f(h_s), b + (v_a * w), 6.0));
+        H_SAMPLE_INPUT_MULTI(unit_type::SOFTMAX)
+        ([&](auto f) {
+            f(h_s) = b + (v_a * w);
+            softmax_sample_rows<false, true>(f(h_s).memory_start(), f(h_s).memory_start(), 1, etl::size(h_s));
+            dll::host_written(f(h_s));
+        });
 
         if (P) {
             nan_check_deep(h_a);
@@ -543,8 +644,8 @@ private:
         V_PROBS(unit_type::RELU, f(v_a) = max(c + (w * h_s), 0.0));
 
         V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = bernoulli(etl::sigmoid(c + (w * h_s))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = normal_noise(c + (w * h_s)));
-        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = logistic_noise(max(c + (w * h_s), 0.0)));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, sample_normal(f(v_s), c + (w * h_s)));
+        V_SAMPLE_INPUT(unit_type::RELU, sample_noisy_relu(f(v_s), max(c + (w * h_s), 0.0), false));
 
         if (P) {
             nan_check_deep(v_a);
@@ -565,42 +666,35 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        H_PROBS(unit_type::BINARY, f(h_a) = etl::sigmoid(rep_l(b, Batch) + v_a * w));
+        cpp::static_if<P && hidden_unit == unit_type::BINARY && !fast_math>([&](auto f) { f(h_a) = etl::sigmoid(rep_l(b, Batch) + v_a * w); });
+        cpp::static_if<P && hidden_unit == unit_type::BINARY && fast_math>([&](auto f) { f(h_a) = rep_l(b, Batch) + v_a * w; fast_activate<function::SIGMOID>(f(h_a)); });
         H_PROBS(unit_type::RELU, f(h_a) = max(rep_l(b, Batch) + v_a * w, 0.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
 
+        // The softmax and the sampling of each row are fused in one kernel
         H_PROBS_MULTI(unit_type::SOFTMAX)
         ([&](auto f) {
-            auto x = f(etl::force_temporary(rep_l(b, Batch) + v_a * w));
-
-            for (size_t b = 0; b < Batch; ++b) {
-                f(h_a)(b) = stable_softmax(x(b));
-            }
+            f(h_a) = rep_l(b, Batch) + v_a * w;
+            softmax_sample_rows<true, S>(f(h_a).memory_start(), f(h_s).memory_start(), Batch, etl::size(h_a) / Batch);
+            dll::host_written(f(h_a));
+            dll::host_written(f(h_s));
         });
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX)
-        ([&](auto f) {
-            for (size_t b = 0; b < Batch; ++b) {
-                f(h_s)(b) = stable_softmax(h_a(b));
-            }
-        });
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(f(h_s), h_a));
+        H_SAMPLE_PROBS(unit_type::RELU, sample_noisy_relu(f(h_s), rep_l(b, Batch) + v_a * w));
+        H_SAMPLE_PROBS(unit_type::RELU1, sample_capped_relu(f(h_s), rep_l(b, Batch) + v_a * w, 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, sample_capped_relu(f(h_s), rep_l(b, Batch) + v_a * w, 6.0));
 
         H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = bernoulli(etl::sigmoid(rep_l(b, Batch) + v_a * w)));
-        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
-        H_SAMPLE_INPUT_MULTI(unit_type::RELU1)
+        H_SAMPLE_INPUT(unit_type::RELU, sample_noisy_relu(f(h_s), rep_l(b, Batch) + v_a * w));
+        H_SAMPLE_INPUT(unit_type::RELU1, sample_capped_relu(f(h_s), rep_l(b, Batch) + v_a * w, 1.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, sample_capped_relu(f(h_s), rep_l(b, Batch) + v_a * w, 6.0));
+        H_SAMPLE_INPUT_MULTI(unit_type::SOFTMAX)
         ([&](auto f) {
-            auto x = f(etl::force_temporary(rep_l(b, Batch) + v_a * w));
-
-            for (size_t b = 0; b < Batch; ++b) {
-                f(h_s)(b) = one_if_max(stable_softmax(x(b)));
-            }
+            f(h_s) = rep_l(b, Batch) + v_a * w;
+            softmax_sample_rows<false, true>(f(h_s).memory_start(), f(h_s).memory_start(), Batch, etl::size(h_s) / Batch);
+            dll::host_written(f(h_s));
         });
 
         if (P) {
@@ -612,6 +706,39 @@ private:
         }
     }
 
+    /*!
+     * \brief Compute the binary hidden activation probabilities (and
+     * samples) of a batch with the block-sparse weights
+     *
+     * \param h_a The batch output to set the activation probabilities
+     * \param h_s The batch output to set the samples (if S)
+     * \param v_a The batch input
+     */
+    template <bool S, typename H1, typename H2, typename V>
+    void batch_block_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a) const {
+        dll::auto_timer timer("rbm:block:batch_activate_hidden");
+
+        const auto Batch = etl::dim<0>(h_a);
+
+        cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
+
+        block_sparse_mul(h_a, v_a, as_derived().w, w_blocks);
+
+        if /*constexpr*/ (fast_math) {
+            h_a = etl::rep_l(as_derived().b, Batch) + h_a;
+            fast_activate<function::SIGMOID>(h_a);
+        } else {
+            h_a = etl::sigmoid(etl::rep_l(as_derived().b, Batch) + h_a);
+        }
+
+        nan_check_deep(h_a);
+
+        if (S) {
+            sample_bernoulli(h_s, h_a);
+            nan_check_deep(h_s);
+        }
+    }
+
     template <bool P = true, bool S = true, typename H, typename V, typename C, typename W>
     static void batch_std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w) {
         dll::auto_timer timer("rbm:std:batch_activate_visible");
@@ -622,13 +749,14 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        V_PROBS(unit_type::BINARY, f(v_a) = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+        cpp::static_if<P && visible_unit == unit_type::BINARY && !fast_math>([&](auto f) { f(v_a) = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))); });
+        cpp::static_if<P && visible_unit == unit_type::BINARY && fast_math>([&](auto f) { f(v_a) = rep_l(c, Batch) + transpose(w * transpose(h_s)); fast_activate<function::SIGMOID>(f(v_a)); });
         V_PROBS(unit_type::GAUSSIAN, f(v_a) = rep_l(c, Batch) + transpose(w * transpose(h_s)));
         V_PROBS(unit_type::RELU, f(v_a) = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
 
         V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = bernoulli(etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, sample_normal(f(v_s), rep_l(c, Batch) + transpose(w * transpose(h_s))));
+        V_SAMPLE_INPUT(unit_type::RELU, sample_noisy_relu(f(v_s), max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0), false));
 
         if (P) {
             nan_check_deep(v_a);
@@ -0,0 +1,167 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Networks sharing their lower layers, for the serving of many
+ * variants of a model.
+ *
+ * The variants of a model often only differ by their top layers, the
+ * lower layers being the same pretrained stack. A shared_dbn is made of a
+ * base network, shared and immutable, and of its own top network: the
+ * memory then grows with the number of different networks, not with the
+ * number of variants. The base networks are loaded once per file from the
+ * model file format (see dll/model_file.hpp) by load_shared.
+ *
+ * The inference of the networks being reentrant, the variants can be used
+ * concurrently from several threads.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <algorithm>
+
+#include "dll/model_file.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A network made of a shared base network and of its own top
+ * network, the output of the base network being the input of the top
+ * network.
+ */
+template <typename Base, typename Top>
+struct shared_dbn {
+    using base_t = Base;                   ///< The type of the shared base network
+    using top_t  = Top;                    ///< The type of the top network
+    using weight = typename top_t::weight; ///< The data type of the network
+
+    std::shared_ptr<const base_t> base; ///< The shared base network
+    std::shared_ptr<const top_t> top;   ///< The top network
+
+    /*!
+     * \brief Create a network from the given base and top networks
+     * \param base The shared base network
+     * \param top The top network
+     */
+    shared_dbn(std::shared_ptr<const base_t> base, std::shared_ptr<const top_t> top)
+            : base(std::move(base)), top(std::move(top)) {
+        cpp_assert(this->base && this->top, "The networks of a shared_dbn cannot be null");
+    }
+
+    /*!
+     * \brief Return the test representation of the network for the given input batch.
+     * \param batch The input batch
+     * \return The output batch of the top network
+     */
+    template <typename Input>
+    auto forward_batch(const Input& batch) const {
+        auto features = base->forward_batch(batch);
+        return top->forward_batch(features);
+    }
+
+    /*!
+     * \brief Return the test representation of the network for the given input sample.
+     * \param sample The input sample
+     * \return The output of the top network
+     */
+    template <typename Input>
+    auto forward_one(const Input& sample) const {
+        auto features = base->forward_one(sample);
+        return top->forward_one(features);
+    }
+
+    /*!
+     * \brief Returns the output features for the given sample
+     * \param sample The sample to get features from
+     * \return the output features of the top network
+     */
+    template <typename Input>
+    auto features(const Input& sample) const {
+        return forward_one(sample);
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     * \param sample The sample to predict the label for
+     * \return the predicted label
+     */
+    template <typename Input>
+    size_t predict(const Input& sample) const {
+        auto result = forward_one(sample);
+        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
+    }
+};
+
+/*!
+ * \brief Create a network from the given base and top networks
+ * \param base The shared base network
+ * \param top The top network
+ */
+template <typename Base, typename Top>
+shared_dbn<Base, Top> make_shared_dbn(std::shared_ptr<const Base> base, std::shared_ptr<const Top> top) {
+    return shared_dbn<Base, Top>(std::move(base), std::move(top));
+}
+
+namespace shared_detail {
+
+/*!
+ * \brief The networks loaded from files, for one type of network
+ */
+template <typename DBN>
+struct shared_registry {
+    std::mutex lock;                                          ///< The lock protecting the networks
+    std::map<std::string, std::weak_ptr<const DBN>> networks; ///< The loaded networks, by file
+
+    /*!
+     * \brief Return the unique registry of the DBN type
+     */
+    static shared_registry& instance() {
+        static shared_registry registry;
+        return registry;
+    }
+};
+
+} //end of namespace shared_detail
+
+/*!
+ * \brief Load the network of the given model file, once.
+ *
+ * The network is only loaded if it is not already used by another model,
+ * in which case the same network is returned. It is released once it is
+ * not used anymore.
+ *
+ * \param path The path of the model file
+ * \return the shared network, or nullptr if it cannot be loaded
+ */
+template <typename DBN>
+std::shared_ptr<const DBN> load_shared(const std::string& path) {
+    auto& registry = shared_detail::shared_registry<DBN>::instance();
+
+    std::lock_guard<std::mutex> l(registry.lock);
+
+    if (auto network = registry.networks[path].lock()) {
+        return network;
+    }
+
+    auto network = std::make_shared<DBN>();
+
+    if (!load_model(*network, path)) {
+        registry.networks.erase(path);
+        return nullptr;
+    }
+
+    registry.networks[path] = network;
+
+    return network;
+}
+
+} //end of dll namespace
@@ -0,0 +1,528 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Incremental inference of a sliding window through the
+ * convolutional layers of a network.
+ *
+ * The last dimension of the input is the time axis (the columns). Each
+ * streamed layer keeps the columns of its output for the current window.
+ * When the window slides by some frames, the cached columns are shifted
+ * and only the new columns are computed: a convolution only needs the
+ * last columns of its input, a pooling only the last blocks of its
+ * input. The layers after the streamed layers are computed on the full
+ * features of the window.
+ *
+ * The convolutional layers, the convolutional RBMs and the max and
+ * average pooling layers (2D and 3D) can be streamed. The shift of the
+ * window must be a multiple of the time pooling ratios of the streamed
+ * layers.
+ *
+ * The streaming only references the network, which must outlive it.
+ */
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/avgp_layer.hpp"
+#include "dll/util/conv_engine.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+namespace streaming_detail {
+
+/*!
+ * \brief The streaming of a layer, the layers are not streamed by default
+ */
+template <typename Layer>
+struct streaming_layer {
+    static constexpr bool supported = false; ///< Indicates if the layer can be streamed
+};
+
+/*!
+ * \brief Stage the columns [first, first + count) of the given input into
+ * a batch of one sample
+ */
+template <typename T>
+etl::dyn_matrix<T, 4> stage_columns(const etl::dyn_matrix<T, 3>& input, size_t first, size_t count) {
+    const size_t C = etl::dim<0>(input);
+    const size_t H = etl::dim<1>(input);
+    const size_t W = etl::dim<2>(input);
+
+    etl::dyn_matrix<T, 4> x(1UL, C, H, count);
+
+    const T* in = input.memory_start();
+    T* out      = x.memory_start();
+
+    for (size_t r = 0; r < C * H; ++r) {
+        std::copy(in + r * W + first, in + r * W + first + count, out + r * count);
+    }
+
+    dll::host_written(x);
+
+    return x;
+}
+
+/*!
+ * \brief Compute the columns [first, first + count) of the output of a
+ * convolution, without the activation, into a batch of one sample
+ */
+template <typename Layer, typename T>
+etl::dyn_matrix<T, 4> convolve_columns(const Layer& layer, const etl::dyn_matrix<T, 3>& input, size_t first, size_t count) {
+    auto x = stage_columns(input, first, count + Layer::NW2 - 1);
+
+    etl::dyn_matrix<T, 4> y(1UL, Layer::K, Layer::NH1, count);
+
+    conv_engine_forward(Layer::desc::engine, y, x, layer.w);
+
+    return y;
+}
+
+/*!
+ * \brief Store the columns of one batch of output into the columns
+ * [first, first + count) of the given output
+ */
+template <typename T>
+void store_columns(etl::dyn_matrix<T, 3>& output, etl::dyn_matrix<T, 4>& y, size_t first) {
+    const size_t R     = etl::dim<0>(output) * etl::dim<1>(output);
+    const size_t W     = etl::dim<2>(output);
+    const size_t count = etl::dim<3>(y);
+
+    dll::host_read(y);
+
+    const T* in = y.memory_start();
+    T* out      = output.memory_start();
+
+    for (size_t r = 0; r < R; ++r) {
+        std::copy(in + r * count, in + (r + 1) * count, out + r * W + first);
+    }
+}
+
+/*!
+ * \brief Compute the columns [first, first + count) of a max or average
+ * pooling by blocks of C1 x C2 x C3
+ */
+template <bool Max, size_t C1, size_t C2, size_t C3, typename T>
+void pool_columns(const etl::dyn_matrix<T, 3>& input, etl::dyn_matrix<T, 3>& output, size_t first, size_t count) {
+    for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+        for (size_t j = 0; j < etl::dim<1>(output); ++j) {
+            for (size_t k = first; k < first + count; ++k) {
+                T value = Max ? input(i * C1, j * C2, k * C3) : T(0);
+
+                for (size_t ii = 0; ii < C1; ++ii) {
+                    for (size_t jj = 0; jj < C2; ++jj) {
+                        for (size_t kk = 0; kk < C3; ++kk) {
+                            auto v = input(i * C1 + ii, j * C2 + jj, k * C3 + kk);
+
+                            value = Max ? std::max(value, v) : value + v;
+                        }
+                    }
+                }
+
+                output(i, j, k) = Max ? value : value / T(C1 * C2 * C3);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief The streaming of a convolutional layer
+ */
+template <typename Desc>
+struct streaming_layer<conv_layer_impl<Desc>> {
+    using layer_t = conv_layer_impl<Desc>; ///< The type of the layer
+
+    static constexpr bool supported = layer_t::S1 == 1 && layer_t::S2 == 1 && layer_t::P1 == 0 && layer_t::P2 == 0; ///< Indicates if the layer can be streamed (not with stride nor padding)
+    static constexpr size_t ratio   = 1;    ///< The pooling ratio of the time axis
+
+    /*!
+     * \brief Return the dimensions of the input
+     */
+    static constexpr std::array<size_t, 3> input_dims() {
+        return {{layer_t::NC, layer_t::NV1, layer_t::NV2}};
+    }
+
+    /*!
+     * \brief Return the dimensions of the output
+     */
+    static constexpr std::array<size_t, 3> output_dims() {
+        return {{layer_t::K, layer_t::NH1, layer_t::NH2}};
+    }
+
+    /*!
+     * \brief Compute the columns [first, first + count) of the output
+     */
+    template <typename T>
+    static void compute(const layer_t& layer, const etl::dyn_matrix<T, 3>& input, etl::dyn_matrix<T, 3>& output, size_t first, size_t count) {
+        auto y = convolve_columns(layer, input, first, count);
+
+        if /*constexpr*/ (!layer_t::no_bias) {
+            y = bias_add_4d(y, layer.b);
+        }
+
+        if /*constexpr*/ (layer_t::activation_function != function::IDENTITY) {
+            activate_inplace<layer_t::activation_function, layer_t::fast_math>(y);
+        }
+
+        store_columns(output, y, first);
+    }
+};
+
+/*!
+ * \brief The streaming of a convolutional RBM, the output being the
+ * activation probabilities of the hidden units
+ */
+template <typename Desc>
+struct streaming_layer<conv_rbm_impl<Desc>> {
+    using layer_t = conv_rbm_impl<Desc>; ///< The type of the layer
+
+    static constexpr bool supported = true; ///< Indicates if the layer can be streamed
+    static constexpr size_t ratio   = 1;    ///< The pooling ratio of the time axis
+
+    /*!
+     * \brief Return the dimensions of the input
+     */
+    static constexpr std::array<size_t, 3> input_dims() {
+        return {{layer_t::NC, layer_t::NV1, layer_t::NV2}};
+    }
+
+    /*!
+     * \brief Return the dimensions of the output
+     */
+    static constexpr std::array<size_t, 3> output_dims() {
+        return {{layer_t::K, layer_t::NH1, layer_t::NH2}};
+    }
+
+    /*!
+     * \brief Compute the columns [first, first + count) of the output
+     */
+    template <typename T>
+    static void compute(const layer_t& layer, const etl::dyn_matrix<T, 3>& input, etl::dyn_matrix<T, 3>& output, size_t first, size_t count) {
+        static_assert(layer_t::hidden_unit == unit_type::BINARY || is_relu(layer_t::hidden_unit), "Invalid hidden unit type");
+
+        auto y = convolve_columns(layer, input, first, count);
+
+        y = bias_add_4d(y, layer.b);
+
+        if /*constexpr*/ (layer_t::hidden_unit == unit_type::BINARY) {
+            if /*constexpr*/ (layer_t::visible_unit == unit_type::GAUSSIAN) {
+                y = etl::sigmoid((1.0 / (0.1 * 0.1)) >> y);
+            } else {
+                y = etl::sigmoid(y);
+            }
+        } else if /*constexpr*/ (layer_t::hidden_unit == unit_type::RELU) {
+            y = etl::max(y, 0.0);
+        } else if /*constexpr*/ (layer_t::hidden_unit == unit_type::RELU6) {
+            y = etl::min(etl::max(y, 0.0), 6.0);
+        } else if /*constexpr*/ (layer_t::hidden_unit == unit_type::RELU1) {
+            y = etl::min(etl::max(y, 0.0), 1.0);
+        }
+
+        store_columns(output, y, first);
+    }
+};
+
+/*!
+ * \brief The streaming of a 2D or 3D pooling layer
+ */
+template <typename Layer, bool Max, size_t C1, size_t C2, size_t C3>
+struct streaming_pooling_layer {
+    using layer_t = Layer; ///< The type of the layer
+
+    static constexpr bool supported = true; ///< Indicates if the layer can be streamed
+    static constexpr size_t ratio   = C3;   ///< The pooling ratio of the time axis
+
+    /*!
+     * \brief Return the dimensions of the input
+     */
+    static constexpr std::array<size_t, 3> input_dims() {
+        return {{layer_t::I1, layer_t::I2, layer_t::I3}};
+    }
+
+    /*!
+     * \brief Return the dimensions of the output
+     */
+    static constexpr std::array<size_t, 3> output_dims() {
+        return {{layer_t::O1, layer_t::O2, layer_t::O3}};
+    }
+
+    /*!
+     * \brief Compute the columns [first, first + count) of the output
+     */
+    template <typename T>
+    static void compute(const layer_t& /*layer*/, const etl::dyn_matrix<T, 3>& input, etl::dyn_matrix<T, 3>& output, size_t first, size_t count) {
+        pool_columns<Max, C1, C2, C3>(input, output, first, count);
+    }
+};
+
+/*!
+ * \brief The streaming of a 2D max pooling layer
+ */
+template <typename Desc>
+struct streaming_layer<mp_2d_layer_impl<Desc>> : streaming_pooling_layer<mp_2d_layer_impl<Desc>, true, 1, Desc::C1, Desc::C2> {};
+
+/*!
+ * \brief The streaming of a 3D max pooling layer
+ */
+template <typename Desc>
+struct streaming_layer<mp_3d_layer_impl<Desc>> : streaming_pooling_layer<mp_3d_layer_impl<Desc>, true, Desc::C1, Desc::C2, Desc::C3> {};
+
+/*!
+ * \brief The streaming of a 2D average pooling layer
+ */
+template <typename Desc>
+struct streaming_layer<avgp_2d_layer_impl<Desc>> : streaming_pooling_layer<avgp_2d_layer_impl<Desc>, false, 1, Desc::C1, Desc::C2> {};
+
+/*!
+ * \brief The streaming of a 3D average pooling layer
+ */
+template <typename Desc>
+struct streaming_layer<avgp_3d_layer_impl<Desc>> : streaming_pooling_layer<avgp_3d_layer_impl<Desc>, false, Desc::C1, Desc::C2, Desc::C3> {};
+
+/*!
+ * \brief The number of leading layers of the network that can be streamed
+ */
+template <typename DBN, size_t I = 0, typename Enable = void>
+struct streamed_layers : std::integral_constant<size_t, I> {};
+
+template <typename DBN, size_t I>
+struct streamed_layers<DBN, I, std::enable_if_t<(I < DBN::layers) && streaming_layer<typename DBN::template layer_type<I>>::supported>>
+        : streamed_layers<DBN, I + 1> {};
+
+} //end of namespace streaming_detail
+
+/*!
+ * \brief Incremental inference of a sliding window through the first L
+ * layers of a network.
+ *
+ * \tparam DBN The type of the network
+ * \tparam L The number of streamed layers, by default all the leading
+ * layers that can be streamed
+ */
+template <typename DBN, size_t L = streaming_detail::streamed_layers<DBN>::value>
+struct streaming_dbn {
+    using dbn_t  = DBN;                    ///< The type of the network
+    using weight = typename dbn_t::weight; ///< The data type of the network
+    using cache_t = etl::dyn_matrix<weight, 3>; ///< The type of the cached columns of a layer
+
+    static constexpr size_t layers   = dbn_t::layers; ///< The number of layers of the network
+    static constexpr size_t streamed = L;             ///< The number of streamed layers
+
+    static_assert(L > 0, "The first layer of the network cannot be streamed");
+    static_assert(L <= layers, "The network does not have enough layers");
+
+    /*!
+     * \brief Create a streaming of the given network
+     * \param dbn The network
+     * \param shift The number of frames pushed at each step
+     */
+    streaming_dbn(const dbn_t& dbn, size_t shift) : dbn(dbn), shift(shift) {
+        init_caches<0>();
+
+        cpp_assert(shift > 0 && shift <= etl::dim<2>(caches[0]), "The shift must be between 1 and the window size");
+    }
+
+    /*!
+     * \brief Compute all the columns of the given window
+     * \param window The input window (channels x rows x frames)
+     */
+    template <typename Input>
+    void start(const Input& window) {
+        dll::auto_timer timer("streaming:start");
+
+        cpp_assert(etl::size(window) == etl::size(caches[0]), "Invalid window size");
+
+        dll::host_read(window);
+
+        std::copy(window.memory_start(), window.memory_end(), caches[0].memory_start());
+
+        compute_layers<0>(etl::dim<2>(caches[0]));
+
+        started = true;
+    }
+
+    /*!
+     * \brief Slide the window by the given frames, only the new columns of
+     * each layer are computed
+     * \param frames The new frames (channels x rows x shift)
+     */
+    template <typename Input>
+    void push(const Input& frames) {
+        dll::auto_timer timer("streaming:push");
+
+        cpp_assert(started, "The window must be started before frames are pushed");
+        cpp_assert(etl::dim<2>(frames) == shift, "push() needs exactly shift frames");
+        cpp_assert(etl::size(frames) == etl::dim<0>(caches[0]) * etl::dim<1>(caches[0]) * shift, "Invalid frames size");
+
+        dll::host_read(frames);
+
+        auto& input = caches[0];
+
+        shift_columns(input, shift);
+
+        const size_t R = etl::dim<0>(input) * etl::dim<1>(input);
+        const size_t W = etl::dim<2>(input);
+
+        for (size_t r = 0; r < R; ++r) {
+            std::copy(frames.memory_start() + r * shift, frames.memory_start() + (r + 1) * shift, input.memory_start() + r * W + W - shift);
+        }
+
+        compute_layers<0>(shift);
+    }
+
+    /*!
+     * \brief Return the output of the last streamed layer for the current
+     * window
+     */
+    const cache_t& features() const {
+        return caches[L];
+    }
+
+    /*!
+     * \brief Return the output of the network for the current window
+     */
+    template <size_t LL = L, cpp_enable_iff((LL < layers))>
+    decltype(auto) output() const {
+        typename dbn_t::template layer_type<L>::input_one_t input;
+
+        cpp_assert(etl::size(input) == etl::size(caches[L]), "The features do not match the input of the next layer");
+
+        std::copy(caches[L].memory_start(), caches[L].memory_end(), input.memory_start());
+
+        dll::host_written(input);
+
+        return etl::force_temporary(dbn.template test_forward_one<layers - 1, L>(input));
+    }
+
+    /*!
+     * \brief Return the output of the network for the current window
+     */
+    template <size_t LL = L, cpp_enable_iff((LL == layers))>
+    const cache_t& output() const {
+        return caches[L];
+    }
+
+    /*!
+     * \brief Return the label predicted for the current window
+     */
+    size_t predict() const {
+        auto out = output();
+
+        dll::host_read(out);
+
+        return std::distance(out.memory_start(), std::max_element(out.memory_start(), out.memory_end()));
+    }
+
+private:
+    const dbn_t& dbn;    ///< The network
+    const size_t shift;  ///< The number of frames pushed at each step
+    bool started = false; ///< Indicates if the window has been started
+
+    std::array<cache_t, L + 1> caches; ///< The input of the first layer and the output of each streamed layer
+
+    /*!
+     * \brief Allocate the caches of the layer I and of the next layers
+     */
+    template <size_t I, cpp_enable_iff((I < L))>
+    void init_caches() {
+        using streaming_t = streaming_detail::streaming_layer<typename dbn_t::template layer_type<I>>;
+
+        static_assert(streaming_t::supported, "This layer cannot be streamed");
+
+        constexpr auto in  = streaming_t::input_dims();
+        constexpr auto out = streaming_t::output_dims();
+
+        if (I == 0) {
+            caches[0] = cache_t(in[0], in[1], in[2]);
+            caches[0] = 0;
+        }
+
+        caches[I + 1] = cache_t(out[0], out[1], out[2]);
+        caches[I + 1] = 0;
+
+        init_caches<I + 1>();
+    }
+
+    /*!
+     * \brief Stop after the last streamed layer
+     */
+    template <size_t I, cpp_enable_iff((I == L))>
+    void init_caches() {}
+
+    /*!
+     * \brief Compute the last columns of the output of the layer I, from
+     * its given number of new input columns, and of the next layers
+     * \param count The number of new columns of the input of the layer I
+     */
+    template <size_t I, cpp_enable_iff((I < L))>
+    void compute_layers(size_t count) {
+        using streaming_t = streaming_detail::streaming_layer<typename dbn_t::template layer_type<I>>;
+
+        auto& output = caches[I + 1];
+
+        const size_t W = etl::dim<2>(output);
+
+        // A full window is computed again
+        const bool full = count == etl::dim<2>(caches[I]);
+
+        cpp_assert(full || count % streaming_t::ratio == 0, "The shift must be a multiple of the pooling ratios");
+
+        const size_t next = full ? W : std::min(W, count / streaming_t::ratio);
+
+        if (next < W) {
+            shift_columns(output, next);
+        }
+
+        streaming_t::compute(dbn.template layer_get<I>(), caches[I], output, W - next, next);
+
+        compute_layers<I + 1>(next);
+    }
+
+    /*!
+     * \brief Stop after the last streamed layer
+     */
+    template <size_t I, cpp_enable_iff((I == L))>
+    void compute_layers(size_t /*count*/) {}
+
+    /*!
+     * \brief Shift the columns of the given cache to the left
+     * \param cache The cache to shift
+     * \param s The number of columns to shift
+     */
+    static void shift_columns(cache_t& cache, size_t s) {
+        const size_t R = etl::dim<0>(cache) * etl::dim<1>(cache);
+        const size_t W = etl::dim<2>(cache);
+
+        weight* memory = cache.memory_start();
+
+        for (size_t r = 0; r < R; ++r) {
+            std::copy(memory + r * W + s, memory + (r + 1) * W, memory + r * W);
+        }
+    }
+};
+
+/*!
+ * \brief Create a streaming of the first layers of the given network
+ * \param dbn The network
+ * \param shift The number of frames pushed at each step
+ */
+template <typename DBN>
+streaming_dbn<DBN> make_streaming(const DBN& dbn, size_t shift) {
+    return streaming_dbn<DBN>(dbn, shift);
+}
+
+} //end of dll namespace
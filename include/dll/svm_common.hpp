@@ -13,10 +13,20 @@
 #ifdef DLL_SVM_SUPPORT
 
 #include <fstream>
+#include <vector>
+#include <numeric>
+#include <random>
+#include <cmath>
+#include <algorithm>
 
 #include "cpp_utils/io.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
 #include "nice_svm.hpp"
 
+#include "dll/util/random.hpp"
+#include "dll/util/affinity.hpp"
+#include "dll/linear_classifier.hpp"
+
 namespace dll {
 
 inline svm_parameter default_svm_parameters() {
@@ -31,6 +41,407 @@ inline svm_parameter default_svm_parameters() {
     return parameters;
 }
 
+/*!
+ * \brief The key of the samples an SVM problem was built from.
+ *
+ * It is used to reuse the problem (and therefore the features) when the
+ * same samples are used several times (grid search and training), as
+ * long as the weights of the network do not change.
+ */
+struct svm_problem_key {
+    const void* samples = nullptr; ///< The address of the first sample
+    const void* labels  = nullptr; ///< The address of the first label
+    size_t n            = 0;       ///< The number of samples
+    bool scale          = false;   ///< Indicates if the features were scaled
+
+    /*!
+     * \brief Indicates if the key is the same as the given one
+     */
+    bool operator==(const svm_problem_key& rhs) const {
+        return samples && samples == rhs.samples && labels == rhs.labels && n == rhs.n && scale == rhs.scale;
+    }
+};
+
+/*!
+ * \brief The support vectors of a libsvm model, as a dense matrix, to
+ * predict batches of samples.
+ *
+ * The kernel values of a batch of samples with all the support vectors
+ * are computed at once from the products of the samples and the support
+ * vectors (X * SV^T, one matrix multiplication), the decision functions
+ * are then the same as the ones of libsvm. The precomputed kernels are
+ * not supported.
+ */
+struct svm_batch_model {
+    const svm_model* model = nullptr; ///< The model of the support vectors, nullptr if not prepared
+    etl::dyn_matrix<double, 2> sv;    ///< The dense support vectors (l x F)
+    std::vector<double> sv_norms;     ///< The squared norms of the support vectors
+    std::vector<size_t> start;        ///< The index of the first support vector of each class
+
+    /*!
+     * \brief Indicates if the batch prediction supports the given model
+     */
+    static bool supported(const svm_model& m) {
+        return m.param.kernel_type != PRECOMPUTED;
+    }
+
+    /*!
+     * \brief Indicates if the support vectors are prepared
+     */
+    bool ready() const {
+        return model;
+    }
+
+    /*!
+     * \brief Forget the support vectors, the model has changed
+     */
+    void reset() {
+        model = nullptr;
+    }
+
+    /*!
+     * \brief Build the dense support vectors of the given model
+     * \param m The model
+     * \param F The number of features of the samples
+     */
+    void prepare(const svm_model& m, size_t F) {
+        const size_t l = m.l;
+
+        sv = etl::dyn_matrix<double, 2>(l, F);
+        sv = 0.0;
+
+        sv_norms.assign(l, 0.0);
+
+        for (size_t j = 0; j < l; ++j) {
+            for (const svm_node* node = m.SV[j]; node->index != -1; ++node) {
+                if (size_t(node->index) <= F) {
+                    sv(j, node->index - 1) = node->value;
+                    sv_norms[j] += node->value * node->value;
+                }
+            }
+        }
+
+        start.assign(m.nr_class, 0);
+
+        for (int i = 1; i < m.nr_class; ++i) {
+            start[i] = start[i - 1] + m.nSV[i - 1];
+        }
+
+        model = &m;
+    }
+
+    /*!
+     * \brief Predict the given batch of features
+     * \param x The features (samples x F)
+     * \param labels The output predictions
+     */
+    template <typename Features>
+    void predict(const Features& x, double* labels) const {
+        const auto& param = model->param;
+
+        const size_t m = etl::dim<0>(x);
+        const size_t F = etl::dim<1>(sv);
+        const size_t l = etl::dim<0>(sv);
+
+        etl::dyn_matrix<double, 2> xs(m, F);
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t f = 0; f < F; ++f) {
+                xs(i, f) = x(i, f);
+            }
+        }
+
+        etl::dyn_matrix<double, 2> k(m, l);
+
+        k = xs * etl::transpose(sv);
+
+        std::vector<double> kvalue(l);
+        std::vector<size_t> votes(model->nr_class);
+
+        for (size_t i = 0; i < m; ++i) {
+            double x_norm = 0.0;
+
+            if (param.kernel_type == RBF) {
+                for (size_t f = 0; f < F; ++f) {
+                    x_norm += xs(i, f) * xs(i, f);
+                }
+            }
+
+            for (size_t j = 0; j < l; ++j) {
+                const double dot = k(i, j);
+
+                switch (param.kernel_type) {
+                    case POLY:
+                        kvalue[j] = std::pow(param.gamma * dot + param.coef0, param.degree);
+                        break;
+                    case RBF:
+                        kvalue[j] = std::exp(-param.gamma * std::max(0.0, x_norm + sv_norms[j] - 2.0 * dot));
+                        break;
+                    case SIGMOID:
+                        kvalue[j] = std::tanh(param.gamma * dot + param.coef0);
+                        break;
+                    default:
+                        kvalue[j] = dot;
+                        break;
+                }
+            }
+
+            labels[i] = decision(kvalue, votes);
+        }
+    }
+
+private:
+    /*!
+     * \brief Return the prediction of one sample from its kernel values
+     * with the support vectors, as libsvm does
+     */
+    double decision(const std::vector<double>& kvalue, std::vector<size_t>& votes) const {
+        const auto& param = model->param;
+
+        if (param.svm_type == ONE_CLASS || param.svm_type == EPSILON_SVR || param.svm_type == NU_SVR) {
+            double sum = -model->rho[0];
+
+            for (size_t j = 0; j < kvalue.size(); ++j) {
+                sum += model->sv_coef[0][j] * kvalue[j];
+            }
+
+            if (param.svm_type == ONE_CLASS) {
+                return sum > 0 ? 1 : -1;
+            }
+
+            return sum;
+        }
+
+        const int nr_class = model->nr_class;
+
+        std::fill(votes.begin(), votes.end(), 0);
+
+        size_t p = 0;
+
+        for (int i = 0; i < nr_class; ++i) {
+            for (int j = i + 1; j < nr_class; ++j) {
+                double sum = -model->rho[p++];
+
+                const double* coef1 = model->sv_coef[j - 1];
+                const double* coef2 = model->sv_coef[i];
+
+                for (size_t s = start[i]; s < start[i] + model->nSV[i]; ++s) {
+                    sum += coef1[s] * kvalue[s];
+                }
+
+                for (size_t s = start[j]; s < start[j] + model->nSV[j]; ++s) {
+                    sum += coef2[s] * kvalue[s];
+                }
+
+                ++votes[sum > 0 ? i : j];
+            }
+        }
+
+        return model->label[std::distance(votes.begin(), std::max_element(votes.begin(), votes.end()))];
+    }
+};
+
+/*!
+ * \brief Convert a linear classifier into a libsvm model with a linear
+ * kernel, to be predicted, stored and loaded as the SVM of a network.
+ *
+ * Each class has one support vector, its weights. The decision of the
+ * pair of classes (i, j) is the difference of their scores, the one-vs-one
+ * votes of libsvm are then won by the class with the maximum score.
+ *
+ * \param linear The linear classifier
+ * \return the equivalent libsvm model
+ */
+inline svm::model svm_from_linear(const linear_model& linear) {
+    const size_t K = linear.classes();
+    const size_t F = linear.features();
+
+    std::vector<svm_node> nodes(K * (F + 1));
+    std::vector<svm_node*> sv(K);
+    std::vector<double> coefs((K - 1) * K);
+    std::vector<double*> sv_coef(K - 1);
+    std::vector<double> rho;
+    std::vector<int> label(K);
+    std::vector<int> n_sv(K, 1);
+
+    for (size_t c = 0; c < K; ++c) {
+        sv[c]    = &nodes[c * (F + 1)];
+        label[c] = int(linear.labels[c]);
+
+        for (size_t f = 0; f < F; ++f) {
+            sv[c][f].index = int(f + 1);
+            sv[c][f].value = linear.w(c, f);
+        }
+
+        sv[c][F].index = -1;
+    }
+
+    // The support vector of the class s has the coefficient 1 in the
+    // pairs where it is the first class and -1 in the others
+    for (size_t r = 0; r < K - 1; ++r) {
+        sv_coef[r] = &coefs[r * K];
+
+        for (size_t c = 0; c < K; ++c) {
+            sv_coef[r][c] = r >= c ? 1.0 : -1.0;
+        }
+    }
+
+    for (size_t i = 0; i < K; ++i) {
+        for (size_t j = i + 1; j < K; ++j) {
+            rho.push_back(linear.b[j] - linear.b[i]);
+        }
+    }
+
+    svm_model model{};
+
+    model.param             = default_svm_parameters();
+    model.param.kernel_type = LINEAR;
+    model.param.probability = 0;
+    model.nr_class          = int(K);
+    model.l                 = int(K);
+    model.SV                = sv.data();
+    model.sv_coef           = sv_coef.data();
+    model.rho               = rho.data();
+    model.label             = label.data();
+    model.nSV               = n_sv.data();
+
+    // The model is owned by libsvm once loaded back
+    svm_save_model("..tmp.svm", &model);
+
+    return svm::load("..tmp.svm");
+}
+
+namespace svm_detail {
+
+/*!
+ * \brief Return the values of one axis of the grid
+ */
+inline std::vector<double> grid_values(double first, double last, size_t steps, svm::grid_search_type type) {
+    std::vector<double> values;
+
+    for (size_t i = 0; i < steps; ++i) {
+        const double r = steps > 1 ? double(i) / double(steps - 1) : 0.0;
+
+        if (type == svm::grid_search_type::EXP) {
+            values.push_back(first * std::pow(last / first, r));
+        } else {
+            values.push_back(first + r * (last - first));
+        }
+    }
+
+    return values;
+}
+
+} //end of namespace svm_detail
+
+/*!
+ * \brief Perform a grid search of the C and gamma parameters of a RBF SVM
+ * with cross-validation.
+ *
+ * Each (C, gamma, fold) combination is trained independently on the
+ * thread pool. The folds are the same for all the points of the grid.
+ * The best parameters are set in the given parameters.
+ *
+ * \param pool The thread pool
+ * \param problem The SVM problem
+ * \param parameters The parameters, updated with the best C and gamma
+ * \param n_fold The number of folds
+ * \param g The grid
+ *
+ * \return The best cross-validation accuracy
+ */
+template <typename Pool>
+double svm_parallel_grid_search(Pool& pool, svm::problem& problem, svm_parameter& parameters, size_t n_fold, const svm::rbf_grid& g) {
+    const auto& sub = problem.get_problem();
+
+    const size_t n = sub.l;
+
+    const auto c_values     = svm_detail::grid_values(g.c_first, g.c_last, size_t(g.c_steps), g.c_search);
+    const auto gamma_values = svm_detail::grid_values(g.gamma_first, g.gamma_last, size_t(g.gamma_steps), g.gamma_search);
+
+    const size_t points = c_values.size() * gamma_values.size();
+
+    // The folds are drawn once, from the seed of DLL
+
+    std::vector<size_t> indices(n);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    std::mt19937_64 engine(dll::seed());
+    std::shuffle(indices.begin(), indices.end(), engine);
+
+    std::vector<size_t> fold_of(n);
+    for (size_t i = 0; i < n; ++i) {
+        fold_of[indices[i]] = i % n_fold;
+    }
+
+    std::vector<size_t> correct(points * n_fold, 0);
+
+    cpp::maybe_parallel_foreach_n(pool, 0, points * n_fold, [&](size_t task) {
+        pin_pool_thread();
+
+        const size_t point = task / n_fold;
+        const size_t fold  = task % n_fold;
+
+        auto p  = parameters;
+        p.C     = c_values[point / gamma_values.size()];
+        p.gamma = gamma_values[point % gamma_values.size()];
+
+        // The probability estimates are not necessary for the accuracy
+        p.probability = 0;
+
+        std::vector<double> y;
+        std::vector<svm_node*> x;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (fold_of[i] != fold) {
+                y.push_back(sub.y[i]);
+                x.push_back(sub.x[i]);
+            }
+        }
+
+        svm_problem train;
+        train.l = int(y.size());
+        train.y = y.data();
+        train.x = x.data();
+
+        auto* model = svm_train(&train, &p);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (fold_of[i] == fold && svm_predict(model, sub.x[i]) == sub.y[i]) {
+                ++correct[task];
+            }
+        }
+
+        svm_free_and_destroy_model(&model);
+    });
+
+    double best_accuracy = -1.0;
+
+    for (size_t point = 0; point < points; ++point) {
+        size_t good = 0;
+        for (size_t fold = 0; fold < n_fold; ++fold) {
+            good += correct[point * n_fold + fold];
+        }
+
+        const double accuracy = 100.0 * double(good) / double(n);
+
+        const double c     = c_values[point / gamma_values.size()];
+        const double gamma = gamma_values[point % gamma_values.size()];
+
+        std::cout << "C=" << c << ",gamma=" << gamma << " -> " << accuracy << "%" << std::endl;
+
+        if (accuracy > best_accuracy) {
+            best_accuracy    = accuracy;
+            parameters.C     = c;
+            parameters.gamma = gamma;
+        }
+    }
+
+    std::cout << "Best: C=" << parameters.C << ",gamma=" << parameters.gamma << " -> " << best_accuracy << "%" << std::endl;
+
+    return best_accuracy;
+}
+
 template <typename DBN>
 void svm_store(const DBN& dbn, std::ostream& os) {
     if (dbn.svm_loaded) {
@@ -82,6 +493,7 @@ void svm_load(DBN& dbn, std::istream& is) {
             svm_os.close();
 
             dbn.svm_model = svm::load("..tmp.svm");
+            dbn.svm_batch.reset();
 
             dbn.svm_loaded = true;
         }
@@ -156,6 +568,7 @@ bool svm_train(DBN& dbn, const Samples& training_data, const Labels& labels, con
 
     //Train the SVM
     dbn.svm_model = svm::train(dbn.problem, parameters);
+    dbn.svm_batch.reset();
 
     dbn.svm_loaded = true;
 
@@ -183,6 +596,7 @@ bool svm_train(DBN& dbn, Iterator&& first, Iterator&& last, LIterator&& lfirst,
 
     //Train the SVM
     dbn.svm_model = svm::train(dbn.problem, parameters);
+    dbn.svm_batch.reset();
 
     dbn.svm_loaded = true;
 
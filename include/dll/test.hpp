@@ -7,8 +7,16 @@
 
 #pragma once
 
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "cpp_utils/tmp.hpp"
 #include "cpp_utils/stop_watch.hpp"
 
+#include "dll/util/parallel.hpp" // For concurrency
+
 namespace dll {
 
 /*!
@@ -22,6 +30,24 @@ struct predictor {
     size_t operator()(T& dbn, V& image) {
         return dbn->predict(image);
     }
+
+    /*!
+     * \brief Return the predicted labels for the given range of images
+     * using the given DBN, forwarded by batches
+     */
+    template <typename T, typename Iterator>
+    std::vector<size_t> batch(T& dbn, Iterator first, Iterator last) {
+        auto outputs = dbn->forward_many(first, last);
+
+        std::vector<size_t> labels;
+        labels.reserve(outputs.size());
+
+        for (auto& output : outputs) {
+            labels.push_back(std::distance(output.begin(), std::max_element(output.begin(), output.end())));
+        }
+
+        return labels;
+    }
 };
 
 #ifdef DLL_SVM_SUPPORT
@@ -38,6 +64,17 @@ struct svm_predictor {
     size_t operator()(T& dbn, V& image) {
         return dbn->svm_predict(image);
     }
+
+    /*!
+     * \brief Return the predicted labels for the given range of images
+     * using the given DBN in SVM mode, by batches
+     */
+    template <typename T, typename Iterator>
+    std::vector<size_t> batch(T& dbn, Iterator first, Iterator last) {
+        auto predictions = dbn->svm_predict_many(first, last);
+
+        return {predictions.begin(), predictions.end()};
+    }
 };
 
 #endif //DLL_SVM_SUPPORT
@@ -54,14 +91,95 @@ struct label_predictor {
     size_t operator()(T& dbn, V& image) {
         return dbn->predict_labels(image, 10);
     }
+
+    /*!
+     * \brief Return the predicted labels for the given range of images
+     * using the given DBN, by batches
+     */
+    template <typename T, typename Iterator>
+    std::vector<size_t> batch(T& dbn, Iterator first, Iterator last) {
+        return dbn->predict_labels_many(first, last, 10);
+    }
 };
 
+namespace test_detail {
+
+/*!
+ * \brief Traits indicating if a functor can predict the labels of a range
+ * of images at once (a batch member function)
+ */
+template <typename Functor, typename DBN, typename Iterator, typename Enable = void>
+struct has_batch : std::false_type {};
+
+/*!
+ * \copydoc has_batch
+ */
+template <typename Functor, typename DBN, typename Iterator>
+struct has_batch<Functor, DBN, Iterator, decltype(void(std::declval<Functor&>().batch(std::declval<DBN&>(), std::declval<Iterator>(), std::declval<Iterator>())))> : std::true_type {};
+
+/*!
+ * \brief Returns the number of samples evaluated at once by the batched
+ * tests, one batch for each thread
+ */
+template <typename DBN>
+size_t test_chunk() {
+    return DBN::batch_size * concurrency();
+}
+
+} //end of namespace test_detail
+
+/*!
+ * \brief Compute the error rate of the network on the given range of
+ * images, the labels of each chunk of images being predicted at once by
+ * the batch functor.
+ *
+ * The batch functor is called with the network and the range of a chunk
+ * of images and must return the predicted labels of the chunk.
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator>
+double test_set_batch(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator /*llast*/, Functor&& f) {
+    const size_t n     = std::distance(first, last);
+    const size_t chunk = test_detail::test_chunk<std::decay_t<decltype(*dbn)>>();
+
+    size_t success = 0;
+
+    for (size_t i = 0; i < n; i += chunk) {
+        auto chunk_last = std::next(first, std::min(chunk, n - i));
+
+        auto predicted = f(dbn, first, chunk_last);
+
+        for (auto label : predicted) {
+            if (label == *lfirst) {
+                ++success;
+            }
+
+            ++lfirst;
+        }
+
+        first = chunk_last;
+    }
+
+    return (n - success) / static_cast<double>(n);
+}
+
+/*!
+ * \copydoc test_set_batch
+ */
+template <typename DBN, typename Functor, typename Samples, typename Labels>
+double test_set_batch(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f) {
+    return test_set_batch(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f));
+}
+
 template <typename DBN, typename Functor, typename Samples, typename Labels>
 double test_set(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f) {
     return test_set(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f));
 }
 
-template <typename DBN, typename Functor, typename Iterator, typename LIterator>
+/*!
+ * \brief Compute the error rate of the network on the given range of
+ * images, the functor predicting the label of one image.
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator, cpp_disable_if(test_detail::has_batch<std::decay_t<Functor>, DBN, Iterator>::value)>
 double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator /*llast*/, Functor&& f) {
     size_t success = 0;
     size_t images  = 0;
@@ -84,27 +202,49 @@ double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIter
     return (images - success) / static_cast<double>(images);
 }
 
+/*!
+ * \brief Compute the error rate of the network on the given range of
+ * images, with a functor able to predict a range of images at once
+ * (predictor). The chunks of images are forwarded in parallel, by batches.
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator, cpp_enable_iff(test_detail::has_batch<std::decay_t<Functor>, DBN, Iterator>::value)>
+double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast, Functor&& f) {
+    return test_set_batch(dbn, first, last, lfirst, llast, [&f](auto& net, Iterator cfirst, Iterator clast) {
+        return f.batch(net, cfirst, clast);
+    });
+}
+
 template <typename DBN, typename Samples>
 double test_set_ae(DBN& dbn, const Samples& images) {
     return test_set_ae(dbn, images.begin(), images.end());
 }
 
+/*!
+ * \brief Compute the mean absolute reconstruction error of the network on
+ * the given range of images.
+ *
+ * The reconstructions are computed by chunks, forwarded in parallel by
+ * batches.
+ */
 template <typename DBN, typename Iterator>
 double test_set_ae(DBN& dbn, Iterator first, Iterator last) {
-    double rate        = 0.0;
-    size_t images = 0;
+    const size_t n     = std::distance(first, last);
+    const size_t chunk = test_detail::test_chunk<DBN>();
 
-    while (first != last) {
-        decltype(auto) image = *first;
-        decltype(auto) rec_image = dbn.features(image);
+    double rate = 0.0;
 
-        rate += etl::mean(abs(image - rec_image));
+    for (size_t i = 0; i < n; i += chunk) {
+        auto chunk_last = std::next(first, std::min(chunk, n - i));
 
-        ++images;
-        ++first;
+        auto rec_images = dbn.forward_many(first, chunk_last);
+
+        for (auto& rec_image : rec_images) {
+            rate += etl::mean(abs(*first - rec_image));
+            ++first;
+        }
     }
 
-    return std::abs(rate) / images;
+    return std::abs(rate) / n;
 }
 
 } //end of dll namespace
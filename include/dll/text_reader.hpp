@@ -18,81 +18,219 @@
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
 
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include "cpp_utils/tmp.hpp"
 #include "etl/etl_light.hpp"
 
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 namespace text {
 
-template<typename Container, typename Functor>
-void read_images(Container& images, const std::string& path, size_t limit, Functor func){
-    using Image = typename Container::value_type;
+/*!
+ * \brief The values of one file of a text dataset
+ */
+struct text_file {
+    int id         = 0; ///< The identifier of the file (its name)
+    size_t lines   = 0; ///< The number of lines
+    size_t columns = 0; ///< The number of columns (of the first line)
 
-    struct dirent* entry;
-    auto dir = opendir(path.c_str());
+    std::vector<double> values; ///< The values, in order
+};
 
-    while ((entry = readdir(dir))) {
-        std::string file_name(entry->d_name);
+namespace text_detail {
 
-        if (file_name.size() <= 3 || file_name.find(".dat") != file_name.size() - 4) {
-            continue;
-        }
+constexpr uint32_t cache_magic = 0x444C4C54; ///< The magic number of the cache files
 
-        int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
+/*!
+ * \brief Return the path of the cache of the given folder.
+ *
+ * The cache is stored next to the folder, not inside, in order not to
+ * change the folder.
+ */
+inline std::string cache_path(std::string path) {
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
 
-        if(!limit || id - 1 < (int) limit){
-            std::vector<double> temp;
+    return path + ".dllcache";
+}
 
-            std::string full_path(path + "/" + file_name);
+/*!
+ * \brief Return the modification time of the given folder
+ */
+inline uint64_t folder_time(const std::string& path) {
+    struct stat st;
 
-            std::ifstream file(full_path);
+    if (stat(path.c_str(), &st) < 0) {
+        return 0;
+    }
 
-            size_t lines = 0;
-            size_t columns = 0;
+    return st.st_mtime;
+}
 
-            // There is a bug in G++7.1 that causes this false positive
+/*!
+ * \brief Parse the given file, the values being separated by ';'
+ */
+inline void parse_file(text_file& file, const std::string& full_path) {
+    std::ifstream stream(full_path);
+
+    // There is a bug in G++7.1 that causes this false positive
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream ss(line);
-                std::string value;
-
-                while (std::getline(ss, value, ';')) {
-                    auto v = std::atof(value.c_str());
-                    temp.push_back(v);
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream ss(line);
+        std::string value;
 
-                    if(lines == 0){
-                        ++columns;
-                    }
-                }
+        while (std::getline(ss, value, ';')) {
+            file.values.push_back(std::atof(value.c_str()));
 
-                ++lines;
+            if (file.lines == 0) {
+                ++file.columns;
             }
+        }
+
+        ++file.lines;
+    }
 #pragma GCC diagnostic pop
+}
 
-            if((int) images.size() < id){
-                images.resize(id);
-            }
+/*!
+ * \brief Read the files of the folder from its cache
+ * \return true if the cache was valid and read, false otherwise
+ */
+inline bool read_cache(std::vector<text_file>& files, const std::string& path) {
+    std::ifstream stream(cache_path(path), std::ios::binary);
 
-            images[id - 1] = func(1, lines, columns);
+    uint32_t magic = 0;
+    uint64_t time  = 0;
+    uint64_t n     = 0;
 
-            size_t i = 0;
-            for (auto& value : temp) {
-                images[id - 1][i++] = static_cast<typename Image::value_type>(value);
-            }
+    stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    stream.read(reinterpret_cast<char*>(&time), sizeof(time));
+    stream.read(reinterpret_cast<char*>(&n), sizeof(n));
+
+    if (!stream || magic != cache_magic || time != folder_time(path)) {
+        return false;
+    }
+
+    files.resize(n);
+
+    for (auto& file : files) {
+        int64_t id;
+        uint64_t lines;
+        uint64_t columns;
+        uint64_t count;
+
+        stream.read(reinterpret_cast<char*>(&id), sizeof(id));
+        stream.read(reinterpret_cast<char*>(&lines), sizeof(lines));
+        stream.read(reinterpret_cast<char*>(&columns), sizeof(columns));
+        stream.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+        if (!stream) {
+            files.clear();
+            return false;
         }
+
+        file.id      = id;
+        file.lines   = lines;
+        file.columns = columns;
+        file.values.resize(count);
+
+        stream.read(reinterpret_cast<char*>(file.values.data()), count * sizeof(double));
     }
+
+    if (!stream) {
+        files.clear();
+        return false;
+    }
+
+    return true;
 }
 
-template<template<typename...> class  Container = std::vector, typename Label = uint8_t>
-void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
+/*!
+ * \brief Write the files of the folder to its cache.
+ *
+ * Failing to write the cache is not an error, the folder will simply
+ * be parsed again the next time.
+ */
+inline void write_cache(const std::vector<text_file>& files, const std::string& path) {
+    const auto target = cache_path(path);
+    const auto temp   = target + ".tmp";
+
+    {
+        std::ofstream stream(temp, std::ios::binary);
+
+        const uint32_t magic = cache_magic;
+        const uint64_t time  = folder_time(path);
+        const uint64_t n     = files.size();
+
+        stream.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        stream.write(reinterpret_cast<const char*>(&time), sizeof(time));
+        stream.write(reinterpret_cast<const char*>(&n), sizeof(n));
+
+        for (auto& file : files) {
+            const int64_t id       = file.id;
+            const uint64_t lines   = file.lines;
+            const uint64_t columns = file.columns;
+            const uint64_t count   = file.values.size();
+
+            stream.write(reinterpret_cast<const char*>(&id), sizeof(id));
+            stream.write(reinterpret_cast<const char*>(&lines), sizeof(lines));
+            stream.write(reinterpret_cast<const char*>(&columns), sizeof(columns));
+            stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            stream.write(reinterpret_cast<const char*>(file.values.data()), count * sizeof(double));
+        }
+
+        if (!stream) {
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+
+    std::rename(temp.c_str(), target.c_str());
+}
+
+} //end of namespace text_detail
+
+/*!
+ * \brief Read all the files (<id>.dat) of the given folder.
+ *
+ * The files are parsed in parallel. When the full folder is read, the
+ * result is stored in a binary cache next to the folder, reused as long
+ * as the folder is not modified.
+ *
+ * \param path The folder
+ * \param limit If not zero, only the files with id <= limit are read
+ * \return The files, in the order of the folder
+ */
+inline std::vector<text_file> read_folder(const std::string& path, size_t limit = 0) {
+    std::vector<text_file> files;
+
+    if (text_detail::read_cache(files, path)) {
+        if (limit) {
+            files.erase(std::remove_if(files.begin(), files.end(), [limit](auto& file) { return file.id - 1 >= int(limit); }), files.end());
+        }
+
+        return files;
+    }
+
+    std::vector<std::string> names;
+
     struct dirent* entry;
     auto dir = opendir(path.c_str());
 
+    if (!dir) {
+        return files;
+    }
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -102,16 +240,66 @@ void read_labels(Container<Label>& labels, const std::string& path, size_t limit
 
         int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
 
-        if((int) labels.size() < id){
-            labels.resize(id);
+        if (!limit || id - 1 < (int)limit) {
+            names.push_back(file_name);
+            files.emplace_back();
+            files.back().id = id;
+        }
+    }
+
+    closedir(dir);
+
+    parallel_for_n(files.size(), [&](size_t i) {
+        text_detail::parse_file(files[i], path + "/" + names[i]);
+    });
+
+    if (!limit) {
+        text_detail::write_cache(files, path);
+    }
+
+    return files;
+}
+
+template<typename Container, typename Functor>
+void read_images(Container& images, const std::string& path, size_t limit, Functor func){
+    using Image = typename Container::value_type;
+
+    auto files = read_folder(path, limit);
+
+    int max_id = 0;
+    for (auto& file : files) {
+        max_id = std::max(max_id, file.id);
+    }
+
+    if ((int)images.size() < max_id) {
+        images.resize(max_id);
+    }
+
+    // The images are allocated in order, then filled in parallel
+    for (auto& file : files) {
+        images[file.id - 1] = func(1, file.lines, file.columns);
+    }
+
+    parallel_for_n(files.size(), [&](size_t f) {
+        auto& file  = files[f];
+        auto& image = images[file.id - 1];
+
+        for (size_t i = 0; i < file.values.size(); ++i) {
+            image[i] = static_cast<typename Image::value_type>(file.values[i]);
         }
+    });
+}
 
-        std::string full_path(path + "/" + file_name);
+template<template<typename...> class  Container = std::vector, typename Label = uint8_t>
+void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
+    auto files = read_folder(path, limit);
+
+    for (auto& file : files) {
+        if ((int)labels.size() < file.id) {
+            labels.resize(file.id);
+        }
 
-        std::ifstream file(full_path);
-        int value;
-        file >> value;
-        labels[id - 1] = static_cast<Label>(value);
+        labels[file.id - 1] = static_cast<Label>(int(file.values.empty() ? 0.0 : file.values[0]));
     }
 
     if(limit && labels.size() > limit){
@@ -0,0 +1,240 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Calibration of the runtime batch size of a dynamic network.
+ *
+ * The runtime batch size of the dynamic networks (dyn_batch_size) can be
+ * changed without recompilation. The tuner trains a few batches of the
+ * generator at each candidate batch size, measures the throughput of the
+ * training (samples per second) and the peak memory of the training (from
+ * the memory accounting, see dll/util/memory_usage.hpp), and keeps the
+ * fastest batch size whose peak memory fits in the given cap. The weights
+ * of the network are restored after each candidate, the calibration does
+ * not change the network except for its batch size (and its learning rate
+ * if a scaling rule is given).
+ */
+
+#pragma once
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include "dll/dbn_traits.hpp"
+#include "dll/util/memory_usage.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The scaling of the learning rate with the tuned batch size
+ */
+enum class lr_scaling {
+    NONE,   ///< The learning rate is not changed
+    LINEAR, ///< The learning rate is scaled by the ratio of the batch sizes
+    SQRT    ///< The learning rate is scaled by the square root of the ratio of the batch sizes
+};
+
+/*!
+ * \brief The parameters of the calibration of the batch size
+ */
+struct batch_tuning_params {
+    std::vector<size_t> candidates;           ///< The batch sizes to try (the powers of two up to the batch size of the network if empty)
+    size_t warmup_batches = 2;                ///< The batches of the generator trained before the measure
+    size_t batches        = 8;                ///< The batches of the generator measured at each batch size
+    size_t memory_cap     = 0;                ///< The maximum peak memory of the training, in bytes (0 for no cap)
+    lr_scaling scaling    = lr_scaling::NONE; ///< The scaling of the learning rate
+    bool verbose          = false;            ///< Indicates if the measures are displayed
+};
+
+/*!
+ * \brief The measure of one candidate batch size
+ */
+struct batch_tuning_point {
+    size_t batch_size = 0;     ///< The batch size
+    size_t memory     = 0;     ///< The peak memory of the training, in bytes
+    bool fits         = false; ///< Indicates if the peak memory fits in the cap
+    double throughput = 0.0;   ///< The samples trained per second (0 if not measured)
+};
+
+/*!
+ * \brief The result of the calibration of the batch size
+ */
+struct batch_tuning_result {
+    size_t batch_size = 0;                  ///< The selected batch size (0 if no candidate fits)
+    double throughput = 0.0;                ///< The throughput at the selected batch size
+    std::vector<batch_tuning_point> points; ///< The measure of each candidate
+};
+
+namespace batch_tuner_detail {
+
+/*!
+ * \brief Returns the factor of the learning rate for the batch size b,
+ * the learning rate being set for the batch size reference
+ */
+inline double lr_factor(lr_scaling scaling, size_t b, size_t reference) {
+    const double ratio = double(b) / double(reference);
+
+    switch (scaling) {
+        case lr_scaling::NONE:
+            return 1.0;
+        case lr_scaling::LINEAR:
+            return ratio;
+        case lr_scaling::SQRT:
+            return std::sqrt(ratio);
+    }
+
+    return 1.0;
+}
+
+/*!
+ * \brief Returns the candidates of the calibration
+ */
+inline std::vector<size_t> candidates(const batch_tuning_params& params, size_t max_batch) {
+    std::vector<size_t> sizes;
+
+    if (params.candidates.empty()) {
+        for (size_t b = 1; b <= max_batch; b *= 2) {
+            sizes.push_back(b);
+        }
+
+        if (sizes.back() != max_batch) {
+            sizes.push_back(max_batch);
+        }
+    } else {
+        for (auto b : params.candidates) {
+            if (b > 0 && b <= max_batch) {
+                sizes.push_back(b);
+            }
+        }
+    }
+
+    return sizes;
+}
+
+} //end of namespace batch_tuner_detail
+
+/*!
+ * \brief Select the runtime batch size of the given dynamic network
+ * maximizing the throughput of the training within the memory cap.
+ *
+ * The candidates are at most the batch size of the network: the batches of
+ * the generator are trained by steps of the runtime batch size. The
+ * network is left with the selected batch size and, if a scaling rule is
+ * given, with its learning rate scaled from its previous runtime batch
+ * size to the selected one. When no candidate fits in the cap, the network
+ * is not changed.
+ *
+ * \param dbn The dynamic network
+ * \param generator The generator of the training
+ * \param params The parameters of the calibration
+ * \return The measures and the selected batch size
+ */
+template <typename DBN, typename Generator>
+batch_tuning_result tune_batch_size(DBN& dbn, Generator& generator, const batch_tuning_params& params = batch_tuning_params()) {
+    static_assert(dbn_traits<DBN>::is_dynamic(), "Only the batch size of a dynamic network can be tuned at runtime");
+
+    using trainer_t = typename DBN::desc::template trainer_t<DBN>;
+
+    dll::auto_timer timer("dbn:tune_batch_size");
+
+    cpp_assert(params.batches > 0, "At least one batch must be measured");
+
+    const size_t reference = dbn.runtime_batch_size();
+    const size_t previous  = dbn.dyn_batch_size;
+    const auto momentum    = dbn.momentum;
+
+    // The weights are restored after each candidate
+    std::stringstream weights;
+    dbn.store(weights);
+
+    batch_tuning_result result;
+
+    for (size_t b : batch_tuner_detail::candidates(params, DBN::batch_size)) {
+        batch_tuning_point point;
+
+        dbn.dyn_batch_size = b;
+
+        point.batch_size = b;
+        point.memory     = dbn.memory_usage(generator).peak();
+        point.fits       = !params.memory_cap || point.memory <= params.memory_cap;
+
+        if (point.fits) {
+            dbn.momentum = dbn.initial_momentum;
+
+            trainer_t trainer(dbn);
+            trainer.init_training(DBN::batch_size);
+
+            generator.reset();
+            generator.set_train();
+
+            size_t samples = 0;
+            auto start     = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < params.warmup_batches + params.batches; ++i) {
+                if (!generator.has_next_batch()) {
+                    generator.reset();
+                }
+
+                if (i == params.warmup_batches) {
+                    start = std::chrono::steady_clock::now();
+                }
+
+                trainer.train_batch(0, generator.data_batch(), generator.label_batch(), false);
+
+                if (i >= params.warmup_batches) {
+                    samples += etl::dim<0>(generator.data_batch());
+                }
+
+                generator.next_batch();
+            }
+
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            point.throughput = seconds > 0.0 ? samples / seconds : 0.0;
+
+            weights.clear();
+            weights.seekg(0);
+            dbn.load(weights);
+
+            if (point.throughput > result.throughput) {
+                result.batch_size = b;
+                result.throughput = point.throughput;
+            }
+        }
+
+        if (params.verbose) {
+            std::cout << "Batch size " << b << ": " << point.memory << " bytes";
+
+            if (point.fits) {
+                std::cout << ", " << point.throughput << " samples/s" << std::endl;
+            } else {
+                std::cout << ", over the memory cap" << std::endl;
+            }
+        }
+
+        result.points.push_back(point);
+    }
+
+    generator.reset();
+
+    dbn.momentum = momentum;
+
+    if (result.batch_size) {
+        dbn.dyn_batch_size = result.batch_size;
+        dbn.learning_rate *= batch_tuner_detail::lr_factor(params.scaling, result.batch_size, reference);
+    } else {
+        dbn.dyn_batch_size = previous;
+    }
+
+    return result;
+}
+
+} //end of dll namespace
@@ -0,0 +1,216 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Helpers for the gradient checkpointing of the SGD trainer.
+ *
+ * With gradient checkpointing, the activations (inputs and outputs) of the
+ * contexts of the layers are released as soon as they have been used by
+ * the forward pass. They are recomputed, one segment of layers at a time,
+ * from the input of the first layer of the segment (the checkpoint), just
+ * before the segment is backpropagated, and released again once the
+ * gradients of its layers have been computed.
+ *
+ * Only the dynamic buffers of the contexts take memory that can be
+ * released, the buffers of the fixed-size contexts are not affected.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace dll {
+
+namespace checkpointing_detail {
+
+constexpr size_t max_rank = 8; ///< The maximum number of dimensions of a released buffer
+
+using shape_t = std::array<size_t, max_rank>; ///< The shape of a released buffer
+
+/*!
+ * \brief Traits to test if a buffer of a context can be released
+ */
+template <typename M>
+struct is_releasable : std::false_type {};
+
+/*!
+ * \copydoc is_releasable
+ */
+template <typename T, size_t D>
+struct is_releasable<etl::dyn_matrix<T, D>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if the activations of a layer can be recomputed.
+ *
+ * The layers with a training state depending on the samples (dropout,
+ * batch normalization, ...) are not recomputed, they would not give the
+ * same activations twice.
+ */
+template <typename Layer>
+constexpr bool is_recomputable = decay_layer_traits<Layer>::is_standard_layer() || decay_layer_traits<Layer>::is_pooling_layer();
+
+/*!
+ * \brief Returns the number of bytes of the buffer that can be released
+ */
+template <typename M, cpp_enable_iff(is_releasable<M>::value)>
+size_t releasable_bytes(const M& m) {
+    return etl::size(m) * sizeof(etl::value_t<M>);
+}
+
+/*!
+ * \copydoc releasable_bytes
+ */
+template <typename M, cpp_disable_if(is_releasable<M>::value)>
+size_t releasable_bytes(const M& m) {
+    cpp_unused(m);
+
+    return 0;
+}
+
+/*!
+ * \brief Returns the shape of the buffer, to be restored after its release
+ */
+template <typename M, cpp_enable_iff(is_releasable<M>::value)>
+shape_t shape(const M& m) {
+    static_assert(etl::dimensions<M>() <= max_rank, "Too many dimensions for a released buffer");
+
+    shape_t s{};
+
+    for (size_t d = 0; d < etl::dimensions<M>(); ++d) {
+        s[d] = etl::dim(m, d);
+    }
+
+    return s;
+}
+
+/*!
+ * \copydoc shape
+ */
+template <typename M, cpp_disable_if(is_releasable<M>::value)>
+shape_t shape(const M& m) {
+    cpp_unused(m);
+
+    return shape_t{};
+}
+
+/*!
+ * \brief Release the memory of the buffer
+ */
+template <typename M, cpp_enable_iff(is_releasable<M>::value)>
+void release(M& m) {
+    m = M();
+}
+
+/*!
+ * \copydoc release
+ */
+template <typename M, cpp_disable_if(is_releasable<M>::value)>
+void release(M& m) {
+    cpp_unused(m);
+}
+
+/*!
+ * \brief Allocate the buffer with the given shape
+ */
+template <typename M, size_t... I>
+void allocate(M& m, const shape_t& s, std::index_sequence<I...> /*seq*/) {
+    m = M(s[I]...);
+}
+
+/*!
+ * \brief Allocate the buffer again with its shape, if it has been released
+ */
+template <typename M, cpp_enable_iff(is_releasable<M>::value)>
+void restore(M& m, const shape_t& s) {
+    if (!etl::size(m)) {
+        allocate(m, s, std::make_index_sequence<etl::dimensions<M>()>());
+    }
+}
+
+/*!
+ * \copydoc restore
+ */
+template <typename M, cpp_disable_if(is_releasable<M>::value)>
+void restore(M& m, const shape_t& s) {
+    cpp_unused(m);
+    cpp_unused(s);
+}
+
+/*!
+ * \brief Choose the segments of the recomputed layers.
+ *
+ * The consecutive recomputable layers are split in segments of about
+ * sqrt(M * m) bytes, with M the bytes of their activations and m the
+ * average bytes of one layer. With k segments, the memory is about
+ * k * m (the checkpoints) + M / k (one recomputed segment), which is
+ * minimal for this size and, since every recomputed layer is forwarded
+ * exactly twice, so is the product of the memory and the time. A run of
+ * layers fitting in a single segment is not recomputed, it would not save
+ * any memory.
+ *
+ * \param bytes The bytes of the activations of each layer, zero for the
+ * layers that are not recomputed
+ * \return the first layer of the segment of each layer, or the number of
+ * layers for the layers that are not recomputed
+ */
+inline std::vector<size_t> choose_segments(const std::vector<size_t>& bytes) {
+    const size_t L = bytes.size();
+
+    std::vector<size_t> segments(L, L);
+
+    size_t first = 0;
+
+    while (first < L) {
+        if (!bytes[first]) {
+            ++first;
+            continue;
+        }
+
+        // The run of consecutive recomputable layers
+        size_t last  = first;
+        double total = 0.0;
+
+        while (last < L && bytes[last]) {
+            total += bytes[last++];
+        }
+
+        const double budget = std::sqrt(total * (total / (last - first)));
+
+        double size = 0.0;
+        size_t start = first;
+        size_t count = 0;
+
+        for (size_t l = first; l < last; ++l) {
+            if (l > start && size + bytes[l] > budget) {
+                start = l;
+                size  = 0.0;
+            }
+
+            if (start == l) {
+                ++count;
+            }
+
+            segments[l] = start;
+            size += bytes[l];
+        }
+
+        if (count < 2) {
+            std::fill(segments.begin() + first, segments.begin() + last, L);
+        }
+
+        first = last;
+    }
+
+    return segments;
+}
+
+} //end of namespace checkpointing_detail
+
+} //end of dll namespace
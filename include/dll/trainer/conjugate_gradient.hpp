@@ -17,8 +17,11 @@
 #pragma once
 
 #include <utility>
+#include <numeric>
 
 #include "dll/util/batch.hpp"
+#include "dll/util/affinity.hpp"
+#include "dll/util/scheduler.hpp"
 
 namespace dll {
 
@@ -50,7 +53,13 @@ struct cg_trainer_base {
 
     dbn_t& dbn; ///< The DBN being trained
 
-    explicit cg_trainer_base(dbn_t& dbn) : dbn(dbn) {
+    size_t horizon = 0; ///< The total number of iterations of the training (no schedule of the learning rate)
+
+    cpp::thread_pool<!dbn_traits<dbn_t>::is_serial()> pool; ///< The thread pool for the gradient evaluation
+
+    etl::dyn_matrix<weight, 2> gr_inputs; ///< The inputs of the batch, one sample per row
+
+    explicit cg_trainer_base(dbn_t& dbn) : dbn(dbn), pool(concurrency()) {
         dbn.for_each_layer([](auto& r1) {
             r1.init_cg_context();
 
@@ -67,31 +76,73 @@ struct cg_trainer_base {
      * \param batch_size The batch size of the network
      */
     void init_training(size_t batch_size) {
-        dbn.for_each_layer([batch_size](auto& rbm) {
+        init_buffers(batch_size);
+    }
+
+    /*!
+     * \brief Allocate the batch buffers of the layers for the given
+     * number of samples.
+     *
+     * The buffers are kept from one batch to the next, they are only
+     * reallocated when the number of samples changes.
+     *
+     * \param n_samples The number of samples of the batch
+     */
+    void init_buffers(size_t n_samples) {
+        const auto n_visible = num_visible(dbn.template layer_get<0>());
+
+        if (etl::dim<0>(gr_inputs) == n_samples && etl::dim<1>(gr_inputs) == n_visible) {
+            return;
+        }
+
+        gr_inputs = etl::dyn_matrix<weight, 2>(n_samples, n_visible);
+
+        dbn.for_each_layer([n_samples](auto& rbm) {
             auto& ctx = rbm.get_cg_context();
 
             if (ctx.is_trained) {
+                using matrix_t = std::decay_t<decltype(ctx.gr_probs_a)>;
+
                 const auto n_hidden = num_hidden(rbm);
 
-                for (size_t i = 0; i < batch_size; ++i) {
-                    ctx.gr_probs_a.emplace_back(n_hidden);
-                    ctx.gr_probs_s.emplace_back(n_hidden);
-                }
+                ctx.gr_probs_a = matrix_t(n_samples, n_hidden);
+                ctx.gr_probs_s = matrix_t(n_samples, n_hidden);
+                ctx.gr_diffs   = matrix_t(n_samples, n_hidden);
             }
         });
     }
 
+    /*!
+     * \brief Write the state of the training to the given stream (the
+     * conjugate gradient has no state between the batches)
+     */
+    void store_state(std::ostream& os) {
+        cpp_unused(os);
+    }
+
+    /*!
+     * \brief Read the state of the training from the given stream
+     * \return always true, there is no state
+     */
+    bool load_state(std::istream& is) {
+        cpp_unused(is);
+        return true;
+    }
+
     /*!
      * \brief Train a batch of inputs
      *
      * \param epoch The current epoch
      * \param inputs The batch of inputs
      * \param labels The batch of labels
+     * \param metrics Indicates if the error and the loss of the batch are computed
      *
      * \return the error and the loss of the batch
      */
     template <typename Inputs, typename Labels>
-    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics = true) {
+        cpp_unused(metrics);
+
         using T = etl::dyn_matrix<etl::value_t<Inputs>, etl::decay_traits<Inputs>::dimensions() - 1>;
         using L = etl::dyn_matrix<etl::value_t<Labels>, etl::decay_traits<Labels>::dimensions() - 1>;
 
@@ -116,59 +167,29 @@ struct cg_trainer_base {
 
     /* Gradient */
 
-    template <bool Temp, typename R1, typename R2, typename C1, typename C2, typename D>
-    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2, std::vector<D>& diffs, size_t n_samples) {
-        auto n_visible = num_visible(r2);
-        auto n_hidden  = num_hidden(r2);
-
-        for (size_t sample = 0; sample < n_samples; ++sample) {
-            D diff(n_visible);
-
-            for (size_t i = 0; i < n_visible; ++i) {
-                double s = 0.0;
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    s += diffs[sample][j] * (Temp ? c2.gr_w_tmp(i, j) : r2.w(i, j));
-                }
-
-                if (R1::hidden_unit != unit_type::RELU) {
-                    s *= c1.gr_probs_a[sample][i] * (1.0 - c1.gr_probs_a[sample][i]);
-                }
-
-                diff[i] = s;
-            }
+    /*!
+     * \brief Backpropagate the errors of the batch from the layer r2 to
+     * the layer r1
+     */
+    template <bool Temp, typename R1, typename R2, typename C1, typename C2>
+    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2) {
+        c1.gr_diffs = c2.gr_diffs * etl::transpose(Temp ? c2.gr_w_tmp : r2.w);
 
-            diffs[sample].swap(diff);
+        if (R1::hidden_unit != unit_type::RELU) {
+            c1.gr_diffs = c1.gr_diffs >> c1.gr_probs_a >> (1.0 - c1.gr_probs_a);
         }
     }
 
+    /*!
+     * \brief Compute the gradients of a layer from the errors of its
+     * output and from its input, for the complete batch
+     */
     template <bool Temp, typename R, typename D, typename V>
-    static void update_incs(R& r, std::vector<D>& diffs, const V& visibles) {
+    static void update_incs(R& r, const D& diffs, const V& visibles) {
         auto& ctx = r.get_cg_context();
 
-        auto n_visible = num_visible(r);
-        auto n_hidden  = num_hidden(r);
-
-        auto it            = visibles.begin();
-        auto end           = visibles.end();
-        size_t sample = 0;
-
-        while (it != end) {
-            auto& v = *it;
-            auto& d = diffs[sample];
-
-            for (size_t i = 0; i < n_visible; ++i) {
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    ctx.gr_w_incs(i, j) += v[i] * d[j];
-                }
-            }
-
-            for (size_t j = 0; j < n_hidden; ++j) {
-                ctx.gr_b_incs(j) += d[j];
-            }
-
-            ++it;
-            ++sample;
-        }
+        ctx.gr_w_incs = etl::transpose(visibles) * diffs;
+        ctx.gr_b_incs = etl::bias_batch_sum_2d(diffs);
     }
 
     /*!
@@ -178,102 +199,93 @@ struct cg_trainer_base {
      */
     template <bool Temp, typename Sample, typename Target>
     void gradient(const gradient_context<Sample, Target>& context, weight& cost) {
-        const auto n_hidden = output_size(dbn.template layer_get<layers - 1>());
-        auto n_samples      = context.inputs.size();
+        const auto n_hidden  = output_size(dbn.template layer_get<layers - 1>());
+        const auto n_samples = context.inputs.size();
 
-        static std::vector<std::vector<weight>> diffs;
-        diffs.resize(n_samples);
+        cpp_assert(etl::dim<0>(gr_inputs) == n_samples, "The batch buffers must be initialized for the batch");
 
-        dbn.for_each_layer([](auto& rbm) {
-            rbm.get_cg_context().gr_w_incs = 0.0;
-            rbm.get_cg_context().gr_b_incs = 0.0;
-        });
+        // The batch is forward propagated layer by layer, each layer being
+        // computed as a single product
 
-        cost         = 0.0;
-        weight error = 0.0;
+        // Note: The samples are not needed, which also keeps this free of
+        // any random state
+        const etl::dyn_matrix<weight, 2>* input = &gr_inputs;
 
-        auto it  = context.inputs.begin();
-        auto end = context.inputs.end();
-        auto tit = context.targets.begin();
+        dbn.for_each_layer([&input](auto& rbm) {
+            auto& ctx = rbm.get_cg_context();
 
-        size_t sample = 0;
+            rbm.template batch_activate_hidden<true, false>(ctx.gr_probs_a, ctx.gr_probs_s, *input, *input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
 
-        while (it != end) {
-            auto& input  = *it;
-            auto output  = std::ref(dbn.template layer_get<0>().get_cg_context().gr_probs_a[sample]);
-            auto& target = *tit;
+            input = &ctx.gr_probs_a;
+        });
 
-            dbn.for_each_layer_i([&input, &output, sample](size_t I, auto& rbm) {
-                auto& ctx        = rbm.get_cg_context();
-                auto& output_ref = static_cast<etl::dyn_vector<weight>&>(output);
+        auto& last_ctx = dbn.template layer_get<layers - 1>().get_cg_context();
 
-                if (I == 0) {
-                    rbm.activate_hidden(output_ref, ctx.gr_probs_s[sample], input, input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                } else {
-                    rbm.activate_hidden(ctx.gr_probs_a[sample], ctx.gr_probs_s[sample], output_ref, output_ref, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                    output = std::ref(ctx.gr_probs_a[sample]);
-                }
-            });
+        auto& result = last_ctx.gr_probs_a;
+        auto& diffs  = last_ctx.gr_diffs;
 
-            auto& diff = diffs[sample];
-            diff.resize(n_hidden);
+        // The outputs are normalized in parallel, each part of the batch
+        // accumulating its own cost and error
 
-            auto& result = dbn.template layer_get<layers - 1>().get_cg_context().gr_probs_a[sample];
-            weight scale = std::accumulate(result.begin(), result.end(), 0.0);
+        const size_t parts = std::max<size_t>(1, std::min<size_t>(n_samples, concurrency()));
 
-            for (auto& r : result) {
-                r *= (1.0 / scale);
-            }
+        std::vector<weight> costs(parts, 0.0);
+        std::vector<weight> errors(parts, 0.0);
 
-            for (size_t i = 0; i < n_hidden; ++i) {
-                diff[i] = result[i] - target[i];
-                cost += target[i] * log(result[i]);
-                error += diff[i] * diff[i];
-            }
+        cpp::maybe_parallel_foreach_n(pool, 0, parts, [&](size_t t) {
+            pin_pool_thread();
 
-            ++it;
-            ++tit;
-            ++sample;
-        }
+            const size_t first = (t * n_samples) / parts;
+            const size_t last  = ((t + 1) * n_samples) / parts;
 
-        cost = -cost;
+            auto tit = std::next(context.targets.begin(), first);
 
-        //Get pointers to the different gr_probs
-        std::array<std::vector<etl::dyn_vector<weight>>*, layers> probs_refs;
-        dbn.for_each_layer_i([&probs_refs](size_t I, auto& rbm) {
-            probs_refs[I] = &rbm.get_cg_context().gr_probs_a;
-        });
+            for (size_t sample = first; sample < last; ++sample) {
+                const auto& target = *tit;
 
-        update_incs<Temp>(dbn.template layer_get<layers - 1>(), diffs, dbn.template layer_get<layers - 2>().get_cg_context().gr_probs_a);
+                weight scale = 0.0;
 
-#ifdef __clang__
-        dbn.for_each_layer_rpair_i([n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
-            auto& c1 = r1.get_cg_context();
-            auto& c2 = r2.get_cg_context();
+                for (size_t i = 0; i < n_hidden; ++i) {
+                    scale += result(sample, i);
+                }
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs, n_samples);
+                for (size_t i = 0; i < n_hidden; ++i) {
+                    result(sample, i) *= (1.0 / scale);
 
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs, *probs_refs[I - 1]);
+                    diffs(sample, i) = result(sample, i) - target[i];
+                    costs[t] += target[i] * log(result(sample, i));
+                    errors[t] += diffs(sample, i) * diffs(sample, i);
+                }
+
+                ++tit;
             }
         });
 
-#else
-        std::vector<std::vector<weight>>& diffs_p = diffs;
+        cost         = -std::accumulate(costs.begin(), costs.end(), weight(0.0));
+        weight error = std::accumulate(errors.begin(), errors.end(), weight(0.0));
+
+        // The gradients are computed for the complete batch at once
 
-        dbn.for_each_layer_rpair_i([&diffs_p, n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
+        //Get pointers to the different gr_probs
+        std::array<const etl::dyn_matrix<weight, 2>*, layers> probs_refs;
+        dbn.for_each_layer_i([&probs_refs](size_t I, auto& rbm) {
+            probs_refs[I] = &rbm.get_cg_context().gr_probs_a;
+        });
+
+        update_incs<Temp>(dbn.template layer_get<layers - 1>(), diffs, *probs_refs[layers - 2]);
+
+        dbn.for_each_layer_rpair_i([&probs_refs](size_t I, auto& r1, auto& r2) {
             auto& c1 = r1.get_cg_context();
             auto& c2 = r2.get_cg_context();
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs_p, n_samples);
+            this_type::update_diffs<Temp>(r1, r2, c1, c2);
 
             if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs_p, *probs_refs[I - 1]);
+                this_type::update_incs<Temp>(r1, c1.gr_diffs, *probs_refs[I - 1]);
             }
         });
-#endif
 
-        update_incs<Temp>(dbn.template layer_get<0>(), diffs, context.inputs);
+        update_incs<Temp>(dbn.template layer_get<0>(), dbn.template layer_get<0>().get_cg_context().gr_diffs, gr_inputs);
 
         if (Debug) {
             std::cout << "evaluating(" << Temp << "): cost:" << cost << " error: " << (error / n_samples) << std::endl;
@@ -401,6 +413,16 @@ struct cg_trainer_base {
         //Maximum number of try
         auto max_iteration = context.max_iterations;
 
+        // The inputs are copied once in the batch buffer, for all the
+        // evaluations of the gradient
+        init_buffers(context.inputs.size());
+
+        size_t sample = 0;
+
+        for (auto& input : context.inputs) {
+            gr_inputs(sample++) = etl::reshape(input, etl::dim<1>(gr_inputs));
+        }
+
         weight cost = 0.0;
         gradient<false>(context, cost);
 
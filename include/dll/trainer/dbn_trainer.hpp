@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <future>
+#include <limits>
+#include <sstream>
+
 #include "cpp_utils/algorithm.hpp" // For parallel_shuffle
+#include "cpp_utils/io.hpp"        // For the state of the checkpoints
 
 #include "etl/etl.hpp"
 
@@ -15,8 +20,12 @@
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/distributed.hpp" // For multi-node training
 #include "dll/test.hpp"
 #include "dll/dbn_traits.hpp"
+#include "dll/watcher.hpp" // For notify_watcher_samples
+#include "dll/generators/batch_prefetcher.hpp" // For the prefetching of the batches
+#include "dll/checkpoint.hpp" // For the checkpoints of the fine-tuning
 
 namespace dll {
 
@@ -32,6 +41,8 @@ struct dbn_trainer {
     using weight     = typename dbn_t::weight; ///< The data type for this layer
     using error_type = typename dbn_t::weight; ///< The error type
 
+    static_assert(!dbn_traits<dbn_t>::inference_only(), "An inference_only network cannot be trained");
+
     /*!
      * \brief The trainer for the given RBM
      */
@@ -47,7 +58,7 @@ struct dbn_trainer {
     //Initialize the watcher
     watcher_t<dbn_t> watcher; ///< The watcher for the DBN
 
-    std::unique_ptr<trainer_t<dbn_t>> trainer; ///< The concrete trainer
+    std::shared_ptr<trainer_t<dbn_t>> trainer; ///< The concrete trainer (shared with the network when it is kept between the trainings)
 
     error_type current_error = 0.0; ///< The current training error
     error_type current_loss  = 0.0; ///< The current training loss
@@ -60,6 +71,13 @@ struct dbn_trainer {
     size_t best_epoch     = 0;   ///< The best epoch
     size_t patience       = 0;   ///< The current patience
 
+    bool adaptive_validation = false;                     ///< Indicates if the early stopping decisions use the validation subsample
+    std::pair<double, double> subsample_stats;           ///< The statistics of the validation subsample at the current epoch
+    double best_subsample = std::numeric_limits<double>::max(); ///< The best metric of the validation subsample
+
+    std::unique_ptr<dbn_t> snapshot;                         ///< The snapshot of the weights for asynchronous validation
+    std::future<std::pair<double, double>> pending_validation; ///< The asynchronous validation in progress
+
     /*!
      * \brief Initialize the training
      * \param dbn The network to train
@@ -72,13 +90,23 @@ struct dbn_trainer {
         //Initialize the momentum
         dbn.momentum = dbn.initial_momentum;
 
-        watcher.fine_tuning_begin(dbn, max_epochs);
+        // In distributed mode, only rank 0 reports the progress
+        if (distributed::is_root()) {
+            watcher.fine_tuning_begin(dbn, max_epochs);
+        }
 
-        trainer = std::make_unique<trainer_t<dbn_t>>(dbn);
+        trainer = acquire_trainer(dbn, 0);
 
         //Initialize the trainer if necessary
         trainer->init_training(batch_size);
 
+        // Continue the training from the state of the checkpoint
+        resume_state(dbn);
+
+        // The subsample of the validation restarts with the training
+        adaptive_validation = false;
+        best_subsample      = std::numeric_limits<double>::max();
+
         // Set the initial error and loss
         current_error = 0.0;
         current_loss = 0.0;
@@ -87,6 +115,42 @@ struct dbn_trainer {
         current_val_loss = 0.0;
     }
 
+    /*!
+     * \brief Return the trainer kept by the network from its previous
+     * training, reset for a new training, or a new trainer, kept by the
+     * network, if there is none or if it cannot be reused.
+     *
+     * The contexts of the layers are therefore only allocated by the first
+     * training of the network, until release_training_memory() is called.
+     */
+    template <typename T = trainer_t<dbn_t>>
+    auto acquire_trainer(dbn_t& dbn, int) -> decltype(std::declval<T&>().reset_training(), std::shared_ptr<T>()) {
+        auto kept = std::static_pointer_cast<T>(dbn.training_state);
+
+        if (kept && kept->reusable()) {
+            kept->reset_training();
+            return kept;
+        }
+
+        // The previous contexts are released before the new ones are allocated
+        dbn.training_state.reset();
+        kept.reset();
+
+        auto created = std::make_shared<T>(dbn);
+
+        dbn.training_state = created;
+
+        return created;
+    }
+
+    /*!
+     * \brief Return a new trainer, for the trainers that cannot be reset
+     */
+    template <typename T = trainer_t<dbn_t>>
+    std::shared_ptr<T> acquire_trainer(dbn_t& dbn, long) {
+        return std::make_shared<T>(dbn);
+    }
+
     /*!
      * \brief Finalize the training
      *
@@ -105,29 +169,147 @@ struct dbn_trainer {
 
             if /*constexpr*/ (s != strategy::NONE) {
                 if(best_epoch < max_epochs - 1){
-                    dbn.restore_weights();
+                    restore_best_weights(dbn);
 
-                    if (is_error(s)) {
-                        std::cout << "Restore the best (error) weights from epoch " << best_epoch << std::endl;
-                    } else {
-                        std::cout << "Restore the best (loss) weights from epoch " << best_epoch << std::endl;
+                    if (distributed::is_root()) {
+                        if (is_error(s)) {
+                            std::cout << "Restore the best (error) weights from epoch " << best_epoch << std::endl;
+                        } else {
+                            std::cout << "Restore the best (loss) weights from epoch " << best_epoch << std::endl;
+                        }
                     }
                 }
             }
         }
 
-        watcher.fine_tuning_end(dbn);
+        snapshot.reset();
+
+        // The last checkpoint must be complete when the training returns
+        if (dbn.checkpoints) {
+            dbn.checkpoints->wait();
+        }
+
+        if (distributed::is_root()) {
+            watcher.fine_tuning_end(dbn);
+        }
 
         return current_error;
     }
 
+    /*!
+     * \brief Copy the weights of a network into another network of the
+     * same type.
+     *
+     * \param from The network to copy the weights from
+     * \param to The network to copy the weights to
+     *
+     * \return true if all the weights were copied, false otherwise
+     */
+    static bool copy_weights(const dbn_t& from, dbn_t& to){
+        std::stringstream buffer;
+
+        from.store(buffer);
+        to.load(buffer);
+
+        // Layers initialized at runtime (init_layer) are not recreated in the copy
+        return buffer && buffer.peek() == std::stringstream::traits_type::eof();
+    }
+
+    /*!
+     * \brief Indicates if the best weights are saved in the snapshot
+     * rather than in the network.
+     *
+     * This is the case when early stopping uses the lagged statistics of
+     * the asynchronous validation.
+     */
+    bool snapshot_early() const {
+        return snapshot && !dbn_traits<dbn_t>::early_uses_training();
+    }
+
+    /*!
+     * \brief Save the weights that gave the current statistics as the best
+     * weights.
+     * \param dbn The network being trained
+     */
+    void backup_best_weights(dbn_t& dbn){
+        if(snapshot_early()){
+            // The weights of the snapshot are copied from the network before
+            // the next validation, they do not need to be kept
+            snapshot->swap_backup_weights();
+        } else {
+            dbn.backup_weights();
+        }
+    }
+
+    /*!
+     * \brief Restore the best weights into the network
+     * \param dbn The network being trained
+     */
+    void restore_best_weights(dbn_t& dbn){
+        if(snapshot_early()){
+            snapshot->restore_weights();
+            copy_weights(*snapshot, dbn);
+        } else {
+            dbn.restore_weights();
+        }
+    }
+
+    /*!
+     * \brief Take a snapshot of the weights and start evaluating it on the
+     * validation set.
+     *
+     * \param dbn The network being trained
+     * \param val_generator The generator for the validation data
+     */
+    template <typename ValGenerator>
+    void start_validation(dbn_t& dbn, ValGenerator& val_generator){
+        copy_weights(dbn, *snapshot);
+
+        pending_validation = std::async(std::launch::async, [this, &val_generator]() {
+            dll::auto_timer timer("dbn::trainer::train::epoch::async_validation");
+
+            double error;
+            double loss;
+            std::tie(error, loss) = snapshot->evaluate_metrics(val_generator);
+
+            return std::make_pair(error, loss);
+        });
+    }
+
+    /*!
+     * \brief Prepare the asynchronous validation and start evaluating the
+     * initial weights.
+     *
+     * \param dbn The network being trained
+     * \param val_generator The generator for the validation data
+     *
+     * \return true if the validation is asynchronous, false if it falls back
+     * to synchronous validation
+     */
+    template <typename ValGenerator>
+    bool start_async_validation(dbn_t& dbn, ValGenerator& val_generator){
+        snapshot = std::make_unique<dbn_t>();
+
+        if(!copy_weights(dbn, *snapshot)){
+            std::cerr << "ERROR: The network cannot be copied for asynchronous validation, validating synchronously" << std::endl;
+            snapshot.reset();
+            return false;
+        }
+
+        start_validation(dbn, val_generator);
+
+        return true;
+    }
+
     /*!
      * \brief Start a new epoch
      * \param dbn The network that is trained
      * \param epoch The current epoch
      */
     void start_epoch(dbn_t& dbn, size_t epoch){
-        watcher.ft_epoch_start(epoch, dbn);
+        if (distributed::is_root()) {
+            watcher.ft_epoch_start(epoch, dbn);
+        }
     }
 
     /*!
@@ -157,14 +339,14 @@ struct dbn_trainer {
                     best_error = error;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best_weights(dbn);
                 }
             } else {
                 if(!epoch || loss < best_loss){
                     best_loss = loss;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best_weights(dbn);
                 }
             }
         }
@@ -178,7 +360,7 @@ struct dbn_trainer {
                     std::cout << "Stopping: Loss below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best_weights(dbn);
 
                         std::cout << ", restore weights from epoch " << best_epoch;
                     }
@@ -194,7 +376,7 @@ struct dbn_trainer {
                     std::cout << "Stopping: Error below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best_weights(dbn);
 
                         std::cout << ", restore weights from epoch " << best_epoch;
                     }
@@ -213,7 +395,7 @@ struct dbn_trainer {
                         std::cout << "Stopping: Loss has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             std::cout << ", restore weights from epoch " << best_epoch;
                         }
@@ -235,7 +417,7 @@ struct dbn_trainer {
                         std::cout << "Stopping: Error has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             std::cout << ", restore weights from epoch " << best_epoch;
                         }
@@ -257,7 +439,7 @@ struct dbn_trainer {
                         std::cout << "Stopping: Loss has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             std::cout << ", restore weights from epoch " << best_epoch;
                         }
@@ -279,7 +461,7 @@ struct dbn_trainer {
                         std::cout << "Stopping: Error has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             std::cout << ", restore weights from epoch " << best_epoch;
                         }
@@ -312,7 +494,9 @@ struct dbn_trainer {
             dbn.momentum = dbn.final_momentum;
         }
 
-        watcher.ft_epoch_end(epoch, error, loss, dbn);
+        if (distributed::is_root()) {
+            watcher.ft_epoch_end(epoch, error, loss, dbn);
+        }
 
         // Early stopping with training error/loss
         auto stop =  early_stop(dbn, epoch, error, loss, current_error, current_loss);
@@ -340,7 +524,9 @@ struct dbn_trainer {
             dbn.momentum = dbn.final_momentum;
         }
 
-        watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
+        if (distributed::is_root()) {
+            watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
+        }
 
         // Early stopping with validation (or training) error/loss
 
@@ -348,15 +534,18 @@ struct dbn_trainer {
         if (dbn_traits<dbn_t>::early_uses_training()) {
             stop = early_stop(dbn, epoch, train_stats.first, train_stats.second, current_error, current_loss);
         } else {
-            stop = early_stop(dbn, epoch, val_stats.first, val_stats.second, current_val_error, current_val_loss);
+            // With a validation subsample, the decisions are taken on the subsample
+            const auto& decision_stats = adaptive_validation ? subsample_stats : val_stats;
+
+            stop = early_stop(dbn, epoch, decision_stats.first, decision_stats.second, current_val_error, current_val_loss);
         }
 
         // Save current error and loss for training and validation
         current_error = train_stats.first;
         current_loss  = train_stats.second;
 
-        current_val_error = val_stats.first;
-        current_val_loss  = val_stats.second;
+        current_val_error = adaptive_validation ? subsample_stats.first : val_stats.first;
+        current_val_loss  = adaptive_validation ? subsample_stats.second : val_stats.second;
 
         return stop;
     }
@@ -365,10 +554,13 @@ struct dbn_trainer {
      * \brief Compute error and loss on the given generator with the given network.
      * \param dbn The network to be used
      * \param generator The generator to get data from
+     * \param limit The number of samples to evaluate, from the first (0 for all the samples)
      * \return a pair containing (error, loss)
+     *
+     * \tparam S The layer the inputs of the generator are given to
      */
-    template<typename Generator>
-    std::pair<double, double> compute_error_loss(dbn_t& dbn, Generator& generator){
+    template<size_t S = 0, typename Generator>
+    std::pair<double, double> compute_error_loss(dbn_t& dbn, Generator& generator, size_t limit = 0){
         // Compute the error and loss at this epoch
         double new_error =  1.0;
         double new_loss  = -1.0;
@@ -377,45 +569,205 @@ struct dbn_trainer {
             dll::auto_timer timer("dbn::trainer::train::epoch::error");
 
             auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
-                return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
+                return this->template forward_batch<S>(dbn, input_batch);
             };
 
-            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+            // The trainer buffers cannot be shared between threads
+            if /*constexpr*/ (dbn_traits<dbn_t>::parallel_evaluation()) {
+                std::tie(new_error, new_loss) = evaluate_parallel<S>(dbn, generator, forward_helper, limit);
+            } else {
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper, limit);
+            }
+
+            const size_t n = limit ? std::min(limit, generator.size()) : generator.size();
+
+            // In distributed mode, each rank evaluated its own shard
+            new_error = distributed::weighted_average(new_error, n);
+            new_loss  = distributed::weighted_average(new_loss, n);
         }
 
         return std::make_pair(new_error, new_loss);
     }
 
+    /*!
+     * \brief Forward a batch of inputs given to the layer S with the trainer
+     */
+    template <size_t S, typename Inputs, cpp_enable_iff(S == 0)>
+    decltype(auto) forward_batch(dbn_t& dbn, Inputs&& inputs) {
+        return trainer->template forward_batch_helper<false>(dbn, inputs);
+    }
+
+    /*!
+     * \copydoc forward_batch
+     */
+    template <size_t S, typename Inputs, cpp_enable_iff(S > 0)>
+    decltype(auto) forward_batch(dbn_t& dbn, Inputs&& inputs) {
+        return trainer->template forward_batch_helper<false, S>(dbn, inputs);
+    }
+
+    /*!
+     * \brief Compute the error and the loss on the generator in parallel
+     */
+    template <size_t S, typename Generator, typename Forward, cpp_enable_iff(S == 0)>
+    std::pair<double, double> evaluate_parallel(dbn_t& dbn, Generator& generator, Forward& forward_helper, size_t limit) {
+        cpp_unused(forward_helper);
+
+        return dbn.evaluate_metrics_parallel(generator, limit);
+    }
+
+    /*!
+     * \brief Compute the error and the loss on the generator of the inputs
+     * of the layer S, only forwarded by the trainer
+     */
+    template <size_t S, typename Generator, typename Forward, cpp_enable_iff(S > 0)>
+    std::pair<double, double> evaluate_parallel(dbn_t& dbn, Generator& generator, Forward& forward_helper, size_t limit) {
+        return dbn.evaluate_metrics(generator, forward_helper, limit);
+    }
+
+    /*!
+     * \brief Train the trainer on a batch of inputs given to the layer S
+     */
+    template <size_t S, typename Inputs, typename Labels, cpp_enable_iff(S == 0)>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics) {
+        return trainer->train_batch(epoch, inputs, labels, metrics);
+    }
+
+    /*!
+     * \copydoc train_batch
+     */
+    template <size_t S, typename Inputs, typename Labels, cpp_enable_iff(S > 0)>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics) {
+        return trainer->template train_batch<S>(epoch, inputs, labels, metrics);
+    }
+
     /*!
      * \brief Train the network for one epoch
      * \param generator The generator for training data
      * \param epoch The current epoch
+     * \tparam S The layer the inputs of the generator are given to
      */
-    template<typename Generator>
+    template<size_t S = 0, typename Generator>
     void train_epoch_only(dbn_t& dbn, Generator& generator, size_t epoch){
         // Set the generator in train mode
         generator.set_train();
 
+        // The metrics of the batches are only needed by the watcher, in
+        // verbose mode, the last computed values are reported in between
+        double batch_error = -1.0;
+        double batch_loss  = -1.0;
+        size_t batch       = 0;
+
+        // The next batch is prepared while training on the current one
+        batch_prefetcher<Generator> prefetcher(generator);
+
+        // The generators drawing their epochs by importance sampling need
+        // the loss of each sample
+        cpp::static_if<is_importance_sampled<Generator>>([&](auto f) {
+            f(trainer)->record_losses = true;
+        });
+
         //Train one mini-batch at a time
-        while(generator.has_next_batch()){
+        while(prefetcher.has_next_batch()){
             dll::auto_timer timer("dbn::trainer::train::epoch::batch");
 
             if /*constexpr*/ (dbn_traits<dbn_t>::is_verbose()){
-                watcher.ft_batch_start(epoch, dbn);
+                if (distributed::is_root()) {
+                    watcher.ft_batch_start(epoch, dbn);
+                }
             }
 
-            double batch_error;
-            double batch_loss;
-            std::tie(batch_error, batch_loss) = trainer->train_batch(
+            const bool metrics = dbn_traits<dbn_t>::is_verbose() && batch++ % dbn_traits<dbn_t>::batch_metrics_period() == 0;
+
+            // The teacher of the distillation forwards the batch first
+            if (dbn.distillation) {
+                dbn.distillation->prepare(prefetcher.data_batch(), prefetcher.current_batch(), dbn.distillation_temperature);
+            }
+
+            auto batch_metrics = train_batch<S>(
                 epoch,
-                generator.data_batch(),
-                generator.label_batch());
+                prefetcher.data_batch(),
+                prefetcher.label_batch(),
+                metrics);
+
+            if (metrics) {
+                std::tie(batch_error, batch_loss) = batch_metrics;
+            }
+
+            cpp::static_if<is_importance_sampled<Generator>>([&](auto f) {
+                f(generator).report_losses(f(trainer)->sample_losses.data(), etl::dim<0>(prefetcher.label_batch()));
+            });
+
+            notify_watcher_samples(watcher, etl::dim<0>(prefetcher.label_batch()));
 
             if /*constexpr*/ (dbn_traits<dbn_t>::is_verbose()){
-                watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+                if (distributed::is_root()) {
+                    watcher.ft_batch_end(epoch, prefetcher.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+                }
+            }
+
+            prefetcher.next_batch();
+
+            // The checkpoints inside the epoch resume at its beginning
+            if (dbn.checkpoints && dbn.checkpoints->batch_period && batch % dbn.checkpoints->batch_period == 0 && distributed::is_root()) {
+                checkpoint(dbn, epoch, batch);
+            }
+        }
+
+        notify_watcher_stalls(watcher, generator);
+    }
+
+    /*!
+     * \brief Returns the first epoch to train, after the epoch of the
+     * checkpoint the network was resumed from, if any
+     */
+    static size_t first_epoch(const dbn_t& dbn) {
+        return dbn.checkpoints ? dbn.checkpoints->first_epoch : 0;
+    }
+
+    /*!
+     * \brief Take a checkpoint of the network and of the state of the
+     * training (the momentum and the state of the trainer)
+     * \param dbn The network being trained
+     * \param epoch The epoch to resume from
+     * \param batch The batch of the epoch the checkpoint is taken after
+     */
+    void checkpoint(dbn_t& dbn, size_t epoch, size_t batch = 0) {
+        std::ostringstream state(std::ostringstream::binary);
+
+        cpp::binary_write(state, dbn.momentum);
+        trainer->store_state(state);
+
+        dbn.checkpoints->snapshot(dbn, epoch, batch, state.str());
+    }
+
+    /*!
+     * \brief Take a checkpoint of the network at the end of an epoch, if
+     * necessary
+     * \param dbn The network being trained
+     * \param epoch The epoch that has just been trained
+     */
+    void checkpoint_epoch(dbn_t& dbn, size_t epoch) {
+        if (dbn.checkpoints && dbn.checkpoints->epoch_period && (epoch + 1) % dbn.checkpoints->epoch_period == 0 && distributed::is_root()) {
+            checkpoint(dbn, epoch + 1);
+        }
+    }
+
+    /*!
+     * \brief Restore the state of the training from the checkpoint the
+     * network was resumed from, if any
+     */
+    void resume_state(dbn_t& dbn) {
+        if (dbn.checkpoints && !dbn.checkpoints->state.empty()) {
+            std::istringstream state(dbn.checkpoints->state, std::istringstream::binary);
+
+            cpp::binary_load(state, dbn.momentum);
+
+            if (!state || !trainer->load_state(state)) {
+                std::cerr << "ERROR: Impossible to restore the state of the training, the updaters restart from zero" << std::endl;
+                dbn.momentum = dbn.initial_momentum;
             }
 
-            generator.next_batch();
+            dbn.checkpoints->state.clear();
         }
     }
 
@@ -428,13 +780,13 @@ struct dbn_trainer {
      *
      * \return a pair containing (error, loss)
      */
-    template<typename Generator>
+    template<size_t S = 0, typename Generator>
     std::pair<double, double> train_epoch(dbn_t& dbn, Generator& generator, size_t epoch){
         // Train one epoch of training data
-        train_epoch_only(dbn, generator, epoch);
+        train_epoch_only<S>(dbn, generator, epoch);
 
         // Compute the error at this epoch
-        return compute_error_loss(dbn, generator);
+        return compute_error_loss<S>(dbn, generator);
     }
 
     /*!
@@ -456,13 +808,50 @@ struct dbn_trainer {
         // Compute the training error at this epoch
         auto train_stats = compute_error_loss(dbn, train_generator);
 
-        // Compute the training error at this epoch
-        auto val_stats = compute_error_loss(dbn, val_generator);
+        // Compute the validation error at this epoch
+        auto val_stats = validate(dbn, val_generator);
 
         // Return the stats
         return std::make_pair(train_stats, val_stats);
     }
 
+    /*!
+     * \brief Compute the error and the loss on the validation set.
+     *
+     * With a validation subsample, only the first samples of the
+     * validation set are evaluated and the early stopping decisions are
+     * taken on them. The full validation set is only evaluated when the
+     * subsample improves, to report the statistics of the best weights.
+     * Otherwise, the statistics of the subsample are reported.
+     *
+     * \param dbn The network to evaluate
+     * \param val_generator The generator of the validation data
+     *
+     * \return a pair containing (error, loss)
+     */
+    template <typename ValGenerator>
+    std::pair<double, double> validate(dbn_t& dbn, ValGenerator& val_generator){
+        adaptive_validation = dbn.validation_subsample && dbn.validation_subsample < val_generator.size();
+
+        if (!adaptive_validation) {
+            return compute_error_loss(dbn, val_generator);
+        }
+
+        subsample_stats = compute_error_loss(dbn, val_generator, dbn.validation_subsample);
+
+        const double metric = is_error(dbn_t::early) ? subsample_stats.first : subsample_stats.second;
+
+        if (metric < best_subsample) {
+            best_subsample = metric;
+
+            dll::auto_timer timer("dbn::trainer::train::epoch::full_validation");
+
+            return compute_error_loss(dbn, val_generator);
+        }
+
+        return subsample_stats;
+    }
+
     /*!
      * \brief Train the network for max_epochs
      *
@@ -471,17 +860,23 @@ struct dbn_trainer {
      * \param max_epochs The maximum number of epochs
      *
      * \return The final error
+     *
+     * \tparam S The layer the inputs of the generator are given to, the
+     * previous layers must be frozen
      */
-    template <typename Generator>
+    template <size_t S = 0, typename Generator>
     error_type train(DBN& dbn, Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("dbn::trainer::train");
 
         // Initialization steps
         start_training(dbn, max_epochs);
 
+        // The schedules of the learning rate span all the updates of the training
+        trainer->horizon = max_epochs * generator.batches() / std::max<size_t>(dbn.accumulation_steps, 1);
+
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch(dbn);
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("dbn::trainer::train::epoch");
 
@@ -499,11 +894,13 @@ struct dbn_trainer {
 
             double error;
             double loss;
-            std::tie(error, loss) = train_epoch(dbn, generator, epoch);
+            std::tie(error, loss) = train_epoch<S>(dbn, generator, epoch);
 
             if(stop_epoch(dbn, epoch, error, loss)){
                 break;
             }
+
+            checkpoint_epoch(dbn, epoch);
         }
 
         // Finalization
@@ -531,9 +928,18 @@ struct dbn_trainer {
         // Initialization steps
         start_training(dbn, max_epochs);
 
+        // The schedules of the learning rate span all the updates of the training
+        trainer->horizon = max_epochs * train_generator.batches() / std::max<size_t>(dbn.accumulation_steps, 1);
+
+        // The first epoch receives the statistics of the initial weights
+        bool async = false;
+        if /*constexpr*/ (dbn_traits<dbn_t>::async_validation() && dbn_traits<dbn_t>::error_on_epoch()) {
+            async = start_async_validation(dbn, val_generator);
+        }
+
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch(dbn);
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("dbn::trainer::train::epoch");
 
@@ -548,11 +954,28 @@ struct dbn_trainer {
 
             std::pair<double, double> train_stats;
             std::pair<double, double> val_stats;
-            std::tie(train_stats, val_stats) = train_epoch(dbn, train_generator, val_generator, epoch);
+
+            if (async) {
+                train_epoch_only(dbn, train_generator, epoch);
+
+                train_stats = compute_error_loss(dbn, train_generator);
+
+                // The statistics of the weights of the previous epoch
+                val_stats = pending_validation.get();
+            } else {
+                std::tie(train_stats, val_stats) = train_epoch(dbn, train_generator, val_generator, epoch);
+            }
 
             if (stop_epoch(dbn, epoch, train_stats, val_stats)) {
                 break;
             }
+
+            checkpoint_epoch(dbn, epoch);
+
+            // Validate the new weights while the next epoch is trained
+            if (async && epoch + 1 < max_epochs) {
+                start_validation(dbn, val_generator);
+            }
         }
 
         // Finalization
@@ -0,0 +1,201 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Knowledge distillation of a student network from a teacher.
+ *
+ * The teacher forwards each batch of the generator in test mode and its
+ * probabilities are softened with the temperature of the distillation.
+ * The errors of the last layer of the student are then computed from the
+ * hard labels and from these soft targets by the SGD trainer.
+ *
+ * When the batches of the generator are the same at each epoch (neither
+ * shuffled nor augmented), the soft targets of each batch are computed
+ * during the first epoch only, and can be stored in a file to be reused
+ * by the next distillations from the same teacher.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <utility>
+
+#include "cpp_utils/io.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/direct.hpp"
+#include "dll/trainer/loss_kernels.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The soft targets of the teacher of a distillation
+ */
+template <typename T>
+struct distillation_teacher {
+    using forward_t = std::function<void(const T* inputs, size_t n, T* outputs)>; ///< The type of the forward pass of the teacher
+
+    forward_t forward; ///< Forward a batch of inputs through the teacher, writing its probabilities
+    size_t classes;    ///< The number of outputs of the teacher
+    bool cached;       ///< Indicates if the soft targets of each batch are kept for the next epochs
+
+    std::vector<std::vector<T>> batches; ///< The soft targets of each batch of the epoch (cached only)
+    std::vector<T> current;              ///< The soft targets of the current batch (not cached only)
+    const T* targets = nullptr;          ///< The soft targets of the current batch
+    bool computed    = false;            ///< Indicates if soft targets have been computed by the teacher
+
+    /*!
+     * \brief Create the soft targets of a teacher
+     * \param forward The forward pass of the teacher
+     * \param classes The number of outputs of the teacher
+     * \param cached Indicates if the batches are the same at each epoch
+     */
+    distillation_teacher(forward_t forward, size_t classes, bool cached) : forward(std::move(forward)), classes(classes), cached(cached) {}
+
+    /*!
+     * \brief Prepare the soft targets of the given batch
+     * \param inputs The inputs of the batch
+     * \param batch The index of the batch in the epoch
+     * \param temperature The temperature of the soft targets
+     */
+    template <typename Inputs>
+    void prepare(const Inputs& inputs, size_t batch, T temperature) {
+        const size_t n = etl::dim<0>(inputs);
+
+        if (cached && batch < batches.size() && batches[batch].size() == n * classes) {
+            targets = batches[batch].data();
+            return;
+        }
+
+        if (cached && batch >= batches.size()) {
+            batches.resize(batch + 1);
+        }
+
+        auto& soft = cached ? batches[batch] : current;
+
+        soft.resize(n * classes);
+
+        decltype(auto) in = direct_memory(inputs);
+
+        host_read(in);
+
+        forward(in.memory_start(), n, soft.data());
+
+        loss_detail::soften(n, classes, soft.data(), soft.data(), temperature);
+
+        targets  = soft.data();
+        computed = true;
+    }
+
+    /*!
+     * \brief Store the cached soft targets to the given file
+     * \param file The path of the file
+     * \param temperature The temperature of the soft targets
+     */
+    void store(const std::string& file, T temperature) const {
+        std::ofstream os(file, std::ofstream::binary);
+
+        cpp::binary_write(os, temperature);
+        cpp::binary_write(os, classes);
+        cpp::binary_write(os, batches.size());
+
+        for (auto& soft : batches) {
+            cpp::binary_write(os, soft.size());
+            cpp::binary_write_all(os, soft);
+        }
+    }
+
+    /*!
+     * \brief Load the cached soft targets from the given file, if it has
+     * been stored with the same temperature and number of classes
+     * \param file The path of the file
+     * \param temperature The temperature of the soft targets
+     * \return true if the soft targets have been loaded, false otherwise
+     */
+    bool load(const std::string& file, T temperature) {
+        std::ifstream is(file, std::ifstream::binary);
+
+        if (!is) {
+            return false;
+        }
+
+        T t      = 0;
+        size_t k = 0;
+        size_t b = 0;
+
+        cpp::binary_load(is, t);
+        cpp::binary_load(is, k);
+        cpp::binary_load(is, b);
+
+        if (!is || t != temperature || k != classes) {
+            return false;
+        }
+
+        std::vector<std::vector<T>> loaded(b);
+
+        for (auto& soft : loaded) {
+            size_t size = 0;
+            cpp::binary_load(is, size);
+
+            soft.resize(size);
+            cpp::binary_load_all(is, soft);
+        }
+
+        if (!is) {
+            return false;
+        }
+
+        batches = std::move(loaded);
+
+        return true;
+    }
+};
+
+namespace distillation_detail {
+
+template <typename Teacher, typename Batch, size_t... I>
+typename distillation_teacher<typename Teacher::weight>::forward_t teacher_forward(Teacher& teacher, const Batch& batch, std::index_sequence<I...> /*seq*/) {
+    using T = typename Teacher::weight;
+
+    const std::array<size_t, sizeof...(I)> dims{{etl::dim<I + 1>(batch)...}};
+
+    return [&teacher, dims](const T* inputs, size_t n, T* outputs) {
+        etl::dyn_matrix<T, sizeof...(I) + 1> input(n, dims[I]...);
+
+        std::copy(inputs, inputs + etl::size(input), input.memory_start());
+
+        host_written(input);
+
+        auto output = etl::force_temporary(teacher.test_forward_batch(input));
+
+        host_read(output);
+
+        std::copy(output.memory_start(), output.memory_start() + etl::size(output), outputs);
+    };
+}
+
+} //end of namespace distillation_detail
+
+/*!
+ * \brief Create the forward pass of the given teacher for the batches of
+ * the same shape as the given batch
+ * \param teacher The teacher network, whose last layer is a softmax
+ * \param batch A batch of inputs of the generator
+ */
+template <typename Teacher, typename Batch>
+typename distillation_teacher<typename Teacher::weight>::forward_t teacher_forward(Teacher& teacher, const Batch& batch) {
+    return distillation_detail::teacher_forward(teacher, batch, std::make_index_sequence<etl::decay_traits<Batch>::dimensions() - 1>());
+}
+
+} //end of dll namespace
@@ -0,0 +1,334 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the errors of the last layer.
+ *
+ * The errors of the last layer and, when needed, the error and the loss
+ * of the batch are computed in a single pass over the output. The data
+ * is seen as B x K, with B the number of samples and K the size of the
+ * output of one sample. The samples are split in contiguous parts
+ * computed in parallel.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "dll/loss.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+namespace loss_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
+/*!
+ * \brief Compute the errors of one sample and add its metrics
+ *
+ * \tparam F The loss function
+ * \tparam Sigmoid Indicates if the output is activated with a sigmoid
+ */
+template <loss_function F, bool Sigmoid, typename T, typename L>
+void sample_errors(size_t K, const T* o, const L* y, T* e, bool metrics, double& error, double& loss) {
+    if /*constexpr*/ (F == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+        // With softmax, the derivative of the activation cancels out with the loss
+        for (size_t k = 0; k < K; ++k) {
+            e[k] = T(y[k]) - o[k];
+        }
+
+        if (metrics) {
+            size_t max_o = 0;
+            size_t max_y = 0;
+
+            for (size_t k = 0; k < K; ++k) {
+                if (y[k] != L(0)) {
+                    loss -= double(y[k]) * std::log(double(o[k]));
+                }
+
+                max_o = o[k] > o[max_o] ? k : max_o;
+                max_y = y[k] > y[max_y] ? k : max_y;
+            }
+
+            error += max_o != max_y;
+        }
+    } else if (F == loss_function::BINARY_CROSS_ENTROPY) {
+        for (size_t k = 0; k < K; ++k) {
+            // Avoid NaN from log(out) and from the division by ((1 - out) * out)
+            const T c = std::min(std::max(o[k], T(0.001)), T(0.999));
+
+            if (Sigmoid) {
+                // The derivative of the sigmoid cancels out with the loss
+                e[k] = T(y[k]) - o[k];
+            } else {
+                e[k] = (T(y[k]) - c) / ((T(1) - c) * c);
+            }
+
+            if (metrics) {
+                loss -= (double(y[k]) * std::log(double(c)) + (1.0 - double(y[k])) * std::log(1.0 - double(c))) / K;
+                error += std::abs(double(y[k]) - double(o[k])) / K;
+            }
+        }
+    } else {
+        for (size_t k = 0; k < K; ++k) {
+            e[k] = T(2) * (T(y[k]) - o[k]);
+
+            if (metrics) {
+                const double d = double(o[k]) - double(y[k]);
+
+                loss += 0.5 * d * d;
+                error += std::abs(d);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the errors of the last layer, and their metrics.
+ *
+ * The errors of the samples after the n first ones are set to zero.
+ *
+ * \param B The number of samples of the errors
+ * \param n The number of samples of the batch
+ * \param K The size of the output of one sample
+ * \param out The output of the last layer (B x K)
+ * \param labels The labels (n x K)
+ * \param errors The errors (B x K)
+ * \param metrics Indicates if the metrics are computed
+ *
+ * \return The sums of the errors and of the losses of the samples (0 when not computed)
+ */
+template <loss_function F, bool Sigmoid, typename T, typename L>
+std::pair<double, double> last_errors(size_t B, size_t n, size_t K, const T* out, const L* labels, T* errors, bool metrics) {
+    const size_t P = n * K >= parallel_threshold && n > 1 ? std::min(n, concurrency()) : 1;
+
+    std::vector<double> parts(2 * P, 0.0);
+
+    auto part = [&](size_t p) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t b = (p * n) / P; b < ((p + 1) * n) / P; ++b) {
+            sample_errors<F, Sigmoid>(K, out + b * K, labels + b * K, errors + b * K, metrics, error, loss);
+        }
+
+        parts[2 * p]     = error;
+        parts[2 * p + 1] = loss;
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+
+    std::fill(errors + n * K, errors + B * K, T(0));
+
+    // The parts are summed in order, independently of the threads
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t p = 0; p < P; ++p) {
+        error += parts[2 * p];
+        loss += parts[2 * p + 1];
+    }
+
+    return std::make_pair(error, loss);
+}
+
+/*!
+ * \brief Soften the probabilities of a softmax with the given temperature.
+ *
+ * The logits being the logarithms of the probabilities, up to a constant,
+ * the softmax of the logits divided by the temperature is computed
+ * directly from the probabilities, relatively to the largest one.
+ *
+ * \param K The number of classes
+ * \param p The probabilities
+ * \param q The softened probabilities (can be the same memory as p)
+ * \param temperature The temperature
+ */
+template <typename T>
+void soften(size_t K, const T* p, T* q, T temperature) {
+    const T m   = *std::max_element(p, p + K);
+    const T inv = T(1) / temperature;
+
+    T sum = T(0);
+
+    for (size_t k = 0; k < K; ++k) {
+        q[k] = std::pow(p[k] / m, inv);
+        sum += q[k];
+    }
+
+    const T scale = T(1) / sum;
+
+    for (size_t k = 0; k < K; ++k) {
+        q[k] *= scale;
+    }
+}
+
+/*!
+ * \brief Soften the probabilities of n samples with the given temperature
+ *
+ * \param n The number of samples
+ * \param K The number of classes
+ * \param p The probabilities (n x K)
+ * \param q The softened probabilities (n x K, can be the same memory as p)
+ * \param temperature The temperature
+ */
+template <typename T>
+void soften(size_t n, size_t K, const T* p, T* q, T temperature) {
+    auto sample = [=](size_t b) {
+        soften(K, p + b * K, q + b * K, temperature);
+    };
+
+    if (n * K >= parallel_threshold && n > 1) {
+        parallel_for_n(n, sample);
+    } else {
+        for (size_t b = 0; b < n; ++b) {
+            sample(b);
+        }
+    }
+}
+
+/*!
+ * \brief Compute the errors of the softmax of the last layer of a student
+ * network distilled from a teacher, and their metrics.
+ *
+ * The errors are the mix of the errors for the hard labels and of the
+ * errors for the soft targets of the teacher: the derivative of the
+ * cross entropy between the softened probabilities of the teacher and of
+ * the student, scaled by the square of the temperature so that the
+ * magnitude of its gradients does not depend on the temperature. Only
+ * the hard labels are used for the metrics.
+ *
+ * The errors of the samples after the n first ones are set to zero.
+ *
+ * \param B The number of samples of the errors
+ * \param n The number of samples of the batch
+ * \param K The number of classes
+ * \param out The output of the last layer (B x K)
+ * \param labels The labels (n x K)
+ * \param soft The softened probabilities of the teacher (n x K)
+ * \param errors The errors (B x K)
+ * \param temperature The temperature of the soft targets
+ * \param alpha The weight of the soft targets, the hard labels having the rest
+ * \param metrics Indicates if the metrics are computed
+ *
+ * \return The sums of the errors and of the losses of the samples (0 when not computed)
+ */
+template <typename T, typename L>
+std::pair<double, double> distilled_errors(size_t B, size_t n, size_t K, const T* out, const L* labels, const T* soft, T* errors, T temperature, T alpha, bool metrics) {
+    const size_t P = n * K >= parallel_threshold && n > 1 ? std::min(n, concurrency()) : 1;
+
+    std::vector<double> parts(2 * P, 0.0);
+
+    const T hard_weight = T(1) - alpha;
+    const T soft_weight = alpha * temperature;
+    const T inv         = T(1) / temperature;
+
+    auto part = [&](size_t p) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t b = (p * n) / P; b < ((p + 1) * n) / P; ++b) {
+            const T* o = out + b * K;
+            const T* s = soft + b * K;
+            T* e       = errors + b * K;
+
+            sample_errors<loss_function::CATEGORICAL_CROSS_ENTROPY, false>(K, o, labels + b * K, e, metrics, error, loss);
+
+            // The softened probabilities of the student
+            const T m = *std::max_element(o, o + K);
+
+            T sum = T(0);
+
+            for (size_t k = 0; k < K; ++k) {
+                sum += std::pow(o[k] / m, inv);
+            }
+
+            const T scale = T(1) / sum;
+
+            for (size_t k = 0; k < K; ++k) {
+                e[k] = hard_weight * e[k] + soft_weight * (s[k] - std::pow(o[k] / m, inv) * scale);
+            }
+        }
+
+        parts[2 * p]     = error;
+        parts[2 * p + 1] = loss;
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+
+    std::fill(errors + n * K, errors + B * K, T(0));
+
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t p = 0; p < P; ++p) {
+        error += parts[2 * p];
+        loss += parts[2 * p + 1];
+    }
+
+    return std::make_pair(error, loss);
+}
+
+/*!
+ * \brief Compute the loss of each sample of the batch, the hardness of the
+ * samples for the importance sampling of the generators
+ *
+ * \param n The number of samples of the batch
+ * \param K The size of the output of one sample
+ * \param out The output of the last layer (n x K)
+ * \param labels The labels (n x K)
+ * \param losses The output loss of each sample (n)
+ */
+template <loss_function F, typename T, typename L>
+void sample_losses(size_t n, size_t K, const T* out, const L* labels, T* losses) {
+    for (size_t b = 0; b < n; ++b) {
+        const T* o = out + b * K;
+        const L* y = labels + b * K;
+
+        double loss = 0.0;
+
+        if /*constexpr*/ (F == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+            for (size_t k = 0; k < K; ++k) {
+                if (y[k] != L(0)) {
+                    loss -= double(y[k]) * std::log(std::max(double(o[k]), 1e-12));
+                }
+            }
+        } else if (F == loss_function::BINARY_CROSS_ENTROPY) {
+            for (size_t k = 0; k < K; ++k) {
+                const double c = std::min(std::max(double(o[k]), 0.001), 0.999);
+
+                loss -= (double(y[k]) * std::log(c) + (1.0 - double(y[k])) * std::log(1.0 - c)) / K;
+            }
+        } else {
+            for (size_t k = 0; k < K; ++k) {
+                const double d = double(o[k]) - double(y[k]);
+
+                loss += 0.5 * d * d;
+            }
+        }
+
+        losses[b] = T(loss);
+    }
+}
+
+} //end of namespace loss_detail
+
+} //end of dll namespace
@@ -0,0 +1,184 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Continual training of a network on batches arriving online.
+ *
+ * The batches are trained one by one, as they arrive, with the SGD
+ * trainer of the network whose state (the state of the updaters) is kept
+ * from one batch to the next. Periodically, the weights are published as
+ * an immutable snapshot of the network, that replaces the previous one
+ * atomically: the serving threads take the current snapshot and use it
+ * for as long as they need, without ever waiting for the training, the
+ * snapshots being released once the last thread using them is done
+ * (read-copy-update).
+ */
+
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <iostream>
+#include <type_traits>
+
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/trainer/dbn_trainer.hpp" // For copy_weights
+
+namespace dll {
+
+/*!
+ * \brief A continual trainer of a network, publishing snapshots of its
+ * weights for serving.
+ *
+ * The network itself is only used by the trainer, the inference must be
+ * done on the published snapshots.
+ */
+template <typename DBN>
+struct online_trainer {
+    using dbn_t     = DBN;                                            ///< The network type
+    using weight    = typename dbn_t::weight;                         ///< The data type of the network
+    using trainer_t = typename dbn_t::desc::template trainer_t<dbn_t>; ///< The trainer of the network
+
+    static_assert(std::is_same<trainer_t, sgd_trainer<dbn_t>>::value, "The online training needs the SGD trainer");
+
+    /*!
+     * \brief Create a continual trainer of the given network and publish
+     * its initial weights
+     * \param dbn The network to train
+     * \param publish_period The number of batches between two publications (0 to only publish manually)
+     */
+    online_trainer(dbn_t& dbn, size_t publish_period) : dbn(dbn), publish_period(publish_period) {
+        dbn.momentum = dbn.initial_momentum;
+
+        trainer = std::make_unique<trainer_t>(dbn);
+        trainer->init_training(dbn_t::batch_size);
+
+        publish();
+    }
+
+    online_trainer(const online_trainer& rhs) = delete;
+    online_trainer& operator=(const online_trainer& rhs) = delete;
+
+    /*!
+     * \brief Train the network on the given batch, and publish its weights
+     * if the publication period is reached.
+     *
+     * \param inputs The batch of inputs
+     * \param labels The batch of labels, as given by the generators (one-hot for classification)
+     * \param metrics Indicates if the error and the loss of the batch are computed
+     *
+     * \return The error and the loss of the batch (only if metrics is set)
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(const Inputs& inputs, const Labels& labels, bool metrics = false) {
+        dll::auto_timer timer("online_trainer:train_batch");
+
+        dbn.weights_changed();
+
+        auto result = trainer->train_batch(publications, inputs, labels, metrics);
+
+        ++batches;
+
+        if (publish_period && batches % publish_period == 0) {
+            publish();
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Publish the current weights of the network as the new
+     * snapshot.
+     *
+     * The snapshot that is replaced remains valid for the threads still
+     * using it.
+     *
+     * \return true if the weights were published, false otherwise
+     */
+    bool publish() {
+        dll::auto_timer timer("online_trainer:publish");
+
+        // The retired snapshot is reused once no thread is using it anymore
+        std::shared_ptr<dbn_t> next;
+
+        if (retired && retired.use_count() == 1) {
+            // Synchronize with the release of the snapshot by the last reader
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            next = std::move(retired);
+        } else {
+            next = std::make_shared<dbn_t>();
+        }
+
+        if (!dbn_trainer<dbn_t>::copy_weights(dbn, *next)) {
+            std::cerr << "ERROR: The network cannot be copied for publication" << std::endl;
+            return false;
+        }
+
+        std::shared_ptr<const dbn_t> current = next;
+
+        current = std::atomic_exchange(&published, std::move(current));
+
+        // Only the trainer modifies the snapshots, they are never visible to
+        // the readers while they are updated
+        retired = std::const_pointer_cast<dbn_t>(current);
+
+        ++publications;
+
+        return true;
+    }
+
+    /*!
+     * \brief Return the current snapshot of the network.
+     *
+     * This can be called concurrently with the training. The snapshot
+     * remains valid and unchanged for as long as it is held.
+     */
+    std::shared_ptr<const dbn_t> snapshot() const {
+        return std::atomic_load(&published);
+    }
+
+    /*!
+     * \brief Return the number of batches trained so far
+     */
+    size_t trained_batches() const {
+        return batches;
+    }
+
+    /*!
+     * \brief Return the number of snapshots published so far
+     */
+    size_t published_snapshots() const {
+        return publications;
+    }
+
+private:
+    dbn_t& dbn;                  ///< The network being trained
+    const size_t publish_period; ///< The number of batches between two publications
+
+    std::unique_ptr<trainer_t> trainer; ///< The SGD trainer, kept between the batches
+
+    size_t batches      = 0; ///< The number of trained batches
+    size_t publications = 0; ///< The number of publications
+
+    std::shared_ptr<const dbn_t> published; ///< The current snapshot (accessed atomically)
+    std::shared_ptr<dbn_t> retired;         ///< The previous snapshot, reused when it is not used anymore
+};
+
+/*!
+ * \brief Create a continual trainer of the given network
+ * \param dbn The network to train
+ * \param publish_period The number of batches between two publications of the weights (0 to only publish manually)
+ */
+template <typename DBN>
+std::unique_ptr<online_trainer<DBN>> make_online_trainer(DBN& dbn, size_t publish_period) {
+    return std::make_unique<online_trainer<DBN>>(dbn, publish_period);
+}
+
+} //end of dll namespace
@@ -0,0 +1,154 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Concurrent training of several RBMs in one pass over the data.
+ *
+ * Several RBMs of the same type (typically the same layer with different
+ * learning rates, sparsity targets or numbers of hidden units) are trained
+ * from the same generator. Each batch of the generator is loaded,
+ * augmented and transformed once and then given to all the RBMs, whose
+ * trainers are run in parallel while the batch is still in cache. Each RBM
+ * keeps its own rbm_trainer (and therefore its own watcher, momentum and
+ * statistics), the result being the same as training them one after the
+ * other on the same batches.
+ */
+
+#pragma once
+
+#include "dll/util/parallel.hpp"
+#include "dll/trainer/rbm_trainer.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Trainer for several RBMs of the same type sharing one generator
+ */
+template <typename RBM, bool EnableWatcher, typename RW>
+struct rbm_multi_trainer {
+    using rbm_t        = RBM;                                 ///< The RBM type being trained
+    using trainer_t    = rbm_trainer<RBM, EnableWatcher, RW>; ///< The trainer of one RBM
+    using error_type   = typename trainer_t::error_type;      ///< The error data type
+    using trainer_type = typename trainer_t::trainer_type;    ///< The type of the CD trainer of one RBM
+
+    std::vector<std::unique_ptr<trainer_t>> trainers; ///< The trainer of each RBM
+
+    /*!
+     * \brief Train the RBMs on the data of the generator
+     * \param rbms The RBMs to train
+     * \param generator The generator of the data
+     * \param max_epochs The number of epochs
+     * \return the last reconstruction error of each RBM
+     */
+    template <typename Generator>
+    std::vector<error_type> train(const std::vector<rbm_t*>& rbms, Generator& generator, size_t max_epochs) {
+        dll::auto_timer timer("rbm_multi_trainer:train");
+
+        cpp_assert(!rbms.empty(), "There must be at least one RBM to train");
+        cpp_assert(!rbm_layer_traits<rbm_t>::is_hogwild(), "Hogwild is not supported when training several RBMs");
+
+        const size_t K = rbms.size();
+
+        trainers.clear();
+
+        std::vector<trainer_type> cds;
+        cds.reserve(K);
+
+        // The parameter servers are not used, the RBMs would share them
+        for (size_t k = 0; k < K; ++k) {
+            trainers.push_back(std::make_unique<trainer_t>());
+            trainers[k]->init_training(*rbms[k], generator);
+            trainer_t::init_weights(*rbms[k], generator);
+            cds.push_back(trainer_t::get_trainer(*rbms[k]));
+        }
+
+        std::vector<rbm_training_context> contexts(K);
+
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            if (rbm_layer_traits<rbm_t>::has_shuffle()) {
+                generator.reset_shuffle();
+            } else {
+                generator.reset();
+            }
+
+            generator.set_train();
+
+            for (size_t k = 0; k < K; ++k) {
+                contexts[k] = rbm_training_context();
+                trainers[k]->init_epoch();
+            }
+
+            batch_prefetcher<Generator> prefetcher(generator);
+
+            while (prefetcher.has_next_batch()) {
+                decltype(auto) input    = prefetcher.data_batch();
+                decltype(auto) expected = prefetcher.label_batch();
+
+                for (size_t k = 0; k < K; ++k) {
+                    trainers[k]->begin_batch(contexts[k], *rbms[k]);
+                }
+
+                // The RBMs are independent, each kernel may also be parallel
+                parallel_for_n(K, [&](size_t k) {
+                    cds[k]->train_batch(input, expected, contexts[k]);
+                });
+
+                // The watchers are called in order
+                for (size_t k = 0; k < K; ++k) {
+                    trainers[k]->end_batch(etl::dim<0>(input), cds[k], contexts[k], *rbms[k]);
+                }
+
+                prefetcher.next_batch();
+            }
+
+            for (size_t k = 0; k < K; ++k) {
+                trainers[k]->finalize_epoch(epoch, contexts[k], *rbms[k]);
+            }
+        }
+
+        std::vector<error_type> errors(K);
+
+        for (size_t k = 0; k < K; ++k) {
+            errors[k] = trainers[k]->finalize_training(*rbms[k]);
+        }
+
+        return errors;
+    }
+};
+
+/*!
+ * \brief Train several RBMs of the same type concurrently, in one pass
+ * over the data of the generator for each epoch
+ *
+ * \param rbms The RBMs to train
+ * \param generator The generator of the data
+ * \param max_epochs The number of epochs
+ * \return the last reconstruction error of each RBM
+ */
+template <bool EnableWatcher = true, typename RW = void, typename RBM, typename Generator>
+auto train_concurrently(const std::vector<RBM*>& rbms, Generator& generator, size_t max_epochs) {
+    rbm_multi_trainer<RBM, EnableWatcher, RW> trainer;
+    return trainer.train(rbms, generator, max_epochs);
+}
+
+/*!
+ * \copydoc train_concurrently
+ */
+template <bool EnableWatcher = true, typename RW = void, typename RBM, typename Generator>
+auto train_concurrently(std::vector<std::unique_ptr<RBM>>& rbms, Generator& generator, size_t max_epochs) {
+    std::vector<RBM*> pointers;
+    pointers.reserve(rbms.size());
+
+    for (auto& rbm : rbms) {
+        pointers.push_back(rbm.get());
+    }
+
+    return train_concurrently<EnableWatcher, RW>(pointers, generator, max_epochs);
+}
+
+} //end of dll namespace
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "cpp_utils/algorithm.hpp"
 #include "cpp_utils/static_if.hpp"
@@ -15,10 +18,16 @@
 #include "dll/decay_type.hpp"
 #include "dll/util/batch.hpp"
 #include "dll/util/timers.hpp"
+#include "dll/util/flight_recorder.hpp"
 #include "dll/util/random.hpp"
+#include "dll/util/parameter_server.hpp"
+#include "dll/util/affinity.hpp"
+#include "dll/util/scheduler.hpp"
 #include "dll/layer_traits.hpp"
 #include "dll/trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
+#include "dll/generators/batch_prefetcher.hpp" // For the prefetching of the batches
+#include "dll/watcher.hpp" // For notify_watcher_samples
 
 namespace dll {
 
@@ -118,7 +127,32 @@ struct rbm_trainer {
         return std::make_unique<trainer_t<rbm_t>>(rbm);
     }
 
+    std::unique_ptr<distributed::parameter_sync<error_type>> ps; ///< The synchronization with the parameter server
+
+    /*!
+     * \brief Connect to the parameter server, if the RBM is pretrained
+     * on several nodes
+     */
+    void init_parameter_server(RBM& rbm) {
+        constexpr size_t period = rbm_layer_traits<rbm_t>::parameter_server_period();
+
+        if (period && distributed::active()) {
+            ps = std::make_unique<distributed::parameter_sync<error_type>>(
+                std::vector<std::pair<error_type*, size_t>>{
+                    {rbm.w.memory_start(), etl::size(rbm.w)},
+                    {rbm.b.memory_start(), etl::size(rbm.b)},
+                    {rbm.c.memory_start(), etl::size(rbm.c)}},
+                period);
+        }
+    }
+
     error_type finalize_training(RBM& rbm) {
+        // Wait for the other nodes and get the final weights
+        if (ps) {
+            ps->finish();
+            ps.reset();
+        }
+
         if (EnableWatcher) {
             watcher.training_end(rbm);
         }
@@ -138,6 +172,9 @@ struct rbm_trainer {
         //sometimes be called with the wrong input values
         init_weights(rbm, generator);
 
+        //Start from the weights of the parameter server if necessary
+        init_parameter_server(rbm);
+
         //Allocate the trainer
         auto trainer = get_trainer(rbm);
 
@@ -180,29 +217,174 @@ struct rbm_trainer {
         samples = 0;
     }
 
+    std::vector<trainer_type> hogwild_trainers; ///< The trainers of the additional hogwild threads
+
     template <typename Generator>
     void train_sub(Generator& generator, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
-        while(generator.has_next_batch()){
+        if (rbm_layer_traits<rbm_t>::is_hogwild()) {
+            train_sub_hogwild(generator, trainer, context, rbm);
+            return;
+        }
+
+        // The next batch is prepared while training on the current one
+        batch_prefetcher<Generator> prefetcher(generator);
+
+        while(prefetcher.has_next_batch()){
             //Train the batch
-            train_batch(generator.data_batch(), generator.label_batch(), trainer, context, rbm);
+            train_batch(prefetcher.data_batch(), prefetcher.label_batch(), trainer, context, rbm);
 
             // Go to the next batch
-            generator.next_batch();
+            prefetcher.next_batch();
+        }
+    }
+
+    /*!
+     * \brief Train on all the data with several threads.
+     *
+     * Each thread takes its own batches from the generator and updates the
+     * weights of the RBM without any locking (Hogwild!). Each thread has its
+     * own trainer and therefore its own gradients, momentum and chains.
+     */
+    template <typename Generator>
+    void train_sub_hogwild(Generator& generator, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
+        dll::auto_timer timer("rbm_trainer:train_sub:hogwild");
+
+        const size_t workers = concurrency();
+
+        // The trainers are kept between epochs (for persistent chains)
+        while (hogwild_trainers.size() + 1 < workers) {
+            hogwild_trainers.push_back(get_trainer(rbm));
+        }
+
+        std::mutex lock;
+
+        auto worker = [&](trainer_type& t_trainer) {
+            rbm_training_context t_context;
+            size_t t_batches = 0;
+
+            while (true) {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                if (!generator.has_next_batch()) {
+                    break;
+                }
+
+                // Copy the batch since the generator may reuse its memory
+                auto input    = etl::force_temporary(generator.data_batch());
+                auto expected = etl::force_temporary(generator.label_batch());
+
+                generator.next_batch();
+
+                ulock.unlock();
+
+                t_context.statistics = t_batches % rbm.statistics_period == 0;
+
+                // The wait of the batch includes the wait for the lock
+                dll::flight_batch flight(dll::flight_source::RBM, etl::dim<0>(input));
+
+                t_trainer->train_batch(input, expected, t_context);
+
+                flight.mark(dll::flight_phase::CD);
+
+                if (ps) {
+                    std::lock_guard<std::mutex> l(lock);
+                    ps->batch_end();
+                }
+
+                ++t_batches;
+
+                if (t_context.statistics) {
+                    t_context.reconstruction_error += t_context.batch_error;
+                    t_context.sparsity += t_context.batch_sparsity;
+                    ++t_context.statistics_batches;
+                }
+
+                cpp::static_if<EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()>([&](auto f) {
+                    if ((t_batches - 1) % rbm.free_energy_period == 0) {
+                        this->batch_free_energy(f(rbm), f(t_trainer), etl::dim<0>(input), t_context);
+                    }
+                });
+
+                if (EnableWatcher && rbm_layer_traits<rbm_t>::is_verbose()) {
+                    std::lock_guard<std::mutex> l(lock);
+                    watcher.batch_end(rbm, t_context, ++batches, total_batches);
+                }
+
+                flight.mark(dll::flight_phase::METRICS);
+            }
+
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!(EnableWatcher && rbm_layer_traits<rbm_t>::is_verbose())) {
+                batches += t_batches;
+            }
+
+            context.reconstruction_error += t_context.reconstruction_error;
+            context.sparsity += t_context.sparsity;
+            context.statistics_batches += t_context.statistics_batches;
+            context.free_energy += t_context.free_energy;
+            context.free_energy_samples += t_context.free_energy_samples;
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(hogwild_trainers.size());
+
+        for (size_t t = 0; t < hogwild_trainers.size(); ++t) {
+            threads.emplace_back([&worker, this, t] {
+                pin_worker(t + 1);
+                worker(hogwild_trainers[t]);
+            });
+        }
+
+        // The current thread is also training
+        worker(trainer);
+
+        for (auto& thread : threads) {
+            thread.join();
         }
     }
 
     template <typename InputBatch, typename ExpectedBatch>
     void train_batch(InputBatch&& input, ExpectedBatch&& expected, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
-        ++batches;
+        dll::flight_batch flight(dll::flight_source::RBM, etl::dim<0>(input));
+
+        begin_batch(context, rbm);
 
         trainer->train_batch(input, expected, context);
 
-        context.reconstruction_error += context.batch_error;
-        context.sparsity += context.batch_sparsity;
+        flight.mark(dll::flight_phase::CD);
+
+        end_batch(etl::dim<0>(input), trainer, context, rbm);
+
+        flight.mark(dll::flight_phase::METRICS);
+    }
+
+    /*!
+     * \brief Start a new batch, before the trainer is called
+     */
+    void begin_batch(rbm_training_context& context, rbm_t& rbm) {
+        ++batches;
+
+        context.statistics = (batches - 1) % rbm.statistics_period == 0;
+    }
+
+    /*!
+     * \brief Finish a batch of n samples, after the trainer is called
+     */
+    void end_batch(size_t n, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
+        if (ps) {
+            ps->batch_end();
+        }
+
+        if (context.statistics) {
+            context.reconstruction_error += context.batch_error;
+            context.sparsity += context.batch_sparsity;
+            ++context.statistics_batches;
+        }
 
         cpp::static_if<EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()>([&](auto f) {
-            for (auto& v : input) {
-                context.free_energy += f(rbm).free_energy(v);
+            if ((batches - 1) % rbm.free_energy_period == 0) {
+                this->batch_free_energy(f(rbm), f(trainer), n, context);
             }
         });
 
@@ -211,11 +393,25 @@ struct rbm_trainer {
         }
     }
 
+    /*!
+     * \brief Add the free energies of the last batch to the context, from
+     * the positive phase of the trainer
+     *
+     * \param n The number of samples of the batch
+     */
+    template <typename R, typename T>
+    static void batch_free_energy(R& rbm, T& trainer, size_t n, rbm_training_context& context) {
+        dll::auto_timer timer("rbm_trainer:free_energy");
+
+        context.free_energy += rbm.batch_free_energy(trainer->v1, trainer->h1_a, n);
+        context.free_energy_samples += n;
+    }
+
     void finalize_epoch(size_t epoch, rbm_training_context& context, rbm_t& rbm) {
         //Average all the gathered information
-        context.reconstruction_error /= batches;
-        context.sparsity /= batches;
-        context.free_energy /= samples;
+        context.reconstruction_error /= std::max<size_t>(context.statistics_batches, 1);
+        context.sparsity /= std::max<size_t>(context.statistics_batches, 1);
+        context.free_energy /= std::max<size_t>(context.free_energy_samples, 1);
 
         //After some time increase the momentum
         if (rbm_layer_traits<rbm_t>::has_momentum() && epoch == rbm.final_momentum_epoch) {
@@ -224,6 +420,7 @@ struct rbm_trainer {
 
         //Notify the watcher
         if (EnableWatcher) {
+            notify_watcher_samples(watcher, batches * batch_size);
             watcher.epoch_end(epoch, context, rbm);
         }
 
@@ -21,6 +21,11 @@ struct rbm_training_context {
     double free_energy          = 0.0; ///< The mean free energy
     double sparsity             = 0.0; ///< The mean sparsity
 
+    size_t free_energy_samples = 0; ///< The number of samples of the free energy
+    size_t statistics_batches  = 0; ///< The number of batches of the reconstruction error and the sparsity
+
+    bool statistics = true; ///< Indicates if the statistics of the next batch are computed
+
     double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
     double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
 };
@@ -0,0 +1,276 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sampled softmax for the training of a last dense layer with a
+ * very large number of classes.
+ *
+ * Instead of the K outputs of the layer, only C candidate classes are
+ * computed for a batch: the classes of the samples of the batch and
+ * classes sampled uniformly among the others. The weights of the
+ * candidates are gathered (transposed) into a C x V matrix, the logits of
+ * the sampled classes are corrected by the log of their inverse sampling
+ * probability (the softmax over the candidates estimates the softmax over
+ * all the classes) and the gradients are scattered back to the columns of
+ * the candidates. The products of the forward pass, of the backward pass
+ * and of the gradients are therefore in C instead of K.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "dll/util/random.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The workspace of the sampled softmax of a last dense layer
+ */
+template <typename T>
+struct sampled_softmax_workspace {
+    static constexpr uint32_t none = uint32_t(-1); ///< The slot of the classes that are not candidates
+
+    size_t V = 0; ///< The input size of the layer
+    size_t K = 0; ///< The number of classes
+    size_t B = 0; ///< The number of samples of a batch
+    size_t C = 0; ///< The number of candidates of each batch
+
+    std::vector<size_t> targets;  ///< The class of each sample of the batch
+    std::vector<size_t> classes;  ///< The candidate classes, the targets of the batch first
+    std::vector<uint32_t> slots;  ///< The index of each class among the candidates (none otherwise)
+    size_t n_targets = 0;         ///< The number of distinct targets in the batch
+    double correction = 0.0;      ///< The correction of the logits of the sampled classes
+
+    etl::dyn_matrix<T, 2> w;      ///< The weights of the candidates (C x V)
+    etl::dyn_matrix<T, 1> b;      ///< The biases of the candidates
+    etl::dyn_matrix<T, 2> output; ///< The logits, then the probabilities, of the candidates (B x C)
+    etl::dyn_matrix<T, 2> errors; ///< The errors of the candidates (B x C)
+    etl::dyn_matrix<T, 2> w_grad; ///< The gradients of the weights of the candidates (C x V)
+    etl::dyn_matrix<T, 1> b_grad; ///< The gradients of the biases of the candidates
+
+    /*!
+     * \brief Prepare the workspace
+     * \param V The input size of the layer
+     * \param K The number of classes
+     * \param B The number of samples of a batch
+     * \param negatives The number of sampled classes
+     */
+    void init(size_t V, size_t K, size_t B, size_t negatives) {
+        const size_t c = std::min(K, B + negatives);
+
+        if (this->V == V && this->K == K && this->B == B && C == c) {
+            return;
+        }
+
+        this->V = V;
+        this->K = K;
+        this->B = B;
+        C       = c;
+
+        targets.resize(B);
+        classes.resize(C);
+        slots.assign(K, none);
+
+        w      = etl::dyn_matrix<T, 2>(C, V);
+        b      = etl::dyn_matrix<T, 1>(C);
+        output = etl::dyn_matrix<T, 2>(B, C);
+        errors = etl::dyn_matrix<T, 2>(B, C);
+        w_grad = etl::dyn_matrix<T, 2>(C, V);
+        b_grad = etl::dyn_matrix<T, 1>(C);
+    }
+
+    /*!
+     * \brief Select the candidates of the batch: the targets of the
+     * samples and classes sampled without replacement among the others
+     *
+     * \param y The categorical labels (n x K)
+     * \param n The number of samples of the batch
+     */
+    template <typename L>
+    void select(const L* y, size_t n) {
+        // The slots of the previous batch
+        for (auto c : classes) {
+            slots[c] = none;
+        }
+
+        n_targets = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            const L* yi = y + i * K;
+
+            targets[i] = std::max_element(yi, yi + K) - yi;
+
+            if (slots[targets[i]] == none) {
+                slots[targets[i]]    = n_targets;
+                classes[n_targets++] = targets[i];
+            }
+        }
+
+        auto& g = dll::rand_engine();
+
+        const size_t others = K - n_targets;
+        const size_t wanted = C - n_targets;
+
+        if (2 * wanted > others) {
+            // Most of the classes are needed, partial shuffle of all the others
+            std::vector<size_t> pool;
+            pool.reserve(others);
+
+            for (size_t k = 0; k < K; ++k) {
+                if (slots[k] == none) {
+                    pool.push_back(k);
+                }
+            }
+
+            for (size_t s = 0; s < wanted; ++s) {
+                std::uniform_int_distribution<size_t> dist(s, others - 1);
+                std::swap(pool[s], pool[dist(g)]);
+
+                slots[pool[s]]         = n_targets + s;
+                classes[n_targets + s] = pool[s];
+            }
+        } else {
+            std::uniform_int_distribution<size_t> dist(0, K - 1);
+
+            for (size_t s = n_targets; s < C;) {
+                const size_t k = dist(g);
+
+                if (slots[k] == none) {
+                    slots[k]   = s;
+                    classes[s] = k;
+                    ++s;
+                }
+            }
+        }
+
+        // Each other class is sampled with a probability of wanted / others
+        correction = wanted ? std::log(double(others) / double(wanted)) : 0.0;
+    }
+
+    /*!
+     * \brief Gather the weights and the biases of the candidates
+     * \param lw The weights of the layer (V x K)
+     * \param lb The biases of the layer, nullptr if the layer has none
+     */
+    void gather(const T* lw, const T* lb) {
+        T* cw = w.memory_start();
+
+        for (size_t v = 0; v < V; ++v) {
+            const T* row = lw + v * K;
+
+            for (size_t c = 0; c < C; ++c) {
+                cw[c * V + v] = row[classes[c]];
+            }
+        }
+
+        for (size_t c = 0; c < C; ++c) {
+            b[c] = lb ? lb[classes[c]] : T(0);
+        }
+
+        host_written(w, b);
+    }
+
+    /*!
+     * \brief Compute the softmax of the candidates from the logits and the
+     * errors of the batch, with the metrics of the batch
+     *
+     * \param n The number of samples of the batch
+     * \param metrics Indicates if the metrics are computed
+     * \return The sums of the errors and of the losses of the samples
+     */
+    std::pair<double, double> compute_errors(size_t n, bool metrics) {
+        host_read(output);
+
+        T* o = output.memory_start();
+        T* e = errors.memory_start();
+
+        const T corr = T(correction);
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t i = 0; i < B; ++i) {
+            T* oi = o + i * C;
+            T* ei = e + i * C;
+
+            if (i >= n) {
+                std::fill(ei, ei + C, T(0));
+                continue;
+            }
+
+            for (size_t c = n_targets; c < C; ++c) {
+                oi[c] += corr;
+            }
+
+            const T m = *std::max_element(oi, oi + C);
+
+            T s = T(0);
+
+            for (size_t c = 0; c < C; ++c) {
+                oi[c] = std::exp(oi[c] - m);
+                s += oi[c];
+            }
+
+            const size_t t = slots[targets[i]];
+
+            for (size_t c = 0; c < C; ++c) {
+                oi[c] /= s;
+                ei[c] = -oi[c];
+            }
+
+            ei[t] += T(1);
+
+            if (metrics) {
+                loss -= std::log(std::max(double(oi[t]), 1e-30));
+                error += size_t(std::max_element(oi, oi + C) - oi) != t;
+            }
+        }
+
+        host_written(output, errors);
+
+        return {error, loss};
+    }
+
+    /*!
+     * \brief Scatter the gradients of the candidates into the gradients of
+     * the layer, the gradients of the other classes being zero
+     *
+     * \param gw The gradients of the weights of the layer (V x K)
+     * \param gb The gradients of the biases of the layer, nullptr if the layer has none
+     */
+    void scatter(T* gw, T* gb) {
+        host_read(w_grad, b_grad);
+
+        const T* cg = w_grad.memory_start();
+
+        std::fill(gw, gw + V * K, T(0));
+
+        for (size_t v = 0; v < V; ++v) {
+            T* row = gw + v * K;
+
+            for (size_t c = 0; c < C; ++c) {
+                row[classes[c]] = cg[c * V + v];
+            }
+        }
+
+        if (gb) {
+            std::fill(gb, gb + K, T(0));
+
+            for (size_t c = 0; c < C; ++c) {
+                gb[classes[c]] = b_grad[c];
+            }
+        }
+    }
+};
+
+} //end of dll namespace
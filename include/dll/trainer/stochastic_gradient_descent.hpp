@@ -15,12 +15,32 @@
 
 #pragma once
 
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #include "cpp_utils/static_if.hpp"
 #include "cpp_utils/tuple_utils.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+#include "cpp_utils/io.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
+#include "dll/layer_fwd.hpp"           // For the sampled softmax layers
+#include "dll/util/arena.hpp"          // For memory_arena
 #include "dll/util/checks.hpp"         // For NaN checks
 #include "dll/util/timers.hpp"         // For auto_timer
+#include "dll/util/flight_recorder.hpp" // For flight_batch
+#include "dll/util/distributed.hpp"    // For multi-node training
+#include "dll/util/compression.hpp"    // For compressed gradients
+#include "dll/util/affinity.hpp"       // For pin_pool_thread and the NUMA nodes
+#include "dll/util/scheduler.hpp"      // For the asynchronous updates
+#include "dll/util/block_sparse.hpp"   // For the masks of the block-sparse weights
+#include "dll/trainer/loss_kernels.hpp" // For the errors of the last layer
+#include "dll/trainer/sampled_softmax.hpp" // For the sampled softmax
+#include "dll/trainer/updater_kernels.hpp" // For the fused updaters
+#include "dll/trainer/checkpointing.hpp"   // For the gradient checkpointing
+#include "dll/lr_schedule.hpp"            // For the schedules of the learning rate
 
 namespace dll {
 
@@ -49,6 +69,14 @@ auto build_sub_context(Layer& layer) {
     return build_sub_context<SubContext, UT>(layer, std::make_index_sequence<N>());
 }
 
+/*!
+ * \brief Indicates if the updater is computed by a fused kernel, with the
+ * weight decay and the gradient clipping
+ */
+constexpr bool is_fused_updater(updater_type UT) {
+    return UT == updater_type::ADAM || UT == updater_type::NADAM || UT == updater_type::RMSPROP || UT == updater_type::ADADELTA;
+}
+
 /*!
  * \brief The sub context for a specific updater
  * \param Layer The layer to optimize
@@ -77,6 +105,15 @@ struct updater_sub_context <Layer, I, updater_type::SGD> {
     updater_sub_context(Layer& layer) : grad(std::get<I>(layer.trainable_parameters())) {
         grad = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training (the SGD updater has no state)
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        cpp_unused(functor);
+    }
 };
 
 /*!
@@ -100,6 +137,15 @@ struct updater_sub_context <Layer, I, updater_type::MOMENTUM> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(inc);
+    }
 };
 
 /*!
@@ -125,6 +171,16 @@ struct updater_sub_context <Layer, I, updater_type::NESTEROV> {
         inc = 0;
         inc_prev = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(inc);
+        functor(inc_prev);
+    }
 };
 
 /*!
@@ -148,6 +204,15 @@ struct updater_sub_context <Layer, I, updater_type::RMSPROP> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(inc);
+    }
 };
 
 /*!
@@ -171,6 +236,15 @@ struct updater_sub_context <Layer, I, updater_type::ADAGRAD> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(inc);
+    }
 };
 
 /*!
@@ -184,19 +258,27 @@ struct updater_sub_context <Layer, I, updater_type::ADADELTA> {
     using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
 
     type grad; ///< The gradients of the variable
-    type g;
-    type x;
-    type v;
+    type g;    ///< Moving average of the squared gradients
+    type x;    ///< Moving average of the squared updates
 
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
      */
-    updater_sub_context(Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), g(grad), x(grad), v(grad) {
+    updater_sub_context(Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), g(grad), x(grad) {
         grad = 0;
         g = 0;
         x = 0;
-        v = 0;
+    }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(g);
+        functor(x);
     }
 };
 
@@ -223,6 +305,16 @@ struct updater_sub_context <Layer, I, updater_type::ADAM> {
         m = 0;
         v = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(m);
+        functor(v);
+    }
 };
 
 /*!
@@ -252,6 +344,18 @@ struct updater_sub_context <Layer, I, updater_type::ADAM_CORRECT> {
         v = 0;
         vt = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(m);
+        functor(mt);
+        functor(v);
+        functor(vt);
+    }
 };
 
 /*!
@@ -266,25 +370,32 @@ struct updater_sub_context <Layer, I, updater_type::NADAM> {
 
     type grad; ///< The gradients of the variable
     type m;    ///< Estimates of the first moment of the gradient
-    type mt;   ///< Corrected estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
-    type vt;   ///< Corrected estimates of the second moment of the gradient
 
-    double m_schedule;
+    double m_schedule; ///< The product of the momentum schedule
 
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
      */
-    updater_sub_context(Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), mt(grad), v(grad), vt(grad) {
+    updater_sub_context(Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad) {
         grad = 0;
         m = 0;
-        mt = 0;
         v = 0;
-        vt = 0;
 
         m_schedule = 1.0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(m);
+        functor(v);
+        functor(m_schedule);
+    }
 };
 
 /*!
@@ -310,6 +421,16 @@ struct updater_sub_context <Layer, I, updater_type::ADAMAX> {
         m = 0;
         v = 0;
     }
+
+    /*!
+     * \brief Call the functor on each part of the state of the updater,
+     * for the checkpoints of the training
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(m);
+        functor(v);
+    }
 };
 
 
@@ -344,6 +465,153 @@ struct updater_context<UT, true, Layer> {
     }
 };
 
+/*!
+ * \brief Call the functor on each part of the state of an updater context
+ * (no state for the layers without parameters)
+ */
+template <updater_type UT, typename Layer, typename Functor>
+void for_each_updater_state(updater_context<UT, false, Layer>& up, Functor&& functor) {
+    cpp_unused(up);
+    cpp_unused(functor);
+}
+
+/*!
+ * \brief Call the functor on each part of the state of an updater context
+ */
+template <updater_type UT, typename Layer, typename Functor>
+void for_each_updater_state(updater_context<UT, true, Layer>& up, Functor&& functor) {
+    cpp::for_each(up.context, [&functor](auto& sub_context) {
+        sub_context->for_each_state(functor);
+    });
+}
+
+/*!
+ * \brief Call the functor on each variable of a layer, on its gradients
+ * and on the state of its updater (nothing for the layers without
+ * parameters)
+ */
+template <updater_type UT, typename Layer, typename Functor>
+void for_each_training_tensor(updater_context<UT, false, Layer>& up, Layer& layer, Functor&& functor) {
+    cpp_unused(up);
+    cpp_unused(layer);
+    cpp_unused(functor);
+}
+
+/*!
+ * \brief Call the functor on each variable of a layer, on its gradients
+ * and on the state of its updater
+ */
+template <updater_type UT, typename Layer, typename Functor>
+void for_each_training_tensor(updater_context<UT, true, Layer>& up, Layer& layer, Functor&& functor) {
+    auto parameters = layer.trainable_parameters();
+
+    cpp::for_each(parameters, [&functor](auto& variable) {
+        functor(variable.get());
+    });
+
+    cpp::for_each(up.context, [&functor](auto& sub_context) {
+        functor(sub_context->grad);
+        sub_context->for_each_state(functor);
+    });
+}
+
+/*!
+ * \brief Mover of the tensors of the training on a NUMA node
+ */
+struct node_mover {
+    size_t node; ///< The NUMA node
+
+    /*!
+     * \brief Move a tensor on the node
+     */
+    template <typename T>
+    void operator()(T& tensor) {
+        move_to_node(tensor.memory_start(), etl::size(tensor) * sizeof(etl::value_t<T>), node);
+    }
+
+    /*!
+     * \brief A scalar of the state stays in the context
+     */
+    void operator()(double& value) {
+        cpp_unused(value);
+    }
+};
+
+/*!
+ * \brief Writer of the state of the updaters in a binary stream. The size of
+ * each tensor is written before its values.
+ */
+struct updater_state_writer {
+    std::ostream& os; ///< The stream to write to
+
+    /*!
+     * \brief Write a tensor of the state
+     */
+    template <typename T>
+    void operator()(const T& tensor) {
+        cpp::binary_write(os, size_t(etl::size(tensor)));
+        cpp::binary_write_all(os, tensor);
+    }
+
+    /*!
+     * \brief Write a scalar of the state
+     */
+    void operator()(double value) {
+        cpp::binary_write(os, value);
+    }
+};
+
+/*!
+ * \brief Reader of the state of the updaters from a binary stream
+ */
+struct updater_state_reader {
+    std::istream& is; ///< The stream to read from
+    bool valid;       ///< Indicates if the state read so far is valid
+
+    /*!
+     * \brief Read a tensor of the state, checking its size
+     */
+    template <typename T>
+    void operator()(T& tensor) {
+        size_t size = 0;
+        cpp::binary_load(is, size);
+
+        if (!is || size != etl::size(tensor)) {
+            valid = false;
+            return;
+        }
+
+        cpp::binary_load_all(is, tensor);
+    }
+
+    /*!
+     * \brief Read a scalar of the state
+     */
+    void operator()(double& value) {
+        cpp::binary_load(is, value);
+    }
+};
+
+/*!
+ * \brief Reset of the state of the updaters, for a new training
+ */
+struct updater_state_reset {
+    /*!
+     * \brief Reset a tensor of the state
+     */
+    template <typename T>
+    void operator()(T& tensor) {
+        tensor = 0;
+    }
+
+    /*!
+     * \brief Reset a scalar of the state (the products of the schedules)
+     */
+    void operator()(double& value) {
+        value = 1.0;
+    }
+};
+
 /*!
  * \brief The full SGD context, it contains the context of the layer as well as
  * the context for the SGD updater
@@ -365,17 +633,62 @@ struct full_sgd_context : sgd_context<DBN, Layer, L> {
     }
 };
 
+/*!
+ * \brief View of a DBN with a smaller batch size.
+ *
+ * This is used to build the contexts of the data-parallel replicas, each of
+ * them only holding a part of the batch.
+ *
+ * \tparam DBN The DBN being trained
+ * \tparam B The batch size of the replica
+ */
+template <typename DBN, size_t B>
+struct sgd_replica_dbn {
+    using weight = typename DBN::weight; ///< The data type of the network
+
+    template <size_t N>
+    using layer_type = typename DBN::template layer_type<N>; ///< The type of the layer at index Nth
+
+    static constexpr size_t layers     = DBN::layers;  ///< The number of layers
+    static constexpr size_t batch_size = B;            ///< The batch size of the replica
+    static constexpr auto updater      = DBN::updater; ///< The Updater type
+};
+
+/*!
+ * \brief The context of a data-parallel replica.
+ *
+ * Only the gradients are necessary in the replica, the state of the
+ * updater is kept in the main context.
+ */
+template <typename DBN, typename Layer, size_t L>
+struct replica_sgd_context : sgd_context<DBN, Layer, L> {
+    using context_type = sgd_context<DBN, Layer, L>; ///< The parent context type
+
+    /*!
+     * \brief The updater context, only holding the gradients
+     */
+    updater_context<updater_type::SGD, decay_layer_traits<Layer>::is_neural_layer(), Layer> up;
+
+    /*!
+     * \brief Construct the replica_sgd_context for the given layer
+     */
+    replica_sgd_context(Layer& layer) : context_type(layer), up(layer) {
+        // Nothing else to init
+    }
+};
+
 /*!
  * \brief Build the context for a DBN for the given sequence of layers
  * \param dbn The DBN to build the context from
+ * \tparam CDBN The network type used to configure the contexts
  */
-template<template<typename, typename, size_t> class Context, typename DBN, size_t... I>
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN, size_t... I>
 auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
     return std::make_tuple
         (
             (std::make_pair(
                 std::ref(dbn.template layer_get<I>()),  // Reference to the layer
-                std::make_shared<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+                std::make_shared<Context<CDBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
             )...
         );
 }
@@ -386,9 +699,128 @@ auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
  */
 template<template<typename, typename, size_t> class Context, typename DBN>
 auto build_context(DBN& dbn){
-    return build_context<Context>(dbn, std::make_index_sequence<DBN::layers>());
+    return build_context<Context, DBN>(dbn, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief Build the context for a DBN, configured by another network type
+ * \param dbn The DBN to build the context from
+ * \tparam CDBN The network type used to configure the contexts
+ */
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN>
+auto build_context(DBN& dbn){
+    return build_context<Context, CDBN>(dbn, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief Build the context for a DBN for the given sequence of layers,
+ * allocating the contexts inside the given arena.
+ * \param dbn The DBN to build the context from
+ * \param arena The arena to allocate the contexts from
+ * \tparam CDBN The network type used to configure the contexts
+ */
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN, size_t... I>
+auto build_context(DBN& dbn, memory_arena& arena, std::index_sequence<I...> /*seq*/){
+    return std::make_tuple
+        (
+            (std::make_pair(
+                std::ref(dbn.template layer_get<I>()),  // Reference to the layer
+                arena.template make_shared<Context<CDBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+            )...
+        );
+}
+
+/*!
+ * \brief Build the context for a DBN inside the given arena
+ * \param dbn The DBN to build the context from
+ * \param arena The arena to allocate the contexts from
+ */
+template<template<typename, typename, size_t> class Context, typename DBN>
+auto build_context(DBN& dbn, memory_arena& arena){
+    return build_context<Context, DBN>(dbn, arena, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief Build the context for a DBN inside the given arena, configured by
+ * another network type
+ * \param dbn The DBN to build the context from
+ * \param arena The arena to allocate the contexts from
+ * \tparam CDBN The network type used to configure the contexts
+ */
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN>
+auto build_context(DBN& dbn, memory_arena& arena){
+    return build_context<Context, CDBN>(dbn, arena, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief Compute the size necessary in an arena to hold the contexts of a DBN
+ * \tparam CDBN The network type used to configure the contexts
+ */
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN, size_t... I>
+constexpr size_t context_arena_size(std::index_sequence<I...> /*seq*/){
+    const size_t sizes[] = {memory_arena::aligned_size(sizeof(Context<CDBN, typename DBN::template layer_type<I>, I>))...};
+
+    size_t size = 0;
+
+    for (auto s : sizes) {
+        size += s;
+    }
+
+    return size;
+}
+
+/*!
+ * \brief Compute the size necessary in an arena to hold the contexts of a DBN
+ * \tparam CDBN The network type used to configure the contexts
+ */
+template<template<typename, typename, size_t> class Context, typename CDBN, typename DBN>
+constexpr size_t context_arena_size(){
+    return context_arena_size<Context, CDBN, DBN>(std::make_index_sequence<DBN::layers>());
 }
 
+/*!
+ * \brief Traits to test if a layer is activated with a sigmoid
+ */
+template <typename Layer, typename Enable = void>
+struct is_sigmoid_layer : std::false_type {};
+
+/*!
+ * \copydoc is_sigmoid_layer
+ */
+template <typename Layer>
+struct is_sigmoid_layer<Layer, std::enable_if_t<Layer::activation_function == function::SIGMOID>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can be trained with a sampled softmax
+ */
+template <typename Layer, typename Enable = void>
+struct is_sampled_softmax_layer : std::false_type {};
+
+/*!
+ * \copydoc is_sampled_softmax_layer
+ */
+template <typename Desc>
+struct is_sampled_softmax_layer<dense_layer_impl<Desc>, std::enable_if_t<Desc::activation_function == function::SOFTMAX>> : std::true_type {};
+
+/*!
+ * \copydoc is_sampled_softmax_layer
+ */
+template <typename Desc>
+struct is_sampled_softmax_layer<dyn_dense_layer_impl<Desc>, std::enable_if_t<Desc::activation_function == function::SOFTMAX>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer unpools at the maximums of a max pooling
+ * layer
+ */
+template <typename Layer, typename Enable = void>
+struct is_max_unpooling_layer : std::false_type {};
+
+/*!
+ * \copydoc is_max_unpooling_layer
+ */
+template <typename Layer>
+struct is_max_unpooling_layer<Layer, std::enable_if_t<Layer::desc::max_unpooling>> : std::true_type {};
+
 /*!
  * \brief Simple gradient descent trainer
  */
@@ -401,9 +833,69 @@ struct sgd_trainer {
     static constexpr auto layers     = dbn_t::layers;     ///< The number of layers
     static constexpr auto batch_size = dbn_t::batch_size; ///< The batch size for training
 
+    static constexpr size_t workers            = dbn_traits<dbn_t>::data_parallel(); ///< The number of data-parallel threads
+    static constexpr size_t replica_batch_size = batch_size / workers;               ///< The batch size of each replica
+
+    using replica_dbn_t     = sgd_replica_dbn<dbn_t, replica_batch_size>;                         ///< The network view of the replicas
+    using replica_context_t = decltype(build_context<replica_sgd_context, replica_dbn_t>(std::declval<dbn_t&>())); ///< The context of a replica
+
+    /*!
+     * \brief The size of the arena holding all the contexts
+     */
+    static constexpr size_t arena_size =
+            context_arena_size<full_sgd_context, dbn_t, dbn_t>()
+        +   (workers > 1 ? workers * context_arena_size<replica_sgd_context, replica_dbn_t, dbn_t>() : 0);
+
     dbn_t& dbn;                                                  ///< The DBN being trained
+    memory_arena arena;                                          ///< The arena holding all the contexts
     decltype(build_context<full_sgd_context>(dbn)) full_context; ///< The context
     size_t iteration;                                            ///< The current iteration
+    size_t horizon = 0;                                          ///< The total number of iterations of the training, for the schedules
+    weight step_eps = 0;                                         ///< The learning rate of the current step
+
+    std::vector<replica_context_t> replicas; ///< The contexts of the data-parallel replicas
+    cpp::thread_pool<(workers > 1)> pool;    ///< The pool of threads for data-parallel training
+
+    static constexpr size_t stages = dbn_traits<dbn_t>::pipeline_parallel(); ///< The number of pipeline stages
+
+    std::array<size_t, stages + 1> stage_begins{}; ///< The first layer of each pipeline stage, followed by the number of layers
+
+    std::vector<std::future<void>> reductions; ///< The pending sums of the gradients over the ranks
+    std::deque<std::vector<weight>> residuals;  ///< The residuals of the compressed gradients, in the order of the sums
+    size_t next_residual = 0;                   ///< The index of the residual of the next sum
+
+    std::atomic<size_t> pending_updates{0}; ///< The number of updates of the layers not yet done
+
+    size_t context_batch = batch_size; ///< The number of samples held by the contexts
+
+    size_t micro_batch         = 0;                  ///< The index of the current batch among the accumulated batches
+    size_t accumulated_samples = 0;                  ///< The number of samples of the previous accumulated batches
+    std::vector<std::vector<std::vector<weight>>> accumulated_grads; ///< The accumulated gradients of each variable of each layer
+
+    bool checkpointing = false;                                  ///< Indicates if the activations are recomputed during the backward pass
+    std::vector<size_t> segments;                                ///< The first layer of the segment of each layer (layers if not recomputed)
+    std::vector<checkpointing_detail::shape_t> input_shapes;     ///< The shape of the input of each layer
+    std::vector<checkpointing_detail::shape_t> output_shapes;    ///< The shape of the output of each layer
+
+    bool record_losses = false;        ///< Indicates if the loss of each sample of the batches is recorded (importance sampling)
+    std::vector<weight> sample_losses; ///< The loss of each sample of the last batch (if recorded)
+
+    /*!
+     * \brief Indicates if the last layer can be trained with a sampled
+     * softmax (a dense softmax layer with the categorical cross entropy)
+     */
+    static constexpr bool sampled_supported =
+                layers > 1
+            &&  dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY
+            &&  is_sampled_softmax_layer<typename dbn_t::template layer_type<layers - 1>>::value;
+
+    sampled_softmax_workspace<weight> sampled; ///< The workspace of the sampled softmax of the last layer
+
+#ifdef ETL_GPU
+    static constexpr bool async_updates = false; ///< Indicates if the layers are updated while backpropagating
+#else
+    static constexpr bool async_updates = true; ///< Indicates if the layers are updated while backpropagating
+#endif
 
     // Transform layers need to inherit dimensions from back
 
@@ -432,246 +924,1816 @@ struct sgd_trainer {
      * \brief construct a new sgd_trainer
      * \param dbn The DBN being trained
      */
-    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn)), iteration(1) {
-        // Inherit dimensions from front to end (for transform layers)
+    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), arena(arena_size), full_context(build_context<full_sgd_context>(dbn, arena)), iteration(1), pool(workers) {
+        // The dynamic contexts hold the batches of the runtime batch size
+
+        if /*constexpr*/ (workers == 1) {
+            context_batch = dbn.runtime_batch_size();
+
+            if (context_batch < batch_size) {
+                cpp::for_each(full_context, [this](auto& layer_ctx) {
+                    this_type::resize_batch(layer_ctx.second->input, context_batch);
+                    this_type::resize_batch(layer_ctx.second->output, context_batch);
+                    this_type::resize_batch(layer_ctx.second->errors, context_batch);
+                });
+            }
+        }
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
-            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+        // Inherit dimensions from front to end (for transform layers)
 
-            if (l2_transform) {
-                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
-            }
-        });
-    }
+        inherit_dimensions(full_context);
+        link_unpooling(full_context);
 
-    /*!
-     * \brief Initialize the training
-     */
-    void init_training(size_t) {}
+        accumulated_grads.resize(layers);
 
-    // CPP17 Replace SFINAE with if constexpr
+        if /*constexpr*/ (dbn_traits<dbn_t>::gradient_checkpointing() && workers == 1) {
+            init_checkpointing();
+        }
 
-    /*!
-     * \brief Compute the errors of the last layer given the loss function
-     */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+        // Prepare one context per thread for data-parallel training
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        if /*constexpr*/ (workers > 1) {
+            replicas.reserve(workers);
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = labels(i) - last_ctx.output(i);
+            for (size_t t = 0; t < workers; ++t) {
+                replicas.push_back(build_context<replica_sgd_context, replica_dbn_t>(dbn, arena));
+                inherit_dimensions(replicas.back());
+                link_unpooling(replicas.back());
             }
-        } else {
-            last_ctx.errors = labels - last_ctx.output;
         }
 
-        // Note: No need to multiply by the derivative of
-        // the activation function since the terms are
-        // canceling out in the derivative of the loss
+        if /*constexpr*/ (stages > 1) {
+            init_pipeline();
+        }
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Split the layers between the pipeline stages and move the
+     * memory of the layers of each stage on its NUMA node.
+     *
+     * The stages are contiguous ranges of layers with about the same number
+     * of parameters, since the wide layers are limited by the bandwidth of
+     * their weights.
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    void init_pipeline() {
+        std::array<size_t, layers> costs;
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        size_t total = 0;
+        size_t l     = 0;
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = 2.0 * (labels(i) - last_ctx.output(i));
-            }
-        } else {
-            last_ctx.errors = 2.0 * (labels - last_ctx.output);
-        }
+        cpp::for_each(full_context, [&costs, &total, &l](auto& layer_ctx) {
+            costs[l] = 1;
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
-    }
+            cpp::static_if<decay_layer_traits<decltype(layer_ctx.first)>::is_neural_layer()>([&](auto f) {
+                costs[l] += f(layer_ctx.first).parameters();
+            });
 
-    /*!
-     * \brief Compute the errors of the last layer given the loss function
-     */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+            total += costs[l++];
+        });
 
-        // Avoid Nan from division by ((1 - out) * out)
-        auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+        stage_begins[0]      = 0;
+        stage_begins[stages] = layers;
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        size_t cumulative = 0;
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = (labels(i) - out(i)) / ((1.0 - out(i)) >> out(i));
+        l = 0;
+
+        for (size_t s = 1; s < stages; ++s) {
+            // Each stage has at least one layer
+            while (l < layers - (stages - s) && (l <= stage_begins[s - 1] || cumulative + costs[l] / 2 <= s * total / stages)) {
+                cumulative += costs[l++];
             }
-        } else {
-            last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
+
+            stage_begins[s] = l;
         }
 
-        // Check for NAN before derivative
-        nan_check_etl(last_ctx.errors);
+        // The weights, the contexts and the state of the updater of the
+        // layers of a stage are moved on its node, the pages of the
+        // memory already being allocated
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
+        l = 0;
 
-        // Check for NAN after derivative
+        cpp::for_each(full_context, [this, &l](auto& layer_ctx) {
+            node_mover mover{this->stage_node(this->stage_of(l++))};
+
+            for_each_training_tensor(layer_ctx.second->up, layer_ctx.first, mover);
+
+            mover(layer_ctx.second->input);
+            mover(layer_ctx.second->output);
+            mover(layer_ctx.second->errors);
+        });
+
+        for (auto& context : replicas) {
+            l = 0;
+
+            cpp::for_each(context, [this, &l](auto& layer_ctx) {
+                node_mover mover{this->stage_node(this->stage_of(l++))};
+
+                for_each_training_tensor(layer_ctx.second->up, layer_ctx.first, mover);
+
+                mover(layer_ctx.second->input);
+                mover(layer_ctx.second->output);
+                mover(layer_ctx.second->errors);
+            });
+        }
+    }
+
+    /*!
+     * \brief Returns the pipeline stage of the given layer
+     */
+    size_t stage_of(size_t l) const {
+        size_t s = 0;
+
+        while (s + 1 < stages && stage_begins[s + 1] <= l) {
+            ++s;
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Returns the NUMA node of the given pipeline stage
+     */
+    static size_t stage_node(size_t s) {
+        return s * numa_nodes() / stages;
+    }
+
+    /*!
+     * \brief Inherit the dimensions of the transform layers in the
+     * given context
+     * \param context The context to initialize
+     */
+    template <typename Context>
+    static void inherit_dimensions(Context& context){
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+
+            if (l2_transform) {
+                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
+            }
+        });
+    }
+
+    /*!
+     * \brief Give the max unpooling layers of the context the positions of
+     * the maximums of their max pooling layer
+     */
+    template <typename Context>
+    static void link_unpooling(Context& context){
+        cpp::for_each(context, [&context](auto& layer_ctx) {
+            this_type::template link_unpooling_layer<std::decay_t<decltype(layer_ctx.first)>>(context, *layer_ctx.second);
+        });
+    }
+
+    /*!
+     * \brief Give a max unpooling layer the positions of the maximums of
+     * its max pooling layer
+     */
+    template <typename Layer, typename Context, typename C, cpp_enable_iff(is_max_unpooling_layer<Layer>::value)>
+    static void link_unpooling_layer(Context& context, C& ctx){
+        static_assert(Layer::desc::pool_layer < layers, "Invalid max pooling layer for max unpooling");
+
+        auto& pool_ctx = *std::get<Layer::desc::pool_layer>(context).second;
+
+        cpp_assert(etl::size(pool_ctx.output) == etl::size(ctx.input), "The max unpooling layer must match its max pooling layer");
+
+        ctx.pool_indices = &pool_ctx.indices;
+    }
+
+    /*!
+     * \copydoc link_unpooling_layer
+     */
+    template <typename Layer, typename Context, typename C, cpp_disable_if(is_max_unpooling_layer<Layer>::value)>
+    static void link_unpooling_layer(Context& /*context*/, C& /*ctx*/){ }
+
+    /*!
+     * \brief Allocate the dynamic buffer of a context for the given number
+     * of samples
+     */
+    template <typename M, cpp_enable_iff(checkpointing_detail::is_releasable<M>::value)>
+    static void resize_batch(M& m, size_t b) {
+        // The buffers of the transform layers are inherited later
+        if (etl::size(m)) {
+            auto s = checkpointing_detail::shape(m);
+            s[0]   = b;
+
+            checkpointing_detail::allocate(m, s, std::make_index_sequence<etl::dimensions<M>()>());
+        }
+    }
+
+    /*!
+     * \copydoc resize_batch
+     */
+    template <typename M, cpp_disable_if(checkpointing_detail::is_releasable<M>::value)>
+    static void resize_batch(M& m, size_t b) {
+        cpp_unused(m);
+        cpp_unused(b);
+    }
+
+    /*!
+     * \brief Choose the segments of the layers whose activations are
+     * recomputed during the backward pass
+     */
+    void init_checkpointing() {
+        std::vector<size_t> bytes(layers, 0);
+
+        input_shapes.resize(layers);
+        output_shapes.resize(layers);
+
+        size_t l = 0;
+
+        cpp::for_each(full_context, [this, &bytes, &l](auto& layer_ctx) {
+            using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+            auto& ctx = *layer_ctx.second;
+
+            input_shapes[l]  = checkpointing_detail::shape(ctx.input);
+            output_shapes[l] = checkpointing_detail::shape(ctx.output);
+
+            // The output of the last layer is necessary for its errors
+            if (checkpointing_detail::is_recomputable<layer_t> && l + 1 < layers) {
+                bytes[l] = checkpointing_detail::releasable_bytes(ctx.input) + checkpointing_detail::releasable_bytes(ctx.output);
+            }
+
+            ++l;
+        });
+
+        segments = checkpointing_detail::choose_segments(bytes);
+
+        checkpointing = std::any_of(segments.begin(), segments.end(), [](size_t first) { return first != layers; });
+    }
+
+    /*!
+     * \brief Indicates if the activations are recomputed for the current batch
+     */
+    bool recompute() const {
+        return checkpointing && !distributed::active();
+    }
+
+    /*!
+     * \brief Returns the index of the first layer that is not frozen, the
+     * number of layers if all of them are frozen
+     */
+    size_t first_trainable() const {
+        size_t l = 0;
+
+        while (l < layers && dbn.frozen[l]) {
+            ++l;
+        }
+
+        return l;
+    }
+
+    /*!
+     * \brief Release the activations of the given layer, if it is recomputed.
+     *
+     * The input of the first layer of a segment is the checkpoint of the
+     * segment, it is kept.
+     */
+    template <typename LayerCtx>
+    void release_activations(LayerCtx& layer_ctx, size_t l) {
+        if (segments[l] != layers) {
+            auto& ctx = *layer_ctx.second;
+
+            if (segments[l] != l) {
+                checkpointing_detail::release(ctx.input);
+            }
+
+            checkpointing_detail::release(ctx.output);
+        }
+    }
+
+    /*!
+     * \brief Allocate the activations of the given layer again, if they
+     * have been released
+     */
+    template <typename LayerCtx>
+    void restore_activations(LayerCtx& layer_ctx, size_t l) {
+        if (checkpointing) {
+            auto& ctx = *layer_ctx.second;
+
+            checkpointing_detail::restore(ctx.input, input_shapes[l]);
+            checkpointing_detail::restore(ctx.output, output_shapes[l]);
+        }
+    }
+
+    /*!
+     * \brief Forward again the segment ending at the given layer, from its
+     * checkpoint, before its backpropagation
+     * \param l The layer about to be backpropagated
+     */
+    void recompute_segment(size_t l) {
+        const size_t first = segments[l];
+
+        // Only done once, before the last layer of the segment
+        if (first == layers || (l + 1 < layers && segments[l + 1] == first)) {
+            return;
+        }
+
+        dll::auto_timer timer("sgd::recompute");
+
+        size_t k = 0;
+
+        cpp::for_each(full_context, [this, first, &k](auto& layer_ctx) {
+            if (k == first) {
+                dll::profile_layer layer_scope(k);
+
+                this->restore_activations(layer_ctx, k);
+
+                layer_ctx.first.train_forward_context(*layer_ctx.second);
+            }
+
+            ++k;
+        });
+
+        k = 0;
+
+        cpp::for_each_pair(full_context, [this, first, l, &k](auto& layer_ctx_1, auto& layer_ctx_2) {
+            ++k;
+
+            if (k > first && k <= l) {
+                dll::profile_layer layer_scope(k);
+
+                this->restore_activations(layer_ctx_2, k);
+
+                layer_ctx_2.second->input = layer_ctx_1.second->output;
+
+                layer_ctx_2.first.train_forward_context(*layer_ctx_2.second);
+            }
+        });
+    }
+
+    /*!
+     * \brief Initialize the training
+     *
+     * In distributed mode, the parameters of rank 0 are copied to all the
+     * ranks so that all the ranks start from the same network.
+     */
+    void init_training(size_t) {
+        if (distributed::active()) {
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                this_type::broadcast_parameters(layer_ctx.first);
+            });
+        }
+    }
+
+    /*!
+     * \brief Write the state of the training (the state of the updaters
+     * and the counter of iterations) to the given stream.
+     *
+     * Together with the parameters of the network, this is enough to
+     * resume a training on the same trajectory.
+     */
+    void store_state(std::ostream& os) {
+        cpp::binary_write(os, iteration);
+
+        updater_state_writer writer{os};
+
+        cpp::for_each(full_context, [&writer](auto& layer_ctx) {
+            for_each_updater_state(layer_ctx.second->up, writer);
+        });
+    }
+
+    /*!
+     * \brief Read the state of the training from the given stream
+     * \return true if the state has been read, false if it is not valid
+     * for this network
+     */
+    bool load_state(std::istream& is) {
+        size_t it = 0;
+        cpp::binary_load(is, it);
+
+        updater_state_reader reader{is, bool(is)};
+
+        cpp::for_each(full_context, [&reader](auto& layer_ctx) {
+            if (reader.valid) {
+                for_each_updater_state(layer_ctx.second->up, reader);
+            }
+        });
+
+        if (!reader.valid || !is) {
+            std::cerr << "ERROR: The state of the training is not valid for this network" << std::endl;
+            return false;
+        }
+
+        iteration = it;
+
+        return true;
+    }
+
+    /*!
+     * \brief Indicates if the contexts of the trainer can be kept for a new
+     * training, that is if they still hold batches of the runtime batch
+     * size of the network
+     */
+    bool reusable() const {
+        return workers > 1 || context_batch == dbn.runtime_batch_size();
+    }
+
+    /*!
+     * \brief Reset the state of the training (the state of the updaters, the
+     * counter of iterations and the accumulated gradients) for a new
+     * training, keeping the contexts
+     */
+    void reset_training() {
+        iteration = 1;
+        horizon   = 0;
+        step_eps  = 0;
+
+        updater_state_reset reset;
+
+        cpp::for_each(full_context, [&reset](auto& layer_ctx) {
+            for_each_updater_state(layer_ctx.second->up, reset);
+        });
+
+        micro_batch         = 0;
+        accumulated_samples = 0;
+
+        residuals.clear();
+        next_residual = 0;
+
+        record_losses = false;
+    }
+
+    /*!
+     * \brief Returns the memory used by the training contexts, in bytes.
+     *
+     * This accounts for the arena holding the contexts and for the
+     * dynamically-sized buffers of the contexts. It does not account for
+     * the memory of the updaters.
+     *
+     * \return The training memory of the contexts
+     */
+    size_t training_memory() const {
+        size_t memory = arena.size() + dynamic_memory(full_context);
+
+        for (auto& replica : replicas) {
+            memory += dynamic_memory(replica);
+        }
+
+        return memory;
+    }
+
+    /*!
+     * \brief Returns the memory of a buffer not allocated inside the context
+     */
+    template <typename E>
+    static size_t dynamic_memory_of(const E& e) {
+        return etl::decay_traits<E>::is_fast ? 0 : etl::size(e) * sizeof(etl::value_t<E>);
+    }
+
+    /*!
+     * \brief Returns the memory of the buffers of the given context that were
+     * not allocated inside the arena
+     */
+    template <typename Context>
+    static size_t dynamic_memory(const Context& context) {
+        size_t memory = 0;
+
+        cpp::for_each(context, [&memory](auto& layer_ctx) {
+            auto& ctx = *layer_ctx.second;
+
+            memory += dynamic_memory_of(ctx.input) + dynamic_memory_of(ctx.output) + dynamic_memory_of(ctx.errors);
+        });
+
+        return memory;
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function,
+     * and the metrics of the batch in the same pass over the output
+     *
+     * \param context The context of the network
+     * \param n The number of samples in the batch
+     * \param labels A batch of labels
+     * \param metrics Indicates if the metrics are computed
+     * \param offset The index of the first sample of the labels in the batch, for the soft targets of the distillation
+     *
+     * \return The sums of the errors and of the losses of the samples
+     */
+    template<loss_function F, typename Context, typename Labels>
+    std::pair<double, double> last_errors(Context& context, size_t n, const Labels& labels, bool metrics, size_t offset = 0){
+        auto& last_layer = std::get<layers - 1>(context).first;
+        auto& last_ctx   = *std::get<layers - 1>(context).second;
+
+        using last_layer_t = std::decay_t<decltype(last_layer)>;
+
+        static constexpr bool sigmoid = is_sigmoid_layer<last_layer_t>::value;
+
+        const size_t B = etl::dim<0>(last_ctx.output);
+        const size_t K = etl::size(last_ctx.output) / B;
+
+        decltype(auto) out = direct_memory(last_ctx.output);
+        decltype(auto) y   = direct_memory(labels);
+
+        host_read(out, y);
+
+        std::pair<double, double> result;
+
+        if (F == loss_function::CATEGORICAL_CROSS_ENTROPY && dbn.distillation) {
+            // The hard labels are mixed with the soft targets of the teacher
+            result = loss_detail::distilled_errors(B, n, K, out.memory_start(), y.memory_start(), dbn.distillation->targets + offset * K,
+                                                   last_ctx.errors.memory_start(), dbn.distillation_temperature, dbn.distillation_alpha, metrics);
+        } else {
+            result = loss_detail::last_errors<F, sigmoid>(B, n, K, out.memory_start(), y.memory_start(), last_ctx.errors.memory_start(), metrics);
+        }
+
+        host_written(last_ctx.errors);
+
+        // Note: With CCE (softmax) and BCE with sigmoid, there is no need
+        // to multiply by the derivative of the activation function since
+        // the terms are canceling out in the derivative of the loss
+        if /*constexpr*/ (F == loss_function::MEAN_SQUARED_ERROR || (F == loss_function::BINARY_CROSS_ENTROPY && !sigmoid)) {
+            // Check for NAN before derivative
+            nan_check_etl(last_ctx.errors);
+
+            // Multiply by the derivative of the activation function
+            last_layer.adapt_errors(last_ctx);
+        }
+
+        // Check for NAN
         nan_check_etl(last_ctx.errors);
+
+        return result;
+    }
+
+    /*!
+     * \brief Compute the loss of each sample of the batch from the output
+     * of the last layer
+     *
+     * \param context The context of the network, after the forward pass
+     * \param n The number of samples in the batch
+     * \param labels A batch of labels
+     * \param losses The output loss of each sample
+     */
+    template <typename Context, typename Labels>
+    static void record_sample_losses(Context& context, size_t n, const Labels& labels, weight* losses) {
+        auto& last_ctx = *std::get<layers - 1>(context).second;
+
+        const size_t K = etl::size(last_ctx.output) / etl::dim<0>(last_ctx.output);
+
+        decltype(auto) out = direct_memory(last_ctx.output);
+        decltype(auto) y   = direct_memory(labels);
+
+        host_read(out, y);
+
+        loss_detail::sample_losses<dbn_t::loss>(n, K, out.memory_start(), y.memory_start(), losses);
+    }
+
+    /*!
+     * \brief Compute the learning rate of the current step, shared by all
+     * the variables of all the layers: the decay and the schedule of the
+     * learning rate are computed once per step
+     */
+    void start_step() {
+        double eps = dbn.learning_rate;
+
+        if (dbn.learning_rate_decay > 0.0) {
+            eps *= 1.0 / (1.0 + dbn.learning_rate_decay * iteration);
+        }
+
+        lr_schedule_params params;
+        params.schedule   = dbn.learning_rate_schedule;
+        params.warmup     = dbn.warmup_iterations;
+        params.horizon    = dbn.learning_rate_horizon ? dbn.learning_rate_horizon : horizon;
+        params.step       = dbn.learning_rate_step;
+        params.gamma      = dbn.learning_rate_gamma;
+        params.min_factor = dbn.learning_rate_min;
+
+        step_eps = weight(eps * lr_schedule_factor(params, iteration - 1));
+    }
+
+    /*!
+     * \brief Train a batch of data
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param metrics Indicates if the error and the loss of the batch are computed
+     * \return a pair containing the error and the loss for the batch, -1.0 if not computed
+     *
+     * \tparam S The layer the inputs are given to, the previous layers must be frozen
+     */
+    template <size_t S = 0, typename Inputs, typename Labels, size_t W = workers, cpp_enable_iff(W == 1)>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics = true) {
+        const size_t n = etl::dim<0>(inputs);
+
+        if (record_losses) {
+            sample_losses.resize(n);
+        }
+
+        if (cpp_likely(n <= context_batch)) {
+            return train_step<S>(epoch, inputs, labels, metrics);
+        }
+
+        // The batch is trained by steps of the runtime batch size
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t first = 0; first < n; first += context_batch) {
+            const size_t last = std::min(n, first + context_batch);
+
+            auto step = train_step<S>(epoch, etl::slice(inputs, first, last), etl::slice(labels, first, last), metrics, first);
+
+            error += step.first * (last - first);
+            loss += step.second * (last - first);
+        }
+
+        if (!metrics) {
+            return std::make_pair(-1.0, -1.0);
+        }
+
+        return std::make_pair(error / n, loss / n);
+    }
+
+    /*!
+     * \brief Train a batch of data, held by the contexts, in one step
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param metrics Indicates if the error and the loss of the batch are computed
+     * \param offset The index of the first sample of the step in the batch
+     * \return a pair containing the error and the loss for the batch, -1.0 if not computed
+     */
+    template <size_t S, typename Inputs, typename Labels>
+    std::pair<double, double> train_step(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics, size_t offset = 0) {
+        dll::auto_timer timer("sgd::train_batch");
+
+        start_step();
+
+        auto& first_ctx = *std::get<0>(full_context).second;
+
+        const auto n = etl::dim<0>(inputs);
+
+        dll::flight_batch flight(dll::flight_source::SGD, n);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        // The frozen layers before the first trainable layer are only forwarded
+        const size_t first = first_trainable();
+
+        cpp_assert(first >= S, "The layers before the inputs must be frozen");
+
+        // The checkpoints of the segments are not forwarded from the layer S
+        const bool recomputed = recompute() && S == 0;
+
+        if (sampled_supported && dbn.sampled_softmax && !recomputed && !record_losses && !distributed::active() && !dbn.frozen[layers - 1] && !dbn.distillation) {
+            return sampled_step<S>(epoch, inputs, labels, metrics, first, flight);
+        }
+
+        //Feedforward pass
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            if (recomputed) {
+                // The activations are released as soon as they are consumed
+                forward_batch_context<true, S>(full_context, inputs,
+                        [this](auto& layer_ctx, size_t l) { this->restore_activations(layer_ctx, l); },
+                        [this](auto& layer_ctx, size_t l) { this->release_activations(layer_ctx, l); },
+                        first);
+            } else {
+                forward_batch_context<true, S>(full_context, inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first);
+            }
+        }
+
+        flight.mark(dll::flight_phase::FORWARD);
+
+        if (record_losses) {
+            record_sample_losses(full_context, n, labels, sample_losses.data() + offset);
+
+            flight.mark(dll::flight_phase::METRICS);
+        }
+
+        // The sums of the metrics, computed with the errors of the last layer
+        std::pair<double, double> sums;
+
+        if (distributed::active()) {
+            {
+                dll::auto_timer timer("sgd::backward");
+
+                sums = backward_batch_context(full_context, n, labels, metrics, [](size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first, offset);
+            }
+
+            flight.mark(dll::flight_phase::BACKWARD);
+
+            // Compute and apply the gradients
+
+            dll::auto_timer timer("sgd::grad");
+
+            const bool update = update_step();
+
+            size_t l = 0;
+            size_t global_n = accumulated_samples + n;
+
+            if (update) {
+                submit_samples(global_n);
+            }
+
+            // The sums of the gradients of a layer overlap with the
+            // computation of the gradients of the next layers
+            cpp::for_each(full_context, [this, update, &l](auto& layer_ctx) {
+                dll::profile_layer layer_scope(l);
+
+                if (!dbn.frozen[l]) {
+                    layer_ctx.first.compute_gradients(*layer_ctx.second);
+
+                    this->tie_gradients(full_context, layer_ctx, l);
+
+                    this->accumulate_gradients(layer_ctx, l);
+
+                    if (update) {
+                        this->submit_gradients(layer_ctx.first, *layer_ctx.second);
+                    }
+                }
+
+                ++l;
+            });
+
+            if (update) {
+                wait_reductions();
+
+                l = 0;
+
+                cpp::for_each(full_context, [this, epoch, global_n, &l](auto& layer_ctx) {
+                    if (!dbn.frozen[l++]) {
+                        this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, global_n);
+                    }
+                });
+            }
+
+            flight.mark(dll::flight_phase::UPDATE);
+        } else {
+            dll::auto_timer timer("sgd::backward");
+
+            // The gradients of each layer are computed and applied as soon
+            // as its errors are backpropagated, while the backpropagation
+            // continues with the previous layers
+            auto update = [this, epoch, n, recomputed](auto& layer_ctx, size_t l) {
+                if (!dbn.frozen[l]) {
+                    this->update_layer(epoch, layer_ctx, accumulated_samples + n, l, recomputed);
+                } else if (recomputed) {
+                    this->release_activations(layer_ctx, l);
+                }
+            };
+
+            if (recomputed) {
+                // Each segment is recomputed before its backpropagation
+                sums = backward_batch_context(full_context, n, labels, metrics, [this](size_t l) { this->recompute_segment(l); }, update, first, offset);
+            } else {
+                sums = backward_batch_context(full_context, n, labels, metrics, [](size_t /*l*/) {}, update, first, offset);
+            }
+
+            // The updates are overlapped with the backpropagation, only
+            // the wait for the last ones is measured as update
+            flight.mark(dll::flight_phase::BACKWARD);
+
+            wait_updates();
+
+            flight.mark(dll::flight_phase::UPDATE);
+        }
+
+        next_micro_batch(n);
+
+        if (!metrics) {
+            return std::make_pair(-1.0, -1.0);
+        }
+
+        // Average the error and loss
+
+        const double error = distributed::weighted_average(sums.first / n, n);
+        const double loss  = distributed::weighted_average(sums.second / n, n);
+
+        flight.mark(dll::flight_phase::METRICS);
+
+        return std::make_pair(error, loss);
+    }
+
+    /*!
+     * \brief Train a batch of data in one step, the last layer being
+     * trained with a sampled softmax
+     *
+     * The last layer is not forwarded: the logits of the candidates of
+     * the batch are computed from its input and the weights of the
+     * candidates, the errors are backpropagated from the candidates and
+     * the gradients of the other classes are zero.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param metrics Indicates if the error and the loss of the batch are computed
+     * \param first The first trainable layer
+     * \param flight The timings of the batch
+     * \return a pair containing the error and the loss for the batch, -1.0 if not computed
+     */
+    template <size_t S, typename Inputs, typename Labels, bool Sampled = sampled_supported, cpp_enable_iff(Sampled)>
+    std::pair<double, double> sampled_step(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics, size_t first, dll::flight_batch& flight) {
+        auto& last_layer = std::get<layers - 1>(full_context).first;
+        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+        auto& prev_ctx   = *std::get<layers - 2>(full_context).second;
+
+        using last_layer_t = std::decay_t<decltype(last_layer)>;
+
+        const size_t n = etl::dim<0>(inputs);
+        const size_t B = etl::dim<0>(last_ctx.input);
+        const size_t V = etl::size(last_ctx.input) / B;
+        const size_t K = etl::size(last_ctx.output) / B;
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_context<true, S>(full_context, inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first, layers - 1);
+
+            last_ctx.input = prev_ctx.output;
+        }
+
+        flight.mark(dll::flight_phase::FORWARD);
+
+        dll::auto_timer timer("sgd::backward");
+
+        auto& ws = sampled;
+
+        ws.init(V, K, B, dbn.sampled_softmax);
+
+        // The candidates and their weights
+
+        decltype(auto) y = direct_memory(labels);
+
+        host_read(y, last_layer.w, last_layer.b);
+
+        ws.select(y.memory_start(), n);
+        ws.gather(last_layer.w.memory_start(), last_layer_t::no_bias ? nullptr : last_layer.b.memory_start());
+
+        // The logits and the errors of the candidates
+
+        auto x = etl::reshape(last_ctx.input, B, V);
+
+        ws.output = x * etl::transpose(ws.w);
+
+        if /*constexpr*/ (!last_layer_t::no_bias) {
+            ws.output = bias_add_2d(ws.output, ws.b);
+        }
+
+        auto sums = ws.compute_errors(n, metrics);
+
+        nan_check_etl(ws.errors);
+
+        // The errors of the previous layer, from the candidates only
+        if (first < layers - 1) {
+            etl::reshape(prev_ctx.errors, B, V) = ws.errors * ws.w;
+        }
+
+        // The gradients of the candidates, scattered to the gradients of the layer
+
+        {
+            dll::profile_layer layer_scope(layers - 1);
+
+            ws.w_grad = etl::transpose(ws.errors) * x;
+
+            if /*constexpr*/ (!last_layer_t::no_bias) {
+                ws.b_grad = bias_batch_sum_2d(ws.errors);
+            }
+
+            auto& w_grad = std::get<0>(last_ctx.up.context)->grad;
+            auto& b_grad = std::get<last_layer_t::no_bias ? 0 : 1>(last_ctx.up.context)->grad;
+
+            ws.scatter(w_grad.memory_start(), last_layer_t::no_bias ? nullptr : b_grad.memory_start());
+
+            host_written(w_grad, b_grad);
+
+            if (this->accumulate_gradients(std::get<layers - 1>(full_context), layers - 1)) {
+                this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, last_layer, last_ctx, accumulated_samples + n);
+            }
+        }
+
+        // The backpropagation through the other layers
+
+        auto update = [this, epoch, n](auto& layer_ctx, size_t l) {
+            if (!dbn.frozen[l]) {
+                this->update_layer(epoch, layer_ctx, accumulated_samples + n, l, false);
+            }
+        };
+
+        backpropagate_context(full_context, [](size_t /*l*/) {}, update, first, layers - 1);
+
+        flight.mark(dll::flight_phase::BACKWARD);
+
+        wait_updates();
+
+        flight.mark(dll::flight_phase::UPDATE);
+
+        next_micro_batch(n);
+
+        if (!metrics) {
+            return std::make_pair(-1.0, -1.0);
+        }
+
+        return std::make_pair(sums.first / n, sums.second / n);
+    }
+
+    /*!
+     * \copydoc sampled_step
+     */
+    template <size_t S, typename Inputs, typename Labels, bool Sampled = sampled_supported, cpp_disable_if(Sampled)>
+    std::pair<double, double> sampled_step(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics, size_t first, dll::flight_batch& flight) {
+        cpp_unused(epoch);
+        cpp_unused(inputs);
+        cpp_unused(labels);
+        cpp_unused(metrics);
+        cpp_unused(first);
+        cpp_unused(flight);
+
+        cpp_unreachable("The sampled softmax is not supported by this network");
+
+        return std::make_pair(-1.0, -1.0);
+    }
+
+    /*!
+     * \brief Train a batch of data, splitting it between several threads.
+     *
+     * Each thread computes the gradients of its part of the batch in its
+     * own replica of the contexts. The gradients are then summed before
+     * being applied to the network.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param metrics Indicates if the error and the loss of the batch are computed
+     * \return a pair containing the error and the loss for the batch, -1.0 if not computed
+     *
+     * \tparam S The layer the inputs are given to, the previous layers must be frozen
+     */
+    template <size_t S = 0, typename Inputs, typename Labels, size_t W = workers, cpp_enable_iff(W > 1)>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels, bool metrics = true) {
+        dll::auto_timer timer("sgd::train_batch");
+
+        start_step();
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the replicas can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        dll::flight_batch flight(dll::flight_source::SGD, n);
+
+        if (record_losses) {
+            sample_losses.resize(n);
+        }
+
+        // The number of replicas that have some samples
+        const size_t active = (n + replica_batch_size - 1) / replica_batch_size;
+
+        // The frozen layers before the first trainable layer are only forwarded
+        const size_t first = first_trainable();
+
+        // The sums of the metrics of each part of the batch
+        std::vector<std::pair<double, double>> sums(active);
+
+        // Forward, backward and gradients of each part of the batch
+
+        if (stages > 1 && S < stage_begins[1]) {
+            dll::auto_timer timer("sgd::pipeline");
+
+            pipeline_replicas<S>(inputs, labels, active, first, metrics, sums);
+        } else {
+            dll::auto_timer timer("sgd::replicas");
+
+            cpp::maybe_parallel_foreach_n(pool, 0, active, [&](size_t t) {
+                pin_pool_thread();
+
+                auto& context = replicas[t];
+
+                const size_t first = t * replica_batch_size;
+                const size_t last  = std::min(n, first + replica_batch_size);
+                const size_t m     = last - first;
+
+                auto sub_inputs = etl::slice(inputs, first, last);
+                auto sub_labels = etl::slice(labels, first, last);
+
+                forward_batch_context<true, S>(context, sub_inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first);
+
+                if (record_losses) {
+                    record_sample_losses(context, m, sub_labels, sample_losses.data() + first);
+                }
+
+                sums[t] = backward_batch_context(context, m, sub_labels, metrics, [](size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first, first);
+
+                size_t l = 0;
+
+                cpp::for_each(context, [this, &context, &l](auto& layer_ctx) {
+                    if (!dbn.frozen[l]) {
+                        layer_ctx.first.compute_gradients(*layer_ctx.second);
+
+                        this->tie_gradients(context, layer_ctx, l);
+                    }
+
+                    ++l;
+                });
+            });
+        }
+
+        // The phases of the replicas overlap, they are measured together
+        flight.mark(dll::flight_phase::BACKWARD);
+
+        // Sum and apply the gradients
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            reduce_gradients(active, std::make_index_sequence<layers>());
+
+            size_t l = 0;
+
+            cpp::for_each(full_context, [this, &l](auto& layer_ctx) {
+                if (!dbn.frozen[l]) {
+                    this->accumulate_gradients(layer_ctx, l);
+                }
+
+                ++l;
+            });
+
+            if (update_step()) {
+                size_t global_n = accumulated_samples + n;
+
+                if (distributed::active()) {
+                    submit_samples(global_n);
+
+                    l = 0;
+
+                    cpp::for_each(full_context, [this, &l](auto& layer_ctx) {
+                        if (!dbn.frozen[l++]) {
+                            this->submit_gradients(layer_ctx.first, *layer_ctx.second);
+                        }
+                    });
+
+                    wait_reductions();
+                }
+
+                l = 0;
+
+                cpp::for_each(full_context, [this, epoch, global_n, &l](auto& layer_ctx) {
+                    if (!dbn.frozen[l++]) {
+                        this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, global_n);
+                    }
+                });
+            }
+        }
+
+        flight.mark(dll::flight_phase::UPDATE);
+
+        next_micro_batch(n);
+
+        if (!metrics) {
+            return std::make_pair(-1.0, -1.0);
+        }
+
+        // Average the error and loss
+
+        double error = 0.0;
+        double loss = 0.0;
+
+        for (auto& sum : sums) {
+            error += sum.first;
+            loss += sum.second;
+        }
+
+        error = distributed::weighted_average(error / n, n);
+        loss  = distributed::weighted_average(loss / n, n);
+
+        flight.mark(dll::flight_phase::METRICS);
+
+        return std::make_pair(error, loss);
+    }
+
+    /*!
+     * \brief Forward, backward and compute the gradients of the parts of
+     * the batch of the replicas through the pipeline stages.
+     *
+     * Each stage runs in its own thread, pinned on its node, and processes
+     * its layers for each micro-batch (the part of a replica), in order.
+     * A stage forwards a micro-batch once the previous stage has forwarded
+     * it and backpropagates it once the next stage has backpropagated it.
+     * After the first micro-batches filling the pipeline, each stage
+     * alternates between one forward and one backward pass, which bounds
+     * the number of micro-batches in flight and keeps all the stages busy.
+     *
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \param active The number of micro-batches
+     * \param first The first trainable layer
+     * \param metrics Indicates if the metrics of the batch are computed
+     * \param sums The sums of the metrics of each micro-batch
+     */
+    template <size_t S, typename Inputs, typename Labels>
+    void pipeline_replicas(const Inputs& inputs, const Labels& labels, size_t active, size_t first, bool metrics, std::vector<std::pair<double, double>>& sums) {
+        const size_t n = etl::dim<0>(inputs);
+
+        // The number of micro-batches forwarded and backpropagated by each stage
+        std::array<size_t, stages> forwarded{};
+        std::array<size_t, stages> backwarded{};
+
+        std::mutex lock;
+        std::condition_variable progress;
+
+        auto wait = [&lock, &progress](const size_t& counter, size_t k) {
+            std::unique_lock<std::mutex> l(lock);
+            progress.wait(l, [&counter, k] { return counter > k; });
+        };
+
+        auto signal = [&lock, &progress](size_t& counter) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                ++counter;
+            }
+
+            progress.notify_all();
+        };
+
+        auto stage = [&](size_t s) {
+            const size_t begin = stage_begins[s];
+            const size_t end   = stage_begins[s + 1];
+
+            auto forward = [&](size_t k) {
+                auto& context = replicas[k];
+
+                if (s == 0) {
+                    auto sub_inputs = etl::slice(inputs, k * replica_batch_size, std::min(n, (k + 1) * replica_batch_size));
+
+                    forward_batch_context<true, S>(context, sub_inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {}, first, end);
+                } else {
+                    wait(forwarded[s - 1], k);
+
+                    forward_range_context(context, begin, end, first);
+                }
+
+                signal(forwarded[s]);
+            };
+
+            auto backward = [&](size_t k) {
+                auto& context = replicas[k];
+
+                auto gradients = [this, &context](auto& layer_ctx, size_t l) {
+                    if (!dbn.frozen[l]) {
+                        layer_ctx.first.compute_gradients(*layer_ctx.second);
+
+                        this->tie_gradients(context, layer_ctx, l);
+                    }
+                };
+
+                if (s + 1 == stages) {
+                    const size_t f = k * replica_batch_size;
+                    const size_t m = std::min(n, f + replica_batch_size) - f;
+
+                    auto sub_labels = etl::slice(labels, f, f + m);
+
+                    if (record_losses) {
+                        record_sample_losses(context, m, sub_labels, sample_losses.data() + f);
+                    }
+
+                    sums[k] = last_errors<dbn_t::loss>(context, m, sub_labels, metrics, f);
+                } else {
+                    wait(backwarded[s + 1], k);
+                }
+
+                backpropagate_context(context, [](size_t /*l*/) {}, gradients, first, end, begin);
+
+                signal(backwarded[s]);
+            };
+
+            const size_t warmup = std::min(stages - 1 - s, active);
+
+            size_t f = 0;
+            size_t b = 0;
+
+            while (f < warmup) {
+                forward(f++);
+            }
+
+            while (f < active) {
+                forward(f++);
+                backward(b++);
+            }
+
+            while (b < active) {
+                backward(b++);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(stages - 1);
+
+        for (size_t s = 1; s < stages; ++s) {
+            threads.emplace_back([&stage, s] {
+                pin_node(stage_node(s), s);
+                stage(s);
+            });
+        }
+
+        // The current thread is the first stage
+        stage(0);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Forward the outputs of the layer before begin through the
+     * layers of the given range of the network of the given context
+     * \param context The context of the network
+     * \param begin The first layer forwarded
+     * \param end The layer after the last layer forwarded
+     * \param first The first layer forwarded in train mode, the previous layers are forwarded in test mode
+     */
+    template <typename Context>
+    static void forward_range_context(Context& context, size_t begin, size_t end, size_t first) {
+        size_t l = 0;
+
+        cpp::for_each_pair(context, [&l, begin, end, first](auto& layer_ctx_1, auto& layer_ctx_2) {
+            auto& layer_2 = layer_ctx_2.first;
+
+            auto& ctx1 = *layer_ctx_1.second;
+            auto& ctx2 = *layer_ctx_2.second;
+
+            if (++l < begin || l >= end) {
+                return;
+            }
+
+            dll::profile_layer layer_scope(l);
+
+            ctx2.input = ctx1.output;
+
+            if (l >= first) {
+                layer_2.train_forward_context(ctx2);
+            } else {
+                layer_2.test_forward_batch(ctx2.output, ctx2.input);
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and backpropagate them
+     * through the network of the given context
+     * \param context The context of the network
+     * \param n The number of samples in the batch
+     * \param labels A batch of labels
+     * \param metrics Indicates if the metrics of the batch are computed
+     * \return The sums of the errors and of the losses of the samples
+     */
+    template <typename Context, typename Labels>
+    std::pair<double, double> backward_batch_context(Context& context, size_t n, const Labels& labels, bool metrics) {
+        return backward_batch_context(context, n, labels, metrics, [](auto& /*layer_ctx*/, size_t /*l*/) {});
+    }
+
+    /*!
+     * \copydoc backward_batch_context
+     */
+    template <typename Context, typename Labels, typename Functor>
+    std::pair<double, double> backward_batch_context(Context& context, size_t n, const Labels& labels, bool metrics, Functor&& done) {
+        return backward_batch_context(context, n, labels, metrics, [](size_t /*l*/) {}, done);
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and backpropagate them
+     * through the network of the given context, calling the functor for
+     * each layer, from the last, once its errors have been backpropagated.
+     *
+     * The errors of the inputs of the first layer are not computed.
+     *
+     * \param context The context of the network
+     * \param n The number of samples in the batch
+     * \param labels A batch of labels
+     * \param metrics Indicates if the metrics of the batch are computed
+     * \param before The functor called with the index of each layer before its backpropagation
+     * \param done The functor called with each layer and its index
+     * \param first The first layer whose errors are computed, the errors are not backpropagated to the previous layers
+     * \param offset The index of the first sample of the labels in the batch
+     * \return The sums of the errors and of the losses of the samples
+     */
+    template <typename Context, typename Labels, typename Before, typename Functor>
+    std::pair<double, double> backward_batch_context(Context& context, size_t n, const Labels& labels, bool metrics, Before&& before, Functor&& done, size_t first = 0, size_t offset = 0) {
+        //Compute the errors of the last layer
+
+        auto result = last_errors<dbn_t::loss>(context, n, labels, metrics, offset);
+
+        // Backpropagate the error
+
+        backpropagate_context(context, before, done, first, layers);
+
+        return result;
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the layer before end through the
+     * network of the given context, calling the functor for each layer, from
+     * the layer before end, once its errors have been backpropagated.
+     *
+     * The errors of the layer before end must have been computed. When end
+     * is not the number of layers, they have not been multiplied by the
+     * derivative of the activation function of the layer.
+     *
+     * \param context The context of the network
+     * \param before The functor called with the index of each layer before its backpropagation
+     * \param done The functor called with each layer and its index
+     * \param first The first layer whose errors are computed, the errors are not backpropagated to the previous layers
+     * \param end The layer after the last layer that is backpropagated
+     * \param begin The first layer that is backpropagated, the errors of its input are still computed
+     */
+    template <typename Context, typename Before, typename Functor>
+    static void backpropagate_context(Context& context, Before&& before, Functor&& done, size_t first, size_t end, size_t begin = 0) {
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+
+        bool last = end == layers;
+        size_t l  = layers;
+
+        cpp::for_each_rpair(context, [&last, &l, &before, &done, first, end, begin](auto& layer_ctx_1, auto& layer_ctx_2) {
+            auto& r2 = layer_ctx_2.first;
+
+            auto& ctx1 = *layer_ctx_1.second;
+            auto& ctx2 = *layer_ctx_2.second;
+
+            if (--l < first || l >= end || l < begin) {
+                return;
+            }
+
+            before(l);
+
+            dll::profile_layer layer_scope(l);
+
+            if(!last){
+                r2.adapt_errors(ctx2);
+            }
+
+            last = false;
+
+            if (l > first) {
+                r2.backward_batch(ctx1.errors, ctx2);
+            }
+
+            done(layer_ctx_2, l);
+        });
+
+        if (first == 0 && begin == 0) {
+            before(0);
+
+            dll::profile_layer layer_scope(0);
+
+            first_layer.adapt_errors(first_ctx);
+
+            done(std::get<0>(context), 0);
+        }
+    }
+
+    //TODO
+    template <bool Train, size_t S = 0, typename Inputs>
+    auto& forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
+        cpp_unused(dbn);
+
+        return this->template forward_batch_helper<Train, S>(inputs);
+    }
+
+    template <bool Train, size_t S = 0, typename Inputs>
+    auto& forward_batch_helper(Inputs&& inputs) {
+        if (checkpointing) {
+            // The activations released by the training are necessary
+            return forward_batch_context<Train, S>(full_context, inputs,
+                    [this](auto& layer_ctx, size_t l) { this->restore_activations(layer_ctx, l); },
+                    [](auto& /*layer_ctx*/, size_t /*l*/) {});
+        }
+
+        return forward_batch_context<Train, S>(full_context, inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {});
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the network of the given
+     * context
+     * \param context The context of the network
+     * \param inputs A batch of inputs
+     * \return a reference to the output of the last layer
+     */
+    template <bool Train, typename Context, typename Inputs>
+    static auto& forward_batch_context(Context& context, Inputs&& inputs) {
+        return forward_batch_context<Train>(context, inputs, [](auto& /*layer_ctx*/, size_t /*l*/) {}, [](auto& /*layer_ctx*/, size_t /*l*/) {});
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the network of the given
+     * context, calling the functors for each layer
+     * \param context The context of the network
+     * \param inputs A batch of inputs
+     * \param before The functor called with each layer and its index before its forward pass
+     * \param done The functor called with each layer and its index once its output has been consumed by the next layer
+     * \param first The first layer forwarded in train mode, the previous layers are forwarded in test mode
+     * \param end The layer after the last layer forwarded, the next layers are not forwarded
+     * \return a reference to the output of the last layer
+     *
+     * \tparam S The layer the inputs are given to, the previous layers are not forwarded
+     */
+    template <bool Train, size_t S = 0, typename Context, typename Inputs, typename Before, typename Functor>
+    static auto& forward_batch_context(Context& context, Inputs&& inputs, Before&& before, Functor&& done, size_t first = 0, size_t end = layers) {
+        auto& first_layer = std::get<S>(context).first;
+        auto& first_ctx   = *std::get<S>(context).second;
+        auto& last_ctx    = *std::get<layers - 1>(context).second;
+
+        const auto n          = etl::dim<0>(inputs);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        before(std::get<S>(context), S);
+
+        if(cpp_unlikely(!full_batch)){
+            first_ctx.input  = 0;
+            first_ctx.output = 0;
+
+            for (size_t i = 0; i < etl::dim<0>(inputs); ++i) {
+                first_ctx.input(i) = inputs(i);
+            }
+        } else {
+            first_ctx.input = inputs;
+        }
+
+        {
+            dll::profile_layer layer_scope(S);
+
+            if (Train && first <= S) {
+                first_layer.train_forward_context(first_ctx);
+            } else {
+                first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+            }
+        }
+
+        size_t l = 0;
+
+        cpp::for_each_pair(context, [&l, &before, &done, first, end](auto& layer_ctx_1, auto& layer_ctx_2) {
+            auto& layer_2 = layer_ctx_2.first;
+
+            auto& ctx1 = *layer_ctx_1.second;
+            auto& ctx2 = *layer_ctx_2.second;
+
+            if (++l <= S || l >= end) {
+                return;
+            }
+
+            before(layer_ctx_2, l);
+
+            dll::profile_layer layer_scope(l);
+
+            ctx2.input = ctx1.output;
+
+            done(layer_ctx_1, l - 1);
+
+            if (Train && l >= first) {
+                layer_2.train_forward_context(ctx2);
+            } else {
+                layer_2.test_forward_batch(ctx2.output, ctx2.input);
+            }
+        });
+
+        return last_ctx.output;
     }
 
     /*!
-     * \brief Train a batch of data
-     * \param epoch The current epoch
-     * \param inputs A batch of inputs
-     * \param labels A batch of labels
-     * \return a pair containing the error and the loss for the batch
+     * \brief Sum the gradients of the active replicas into the main context
+     * \param active The number of replicas with samples
      */
-    template <typename Inputs, typename Labels>
-    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
-        dll::auto_timer timer("sgd::train_batch");
+    template <size_t... L>
+    void reduce_gradients(size_t active, std::index_sequence<L...> /* args */) {
+        int unused[] = {(this->template reduce_layer_gradients<L>(active), 1)...};
+        cpp_unused(unused);
+    }
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+    template <size_t L, cpp_disable_if(decay_layer_traits<typename dbn_t::template layer_type<L>>::is_neural_layer())>
+    void reduce_layer_gradients(size_t active) {
+        cpp_unused(active);
+    }
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+    template <size_t L, cpp_enable_iff(decay_layer_traits<typename dbn_t::template layer_type<L>>::is_neural_layer())>
+    void reduce_layer_gradients(size_t active) {
+        if (dbn.frozen[L]) {
+            return;
+        }
 
-        // Ensure that the data batch and the label batch are of the same size
-        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+        static constexpr size_t N = std::tuple_size<decltype(std::get<L>(full_context).first.trainable_parameters())>();
 
-        // Ensure that the context can hold the inputs
-        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+        reduce_variables<L>(active, std::make_index_sequence<N>());
+    }
 
-        //Feedforward pass
+    template <size_t L, size_t... I>
+    void reduce_variables(size_t active, std::index_sequence<I...> /* args */) {
+        int unused[] = {(this->template reduce_variable<L, I>(active), 1)...};
+        cpp_unused(unused);
+    }
 
-        {
-            dll::auto_timer timer("sgd::forward");
+    template <size_t L, size_t I>
+    void reduce_variable(size_t active) {
+        auto& grad = std::get<I>(std::get<L>(full_context).second->up.context)->grad;
+
+        grad = std::get<I>(std::get<L>(replicas[0]).second->up.context)->grad;
 
-            forward_batch_helper<true>(inputs);
+        for (size_t t = 1; t < active; ++t) {
+            grad += std::get<I>(std::get<L>(replicas[t]).second->up.context)->grad;
         }
+    }
 
-        {
-            dll::auto_timer timer("sgd::backward");
+    /*!
+     * \brief Copy the parameters of the given layer from rank 0 to all the ranks
+     */
+    template <typename L, cpp_disable_if(decay_layer_traits<L>::is_neural_layer())>
+    static void broadcast_parameters(L& layer) {
+        cpp_unused(layer);
+    }
 
-            //Compute the errors of the last layer
+    template <typename L, cpp_enable_iff(decay_layer_traits<L>::is_neural_layer())>
+    static void broadcast_parameters(L& layer) {
+        static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-            last_errors<dbn_t::loss>(full_batch, n, labels);
+        broadcast_variables(layer, std::make_index_sequence<N>());
+    }
 
-            // Backpropagate the error
+    template <typename L, size_t... I>
+    static void broadcast_variables(L& layer, std::index_sequence<I...> /* args */) {
+        int unused[] = {(this_type::template broadcast_variable<I>(layer), 1)...};
+        cpp_unused(unused);
+    }
 
-            bool last = true;
+    template <size_t I, typename L>
+    static void broadcast_variable(L& layer) {
+        auto& w = std::get<I>(layer.trainable_parameters());
 
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                auto& r2 = layer_ctx_2.first;
+        host_read(w);
 
-                auto& ctx1 = *layer_ctx_1.second;
-                auto& ctx2 = *layer_ctx_2.second;
+        distributed::comm().broadcast(w.memory_start(), etl::size(w));
 
-                if(!last){
-                    r2.adapt_errors(ctx2);
-                }
+        host_written(w);
+    }
 
-                last = false;
+    /*!
+     * \brief Start the sum of the number of samples over all the ranks
+     * \param n The number of samples, replaced by the sum
+     */
+    void submit_samples(size_t& n) {
+        reductions.push_back(distributed::comm().submit([&n] {
+            distributed::comm().all_reduce(&n, 1);
+        }));
+    }
 
-                r2.backward_batch(ctx1.errors, ctx2);
-            });
+    /*!
+     * \brief Start the sum of the gradients of the given layer over all the
+     * ranks, on the communication thread
+     */
+    template <typename L, typename C, cpp_disable_if(decay_layer_traits<L>::is_neural_layer())>
+    void submit_gradients(L& layer, C& context) {
+        cpp_unused(layer);
+        cpp_unused(context);
+    }
 
-            first_layer.adapt_errors(first_ctx);
-        }
+    template <typename L, typename C, cpp_enable_iff(decay_layer_traits<L>::is_neural_layer())>
+    void submit_gradients(L& layer, C& context) {
+        static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-        // Compute and apply the gradients
+        submit_variables(context, std::make_index_sequence<N>());
+    }
 
-        {
-            dll::auto_timer timer("sgd::grad");
+    template <typename C, size_t... I>
+    void submit_variables(C& context, std::index_sequence<I...> /* args */) {
+        int unused[] = {(this->template submit_variable<I>(context), 1)...};
+        cpp_unused(unused);
+    }
 
-            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
-                // Compute the gradients
-                layer_ctx.first.compute_gradients(*layer_ctx.second);
+    template <size_t I, typename C>
+    void submit_variable(C& context) {
+        static constexpr auto compression = dbn_traits<dbn_t>::compression();
 
-                // Apply the gradients
-                this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, n);
-            });
+        auto& grad = std::get<I>(context.up.context)->grad;
+
+        // The sum is written on the host, the gradients are not used
+        // before wait_reductions
+        host_read(grad);
+        host_written(grad);
+
+        if /*constexpr*/ (compression == compression_type::NONE) {
+            reductions.push_back(distributed::comm().submit([&grad] {
+                distributed::comm().all_reduce(grad.memory_start(), etl::size(grad));
+            }));
+        } else {
+            // The residuals are always used in the same order
+            if (next_residual == residuals.size()) {
+                residuals.emplace_back(etl::size(grad), weight(0));
+            }
+
+            auto& residual = residuals[next_residual++];
+
+            reductions.push_back(distributed::comm().submit([&grad, &residual] {
+                compressed_all_reduce<compression>(grad.memory_start(), residual.data(), etl::size(grad));
+            }));
         }
+    }
 
-        // Update the counter of iterations
-        ++iteration;
+    /*!
+     * \brief Wait for the pending sums over the ranks
+     */
+    void wait_reductions() {
+        dll::auto_timer timer("sgd::all_reduce");
 
-        // Compute error and loss
+        for (auto& reduction : reductions) {
+            reduction.get();
+        }
 
-        double error = 0.0;
-        double loss = 0.0;
+        reductions.clear();
 
-        {
-            dll::auto_timer timer("sgd::error");
+        next_residual = 0;
+    }
+
+    /*!
+     * \brief Returns the number of batches whose gradients are accumulated
+     * before each update of the weights
+     */
+    size_t accumulation() const {
+        return std::max<size_t>(dbn.accumulation_steps, 1);
+    }
+
+    /*!
+     * \brief Indicates if the weights are updated after the current batch
+     */
+    bool update_step() const {
+        return micro_batch + 1 >= accumulation();
+    }
+
+    /*!
+     * \brief Move to the next batch, the counter of iterations being only
+     * updated with the weights
+     * \param n The number of samples of the current batch
+     */
+    void next_micro_batch(size_t n) {
+        if (update_step()) {
+            ++iteration;
 
-            std::tie(error, loss) = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+            micro_batch         = 0;
+            accumulated_samples = 0;
+        } else {
+            ++micro_batch;
+
+            accumulated_samples += n;
         }
+    }
 
-        return std::make_pair(error, loss);
+    /*!
+     * \brief Accumulate the gradients of the current batch for the given
+     * layer.
+     *
+     * The gradients of the first batches are summed in the accumulators
+     * and the sum is added to the gradients of the last batch, which are
+     * then applied.
+     *
+     * \return true if the weights must be updated after this batch, false otherwise
+     */
+    template <typename LayerCtx>
+    bool accumulate_gradients(LayerCtx& layer_ctx, size_t l) {
+        if (accumulation() > 1) {
+            accumulate_layer(layer_ctx.first, *layer_ctx.second, l);
+        }
+
+        return update_step();
     }
 
-    //TODO
-    template <bool Train, typename Inputs>
-    auto& forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
-        cpp_unused(dbn);
+    template <typename L, typename C, cpp_disable_if(decay_layer_traits<L>::is_neural_layer())>
+    void accumulate_layer(L& layer, C& context, size_t l) {
+        cpp_unused(layer);
+        cpp_unused(context);
+        cpp_unused(l);
+    }
+
+    template <typename L, typename C, cpp_enable_iff(decay_layer_traits<L>::is_neural_layer())>
+    void accumulate_layer(L& layer, C& context, size_t l) {
+        static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-        return this->template forward_batch_helper<Train>(inputs);
+        // Only the accumulators of this layer, the layers can be updated concurrently
+        accumulated_grads[l].resize(N);
+
+        accumulate_variables(context, l, std::make_index_sequence<N>());
     }
 
-    template <bool Train, typename Inputs>
-    auto& forward_batch_helper(Inputs&& inputs) {
+    template <typename C, size_t... I>
+    void accumulate_variables(C& context, size_t l, std::index_sequence<I...> /* args */) {
+        int unused[] = {(this->template accumulate_variable<I>(context, l), 1)...};
+        cpp_unused(unused);
+    }
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+    template <size_t I, typename C>
+    void accumulate_variable(C& context, size_t l) {
+        auto& grad = std::get<I>(context.up.context)->grad;
+        auto& acc  = accumulated_grads[l][I];
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+        const size_t N = etl::size(grad);
 
-        // Ensure that the context can hold the inputs
-        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+        host_read(grad);
 
-        if(cpp_unlikely(!full_batch)){
-            first_ctx.input  = 0;
-            first_ctx.output = 0;
+        auto* g = grad.memory_start();
 
-            for (size_t i = 0; i < etl::dim<0>(inputs); ++i) {
-                first_ctx.input(i) = inputs(i);
+        if (micro_batch == 0) {
+            acc.assign(g, g + N);
+        } else if (!update_step()) {
+            for (size_t i = 0; i < N; ++i) {
+                acc[i] += g[i];
             }
         } else {
-            first_ctx.input = inputs;
-        }
+            for (size_t i = 0; i < N; ++i) {
+                g[i] += acc[i];
+            }
 
-        if /*constexpr*/ (Train) {
-            first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
-        } else {
-            first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+            host_written(grad);
         }
+    }
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
-            auto& layer_2 = layer_ctx_2.first;
+    /*!
+     * \brief Add the gradients of the tied layer mirroring the given layer,
+     * if any, to the gradients of its weights.
+     *
+     * The gradients of the tied layers are computed during the
+     * backpropagation of their errors, before the ones of the layers they
+     * mirror.
+     */
+    template <typename Context, typename LayerCtx>
+    static void tie_gradients(Context& context, LayerCtx& layer_ctx, size_t l) {
+        size_t i = 0;
 
-            auto& ctx1 = *layer_ctx_1.second;
-            auto& ctx2 = *layer_ctx_2.second;
+        cpp::for_each(context, [&layer_ctx, l, &i](auto& tied_ctx) {
+            if (i++ == layers - 1 - l) {
+                add_tied_gradients(layer_ctx, tied_ctx);
+            }
+        });
+    }
 
-            ctx2.input = ctx1.output;
+    template <typename LayerCtx, typename TiedCtx, cpp_enable_iff(is_tied_layer<std::decay_t<decltype(std::declval<TiedCtx>().first)>, std::decay_t<decltype(std::declval<LayerCtx>().first)>>::value)>
+    static void add_tied_gradients(LayerCtx& layer_ctx, TiedCtx& tied_ctx) {
+        std::get<0>(layer_ctx.second->up.context)->grad += etl::transpose(tied_ctx.second->w_grad);
+    }
 
-            if /*constexpr*/ (Train) {
-                layer_2.train_forward_batch(ctx2.output, ctx2.input);
-            } else {
-                layer_2.test_forward_batch(ctx2.output, ctx2.input);
+    template <typename LayerCtx, typename TiedCtx, cpp_disable_if(is_tied_layer<std::decay_t<decltype(std::declval<TiedCtx>().first)>, std::decay_t<decltype(std::declval<LayerCtx>().first)>>::value)>
+    static void add_tied_gradients(LayerCtx& /*layer_ctx*/, TiedCtx& /*tied_ctx*/) {}
+
+    /*!
+     * \brief Compute and apply the gradients of the given layer.
+     *
+     * When possible, this is done by the scheduler, concurrently with the
+     * backpropagation to the previous layers, which does not depend on
+     * the weights of this layer anymore.
+     */
+    template <typename LayerCtx>
+    void update_layer(size_t epoch, LayerCtx& layer_ctx, size_t n, size_t l, bool recomputed) {
+        auto update = [this, epoch, &layer_ctx, n, l, recomputed]() {
+            dll::profile_layer layer_scope(l);
+
+            layer_ctx.first.compute_gradients(*layer_ctx.second);
+
+            this->tie_gradients(this->full_context, layer_ctx, l);
+
+            if (recomputed) {
+                this->release_activations(layer_ctx, l);
             }
-        });
 
-        return last_ctx.output;
+            if (this->accumulate_gradients(layer_ctx, l)) {
+                this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, n);
+            }
+        };
+
+        if (async_updates && concurrency() > 1) {
+            ++pending_updates;
+
+            // The kernels of ETL are run serially, the threads of ETL are
+            // used by the backpropagation
+            scheduler().push([this, update]() {
+                SERIAL_SECTION {
+                    update();
+                }
+
+                --pending_updates;
+            });
+        } else {
+            update();
+        }
+    }
+
+    /*!
+     * \brief Wait for the end of the updates of the layers, running the
+     * other tasks of the scheduler in the meantime
+     */
+    void wait_updates() {
+        while (pending_updates) {
+            if (!scheduler().run_one()) {
+                std::this_thread::yield();
+            }
+        }
     }
 
     // CPP17 Replace with if constexpr
@@ -696,6 +2758,9 @@ struct sgd_trainer {
         static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
         update_variables<UT>(epoch, layer, context, n, std::make_index_sequence<N>());
+
+        // The removed blocks of block-sparse weights stay at zero
+        mask_blocks(layer);
     }
 
     template <updater_type UT, typename L, typename C, size_t... I>
@@ -704,18 +2769,9 @@ struct sgd_trainer {
         cpp_unused(unused);
     }
 
-    template <size_t I, updater_type UT, typename L, typename C>
+    template <size_t I, updater_type UT, typename L, typename C, cpp_disable_if(is_fused_updater(UT))>
     void update_variable(size_t epoch, L& layer, C& context, size_t n) {
-        // 1. Decay the learning rate (if necessary)
-
-        auto eps             = dbn.learning_rate;
-        const auto eps_decay = dbn.learning_rate_decay;
-
-        if (eps_decay > 0.0) {
-            eps *= 1.0 / (1.0 + eps_decay * iteration);
-        }
-
-        //2. Update the gradients (L1/L2 and gradient clipping)
+        // 1. Update the gradients (L1/L2 and gradient clipping)
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
@@ -727,11 +2783,93 @@ struct sgd_trainer {
             this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
         }
 
+        // 2. The learning rate of the step, scaled for the layer (if necessary)
+
+        auto eps = step_eps;
+
+        if (dbn.layer_wise_scaling) {
+            using T = etl::value_t<decltype(w)>;
+
+            eps *= trust_ratio(w, w_grad, updater_detail::gradient_adjust<T>{T(0), T(0), T(1)}, n);
+        }
+
         // 3. Apply the gradients
 
         apply_gradients<I, UT>(epoch, layer, context, n, eps);
     }
 
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(is_fused_updater(UT))>
+    void update_variable(size_t epoch, L& layer, C& context, size_t n) {
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+
+        // 1. The adjustment of the gradients (L1/L2 and gradient clipping)
+
+        auto adjust = gradient_adjustment<I>(w, w_grad, n);
+
+        // 2. The learning rate of the step, scaled for the layer (if necessary)
+
+        auto eps = step_eps;
+
+        if (dbn.layer_wise_scaling) {
+            eps *= trust_ratio(w, w_grad, adjust, n);
+        }
+
+        // 3. Apply the gradients, adjusted on the fly
+
+        apply_gradients<I, UT>(epoch, layer, context, eps, adjust);
+    }
+
+    /*!
+     * \brief Returns the layer-wise trust ratio (LARS) of a variable: the
+     * ratio of the norm of the variable to the norm of its mean adjusted
+     * gradient, times the LARS coefficient
+     */
+    template <typename V, typename G>
+    weight trust_ratio(const V& value, const G& grad, updater_detail::gradient_adjust<etl::value_t<V>> adjust, size_t n) {
+        using T = etl::value_t<V>;
+
+        const size_t N = etl::size(value);
+
+        host_read(value, grad);
+
+        const double w_norm = std::sqrt(updater_detail::squared_norm(N, value.memory_start(), value.memory_start(), updater_detail::gradient_adjust<T>{T(0), T(0), T(1)}));
+        const double g_norm = std::sqrt(updater_detail::squared_norm(N, value.memory_start(), grad.memory_start(), adjust)) / n;
+
+        // The ratio is not defined before the variables are initialized
+        if (w_norm == 0.0 || g_norm == 0.0) {
+            return weight(1);
+        }
+
+        return weight(dbn.lars_coefficient * w_norm / g_norm);
+    }
+
+    /*!
+     * \brief Returns the adjustment of the gradients of the I-th variable
+     * of a layer, for the fused updaters
+     */
+    template <size_t I, typename V, typename G>
+    updater_detail::gradient_adjust<etl::value_t<V>> gradient_adjustment(const V& value, const G& grad, size_t n) {
+        using T = etl::value_t<V>;
+
+        // Note the distinction for w and b for decay is far from optimal...
+        constexpr decay_type decay = I == 0 ? w_decay(dbn_traits<dbn_t>::decay()) : b_decay(dbn_traits<dbn_t>::decay());
+
+        updater_detail::gradient_adjust<T> adjust{T(0), T(0), T(1)};
+
+        if (decay == decay_type::L1 || decay == decay_type::L1L2) {
+            adjust.l1 = T(dbn.l1_weight_cost);
+        }
+
+        if (decay == decay_type::L2 || decay == decay_type::L1L2) {
+            adjust.l2 = T(dbn.l2_weight_cost);
+        }
+
+        adjust.scale = clip_scale(value, grad, n, adjust);
+
+        return adjust;
+    }
+
     /*!
      * \brief Apply the gradients to the given layer
      */
@@ -826,28 +2964,26 @@ struct sgd_trainer {
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADADELTA)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+    template <size_t I, updater_type UT, typename L, typename C, typename T, cpp_enable_iff(UT == updater_type::ADADELTA)>
+    void apply_gradients(size_t epoch, L& layer, C& context, weight eps, updater_detail::gradient_adjust<T> adjust) {
         dll::auto_timer timer("sgd::apply_grad:adadelta");
 
-        const auto beta = dbn.adadelta_beta;
-        const auto e = 1e-8;
+        const T beta = dbn.adadelta_beta;
+        const T e    = 1e-8;
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
         auto& w_g    = std::get<I>(context.up.context)->g;
-        auto& w_v    = std::get<I>(context.up.context)->v;
         auto& w_x    = std::get<I>(context.up.context)->x;
 
-        w_g = beta * w_g + ((1.0 - beta) >> w_grad >> w_grad);
-        w_v = (sqrt(w_x + e) >> w_grad) / sqrt(w_g + e);
-        w_x = beta * w_x + ((1.0 - beta) >> w_v >> w_v);
+        host_read(w, w_grad, w_g, w_x);
 
-        w += w_v;
+        updater_detail::adadelta(etl::size(w), w.memory_start(), w_grad.memory_start(), w_g.memory_start(), w_x.memory_start(), adjust, beta, e);
+
+        host_written(w, w_g, w_x);
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
         cpp_unused(eps);
     }
@@ -855,31 +2991,29 @@ struct sgd_trainer {
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+    template <size_t I, updater_type UT, typename L, typename C, typename T, cpp_enable_iff(UT == updater_type::ADAM)>
+    void apply_gradients(size_t epoch, L& layer, C& context, weight eps, updater_detail::gradient_adjust<T> adjust) {
         dll::auto_timer timer("sgd::apply_grad:adam");
 
-        const auto beta1 = dbn.adam_beta1;
-        const auto beta2 = dbn.adam_beta2;
-        const auto e = 1e-8;
+        const T beta1 = dbn.adam_beta1;
+        const T beta2 = dbn.adam_beta2;
+        const T e     = 1e-8;
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
         auto& w_m    = std::get<I>(context.up.context)->m;
         auto& w_v    = std::get<I>(context.up.context)->v;
 
-        // Standard Adam estimations of the first and second moments
+        // Standard Adam estimations of the first and second moments and update of the parameters
 
-        w_m = beta1 * w_m + ((1.0 - beta1) >> w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) >> (w_grad >> w_grad));
+        host_read(w, w_grad, w_m, w_v);
 
-        // Update the parameters
+        updater_detail::adam(etl::size(w), w.memory_start(), w_grad.memory_start(), w_m.memory_start(), w_v.memory_start(), adjust, T(eps), beta1, beta2, e);
 
-        w += (eps >> w_m) / (etl::sqrt(w_v) + e);
+        host_written(w, w_m, w_v);
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
     }
 
@@ -958,8 +3092,8 @@ struct sgd_trainer {
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NADAM)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+    template <size_t I, updater_type UT, typename L, typename C, typename T, cpp_enable_iff(UT == updater_type::NADAM)>
+    void apply_gradients(size_t epoch, L& layer, C& context, weight eps, updater_detail::gradient_adjust<T> adjust) {
         dll::auto_timer timer("sgd::apply_grad:nadam");
 
         const weight beta1          = dbn.adam_beta1;
@@ -971,9 +3105,7 @@ struct sgd_trainer {
         auto& w          = std::get<I>(layer.trainable_parameters());
         auto& w_grad     = std::get<I>(context.up.context)->grad;
         auto& w_m        = std::get<I>(context.up.context)->m;
-        auto& w_mt       = std::get<I>(context.up.context)->mt;
         auto& w_v        = std::get<I>(context.up.context)->v;
-        auto& w_vt       = std::get<I>(context.up.context)->vt;
         auto& m_schedule = std::get<I>(context.up.context)->m_schedule;
 
         // Compute the schedule for momentum
@@ -988,17 +3120,8 @@ struct sgd_trainer {
             m_schedule = m_schedule_new;
         }
 
-        // Standard Adam estimations of the first and second order moments
-
-        w_m = beta1 * w_m + ((1.0 - beta1) >> w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) >> (w_grad >> w_grad));
-
-        // Correct the bias (towards zero) of the first and second moments
-
-        w_mt = w_m / (1.0 - m_schedule_next);
-        w_vt = w_v / (1.0 - std::pow(beta2, t));
-
-        // Update the parameters
+        // Standard Adam estimations of the first and second order moments,
+        // corrected towards zero, and update of the parameters
 
         weight f1 = 1.0 - momentum_cache_t;
         weight f2 = 1.0 - m_schedule_new;
@@ -1006,35 +3129,40 @@ struct sgd_trainer {
         weight m1 = eps * (f1 / f2);
         weight m2 = eps * momentum_cache_t_1;
 
-        w += (m1 * w_grad + m2 * w_mt) / (etl::sqrt(w_vt) + e);
+        host_read(w, w_grad, w_m, w_v);
+
+        updater_detail::nadam(etl::size(w), w.memory_start(), w_grad.memory_start(), w_m.memory_start(), w_v.memory_start(), adjust,
+                              T(m1), T(m2), T(1.0 - m_schedule_next), T(1.0 - std::pow(beta2, t)), T(beta1), T(beta2), T(e));
+
+        host_written(w, w_m, w_v);
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
     }
 
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::RMSPROP)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+    template <size_t I, updater_type UT, typename L, typename C, typename T, cpp_enable_iff(UT == updater_type::RMSPROP)>
+    void apply_gradients(size_t epoch, L& layer, C& context, weight eps, updater_detail::gradient_adjust<T> adjust) {
         dll::auto_timer timer("sgd::apply_grad:rmsprop");
 
-        const auto decay = dbn.rmsprop_decay;
-        const auto e = 1e-8;
+        const T decay = dbn.rmsprop_decay;
+        const T e     = 1e-8;
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
         auto& w_inc  = std::get<I>(context.up.context)->inc;
 
-        w_inc = decay * w_inc + (1 - decay) * (w_grad >> w_grad);
+        host_read(w, w_grad, w_inc);
 
-        w += (eps >> w_grad) / etl::sqrt(w_inc + e);
+        updater_detail::rmsprop(etl::size(w), w.memory_start(), w_grad.memory_start(), w_inc.memory_start(), adjust, T(eps), decay, e);
+
+        host_written(w, w_inc);
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
     }
 
@@ -1060,6 +3188,35 @@ struct sgd_trainer {
         cpp_unused(n);
     }
 
+    /*!
+     * \brief Returns the scale of the gradient clipping for the gradients
+     * adjusted by the given weight decay
+     */
+    template <typename D = dbn_t, typename V, typename G, typename T, cpp_enable_iff(dbn_traits<D>::has_clip_gradients())>
+    T clip_scale(const V& value, const G& grad, size_t n, updater_detail::gradient_adjust<T> adjust) {
+        const auto t = dbn.gradient_clip;
+
+        host_read(value, grad);
+
+        const auto grad_l2_norm = std::sqrt(updater_detail::squared_norm(etl::size(grad), value.memory_start(), grad.memory_start(), adjust) / (n * n));
+
+        return grad_l2_norm > t ? T(t / grad_l2_norm) : T(1);
+    }
+
+    /*!
+     * \brief Returns the scale of the gradient clipping, one since the
+     * gradients are not clipped
+     */
+    template <typename D = dbn_t, typename V, typename G, typename T, cpp_disable_if(dbn_traits<D>::has_clip_gradients())>
+    T clip_scale(const V& value, const G& grad, size_t n, updater_detail::gradient_adjust<T> adjust) {
+        cpp_unused(value);
+        cpp_unused(grad);
+        cpp_unused(n);
+        cpp_unused(adjust);
+
+        return T(1);
+    }
+
     /*!
      * \brief Update the given gradients according to the given decay function
      */
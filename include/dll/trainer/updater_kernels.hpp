@@ -0,0 +1,206 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the updaters of the SGD trainer.
+ *
+ * Each kernel reads the gradients, the parameters and the state of the
+ * updater once, adjusts the gradients (weight decay and clipping) on the
+ * fly and writes the new parameters and the new state once. The
+ * gradients themselves are not modified. The parameters are split in
+ * contiguous parts computed in parallel.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace updater_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of parameters to be updated in parallel
+
+/*!
+ * \brief Adjustment of the raw gradients: L1 and L2 weight decay followed
+ * by the scaling of the gradient clipping. The costs are zero when the
+ * decay is not applied and the scale is one when the gradients are not
+ * clipped.
+ */
+template <typename T>
+struct gradient_adjust {
+    T l1;    ///< The L1 weight cost
+    T l2;    ///< The L2 weight cost
+    T scale; ///< The scale of the clipping
+
+    /*!
+     * \brief Returns the adjusted gradient of the parameter w
+     */
+    T operator()(T w, T g) const {
+        return (g - l1 * std::abs(w) - l2 * w) * scale;
+    }
+};
+
+/*!
+ * \brief Call the functor on the contiguous parts of [0, N), in parallel
+ * if there are enough parameters
+ */
+template <typename Functor>
+void for_each_part(size_t N, Functor&& functor) {
+    const size_t P = N >= parallel_threshold ? std::min(N, concurrency()) : 1;
+
+    auto part = [&](size_t p) {
+        functor((p * N) / P, ((p + 1) * N) / P);
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+}
+
+/*!
+ * \brief Compute the sum of the squares of the decayed gradients, for the
+ * gradient clipping
+ *
+ * \param adjust The adjustment of the gradients, without scaling
+ */
+template <typename T>
+double squared_norm(size_t N, const T* w, const T* g, gradient_adjust<T> adjust) {
+    const size_t P = N >= parallel_threshold ? std::min(N, concurrency()) : 1;
+
+    std::vector<double> parts(P, 0.0);
+
+    auto part = [&](size_t p) {
+        double sum = 0.0;
+
+        for (size_t i = (p * N) / P; i < ((p + 1) * N) / P; ++i) {
+            const double d = adjust(w[i], g[i]);
+            sum += d * d;
+        }
+
+        parts[p] = sum;
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+
+    // The parts are summed in order, independently of the threads
+    double sum = 0.0;
+
+    for (size_t p = 0; p < P; ++p) {
+        sum += parts[p];
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Adam update of N parameters
+ *
+ * \param w The parameters
+ * \param g The gradients
+ * \param m The estimates of the first moment of the gradients
+ * \param v The estimates of the second moment of the gradients
+ */
+template <typename T>
+void adam(size_t N, T* w, const T* g, T* m, T* v, gradient_adjust<T> adjust, T eps, T beta1, T beta2, T e) {
+    for_each_part(N, [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const T gi = adjust(w[i], g[i]);
+            const T mi = beta1 * m[i] + (T(1) - beta1) * gi;
+            const T vi = beta2 * v[i] + (T(1) - beta2) * gi * gi;
+
+            m[i] = mi;
+            v[i] = vi;
+            w[i] += eps * mi / (std::sqrt(vi) + e);
+        }
+    });
+}
+
+/*!
+ * \brief Nesterov Adam (NAdam) update of N parameters
+ *
+ * \param w The parameters
+ * \param g The gradients
+ * \param m The estimates of the first moment of the gradients
+ * \param v The estimates of the second moment of the gradients
+ * \param m1 The factor of the gradients
+ * \param m2 The factor of the first moment
+ * \param mc The bias correction of the first moment
+ * \param vc The bias correction of the second moment
+ */
+template <typename T>
+void nadam(size_t N, T* w, const T* g, T* m, T* v, gradient_adjust<T> adjust, T m1, T m2, T mc, T vc, T beta1, T beta2, T e) {
+    for_each_part(N, [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const T gi = adjust(w[i], g[i]);
+            const T mi = beta1 * m[i] + (T(1) - beta1) * gi;
+            const T vi = beta2 * v[i] + (T(1) - beta2) * gi * gi;
+
+            m[i] = mi;
+            v[i] = vi;
+            w[i] += (m1 * gi + m2 * (mi / mc)) / (std::sqrt(vi / vc) + e);
+        }
+    });
+}
+
+/*!
+ * \brief RMSprop update of N parameters
+ *
+ * \param w The parameters
+ * \param g The gradients
+ * \param inc The moving average of the squared gradients
+ */
+template <typename T>
+void rmsprop(size_t N, T* w, const T* g, T* inc, gradient_adjust<T> adjust, T eps, T decay, T e) {
+    for_each_part(N, [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const T gi = adjust(w[i], g[i]);
+            const T ci = decay * inc[i] + (T(1) - decay) * gi * gi;
+
+            inc[i] = ci;
+            w[i] += eps * gi / std::sqrt(ci + e);
+        }
+    });
+}
+
+/*!
+ * \brief Adadelta update of N parameters
+ *
+ * \param w The parameters
+ * \param g The gradients
+ * \param acc_g The moving average of the squared gradients
+ * \param acc_x The moving average of the squared updates
+ */
+template <typename T>
+void adadelta(size_t N, T* w, const T* g, T* acc_g, T* acc_x, gradient_adjust<T> adjust, T beta, T e) {
+    for_each_part(N, [=](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const T gi = adjust(w[i], g[i]);
+            const T ai = beta * acc_g[i] + (T(1) - beta) * gi * gi;
+            const T di = std::sqrt(acc_x[i] + e) * gi / std::sqrt(ai + e);
+
+            acc_g[i] = ai;
+            acc_x[i] = beta * acc_x[i] + (T(1) - beta) * di * di;
+            w[i] += di;
+        }
+    });
+}
+
+} //end of namespace updater_detail
+
+} //end of dll namespace
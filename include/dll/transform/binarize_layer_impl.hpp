@@ -25,6 +25,8 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
 
     static constexpr size_t Threshold = desc::T;
 
+    static constexpr bool is_inplace = true; ///< The output can be written in the input
+
     binarize_layer_impl() = default;
 
     /*!
@@ -41,7 +43,7 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = input;
+        view_copy(output, input);
 
         for (auto& value : output) {
             value = value > Threshold ? 1 : 0;
@@ -112,13 +114,13 @@ struct sgd_context<DBN, binarize_layer_impl<Desc>, L> {
     using layer_t          = binarize_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output, the input binarized in place
+    inputs_t errors;  ///< A batch of errors
 
-    sgd_context(layer_t& /*layer*/){}
+    sgd_context(layer_t& /*layer*/) : output(input) {}
 };
 
 /*!
@@ -155,8 +157,10 @@ struct cg_context<binarize_layer_impl<Desc>> {
     etl::fast_matrix<weight, 1, 1> gr_w_tmp;
     etl::fast_vector<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    // The batch buffers (one sample per row), allocated by the trainer
+    etl::dyn_matrix<weight, 2> gr_probs_a;
+    etl::dyn_matrix<weight, 2> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_diffs;
 };
 
 } //end of dll namespace
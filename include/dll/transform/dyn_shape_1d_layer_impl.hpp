@@ -22,6 +22,8 @@ struct dyn_shape_1d_layer_impl : transform_layer<dyn_shape_1d_layer_impl<Desc>>
 
     static constexpr size_t D = 1; ///< The number of dimensions
 
+    static constexpr bool is_view = true; ///< The output is the input, with the shape of the layer
+
     using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The preferred type of input
     using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of output
 
@@ -66,7 +68,8 @@ struct dyn_shape_1d_layer_impl : transform_layer<dyn_shape_1d_layer_impl<Desc>>
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = input;
+        // In the SGD context, the output is the input itself
+        view_copy(output, input);
     }
 
     /*!
@@ -88,8 +91,7 @@ struct dyn_shape_1d_layer_impl : transform_layer<dyn_shape_1d_layer_impl<Desc>>
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        view_copy(output, context.errors);
     }
 
     /*!
@@ -132,11 +134,11 @@ struct sgd_context<DBN, dyn_shape_1d_layer_impl<Desc>, L> {
 
     using inputs_t = etl::dyn_matrix<weight, 2>;
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output (the input itself)
+    inputs_t& errors; ///< A batch of errors (the storage of the input)
 
-    sgd_context(layer_t& layer) : input(batch_size, layer.S), output(batch_size, layer.S), errors(batch_size, layer.S){}
+    sgd_context(layer_t& layer) : input(batch_size, layer.S), output(input), errors(input) {}
 };
 
 } //end of dll namespace
@@ -22,6 +22,8 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
 
     static constexpr size_t D = 3; ///< The number of dimensions
 
+    static constexpr bool is_view = true; ///< The output is the input, with the shape of the layer
+
     using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The preferred type of input
     using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type of output
 
@@ -72,7 +74,8 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = input;
+        // In the SGD context, the output is the input itself
+        view_copy(output, input);
     }
 
     /*!
@@ -94,8 +97,7 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        view_copy(output, context.errors);
     }
 
     /*!
@@ -138,11 +140,11 @@ struct sgd_context<DBN, dyn_shape_3d_layer_impl<Desc>, L> {
 
     using inputs_t = etl::dyn_matrix<weight, 4>;
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output (the input itself)
+    inputs_t& errors; ///< A batch of errors (the storage of the input)
 
-    sgd_context(layer_t& layer) : input(batch_size, layer.C, layer.W, layer.H), output(batch_size, layer.C, layer.W, layer.H), errors(batch_size, layer.C, layer.W, layer.H){}
+    sgd_context(layer_t& layer) : input(batch_size, layer.C, layer.W, layer.H), output(input), errors(input) {}
 };
 
 } //end of dll namespace
@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
 namespace dll {
 
 inline double gaussian(double x, double y, double sigma) {
@@ -25,12 +30,27 @@ void lcn_filter(W& w, size_t K, size_t Mid, double sigma){
     w /= etl::sum(w);
 }
 
+/*!
+ * \brief Compute the 1D gaussian filter of LCN.
+ *
+ * The 2D filter computed by lcn_filter is exactly the outer product of
+ * this filter with itself.
+ */
+template <typename G>
+void lcn_filter_1d(G& g, size_t K, size_t Mid, double sigma){
+    for (size_t i = 0; i < K; ++i) {
+        g(i) = std::exp(-((double(i) - Mid) * (double(i) - Mid)) / (2.0 * sigma * sigma));
+    }
+
+    g /= etl::sum(g);
+}
+
 /*!
  * \brief Apply the layer to the input
  * \param y The output
  * \param x The input to apply the layer to
  */
-template <typename Input, typename Output, typename W>
+template <typename Input, typename Output, typename W, cpp_enable_iff(etl::decay_traits<W>::dimensions() == 2)>
 void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     using weight_t = etl::value_t<Input>;
 
@@ -82,4 +102,111 @@ void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     }
 }
 
+namespace lcn_detail {
+
+/*!
+ * \brief Filter an image with the separable filter g x g, with zero padding.
+ *
+ * \param out The filtered image (H x W)
+ * \param tmp A temporary image (H x W)
+ * \param in The image to filter (H x W)
+ * \param g The 1D filter
+ */
+template <typename T, typename G>
+DLL_MULTI_VERSION void separable_filter(T* out, T* tmp, const T* in, const G& g, size_t K, size_t Mid, size_t H, size_t W){
+    // 1. Horizontal pass, the inner loop is contiguous in the row
+
+    for (size_t j = 0; j < H; ++j) {
+        const T* in_row = in + j * W;
+        T* tmp_row      = tmp + j * W;
+
+        std::fill(tmp_row, tmp_row + W, T(0));
+
+        for (size_t q = 0; q < K; ++q) {
+            // Output k reads input k + q - Mid
+            const size_t first = q < Mid ? std::min(W, Mid - q) : 0;
+            const size_t last  = q <= Mid ? W : (q - Mid < W ? W - (q - Mid) : 0);
+
+            const T gq = g(q);
+
+            for (size_t k = first; k < last; ++k) {
+                tmp_row[k] += gq * in_row[k + q - Mid];
+            }
+        }
+    }
+
+    // 2. Vertical pass, on full rows
+
+    for (size_t j = 0; j < H; ++j) {
+        T* out_row = out + j * W;
+
+        std::fill(out_row, out_row + W, T(0));
+
+        for (size_t p = 0; p < K; ++p) {
+            if (j + p < Mid || j + p - Mid >= H) {
+                continue;
+            }
+
+            const T* tmp_row = tmp + (j + p - Mid) * W;
+            const T gp       = g(p);
+
+            for (size_t k = 0; k < W; ++k) {
+                out_row[k] += gp * tmp_row[k];
+            }
+        }
+    }
+}
+
+} //end of namespace lcn_detail
+
+/*!
+ * \brief Apply the layer to the input, with the separable 1D filter
+ * \param y The output
+ * \param x The input to apply the layer to
+ * \param g The 1D filter, as computed by lcn_filter_1d
+ */
+template <typename Input, typename Output, typename G, cpp_enable_iff(etl::decay_traits<G>::dimensions() == 1)>
+void lcn_compute(Output&& y, const Input& x, const G& g, size_t K, size_t Mid){
+    using weight_t = etl::value_t<Input>;
+
+    const size_t H = etl::dim<1>(x);
+    const size_t W = etl::dim<2>(x);
+
+    etl::dyn_matrix<weight_t, 2> v(H, W);
+    etl::dyn_matrix<weight_t, 2> s(H, W);
+    etl::dyn_matrix<weight_t, 2> m(H, W);
+    etl::dyn_matrix<weight_t, 2> o(H, W);
+    etl::dyn_matrix<weight_t, 2> tmp(H, W);
+
+    for (size_t c = 0; c < etl::dim<0>(x); ++c) {
+        v = x(c);
+        s = v >> v;
+
+        //1. For each pixel, remove mean of the neighborhood
+        lcn_detail::separable_filter(m.memory_start(), tmp.memory_start(), v.memory_start(), g, K, Mid, H, W);
+
+        //2. Scale down norm of the patch if norm is bigger than 1
+        lcn_detail::separable_filter(o.memory_start(), tmp.memory_start(), s.memory_start(), g, K, Mid, H, W);
+
+        v -= m;
+        o = etl::sqrt(o);
+
+        auto cst = etl::mean(o);
+        y(c) = v / etl::max(o, cst);
+    }
+}
+
+/*!
+ * \brief Apply the layer to a batch of input, in parallel over the samples
+ * \param y The batch of output
+ * \param x The batch of input to apply the layer to
+ * \param g The 1D filter, as computed by lcn_filter_1d
+ */
+template <typename Input, typename Output, typename G>
+void lcn_compute_batch(Output&& y, const Input& x, const G& g, size_t K, size_t Mid){
+    parallel_for_n(etl::dim<0>(x), [&](size_t b) {
+        lcn_compute(y(b), x(b), g, K, Mid);
+    });
+}
+
 } //end of dll namespace
@@ -24,6 +24,8 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
     using desc      = Desc;                                   ///< The descriptor type
     using base_type = transform_layer<normalize_layer_impl<Desc>>; ///< The base type
 
+    static constexpr bool is_inplace = true; ///< The output can be written in the input
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -38,7 +40,7 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = input;
+        view_copy(output, input);
         cpp::normalize(output);
     }
 
@@ -101,13 +103,13 @@ struct sgd_context<DBN, normalize_layer_impl<Desc>, L> {
     using layer_t          = normalize_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output, the input normalized in place
+    inputs_t errors;  ///< A batch of errors
 
-    sgd_context(layer_t& /*layer*/){}
+    sgd_context(layer_t& /*layer*/) : output(input) {}
 };
 
 } //end of dll namespace
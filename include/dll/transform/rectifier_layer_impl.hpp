@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
 #include "dll/base_traits.hpp"
+#include "dll/util/parallel.hpp"
 #include "transform_layer.hpp"
 
 namespace dll {
@@ -26,6 +31,10 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
 
     static_assert(method == rectifier_method::ABS, "Only ABS rectifier has been implemented");
 
+    static constexpr bool is_inplace = true; ///< The output can be written in the input
+
+    static constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum size of a batch to be computed in parallel
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -44,6 +53,109 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
             output = etl::abs(input);
         }
     }
+
+    /*!
+     * \brief Apply the layer to the batch of input of the given SGD context.
+     *
+     * The output of the context is its input, the input is rectified in
+     * place and the sign of the values is stored in the context, one bit
+     * per value, for the backpropagation.
+     *
+     * \param context The training context
+     */
+    template <typename C>
+    void train_forward_context(C& context) const {
+        using T = etl::value_t<decltype(context.input)>;
+
+        const size_t n = etl::size(context.input);
+
+        context.signs.resize((n + 63) / 64);
+
+        T* x            = context.input.memory_start();
+        uint64_t* signs = context.signs.data();
+
+        for_each_word(n, [x, signs](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                if (!(i & 63)) {
+                    signs[i / 64] = 0;
+                }
+
+                if (x[i] < T(0)) {
+                    x[i] = -x[i];
+                    signs[i / 64] |= uint64_t(1) << (i & 63);
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        using T = etl::value_t<decltype(context.errors)>;
+
+        const size_t n = etl::size(context.errors);
+
+        const T* e            = context.errors.memory_start();
+        T* y                  = output.memory_start();
+        const uint64_t* signs = context.signs.data();
+
+        // The derivative of abs is the sign of the input
+        for_each_word(n, [e, y, signs](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                y[i] = (signs[i / 64] >> (i & 63)) & 1 ? -e[i] : e[i];
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        cpp_unused(context);
+    }
+
+private:
+    /*!
+     * \brief Call the functor on contiguous ranges of [0, n), in parallel
+     * if the batch is large enough. The ranges are multiples of 64 values,
+     * each word of the signs is written by a single task.
+     */
+    template <typename Functor>
+    static void for_each_word(size_t n, Functor&& functor) {
+        constexpr size_t block = 64 * 64;
+
+        const size_t tasks = (n + block - 1) / block;
+
+        auto task = [&](size_t t) {
+            functor(t * block, std::min(n, (t + 1) * block));
+        };
+
+        if (n >= parallel_threshold && tasks > 1) {
+            parallel_for_n(tasks, task);
+        } else {
+            for (size_t t = 0; t < tasks; ++t) {
+                task(t);
+            }
+        }
+    }
 };
 
 //Allow odr-use of the constexpr static members
@@ -77,13 +189,15 @@ struct sgd_context<DBN, rectifier_layer_impl<Desc>, L> {
     using layer_t          = rectifier_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
+
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output, the input rectified in place
+    inputs_t errors;  ///< A batch of errors
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    std::vector<uint64_t> signs; ///< The negative inputs, one bit per value
 
-    sgd_context(layer_t& /*layer*/){}
+    sgd_context(layer_t& /*layer*/) : output(input) {}
 };
 
 } //end of dll namespace
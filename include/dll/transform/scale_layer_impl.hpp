@@ -26,6 +26,8 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
     static constexpr int A = desc::A; ///< The scale multiplier
     static constexpr int B = desc::B; ///< The scale divisor
 
+    static constexpr bool is_inplace = true; ///< The output can be written in the input
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -62,8 +64,7 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        output = context.errors * (double(A) / double(B));
     }
 
     /*!
@@ -102,13 +103,13 @@ struct sgd_context<DBN, scale_layer_impl<Desc>, L> {
     using layer_t          = scale_layer_impl<Desc>;                            ///< The current layer type
     using previous_layer   = typename DBN::template layer_type<L - 1>;          ///< The previous layer type
     using previous_context = sgd_context<DBN, previous_layer, L - 1>;           ///< The previous layer's context
-    using inputs_t         = decltype(std::declval<previous_context>().output); ///< The type of inputs
+    using inputs_t         = std::decay_t<decltype(std::declval<previous_context>().output)>; ///< The type of inputs
 
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output, the input scaled in place
+    inputs_t errors;  ///< A batch of errors
 
-    sgd_context(layer_t& /*layer*/){}
+    sgd_context(layer_t& /*layer*/) : output(input) {}
 };
 
 } //end of dll namespace
@@ -25,6 +25,8 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
     static constexpr size_t Size = desc::S; ///< The input size
     static constexpr size_t D    = 1;       ///< The number of dimensions
 
+    static constexpr bool is_view = true; ///< The output is the input, with the shape of the layer
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Size>; ///< The preferred type of input
     using output_one_t = etl::fast_dyn_matrix<weight, Size>; ///< The type of output
 
@@ -60,7 +62,8 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = input;
+        // In the SGD context, the output is the input itself
+        view_copy(output, input);
     }
 
     /*!
@@ -82,8 +85,7 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        view_copy(output, context.errors);
     }
 
     /*!
@@ -129,11 +131,13 @@ struct sgd_context<DBN, shape_1d_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, layer_t::Size> input;
-    etl::fast_matrix<weight, batch_size, layer_t::Size> output;
-    etl::fast_matrix<weight, batch_size, layer_t::Size> errors;
+    using inputs_t = etl::fast_matrix<weight, batch_size, layer_t::Size>;
+
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output (the input itself)
+    inputs_t& errors; ///< A batch of errors (the storage of the input)
 
-    sgd_context(const shape_1d_layer_impl<Desc>& /* layer */){}
+    sgd_context(const shape_1d_layer_impl<Desc>& /* layer */) : output(input), errors(input) {}
 };
 
 } //end of dll namespace
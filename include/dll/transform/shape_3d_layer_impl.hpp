@@ -23,6 +23,8 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
     using base_type = transform_layer<this_type>; ///< The base type
 
     static constexpr size_t D = 3;       ///< The number of dimensions
+
+    static constexpr bool is_view = true; ///< The output is the input, with the shape of the layer
     static constexpr size_t C = desc::C; ///< The number of channels
     static constexpr size_t W = desc::W; ///< The height of the input
     static constexpr size_t H = desc::H; ///< The width of the input
@@ -62,7 +64,8 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = input;
+        // In the SGD context, the output is the input itself
+        view_copy(output, input);
     }
 
     /*!
@@ -84,8 +87,7 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        view_copy(output, context.errors);
     }
 
     /*!
@@ -137,11 +139,13 @@ struct sgd_context<DBN, shape_3d_layer_impl<Desc>, L> {
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> input;
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> output;
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> errors;
+    using inputs_t = etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W>;
+
+    inputs_t input;   ///< A batch of input
+    inputs_t& output; ///< A batch of output (the input itself)
+    inputs_t& errors; ///< A batch of errors (the storage of the input)
 
-    sgd_context(const shape_3d_layer_impl<Desc>& /* layer */){}
+    sgd_context(const shape_3d_layer_impl<Desc>& /* layer */) : output(input), errors(input) {}
 };
 
 } //end of dll namespace
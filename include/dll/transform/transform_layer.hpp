@@ -86,4 +86,27 @@ void inherit_dim(Output& output, const Input& input) {
     output.inherit_if_null(input);
 }
 
+/*!
+ * \brief Copy the input into the output of a view layer, unless the
+ * output is the input itself
+ * \param output The output
+ * \param input The input
+ */
+template <typename T>
+void view_copy(T& output, const T& input) {
+    if (&output != &input) {
+        output = input;
+    }
+}
+
+/*!
+ * \brief Copy the input into the output of a view layer
+ * \param output The output
+ * \param input The input
+ */
+template <typename Input, typename Output, cpp_disable_if(std::is_same<std::decay_t<Output>, Input>::value)>
+void view_copy(Output&& output, const Input& input) {
+    output = input;
+}
+
 } //end of dll namespace
@@ -0,0 +1,321 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Pinning of the threads of DLL on the CPUs, following the NUMA
+ * topology of the machine.
+ *
+ * The CPUs are ordered node by node. The compute workers (the trainer
+ * thread, the workers of the parallel loops and the threads of the pools)
+ * are pinned from the first CPUs, the helper threads (generators,
+ * loaders, flushers) from the last ones, so that they stay
+ * on the same nodes as long as possible and do not compete with each
+ * other when there are enough CPUs.
+ *
+ * Since the memory of a page is allocated on the node of the thread that
+ * first touches it, pinning the trainer thread before creating the
+ * networks and the generators also keeps their memory on its node.
+ *
+ * The pinning is disabled by default. It is enabled with
+ * set_thread_affinity(true) or with the DLL_AFFINITY environment variable,
+ * in which case the thread creating the first network is the trainer.
+ *
+ * The stages of the pipeline-parallel training are pinned on the nodes of
+ * the machine and their memory is moved on their node.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+
+#include "cpp_utils/assert.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The CPUs of the machine, ordered node by node
+ */
+struct cpu_topology {
+    std::vector<std::vector<size_t>> nodes; ///< The CPUs of each NUMA node
+    std::vector<size_t> cpus;               ///< All the CPUs, node by node
+
+    /*!
+     * \brief Read the topology of the machine
+     */
+    cpu_topology() {
+        for (size_t node = 0;; ++node) {
+            std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+            if (!stream) {
+                break;
+            }
+
+            std::string list;
+            std::getline(stream, list);
+
+            nodes.push_back(parse_list(list));
+
+            cpus.insert(cpus.end(), nodes.back().begin(), nodes.back().end());
+        }
+
+        // Without NUMA information, a single node with all the CPUs
+        if (cpus.empty()) {
+            nodes.emplace_back();
+
+            for (size_t c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) {
+                nodes.back().push_back(c);
+            }
+
+            cpus = nodes.back();
+        }
+    }
+
+    /*!
+     * \brief Parse a list of CPUs such as "0-3,8-11"
+     */
+    static std::vector<size_t> parse_list(const std::string& list) {
+        std::vector<size_t> result;
+
+        size_t i = 0;
+        while (i < list.size()) {
+            auto end = list.find(',', i);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+
+            auto range = list.substr(i, end - i);
+            auto dash  = range.find('-');
+
+            if (!range.empty()) {
+                const size_t first = std::stoul(range.substr(0, dash));
+                const size_t last  = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+                for (size_t c = first; c <= last; ++c) {
+                    result.push_back(c);
+                }
+            }
+
+            i = end + 1;
+        }
+
+        return result;
+    }
+};
+
+/*!
+ * \brief Return the topology of the machine
+ */
+inline const cpu_topology& topology() {
+    static cpu_topology t;
+    return t;
+}
+
+namespace affinity_detail {
+
+/*!
+ * \brief Indicates if the threads are pinned
+ */
+inline std::atomic<bool>& enabled() {
+    static std::atomic<bool> value(std::getenv("DLL_AFFINITY") != nullptr);
+    return value;
+}
+
+/*!
+ * \brief The number of helper threads pinned so far
+ */
+inline std::atomic<size_t>& helpers() {
+    static std::atomic<size_t> value(0);
+    return value;
+}
+
+/*!
+ * \brief The number of pool threads pinned so far
+ */
+inline std::atomic<size_t>& pool_threads() {
+    static std::atomic<size_t> value(0);
+    return value;
+}
+
+/*!
+ * \brief Indicates if the current thread has been pinned
+ */
+inline bool& pinned() {
+    static thread_local bool value = false;
+    return value;
+}
+
+/*!
+ * \brief Pin the current thread on the given CPU
+ */
+inline void pin(size_t cpu) {
+    pinned() = true;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    cpp_unused(cpu);
+#endif
+}
+
+} //end of namespace affinity_detail
+
+/*!
+ * \brief Indicates if the threads of DLL are pinned on the CPUs
+ */
+inline bool thread_affinity() {
+    return affinity_detail::enabled();
+}
+
+/*!
+ * \brief Pin the current thread as the compute worker of the given index.
+ *
+ * The worker 0 is the trainer thread.
+ */
+inline void pin_worker(size_t worker) {
+    if (thread_affinity()) {
+        auto& cpus = topology().cpus;
+        affinity_detail::pin(cpus[worker % cpus.size()]);
+    }
+}
+
+/*!
+ * \brief Pin the current thread as the helper thread of the given index,
+ * the helpers being pinned from the last CPUs.
+ */
+inline void pin_helper(size_t helper) {
+    if (thread_affinity()) {
+        auto& cpus = topology().cpus;
+        affinity_detail::pin(cpus[cpus.size() - 1 - helper % cpus.size()]);
+    }
+}
+
+/*!
+ * \brief Pin the current thread as a helper thread, on the next free
+ * helper CPU. A thread is only pinned once.
+ */
+inline void pin_helper() {
+    if (thread_affinity() && !affinity_detail::pinned()) {
+        pin_helper(affinity_detail::helpers()++);
+    }
+}
+
+/*!
+ * \brief Pin the current thread of a thread pool as a compute worker, on
+ * the next free worker CPU. A thread is only pinned once, the trainer
+ * thread running the tasks of a serial pool is not moved.
+ */
+inline void pin_pool_thread() {
+    if (thread_affinity() && !affinity_detail::pinned()) {
+        pin_worker(1 + affinity_detail::pool_threads()++);
+    }
+}
+
+/*!
+ * \brief Pin the current thread as the trainer thread, if it has not
+ * already been pinned
+ */
+inline void pin_trainer() {
+    if (thread_affinity() && !affinity_detail::pinned()) {
+        pin_worker(0);
+    }
+}
+
+/*!
+ * \brief Returns the number of NUMA nodes of the machine
+ */
+inline size_t numa_nodes() {
+    return topology().nodes.size();
+}
+
+/*!
+ * \brief Pin the current thread on the given CPU of the given NUMA node
+ * \param node The NUMA node
+ * \param index The index of the CPU in the node
+ */
+inline void pin_node(size_t node, size_t index) {
+    if (thread_affinity()) {
+        auto& cpus = topology().nodes[node % numa_nodes()];
+
+        if (!cpus.empty()) {
+            affinity_detail::pin(cpus[index % cpus.size()]);
+        }
+    }
+}
+
+/*!
+ * \brief Move the memory pages to the given NUMA node and make it the
+ * preferred node of the next pages allocated in this memory.
+ *
+ * Only the pages entirely inside the memory are moved, a page shared with
+ * another memory is left on its node. Nothing is done when the threads are
+ * not pinned or without NUMA nodes.
+ *
+ * \param memory The start of the memory
+ * \param bytes The size of the memory
+ * \param node The NUMA node
+ */
+inline void move_to_node(const void* memory, size_t bytes, size_t node) {
+#ifdef __linux__
+    if (!thread_affinity() || numa_nodes() < 2 || node >= 8 * sizeof(unsigned long)) {
+        return;
+    }
+
+    const size_t page  = sysconf(_SC_PAGESIZE);
+    const size_t start = (reinterpret_cast<size_t>(memory) + page - 1) / page * page;
+    const size_t end   = (reinterpret_cast<size_t>(memory) + bytes) / page * page;
+
+    if (start >= end) {
+        return;
+    }
+
+    static constexpr int mpol_preferred = 1;        // MPOL_PREFERRED
+    static constexpr unsigned mpol_mf_move = 1 << 1; // MPOL_MF_MOVE
+
+    unsigned long mask = 1UL << node;
+
+    // mbind is called directly, to not depend on libnuma
+    syscall(SYS_mbind, start, end - start, mpol_preferred, &mask, 8 * sizeof(mask), mpol_mf_move);
+#else
+    cpp_unused(memory);
+    cpp_unused(bytes);
+    cpp_unused(node);
+#endif
+}
+
+/*!
+ * \brief Enable or disable the pinning of the threads of DLL.
+ *
+ * When enabled, the current thread is pinned as the trainer thread. This
+ * should be called before the creation of the networks and generators
+ * so that their memory is allocated on the node of the trainer.
+ */
+inline void set_thread_affinity(bool enable) {
+    affinity_detail::enabled() = enable;
+
+    if (enable) {
+        pin_worker(0);
+    }
+}
+
+} //end of dll namespace
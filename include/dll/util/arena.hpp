@@ -0,0 +1,93 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Simple arena to allocate several objects in one contiguous block
+ * of memory.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace dll {
+
+/*!
+ * \brief A fixed-size arena of aligned memory.
+ *
+ * Objects are allocated one after another and are destructed by their
+ * shared_ptr, but the memory itself is only released with the arena. The
+ * arena must therefore outlive all the objects allocated from it.
+ */
+struct memory_arena {
+    static constexpr size_t alignment = 64; ///< The alignment of each object (cache line)
+
+    /*!
+     * \brief Returns the size taken by an object of the given size inside an arena
+     * \param n The size of the object, in bytes
+     * \return the aligned size of the object
+     */
+    static constexpr size_t aligned_size(size_t n) {
+        return ((n + alignment - 1) / alignment) * alignment;
+    }
+
+    /*!
+     * \brief Construct a new memory_arena
+     * \param capacity The capacity of the arena, in bytes
+     */
+    explicit memory_arena(size_t capacity) : memory(new char[capacity + alignment]), capacity(capacity) {
+        auto address = reinterpret_cast<uintptr_t>(memory.get());
+        start        = memory.get() + (aligned_size(address) - address);
+    }
+
+    memory_arena(const memory_arena& rhs) = delete;
+    memory_arena& operator=(const memory_arena& rhs) = delete;
+
+    memory_arena(memory_arena&& rhs) = delete;
+    memory_arena& operator=(memory_arena&& rhs) = delete;
+
+    /*!
+     * \brief Construct a new object inside the arena.
+     *
+     * If the arena is full, the object is allocated normally.
+     *
+     * \param args The arguments to forward to the constructor of the object
+     * \return A shared_ptr to the new object
+     */
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_shared(Args&&... args) {
+        static_assert(alignof(T) <= alignment, "The arena is not aligned enough for this type");
+
+        const size_t n = aligned_size(sizeof(T));
+
+        if (cpp_unlikely(used + n > capacity)) {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+
+        auto* object = new (start + used) T(std::forward<Args>(args)...);
+
+        used += n;
+
+        return std::shared_ptr<T>(object, [](T* ptr) { ptr->~T(); });
+    }
+
+    /*!
+     * \brief Returns the number of bytes used in the arena
+     */
+    size_t size() const {
+        return used;
+    }
+
+private:
+    std::unique_ptr<char[]> memory; ///< The allocated memory
+    char* start     = nullptr;      ///< The aligned start of the arena
+    size_t capacity = 0;            ///< The capacity of the arena
+    size_t used     = 0;            ///< The number of bytes used
+};
+
+} //end of dll namespace
@@ -0,0 +1,93 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Conversions to and from the bfloat16 storage format
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The storage type of a bfloat16 value.
+ *
+ * A bfloat16 is the upper half of a single-precision float: the same
+ * exponent range with only 8 bits of mantissa.
+ */
+using bf16_t = uint16_t;
+
+/*!
+ * \brief Convert a floating point value to bfloat16, rounding to the
+ * nearest even.
+ * \param value The value to convert
+ * \return The bfloat16 representation of value
+ */
+inline bf16_t to_bf16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    // NaN must stay NaN (the rounding could overflow into the infinity)
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+        return bf16_t((bits >> 16) | 0x40u);
+    }
+
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+
+    return bf16_t(bits >> 16);
+}
+
+/*!
+ * \brief Convert a bfloat16 value to single-precision.
+ * \param value The bfloat16 value to convert
+ * \return The float value
+ */
+inline float from_bf16(bf16_t value) {
+    const uint32_t bits = uint32_t(value) << 16;
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/*!
+ * \brief Store the given expression in the given bfloat16 container
+ * \param out The bfloat16 container (of the same size as in)
+ * \param in The floating point values to store
+ */
+template <typename O, typename I>
+void bf16_encode(O&& out, const I& in) {
+    cpp_assert(etl::size(out) == etl::size(in), "bf16_encode needs containers of the same size");
+
+    for (size_t i = 0; i < etl::size(in); ++i) {
+        out[i] = to_bf16(float(in[i]));
+    }
+}
+
+/*!
+ * \brief Load the values of the given bfloat16 container
+ * \param out The output floating point container (of the same size as in)
+ * \param in The bfloat16 container
+ */
+template <typename O, typename I>
+void bf16_decode(O&& out, const I& in) {
+    cpp_assert(etl::size(out) == etl::size(in), "bf16_decode needs containers of the same size");
+
+    using T = etl::value_t<O>;
+
+    for (size_t i = 0; i < etl::size(in); ++i) {
+        out[i] = T(from_bf16(in[i]));
+    }
+}
+
+} //end of dll namespace
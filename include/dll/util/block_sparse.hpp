@@ -0,0 +1,403 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Block-sparse weights for the dense layers and the RBMs.
+ *
+ * The weights (V x H) are divided in blocks of R x C weights and only the
+ * blocks with non-zero weights are kept, in Block Sparse Row (BSR) format.
+ * The structure only holds the indices of the kept blocks, the values are
+ * read from the dense weights of the layer, which stay the reference for
+ * the backpropagation, the serialization and the backups. The products
+ * then cost in proportion to the number of kept blocks instead of the
+ * number of weights.
+ *
+ * The trainers (SGD and CD) mask the weights after each update, the
+ * removed blocks staying at zero during the fine-tuning.
+ *
+ * The blocks of 4 x 4, 8 x 1 and 1 x 8 weights have kernels compiled with
+ * their sizes as constants, fully vectorized by the compiler.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/direct.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The structure of block-sparse weights, the indices of the kept
+ * blocks in Block Sparse Row format
+ */
+struct block_sparsity {
+    size_t block_rows    = 0; ///< The number of rows (inputs) of a block
+    size_t block_columns = 0; ///< The number of columns (outputs) of a block
+    size_t rows          = 0; ///< The number of rows of blocks
+    size_t columns       = 0; ///< The number of columns of blocks
+    std::vector<size_t> ptr;  ///< The index of the first kept block of each row of blocks (rows + 1)
+    std::vector<size_t> col;  ///< The column of each kept block
+
+    /*!
+     * \brief Indicates if the weights are block-sparse
+     */
+    bool enabled() const {
+        return !ptr.empty();
+    }
+
+    /*!
+     * \brief Return the number of kept blocks
+     */
+    size_t blocks() const {
+        return col.size();
+    }
+
+    /*!
+     * \brief Return the ratio of kept blocks
+     */
+    double density() const {
+        return rows && columns ? double(blocks()) / double(rows * columns) : 0.0;
+    }
+
+    /*!
+     * \brief Go back to dense weights
+     */
+    void clear() {
+        rows    = 0;
+        columns = 0;
+        ptr.clear();
+        col.clear();
+    }
+
+    /*!
+     * \brief Keep the blocks of the given weights with at least one
+     * non-zero weight
+     *
+     * \param w The weights (V x H)
+     * \param r The number of rows of a block, dividing V
+     * \param c The number of columns of a block, dividing H
+     */
+    template <typename W>
+    void compress(const W& w, size_t r, size_t c) {
+        using T = etl::value_t<W>;
+
+        select(w, r, c, [](const T* block, size_t H, size_t r, size_t c) {
+            for (size_t a = 0; a < r; ++a) {
+                for (size_t b = 0; b < c; ++b) {
+                    if (block[a * H + b] != T(0)) {
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        });
+    }
+
+    /*!
+     * \brief Remove the given ratio of the blocks of the given weights,
+     * with the lowest magnitudes, and keep the others
+     *
+     * The weights of the removed blocks are set to zero.
+     *
+     * \param w The weights (V x H)
+     * \param r The number of rows of a block, dividing V
+     * \param c The number of columns of a block, dividing H
+     * \param ratio The ratio of blocks to remove, in [0, 1]
+     */
+    template <typename W>
+    void prune(W& w, size_t r, size_t c, double ratio) {
+        using T = etl::value_t<W>;
+
+        cpp_assert(ratio >= 0.0 && ratio <= 1.0, "The ratio of removed blocks must be in [0, 1]");
+
+        const size_t V = etl::dim<0>(w);
+        const size_t H = etl::dim<1>(w);
+
+        host_read(w);
+
+        const T* weights = w.memory_start();
+
+        // The L2 norm of each block
+
+        std::vector<double> norms;
+        norms.reserve((V / r) * (H / c));
+
+        for (size_t i = 0; i < V / r; ++i) {
+            for (size_t j = 0; j < H / c; ++j) {
+                const T* block = weights + i * r * H + j * c;
+
+                double norm = 0.0;
+
+                for (size_t a = 0; a < r; ++a) {
+                    for (size_t b = 0; b < c; ++b) {
+                        norm += double(block[a * H + b]) * double(block[a * H + b]);
+                    }
+                }
+
+                norms.push_back(std::sqrt(norm));
+            }
+        }
+
+        const size_t removed = std::min(norms.size(), size_t(ratio * norms.size() + 0.5));
+
+        // The threshold is the norm of the last removed block, the ties are
+        // broken by the order of the blocks
+
+        auto sorted = norms;
+        std::sort(sorted.begin(), sorted.end());
+
+        const double threshold = removed ? sorted[removed - 1] : -1.0;
+
+        size_t ties = std::count(sorted.begin(), sorted.begin() + removed, threshold);
+        size_t k    = 0;
+
+        select(w, r, c, [&](const T*, size_t, size_t, size_t) {
+            const double norm = norms[k++];
+
+            if (norm < threshold) {
+                return false;
+            } else if (norm == threshold && ties) {
+                --ties;
+                return false;
+            }
+
+            return true;
+        });
+
+        mask(w);
+    }
+
+    /*!
+     * \brief Set the weights of the removed blocks to zero
+     * \param w The weights (V x H)
+     */
+    template <typename W>
+    void mask(W& w) const {
+        using T = etl::value_t<W>;
+
+        const size_t H = columns * block_columns;
+
+        host_read(w);
+
+        T* weights = w.memory_start();
+
+        for (size_t i = 0; i < rows; ++i) {
+            size_t k = ptr[i];
+
+            for (size_t j = 0; j < columns; ++j) {
+                if (k < ptr[i + 1] && col[k] == j) {
+                    ++k;
+                    continue;
+                }
+
+                T* block = weights + i * block_rows * H + j * block_columns;
+
+                for (size_t a = 0; a < block_rows; ++a) {
+                    std::fill(block + a * H, block + a * H + block_columns, T(0));
+                }
+            }
+        }
+
+        host_written(w);
+    }
+
+private:
+    /*!
+     * \brief Build the structure from the blocks accepted by the given
+     * predicate, called on each block in row-major order
+     */
+    template <typename W, typename P>
+    void select(const W& w, size_t r, size_t c, P&& keep) {
+        const size_t V = etl::dim<0>(w);
+        const size_t H = etl::dim<1>(w);
+
+        cpp_assert(r && c && V % r == 0 && H % c == 0, "The blocks must divide the weights");
+
+        host_read(w);
+
+        const auto* weights = w.memory_start();
+
+        block_rows    = r;
+        block_columns = c;
+        rows          = V / r;
+        columns       = H / c;
+
+        ptr.resize(rows + 1);
+        col.clear();
+
+        for (size_t i = 0; i < rows; ++i) {
+            ptr[i] = col.size();
+
+            for (size_t j = 0; j < columns; ++j) {
+                if (keep(weights + i * r * H + j * c, H, r, c)) {
+                    col.push_back(j);
+                }
+            }
+        }
+
+        ptr[rows] = col.size();
+    }
+};
+
+namespace block_sparse_detail {
+
+/*!
+ * \brief Compute y = x * w for a batch x (B x V) and block-sparse weights
+ * w (V x H).
+ *
+ * The sizes of the blocks are constants when R and C are not zero, the
+ * sizes of the structure being used otherwise. The batch is processed by
+ * tiles of rows, each kept block is loaded once per tile.
+ */
+template <size_t R, size_t C, typename T>
+void bsr_mul(T* y, const T* x, const T* w, const block_sparsity& s, size_t B) {
+    constexpr size_t tile = 8;
+
+    const size_t r = R ? R : s.block_rows;
+    const size_t c = C ? C : s.block_columns;
+    const size_t V = s.rows * r;
+    const size_t H = s.columns * c;
+
+    auto task = [&](size_t t) {
+        const size_t first = t * tile;
+        const size_t last  = std::min(B, first + tile);
+
+        std::fill(y + first * H, y + last * H, T(0));
+
+        for (size_t i = 0; i < s.rows; ++i) {
+            for (size_t k = s.ptr[i]; k < s.ptr[i + 1]; ++k) {
+                const T* w_block = w + i * r * H + s.col[k] * c;
+
+                for (size_t b = first; b < last; ++b) {
+                    const T* x_block = x + b * V + i * r;
+                    T* y_block       = y + b * H + s.col[k] * c;
+
+                    for (size_t a = 0; a < r; ++a) {
+                        const T x_a    = x_block[a];
+                        const T* w_row = w_block + a * H;
+
+                        for (size_t j = 0; j < c; ++j) {
+                            y_block[j] += x_a * w_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    const size_t tiles = (B + tile - 1) / tile;
+
+    if (tiles > 1) {
+        parallel_for_n(tiles, task);
+    } else {
+        task(0);
+    }
+}
+
+/*!
+ * \brief Set the weights of the removed blocks of a layer with
+ * block-sparse weights to zero
+ */
+template <typename L>
+auto mask_blocks(L& layer, int) -> decltype(layer.w_blocks.mask(layer.w), void()) {
+    if (layer.w_blocks.enabled()) {
+        layer.w_blocks.mask(layer.w);
+    }
+}
+
+/*!
+ * \brief Do nothing for a layer without block-sparse weights
+ */
+template <typename L>
+void mask_blocks(L& layer, long) {
+    cpp_unused(layer);
+}
+
+} //end of namespace block_sparse_detail
+
+/*!
+ * \brief Compute y = x * w with the block-sparse weights w
+ *
+ * \param y The output (samples x H), with direct memory access
+ * \param x The batch (samples x V)
+ * \param w The weights (V x H), zero outside of the kept blocks
+ * \param s The structure of the weights
+ */
+template <typename Y, typename X, typename W>
+void block_sparse_mul(Y&& y, const X& x, const W& w, const block_sparsity& s) {
+    using block_sparse_detail::bsr_mul;
+
+    decltype(auto) in = direct_memory(x);
+
+    cpp_assert(etl::size(in) / etl::dim<0>(in) == s.rows * s.block_rows, "Invalid input for the block-sparse weights");
+    cpp_assert(etl::dim<1>(w) == s.columns * s.block_columns, "Invalid block-sparse weights");
+
+    host_read(in, w);
+
+    auto* out      = y.memory_start();
+    const auto* ix = in.memory_start();
+    const auto* iw = w.memory_start();
+    const size_t B = etl::dim<0>(in);
+
+    if (s.block_rows == 4 && s.block_columns == 4) {
+        bsr_mul<4, 4>(out, ix, iw, s, B);
+    } else if (s.block_rows == 8 && s.block_columns == 1) {
+        bsr_mul<8, 1>(out, ix, iw, s, B);
+    } else if (s.block_rows == 1 && s.block_columns == 8) {
+        bsr_mul<1, 8>(out, ix, iw, s, B);
+    } else {
+        bsr_mul<0, 0>(out, ix, iw, s, B);
+    }
+
+    host_written(y);
+}
+
+/*!
+ * \brief Make the weights of the given layer block-sparse, removing the
+ * given ratio of the blocks with the lowest magnitudes.
+ *
+ * \param layer The layer (dense layer or RBM)
+ * \param r The number of rows (inputs) of a block
+ * \param c The number of columns (outputs) of a block
+ * \param ratio The ratio of blocks to remove, in [0, 1]
+ */
+template <typename L>
+void block_sparsify(L& layer, size_t r, size_t c, double ratio) {
+    layer.w_blocks.prune(layer.w, r, c, ratio);
+}
+
+/*!
+ * \brief Make the weights of the given layer block-sparse, keeping the
+ * blocks with non-zero weights (e.g. after a pruning)
+ *
+ * \param layer The layer (dense layer or RBM)
+ * \param r The number of rows (inputs) of a block
+ * \param c The number of columns (outputs) of a block
+ */
+template <typename L>
+void block_compress(L& layer, size_t r, size_t c) {
+    layer.w_blocks.compress(layer.w, r, c);
+}
+
+/*!
+ * \brief Set the weights of the removed blocks of the given layer to zero,
+ * if its weights are block-sparse
+ */
+template <typename L>
+void mask_blocks(L& layer) {
+    block_sparse_detail::mask_blocks(layer, 0);
+}
+
+} //end of dll namespace
@@ -0,0 +1,253 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused computation of the gradients of Contrastive Divergence.
+ *
+ * The positive and negative statistics of the weights are accumulated in
+ * a single pass, transpose(V1) * H1 - transpose(V2) * H2, instead of two
+ * separate products and a subtraction. The gradients are computed by
+ * tiles of visible units, each tile staying in cache while the samples
+ * of the batch are streamed.
+ *
+ * The statistics of the batch (reconstruction error and mean activation
+ * of the hidden units) are reductions over the same inputs, they are
+ * accumulated by the passes of the gradients when they are fused.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the fused kernel is faster than the products of
+ * the ETL configuration.
+ */
+constexpr bool fused_cd_gradients_enabled() {
+#if defined(ETL_BLAS_MODE) || defined(ETL_MKL_MODE) || defined(ETL_CUBLAS_MODE) || defined(ETL_GPU)
+    return false;
+#else
+    return true;
+#endif
+}
+
+/*!
+ * \brief Accumulate the gradients of the weights and of the visible biases
+ * of the visible units [first, last) over the batch
+ * \return The sum of the squared reconstruction errors of the tile
+ */
+template <typename T>
+DLL_MULTI_VERSION double fused_cd_tile(T* w_grad, T* c_grad, const T* v1, const T* h1, const T* v2, const T* h2, size_t B, size_t V, size_t H, size_t first, size_t last) {
+    double error = 0.0;
+
+    std::fill(w_grad + first * H, w_grad + last * H, T(0));
+    std::fill(c_grad + first, c_grad + last, T(0));
+
+    for (size_t b = 0; b < B; ++b) {
+        const T* h1_row = h1 + b * H;
+        const T* h2_row = h2 + b * H;
+
+        for (size_t i = first; i < last; ++i) {
+            const T pos = v1[b * V + i];
+            const T neg = v2[b * V + i];
+
+            T* grad_row = w_grad + i * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                grad_row[j] += pos * h1_row[j] - neg * h2_row[j];
+            }
+
+            c_grad[i] += pos - neg;
+            error += double(pos - neg) * double(pos - neg);
+        }
+    }
+
+    return error;
+}
+
+/*!
+ * \brief Compute the gradients of CD for a fully-connected RBM.
+ *
+ * \param w_grad The gradients of the weights (V x H)
+ * \param b_grad The gradients of the hidden biases (H)
+ * \param c_grad The gradients of the visible biases (V)
+ * \param v1 The visible units of the positive phase (B x V)
+ * \param h1 The hidden probabilities of the positive phase (B x H)
+ * \param v2 The visible probabilities of the negative phase (B x V)
+ * \param h2 The hidden probabilities of the negative phase (B x H)
+ * \param stats The sums of the squared reconstruction errors and of the
+ * probabilities of the negative phase, or nullptr
+ */
+template <typename T>
+void fused_cd_gradients(T* w_grad, T* b_grad, T* c_grad, const T* v1, const T* h1, const T* v2, const T* h2, size_t B, size_t V, size_t H, double* stats = nullptr) {
+    constexpr size_t tile = 16;
+
+    const size_t tiles = (V + tile - 1) / tile;
+
+    std::vector<double> errors(stats ? tiles : 0, 0.0);
+
+    auto task = [&](size_t t) {
+        const size_t first = t * tile;
+        const size_t last  = std::min(V, first + tile);
+
+        const double error = fused_cd_tile(w_grad, c_grad, v1, h1, v2, h2, B, V, H, first, last);
+
+        if (stats) {
+            errors[t] = error;
+        }
+    };
+
+    if (tiles > 1) {
+        parallel_for_n(tiles, task);
+    } else {
+        task(0);
+    }
+
+    std::fill(b_grad, b_grad + H, T(0));
+
+    double activation = 0.0;
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t j = 0; j < H; ++j) {
+            b_grad[j] += h1[b * H + j] - h2[b * H + j];
+            activation += h2[b * H + j];
+        }
+    }
+
+    if (stats) {
+        // The tiles are summed in order, independently of the threads
+        stats[0] = 0.0;
+
+        for (size_t t = 0; t < tiles; ++t) {
+            stats[0] += errors[t];
+        }
+
+        stats[1] = activation;
+    }
+}
+
+/*!
+ * \brief Subtract a penalty from the blocks [first, last) of the given
+ * gradients
+ */
+template <typename T>
+DLL_MULTI_VERSION void subtract_penalty_blocks(T* grad, const T* penalty, size_t S, bool per_block, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        T* row = grad + i * S;
+
+        if (per_block) {
+            const T value = penalty[i];
+
+            for (size_t j = 0; j < S; ++j) {
+                row[j] -= value;
+            }
+        } else {
+            for (size_t j = 0; j < S; ++j) {
+                row[j] -= penalty[j];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Subtract a penalty from each block of the given gradients, the
+ * blocks being processed in parallel by tiles.
+ *
+ * With a block per visible unit, the penalty of each hidden unit is
+ * subtracted from its column of the weights (local sparsity of a
+ * fully-connected RBM). With a block per filter, the penalty of each
+ * filter is subtracted from all its weights (local sparsity of a
+ * convolutional RBM).
+ *
+ * \param grad The gradients (N blocks of S values)
+ * \param penalty The penalty (S values, or N values when per_block is set)
+ * \param N The number of blocks
+ * \param S The number of values of a block
+ * \param per_block Indicates if the penalty is a scalar per block
+ */
+template <typename T>
+void subtract_penalty(T* grad, const T* penalty, size_t N, size_t S, bool per_block) {
+    constexpr size_t parallel_threshold = 64 * 1024;
+
+    const size_t P = N * S >= parallel_threshold ? std::min(N, concurrency()) : 1;
+
+    auto part = [&](size_t p) {
+        const size_t first = (p * N) / P;
+        const size_t last  = ((p + 1) * N) / P;
+
+        subtract_penalty_blocks(grad, penalty, S, per_block, first, last);
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+}
+
+/*!
+ * \brief Compute the statistics of a CD batch in a single parallel pass.
+ *
+ * \param v1 The visible units of the positive phase (NV values)
+ * \param v2 The visible probabilities of the negative phase (NV values)
+ * \param h2 The hidden probabilities of the negative phase (NH values)
+ * \param stats The sums of the squared reconstruction errors and of the
+ * probabilities of the negative phase
+ */
+template <typename T>
+void cd_statistics(const T* v1, const T* v2, const T* h2, size_t NV, size_t NH, double* stats) {
+    constexpr size_t parallel_threshold = 64 * 1024;
+
+    const size_t N = NV + NH;
+    const size_t P = N >= parallel_threshold ? std::min(N, concurrency()) : 1;
+
+    std::vector<double> parts(2 * P, 0.0);
+
+    // The visible and the hidden values are seen as a single range
+    auto part = [&](size_t p) {
+        double error      = 0.0;
+        double activation = 0.0;
+
+        const size_t first = (p * N) / P;
+        const size_t last  = ((p + 1) * N) / P;
+
+        for (size_t i = first; i < std::min(last, NV); ++i) {
+            const double d = double(v1[i]) - double(v2[i]);
+            error += d * d;
+        }
+
+        for (size_t i = std::max(first, NV); i < last; ++i) {
+            activation += h2[i - NV];
+        }
+
+        parts[2 * p]     = error;
+        parts[2 * p + 1] = activation;
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, part);
+    } else {
+        part(0);
+    }
+
+    stats[0] = 0.0;
+    stats[1] = 0.0;
+
+    for (size_t p = 0; p < P; ++p) {
+        stats[0] += parts[2 * p];
+        stats[1] += parts[2 * p + 1];
+    }
+}
+
+} //end of dll namespace
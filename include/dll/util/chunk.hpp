@@ -0,0 +1,60 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Staging of the chunks of a range of samples into batches
+ */
+
+#pragma once
+
+#include <iterator>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace chunk_detail {
+
+/*!
+ * \brief Create an empty chunk with the dimensions of the given sample
+ */
+template <typename T, typename Input, size_t... I>
+etl::dyn_matrix<T, sizeof...(I) + 1> make_chunk(size_t n, const Input& sample, std::index_sequence<I...> /*seq*/) {
+    return etl::dyn_matrix<T, sizeof...(I) + 1>(n, etl::dim<I>(sample)...);
+}
+
+} //end of namespace chunk_detail
+
+/*!
+ * \brief Stage the c-th chunk of B samples of the given range of n samples
+ * into a batch
+ * \param first Iterator to the first sample of the range
+ * \param c The index of the chunk
+ * \param n The number of samples of the range
+ * \param B The number of samples of a chunk
+ * \return the batch of the samples of the chunk (the last chunk can be smaller)
+ */
+template <typename T, typename Iterator>
+auto stage_chunk(const Iterator& first, size_t c, size_t n, size_t B) {
+    using input_t = std::decay_t<decltype(*first)>;
+
+    const size_t m = std::min(B, n - c * B);
+
+    auto input = chunk_detail::make_chunk<T>(m, *first, std::make_index_sequence<etl::decay_traits<input_t>::dimensions()>());
+
+    auto it = std::next(first, c * B);
+
+    for (size_t i = 0; i < m; ++i, ++it) {
+        input(i) = *it;
+    }
+
+    return input;
+}
+
+} //end of dll namespace
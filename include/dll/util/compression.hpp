@@ -0,0 +1,224 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compression of the gradients exchanged during distributed
+ * training.
+ *
+ * Each rank compresses its gradients, the compressed gradients of all the
+ * ranks are gathered and summed by each rank. The difference between the
+ * gradients and their compressed version is kept in a residual, added to
+ * the next gradients (error feedback), so that no part of the gradients
+ * is lost, only delayed.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "dll/compression_type.hpp"
+#include "dll/util/distributed.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The ratio of the gradients exchanged with top-k compression
+ */
+constexpr double top_k_ratio = 0.01;
+
+namespace compression_detail {
+
+/*!
+ * \brief Append the given value to the message
+ */
+template <typename V>
+void append(std::vector<char>& message, const V& value) {
+    const auto* p = reinterpret_cast<const char*>(&value);
+    message.insert(message.end(), p, p + sizeof(V));
+}
+
+/*!
+ * \brief Read a value of the message at the given position
+ */
+template <typename V>
+V read(const std::vector<char>& message, size_t& position) {
+    V value;
+    std::memcpy(&value, message.data() + position, sizeof(V));
+    position += sizeof(V);
+    return value;
+}
+
+} //end of namespace compression_detail
+
+/*!
+ * \brief Compress the given gradients into the message
+ * \param message The message, replaced
+ * \param g The gradients
+ * \param n The number of gradients
+ */
+template <compression_type C, typename T>
+void compress(std::vector<char>& message, const T* g, size_t n) {
+    using namespace compression_detail;
+
+    message.clear();
+
+    if /*constexpr*/ (C == compression_type::TOP_K) {
+        const size_t k = std::min(n, std::max(size_t(1), size_t(n * top_k_ratio)));
+
+        std::vector<uint32_t> indices(n);
+        for (size_t i = 0; i < n; ++i) {
+            indices[i] = i;
+        }
+
+        std::nth_element(indices.begin(), indices.begin() + (k - 1), indices.end(), [g](uint32_t a, uint32_t b) {
+            return std::abs(g[a]) > std::abs(g[b]);
+        });
+
+        message.reserve(sizeof(uint32_t) + k * (sizeof(uint32_t) + sizeof(T)));
+
+        append(message, uint32_t(k));
+
+        for (size_t i = 0; i < k; ++i) {
+            append(message, indices[i]);
+            append(message, g[indices[i]]);
+        }
+    } else if (C == compression_type::ONE_BIT) {
+        // The scale is the mean magnitude of the gradients
+        T scale = 0;
+        for (size_t i = 0; i < n; ++i) {
+            scale += std::abs(g[i]);
+        }
+        scale = n ? scale / n : T(0);
+
+        append(message, scale);
+
+        const size_t offset = message.size();
+        message.resize(offset + (n + 7) / 8, 0);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (g[i] >= T(0)) {
+                message[offset + i / 8] |= char(1 << (i % 8));
+            }
+        }
+    } else if (C == compression_type::EIGHT_BIT) {
+        T max = 0;
+        for (size_t i = 0; i < n; ++i) {
+            max = std::max(max, std::abs(g[i]));
+        }
+
+        const T scale = max / T(127);
+
+        append(message, scale);
+
+        const size_t offset = message.size();
+        message.resize(offset + n);
+
+        const T inv = scale > T(0) ? T(1) / scale : T(0);
+
+        for (size_t i = 0; i < n; ++i) {
+            message[offset + i] = char(int8_t(std::lround(g[i] * inv)));
+        }
+    } else {
+        message.resize(n * sizeof(T));
+        std::memcpy(message.data(), g, n * sizeof(T));
+    }
+}
+
+/*!
+ * \brief Decompress the given message and add it to the gradients
+ * \param g The gradients
+ * \param message The compressed gradients
+ * \param n The number of gradients
+ */
+template <compression_type C, typename T>
+void decompress_add(T* g, const std::vector<char>& message, size_t n) {
+    using namespace compression_detail;
+
+    size_t position = 0;
+
+    if /*constexpr*/ (C == compression_type::TOP_K) {
+        const auto k = read<uint32_t>(message, position);
+
+        for (size_t i = 0; i < k; ++i) {
+            const auto index = read<uint32_t>(message, position);
+            g[index] += read<T>(message, position);
+        }
+    } else if (C == compression_type::ONE_BIT) {
+        const auto scale = read<T>(message, position);
+
+        for (size_t i = 0; i < n; ++i) {
+            g[i] += (message[position + i / 8] & char(1 << (i % 8))) ? scale : -scale;
+        }
+    } else if (C == compression_type::EIGHT_BIT) {
+        const auto scale = read<T>(message, position);
+
+        for (size_t i = 0; i < n; ++i) {
+            g[i] += scale * T(int8_t(message[position + i]));
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            g[i] += read<T>(message, position);
+        }
+    }
+}
+
+/*!
+ * \brief Compress the given gradients with error feedback.
+ *
+ * The residual is added to the gradients before the compression and is
+ * replaced by the part of the gradients lost by the compression.
+ *
+ * \param message The message, replaced
+ * \param g The gradients
+ * \param residual The residual of the previous compressions
+ * \param n The number of gradients
+ */
+template <compression_type C, typename T>
+void compress_feedback(std::vector<char>& message, const T* g, T* residual, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        residual[i] += g[i];
+    }
+
+    compress<C>(message, residual, n);
+
+    // Remove what has been sent from the residual
+    std::vector<T> sent(n, T(0));
+    decompress_add<C>(sent.data(), message, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        residual[i] -= sent[i];
+    }
+}
+
+/*!
+ * \brief Sum the given gradients over all the ranks, in place, exchanging
+ * them compressed.
+ *
+ * \param g The gradients
+ * \param residual The residual of the previous compressions of these gradients
+ * \param n The number of gradients
+ */
+template <compression_type C, typename T>
+void compressed_all_reduce(T* g, T* residual, size_t n) {
+    std::vector<char> message;
+    compress_feedback<C>(message, g, residual, n);
+
+    auto messages = distributed::comm().all_gather(std::move(message));
+
+    std::fill(g, g + n, T(0));
+
+    for (auto& m : messages) {
+        decompress_add<C>(g, m, n);
+    }
+}
+
+} //end of dll namespace
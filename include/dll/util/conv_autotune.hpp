@@ -0,0 +1,261 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Autotuning of the convolution algorithms.
+ *
+ * The first time a convolution of a given shape is computed with
+ * conv_algorithm::AUTOTUNE, all the candidate algorithms are benchmarked
+ * and the fastest one is used for all the following convolutions of the
+ * same shape.
+ *
+ * The results are kept in a cache, keyed by the CPU model, the operation
+ * and the exact shape, that is persisted to a text file. The file is
+ * given by the DLL_CONV_CACHE environment variable, by default
+ * $HOME/.dll_conv_cache. Setting DLL_CONV_CACHE to an empty string
+ * disables the persistence.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+
+#include "dll/conv_algorithm.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The cache of the autotuned convolution algorithms
+ */
+struct conv_tuning_cache {
+    /*!
+     * \brief Return the unique instance of the cache
+     */
+    static conv_tuning_cache& instance() {
+        static conv_tuning_cache cache;
+        return cache;
+    }
+
+    /*!
+     * \brief Find the algorithm tuned for the given key
+     * \param key The key of the convolution
+     * \param a The algorithm, only set if the key is found
+     * \return true if the key was found, false otherwise
+     */
+    bool find(const std::string& key, conv_algorithm& a) {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto it = entries.find(cpu + " " + key);
+
+        if (it != entries.end()) {
+            a = it->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Store the algorithm tuned for the given key
+     * \param key The key of the convolution
+     * \param a The tuned algorithm
+     */
+    void store(const std::string& key, conv_algorithm a) {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto full_key = cpu + " " + key;
+
+        entries[full_key] = a;
+
+        if (!path.empty()) {
+            std::ofstream os(path, std::ofstream::app);
+
+            if (!os) {
+                std::cerr << "ERROR: Impossible to write the convolution cache (" << path << ")" << std::endl;
+                return;
+            }
+
+            os << full_key << '\t' << to_string(a) << '\n';
+        }
+    }
+
+    /*!
+     * \brief Remove all the entries of the cache (the file is untouched)
+     */
+    void clear() {
+        std::lock_guard<std::mutex> l(lock);
+        entries.clear();
+    }
+
+    /*!
+     * \brief Return the path of the persisted cache, empty if the cache is
+     * not persisted
+     */
+    const std::string& file() const {
+        return path;
+    }
+
+private:
+    conv_tuning_cache() {
+        path = default_path();
+        cpu  = cpu_model();
+
+        if (!path.empty()) {
+            load();
+        }
+    }
+
+    static std::string default_path() {
+        if (auto* env = std::getenv("DLL_CONV_CACHE")) {
+            return env;
+        }
+
+        if (auto* home = std::getenv("HOME")) {
+            return std::string(home) + "/.dll_conv_cache";
+        }
+
+        return ".dll_conv_cache";
+    }
+
+    static std::string cpu_model() {
+        std::ifstream is("/proc/cpuinfo");
+
+        std::string line;
+        while (std::getline(is, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                auto first = line.find(':');
+
+                if (first != std::string::npos) {
+                    auto model = line.substr(line.find_first_not_of(' ', first + 1));
+
+                    // The key is space-separated
+                    for (auto& c : model) {
+                        if (c == ' ' || c == '\t') {
+                            c = '_';
+                        }
+                    }
+
+                    return model;
+                }
+            }
+        }
+
+        return "unknown_cpu";
+    }
+
+    void load() {
+        std::ifstream is(path);
+
+        std::string line;
+        while (std::getline(is, line)) {
+            auto tab = line.rfind('\t');
+
+            if (tab == std::string::npos) {
+                continue;
+            }
+
+            auto name = line.substr(tab + 1);
+
+            // Entries with an unknown algorithm are ignored
+            for (auto a : {conv_algorithm::DIRECT, conv_algorithm::IM2COL, conv_algorithm::WINOGRAD, conv_algorithm::FFT}) {
+                if (name == to_string(a)) {
+                    entries[line.substr(0, tab)] = a;
+                }
+            }
+        }
+    }
+
+    std::mutex lock;                                         ///< The lock protecting the cache
+    std::string path;                                        ///< The path of the persisted cache
+    std::string cpu;                                         ///< The model of the CPU
+    std::unordered_map<std::string, conv_algorithm> entries; ///< The tuned algorithms
+};
+
+/*!
+ * \brief Build the key of a convolution
+ * \param op The name of the operation
+ * \param T The size of the value type
+ * \param B The number of samples
+ * \param C The number of input channels
+ * \param V1 The first dimension of the input
+ * \param V2 The second dimension of the input
+ * \param K The number of kernels
+ * \param W1 The first dimension of the kernels
+ * \param W2 The second dimension of the kernels
+ */
+inline std::string conv_tuning_key(const char* op, size_t T, size_t B, size_t C, size_t V1, size_t V2, size_t K, size_t W1, size_t W2) {
+    return std::string(op) + " " + std::to_string(T) + " " + std::to_string(B) + "x" + std::to_string(C) + "x" + std::to_string(V1) + "x" + std::to_string(V2)
+           + " " + std::to_string(K) + "x" + std::to_string(W1) + "x" + std::to_string(W2);
+}
+
+/*!
+ * \brief Return the fastest algorithm for the given convolution,
+ * benchmarking the candidates if the convolution was never tuned.
+ *
+ * \param key The key of the convolution
+ * \param W1 The first dimension of the kernels
+ * \param W2 The second dimension of the kernels
+ * \param winograd Indicates if Winograd is a candidate for this operation
+ * \param run Functor computing the convolution with the given algorithm
+ *
+ * \return The fastest algorithm
+ */
+template <typename Functor>
+conv_algorithm conv_autotune(const std::string& key, size_t W1, size_t W2, bool winograd, Functor&& run) {
+    auto& cache = conv_tuning_cache::instance();
+
+    conv_algorithm best = conv_algorithm::DIRECT;
+
+    if (cache.find(key, best)) {
+        return best;
+    }
+
+    constexpr size_t repeat = 3;
+
+    double best_time = 0.0;
+
+    for (auto a : {conv_algorithm::DIRECT, conv_algorithm::IM2COL, conv_algorithm::WINOGRAD, conv_algorithm::FFT}) {
+        if (a == conv_algorithm::WINOGRAD && (!winograd || W1 != 3 || W2 != 3)) {
+            continue;
+        }
+
+        // Warmup (allocations and first touch)
+        run(a);
+
+        double time = 0.0;
+
+        for (size_t i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            run(a);
+            auto end = std::chrono::steady_clock::now();
+
+            double t = std::chrono::duration<double>(end - start).count();
+
+            if (i == 0 || t < time) {
+                time = t;
+            }
+        }
+
+        if (a == conv_algorithm::DIRECT || time < best_time) {
+            best      = a;
+            best_time = time;
+        }
+    }
+
+    cache.store(key, best);
+
+    return best;
+}
+
+} //end of dll namespace
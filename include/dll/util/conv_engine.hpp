@@ -0,0 +1,1357 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Selectable algorithms for the batched 4D convolutions of the
+ * layers.
+ *
+ * Three operations are provided, with B samples, C input channels and K
+ * kernels:
+ *  - forward: y[b][k] = sum_c valid_correlation(x[b][c], w[k][c])
+ *    (etl::ml::convolution_forward or etl::conv_4d_valid_flipped)
+ *  - backward: dx[b][c] = sum_k full_convolution(dy[b][k], w[k][c])
+ *    (etl::ml::convolution_backward or etl::conv_4d_full)
+ *  - backward_filter: dw[k][c] = sum_b valid_correlation(x[b][c], dy[b][k])
+ *    (etl::ml::convolution_backward_filter)
+ *
+ * The forward pass of the deconvolutional layers (deconv_engine_forward)
+ * is the backward pass with the flipped kernels.
+ *
+ * The pointwise (1x1) convolutions are always computed with one matrix
+ * multiplication per sample, whatever the algorithm.
+ *
+ * The single-channel convolutions with DIRECT or AUTO, whose kernels are
+ * known at compile time to have one channel (the first layers of most
+ * networks), are computed with kernels specialized on the size of the
+ * kernels and vectorized across the output columns of all the kernels.
+ *
+ * The strided and zero-padded convolutions only compute the strided
+ * outputs, with im2col and matrix multiplications, whatever the
+ * algorithm.
+ *
+ * During training, the layers computing their convolutions with im2col
+ * keep the columns of their input from the forward pass to compute the
+ * gradients of the kernels (conv_engine_forward_lowered).
+ *
+ * The outputs must have direct memory access for all the algorithms but
+ * DIRECT. With AUTOTUNE, the algorithm is selected by benchmarking the
+ * candidates the first time a shape is seen (see conv_autotune.hpp).
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <complex>
+#include <cmath>
+
+#include "etl/etl.hpp"
+
+#include "dll/conv_algorithm.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/direct.hpp"
+#include "dll/util/conv_autotune.hpp"
+
+namespace dll {
+
+namespace conv_detail {
+
+/*!
+ * \brief Unroll the patches of one sample (C x V1 x V2) into columns
+ * ((C x W1 x W2) x (H1 x H2))
+ */
+template <typename T>
+void im2col(T* cols, const T* x, size_t C, size_t V1, size_t V2, size_t W1, size_t W2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t p = 0; p < W1; ++p) {
+            for (size_t q = 0; q < W2; ++q) {
+                T* row = cols + ((c * W1 + p) * W2 + q) * H1 * H2;
+
+                for (size_t i = 0; i < H1; ++i) {
+                    const T* src = x + (c * V1 + i + p) * V2 + q;
+
+                    for (size_t j = 0; j < H2; ++j) {
+                        row[i * H2 + j] = src[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate columns ((C x W1 x W2) x (H1 x H2)) back into one
+ * sample (C x V1 x V2), which must be zeroed before
+ */
+template <typename T>
+void col2im(T* x, const T* cols, size_t C, size_t V1, size_t V2, size_t W1, size_t W2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t p = 0; p < W1; ++p) {
+            for (size_t q = 0; q < W2; ++q) {
+                const T* row = cols + ((c * W1 + p) * W2 + q) * H1 * H2;
+
+                for (size_t i = 0; i < H1; ++i) {
+                    T* dst = x + (c * V1 + i + p) * V2 + q;
+
+                    for (size_t j = 0; j < H2; ++j) {
+                        dst[j] += row[i * H2 + j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Flip the N kernels (W1 x W2) in both dimensions
+ */
+template <typename T>
+void flip_kernels(T* out, const T* w, size_t N, size_t W1, size_t W2) {
+    for (size_t n = 0; n < N; ++n) {
+        for (size_t i = 0; i < W1 * W2; ++i) {
+            out[n * W1 * W2 + i] = w[n * W1 * W2 + W1 * W2 - 1 - i];
+        }
+    }
+}
+
+/*!
+ * \brief Compute U = G g G^T for one 3x3 kernel
+ */
+template <typename T>
+void winograd_filter(T* u, const T* g) {
+    T t[4][3];
+
+    for (size_t j = 0; j < 3; ++j) {
+        t[0][j] = g[j];
+        t[1][j] = T(0.5) * (g[j] + g[3 + j] + g[6 + j]);
+        t[2][j] = T(0.5) * (g[j] - g[3 + j] + g[6 + j]);
+        t[3][j] = g[6 + j];
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        u[i * 4 + 0] = t[i][0];
+        u[i * 4 + 1] = T(0.5) * (t[i][0] + t[i][1] + t[i][2]);
+        u[i * 4 + 2] = T(0.5) * (t[i][0] - t[i][1] + t[i][2]);
+        u[i * 4 + 3] = t[i][2];
+    }
+}
+
+/*!
+ * \brief Compute V = B^T d B for one 4x4 tile
+ */
+template <typename T>
+void winograd_input(T* v, const T (&d)[4][4]) {
+    T t[4][4];
+
+    for (size_t j = 0; j < 4; ++j) {
+        t[0][j] = d[0][j] - d[2][j];
+        t[1][j] = d[1][j] + d[2][j];
+        t[2][j] = d[2][j] - d[1][j];
+        t[3][j] = d[1][j] - d[3][j];
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        v[i * 4 + 0] = t[i][0] - t[i][2];
+        v[i * 4 + 1] = t[i][1] + t[i][2];
+        v[i * 4 + 2] = t[i][2] - t[i][1];
+        v[i * 4 + 3] = t[i][1] - t[i][3];
+    }
+}
+
+/*!
+ * \brief Compute Y = A^T m A for one 2x2 output tile
+ */
+template <typename T>
+void winograd_output(T (&y)[2][2], const T* m) {
+    T t[2][4];
+
+    for (size_t j = 0; j < 4; ++j) {
+        t[0][j] = m[j] + m[4 + j] + m[8 + j];
+        t[1][j] = m[4 + j] - m[8 + j] - m[12 + j];
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        y[i][0] = t[i][0] + t[i][1] + t[i][2];
+        y[i][1] = t[i][1] - t[i][2] - t[i][3];
+    }
+}
+
+/*!
+ * \brief Valid correlation of a batch with 3x3 kernels, with Winograd
+ * F(2x2, 3x3).
+ *
+ * \param y The output (B x K x (V1 - 2) x (V2 - 2))
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (K x C x 3 x 3)
+ */
+template <typename T>
+void winograd_forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2) {
+    const size_t H1 = V1 - 2;
+    const size_t H2 = V2 - 2;
+    const size_t T1 = (H1 + 1) / 2;
+    const size_t T2 = (H2 + 1) / 2;
+
+    std::vector<T> u(K * C * 16);
+
+    for (size_t kc = 0; kc < K * C; ++kc) {
+        winograd_filter(&u[kc * 16], w + kc * 9);
+    }
+
+    parallel_for_n(B, [&](size_t b) {
+        std::vector<T> v(C * 16);
+        T m[16];
+        T d[4][4];
+        T out[2][2];
+
+        for (size_t t1 = 0; t1 < T1; ++t1) {
+            for (size_t t2 = 0; t2 < T2; ++t2) {
+                // Transform the tiles of all the channels (zero outside of the input)
+                for (size_t c = 0; c < C; ++c) {
+                    const T* xc = x + (b * C + c) * V1 * V2;
+
+                    for (size_t i = 0; i < 4; ++i) {
+                        for (size_t j = 0; j < 4; ++j) {
+                            const size_t ii = 2 * t1 + i;
+                            const size_t jj = 2 * t2 + j;
+
+                            d[i][j] = ii < V1 && jj < V2 ? xc[ii * V2 + jj] : T(0);
+                        }
+                    }
+
+                    winograd_input(&v[c * 16], d);
+                }
+
+                for (size_t k = 0; k < K; ++k) {
+                    for (size_t e = 0; e < 16; ++e) {
+                        m[e] = 0;
+                    }
+
+                    for (size_t c = 0; c < C; ++c) {
+                        const T* uk = &u[(k * C + c) * 16];
+                        const T* vc = &v[c * 16];
+
+                        for (size_t e = 0; e < 16; ++e) {
+                            m[e] += uk[e] * vc[e];
+                        }
+                    }
+
+                    winograd_output(out, m);
+
+                    T* yk = y + (b * K + k) * H1 * H2;
+
+                    for (size_t i = 0; i < 2 && 2 * t1 + i < H1; ++i) {
+                        for (size_t j = 0; j < 2 && 2 * t2 + j < H2; ++j) {
+                            yk[(2 * t1 + i) * H2 + 2 * t2 + j] = out[i][j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Full convolution of a batch with 3x3 kernels, with Winograd
+ * F(2x2, 3x3) on the padded errors and the rotated kernels.
+ *
+ * \param dx The output (B x C x (H1 + 2) x (H2 + 2))
+ * \param dy The input (B x K x H1 x H2)
+ * \param w The kernels (K x C x 3 x 3)
+ */
+template <typename T>
+void winograd_backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t K, size_t H1, size_t H2) {
+    const size_t P1 = H1 + 4;
+    const size_t P2 = H2 + 4;
+
+    std::vector<T> padded(B * K * P1 * P2, T(0));
+
+    for (size_t bk = 0; bk < B * K; ++bk) {
+        for (size_t i = 0; i < H1; ++i) {
+            for (size_t j = 0; j < H2; ++j) {
+                padded[(bk * P1 + i + 2) * P2 + j + 2] = dy[(bk * H1 + i) * H2 + j];
+            }
+        }
+    }
+
+    // wr[c][k] = rot180(w[k][c])
+    std::vector<T> wr(C * K * 9);
+
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t e = 0; e < 9; ++e) {
+                wr[(c * K + k) * 9 + e] = w[(k * C + c) * 9 + 8 - e];
+            }
+        }
+    }
+
+    winograd_forward(dx, padded.data(), wr.data(), B, K, C, P1, P2);
+}
+
+/*!
+ * \brief In-place radix-2 FFT of a contiguous sequence
+ * \param a The sequence
+ * \param n The length of the sequence (power of two)
+ * \param inverse Compute the inverse transform (without normalization)
+ */
+template <typename T>
+void fft_1d(std::complex<T>* a, size_t n, bool inverse) {
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const T angle = T(2.0 * M_PI / len) * (inverse ? T(1) : T(-1));
+        const std::complex<T> wlen(std::cos(angle), std::sin(angle));
+
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<T> wn(1);
+
+            for (size_t j = 0; j < len / 2; ++j) {
+                const auto u = a[i + j];
+                const auto v = a[i + j + len / 2] * wn;
+
+                a[i + j]           = u + v;
+                a[i + j + len / 2] = u - v;
+
+                wn *= wlen;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief In-place 2D FFT of a N1 x N2 matrix
+ * \param inverse Compute the inverse transform (normalized)
+ */
+template <typename T>
+void fft_2d(std::complex<T>* a, size_t N1, size_t N2, bool inverse) {
+    for (size_t i = 0; i < N1; ++i) {
+        fft_1d(a + i * N2, N2, inverse);
+    }
+
+    std::vector<std::complex<T>> column(N1);
+
+    for (size_t j = 0; j < N2; ++j) {
+        for (size_t i = 0; i < N1; ++i) {
+            column[i] = a[i * N2 + j];
+        }
+
+        fft_1d(column.data(), N1, inverse);
+
+        for (size_t i = 0; i < N1; ++i) {
+            a[i * N2 + j] = column[i];
+        }
+    }
+
+    if (inverse) {
+        const T scale = T(1) / T(N1 * N2);
+
+        for (size_t i = 0; i < N1 * N2; ++i) {
+            a[i] *= scale;
+        }
+    }
+}
+
+/*!
+ * \brief Compute the 2D FFT of a real S1 x S2 matrix, zero-padded to
+ * N1 x N2
+ */
+template <typename T>
+void fft_2d_real(std::complex<T>* a, const T* x, size_t S1, size_t S2, size_t N1, size_t N2) {
+    std::fill(a, a + N1 * N2, std::complex<T>(0));
+
+    for (size_t i = 0; i < S1; ++i) {
+        for (size_t j = 0; j < S2; ++j) {
+            a[i * N2 + j] = x[i * S2 + j];
+        }
+    }
+
+    fft_2d(a, N1, N2, false);
+}
+
+/*!
+ * \brief Return the smallest power of two greater or equal to n
+ */
+inline size_t next_power_of_two(size_t n) {
+    size_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+/*!
+ * \brief Valid correlation of a batch, in the frequency domain
+ */
+template <typename T>
+void fft_forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2) {
+    using complex = std::complex<T>;
+
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+    const size_t N1 = next_power_of_two(V1);
+    const size_t N2 = next_power_of_two(V2);
+    const size_t N  = N1 * N2;
+
+    std::vector<complex> wf(K * C * N);
+
+    parallel_for_n(K * C, [&](size_t kc) {
+        fft_2d_real(&wf[kc * N], w + kc * W1 * W2, W1, W2, N1, N2);
+    });
+
+    parallel_for_n(B, [&](size_t b) {
+        std::vector<complex> xf(C * N);
+        std::vector<complex> acc(N);
+
+        for (size_t c = 0; c < C; ++c) {
+            fft_2d_real(&xf[c * N], x + (b * C + c) * V1 * V2, V1, V2, N1, N2);
+        }
+
+        for (size_t k = 0; k < K; ++k) {
+            std::fill(acc.begin(), acc.end(), complex(0));
+
+            for (size_t c = 0; c < C; ++c) {
+                const complex* xc = &xf[c * N];
+                const complex* wc = &wf[(k * C + c) * N];
+
+                for (size_t i = 0; i < N; ++i) {
+                    acc[i] += xc[i] * std::conj(wc[i]);
+                }
+            }
+
+            fft_2d(acc.data(), N1, N2, true);
+
+            T* yk = y + (b * K + k) * H1 * H2;
+
+            for (size_t i = 0; i < H1; ++i) {
+                for (size_t j = 0; j < H2; ++j) {
+                    yk[i * H2 + j] = acc[i * N2 + j].real();
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Full convolution of a batch, in the frequency domain
+ */
+template <typename T>
+void fft_backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t K, size_t H1, size_t H2, size_t W1, size_t W2) {
+    using complex = std::complex<T>;
+
+    const size_t V1 = H1 + W1 - 1;
+    const size_t V2 = H2 + W2 - 1;
+    const size_t N1 = next_power_of_two(V1);
+    const size_t N2 = next_power_of_two(V2);
+    const size_t N  = N1 * N2;
+
+    std::vector<complex> wf(K * C * N);
+
+    parallel_for_n(K * C, [&](size_t kc) {
+        fft_2d_real(&wf[kc * N], w + kc * W1 * W2, W1, W2, N1, N2);
+    });
+
+    parallel_for_n(B, [&](size_t b) {
+        std::vector<complex> dyf(K * N);
+        std::vector<complex> acc(N);
+
+        for (size_t k = 0; k < K; ++k) {
+            fft_2d_real(&dyf[k * N], dy + (b * K + k) * H1 * H2, H1, H2, N1, N2);
+        }
+
+        for (size_t c = 0; c < C; ++c) {
+            std::fill(acc.begin(), acc.end(), complex(0));
+
+            for (size_t k = 0; k < K; ++k) {
+                const complex* dk = &dyf[k * N];
+                const complex* wk = &wf[(k * C + c) * N];
+
+                for (size_t i = 0; i < N; ++i) {
+                    acc[i] += dk[i] * wk[i];
+                }
+            }
+
+            fft_2d(acc.data(), N1, N2, true);
+
+            T* dxc = dx + (b * C + c) * V1 * V2;
+
+            for (size_t i = 0; i < V1; ++i) {
+                for (size_t j = 0; j < V2; ++j) {
+                    dxc[i * V2 + j] = acc[i * N2 + j].real();
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Gradients of the kernels, in the frequency domain
+ */
+template <typename T>
+void fft_backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2) {
+    using complex = std::complex<T>;
+
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+    const size_t N1 = next_power_of_two(V1);
+    const size_t N2 = next_power_of_two(V2);
+    const size_t N  = N1 * N2;
+
+    std::vector<complex> xf(B * C * N);
+    std::vector<complex> dyf(B * K * N);
+
+    parallel_for_n(B, [&](size_t b) {
+        for (size_t c = 0; c < C; ++c) {
+            fft_2d_real(&xf[(b * C + c) * N], x + (b * C + c) * V1 * V2, V1, V2, N1, N2);
+        }
+
+        for (size_t k = 0; k < K; ++k) {
+            fft_2d_real(&dyf[(b * K + k) * N], dy + (b * K + k) * H1 * H2, H1, H2, N1, N2);
+        }
+    });
+
+    parallel_for_n(K, [&](size_t k) {
+        std::vector<complex> acc(N);
+
+        for (size_t c = 0; c < C; ++c) {
+            std::fill(acc.begin(), acc.end(), complex(0));
+
+            for (size_t b = 0; b < B; ++b) {
+                const complex* xc = &xf[(b * C + c) * N];
+                const complex* dk = &dyf[(b * K + k) * N];
+
+                for (size_t i = 0; i < N; ++i) {
+                    acc[i] += xc[i] * std::conj(dk[i]);
+                }
+            }
+
+            fft_2d(acc.data(), N1, N2, true);
+
+            T* dwkc = dw + (k * C + c) * W1 * W2;
+
+            for (size_t p = 0; p < W1; ++p) {
+                for (size_t q = 0; q < W2; ++q) {
+                    dwkc[p * W2 + q] = acc[p * N2 + q].real();
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Valid correlation of a batch with im2col and matrix
+ * multiplications
+ */
+template <typename T>
+void im2col_forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    etl::dyn_matrix<T, 2> wm(K, C * W1 * W2);
+    std::copy(w, w + K * C * W1 * W2, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+    etl::dyn_matrix<T, 2> yb(K, H1 * H2);
+
+    for (size_t b = 0; b < B; ++b) {
+        im2col(cols.memory_start(), x + b * C * V1 * V2, C, V1, V2, W1, W2);
+
+        yb = wm * cols;
+
+        std::copy(yb.memory_start(), yb.memory_start() + K * H1 * H2, y + b * K * H1 * H2);
+    }
+}
+
+/*!
+ * \brief Full convolution of a batch with matrix multiplications and
+ * col2im
+ */
+template <typename T>
+void im2col_backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t K, size_t H1, size_t H2, size_t W1, size_t W2) {
+    const size_t V1 = H1 + W1 - 1;
+    const size_t V2 = H2 + W2 - 1;
+
+    etl::dyn_matrix<T, 2> wm(K, C * W1 * W2);
+    std::copy(w, w + K * C * W1 * W2, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> dyb(K, H1 * H2);
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(dy + b * K * H1 * H2, dy + (b + 1) * K * H1 * H2, dyb.memory_start());
+
+        cols = etl::transpose(wm) * dyb;
+
+        T* dxb = dx + b * C * V1 * V2;
+        std::fill(dxb, dxb + C * V1 * V2, T(0));
+
+        col2im(dxb, cols.memory_start(), C, V1, V2, W1, W2);
+    }
+}
+
+/*!
+ * \brief Gradients of the kernels with im2col and matrix multiplications
+ */
+template <typename T>
+void im2col_backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+    etl::dyn_matrix<T, 2> dyb(K, H1 * H2);
+    etl::dyn_matrix<T, 2> acc(K, C * W1 * W2);
+
+    acc = 0;
+
+    for (size_t b = 0; b < B; ++b) {
+        im2col(cols.memory_start(), x + b * C * V1 * V2, C, V1, V2, W1, W2);
+        std::copy(dy + b * K * H1 * H2, dy + (b + 1) * K * H1 * H2, dyb.memory_start());
+
+        acc += dyb * etl::transpose(cols);
+    }
+
+    std::copy(acc.memory_start(), acc.memory_start() + K * C * W1 * W2, dw);
+}
+
+/*!
+ * \brief Unroll the strided patches of one zero-padded sample
+ * (C x V1 x V2) into columns ((C x W1 x W2) x (H1 x H2))
+ */
+template <typename T>
+void im2col_strided(T* cols, const T* x, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t p = 0; p < W1; ++p) {
+            for (size_t q = 0; q < W2; ++q) {
+                T* row = cols + ((c * W1 + p) * W2 + q) * H1 * H2;
+
+                for (size_t i = 0; i < H1; ++i) {
+                    // Unsigned wrap-around makes the padding rows out of range
+                    const size_t ii = i * S1 + p - P1;
+
+                    if (ii >= V1) {
+                        std::fill(row + i * H2, row + (i + 1) * H2, T(0));
+                        continue;
+                    }
+
+                    const T* src = x + (c * V1 + ii) * V2;
+
+                    for (size_t j = 0; j < H2; ++j) {
+                        const size_t jj = j * S2 + q - P2;
+
+                        row[i * H2 + j] = jj < V2 ? src[jj] : T(0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate strided columns ((C x W1 x W2) x (H1 x H2)) back into
+ * one sample (C x V1 x V2), which must be zeroed before. The values of
+ * the padding are dropped.
+ */
+template <typename T>
+void col2im_strided(T* x, const T* cols, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t p = 0; p < W1; ++p) {
+            for (size_t q = 0; q < W2; ++q) {
+                const T* row = cols + ((c * W1 + p) * W2 + q) * H1 * H2;
+
+                for (size_t i = 0; i < H1; ++i) {
+                    const size_t ii = i * S1 + p - P1;
+
+                    if (ii >= V1) {
+                        continue;
+                    }
+
+                    T* dst = x + (c * V1 + ii) * V2;
+
+                    for (size_t j = 0; j < H2; ++j) {
+                        const size_t jj = j * S2 + q - P2;
+
+                        if (jj < V2) {
+                            dst[jj] += row[i * H2 + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Strided valid correlation of a zero-padded batch, only the
+ * strided outputs being computed, with im2col and matrix multiplications
+ */
+template <typename T>
+void strided_forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    etl::dyn_matrix<T, 2> wm(K, C * W1 * W2);
+    std::copy(w, w + K * C * W1 * W2, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+    etl::dyn_matrix<T, 2> yb(K, H1 * H2);
+
+    for (size_t b = 0; b < B; ++b) {
+        im2col_strided(cols.memory_start(), x + b * C * V1 * V2, C, V1, V2, W1, W2, S1, S2, P1, P2);
+
+        yb = wm * cols;
+
+        std::copy(yb.memory_start(), yb.memory_start() + K * H1 * H2, y + b * K * H1 * H2);
+    }
+}
+
+/*!
+ * \brief Errors of the input of a strided convolution, with matrix
+ * multiplications and col2im
+ */
+template <typename T>
+void strided_backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    etl::dyn_matrix<T, 2> wm(K, C * W1 * W2);
+    std::copy(w, w + K * C * W1 * W2, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> dyb(K, H1 * H2);
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(dy + b * K * H1 * H2, dy + (b + 1) * K * H1 * H2, dyb.memory_start());
+
+        cols = etl::transpose(wm) * dyb;
+
+        T* dxb = dx + b * C * V1 * V2;
+        std::fill(dxb, dxb + C * V1 * V2, T(0));
+
+        col2im_strided(dxb, cols.memory_start(), C, V1, V2, W1, W2, S1, S2, P1, P2);
+    }
+}
+
+/*!
+ * \brief Gradients of the kernels of a strided convolution with im2col and
+ * matrix multiplications
+ */
+template <typename T>
+void strided_backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t C, size_t K, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    etl::dyn_matrix<T, 2> cols(C * W1 * W2, H1 * H2);
+    etl::dyn_matrix<T, 2> dyb(K, H1 * H2);
+    etl::dyn_matrix<T, 2> acc(K, C * W1 * W2);
+
+    acc = 0;
+
+    for (size_t b = 0; b < B; ++b) {
+        im2col_strided(cols.memory_start(), x + b * C * V1 * V2, C, V1, V2, W1, W2, S1, S2, P1, P2);
+        std::copy(dy + b * K * H1 * H2, dy + (b + 1) * K * H1 * H2, dyb.memory_start());
+
+        acc += dyb * etl::transpose(cols);
+    }
+
+    std::copy(acc.memory_start(), acc.memory_start() + K * C * W1 * W2, dw);
+}
+
+/*!
+ * \brief Pointwise (1x1) correlation of a batch, one matrix multiplication
+ * per sample: y[b] (K x N) = w (K x C) * x[b] (C x N)
+ */
+template <typename T>
+void pointwise_forward(T* y, const T* x, const T* w, size_t B, size_t C, size_t K, size_t N) {
+    etl::dyn_matrix<T, 2> wm(K, C);
+    std::copy(w, w + K * C, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> xb(C, N);
+    etl::dyn_matrix<T, 2> yb(K, N);
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(x + b * C * N, x + (b + 1) * C * N, xb.memory_start());
+
+        yb = wm * xb;
+
+        std::copy(yb.memory_start(), yb.memory_start() + K * N, y + b * K * N);
+    }
+}
+
+/*!
+ * \brief Errors of the input of a pointwise (1x1) correlation:
+ * dx[b] (C x N) = w^T (C x K) * dy[b] (K x N)
+ */
+template <typename T>
+void pointwise_backward(T* dx, const T* dy, const T* w, size_t B, size_t C, size_t K, size_t N) {
+    etl::dyn_matrix<T, 2> wm(K, C);
+    std::copy(w, w + K * C, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> dyb(K, N);
+    etl::dyn_matrix<T, 2> dxb(C, N);
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(dy + b * K * N, dy + (b + 1) * K * N, dyb.memory_start());
+
+        dxb = etl::transpose(wm) * dyb;
+
+        std::copy(dxb.memory_start(), dxb.memory_start() + C * N, dx + b * C * N);
+    }
+}
+
+/*!
+ * \brief Gradients of the kernels of a pointwise (1x1) correlation:
+ * dw (K x C) = sum_b dy[b] (K x N) * x[b]^T (N x C)
+ */
+template <typename T>
+void pointwise_backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t C, size_t K, size_t N) {
+    etl::dyn_matrix<T, 2> xb(C, N);
+    etl::dyn_matrix<T, 2> dyb(K, N);
+    etl::dyn_matrix<T, 2> acc(K, C);
+
+    acc = 0;
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(x + b * C * N, x + (b + 1) * C * N, xb.memory_start());
+        std::copy(dy + b * K * N, dy + (b + 1) * K * N, dyb.memory_start());
+
+        acc += dyb * etl::transpose(xb);
+    }
+
+    std::copy(acc.memory_start(), acc.memory_start() + K * C, dw);
+}
+
+/*!
+ * \brief Valid correlation of a single-channel batch (B x 1 x V1 x V2)
+ * with K kernels of W1 x W2.
+ *
+ * Each row of the input is multiplied by the weights of all the kernels in
+ * turn, the K output rows staying in cache, and the inner loop over the
+ * columns of the output row being vectorized.
+ */
+template <size_t W1, size_t W2, typename T>
+void single_channel_forward(T* y, const T* x, const T* w, size_t B, size_t K, size_t V1, size_t V2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    parallel_for_n(B, [&](size_t b) {
+        const T* xb = x + b * V1 * V2;
+        T* yb       = y + b * K * H1 * H2;
+
+        std::fill(yb, yb + K * H1 * H2, T(0));
+
+        for (size_t i = 0; i < H1; ++i) {
+            for (size_t p = 0; p < W1; ++p) {
+                for (size_t q = 0; q < W2; ++q) {
+                    const T* xr = xb + (i + p) * V2 + q;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        const T wv = w[(k * W1 + p) * W2 + q];
+                        T* yr      = yb + (k * H1 + i) * H2;
+
+                        for (size_t j = 0; j < H2; ++j) {
+                            yr[j] += wv * xr[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Full convolution of a batch (B x K x H1 x H2) with K kernels of
+ * W1 x W2 into a single channel (B x 1 x V1 x V2)
+ */
+template <size_t W1, size_t W2, typename T>
+void single_channel_backward(T* dx, const T* dy, const T* w, size_t B, size_t K, size_t H1, size_t H2) {
+    const size_t V1 = H1 + W1 - 1;
+    const size_t V2 = H2 + W2 - 1;
+
+    parallel_for_n(B, [&](size_t b) {
+        const T* dyb = dy + b * K * H1 * H2;
+        T* dxb       = dx + b * V1 * V2;
+
+        std::fill(dxb, dxb + V1 * V2, T(0));
+
+        for (size_t i = 0; i < H1; ++i) {
+            for (size_t p = 0; p < W1; ++p) {
+                for (size_t q = 0; q < W2; ++q) {
+                    T* dxr = dxb + (i + p) * V2 + q;
+
+                    for (size_t k = 0; k < K; ++k) {
+                        const T wv   = w[(k * W1 + p) * W2 + q];
+                        const T* dyr = dyb + (k * H1 + i) * H2;
+
+                        for (size_t j = 0; j < H2; ++j) {
+                            dxr[j] += wv * dyr[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Gradients of K kernels of W1 x W2 of a single-channel batch, the
+ * kernels being computed in parallel
+ */
+template <size_t W1, size_t W2, typename T>
+void single_channel_backward_filter(T* dw, const T* x, const T* dy, size_t B, size_t K, size_t V1, size_t V2) {
+    const size_t H1 = V1 - W1 + 1;
+    const size_t H2 = V2 - W2 + 1;
+
+    parallel_for_n(K, [&](size_t k) {
+        T acc[W1 * W2] = {};
+
+        for (size_t b = 0; b < B; ++b) {
+            const T* xb  = x + b * V1 * V2;
+            const T* dyk = dy + (b * K + k) * H1 * H2;
+
+            for (size_t i = 0; i < H1; ++i) {
+                const T* dyr = dyk + i * H2;
+
+                for (size_t p = 0; p < W1; ++p) {
+                    for (size_t q = 0; q < W2; ++q) {
+                        const T* xr = xb + (i + p) * V2 + q;
+
+                        T sum(0);
+
+                        for (size_t j = 0; j < H2; ++j) {
+                            sum += dyr[j] * xr[j];
+                        }
+
+                        acc[p * W2 + q] += sum;
+                    }
+                }
+            }
+        }
+
+        std::copy(acc, acc + W1 * W2, dw + k * W1 * W2);
+    });
+}
+
+/*!
+ * \brief Unroll the (strided and zero-padded) patches of a batch into the
+ * columns of the given workspace (B x (C x W1 x W2) x (H1 x H2))
+ */
+template <typename T>
+void lower_batch(T* cols, const T* x, size_t B, size_t C, size_t V1, size_t V2, size_t W1, size_t W2, size_t S1, size_t S2, size_t P1, size_t P2) {
+    const size_t H1 = (V1 + 2 * P1 - W1) / S1 + 1;
+    const size_t H2 = (V2 + 2 * P2 - W2) / S2 + 1;
+
+    const size_t n = C * W1 * W2 * H1 * H2;
+
+    for (size_t b = 0; b < B; ++b) {
+        if (S1 == 1 && S2 == 1 && !P1 && !P2) {
+            im2col(cols + b * n, x + b * C * V1 * V2, C, V1, V2, W1, W2);
+        } else {
+            im2col_strided(cols + b * n, x + b * C * V1 * V2, C, V1, V2, W1, W2, S1, S2, P1, P2);
+        }
+    }
+}
+
+/*!
+ * \brief Valid correlation of a batch whose columns are already lowered
+ * in the given workspace (B x (C x W1 x W2) x N)
+ */
+template <typename T, typename Cols>
+void lowered_forward(T* y, const Cols& cols, const T* w, size_t B, size_t K, size_t N) {
+    const size_t CW = etl::dim<1>(cols);
+
+    etl::dyn_matrix<T, 2> wm(K, CW);
+    std::copy(w, w + K * CW, wm.memory_start());
+
+    etl::dyn_matrix<T, 2> yb(K, N);
+
+    for (size_t b = 0; b < B; ++b) {
+        yb = wm * cols(b);
+
+        std::copy(yb.memory_start(), yb.memory_start() + K * N, y + b * K * N);
+    }
+}
+
+/*!
+ * \brief Gradients of the kernels from the columns already lowered in the
+ * given workspace (B x (C x W1 x W2) x N)
+ */
+template <typename T, typename Cols>
+void lowered_backward_filter(T* dw, const Cols& cols, const T* dy, size_t B, size_t K, size_t N) {
+    const size_t CW = etl::dim<1>(cols);
+
+    etl::dyn_matrix<T, 2> dyb(K, N);
+    etl::dyn_matrix<T, 2> acc(K, CW);
+
+    acc = 0;
+
+    for (size_t b = 0; b < B; ++b) {
+        std::copy(dy + b * K * N, dy + (b + 1) * K * N, dyb.memory_start());
+
+        acc += dyb * etl::transpose(cols(b));
+    }
+
+    std::copy(acc.memory_start(), acc.memory_start() + K * CW, dw);
+}
+
+} //end of namespace conv_detail
+
+/*!
+ * \brief Traits indicating if the kernels of type W are known at compile
+ * time to have a single channel and to be larger than 1x1.
+ *
+ * The convolutions with such kernels computed with DIRECT or AUTO use the
+ * single-channel kernels, specialized on the size of the kernels.
+ */
+template <typename W, typename Enable = void>
+struct single_channel_kernels {
+    static constexpr bool value = false; ///< Indicates if the kernels have a single channel
+    static constexpr size_t W1  = 1;     ///< The first dimension of the kernels
+    static constexpr size_t W2  = 1;     ///< The second dimension of the kernels
+};
+
+/*!
+ * \copydoc single_channel_kernels
+ */
+template <typename W>
+struct single_channel_kernels<W, std::enable_if_t<etl::decay_traits<W>::is_fast && etl::decay_traits<W>::dimensions() == 4>> {
+    static constexpr size_t W1  = etl::decay_traits<W>::template dim<2>();                        ///< The first dimension of the kernels
+    static constexpr size_t W2  = etl::decay_traits<W>::template dim<3>();                        ///< The second dimension of the kernels
+    static constexpr bool value = etl::decay_traits<W>::template dim<1>() == 1 && W1 * W2 > 1; ///< Indicates if the kernels have a single channel
+};
+
+/*!
+ * \brief Indicates if the convolution with the algorithm \p a and the
+ * kernels of type W is computed with the single-channel kernels
+ */
+template <typename W>
+constexpr bool single_channel_conv(conv_algorithm a) {
+    return single_channel_kernels<W>::value && (a == conv_algorithm::DIRECT || a == conv_algorithm::AUTO);
+}
+
+/*!
+ * \brief Compute y[b][k] = sum_c valid_correlation(x[b][c], w[k][c])
+ * \param a The algorithm to use
+ * \param y The output (B x K x H1 x H2)
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param s1 The stride of the first dimension
+ * \param s2 The stride of the second dimension
+ * \param p1 The zero-padding of the first dimension
+ * \param p2 The zero-padding of the second dimension
+ */
+template <typename Y, typename X, typename W>
+void conv_engine_forward(conv_algorithm a, Y&& y, const X& x, const W& w, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+    const size_t B  = etl::dim<0>(x);
+    const size_t C  = etl::dim<1>(x);
+    const size_t V1 = etl::dim<2>(x);
+    const size_t V2 = etl::dim<3>(x);
+    const size_t K  = etl::dim<0>(w);
+    const size_t W1 = etl::dim<2>(w);
+    const size_t W2 = etl::dim<3>(w);
+
+    if (s1 != 1 || s2 != 1 || p1 || p2) {
+        decltype(auto) xd = direct_memory(x);
+        decltype(auto) wd = direct_memory(w);
+
+        conv_detail::strided_forward(y.memory_start(), xd.memory_start(), wd.memory_start(), B, C, K, V1, V2, W1, W2, s1, s2, p1, p2);
+        return;
+    }
+
+    if (W1 == 1 && W2 == 1) {
+        decltype(auto) xd = direct_memory(x);
+        decltype(auto) wd = direct_memory(w);
+
+        conv_detail::pointwise_forward(y.memory_start(), xd.memory_start(), wd.memory_start(), B, C, K, V1 * V2);
+        return;
+    }
+
+    if (single_channel_conv<W>(a)) {
+        decltype(auto) xd = direct_memory(x);
+        decltype(auto) wd = direct_memory(w);
+
+        using sc = single_channel_kernels<W>;
+
+        conv_detail::single_channel_forward<sc::W1, sc::W2>(y.memory_start(), xd.memory_start(), wd.memory_start(), B, K, V1, V2);
+        return;
+    }
+
+    if (a == conv_algorithm::AUTOTUNE) {
+        auto key = conv_tuning_key("forward", sizeof(etl::value_t<X>), B, C, V1, V2, K, W1, W2);
+        a        = conv_autotune(key, W1, W2, true, [&](conv_algorithm c) { conv_engine_forward(c, y, x, w); });
+    }
+
+    a = resolve_conv_algorithm(a, W1, W2);
+
+    if (a == conv_algorithm::DIRECT) {
+        y = etl::ml::convolution_forward(x, w);
+        return;
+    }
+
+    decltype(auto) xd = direct_memory(x);
+    decltype(auto) wd = direct_memory(w);
+
+    if (a == conv_algorithm::WINOGRAD) {
+        conv_detail::winograd_forward(y.memory_start(), xd.memory_start(), wd.memory_start(), B, C, K, V1, V2);
+    } else if (a == conv_algorithm::FFT) {
+        conv_detail::fft_forward(y.memory_start(), xd.memory_start(), wd.memory_start(), B, C, K, V1, V2, W1, W2);
+    } else {
+        conv_detail::im2col_forward(y.memory_start(), xd.memory_start(), wd.memory_start(), B, C, K, V1, V2, W1, W2);
+    }
+}
+
+/*!
+ * \brief Compute dx[b][c] = sum_k full_convolution(dy[b][k], w[k][c])
+ * \param a The algorithm to use
+ * \param dx The output (B x C x V1 x V2)
+ * \param dy The input (B x K x H1 x H2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param s1 The stride of the first dimension
+ * \param s2 The stride of the second dimension
+ * \param p1 The zero-padding of the first dimension
+ * \param p2 The zero-padding of the second dimension
+ */
+template <typename DX, typename DY, typename W>
+void conv_engine_backward(conv_algorithm a, DX&& dx, const DY& dy, const W& w, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+    const size_t B  = etl::dim<0>(dy);
+    const size_t K  = etl::dim<1>(dy);
+    const size_t H1 = etl::dim<2>(dy);
+    const size_t H2 = etl::dim<3>(dy);
+    const size_t C  = etl::dim<1>(w);
+    const size_t W1 = etl::dim<2>(w);
+    const size_t W2 = etl::dim<3>(w);
+
+    if (s1 != 1 || s2 != 1 || p1 || p2) {
+        decltype(auto) dyd = direct_memory(dy);
+        decltype(auto) wd  = direct_memory(w);
+
+        conv_detail::strided_backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, C, K, etl::dim<2>(dx), etl::dim<3>(dx), W1, W2, s1, s2, p1, p2);
+        return;
+    }
+
+    if (W1 == 1 && W2 == 1) {
+        decltype(auto) dyd = direct_memory(dy);
+        decltype(auto) wd  = direct_memory(w);
+
+        conv_detail::pointwise_backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, C, K, H1 * H2);
+        return;
+    }
+
+    if (single_channel_conv<W>(a)) {
+        decltype(auto) dyd = direct_memory(dy);
+        decltype(auto) wd  = direct_memory(w);
+
+        using sc = single_channel_kernels<W>;
+
+        conv_detail::single_channel_backward<sc::W1, sc::W2>(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, K, H1, H2);
+        return;
+    }
+
+    if (a == conv_algorithm::AUTOTUNE) {
+        auto key = conv_tuning_key("backward", sizeof(etl::value_t<DY>), B, C, H1 + W1 - 1, H2 + W2 - 1, K, W1, W2);
+        a        = conv_autotune(key, W1, W2, true, [&](conv_algorithm c) { conv_engine_backward(c, dx, dy, w); });
+    }
+
+    a = resolve_conv_algorithm(a, W1, W2);
+
+    if (a == conv_algorithm::DIRECT) {
+        dx = etl::ml::convolution_backward(dy, w);
+        return;
+    }
+
+    decltype(auto) dyd = direct_memory(dy);
+    decltype(auto) wd  = direct_memory(w);
+
+    if (a == conv_algorithm::WINOGRAD) {
+        conv_detail::winograd_backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, C, K, H1, H2);
+    } else if (a == conv_algorithm::FFT) {
+        conv_detail::fft_backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, C, K, H1, H2, W1, W2);
+    } else {
+        conv_detail::im2col_backward(dx.memory_start(), dyd.memory_start(), wd.memory_start(), B, C, K, H1, H2, W1, W2);
+    }
+}
+
+/*!
+ * \brief Compute dw[k][c] = sum_b valid_correlation(x[b][c], dy[b][k])
+ *
+ * Winograd is not used for the gradients of the kernels, im2col is used
+ * instead.
+ *
+ * \param a The algorithm to use
+ * \param dw The output (K x C x W1 x W2)
+ * \param x The input (B x C x V1 x V2)
+ * \param dy The errors (B x K x H1 x H2)
+ * \param s1 The stride of the first dimension
+ * \param s2 The stride of the second dimension
+ * \param p1 The zero-padding of the first dimension
+ * \param p2 The zero-padding of the second dimension
+ */
+template <typename DW, typename X, typename DY>
+void conv_engine_backward_filter(conv_algorithm a, DW&& dw, const X& x, const DY& dy, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+    const size_t B  = etl::dim<0>(x);
+    const size_t C  = etl::dim<1>(x);
+    const size_t V1 = etl::dim<2>(x);
+    const size_t V2 = etl::dim<3>(x);
+    const size_t K  = etl::dim<1>(dy);
+
+    if (s1 != 1 || s2 != 1 || p1 || p2) {
+        decltype(auto) xd  = direct_memory(x);
+        decltype(auto) dyd = direct_memory(dy);
+
+        conv_detail::strided_backward_filter(dw.memory_start(), xd.memory_start(), dyd.memory_start(), B, C, K, V1, V2, etl::dim<2>(dw), etl::dim<3>(dw), s1, s2, p1, p2);
+        return;
+    }
+
+    const size_t W1 = V1 - etl::dim<2>(dy) + 1;
+    const size_t W2 = V2 - etl::dim<3>(dy) + 1;
+
+    if (W1 == 1 && W2 == 1) {
+        decltype(auto) xd  = direct_memory(x);
+        decltype(auto) dyd = direct_memory(dy);
+
+        conv_detail::pointwise_backward_filter(dw.memory_start(), xd.memory_start(), dyd.memory_start(), B, C, K, V1 * V2);
+        return;
+    }
+
+    if (single_channel_conv<std::decay_t<DW>>(a)) {
+        decltype(auto) xd  = direct_memory(x);
+        decltype(auto) dyd = direct_memory(dy);
+
+        using sc = single_channel_kernels<std::decay_t<DW>>;
+
+        conv_detail::single_channel_backward_filter<sc::W1, sc::W2>(dw.memory_start(), xd.memory_start(), dyd.memory_start(), B, K, V1, V2);
+        return;
+    }
+
+    if (a == conv_algorithm::AUTOTUNE) {
+        auto key = conv_tuning_key("backward_filter", sizeof(etl::value_t<X>), B, C, V1, V2, K, W1, W2);
+        a        = conv_autotune(key, W1, W2, false, [&](conv_algorithm c) { conv_engine_backward_filter(c, dw, x, dy); });
+    }
+
+    a = resolve_conv_algorithm(a, W1, W2);
+
+    if (a == conv_algorithm::DIRECT) {
+        dw = etl::ml::convolution_backward_filter(x, dy);
+        return;
+    }
+
+    decltype(auto) xd  = direct_memory(x);
+    decltype(auto) dyd = direct_memory(dy);
+
+    if (a == conv_algorithm::FFT) {
+        conv_detail::fft_backward_filter(dw.memory_start(), xd.memory_start(), dyd.memory_start(), B, C, K, V1, V2, W1, W2);
+    } else {
+        conv_detail::im2col_backward_filter(dw.memory_start(), xd.memory_start(), dyd.memory_start(), B, C, K, V1, V2, W1, W2);
+    }
+}
+
+/*!
+ * \brief Indicates if the convolution with the given algorithm, kernels,
+ * stride and padding is computed with im2col, i.e. if its input can be
+ * lowered once for the forward pass and the gradients of the kernels.
+ */
+constexpr bool conv_engine_lowered(conv_algorithm a, size_t w1, size_t w2, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+    if (s1 != 1 || s2 != 1 || p1 || p2) {
+        return true;
+    }
+
+    return a == conv_algorithm::IM2COL && !(w1 == 1 && w2 == 1);
+}
+
+/*!
+ * \brief Compute the forward convolution like conv_engine_forward with
+ * im2col, the columns of the input being kept in the given workspace to
+ * be reused by conv_engine_backward_filter_lowered.
+ *
+ * \param y The output (B x K x H1 x H2)
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (K x C x W1 x W2)
+ * \param cols The workspace (B x (C x W1 x W2) x (H1 x H2))
+ */
+template <typename Y, typename X, typename W, typename Cols>
+void conv_engine_forward_lowered(Y&& y, const X& x, const W& w, Cols& cols, size_t s1 = 1, size_t s2 = 1, size_t p1 = 0, size_t p2 = 0) {
+    const size_t B  = etl::dim<0>(x);
+    const size_t K  = etl::dim<0>(w);
+
+    decltype(auto) xd = direct_memory(x);
+    decltype(auto) wd = direct_memory(w);
+
+    conv_detail::lower_batch(cols.memory_start(), xd.memory_start(), B, etl::dim<1>(x), etl::dim<2>(x), etl::dim<3>(x), etl::dim<2>(w), etl::dim<3>(w), s1, s2, p1, p2);
+    conv_detail::lowered_forward(y.memory_start(), cols, wd.memory_start(), B, K, etl::dim<2>(cols));
+}
+
+/*!
+ * \brief Compute the gradients of the kernels like
+ * conv_engine_backward_filter, from the columns of the input lowered by
+ * conv_engine_forward_lowered.
+ *
+ * \param dw The output (K x C x W1 x W2)
+ * \param cols The workspace (B x (C x W1 x W2) x (H1 x H2))
+ * \param dy The errors (B x K x H1 x H2)
+ */
+template <typename DW, typename Cols, typename DY>
+void conv_engine_backward_filter_lowered(DW&& dw, const Cols& cols, const DY& dy) {
+    decltype(auto) dyd = direct_memory(dy);
+
+    conv_detail::lowered_backward_filter(dw.memory_start(), cols, dyd.memory_start(), etl::dim<0>(dy), etl::dim<1>(dy), etl::dim<2>(cols));
+}
+
+/*!
+ * \brief Compute y[b][k] = sum_c full_correlation(x[b][c], w[c][k]), the
+ * forward pass of the deconvolutional layers.
+ *
+ * This is the backward pass of a convolution with the flipped kernels:
+ * except with DIRECT, the kernels are flipped and the product is computed
+ * by the backward algorithms (col2im with matrix multiplications, FFT or
+ * Winograd), without the zero-padded input of the full convolution.
+ *
+ * \param a The algorithm to use
+ * \param y The output (B x K x V1 + W1 - 1 x V2 + W2 - 1)
+ * \param x The input (B x C x V1 x V2)
+ * \param w The kernels (C x K x W1 x W2)
+ */
+template <typename Y, typename X, typename W>
+void deconv_engine_forward(conv_algorithm a, Y&& y, const X& x, const W& w) {
+    if (a == conv_algorithm::DIRECT) {
+        y = etl::conv_4d_full_flipped(x, w);
+        return;
+    }
+
+    decltype(auto) wd = direct_memory(w);
+
+    etl::dyn_matrix<etl::value_t<W>, 4> wf(etl::dim<0>(w), etl::dim<1>(w), etl::dim<2>(w), etl::dim<3>(w));
+
+    conv_detail::flip_kernels(wf.memory_start(), wd.memory_start(), etl::dim<0>(w) * etl::dim<1>(w), etl::dim<2>(w), etl::dim<3>(w));
+
+    conv_engine_backward(a, y, x, wf);
+}
+
+} //end of dll namespace
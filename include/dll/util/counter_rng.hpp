@@ -0,0 +1,428 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Counter-based random number generation (Philox4x32-10).
+ *
+ * The random numbers of a stream are a pure function of the key (the
+ * seed), the stream and the index of the number. They can be generated
+ * in any order and in parallel, and the results do not depend on the
+ * number of threads.
+ *
+ * Each call of next_rng() returns a new stream, the streams being
+ * numbered from the last call of set_seed(). As long as the layers draw
+ * their numbers in the same order, two runs with the same seed are
+ * identical.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+#include "dll/util/random.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/direct.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A stream of counter-based random numbers
+ */
+struct counter_rng {
+    static constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of values to generate in parallel
+    static constexpr size_t parallel_block     = 4096;      ///< The number of values per parallel task
+
+    /*!
+     * \brief Create the stream of the given key
+     * \param seed The seed (key) of the generator
+     * \param stream The index of the stream
+     */
+    counter_rng(uint64_t seed, uint64_t stream) : seed(seed), stream(stream) {}
+
+    /*!
+     * \brief Return the block of four random numbers at the given index
+     */
+    std::array<uint32_t, 4> block(uint64_t index) const {
+        uint32_t c0 = uint32_t(index);
+        uint32_t c1 = uint32_t(index >> 32);
+        uint32_t c2 = uint32_t(stream);
+        uint32_t c3 = uint32_t(stream >> 32);
+
+        uint32_t k0 = uint32_t(seed);
+        uint32_t k1 = uint32_t(seed >> 32);
+
+        for (size_t r = 0; r < 10; ++r) {
+            const uint64_t p0 = uint64_t(0xD2511F53) * c0;
+            const uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+
+            const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            const uint32_t n1 = uint32_t(p1);
+            const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+            const uint32_t n3 = uint32_t(p0);
+
+            c0 = n0;
+            c1 = n1;
+            c2 = n2;
+            c3 = n3;
+
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+
+        return {{c0, c1, c2, c3}};
+    }
+
+    /*!
+     * \brief Convert a random integer to a uniform number in [0, 1)
+     */
+    template <typename T>
+    static T to_uniform(uint32_t x) {
+        return T(x >> 8) * T(1.0 / 16777216.0);
+    }
+
+    /*!
+     * \brief Call the functor with (i, u) for each index i in [0, n), u
+     * being the i-th uniform number of the stream in [0, 1).
+     *
+     * Large ranges are generated in parallel.
+     */
+    template <typename T, typename Functor>
+    void for_each_uniform(size_t n, Functor&& functor) const {
+        auto task = [&](size_t t) {
+            const size_t first = t * parallel_block;
+            const size_t last  = std::min(n, first + parallel_block);
+
+            for (size_t i = first; i < last; i += 4) {
+                auto r = block(i / 4);
+
+                for (size_t j = 0; j < 4 && i + j < last; ++j) {
+                    functor(i + j, to_uniform<T>(r[j]));
+                }
+            }
+        };
+
+        const size_t tasks = (n + parallel_block - 1) / parallel_block;
+
+        if (n >= parallel_threshold && tasks > 1) {
+            parallel_for_n(tasks, task);
+        } else {
+            for (size_t t = 0; t < tasks; ++t) {
+                task(t);
+            }
+        }
+    }
+
+    /*!
+     * \brief Call the functor with (i, z) for each index i in [0, n), z
+     * being the i-th standard normal number of the stream.
+     *
+     * Each block of four random numbers gives four normal numbers with the
+     * Box-Muller transform, without branches. Large ranges are generated
+     * in parallel.
+     */
+    template <typename T, typename Functor>
+    void for_each_normal(size_t n, Functor&& functor) const {
+        auto task = [&](size_t t) {
+            const size_t first = t * parallel_block;
+            const size_t last  = std::min(n, first + parallel_block);
+
+            for (size_t i = first; i < last; i += 4) {
+                auto r = block(i / 4);
+
+                T z[4];
+
+                for (size_t j = 0; j < 4; j += 2) {
+                    // u1 in (0, 1] for the logarithm
+                    const T u1 = to_uniform<T>(r[j]) + T(1.0 / 16777216.0);
+                    const T u2 = to_uniform<T>(r[j + 1]);
+
+                    const T radius = std::sqrt(T(-2) * std::log(u1));
+                    const T theta  = T(6.283185307179586) * u2;
+
+                    z[j]     = radius * std::cos(theta);
+                    z[j + 1] = radius * std::sin(theta);
+                }
+
+                for (size_t j = 0; j < 4 && i + j < last; ++j) {
+                    functor(i + j, z[j]);
+                }
+            }
+        };
+
+        const size_t tasks = (n + parallel_block - 1) / parallel_block;
+
+        if (n >= parallel_threshold && tasks > 1) {
+            parallel_for_n(tasks, task);
+        } else {
+            for (size_t t = 0; t < tasks; ++t) {
+                task(t);
+            }
+        }
+    }
+
+    /*!
+     * \brief Fill the given range with uniform numbers in [0, 1)
+     */
+    template <typename T>
+    void uniform(T* out, size_t n) const {
+        for_each_uniform<T>(n, [out](size_t i, T u) { out[i] = u; });
+    }
+
+    /*!
+     * \brief Fill the given range with normal numbers (Box-Muller)
+     */
+    template <typename T>
+    void normal(T* out, size_t n, T mean, T stddev) const {
+        for (size_t i = 0; i < n; i += 2) {
+            auto r = block(i / 2);
+
+            // u1 in (0, 1] for the logarithm
+            const T u1 = to_uniform<T>(r[0]) + T(1.0 / 16777216.0);
+            const T u2 = to_uniform<T>(r[1]);
+
+            const T radius = std::sqrt(T(-2) * std::log(u1));
+            const T theta  = T(6.283185307179586) * u2;
+
+            out[i] = mean + stddev * radius * std::cos(theta);
+
+            if (i + 1 < n) {
+                out[i + 1] = mean + stddev * radius * std::sin(theta);
+            }
+        }
+    }
+
+private:
+    const uint64_t seed;   ///< The key of the generator
+    const uint64_t stream; ///< The index of the stream
+};
+
+/*!
+ * \brief Return the next random stream of DLL
+ */
+inline counter_rng next_rng() {
+    return {seed(), detail::draw_counter()++};
+}
+
+/*!
+ * \brief Fill the given matrix with normal numbers, with counter-based
+ * random numbers, in parallel for large matrices
+ *
+ * \param output The matrix to fill, with direct memory access
+ * \param mean The mean of the distribution
+ * \param stddev The standard deviation of the distribution
+ */
+template <typename O>
+void fill_normal(O&& output, double mean, double stddev) {
+    using T = etl::value_t<O>;
+
+    T* out = output.memory_start();
+
+    const T m = mean;
+    const T s = stddev;
+
+    next_rng().for_each_normal<T>(etl::size(output), [out, m, s](size_t i, T z) {
+        out[i] = m + s * z;
+    });
+
+    dll::host_written(output);
+}
+
+/*!
+ * \brief Fill the given matrix with uniform numbers in [a, b), with
+ * counter-based random numbers, in parallel for large matrices
+ *
+ * \param output The matrix to fill, with direct memory access
+ * \param a The lower bound of the distribution
+ * \param b The upper bound of the distribution
+ */
+template <typename O>
+void fill_uniform(O&& output, double a, double b) {
+    using T = etl::value_t<O>;
+
+    T* out = output.memory_start();
+
+    const T lo    = a;
+    const T range = b - a;
+
+    next_rng().for_each_uniform<T>(etl::size(output), [out, lo, range](size_t i, T u) {
+        out[i] = lo + range * u;
+    });
+
+    dll::host_written(output);
+}
+
+/*!
+ * \brief Sample each output from a Bernoulli distribution with the
+ * given probabilities, with counter-based random numbers
+ *
+ * \param output The output
+ * \param p The probabilities (same size as the output)
+ */
+template <typename O, typename P>
+void sample_bernoulli(O&& output, const P& p) {
+    using T = etl::value_t<P>;
+
+    decltype(auto) pd = direct_memory(p);
+    const T* probs    = pd.memory_start();
+
+    next_rng().for_each_uniform<T>(etl::size(output), [&](size_t i, T u) {
+        output[i] = u < probs[i] ? T(1) : T(0);
+    });
+}
+
+/*!
+ * \brief Sample each output from a normal distribution of unit variance
+ * centered on the given means, with counter-based random numbers
+ *
+ * \param output The output
+ * \param mean The means (same size as the output)
+ */
+template <typename O, typename M>
+void sample_normal(O&& output, const M& mean) {
+    using T = etl::value_t<M>;
+
+    decltype(auto) md = direct_memory(mean);
+    const T* x        = md.memory_start();
+
+    next_rng().for_each_normal<T>(etl::size(output), [&](size_t i, T z) {
+        output[i] = x[i] + z;
+    });
+}
+
+/*!
+ * \brief Sample each output of noisy rectified linear units from the given
+ * pre-activations: max(x + N(0, sigmoid(x)), 0), with counter-based random
+ * numbers
+ *
+ * \param output The output
+ * \param input The pre-activations (same size as the output)
+ * \param rectify Indicates if the samples are rectified
+ */
+template <typename O, typename I>
+void sample_noisy_relu(O&& output, const I& input, bool rectify = true) {
+    using T = etl::value_t<I>;
+
+    decltype(auto) id = direct_memory(input);
+    const T* x        = id.memory_start();
+
+    next_rng().for_each_normal<T>(etl::size(output), [&](size_t i, T z) {
+        const T y = x[i] + z / (T(1) + std::exp(-x[i]));
+
+        output[i] = rectify ? std::max(y, T(0)) : y;
+    });
+}
+
+/*!
+ * \brief Sample each output of capped rectified linear units from the
+ * given pre-activations: the values strictly inside (0, max) get a noise
+ * of unit variance, the samples are clipped to [0, max], with
+ * counter-based random numbers
+ *
+ * \param output The output
+ * \param input The pre-activations (same size as the output)
+ * \param max The maximum value of the units
+ */
+template <typename O, typename I>
+void sample_capped_relu(O&& output, const I& input, etl::value_t<I> max) {
+    using T = etl::value_t<I>;
+
+    decltype(auto) id = direct_memory(input);
+    const T* x        = id.memory_start();
+
+    next_rng().for_each_normal<T>(etl::size(output), [&](size_t i, T z) {
+        const T y = x[i] == T(0) || x[i] == max ? x[i] : x[i] + z;
+
+        output[i] = std::min(std::max(y, T(0)), max);
+    });
+}
+
+/*!
+ * \brief Compute the softmax of each row of the pre-activations and sample
+ * a one-hot categorical from it, with counter-based random numbers.
+ *
+ * Each row is processed by a single kernel: the maximum is subtracted
+ * before the exponentials, the exponentials are normalized and the sample
+ * is drawn by inverting the cumulative distribution with one uniform
+ * number per row, while the row is still in cache. The rows are processed
+ * in parallel for large batches, the samples do not depend on the number
+ * of threads.
+ *
+ * \param x The rows of pre-activations, replaced by the probabilities if P (or used as scratch)
+ * \param samples The rows of one-hot samples (if S), can be x if not P
+ * \param rows The number of rows
+ * \param n The number of units of a row
+ *
+ * \tparam P Indicates if the probabilities are kept in x
+ * \tparam S Indicates if the rows are sampled
+ */
+template <bool P, bool S, typename T>
+void softmax_sample_rows(T* x, T* samples, size_t rows, size_t n) {
+    static_assert(P || S, "softmax_sample_rows must compute the probabilities or the samples");
+
+    const auto rng = next_rng();
+
+    auto row = [&rng, x, samples, n](size_t i) {
+        T* r = x + i * n;
+
+        T m = r[0];
+
+        for (size_t j = 1; j < n; ++j) {
+            m = std::max(m, r[j]);
+        }
+
+        T sum = T(0);
+
+        for (size_t j = 0; j < n; ++j) {
+            r[j] = std::exp(r[j] - m);
+            sum += r[j];
+        }
+
+        if (P) {
+            const T inv = T(1) / sum;
+
+            for (size_t j = 0; j < n; ++j) {
+                r[j] *= inv;
+            }
+        }
+
+        if (S) {
+            // The unnormalized exponentials are sampled with a scaled uniform
+            const T u = counter_rng::to_uniform<T>(rng.block(i / 4)[i % 4]) * (P ? T(1) : sum);
+
+            size_t k = n - 1;
+            T c      = T(0);
+
+            for (size_t j = 0; j < n; ++j) {
+                c += r[j];
+
+                if (u < c) {
+                    k = j;
+                    break;
+                }
+            }
+
+            T* o = samples + i * n;
+
+            std::fill(o, o + n, T(0));
+            o[k] = T(1);
+        }
+    };
+
+    if (rows * n >= counter_rng::parallel_threshold && rows > 1) {
+        parallel_for_n(rows, row);
+    } else {
+        for (size_t i = 0; i < rows; ++i) {
+            row(i);
+        }
+    }
+}
+
+} //end of dll namespace
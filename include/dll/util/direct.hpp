@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Access to the memory of ETL expressions for the raw kernels.
+ *
+ * When ETL is built in GPU mode (ETL_GPU), the containers stay on the
+ * device between the expressions and only the raw kernels working on the
+ * host memory need a copy back. The kernels synchronize their inputs with
+ * host_read and flag their outputs with host_written, the expressions
+ * upload them back only when they are next used on the device. Without
+ * GPU, both are no-ops.
+ */
+
+#pragma once
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Return the expression itself if it has direct memory access
+ */
+template <typename E, cpp_enable_iff(etl::decay_traits<E>::is_direct)>
+const E& direct_memory(const E& e) {
+    return e;
+}
+
+/*!
+ * \brief Return a temporary copy of the expression if it has no direct
+ * memory access
+ */
+template <typename E, cpp_disable_if(etl::decay_traits<E>::is_direct)>
+auto direct_memory(const E& e) {
+    return etl::force_temporary(e);
+}
+
+/*!
+ * \brief Make the host memory of the containers up to date before it is
+ * read (or updated) by a raw kernel
+ */
+template <typename... E>
+void host_read(const E&... e) {
+    int unused[] = {(e.ensure_cpu_up_to_date(), 1)...};
+    cpp_unused(unused);
+}
+
+/*!
+ * \brief Flag the device memory of the containers as outdated after
+ * their host memory has been written by a raw kernel
+ */
+template <typename... E>
+void host_written(E&... e) {
+    int unused[] = {(e.invalidate_gpu(), 1)...};
+    cpp_unused(unused);
+}
+
+} //end of dll namespace
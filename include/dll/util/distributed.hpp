@@ -0,0 +1,517 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Communication between the processes of a multi-node training.
+ *
+ * The processes (ranks) are connected in a ring over TCP. The rank and
+ * the addresses of all the ranks are given by the environment:
+ *
+ *  - DLL_RANK: the rank of this process, in [0, N)
+ *  - DLL_PEERS: the N addresses (host:port) of the ranks, separated by commas
+ *
+ * Without these variables, the training is not distributed and all the
+ * functions are no-ops.
+ *
+ * The sums are computed with the ring all-reduce algorithm (reduce-scatter
+ * then all-gather), each rank sending and receiving 2 * (N - 1) / N of the
+ * data. The operations can be submitted to a communication thread, running
+ * them in order, to overlap them with the computations.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace dll {
+
+namespace distributed {
+
+namespace detail {
+
+/*!
+ * \brief Send n bytes to the given socket
+ */
+inline void send_all(int fd, const void* data, size_t n) {
+    auto* p = static_cast<const char*>(data);
+
+    while (n) {
+        auto sent = ::send(fd, p, n, MSG_NOSIGNAL);
+
+        if (sent <= 0) {
+            std::cerr << "ERROR: Lost connection with a rank of the distributed training" << std::endl;
+            std::abort();
+        }
+
+        p += sent;
+        n -= sent;
+    }
+}
+
+/*!
+ * \brief Receive n bytes from the given socket
+ */
+inline void receive_all(int fd, void* data, size_t n) {
+    auto* p = static_cast<char*>(data);
+
+    while (n) {
+        auto received = ::recv(fd, p, n, 0);
+
+        if (received <= 0) {
+            std::cerr << "ERROR: Lost connection with a rank of the distributed training" << std::endl;
+            std::abort();
+        }
+
+        p += received;
+        n -= received;
+    }
+}
+
+/*!
+ * \brief Resolve the given host:port address
+ */
+inline addrinfo* resolve(const std::string& peer, bool passive) {
+    auto colon = peer.rfind(':');
+
+    if (colon == std::string::npos) {
+        return nullptr;
+    }
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = passive ? AI_PASSIVE : 0;
+
+    addrinfo* result = nullptr;
+
+    const auto host = peer.substr(0, colon);
+    const auto port = peer.substr(colon + 1);
+
+    if (::getaddrinfo(passive ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) {
+        return nullptr;
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Disable the Nagle algorithm on the given socket, the messages
+ * being sent as soon as possible
+ */
+inline void no_delay(int fd) {
+    int yes = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+/*!
+ * \brief Create a socket listening on the port of the given host:port address
+ * \return the socket, or -1 in case of error
+ */
+inline int listen_socket(const std::string& peer, int backlog = 1) {
+    auto* local = resolve(peer, true);
+
+    if (!local) {
+        return -1;
+    }
+
+    int fd = ::socket(local->ai_family, local->ai_socktype, local->ai_protocol);
+
+    int yes = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if (::bind(fd, local->ai_addr, local->ai_addrlen) < 0 || ::listen(fd, backlog) < 0) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    ::freeaddrinfo(local);
+
+    return fd;
+}
+
+/*!
+ * \brief Connect to the given host:port address, retrying for one minute
+ * since the other process may not be listening yet
+ * \return the socket, or -1 in case of error
+ */
+inline int connect_socket(const std::string& peer) {
+    auto* remote = resolve(peer, false);
+
+    if (!remote) {
+        return -1;
+    }
+
+    int result = -1;
+
+    for (size_t attempt = 0; attempt < 600 && result < 0; ++attempt) {
+        int fd = ::socket(remote->ai_family, remote->ai_socktype, remote->ai_protocol);
+
+        if (::connect(fd, remote->ai_addr, remote->ai_addrlen) == 0) {
+            result = fd;
+        } else {
+            ::close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    ::freeaddrinfo(remote);
+
+    return result;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief The ring of the processes of a distributed training
+ */
+struct communicator {
+    size_t rank  = 0; ///< The rank of this process
+    size_t world = 1; ///< The number of processes
+
+    /*!
+     * \brief Connect the ring from the environment
+     */
+    communicator() {
+        const char* rank_env  = std::getenv("DLL_RANK");
+        const char* peers_env = std::getenv("DLL_PEERS");
+
+        if (!rank_env || !peers_env) {
+            return;
+        }
+
+        std::vector<std::string> peers;
+
+        std::string all(peers_env);
+        size_t start = 0;
+        while (start <= all.size()) {
+            auto end = all.find(',', start);
+            if (end == std::string::npos) {
+                end = all.size();
+            }
+
+            if (end > start) {
+                peers.push_back(all.substr(start, end - start));
+            }
+
+            start = end + 1;
+        }
+
+        const size_t r = std::atoi(rank_env);
+
+        if (peers.size() < 2 || r >= peers.size()) {
+            std::cerr << "ERROR: Invalid DLL_RANK/DLL_PEERS, the training is not distributed" << std::endl;
+            return;
+        }
+
+        if (!connect_ring(peers, r)) {
+            std::cerr << "ERROR: Impossible to connect the ring of rank " << r << ", the training is not distributed" << std::endl;
+            return;
+        }
+
+        rank  = r;
+        world = peers.size();
+
+        comm_thread = std::thread([this] { run(); });
+    }
+
+    communicator(const communicator& rhs) = delete;
+    communicator& operator=(const communicator& rhs) = delete;
+
+    /*!
+     * \brief Stop the communication thread and close the ring
+     */
+    ~communicator() {
+        if (comm_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                stop = true;
+            }
+
+            condition.notify_all();
+            comm_thread.join();
+        }
+
+        if (next_fd >= 0) {
+            ::close(next_fd);
+        }
+
+        if (prev_fd >= 0) {
+            ::close(prev_fd);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the training is distributed
+     */
+    bool active() const {
+        return world > 1;
+    }
+
+    /*!
+     * \brief Sum the given values over all the ranks, in place
+     */
+    template <typename T>
+    void all_reduce(T* data, size_t n) {
+        if (!active() || !n) {
+            return;
+        }
+
+        const size_t P = world;
+
+        auto first  = [n, P](size_t c) { return (c * n) / P; };
+        auto length = [n, P, &first](size_t c) { return first(c + 1) - first(c); };
+
+        std::vector<T> buffer(n / P + 1);
+
+        // Reduce-scatter: after P - 1 steps, rank r has the sum of chunk r + 1
+        for (size_t s = 0; s < P - 1; ++s) {
+            const size_t send_c = (rank + P - s) % P;
+            const size_t recv_c = (rank + 2 * P - s - 1) % P;
+
+            exchange(data + first(send_c), length(send_c), buffer.data(), length(recv_c));
+
+            T* out = data + first(recv_c);
+            for (size_t i = 0; i < length(recv_c); ++i) {
+                out[i] += buffer[i];
+            }
+        }
+
+        // All-gather: the complete chunks go around the ring
+        for (size_t s = 0; s < P - 1; ++s) {
+            const size_t send_c = (rank + 1 + P - s) % P;
+            const size_t recv_c = (rank + P - s) % P;
+
+            exchange(data + first(send_c), length(send_c), data + first(recv_c), length(recv_c));
+        }
+    }
+
+    /*!
+     * \brief Copy the values of rank 0 to all the ranks
+     */
+    template <typename T>
+    void broadcast(T* data, size_t n) {
+        if (!active() || !n) {
+            return;
+        }
+
+        if (rank > 0) {
+            detail::receive_all(prev_fd, data, n * sizeof(T));
+        }
+
+        if (rank < world - 1) {
+            detail::send_all(next_fd, data, n * sizeof(T));
+        }
+    }
+
+    /*!
+     * \brief Gather the messages of all the ranks
+     * \param local The message of this rank
+     * \return the messages of all the ranks, indexed by rank
+     */
+    std::vector<std::vector<char>> all_gather(std::vector<char> local) {
+        std::vector<std::vector<char>> messages(world);
+        messages[rank] = std::move(local);
+
+        const size_t P = world;
+
+        // At each step, forward the message received at the previous step
+        for (size_t s = 0; s + 1 < P; ++s) {
+            const size_t send_m = (rank + P - s) % P;
+            const size_t recv_m = (rank + 2 * P - s - 1) % P;
+
+            uint64_t send_size = messages[send_m].size();
+            uint64_t recv_size = 0;
+
+            exchange(&send_size, 1, &recv_size, 1);
+
+            messages[recv_m].resize(recv_size);
+
+            exchange(messages[send_m].data(), send_size, messages[recv_m].data(), recv_size);
+        }
+
+        return messages;
+    }
+
+    /*!
+     * \brief Run the given operation on the communication thread, after
+     * the operations submitted before.
+     *
+     * \return a future signaled when the operation is done
+     */
+    std::future<void> submit(std::function<void()> operation) {
+        std::packaged_task<void()> task(std::move(operation));
+        auto future = task.get_future();
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            tasks.push_back(std::move(task));
+        }
+
+        condition.notify_one();
+
+        return future;
+    }
+
+private:
+    /*!
+     * \brief Send to the next rank while receiving from the previous one
+     */
+    template <typename T>
+    void exchange(const T* send, size_t send_n, T* receive, size_t recv_n) {
+        std::thread sender([&] { detail::send_all(next_fd, send, send_n * sizeof(T)); });
+
+        detail::receive_all(prev_fd, receive, recv_n * sizeof(T));
+
+        sender.join();
+    }
+
+    /*!
+     * \brief Listen on the address of this rank, connect to the next rank
+     * and accept the connection of the previous rank.
+     */
+    bool connect_ring(const std::vector<std::string>& peers, size_t r) {
+        int listen_fd = detail::listen_socket(peers[r]);
+
+        if (listen_fd < 0) {
+            return false;
+        }
+
+        // The next rank may not be listening yet
+        std::thread connector([&] { next_fd = detail::connect_socket(peers[(r + 1) % peers.size()]); });
+
+        prev_fd = ::accept(listen_fd, nullptr, nullptr);
+
+        connector.join();
+
+        ::close(listen_fd);
+
+        if (prev_fd < 0 || next_fd < 0) {
+            return false;
+        }
+
+        detail::no_delay(next_fd);
+        detail::no_delay(prev_fd);
+
+        return true;
+    }
+
+    /*!
+     * \brief The main function of the communication thread
+     */
+    void run() {
+        while (true) {
+            std::packaged_task<void()> task;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [this] { return stop || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    int next_fd = -1; ///< The socket to the next rank
+    int prev_fd = -1; ///< The socket from the previous rank
+
+    std::thread comm_thread;                      ///< The communication thread
+    std::deque<std::packaged_task<void()>> tasks; ///< The operations waiting for the communication thread
+    std::mutex lock;                              ///< The lock protecting the operations
+    std::condition_variable condition;            ///< Signals new operations
+    bool stop = false;                            ///< Indicates that the communication thread must stop
+};
+
+/*!
+ * \brief Return the communicator of the process
+ */
+inline communicator& comm() {
+    static communicator c;
+    return c;
+}
+
+/*!
+ * \brief Indicates if the training is distributed
+ */
+inline bool active() {
+    return comm().active();
+}
+
+/*!
+ * \brief Return the rank of the process (0 if not distributed)
+ */
+inline size_t rank() {
+    return comm().rank;
+}
+
+/*!
+ * \brief Return the number of processes (1 if not distributed)
+ */
+inline size_t world() {
+    return comm().world;
+}
+
+/*!
+ * \brief Indicates if the process is the root (rank 0) of the training,
+ * the one reporting the progress
+ */
+inline bool is_root() {
+    return rank() == 0;
+}
+
+/*!
+ * \brief Return the range [first, last) of the samples of this rank for
+ * a dataset of n samples
+ */
+inline std::pair<size_t, size_t> shard(size_t n) {
+    return {(rank() * n) / world(), ((rank() + 1) * n) / world()};
+}
+
+/*!
+ * \brief Compute the average of the given value over all the ranks,
+ * weighted by the given number of samples
+ */
+inline double weighted_average(double value, size_t samples) {
+    if (!active()) {
+        return value;
+    }
+
+    double values[2] = {value * samples, double(samples)};
+    comm().all_reduce(values, 2);
+
+    return values[1] > 0.0 ? values[0] / values[1] : 0.0;
+}
+
+} //end of namespace distributed
+
+} //end of dll namespace
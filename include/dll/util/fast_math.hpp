@@ -0,0 +1,178 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fast approximations of the activation functions.
+ *
+ * exp is computed as 2^n * 2^f with n = round(x * log2(e)) and 2^f,
+ * f in [-0.5, 0.5], approximated with a polynomial of degree 5. The
+ * relative error of exp is below 3e-6, sigmoid and tanh are derived
+ * from it. The loops have no branches and are vectorized by the
+ * compiler.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/multi_isa.hpp"
+
+namespace dll {
+
+namespace fast_math_detail {
+
+/*!
+ * \brief Compute 2^n for an integer n in the range of the exponents of
+ * single-precision numbers
+ */
+inline float pow2i(float, int32_t n) {
+    int32_t bits = (n + 127) << 23;
+    float r;
+    std::memcpy(&r, &bits, sizeof(r));
+    return r;
+}
+
+/*!
+ * \copydoc pow2i
+ */
+inline double pow2i(double, int32_t n) {
+    int64_t bits = int64_t(n + 1023) << 52;
+    double r;
+    std::memcpy(&r, &bits, sizeof(r));
+    return r;
+}
+
+} //end of namespace fast_math_detail
+
+/*!
+ * \brief Fast approximation of exp, the input is clamped to [-87, 87]
+ */
+template <typename T>
+inline T fast_exp(T x) {
+    x = std::min(std::max(x, T(-87)), T(87));
+
+    const T t = x * T(1.4426950408889634);
+    const T n = std::floor(t + T(0.5));
+    const T f = t - n;
+
+    // 2^f = e^(f * ln(2))
+    const T p = T(1) + f * (T(0.6931471806) + f * (T(0.2402265070) + f * (T(0.0555041087) + f * (T(0.0096181291) + f * T(0.0013333558)))));
+
+    return p * fast_math_detail::pow2i(T(), int32_t(n));
+}
+
+/*!
+ * \brief Fast approximation of the logistic sigmoid
+ */
+template <typename T>
+inline T fast_sigmoid(T x) {
+    return T(1) / (T(1) + fast_exp(-x));
+}
+
+/*!
+ * \brief Fast approximation of the hyperbolic tangent
+ */
+template <typename T>
+inline T fast_tanh(T x) {
+    return T(1) - T(2) / (T(1) + fast_exp(T(2) * x));
+}
+
+/*!
+ * \brief Compute the activation function on the given memory, in place,
+ * with the fast approximations.
+ *
+ * \param x The values
+ * \param n The number of values
+ * \param rows The number of samples (for the softmax)
+ */
+template <function F, typename T>
+DLL_MULTI_VERSION void fast_activate_kernel(T* x, size_t n, size_t rows) {
+    if (F == function::SIGMOID) {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = fast_sigmoid(x[i]);
+        }
+    } else if (F == function::TANH) {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = fast_tanh(x[i]);
+        }
+    } else if (F == function::SOFTMAX) {
+        const size_t m = n / rows;
+
+        for (size_t r = 0; r < rows; ++r) {
+            T* row = x + r * m;
+
+            T max = row[0];
+            for (size_t i = 1; i < m; ++i) {
+                max = std::max(max, row[i]);
+            }
+
+            T sum = 0;
+            for (size_t i = 0; i < m; ++i) {
+                row[i] = fast_exp(row[i] - max);
+                sum += row[i];
+            }
+
+            const T inv = T(1) / sum;
+            for (size_t i = 0; i < m; ++i) {
+                row[i] *= inv;
+            }
+        }
+    } else if (F == function::RELU) {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = std::max(x[i], T(0));
+        }
+    }
+}
+
+/*!
+ * \brief Compute the activation function on the given batch, in place,
+ * with the fast approximations.
+ *
+ * The softmax is computed for each sample (first dimension), in a
+ * single fused pass, and is numerically stable.
+ *
+ * \param output The batch, with direct memory access
+ */
+template <function F, typename O>
+void fast_activate(O&& output) {
+    fast_activate_kernel<F>(output.memory_start(), etl::size(output), etl::dim<0>(output));
+}
+
+/*!
+ * \brief Compute the activation function on the given batch, in place,
+ * with the fast approximations.
+ *
+ * \tparam F The activation function
+ * \tparam Fast Indicates if the fast approximations are used
+ * \param output The batch, with direct memory access
+ */
+template <function F, bool Fast, typename O, cpp_enable_iff(Fast)>
+void activate_inplace(O&& output) {
+    fast_activate<F>(output);
+}
+
+/*!
+ * \brief Compute the activation function on the given batch, in place,
+ * with the ETL functions.
+ *
+ * \tparam F The activation function
+ * \tparam Fast Indicates if the fast approximations are used
+ * \param output The batch
+ */
+template <function F, bool Fast, typename O, cpp_disable_if(Fast)>
+void activate_inplace(O&& output) {
+    output = f_activate<F>(output);
+}
+
+} //end of dll namespace
@@ -0,0 +1,409 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Flight recorder of the training: the phase timings of the last
+ * batches.
+ *
+ * The timers (timers.hpp) only give the totals of the run. When the flight
+ * recorder is started, each batch trained by the SGD trainer or by the RBM
+ * trainer records the durations of its phases in a fixed-size ring, the
+ * oldest batches being overwritten. The wait phase is the time since the
+ * end of the previous batch of the same thread: waiting for the data, the
+ * validation, the watchers, ..., periodic stalls are therefore visible batch
+ * per batch.
+ *
+ * The ring is lock-free: each writer takes the next slot with an atomic
+ * increment and publishes it with a sequence number, a reader only keeps
+ * the slots that were not being written while it copied them. The ring can
+ * be dumped at any time (in CSV or in the Chrome trace format), or when the
+ * process receives a given signal, in which case the dump is done by the
+ * next batch, out of the signal handler.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace dll {
+
+/*!
+ * \brief The phases of a batch
+ */
+enum class flight_phase {
+    WAIT,     ///< The time since the end of the previous batch of the thread
+    FORWARD,  ///< The forward propagation
+    BACKWARD, ///< The backward propagation
+    UPDATE,   ///< The gradients and the update of the weights
+    METRICS,  ///< The metrics of the batch
+    CD        ///< The contrastive divergence step (RBM only)
+};
+
+constexpr size_t flight_phases = 6; ///< The number of phases of a batch
+
+/*!
+ * \brief Returns the name of the given phase
+ */
+inline const char* to_string(flight_phase phase) {
+    switch (phase) {
+        case flight_phase::WAIT:
+            return "wait";
+        case flight_phase::FORWARD:
+            return "forward";
+        case flight_phase::BACKWARD:
+            return "backward";
+        case flight_phase::UPDATE:
+            return "update";
+        case flight_phase::METRICS:
+            return "metrics";
+        case flight_phase::CD:
+            return "cd";
+    }
+
+    return "";
+}
+
+/*!
+ * \brief The trainer that recorded a batch
+ */
+enum class flight_source : uint32_t {
+    SGD, ///< The SGD trainer
+    RBM  ///< The RBM trainer
+};
+
+/*!
+ * \brief The timings of one batch
+ */
+struct flight_record {
+    uint64_t batch;                                ///< The index of the batch in the recorder
+    uint64_t start;                                ///< The start of the wait phase (ns since the start of the recorder)
+    uint32_t thread;                               ///< The index of the thread
+    flight_source source;                          ///< The trainer of the batch
+    uint64_t samples;                              ///< The number of samples of the batch
+    std::array<uint64_t, flight_phases> durations; ///< The duration of each phase (ns)
+};
+
+/*!
+ * \brief One slot of the ring
+ */
+struct flight_slot {
+    std::atomic<uint64_t> sequence{0}; ///< 2 * batch + 1 while written, 2 * batch + 2 once written, 0 if empty
+    flight_record record;              ///< The record
+};
+
+/*!
+ * \brief The state of the flight recorder
+ */
+struct flight_recorder_t {
+    std::atomic<bool> enabled{false};            ///< Indicates if batches are recorded
+    std::atomic<uint64_t> head{0};               ///< The index of the next batch
+    std::atomic<uint32_t> threads{0};            ///< The number of threads that recorded batches
+    std::atomic<bool> dump_requested{false};     ///< Indicates that a dump was requested by a signal
+    std::chrono::steady_clock::time_point epoch; ///< The start of the recorder
+    std::unique_ptr<flight_slot[]> slots;        ///< The ring of slots
+    size_t capacity = 0;                         ///< The number of slots (a power of two)
+    std::string signal_path;                     ///< The file of the dump requested by a signal
+};
+
+/*!
+ * \brief Get a reference to the flight recorder
+ */
+inline flight_recorder_t& get_flight_recorder() {
+    static flight_recorder_t recorder;
+    return recorder;
+}
+
+namespace flight_detail {
+
+/*!
+ * \brief The end of the previous batch of the current thread (ns since the
+ * start of the recorder)
+ */
+inline uint64_t& last_end() {
+    thread_local uint64_t value = 0;
+    return value;
+}
+
+/*!
+ * \brief The index of the current thread in the recorder
+ */
+inline uint32_t thread_index() {
+    thread_local uint32_t index = get_flight_recorder().threads++;
+    return index;
+}
+
+/*!
+ * \brief Returns the current time in ns since the start of the recorder
+ */
+inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - get_flight_recorder().epoch).count();
+}
+
+/*!
+ * \brief The signal handler, only requesting the dump
+ */
+inline void signal_handler(int /*signal*/) {
+    get_flight_recorder().dump_requested = true;
+}
+
+} //end of namespace flight_detail
+
+/*!
+ * \brief Indicates if the flight recorder is recording batches
+ */
+inline bool is_flight_recording() {
+    return get_flight_recorder().enabled.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Start recording the batches in a ring of the given capacity,
+ * discarding the previous ones.
+ *
+ * This must not be called while batches are being trained.
+ *
+ * \param capacity The number of batches kept (rounded up to a power of two)
+ */
+inline void start_flight_recorder(size_t capacity = 4096) {
+    auto& recorder = get_flight_recorder();
+
+    recorder.enabled = false;
+
+    size_t c = 1;
+    while (c < capacity) {
+        c *= 2;
+    }
+
+    recorder.capacity = c;
+    recorder.slots.reset(new flight_slot[c]);
+    recorder.head     = 0;
+    recorder.epoch    = std::chrono::steady_clock::now();
+
+    flight_detail::last_end() = 0;
+
+    recorder.enabled = true;
+}
+
+/*!
+ * \brief Stop recording batches, the recorded ones are kept
+ */
+inline void stop_flight_recorder() {
+    get_flight_recorder().enabled = false;
+}
+
+/*!
+ * \brief Returns the batches currently in the ring, from the oldest to the
+ * most recent
+ */
+inline std::vector<flight_record> flight_records() {
+    auto& recorder = get_flight_recorder();
+
+    std::vector<flight_record> records;
+
+    if (!recorder.slots) {
+        return records;
+    }
+
+    const uint64_t head  = recorder.head.load(std::memory_order_acquire);
+    const uint64_t first = head > recorder.capacity ? head - recorder.capacity : 0;
+
+    records.reserve(head - first);
+
+    for (uint64_t b = first; b < head; ++b) {
+        auto& slot = recorder.slots[b & (recorder.capacity - 1)];
+
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+
+        if (before != 2 * b + 2) {
+            continue; // Still being written, or already overwritten
+        }
+
+        flight_record record;
+        std::memcpy(&record, &slot.record, sizeof(record));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            records.push_back(record);
+        }
+    }
+
+    return records;
+}
+
+/*!
+ * \brief Dump the recorded batches in CSV, one line per batch, the
+ * durations being in nanoseconds
+ * \param os The stream to write to
+ */
+inline void dump_flight_recorder(std::ostream& os = std::cout) {
+    os << "batch,thread,source,samples,start_ns";
+
+    for (size_t p = 0; p < flight_phases; ++p) {
+        os << "," << to_string(flight_phase(p)) << "_ns";
+    }
+
+    os << "\n";
+
+    for (auto& record : flight_records()) {
+        os << record.batch << "," << record.thread << "," << (record.source == flight_source::SGD ? "sgd" : "rbm") << ","
+           << record.samples << "," << record.start;
+
+        for (auto d : record.durations) {
+            os << "," << d;
+        }
+
+        os << "\n";
+    }
+
+    os.flush();
+}
+
+/*!
+ * \brief Export the recorded batches in the Chrome trace format (JSON),
+ * which can be opened with chrome://tracing. Each phase of each batch is
+ * one event, the phases of a batch being consecutive.
+ * \param os The stream to write to
+ */
+inline void export_flight_chrome_trace(std::ostream& os) {
+    os << "{\"traceEvents\":[";
+
+    bool first = true;
+
+    for (auto& record : flight_records()) {
+        uint64_t start = record.start;
+
+        for (size_t p = 0; p < flight_phases; ++p) {
+            if (!record.durations[p]) {
+                continue;
+            }
+
+            os << (first ? "\n" : ",\n");
+            os << "{\"name\":\"" << to_string(flight_phase(p)) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << record.thread
+               << ",\"ts\":" << start / 1000.0 << ",\"dur\":" << record.durations[p] / 1000.0
+               << ",\"args\":{\"batch\":" << record.batch << ",\"samples\":" << record.samples << "}}";
+
+            start += record.durations[p];
+            first = false;
+        }
+    }
+
+    os << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+}
+
+/*!
+ * \brief Export the recorded batches in the Chrome trace format (JSON)
+ * \param path The path of the file to write
+ */
+inline void export_flight_chrome_trace(const std::string& path) {
+    std::ofstream os(path);
+    export_flight_chrome_trace(os);
+}
+
+/*!
+ * \brief Export the recorded batches in the Chrome trace format in the
+ * given file when the process receives the given signal (SIGUSR1 for
+ * instance). The export is done by the next recorded batch.
+ * \param signal The signal
+ * \param path The path of the file to write
+ */
+inline void dump_flight_recorder_on_signal(int signal, const std::string& path) {
+    get_flight_recorder().signal_path = path;
+    std::signal(signal, flight_detail::signal_handler);
+}
+
+/*!
+ * \brief The timings of the batch being trained by the current thread,
+ * recorded in the ring at the end of its scope.
+ *
+ * Each call to mark() attributes the time since the previous mark (or the
+ * start of the batch) to the given phase. Nothing is measured when the
+ * recorder is not started.
+ */
+struct flight_batch {
+    bool active;          ///< Indicates if the batch is recorded
+    flight_record record; ///< The record of the batch
+    uint64_t last = 0;    ///< The time of the last mark
+
+    /*!
+     * \brief Start a batch
+     * \param source The trainer of the batch
+     * \param samples The number of samples of the batch
+     */
+    flight_batch(flight_source source, size_t samples) : active(is_flight_recording()) {
+        if (active) {
+            last = flight_detail::now();
+
+            auto& prev = flight_detail::last_end();
+
+            record.source    = source;
+            record.samples   = samples;
+            record.thread    = flight_detail::thread_index();
+            record.start     = prev && prev < last ? prev : last;
+            record.durations = {};
+
+            record.durations[size_t(flight_phase::WAIT)] = last - record.start;
+        }
+    }
+
+    /*!
+     * \brief Attribute the time since the previous mark to the given phase
+     */
+    void mark(flight_phase phase) {
+        if (active) {
+            const uint64_t t = flight_detail::now();
+
+            record.durations[size_t(phase)] += t - last;
+            last = t;
+        }
+    }
+
+    /*!
+     * \brief Record the batch in the ring
+     */
+    ~flight_batch() {
+        if (!active) {
+            return;
+        }
+
+        auto& recorder = get_flight_recorder();
+
+        flight_detail::last_end() = last;
+
+        const uint64_t b = recorder.head.fetch_add(1, std::memory_order_relaxed);
+
+        auto& slot = recorder.slots[b & (recorder.capacity - 1)];
+
+        record.batch = b;
+
+        slot.sequence.store(2 * b + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&slot.record, &record, sizeof(record));
+
+        slot.sequence.store(2 * b + 2, std::memory_order_release);
+
+        if (recorder.dump_requested.load(std::memory_order_relaxed) && recorder.dump_requested.exchange(false)) {
+            export_flight_chrome_trace(recorder.signal_path);
+        }
+    }
+
+    flight_batch(const flight_batch& rhs) = delete;
+    flight_batch& operator=(const flight_batch& rhs) = delete;
+};
+
+} //end of namespace dll
@@ -0,0 +1,156 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused Gibbs steps for binary RBM.
+ *
+ * The K steps of CD-k are computed tile by tile: the rows of a tile of
+ * the batch go back and forth between the visible and hidden layers
+ * while staying in cache, instead of materializing the full batches at
+ * each step. The weights are streamed once per tile and per half-step.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "dll/util/counter_rng.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace gibbs_detail {
+
+/*!
+ * \brief Logistic sigmoid, exact or approximated
+ */
+template <bool Fast, typename T>
+inline T sigmoid(T x) {
+    return Fast ? fast_sigmoid(x) : T(1) / (T(1) + std::exp(-x));
+}
+
+} //end of namespace gibbs_detail
+
+/*!
+ * \brief Compute K Gibbs steps of a binary RBM, as done by CD-k.
+ *
+ * Each step computes the visible probabilities from the hidden samples
+ * and then the hidden probabilities, and samples, from the visible
+ * probabilities. The hidden samples of the last step are only drawn if
+ * sample_last is set.
+ *
+ * The random numbers are a function of the step, the row and the unit,
+ * the results do not depend on the number of threads.
+ *
+ * \param w The weights (V x H)
+ * \param b The hidden biases (H)
+ * \param c The visible biases (V)
+ * \param h_in The hidden samples the chains start from (B x H)
+ * \param v_a The visible probabilities of the last step (B x V)
+ * \param h_a The hidden probabilities of the last step (B x H)
+ * \param h_s The hidden samples of the last step (B x H)
+ * \param sample_last Indicates if the hidden samples of the last step are drawn
+ *
+ * \tparam K The number of steps
+ * \tparam Fast Indicates if the fast approximation of the sigmoid is used
+ */
+template <size_t K, bool Fast, typename T>
+void fused_gibbs_binary(const T* w, const T* b, const T* c, size_t B, size_t V, size_t H, const T* h_in, T* v_a, T* h_a, T* h_s, bool sample_last) {
+    static_assert(K > 0, "At least one Gibbs step is necessary");
+
+    constexpr size_t tile = 16;
+
+    // Rows start at the beginning of a block of the counter-based generator
+    const size_t stride = (H + 3) & ~size_t(3);
+
+    const auto rng = next_rng();
+
+    auto task = [&](size_t t) {
+        const size_t first = t * tile;
+        const size_t last  = std::min(B, first + tile);
+
+        if (h_in != h_s) {
+            std::copy(h_in + first * H, h_in + last * H, h_s + first * H);
+        }
+
+        for (size_t k = 0; k < K; ++k) {
+            // Visible probabilities from the hidden samples
+            for (size_t r = first; r < last; ++r) {
+                const T* h = h_s + r * H;
+                T* v       = v_a + r * V;
+
+                for (size_t i = 0; i < V; ++i) {
+                    const T* w_row = w + i * H;
+
+                    T x = c[i];
+                    for (size_t j = 0; j < H; ++j) {
+                        x += w_row[j] * h[j];
+                    }
+
+                    v[i] = gibbs_detail::sigmoid<Fast>(x);
+                }
+            }
+
+            // Hidden probabilities from the visible probabilities
+            for (size_t r = first; r < last; ++r) {
+                std::copy(b, b + H, h_a + r * H);
+            }
+
+            for (size_t i = 0; i < V; ++i) {
+                const T* w_row = w + i * H;
+
+                for (size_t r = first; r < last; ++r) {
+                    const T x_i = v_a[r * V + i];
+                    T* h        = h_a + r * H;
+
+                    for (size_t j = 0; j < H; ++j) {
+                        h[j] += x_i * w_row[j];
+                    }
+                }
+            }
+
+            for (size_t r = first; r < last; ++r) {
+                T* h = h_a + r * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    h[j] = gibbs_detail::sigmoid<Fast>(h[j]);
+                }
+            }
+
+            // Hidden samples
+            if (k + 1 < K || sample_last) {
+                for (size_t r = first; r < last; ++r) {
+                    const T* p = h_a + r * H;
+                    T* s       = h_s + r * H;
+
+                    const size_t base = (k * B + r) * stride;
+
+                    for (size_t j = 0; j < H; j += 4) {
+                        auto u = rng.block((base + j) / 4);
+
+                        for (size_t l = 0; l < 4 && j + l < H; ++l) {
+                            s[j + l] = counter_rng::to_uniform<T>(u[l]) < p[j + l] ? T(1) : T(0);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    const size_t tiles = (B + tile - 1) / tile;
+
+    if (tiles > 1) {
+        parallel_for_n(tiles, task);
+    } else {
+        task(0);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,102 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Transparent huge pages for the large buffers.
+ *
+ * The memory of the large containers (the caches of the generators and the
+ * weights of the large dynamic layers) is advised to the kernel to be
+ * backed by transparent huge pages (2MB on x86-64), which divides by 512
+ * the number of TLB entries needed to traverse them. Only the 2MB pages
+ * fully inside the container are advised, and only for containers of at
+ * least huge_page_threshold bytes. The containers themselves are allocated
+ * by ETL, already aligned for its vectorized loads.
+ *
+ * This is only done on Linux, where it can be disabled with
+ * DLL_NO_HUGE_PAGES. Elsewhere, nothing is advised.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "etl/etl.hpp"
+
+#if defined(__linux__) && !defined(DLL_NO_HUGE_PAGES)
+#include <sys/mman.h>
+#endif
+
+namespace dll {
+
+constexpr size_t huge_page_size      = 2 * 1024 * 1024; ///< The size of a huge page
+constexpr size_t huge_page_threshold = 8 * 1024 * 1024; ///< The minimum size of a container to be advised
+
+namespace huge_pages_detail {
+
+/*!
+ * \brief Returns the counter of the bytes advised to huge pages
+ */
+inline std::atomic<size_t>& counter() {
+    static std::atomic<size_t> bytes(0);
+    return bytes;
+}
+
+} //end of namespace huge_pages_detail
+
+/*!
+ * \brief Advise the given memory to be backed by huge pages, if it is
+ * large enough.
+ * \param p The start of the memory
+ * \param bytes The size of the memory, in bytes
+ * \return the number of bytes advised
+ */
+inline size_t advise_huge_pages(void* p, size_t bytes) {
+#if defined(__linux__) && !defined(DLL_NO_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    if (!p || bytes < huge_page_threshold) {
+        return 0;
+    }
+
+    // Only the huge pages fully inside the memory are advised
+    const auto start = reinterpret_cast<uintptr_t>(p);
+    const auto first = (start + huge_page_size - 1) / huge_page_size * huge_page_size;
+    const auto last  = (start + bytes) / huge_page_size * huge_page_size;
+
+    if (last <= first || madvise(reinterpret_cast<void*>(first), last - first, MADV_HUGEPAGE)) {
+        return 0;
+    }
+
+    huge_pages_detail::counter() += last - first;
+
+    return last - first;
+#else
+    cpp_unused(p);
+    cpp_unused(bytes);
+    return 0;
+#endif
+}
+
+/*!
+ * \brief Advise the memory of the given container to be backed by huge
+ * pages, if it is large enough.
+ * \return the number of bytes advised
+ */
+template <typename C>
+size_t advise_huge_pages(C& container) {
+    return advise_huge_pages(container.memory_start(), etl::size(container) * sizeof(etl::value_t<C>));
+}
+
+/*!
+ * \brief Returns the number of bytes advised to huge pages since the start
+ * of the program
+ */
+inline size_t huge_page_bytes() {
+    return huge_pages_detail::counter().load();
+}
+
+} //end of dll namespace
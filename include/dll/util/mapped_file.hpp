@@ -0,0 +1,151 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Memory-mapped binary files, for the direct readers of the
+ * datasets.
+ *
+ * The files are mapped read-only and only the pages of the samples that
+ * are used are read. The bytes are converted directly into the caches of
+ * the generators, in parallel.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A read-only memory-mapped file
+ */
+struct mapped_file {
+    /*!
+     * \brief Map the given file
+     */
+    explicit mapped_file(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || st.st_size == 0) {
+            return;
+        }
+
+        void* mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED) {
+            return;
+        }
+
+        ::madvise(mapped, st.st_size, MADV_WILLNEED);
+
+        memory = static_cast<const uint8_t*>(mapped);
+        length = st.st_size;
+    }
+
+    mapped_file(const mapped_file& rhs) = delete;
+    mapped_file& operator=(const mapped_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mapped_file() {
+        if (memory) {
+            ::munmap(const_cast<uint8_t*>(memory), length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the file is mapped
+     */
+    bool valid() const {
+        return memory != nullptr;
+    }
+
+    /*!
+     * \brief Return the bytes of the file
+     */
+    const uint8_t* data() const {
+        return memory;
+    }
+
+    /*!
+     * \brief Return the size of the file, in bytes
+     */
+    size_t size() const {
+        return length;
+    }
+
+    /*!
+     * \brief Return the big-endian 32-bit integer at the given offset
+     */
+    uint32_t read_be32(size_t offset) const {
+        const uint8_t* p = memory + offset;
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+private:
+    int fd                = -1;      ///< The file descriptor
+    const uint8_t* memory = nullptr; ///< The mapped memory
+    size_t length         = 0;       ///< The size of the mapping
+};
+
+/*!
+ * \brief Convert n records of bytes to the given destination, in
+ * parallel.
+ *
+ * \param dst The destination, n * record values
+ * \param src The first record
+ * \param n The number of records
+ * \param record The number of values per record
+ * \param stride The distance between two records in the source, in bytes
+ */
+template <typename T>
+void convert_u8(T* dst, const uint8_t* src, size_t n, size_t record, size_t stride) {
+    constexpr size_t block = 256;
+
+    auto task = [&](size_t t) {
+        const size_t first = t * block;
+        const size_t last  = std::min(n, first + block);
+
+        for (size_t i = first; i < last; ++i) {
+            const uint8_t* in = src + i * stride;
+            T* out            = dst + i * record;
+
+            for (size_t j = 0; j < record; ++j) {
+                out[j] = T(in[j]);
+            }
+        }
+    };
+
+    const size_t blocks = (n + block - 1) / block;
+
+    if (blocks > 1) {
+        parallel_for_n(blocks, task);
+    } else if (blocks) {
+        task(0);
+    }
+}
+
+} //end of dll namespace
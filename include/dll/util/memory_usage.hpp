@@ -0,0 +1,318 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Accounting of the memory used by a network and by its training.
+ *
+ * The contexts of the trainers are only allocated during the training,
+ * their memory is computed from the shapes of the layers, the batch size and
+ * the updater of the network, as they would be allocated:
+ *
+ *  - the SGD trainer keeps the gradients and the state of the updater of
+ *  each trainable parameter, and the inputs, the outputs and the errors of
+ *  the batch for each layer, all at the same time;
+ *  - the CD trainer keeps the visible and hidden batches, the gradients and
+ *  the momentum of the RBM being pretrained, one RBM at a time.
+ *
+ * The backup of the weights is counted for each trained layer even though
+ * it is only allocated on the first backup (early stopping).
+ *
+ * The report also displays the memory of the large buffers backed by huge
+ * pages (see huge_pages.hpp) since the start of the program.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "cpp_utils/static_if.hpp"
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "dll/layer_traits.hpp"
+#include "dll/updater_type.hpp"
+#include "dll/util/huge_pages.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the number of bytes of the elements of the given container
+ */
+template <typename C>
+size_t container_bytes(const C& container) {
+    return etl::size(container) * sizeof(etl::value_t<std::decay_t<C>>);
+}
+
+/*!
+ * \brief Returns the number of containers of the size of a parameter kept
+ * by the SGD trainer for each parameter (the gradients and the state of the
+ * updater)
+ */
+constexpr size_t updater_buffers(updater_type updater) {
+    return updater == updater_type::SGD          ? 1
+         : updater == updater_type::MOMENTUM     ? 2
+         : updater == updater_type::NESTEROV     ? 3
+         : updater == updater_type::ADAGRAD      ? 2
+         : updater == updater_type::RMSPROP      ? 2
+         : updater == updater_type::ADAM_CORRECT ? 5
+         : 3; // ADAM, ADAMAX, NADAM and ADADELTA
+}
+
+/*!
+ * \brief The memory used by a layer, in bytes
+ */
+struct layer_memory {
+    std::string name;       ///< The description of the layer
+    size_t parameters  = 0; ///< The weights of the layer
+    size_t backup      = 0; ///< The backup of the weights
+    size_t updater     = 0; ///< The gradients and the state of the updater of the SGD trainer
+    size_t activations = 0; ///< The inputs, outputs and errors of the layer in the SGD trainer
+    size_t cd          = 0; ///< The buffers of the CD trainer (RBM only)
+};
+
+/*!
+ * \brief The memory used by a network and by its training, in bytes
+ */
+struct memory_report {
+    std::vector<layer_memory> layers; ///< The memory of each layer
+    size_t generator = 0;             ///< The caches of the generator (0 if not given)
+
+    /*!
+     * \brief Returns the memory always used by the weights and their backups
+     */
+    size_t resident() const {
+        size_t bytes = 0;
+
+        for (auto& layer : layers) {
+            bytes += layer.parameters + layer.backup;
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the memory of the context of the SGD trainer
+     */
+    size_t sgd() const {
+        size_t bytes = 0;
+
+        for (auto& layer : layers) {
+            bytes += layer.updater + layer.activations;
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the memory of the largest CD trainer, the RBMs being
+     * pretrained one after another
+     */
+    size_t cd() const {
+        size_t bytes = 0;
+
+        for (auto& layer : layers) {
+            bytes = std::max(bytes, layer.cd);
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the peak memory of the training
+     */
+    size_t peak() const {
+        return resident() + generator + std::max(sgd(), cd());
+    }
+
+    /*!
+     * \brief Display the report in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Memory (bytes):" << std::endl;
+
+        for (size_t i = 0; i < layers.size(); ++i) {
+            auto& layer = layers[i];
+
+            stream << "    Layer " << i << ": " << layer.name << std::endl;
+            stream << "        Parameters: " << layer.parameters << std::endl;
+            stream << "            Backup: " << layer.backup << std::endl;
+            stream << "           Updater: " << layer.updater << std::endl;
+            stream << "       Activations: " << layer.activations << std::endl;
+
+            if (layer.cd) {
+                stream << "        CD Trainer: " << layer.cd << std::endl;
+            }
+        }
+
+        if (generator) {
+            stream << "         Generator: " << generator << std::endl;
+        }
+
+        stream << "          Resident: " << resident() << std::endl;
+        stream << "       SGD Trainer: " << sgd() << std::endl;
+        stream << "        CD Trainer: " << cd() << std::endl;
+        stream << "              Peak: " << peak() << std::endl;
+
+        if (huge_page_bytes()) {
+            stream << "        Huge pages: " << huge_page_bytes() << std::endl;
+        }
+
+        return stream;
+    }
+};
+
+namespace memory_detail {
+
+/*!
+ * \brief Returns the bytes of the containers of the given tuple of
+ * references
+ */
+template <typename Tuple>
+size_t parameters_bytes(Tuple&& parameters) {
+    size_t bytes = 0;
+
+    cpp::for_each(parameters, [&bytes](auto& p) {
+        bytes += container_bytes(p.get());
+    });
+
+    return bytes;
+}
+
+/*!
+ * \brief Returns the input size of a layer with a shape
+ */
+template <typename L>
+auto input_size(const L& layer, size_t, int) -> decltype(size_t(layer.input_size())) {
+    return layer.input_size();
+}
+
+/*!
+ * \brief Returns the input size of a layer without shape, the output of the
+ * previous layer
+ */
+template <typename L>
+size_t input_size(const L&, size_t previous, long) {
+    return previous;
+}
+
+/*!
+ * \brief Returns the output size of a layer with a shape
+ */
+template <typename L>
+auto output_size(const L& layer, size_t, int) -> decltype(size_t(layer.output_size())) {
+    return layer.output_size();
+}
+
+/*!
+ * \brief Returns the output size of a layer without shape, its input size
+ */
+template <typename L>
+size_t output_size(const L&, size_t input, long) {
+    return input;
+}
+
+/*!
+ * \brief Returns the memory of the caches of a generator
+ */
+template <typename G>
+auto generator_bytes(const G& generator, int) -> decltype(size_t(generator.memory())) {
+    return generator.memory();
+}
+
+/*!
+ * \brief Returns the memory of the caches of a generator that does not
+ * report it
+ */
+template <typename G>
+size_t generator_bytes(const G&, long) {
+    return 0;
+}
+
+} //end of namespace memory_detail
+
+/*!
+ * \brief Returns the memory used by the given network and by its training
+ * \param dbn The network
+ */
+template <typename DBN>
+memory_report memory_usage(const DBN& dbn) {
+    using weight = typename DBN::weight;
+
+    // The contexts of the dynamic networks hold batches of the runtime batch size
+    const size_t B = dbn.runtime_batch_size();
+
+    memory_report report;
+
+    size_t previous = 0;
+
+    dbn.for_each_layer([&](auto& layer) {
+        using layer_t = std::decay_t<decltype(layer)>;
+
+        layer_memory m;
+
+        m.name = layer.to_short_string();
+
+        const size_t in  = memory_detail::input_size(layer, previous, 0);
+        const size_t out = memory_detail::output_size(layer, in, 0);
+
+        // The SGD context of each layer has a batch of inputs, of outputs
+        // and of errors
+        m.activations = B * (in + 2 * out) * sizeof(weight);
+
+        cpp::static_if<decay_layer_traits<layer_t>::is_neural_layer()>([&](auto f) {
+            m.parameters = memory_detail::parameters_bytes(f(layer).stored_parameters());
+            m.backup     = m.parameters;
+
+            // trainable_parameters() is not const, only the sizes are read
+            auto& mutable_layer = const_cast<layer_t&>(f(layer));
+
+            m.updater = updater_buffers(DBN::updater) * memory_detail::parameters_bytes(mutable_layer.trainable_parameters());
+        });
+
+        cpp::static_if<decay_layer_traits<layer_t>::is_rbm_layer()>([&](auto f) {
+            constexpr size_t RB = layer_t::batch_size;
+
+            // v1, vf, v2_a and v2_s, h1_a, h1_s, h2_a, h2_s and the
+            // persistent chain, the local sparsity, the gradients and the
+            // momentum of each parameter
+            m.cd = RB * (4 * in + 6 * out) * sizeof(weight) + 2 * out * sizeof(weight) + 2 * m.parameters;
+
+            // The positive and negative gradients of the filters
+            if (decay_layer_traits<layer_t>::is_convolutional_rbm_layer()) {
+                m.cd += 2 * container_bytes(f(layer).w);
+            }
+        });
+
+        previous = out;
+
+        report.layers.push_back(std::move(m));
+    });
+
+    return report;
+}
+
+/*!
+ * \brief Returns the memory used by the given network and by its training
+ * with the given generator
+ * \param dbn The network
+ * \param generator The generator of the training
+ */
+template <typename DBN, typename Generator>
+memory_report memory_usage(const DBN& dbn, const Generator& generator) {
+    auto report = memory_usage(dbn);
+
+    report.generator = memory_detail::generator_bytes(generator, 0);
+
+    return report;
+}
+
+} //end of dll namespace
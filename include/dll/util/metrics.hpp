@@ -0,0 +1,380 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Export of the metrics of the training for the monitoring of the
+ * long-running jobs.
+ *
+ * The metrics are updated by the watchers on the training thread, under a
+ * lock, and exported periodically by the thread of the exporter:
+ *
+ *  - pushed as StatsD gauges, over UDP, to the DLL_STATSD (host:port)
+ *  address;
+ *  - written in the Prometheus text format to the DLL_METRICS_FILE file,
+ *  for the textfile collector of the node exporter. The file is written
+ *  under a temporary name and renamed, a scrape never sees a partial file.
+ *
+ * The period of the export is DLL_METRICS_PERIOD milliseconds (10s by
+ * default). The totals of the timers (auto_timer) are exported with the
+ * metrics, unless they are disabled (DLL_NO_TIMERS).
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The configuration of the export of the metrics
+ */
+struct metrics_config {
+    std::string statsd;         ///< The host:port address of the StatsD server (empty to disable)
+    std::string file;           ///< The path of the Prometheus text file (empty to disable)
+    std::string prefix = "dll"; ///< The prefix of the names of the metrics
+    size_t period      = 10000; ///< The period of the export, in milliseconds
+
+    /*!
+     * \brief Returns the configuration from the environment variables
+     */
+    static metrics_config from_env() {
+        metrics_config config;
+
+        if (auto* env = std::getenv("DLL_STATSD")) {
+            config.statsd = env;
+        }
+
+        if (auto* env = std::getenv("DLL_METRICS_FILE")) {
+            config.file = env;
+        }
+
+        if (auto* env = std::getenv("DLL_METRICS_PERIOD")) {
+            config.period = std::max<size_t>(1, std::strtoul(env, nullptr, 10));
+        }
+
+        return config;
+    }
+};
+
+/*!
+ * \brief The metrics of a training
+ */
+struct training_metrics {
+    static constexpr size_t max_latencies = 1024; ///< The number of latencies kept for the percentiles
+
+    size_t epoch      = 0;    ///< The current epoch
+    size_t batches    = 0;    ///< The total number of batches trained
+    size_t samples    = 0;    ///< The total number of samples trained
+    double throughput = 0.0;  ///< The samples per second of the last epoch
+    double error      = -1.0; ///< The training error of the last epoch or batch (-1 if unknown)
+    double loss       = -1.0; ///< The training loss of the last epoch or batch (-1 if unknown)
+    double val_error  = -1.0; ///< The validation error of the last epoch (-1 if unknown)
+    double val_loss   = -1.0; ///< The validation loss of the last epoch (-1 if unknown)
+
+    double data_wait_ms     = -1.0; ///< The time waited for the batches in the last epoch (-1 if unknown)
+    double producer_wait_ms = -1.0; ///< The time the workers of the generator waited in the last epoch (-1 if unknown)
+    double transform_ms     = -1.0; ///< The time spent transforming the samples in the last epoch (-1 if unknown)
+    double augment_ms       = -1.0; ///< The time spent augmenting the batches in the last epoch (-1 if unknown)
+
+    std::vector<double> latencies; ///< The last latencies of the batches, in milliseconds
+    size_t next_latency = 0;       ///< The next latency to replace once full
+
+    /*!
+     * \brief Add the latency of a batch
+     * \param ms The latency of the batch, in milliseconds
+     */
+    void add_latency(double ms) {
+        if (latencies.size() < max_latencies) {
+            latencies.push_back(ms);
+        } else {
+            latencies[next_latency] = ms;
+            next_latency = (next_latency + 1) % max_latencies;
+        }
+    }
+
+    /*!
+     * \brief Returns the given percentile of the last latencies, in
+     * milliseconds, or zero if there is none
+     * \param p The percentile, in [0, 1]
+     */
+    double latency_percentile(double p) const {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+
+        auto sorted = latencies;
+
+        const size_t k = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5));
+
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+
+        return sorted[k];
+    }
+};
+
+namespace metrics_detail {
+
+/*!
+ * \brief A named value exported
+ */
+struct gauge {
+    std::string name; ///< The name of the value, without prefix
+    double value;     ///< The value
+};
+
+/*!
+ * \brief Returns the name of a timer as a metric name
+ */
+inline std::string timer_name(const char* name) {
+    std::string result(name);
+
+    for (auto& c : result) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) {
+            c = '_';
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Returns all the values of the given metrics and of the timers
+ */
+inline std::vector<gauge> gauges(const training_metrics& m) {
+    std::vector<gauge> result{
+        {"epoch", double(m.epoch)},
+        {"batches_total", double(m.batches)},
+        {"samples_total", double(m.samples)},
+        {"samples_per_second", m.throughput},
+        {"batch_latency_p50_ms", m.latency_percentile(0.5)},
+        {"batch_latency_p90_ms", m.latency_percentile(0.9)},
+        {"batch_latency_p99_ms", m.latency_percentile(0.99)}};
+
+    if (m.error >= 0.0) {
+        result.push_back({"error", m.error});
+    }
+
+    if (m.loss >= 0.0) {
+        result.push_back({"loss", m.loss});
+    }
+
+    if (m.val_error >= 0.0) {
+        result.push_back({"val_error", m.val_error});
+    }
+
+    if (m.val_loss >= 0.0) {
+        result.push_back({"val_loss", m.val_loss});
+    }
+
+    if (m.data_wait_ms >= 0.0) {
+        result.push_back({"data_wait_ms", m.data_wait_ms});
+        result.push_back({"producer_wait_ms", m.producer_wait_ms});
+        result.push_back({"transform_ms", m.transform_ms});
+        result.push_back({"augment_ms", m.augment_ms});
+    }
+
+#ifndef DLL_NO_TIMERS
+    auto& timers = get_timers();
+
+    std::lock_guard<std::mutex> l(timers.lock);
+
+    for (auto& timer : timers.timers) {
+        if (timer.name) {
+            result.push_back({"timer_" + timer_name(timer.name) + "_seconds_total", timer.duration / 1e9});
+        }
+    }
+#endif
+
+    return result;
+}
+
+/*!
+ * \brief Returns the StatsD payload of the given values
+ */
+inline std::string statsd_payload(const std::string& prefix, const std::vector<gauge>& values) {
+    std::ostringstream os;
+
+    for (auto& v : values) {
+        os << prefix << "." << v.name << ":" << v.value << "|g\n";
+    }
+
+    return os.str();
+}
+
+/*!
+ * \brief Returns the Prometheus text of the given values
+ */
+inline std::string prometheus_text(const std::string& prefix, const std::vector<gauge>& values) {
+    std::ostringstream os;
+
+    for (auto& v : values) {
+        os << "# TYPE " << prefix << "_" << v.name << " gauge\n";
+        os << prefix << "_" << v.name << " " << v.value << "\n";
+    }
+
+    return os.str();
+}
+
+} //end of namespace metrics_detail
+
+/*!
+ * \brief The exporter of the metrics of a training, with its own thread
+ */
+struct metrics_exporter {
+    /*!
+     * \brief Start the exporter with the given configuration
+     */
+    explicit metrics_exporter(metrics_config config) : config(std::move(config)) {
+        if (!this->config.statsd.empty()) {
+            open_statsd();
+        }
+
+        thread = std::thread([this] { run(); });
+    }
+
+    metrics_exporter(const metrics_exporter& rhs) = delete;
+    metrics_exporter& operator=(const metrics_exporter& rhs) = delete;
+
+    /*!
+     * \brief Export the metrics a last time and stop the exporter
+     */
+    ~metrics_exporter() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop_flag = true;
+        }
+
+        condition.notify_all();
+        thread.join();
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Update the metrics with the given functor, called with the
+     * metrics, under the lock of the exporter
+     */
+    template <typename F>
+    void update(F&& f) {
+        std::lock_guard<std::mutex> l(lock);
+        f(metrics);
+    }
+
+    /*!
+     * \brief Export the metrics now, from the calling thread
+     */
+    void export_metrics() {
+        std::vector<metrics_detail::gauge> values;
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            values = metrics_detail::gauges(metrics);
+        }
+
+        if (fd >= 0) {
+            auto payload = metrics_detail::statsd_payload(config.prefix, values);
+            ::sendto(fd, payload.data(), payload.size(), 0, reinterpret_cast<const sockaddr*>(&address), address_len);
+        }
+
+        if (!config.file.empty()) {
+            const std::string tmp = config.file + ".tmp";
+
+            {
+                std::ofstream os(tmp);
+                os << metrics_detail::prometheus_text(config.prefix, values);
+            }
+
+            if (std::rename(tmp.c_str(), config.file.c_str()) != 0) {
+                std::cerr << "ERROR: Impossible to write the metrics to " << config.file << std::endl;
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Open the UDP socket to the StatsD server
+     */
+    void open_statsd() {
+        auto colon = config.statsd.rfind(':');
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* resolved = nullptr;
+
+        if (colon == std::string::npos
+            || ::getaddrinfo(config.statsd.substr(0, colon).c_str(), config.statsd.substr(colon + 1).c_str(), &hints, &resolved) != 0) {
+            std::cerr << "ERROR: Invalid StatsD address " << config.statsd << std::endl;
+            return;
+        }
+
+        fd = ::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open the StatsD socket" << std::endl;
+        }
+
+        std::memcpy(&address, resolved->ai_addr, resolved->ai_addrlen);
+        address_len = resolved->ai_addrlen;
+
+        ::freeaddrinfo(resolved);
+    }
+
+    /*!
+     * \brief The main function of the exporter thread
+     */
+    void run() {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        while (true) {
+            const bool stopping = condition.wait_for(ulock, std::chrono::milliseconds(config.period), [this] { return stop_flag; });
+
+            ulock.unlock();
+            export_metrics();
+            ulock.lock();
+
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    const metrics_config config;       ///< The configuration
+    training_metrics metrics;          ///< The current metrics
+    std::mutex lock;                   ///< The lock protecting the metrics
+    std::condition_variable condition; ///< The condition to wake the exporter thread
+    bool stop_flag = false;            ///< Indicates to the exporter thread to stop
+    int fd         = -1;               ///< The StatsD socket, if any
+    sockaddr_storage address;          ///< The address of the StatsD server
+    socklen_t address_len = 0;         ///< The length of the address of the StatsD server
+    std::thread thread;                ///< The exporter thread
+};
+
+} //end of dll namespace
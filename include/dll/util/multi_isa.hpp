@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime dispatch of the kernels of DLL on the instruction set of
+ * the processor.
+ *
+ * When DLL_MULTI_ISA is defined, the kernels marked with
+ * DLL_MULTI_VERSION are compiled several times, for AVX-512 (Skylake-SP),
+ * for AVX2 (Haswell / Broadwell) and for the baseline of the build, and
+ * the best version for the processor is selected once, when the program
+ * is loaded. The bit-packed kernels, marked with DLL_MULTI_VERSION_POPCNT,
+ * are compiled with and without the popcnt instruction. This needs GCC on
+ * x86-64 with the GNU indirect functions.
+ *
+ * The baseline of aarch64 already includes NEON, the kernels are
+ * compiled only once on ARM.
+ */
+
+#pragma once
+
+#include <string>
+
+#if defined(DLL_MULTI_ISA) && defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER) && defined(__x86_64__) && defined(__ELF__) && !defined(__AVX512F__)
+#define DLL_MULTI_VERSION __attribute__((target_clones("avx512f", "avx2", "default")))
+#define DLL_MULTI_VERSION_POPCNT __attribute__((target_clones("popcnt", "default")))
+#define DLL_MULTI_VERSIONED
+#else
+#define DLL_MULTI_VERSION
+#define DLL_MULTI_VERSION_POPCNT
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Return the name of the instruction set the kernels of DLL use on
+ * this processor
+ */
+inline std::string kernels_isa() {
+#if defined(DLL_MULTI_VERSIONED)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+
+    return "default";
+#elif defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return "neon";
+#else
+    return "default";
+#endif
+}
+
+} //end of dll namespace
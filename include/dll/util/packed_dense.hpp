@@ -0,0 +1,126 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Pre-packed weights of the dense layers for the small batches.
+ *
+ * The weights of the dense layers (V x H) are stored input-major, which
+ * makes the product of one sample (a GEMV) stride through all the weights
+ * for each input. At inference, the weights are packed once, transposed
+ * (H x V), so that each output is the dot product of a contiguous row of
+ * weights with the samples. Each row is read once from memory for all the
+ * samples of the batch, the other samples reading it from the cache. This
+ * is only used for batches of at most packed_max_batch samples, the larger
+ * batches being computed with a matrix multiplication.
+ */
+
+#pragma once
+
+#include "etl/etl.hpp"
+
+#include "dll/util/direct.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/multi_isa.hpp"
+#include "dll/util/huge_pages.hpp"
+
+namespace dll {
+
+constexpr size_t packed_max_batch = 8; ///< The maximum number of samples computed with the packed weights
+
+namespace packed_detail {
+
+constexpr size_t parallel_threshold = 64 * 1024; ///< The minimum number of weights to compute the outputs in parallel
+
+/*!
+ * \brief Compute the output o of each sample of y (B x H) = x (B x V) * w
+ * with the packed weights wt (H x V)
+ */
+template <typename T>
+DLL_MULTI_VERSION void packed_mul_output(T* y, const T* x, const T* wt, size_t B, size_t V, size_t H, size_t o) {
+    const T* wr = wt + o * V;
+
+    for (size_t s = 0; s < B; ++s) {
+        const T* xs = x + s * V;
+
+        T sum(0);
+
+        for (size_t i = 0; i < V; ++i) {
+            sum += wr[i] * xs[i];
+        }
+
+        y[s * H + o] = sum;
+    }
+}
+
+/*!
+ * \brief Compute y (B x H) = x (B x V) * w with the packed weights
+ * wt (H x V)
+ */
+template <typename T>
+void packed_mul(T* y, const T* x, const T* wt, size_t B, size_t V, size_t H) {
+    auto row = [&](size_t o) {
+        packed_mul_output(y, x, wt, B, V, H, o);
+    };
+
+    if (V * H >= parallel_threshold) {
+        parallel_for_n(H, row);
+    } else {
+        for (size_t o = 0; o < H; ++o) {
+            row(o);
+        }
+    }
+}
+
+} //end of namespace packed_detail
+
+/*!
+ * \brief The weights of a dense layer packed for the small batches
+ */
+template <typename T>
+struct packed_dense_weights {
+    etl::dyn_matrix<T, 2> wt; ///< The transposed weights (H x V)
+
+    /*!
+     * \brief Pack the given weights (V x H)
+     */
+    template <typename W>
+    explicit packed_dense_weights(const W& w) : wt(etl::dim<1>(w), etl::dim<0>(w)) {
+        advise_huge_pages(wt);
+
+        wt = etl::transpose(w);
+    }
+
+    /*!
+     * \brief Compute output = input * w for a batch of at most
+     * packed_max_batch samples.
+     *
+     * \param output The batch of output (B x H)
+     * \param input The batch of input (B x V), or any shape of B x V values
+     * \return true if the product was computed, false if the batch is too large
+     */
+    template <typename O, typename I>
+    bool mul(O&& output, const I& input) const {
+        const size_t B = etl::dim<0>(input);
+
+        if (B > packed_max_batch) {
+            return false;
+        }
+
+        decltype(auto) x = direct_memory(input);
+
+        dll::host_read(x, wt);
+
+        packed_detail::packed_mul(output.memory_start(), x.memory_start(), wt.memory_start(), B, etl::dim<1>(wt), etl::dim<0>(wt));
+
+        dll::host_written(output);
+
+        return true;
+    }
+};
+
+} //end of dll namespace
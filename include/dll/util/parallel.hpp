@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel loop for the kernels of the layers
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/scheduler.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Call the functor for each index in [0, n), splitting the range
+ * in contiguous parts over at most concurrency() threads.
+ *
+ * The parts are run by the workers of the scheduler, the current thread
+ * running the first part and then helping with the other tasks of the
+ * scheduler until all the parts are done. The loops can therefore be
+ * nested. The functor must be safe to call concurrently for different
+ * indices.
+ *
+ * \param n The number of indices
+ * \param functor The functor to call for each index
+ */
+template <typename Functor>
+void parallel_for_n(size_t n, Functor&& functor) {
+    const size_t T = std::max<size_t>(1, std::min<size_t>(n, concurrency()));
+
+    auto worker = [&functor, n, T](size_t t) {
+        for (size_t i = (t * n) / T; i < ((t + 1) * n) / T; ++i) {
+            functor(i);
+        }
+    };
+
+    if (T == 1) {
+        worker(0);
+        return;
+    }
+
+    auto& s = scheduler();
+
+    std::atomic<size_t> remaining(T - 1);
+
+    for (size_t t = 1; t < T; ++t) {
+        s.push([&worker, &remaining, t] {
+            worker(t);
+            --remaining;
+        });
+    }
+
+    worker(0);
+
+    while (remaining) {
+        if (!s.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,350 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous parameter server for multi-node training.
+ *
+ * Rank 0 holds the reference copy of the parameters. Each rank trains
+ * its own copy and periodically pushes the changes made since its last
+ * synchronization, then pulls the reference parameters. The ranks never
+ * wait for each other, except at the end of the training.
+ *
+ * The address of the server is given by the DLL_SERVER (host:port)
+ * environment variable, in addition to DLL_RANK and DLL_PEERS.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "dll/util/distributed.hpp"
+
+namespace dll {
+
+namespace distributed {
+
+/*!
+ * \brief Synchronization of a set of parameters with the parameter server.
+ *
+ * The changes are sent as sparse (index, value) pairs when less than a
+ * quarter of the parameters have changed, dense otherwise.
+ */
+template <typename T>
+struct parameter_sync {
+    /*!
+     * \brief The messages sent to the server
+     */
+    enum class message : uint32_t {
+        PUSH_DENSE,  ///< Dense changes, followed by the new parameters
+        PUSH_SPARSE, ///< Sparse changes, followed by the new parameters
+        DONE         ///< End of the training, followed by the final parameters
+    };
+
+    /*!
+     * \brief Connect to the parameter server, the parameters being
+     * replaced by the ones of the server.
+     *
+     * \param parameters The memory and size of each parameter
+     * \param period The number of batches between two synchronizations
+     */
+    parameter_sync(std::vector<std::pair<T*, size_t>> parameters, size_t period) : parameters(std::move(parameters)), period(period) {
+        if (!distributed::active()) {
+            return;
+        }
+
+        const char* server_env = std::getenv("DLL_SERVER");
+
+        if (!server_env) {
+            std::cerr << "ERROR: DLL_SERVER is not set, the pretraining is not distributed" << std::endl;
+            return;
+        }
+
+        size_t n = 0;
+        for (auto& p : this->parameters) {
+            n += p.second;
+        }
+
+        base.resize(n);
+        gather(base.data());
+
+        if (distributed::is_root()) {
+            reference = base;
+
+            listen_fd = detail::listen_socket(server_env, distributed::world());
+
+            if (listen_fd < 0) {
+                std::cerr << "ERROR: Impossible to listen on " << server_env << std::endl;
+                std::abort();
+            }
+
+            server = std::thread([this] { accept_workers(); });
+        } else {
+            server_fd = detail::connect_socket(server_env);
+
+            if (server_fd < 0) {
+                std::cerr << "ERROR: Impossible to connect to the parameter server " << server_env << std::endl;
+                std::abort();
+            }
+
+            detail::no_delay(server_fd);
+
+            // Start from the parameters of the server
+            detail::receive_all(server_fd, base.data(), n * sizeof(T));
+            scatter(base.data());
+        }
+
+        enabled = true;
+    }
+
+    parameter_sync(const parameter_sync& rhs) = delete;
+    parameter_sync& operator=(const parameter_sync& rhs) = delete;
+
+    /*!
+     * \brief Wait for the end of the training of all the ranks
+     */
+    ~parameter_sync() {
+        finish();
+    }
+
+    /*!
+     * \brief Indicates that a batch has been trained, synchronizing the
+     * parameters every period batches
+     */
+    void batch_end() {
+        if (enabled && ++batches % period == 0) {
+            synchronize(message::PUSH_DENSE);
+        }
+    }
+
+    /*!
+     * \brief Push the last changes and wait for all the ranks to finish
+     * their training, the parameters being replaced with the final
+     * parameters of the server.
+     */
+    void finish() {
+        if (!enabled) {
+            return;
+        }
+
+        enabled = false;
+
+        synchronize(message::DONE);
+
+        if (distributed::is_root()) {
+            {
+                std::unique_lock<std::mutex> l(lock);
+                condition.wait(l, [this] { return done == distributed::world() - 1; });
+            }
+
+            server.join();
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+            ::close(listen_fd);
+
+            scatter(reference.data());
+        } else {
+            ::close(server_fd);
+        }
+    }
+
+private:
+    /*!
+     * \brief Copy the parameters into the given buffer
+     */
+    void gather(T* out) const {
+        for (auto& p : parameters) {
+            std::copy(p.first, p.first + p.second, out);
+            out += p.second;
+        }
+    }
+
+    /*!
+     * \brief Copy the given buffer into the parameters
+     */
+    void scatter(const T* in) const {
+        for (auto& p : parameters) {
+            std::copy(in, in + p.second, p.first);
+            in += p.second;
+        }
+    }
+
+    /*!
+     * \brief Push the changes since the last synchronization and pull the
+     * parameters of the server
+     */
+    void synchronize(message type) {
+        const size_t n = base.size();
+
+        // The changes since the last synchronization, in place
+        std::vector<T> current(n);
+        gather(current.data());
+
+        size_t changed = 0;
+        for (size_t i = 0; i < n; ++i) {
+            base[i] = current[i] - base[i];
+            changed += base[i] != T(0);
+        }
+
+        if (distributed::is_root()) {
+            std::lock_guard<std::mutex> l(lock);
+
+            for (size_t i = 0; i < n; ++i) {
+                reference[i] += base[i];
+            }
+
+            base = reference;
+        } else {
+            const bool sparse = type != message::DONE && changed < n / 4;
+
+            uint32_t header[2] = {uint32_t(type == message::DONE ? message::DONE : sparse ? message::PUSH_SPARSE : message::PUSH_DENSE), uint32_t(changed)};
+            detail::send_all(server_fd, header, sizeof(header));
+
+            if (sparse) {
+                std::vector<uint32_t> indices;
+                std::vector<T> values;
+
+                indices.reserve(changed);
+                values.reserve(changed);
+
+                for (size_t i = 0; i < n; ++i) {
+                    if (base[i] != T(0)) {
+                        indices.push_back(i);
+                        values.push_back(base[i]);
+                    }
+                }
+
+                detail::send_all(server_fd, indices.data(), changed * sizeof(uint32_t));
+                detail::send_all(server_fd, values.data(), changed * sizeof(T));
+            } else {
+                detail::send_all(server_fd, base.data(), n * sizeof(T));
+            }
+
+            detail::receive_all(server_fd, base.data(), n * sizeof(T));
+        }
+
+        scatter(base.data());
+    }
+
+    /*!
+     * \brief Accept the connections of all the other ranks (server only)
+     */
+    void accept_workers() {
+        for (size_t r = 1; r < distributed::world(); ++r) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+
+            if (fd < 0) {
+                std::cerr << "ERROR: Impossible to accept a rank on the parameter server" << std::endl;
+                std::abort();
+            }
+
+            detail::no_delay(fd);
+
+            workers.emplace_back([this, fd] { serve(fd); });
+        }
+    }
+
+    /*!
+     * \brief Serve the requests of one rank (server only)
+     */
+    void serve(int fd) {
+        const size_t n = reference.size();
+
+        std::vector<T> values(n);
+        std::vector<uint32_t> indices;
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            values = reference;
+        }
+
+        detail::send_all(fd, values.data(), n * sizeof(T));
+
+        while (true) {
+            uint32_t header[2];
+            detail::receive_all(fd, header, sizeof(header));
+
+            const auto type    = message(header[0]);
+            const auto changed = header[1];
+
+            if (type == message::PUSH_SPARSE) {
+                indices.resize(changed);
+                detail::receive_all(fd, indices.data(), changed * sizeof(uint32_t));
+                detail::receive_all(fd, values.data(), changed * sizeof(T));
+
+                std::lock_guard<std::mutex> l(lock);
+
+                for (size_t i = 0; i < changed; ++i) {
+                    reference[indices[i]] += values[i];
+                }
+
+                values = reference;
+            } else {
+                detail::receive_all(fd, values.data(), n * sizeof(T));
+
+                std::lock_guard<std::mutex> l(lock);
+
+                for (size_t i = 0; i < n; ++i) {
+                    reference[i] += values[i];
+                }
+
+                values = reference;
+            }
+
+            if (type == message::DONE) {
+                std::unique_lock<std::mutex> l(lock);
+
+                ++done;
+                condition.notify_all();
+
+                // The final parameters are sent once all the ranks are done
+                condition.wait(l, [this] { return done == distributed::world() - 1; });
+
+                values = reference;
+
+                l.unlock();
+
+                detail::send_all(fd, values.data(), n * sizeof(T));
+
+                ::close(fd);
+
+                return;
+            }
+
+            detail::send_all(fd, values.data(), n * sizeof(T));
+        }
+    }
+
+    std::vector<std::pair<T*, size_t>> parameters; ///< The parameters to synchronize
+    const size_t period;                          ///< The number of batches between two synchronizations
+
+    bool enabled   = false; ///< Indicates if the parameters are synchronized
+    size_t batches = 0;     ///< The number of batches since the start
+    std::vector<T> base;    ///< The parameters at the last synchronization
+
+    int server_fd = -1; ///< The socket to the server (other ranks)
+
+    int listen_fd = -1;                 ///< The listening socket (server only)
+    std::vector<T> reference;           ///< The reference parameters (server only)
+    std::thread server;                 ///< The thread accepting the ranks (server only)
+    std::vector<std::thread> workers;   ///< The thread serving each rank (server only)
+    std::mutex lock;                    ///< The lock protecting the reference parameters
+    std::condition_variable condition;  ///< Signals the end of the training of a rank
+    size_t done = 0;                    ///< The number of ranks that are done (server only)
+};
+
+} //end of namespace distributed
+
+} //end of dll namespace
@@ -0,0 +1,172 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Hardware performance counters (Linux perf_event_open)
+ *
+ * The counters are opened on the calling thread only. When the counters
+ * are not available (other systems, perf_event_paranoid, virtual
+ * machines), they are simply reported as unavailable.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "cpp_utils/assert.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The hardware counters that can be read
+ */
+enum class perf_counter : size_t {
+    CYCLES       = 0, ///< CPU cycles
+    INSTRUCTIONS = 1, ///< Retired instructions
+    LLC_MISSES   = 2, ///< Last Level Cache misses
+    FLOPS        = 3  ///< Floating point operations (raw, model-specific, event)
+};
+
+/*!
+ * \brief The number of hardware counters
+ */
+constexpr size_t perf_counters_n = 4;
+
+/*!
+ * \brief The values of all the hardware counters
+ */
+using perf_values = std::array<uint64_t, perf_counters_n>;
+
+/*!
+ * \brief Get a reference to the raw event used to count the floating
+ * point operations (zero to disable the counter).
+ *
+ * This must be set before the counters are opened.
+ */
+inline uint64_t& perf_flops_event() {
+    static uint64_t event = 0;
+    return event;
+}
+
+/*!
+ * \brief A set of hardware performance counters on the current thread
+ */
+struct perf_counters {
+    std::array<int, perf_counters_n> fds; ///< The file descriptors of the counters (-1 if unavailable)
+
+    /*!
+     * \brief Open the counters.
+     *
+     * There is no portable event for floating point operations, therefore
+     * it has to be given as a raw event of the CPU (for instance
+     * FP_ARITH_INST_RETIRED on recent Intel processors). When flops_event
+     * is zero, the FLOPS counter is not opened.
+     *
+     * \param flops_event The raw event configuration counting the floating point operations
+     */
+    explicit perf_counters(uint64_t flops_event = perf_flops_event()) {
+        fds.fill(-1);
+
+#ifdef __linux__
+        fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+        if (flops_event) {
+            fds[3] = open_counter(PERF_TYPE_RAW, flops_event);
+        }
+#else
+        cpp_unused(flops_event);
+#endif
+    }
+
+    perf_counters(const perf_counters& rhs) = delete;
+    perf_counters& operator=(const perf_counters& rhs) = delete;
+
+    /*!
+     * \brief Close the counters
+     */
+    ~perf_counters() {
+#ifdef __linux__
+        for (auto fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    /*!
+     * \brief Indicates if the given counter could be opened
+     */
+    bool available(perf_counter counter) const {
+        return fds[size_t(counter)] >= 0;
+    }
+
+    /*!
+     * \brief Indicates if at least one counter could be opened
+     */
+    bool any_available() const {
+        for (auto fd : fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Read the current value of all the counters (zero for the
+     * unavailable ones)
+     */
+    perf_values read() const {
+        perf_values values;
+        values.fill(0);
+
+#ifdef __linux__
+        for (size_t i = 0; i < perf_counters_n; ++i) {
+            if (fds[i] >= 0) {
+                uint64_t value = 0;
+
+                if (::read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+                    values[i] = value;
+                }
+            }
+        }
+#endif
+
+        return values;
+    }
+
+private:
+#ifdef __linux__
+    static int open_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+
+        return int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+};
+
+} //end of dll namespace
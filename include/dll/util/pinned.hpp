@@ -0,0 +1,105 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Page-locked (pinned) host memory for the batches copied to the
+ * device.
+ *
+ * The memory of an existing container is registered with the CUDA driver,
+ * so that its copies to the device are direct and can be asynchronous.
+ * Without GPU (ETL_GPU), nothing is registered and the memory stays
+ * pageable.
+ */
+
+#pragma once
+
+#include <iostream>
+
+#ifdef ETL_GPU
+#include <cuda_runtime.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief A registration of host memory as page-locked, released when
+ * destroyed.
+ *
+ * The registered memory must outlive the registration.
+ */
+struct pinned_memory {
+    pinned_memory() = default;
+
+    pinned_memory(const pinned_memory& rhs) = delete;
+    pinned_memory& operator=(const pinned_memory& rhs) = delete;
+
+    /*!
+     * \brief Release the registration, if any
+     */
+    ~pinned_memory() {
+        unpin();
+    }
+
+    /*!
+     * \brief Register the memory of the given container.
+     *
+     * If the registration fails, the memory stays pageable and a warning
+     * is printed.
+     */
+    template <typename C>
+    void pin(C& container) {
+        pin(container.memory_start(), etl::size(container) * sizeof(etl::value_t<C>));
+    }
+
+    /*!
+     * \brief Register the given memory.
+     * \param p The start of the memory
+     * \param bytes The size of the memory, in bytes
+     */
+    void pin(void* p, size_t bytes) {
+        unpin();
+
+#ifdef ETL_GPU
+        if (p && bytes) {
+            if (cudaHostRegister(p, bytes, cudaHostRegisterPortable) == cudaSuccess) {
+                memory = p;
+            } else {
+                std::cerr << "WARNING: Impossible to pin " << bytes << " bytes, the batches stay in pageable memory" << std::endl;
+            }
+        }
+#else
+        cpp_unused(p);
+        cpp_unused(bytes);
+#endif
+    }
+
+    /*!
+     * \brief Release the registration, if any
+     */
+    void unpin() {
+#ifdef ETL_GPU
+        if (memory) {
+            cudaHostUnregister(memory);
+        }
+#endif
+
+        memory = nullptr;
+    }
+
+    /*!
+     * \brief Indicates if the memory is page-locked
+     */
+    bool pinned() const {
+        return memory != nullptr;
+    }
+
+private:
+    void* memory = nullptr; ///< The registered memory, if any
+};
+
+} //end of dll namespace
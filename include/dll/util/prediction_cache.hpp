@@ -0,0 +1,279 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bounded cache of the results of the predictions of a network
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+namespace dll {
+
+/*!
+ * \brief Return a fast 64 bits hash of the given memory
+ * \param data The memory to hash
+ * \param bytes The size of the memory, in bytes
+ */
+inline uint64_t hash_memory(const void* data, size_t bytes) {
+    const auto* p = static_cast<const char*>(data);
+
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ bytes;
+
+    auto mix = [&h](uint64_t w) {
+        w *= 0xBF58476D1CE4E5B9ULL;
+        w ^= w >> 31;
+
+        h ^= w;
+        h = (h << 27 | h >> 37) * 0x94D049BB133111EBULL;
+    };
+
+    size_t i = 0;
+
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        mix(w);
+    }
+
+    if (i < bytes) {
+        uint64_t w = 0;
+        std::memcpy(&w, p + i, bytes - i);
+        mix(w);
+    }
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/*!
+ * \brief A bounded, concurrent, cache of the results of a network.
+ *
+ * The results are keyed by the hash of their input and by the version of
+ * the weights of the network they were computed with. The entries are
+ * distributed over independent shards, each with its own lock and its
+ * own least-recently-used eviction, so that the concurrent lookups rarely
+ * contend. All the entries are dropped as soon as a new version of the
+ * weights is seen.
+ *
+ * Only the hashes of the inputs are kept, two inputs with the same 64
+ * bits hash share their result.
+ *
+ * \tparam Value The type of the cached results
+ */
+template <typename Value>
+struct prediction_cache {
+    static constexpr size_t shards = 16; ///< The number of shards
+
+    /*!
+     * \brief Create a cache of at most the given number of results
+     * \param capacity The maximum number of cached results
+     */
+    explicit prediction_cache(size_t capacity)
+            : shard_capacity(std::max(size_t(1), (capacity + shards - 1) / shards)), storage(shards) {}
+
+    /*!
+     * \brief Look for the result of the given key
+     * \param key The hash of the input
+     * \param version The version of the weights of the network
+     * \param value The result, set on hit
+     * \return true if the result was found, false otherwise
+     */
+    bool get(uint64_t key, size_t version, Value& value) {
+        refresh(version);
+
+        auto& shard = shard_of(key);
+
+        {
+            std::lock_guard<std::mutex> l(shard.lock);
+
+            shard.update(version);
+
+            auto it = shard.index.find(key);
+
+            if (it != shard.index.end()) {
+                // Move the entry to the front of the LRU list
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+
+                value = it->second->second;
+
+                ++hits;
+
+                return true;
+            }
+        }
+
+        ++misses;
+
+        return false;
+    }
+
+    /*!
+     * \brief Insert the result of the given key, evicting the least
+     * recently used result of its shard if necessary
+     * \param key The hash of the input
+     * \param version The version of the weights the result was computed with
+     * \param value The result
+     */
+    void put(uint64_t key, size_t version, const Value& value) {
+        refresh(version);
+
+        auto& shard = shard_of(key);
+
+        std::lock_guard<std::mutex> l(shard.lock);
+
+        shard.update(version);
+
+        // The result of an older version of the weights is not kept
+        if (shard.version != version) {
+            return;
+        }
+
+        auto it = shard.index.find(key);
+
+        if (it != shard.index.end()) {
+            it->second->second = value;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+
+        if (shard.entries.size() >= shard_capacity) {
+            shard.index.erase(shard.entries.back().first);
+            shard.entries.pop_back();
+        }
+
+        shard.entries.emplace_front(key, value);
+        shard.index[key] = shard.entries.begin();
+    }
+
+    /*!
+     * \brief Remove all the cached results
+     */
+    void clear() {
+        for (auto& shard : storage) {
+            std::lock_guard<std::mutex> l(shard.lock);
+
+            shard.entries.clear();
+            shard.index.clear();
+        }
+    }
+
+    /*!
+     * \brief Return the number of cached results
+     */
+    size_t size() const {
+        size_t n = 0;
+
+        for (auto& shard : storage) {
+            std::lock_guard<std::mutex> l(shard.lock);
+            n += shard.entries.size();
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Return the maximum number of cached results
+     */
+    size_t capacity() const {
+        return shard_capacity * shards;
+    }
+
+    /*!
+     * \brief Return the number of lookups that found their result
+     */
+    size_t hit_count() const {
+        return hits;
+    }
+
+    /*!
+     * \brief Return the number of lookups that did not find their result
+     */
+    size_t miss_count() const {
+        return misses;
+    }
+
+    /*!
+     * \brief Return the ratio of the lookups that found their result
+     */
+    double hit_rate() const {
+        const size_t h = hits;
+        const size_t m = misses;
+
+        return h + m ? double(h) / double(h + m) : 0.0;
+    }
+
+private:
+    using entry_t = std::pair<uint64_t, Value>; ///< A cached result with its key
+
+    /*!
+     * \brief An independent part of the cache
+     */
+    struct shard_t {
+        std::list<entry_t> entries;                                                ///< The entries, from the most to the least recently used
+        std::unordered_map<uint64_t, typename std::list<entry_t>::iterator> index; ///< The entries by key
+        size_t version = 0;                                                        ///< The version of the weights of the entries
+        mutable std::mutex lock;                                                   ///< The lock protecting the shard
+
+        /*!
+         * \brief Drop the entries of the shard if they were computed with
+         * an older version of the weights
+         */
+        void update(size_t new_version) {
+            if (new_version > version) {
+                entries.clear();
+                index.clear();
+                version = new_version;
+            }
+        }
+    };
+
+    /*!
+     * \brief Drop all the entries if the given version of the weights is
+     * newer than the version of the entries
+     */
+    void refresh(size_t version) {
+        size_t seen = latest;
+
+        while (version > seen) {
+            if (latest.compare_exchange_weak(seen, version)) {
+                for (auto& shard : storage) {
+                    std::lock_guard<std::mutex> l(shard.lock);
+                    shard.update(version);
+                }
+
+                return;
+            }
+        }
+    }
+
+    shard_t& shard_of(uint64_t key) {
+        return storage[(key >> 32) % shards];
+    }
+
+    const size_t shard_capacity;   ///< The maximum number of entries of each shard
+    std::vector<shard_t> storage;  ///< The shards
+    std::atomic<size_t> hits{0};   ///< The number of hits
+    std::atomic<size_t> misses{0}; ///< The number of misses
+    std::atomic<size_t> latest{0}; ///< The newest version of the weights seen by the cache
+};
+
+} //end of dll namespace
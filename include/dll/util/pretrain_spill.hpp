@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Keys and paths of the persisted pretraining of a DBN.
+ *
+ * When the pretraining directory of a DBN is set, the weights of each
+ * pretrained layer and the outputs of each layer are stored in that
+ * directory. The files of a layer are named after a key chaining the key
+ * of its input with the weights of the layer: the weights of layer I are
+ * keyed by its input and its outputs by its input and its weights. A
+ * resumed or repeated pretraining therefore reloads the weights of the
+ * layers already trained on the same input and reads the outputs already
+ * computed for the same weights, instead of computing them again.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <fstream>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace spill_detail {
+
+constexpr uint64_t fnv_offset = 14695981039346656037ULL; ///< The offset basis of the FNV-1a hash
+constexpr uint64_t fnv_prime  = 1099511628211ULL;        ///< The prime of the FNV-1a hash
+
+} //end of namespace spill_detail
+
+/*!
+ * \brief Chain the given bytes to the given key (FNV-1a)
+ */
+inline uint64_t spill_hash(uint64_t key, const void* data, size_t bytes) {
+    const auto* p = static_cast<const unsigned char*>(data);
+
+    uint64_t h = key ^ spill_detail::fnv_offset;
+
+    for (size_t i = 0; i < bytes; ++i) {
+        h = (h ^ p[i]) * spill_detail::fnv_prime;
+    }
+
+    return h;
+}
+
+/*!
+ * \brief Chain the given value to the given key
+ */
+inline uint64_t spill_hash(uint64_t key, uint64_t value) {
+    return spill_hash(key, &value, sizeof(value));
+}
+
+/*!
+ * \brief Compute the key of the input of the first layer from its size
+ * and its first batch
+ */
+template <typename Generator>
+uint64_t spill_input_key(Generator& generator) {
+    generator.reset();
+    generator.set_test();
+
+    auto first = etl::force_temporary(generator.data_batch());
+
+    uint64_t key = spill_hash(0, generator.size());
+
+    for (auto value : first) {
+        key = spill_hash(key, &value, sizeof(value));
+    }
+
+    return key;
+}
+
+/*!
+ * \brief Chain the weights of the given layer to the given key
+ */
+template <typename Layer>
+uint64_t spill_layer_key(uint64_t key, const Layer& layer) {
+    std::ostringstream os;
+    layer.store(os);
+
+    const auto weights = os.str();
+
+    return spill_hash(key, weights.data(), weights.size());
+}
+
+/*!
+ * \brief Return the path of a persisted file of the pretraining
+ * \param directory The pretraining directory
+ * \param layer The index of the layer
+ * \param key The key of the file
+ * \param extension The extension of the file
+ */
+inline std::string spill_path(const std::string& directory, size_t layer, uint64_t key, const char* extension) {
+    char name[64];
+    snprintf(name, 64, "/layer_%lu_%016lx.%s", layer, static_cast<unsigned long>(key), extension);
+    return directory + name;
+}
+
+/*!
+ * \brief Indicates if the given file exists
+ */
+inline bool spill_exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+} //end of dll namespace
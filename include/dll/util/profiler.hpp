@@ -0,0 +1,297 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Event profiler with per-thread buffers and per-layer attribution
+ *
+ * When profiling is started, each auto_timer records one event (name,
+ * layer, start and duration in nanoseconds) in a buffer local to its
+ * thread instead of updating the shared timers. The layer is the index of
+ * the layer of the network that is being computed by the thread, or -1
+ * if the event is not inside a layer.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+namespace dll {
+
+/*!
+ * \brief One event recorded by the profiler
+ */
+struct profiler_event {
+    const char* name;  ///< The name of the timer
+    int layer;         ///< The index of the layer (-1 if not in a layer)
+    uint64_t start;    ///< The start time (ns since the start of profiling)
+    uint64_t duration; ///< The duration (ns)
+};
+
+/*!
+ * \brief The buffer of events of one thread
+ */
+struct profiler_buffer {
+    size_t thread;                       ///< The index of the thread
+    std::mutex lock;                     ///< The lock, only contended while exporting
+    std::vector<profiler_event> events; ///< The recorded events
+
+    explicit profiler_buffer(size_t thread) : thread(thread) {}
+};
+
+/*!
+ * \brief The state of the profiler
+ */
+struct profiler_t {
+    std::atomic<bool> enabled{false};                       ///< Indicates if profiling is active
+    std::chrono::steady_clock::time_point epoch;            ///< The start of profiling
+    std::mutex lock;                                        ///< The lock protecting the buffers list
+    std::vector<std::shared_ptr<profiler_buffer>> buffers; ///< The buffers of all the threads
+};
+
+/*!
+ * \brief Get a reference to the profiler
+ */
+inline profiler_t& get_profiler() {
+    static profiler_t profiler;
+    return profiler;
+}
+
+/*!
+ * \brief Get the buffer of events of the current thread.
+ *
+ * The buffer is registered on the first use and is kept alive by the
+ * profiler after the end of the thread, until it is exported.
+ */
+inline profiler_buffer& local_profiler_buffer() {
+    thread_local std::shared_ptr<profiler_buffer> buffer = [] {
+        auto& profiler = get_profiler();
+
+        std::lock_guard<std::mutex> l(profiler.lock);
+
+        profiler.buffers.push_back(std::make_shared<profiler_buffer>(profiler.buffers.size()));
+        return profiler.buffers.back();
+    }();
+
+    return *buffer;
+}
+
+/*!
+ * \brief Get the index of the layer currently computed by this thread
+ */
+inline int& current_profiled_layer() {
+    thread_local int layer = -1;
+    return layer;
+}
+
+/*!
+ * \brief A listener of the changes of the layer computed by a thread
+ */
+struct layer_listener {
+    /*!
+     * \brief Indicates that the thread switches from one layer to another
+     * \param from The index of the previous layer (-1 if none)
+     * \param to The index of the next layer (-1 if none)
+     */
+    virtual void switch_layer(int from, int to) = 0;
+
+    virtual ~layer_listener() = default;
+};
+
+/*!
+ * \brief Get the listener of the layer changes of this thread (nullptr if none)
+ */
+inline layer_listener*& current_layer_listener() {
+    thread_local layer_listener* listener = nullptr;
+    return listener;
+}
+
+/*!
+ * \brief Attribute the events of the current thread to the given layer,
+ * until the end of the scope.
+ */
+struct profile_layer {
+    int previous; ///< The previous layer of the thread
+
+    /*!
+     * \brief Enter the given layer
+     * \param layer The index of the layer
+     */
+    explicit profile_layer(size_t layer) : previous(current_profiled_layer()) {
+        current_profiled_layer() = layer;
+
+        if (auto* listener = current_layer_listener()) {
+            listener->switch_layer(previous, layer);
+        }
+    }
+
+    /*!
+     * \brief Leave the layer
+     */
+    ~profile_layer() {
+        if (auto* listener = current_layer_listener()) {
+            listener->switch_layer(current_profiled_layer(), previous);
+        }
+
+        current_profiled_layer() = previous;
+    }
+
+    profile_layer(const profile_layer& rhs) = delete;
+    profile_layer& operator=(const profile_layer& rhs) = delete;
+};
+
+/*!
+ * \brief Indicates if the profiler is recording events
+ */
+inline bool is_profiling() {
+    return get_profiler().enabled.load(std::memory_order_acquire);
+}
+
+/*!
+ * \brief Discard all the recorded events
+ */
+inline void reset_profiling() {
+    auto& profiler = get_profiler();
+
+    std::lock_guard<std::mutex> l(profiler.lock);
+
+    for (auto& buffer : profiler.buffers) {
+        std::lock_guard<std::mutex> bl(buffer->lock);
+        buffer->events.clear();
+    }
+}
+
+/*!
+ * \brief Start recording events, discarding the previous ones
+ */
+inline void start_profiling() {
+    reset_profiling();
+
+    get_profiler().epoch = std::chrono::steady_clock::now();
+    get_profiler().enabled = true;
+}
+
+/*!
+ * \brief Stop recording events
+ */
+inline void stop_profiling() {
+    get_profiler().enabled = false;
+}
+
+/*!
+ * \brief Record an event in the buffer of the current thread
+ * \param name The name of the event
+ * \param start The start time of the event
+ * \param end The end time of the event
+ */
+inline void record_profile(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    auto& buffer = local_profiler_buffer();
+
+    const uint64_t begin    = std::chrono::duration_cast<std::chrono::nanoseconds>(start - get_profiler().epoch).count();
+    const uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    std::lock_guard<std::mutex> l(buffer.lock);
+    buffer.events.push_back({name, current_profiled_layer(), begin, duration});
+}
+
+/*!
+ * \brief Call the functor on each recorded event, with the index of its
+ * thread
+ */
+template <typename Functor>
+void for_each_profile_event(Functor&& functor) {
+    auto& profiler = get_profiler();
+
+    std::lock_guard<std::mutex> l(profiler.lock);
+
+    for (auto& buffer : profiler.buffers) {
+        std::lock_guard<std::mutex> bl(buffer->lock);
+
+        for (auto& event : buffer->events) {
+            functor(buffer->thread, event);
+        }
+    }
+}
+
+/*!
+ * \brief Export the recorded events in the Chrome trace format (JSON),
+ * which can be opened with chrome://tracing
+ * \param os The stream to write to
+ */
+inline void export_chrome_trace(std::ostream& os) {
+    os << "{\"traceEvents\":[";
+
+    bool first = true;
+
+    for_each_profile_event([&](size_t thread, const profiler_event& event) {
+        os << (first ? "\n" : ",\n");
+        os << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+           << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0
+           << ",\"args\":{\"layer\":" << event.layer << "}}";
+
+        first = false;
+    });
+
+    os << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+}
+
+/*!
+ * \brief Export the recorded events in the Chrome trace format (JSON)
+ * \param path The path of the file to write
+ */
+inline void export_chrome_trace(const std::string& path) {
+    std::ofstream os(path);
+    export_chrome_trace(os);
+}
+
+/*!
+ * \brief Export the flat profile in CSV.
+ *
+ * There is one line per timer and per layer, with the number of events,
+ * the total and the mean durations, in nanoseconds.
+ *
+ * \param os The stream to write to
+ */
+inline void export_profile_csv(std::ostream& os) {
+    std::map<std::tuple<std::string, int>, std::pair<size_t, uint64_t>> flat;
+
+    for_each_profile_event([&](size_t, const profiler_event& event) {
+        auto& entry = flat[std::make_tuple(std::string(event.name), event.layer)];
+
+        ++entry.first;
+        entry.second += event.duration;
+    });
+
+    os << "name,layer,count,total_ns,mean_ns\n";
+
+    for (auto& entry : flat) {
+        os << std::get<0>(entry.first) << "," << std::get<1>(entry.first) << "," << entry.second.first << ","
+           << entry.second.second << "," << entry.second.second / entry.second.first << "\n";
+    }
+
+    os.flush();
+}
+
+/*!
+ * \brief Export the flat profile in CSV.
+ * \param path The path of the file to write
+ */
+inline void export_profile_csv(const std::string& path) {
+    std::ofstream os(path);
+    export_profile_csv(os);
+}
+
+} //end of namespace dll
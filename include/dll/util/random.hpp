@@ -8,6 +8,7 @@
 #pragma once
 
 #include <random>
+#include <atomic>
 
 namespace dll {
 
@@ -34,6 +35,15 @@ inline size_t seed_impl(size_t new_seed = 0){
     return seed;
 }
 
+/*!
+ * \brief Return the number of counter-based random streams drawn since
+ * the seed was set
+ */
+inline std::atomic<uint64_t>& draw_counter(){
+    static std::atomic<uint64_t> counter(0);
+    return counter;
+}
+
 } // end of namespace detail
 
 /*!
@@ -50,6 +60,7 @@ inline size_t seed(){
  */
 inline void set_seed(size_t new_seed){
     detail::seed_impl(new_seed);
+    detail::draw_counter() = 0;
 }
 
 /*!
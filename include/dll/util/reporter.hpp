@@ -0,0 +1,251 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Reporting of the progress of the training by a background thread.
+ *
+ * The watchers push compact records of the batches in a bounded lock-free
+ * queue and a single reporter thread formats and prints them. The training
+ * threads never format nor write to the console for a batch. A record is
+ * dropped if the queue is full. The lines of the epochs are still printed
+ * by the watchers, after a flush of the pending records, to keep the order
+ * of the output.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <chrono>
+
+namespace dll {
+
+/*!
+ * \brief A record of the progress of a batch
+ */
+struct progress_record {
+    /*!
+     * \brief The kind of record, giving its format
+     */
+    enum class kind_t {
+        RBM_BATCH,     ///< A batch of pretraining (batch, batches, error, value = sparsity)
+        FT_BATCH,      ///< A batch of fine-tuning (epoch, batch, batches, error, value = loss, duration)
+        FT_EPOCH_BATCH ///< A batch of fine-tuning without index (epoch, error, value = loss, duration)
+    };
+
+    kind_t kind     = kind_t::RBM_BATCH; ///< The kind of record
+    size_t epoch    = 0;                 ///< The epoch
+    size_t batch    = 0;                 ///< The batch
+    size_t batches  = 0;                 ///< The number of batches
+    size_t duration = 0;                 ///< The duration of the batch, in milliseconds
+    double error    = 0.0;               ///< The error of the batch
+    double value    = 0.0;               ///< The second metric of the batch (loss or sparsity)
+};
+
+/*!
+ * \brief Time-based throttling of the records of a watcher
+ */
+struct report_throttle {
+    size_t period = 0; ///< The minimum time between two records, in milliseconds (0 for no throttling)
+
+    /*!
+     * \brief Indicates if a record can be reported now
+     */
+    bool pass() {
+        if (!period) {
+            return true;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if (started && now - last < std::chrono::milliseconds(period)) {
+            return false;
+        }
+
+        last    = now;
+        started = true;
+
+        return true;
+    }
+
+private:
+    std::chrono::steady_clock::time_point last; ///< The time of the last record
+    bool started = false;                       ///< Indicates if a record has been reported
+};
+
+/*!
+ * \brief The reporter of the progress records, with its own thread started
+ * with the first record.
+ *
+ * The queue is a bounded multi-producer queue: each slot has a sequence
+ * number telling if it can be written or read, so that the producers only
+ * contend on the position of the queue.
+ */
+struct progress_reporter {
+    static constexpr size_t capacity = 1024; ///< The number of records of the queue (a power of two)
+
+    progress_reporter() : slots(new slot[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].sequence = i;
+        }
+    }
+
+    progress_reporter(const progress_reporter& rhs) = delete;
+    progress_reporter& operator=(const progress_reporter& rhs) = delete;
+
+    /*!
+     * \brief Print the pending records and stop the reporter thread
+     */
+    ~progress_reporter() {
+        stop_flag = true;
+
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Push a record to be printed, from any thread
+     * \return true if the record was queued, false if the queue was full
+     */
+    bool push(const progress_record& record) {
+        std::call_once(started, [this] { thread = std::thread([this] { run(); }); });
+
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto& s        = slots[pos & (capacity - 1)];
+            const size_t q = s.sequence.load(std::memory_order_acquire);
+
+            if (q == pos) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.record = record;
+                    s.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (q < pos) {
+                ++dropped;
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*!
+     * \brief Wait for all the records pushed so far to be printed
+     */
+    void flush() {
+        const size_t target = enqueue_pos.load(std::memory_order_acquire);
+
+        while (printed.load(std::memory_order_acquire) < target) {
+            std::this_thread::yield();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of records dropped because the queue was full
+     */
+    size_t dropped_records() const {
+        return dropped;
+    }
+
+private:
+    /*!
+     * \brief A slot of the queue
+     */
+    struct slot {
+        std::atomic<size_t> sequence; ///< The sequence number of the slot
+        progress_record record;       ///< The record of the slot
+    };
+
+    /*!
+     * \brief Pop a record, from the reporter thread only
+     */
+    bool pop(progress_record& record) {
+        auto& s = slots[dequeue_pos & (capacity - 1)];
+
+        if (s.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+            return false;
+        }
+
+        record = s.record;
+        s.sequence.store(dequeue_pos + capacity, std::memory_order_release);
+
+        ++dequeue_pos;
+
+        return true;
+    }
+
+    /*!
+     * \brief The main function of the reporter thread
+     */
+    void run() {
+        while (true) {
+            const bool stopping = stop_flag;
+
+            size_t n = 0;
+            progress_record record;
+
+            while (pop(record)) {
+                print(record);
+                ++n;
+            }
+
+            if (n) {
+                std::fflush(stdout);
+                printed += n;
+            } else if (stopping) {
+                return;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+
+    /*!
+     * \brief Print the given record
+     */
+    static void print(const progress_record& r) {
+        switch (r.kind) {
+            case progress_record::kind_t::RBM_BATCH:
+                std::printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", r.batch, r.batches, r.error, r.value);
+                break;
+
+            case progress_record::kind_t::FT_BATCH:
+                std::printf("Epoch %3ld:%ld/%ld- B. Error: %.5f B. Loss: %.5f Time %ldms\n", r.epoch, r.batch, r.batches, r.error, r.value, r.duration);
+                break;
+
+            case progress_record::kind_t::FT_EPOCH_BATCH:
+                std::printf("Epoch %3ld - B.Error: %.5f B.Loss: %.5f Time %ldms\n", r.epoch, r.error, r.value, r.duration);
+                break;
+        }
+    }
+
+    std::unique_ptr<slot[]> slots;       ///< The slots of the queue
+    std::atomic<size_t> enqueue_pos{0};  ///< The position of the next pushed record
+    size_t dequeue_pos = 0;              ///< The position of the next popped record
+    std::atomic<size_t> printed{0};      ///< The number of records printed
+    std::atomic<size_t> dropped{0};      ///< The number of records dropped
+    std::atomic<bool> stop_flag{false};  ///< Indicates to the reporter thread to stop
+    std::once_flag started;              ///< Starts the thread with the first record
+    std::thread thread;                  ///< The reporter thread
+};
+
+/*!
+ * \brief Return the reporter of the progress of DLL
+ */
+inline progress_reporter& reporter() {
+    static progress_reporter r;
+    return r;
+}
+
+} //end of dll namespace
@@ -0,0 +1,389 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Analytic FLOPs and bytes of the layers and roofline report.
+ *
+ * The floating point operations and the bytes moved of each phase of a
+ * layer (forward, backward, gradients and contrastive divergence) are
+ * computed from the shapes of the layer for one batch, as in
+ * memory_usage.hpp. The bytes are the minimal traffic of each operation:
+ * each operand is read once and each result is written once.
+ *
+ *  - dense layers and RBMs are counted as matrix products, the CD of an
+ *  RBM being three products for the Gibbs step and two for the gradients;
+ *  - convolutional layers and RBMs are counted as direct convolutions;
+ *  - pooling and the transform layers (activations, dropout, batch
+ *  normalization, ...) are counted as one operation per input value.
+ *
+ * The measured durations come from the profiler (see profiler.hpp): the
+ * events of the phases of each layer, recorded between start_profiling()
+ * and stop_profiling(), give the achieved GFLOP/s and GB/s of the layer.
+ * With the peaks of the machine, the report also gives the roofline bound
+ * of each phase, min(peak GFLOP/s, intensity * peak GB/s), telling whether
+ * a layer is bound by the computation or by the memory.
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "cpp_utils/static_if.hpp"
+
+#include "dll/layer_traits.hpp"
+#include "dll/util/profiler.hpp"
+#include "dll/util/memory_usage.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The cost of one phase of a layer for one batch
+ */
+struct phase_cost {
+    double flops = 0.0; ///< The floating point operations
+    double bytes = 0.0; ///< The bytes read from and written to the memory
+
+    /*!
+     * \brief Returns the arithmetic intensity of the phase (FLOP/byte)
+     */
+    double intensity() const {
+        return bytes > 0.0 ? flops / bytes : 0.0;
+    }
+};
+
+/*!
+ * \brief Returns the cost of the two given phases done one after the other
+ */
+inline phase_cost operator+(phase_cost lhs, const phase_cost& rhs) {
+    lhs.flops += rhs.flops;
+    lhs.bytes += rhs.bytes;
+    return lhs;
+}
+
+/*!
+ * \brief The phases of a layer
+ */
+enum class layer_phase {
+    FORWARD,   ///< The forward propagation
+    BACKWARD,  ///< The backward propagation of the errors
+    GRADIENTS, ///< The computation of the gradients
+    CD         ///< One batch of contrastive divergence (RBM only)
+};
+
+constexpr size_t layer_phases = 4; ///< The number of phases of a layer
+
+/*!
+ * \brief Returns the name of the given phase
+ */
+inline const char* to_string(layer_phase phase) {
+    switch (phase) {
+        case layer_phase::FORWARD:
+            return "Forward";
+        case layer_phase::BACKWARD:
+            return "Backward";
+        case layer_phase::GRADIENTS:
+            return "Gradients";
+        case layer_phase::CD:
+            return "CD";
+    }
+
+    return "";
+}
+
+/*!
+ * \brief The cost of the phases of a layer for one batch
+ */
+struct layer_cost {
+    std::string name;                            ///< The description of the layer
+    size_t batch = 0;                            ///< The number of samples of the batch
+    std::array<phase_cost, layer_phases> phases; ///< The cost of each phase
+
+    /*!
+     * \brief Returns the cost of the given phase
+     */
+    phase_cost& operator[](layer_phase phase) {
+        return phases[size_t(phase)];
+    }
+
+    /*!
+     * \brief Returns the cost of the given phase
+     */
+    const phase_cost& operator[](layer_phase phase) const {
+        return phases[size_t(phase)];
+    }
+};
+
+namespace roofline_detail {
+
+/*!
+ * \brief Returns the cost of the product of a (m x k) matrix by a (k x n) matrix
+ */
+inline phase_cost gemm(double m, double n, double k, double s) {
+    return {2.0 * m * n * k, (m * k + k * n + m * n) * s};
+}
+
+/*!
+ * \brief Returns the cost of a direct convolution of a batch of B inputs
+ * into a batch of outputs with the given filters, each output value being
+ * the product of the filters of its channel with the input
+ */
+inline phase_cost conv(double B, double in, double hidden, double filters, double K, double s) {
+    return {2.0 * B * (hidden / K) * filters, (B * in + filters + B * hidden) * s};
+}
+
+/*!
+ * \brief Returns the cost of an element-wise operation on n values,
+ * reading the given number of operands for each value
+ */
+inline phase_cost elementwise(double n, double operands, double s) {
+    return {n, (operands + 1.0) * n * s};
+}
+
+/*!
+ * \brief Returns the number of hidden units of a convolutional RBM with
+ * static dimensions (the hidden units before the pooling if any)
+ */
+template <typename L>
+auto hidden_size(const L& layer, size_t, int) -> decltype(size_t(L::NH1 * L::NH2)) {
+    return etl::dim<0>(layer.w) * L::NH1 * L::NH2;
+}
+
+/*!
+ * \brief Returns the number of hidden units of a convolutional RBM with
+ * dynamic dimensions (the hidden units before the pooling if any)
+ */
+template <typename L>
+auto hidden_size(const L& layer, size_t, long) -> decltype(size_t(layer.nh1 * layer.nh2)) {
+    return etl::dim<0>(layer.w) * layer.nh1 * layer.nh2;
+}
+
+/*!
+ * \brief Returns the number of hidden units of a layer, its output size
+ */
+template <typename L>
+size_t hidden_size(const L&, size_t out, ...) {
+    return out;
+}
+
+/*!
+ * \brief Returns the phase of the given profiler event, false if the event
+ * is not one of the phases of a layer
+ */
+inline bool event_phase(const char* name, layer_phase& phase) {
+    const std::string n(name);
+
+    auto ends_with = [&n](const std::string& suffix) {
+        return n.size() >= suffix.size() && n.compare(n.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    if (ends_with(":forward_batch") || ends_with(":train_forward_batch")) {
+        phase = layer_phase::FORWARD;
+    } else if (ends_with(":backward_batch")) {
+        phase = layer_phase::BACKWARD;
+    } else if (ends_with(":compute_gradients")) {
+        phase = layer_phase::GRADIENTS;
+    } else if (n.compare(0, 9, "cd:train:") == 0) {
+        phase = layer_phase::CD;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+} //end of namespace roofline_detail
+
+/*!
+ * \brief Returns the cost of the phases of the given layer for a batch
+ * \param layer The layer
+ * \param in The input size of the layer
+ * \param out The output size of the layer
+ * \param B The number of samples of the batch
+ */
+template <typename Weight, typename Layer>
+layer_cost compute_layer_cost(const Layer& layer, size_t in, size_t out, size_t B) {
+    using layer_t = std::decay_t<Layer>;
+    using traits  = decay_layer_traits<layer_t>;
+
+    const double s = sizeof(Weight);
+
+    layer_cost cost;
+    cost.name  = layer.to_short_string();
+    cost.batch = B;
+
+    if /*constexpr*/ (traits::is_dense_layer()) {
+        const double V = in;
+        const double K = out;
+
+        cost[layer_phase::FORWARD]   = roofline_detail::gemm(B, K, V, s) + roofline_detail::elementwise(B * K, 1, s);
+        cost[layer_phase::BACKWARD]  = roofline_detail::gemm(B, V, K, s);
+        cost[layer_phase::GRADIENTS] = roofline_detail::gemm(V, K, B, s) + roofline_detail::elementwise(B * K, 1, s);
+    }
+
+    cpp::static_if<traits::is_convolutional_layer()>([&](auto f) {
+        const double filters = etl::size(f(layer).w);
+        const double K       = etl::dim<0>(f(layer).w);
+
+        auto c = roofline_detail::conv(B, in, out, filters, K, s);
+
+        cost[layer_phase::FORWARD]   = c + roofline_detail::elementwise(B * out, 1, s);
+        cost[layer_phase::BACKWARD]  = c;
+        cost[layer_phase::GRADIENTS] = c + roofline_detail::elementwise(B * out, 1, s);
+    });
+
+    if /*constexpr*/ (traits::is_dense_rbm_layer()) {
+        const double V = in;
+        const double H = out;
+
+        cost[layer_phase::FORWARD] = roofline_detail::gemm(B, H, V, s);
+
+        // h1, v2 and h2, then the positive and negative gradients
+        cost[layer_phase::CD] = roofline_detail::gemm(B, H, V, s) + roofline_detail::gemm(B, V, H, s) + roofline_detail::gemm(B, H, V, s)
+                              + roofline_detail::gemm(V, H, B, s) + roofline_detail::gemm(V, H, B, s);
+    }
+
+    cpp::static_if<traits::is_convolutional_rbm_layer()>([&](auto f) {
+        const double filters = etl::size(f(layer).w);
+        const double K       = etl::dim<0>(f(layer).w);
+        const double hidden  = roofline_detail::hidden_size(f(layer), out, 0);
+
+        auto c = roofline_detail::conv(B, in, hidden, filters, K, s);
+
+        cost[layer_phase::FORWARD] = c;
+
+        // h1, v2 and h2, then the positive and negative gradients
+        cost[layer_phase::CD] = c + c + c + c + c;
+    });
+
+    if /*constexpr*/ (traits::is_pooling_layer() || traits::is_transform_layer()) {
+        // The backward pass reads the input, the output and the errors
+        cost[layer_phase::FORWARD]  = roofline_detail::elementwise(B * in, 1, s);
+        cost[layer_phase::BACKWARD] = {double(B * in), (2.0 * in + out) * B * s};
+    }
+
+    return cost;
+}
+
+/*!
+ * \brief Returns the cost of the phases of each layer of the given
+ * network for one batch of its runtime batch size
+ */
+template <typename DBN>
+std::vector<layer_cost> compute_costs(const DBN& dbn) {
+    const size_t B = dbn.runtime_batch_size();
+
+    std::vector<layer_cost> costs;
+
+    size_t previous = 0;
+
+    dbn.for_each_layer([&](auto& layer) {
+        const size_t in  = memory_detail::input_size(layer, previous, 0);
+        const size_t out = memory_detail::output_size(layer, in, 0);
+
+        costs.push_back(compute_layer_cost<typename DBN::weight>(layer, in, out, B));
+
+        previous = out;
+    });
+
+    return costs;
+}
+
+/*!
+ * \brief The measured durations of the phases of a layer
+ */
+struct phase_measure {
+    size_t count      = 0; ///< The number of events
+    uint64_t duration = 0; ///< The total duration, in nanoseconds
+};
+
+/*!
+ * \brief Returns the durations of the phases of each of the given number
+ * of layers, from the events recorded by the profiler
+ */
+inline std::vector<std::array<phase_measure, layer_phases>> measure_phases(size_t layers) {
+    std::vector<std::array<phase_measure, layer_phases>> measures(layers);
+
+    for_each_profile_event([&](size_t, const profiler_event& event) {
+        layer_phase phase;
+
+        if (event.layer >= 0 && size_t(event.layer) < layers && roofline_detail::event_phase(event.name, phase)) {
+            auto& m = measures[event.layer][size_t(phase)];
+
+            ++m.count;
+            m.duration += event.duration;
+        }
+    });
+
+    return measures;
+}
+
+/*!
+ * \brief Display the analytic cost of the layers of the given network and
+ * their measured performance in the given stream.
+ *
+ * The achieved performance is only displayed for the phases with recorded
+ * profiler events. When the peaks of the machine are given, the roofline
+ * bound of each phase and the fraction of the bound achieved are displayed.
+ *
+ * \param dbn The network
+ * \param stream The stream to print to
+ * \param peak_gflops The peak GFLOP/s of the machine (0 if unknown)
+ * \param peak_gbs The peak memory bandwidth of the machine, in GB/s (0 if unknown)
+ */
+template <typename DBN>
+std::ostream& display_performance(const DBN& dbn, std::ostream& stream, double peak_gflops = 0.0, double peak_gbs = 0.0) {
+    auto costs    = compute_costs(dbn);
+    auto measures = measure_phases(costs.size());
+
+    stream << "Performance (batch of " << dbn.runtime_batch_size() << "):" << std::endl;
+
+    for (size_t i = 0; i < costs.size(); ++i) {
+        auto& cost = costs[i];
+
+        stream << "    Layer " << i << ": " << cost.name << std::endl;
+
+        for (size_t p = 0; p < layer_phases; ++p) {
+            auto& c = cost.phases[p];
+            auto& m = measures[i][p];
+
+            if (c.flops == 0.0 && c.bytes == 0.0) {
+                continue;
+            }
+
+            stream << "        " << std::setw(9) << to_string(layer_phase(p)) << ": " << std::setprecision(4)
+                   << c.flops / 1e6 << " MFLOP, " << c.bytes / 1e6 << " MB, " << c.intensity() << " FLOP/B";
+
+            if (m.count && m.duration) {
+                // The batches of the events may be smaller than the batch of the cost (last batch)
+                const double seconds = m.duration / 1e9;
+                const double gflops  = m.count * c.flops / seconds / 1e9;
+                const double gbs     = m.count * c.bytes / seconds / 1e9;
+
+                stream << ", " << gflops << " GFLOP/s, " << gbs << " GB/s";
+
+                if (peak_gflops > 0.0 && peak_gbs > 0.0) {
+                    const double bound = std::min(peak_gflops, c.intensity() * peak_gbs);
+
+                    stream << ", " << 100.0 * gflops / bound << "% of " << bound << " GFLOP/s ("
+                           << (c.intensity() * peak_gbs < peak_gflops ? "memory" : "compute") << " bound)";
+                }
+            }
+
+            stream << std::endl;
+        }
+    }
+
+    return stream;
+}
+
+} //end of dll namespace
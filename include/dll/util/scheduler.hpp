@@ -0,0 +1,321 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Work-stealing scheduler shared by the parallel loops of the
+ * kernels and the background tasks of the generators.
+ *
+ * A single set of worker threads runs all the tasks, instead of each
+ * component creating its own threads. Each worker has its own queue of
+ * tasks: a worker takes the last task it pushed and, when its queue is
+ * empty, steals the oldest task of another worker.
+ *
+ * The compute tasks always have the priority over the background tasks
+ * (prefetching, loading). Since the compute tasks are the short parts of
+ * a parallel loop, the background tasks run as soon as a worker is free,
+ * between two loops at the latest.
+ *
+ * The total number of threads is set once, with set_concurrency() or the
+ * DLL_THREADS environment variable, and defaults to etl::threads.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <cstdlib>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/affinity.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The priority of a task of the scheduler
+ */
+enum class task_priority {
+    COMPUTE,   ///< The tasks of the kernels
+    BACKGROUND ///< The tasks of the generators (prefetching, loading)
+};
+
+namespace scheduler_detail {
+
+/*!
+ * \brief The configured number of threads, 0 for the default
+ */
+inline std::atomic<size_t>& requested_concurrency() {
+    static std::atomic<size_t> value(std::getenv("DLL_THREADS") ? std::strtoul(std::getenv("DLL_THREADS"), nullptr, 10) : 0);
+    return value;
+}
+
+/*!
+ * \brief The index of the worker of the current thread, -1 for the
+ * threads that are not workers of the scheduler
+ */
+inline long& worker_index() {
+    static thread_local long value = -1;
+    return value;
+}
+
+} //end of namespace scheduler_detail
+
+/*!
+ * \brief Set the total number of threads used by DLL (including the
+ * calling thread).
+ *
+ * This must be called before the first parallel operation.
+ */
+inline void set_concurrency(size_t threads) {
+    scheduler_detail::requested_concurrency() = threads;
+}
+
+/*!
+ * \brief Return the total number of threads used by DLL (including the
+ * calling thread).
+ */
+inline size_t concurrency() {
+    const size_t requested = scheduler_detail::requested_concurrency();
+    return std::max<size_t>(1, requested ? requested : size_t(etl::threads));
+}
+
+/*!
+ * \brief The work-stealing scheduler
+ */
+struct task_scheduler {
+    using task_t = std::function<void()>; ///< The type of the tasks
+
+    /*!
+     * \brief Create the scheduler with the given number of worker threads
+     */
+    explicit task_scheduler(size_t workers) : queues(workers) {
+        threads.reserve(workers);
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { work(w); });
+        }
+    }
+
+    task_scheduler(const task_scheduler& rhs) = delete;
+    task_scheduler& operator=(const task_scheduler& rhs) = delete;
+
+    /*!
+     * \brief Stop the workers, after the end of the pending tasks
+     */
+    ~task_scheduler() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Return the number of worker threads
+     */
+    size_t workers() const {
+        return threads.size();
+    }
+
+    /*!
+     * \brief Push a task to the scheduler
+     *
+     * The compute tasks pushed by a worker go to its own queue, the others
+     * are distributed between the queues.
+     */
+    void push(task_t task, task_priority priority = task_priority::COMPUTE) {
+        if (priority == task_priority::BACKGROUND) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                background.push_back(std::move(task));
+                ++pending;
+            }
+
+            condition.notify_one();
+
+            return;
+        }
+
+        const long self = scheduler_detail::worker_index();
+        const size_t q  = self >= 0 ? size_t(self) : next_queue++ % queues.size();
+
+        // The counter is incremented first, it never goes below zero
+        {
+            std::lock_guard<std::mutex> l(lock);
+            ++pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(queues[q].lock);
+            queues[q].tasks.push_back(std::move(task));
+        }
+
+        condition.notify_one();
+    }
+
+    /*!
+     * \brief Push a background task and return a future signaled at its end
+     */
+    std::future<void> submit_background(task_t task) {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future  = promise->get_future();
+
+        push([task = std::move(task), promise]() {
+            task();
+            promise->set_value();
+        }, task_priority::BACKGROUND);
+
+        return future;
+    }
+
+    /*!
+     * \brief Run a compute task, if any, from the current thread
+     * \return true if a task has been run
+     */
+    bool run_one() {
+        const long self = scheduler_detail::worker_index();
+
+        task_t task;
+
+        if (take_compute(self >= 0 ? size_t(self) : 0, task)) {
+            task();
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    /*!
+     * \brief A queue of compute tasks
+     */
+    struct queue {
+        std::mutex lock;          ///< The lock of the queue
+        std::deque<task_t> tasks; ///< The tasks
+    };
+
+    /*!
+     * \brief Take a compute task, from the given queue first and then from
+     * the others
+     */
+    bool take_compute(size_t q, task_t& task) {
+        // The last task of the own queue
+        {
+            std::lock_guard<std::mutex> l(queues[q].lock);
+
+            if (!queues[q].tasks.empty()) {
+                task = std::move(queues[q].tasks.back());
+                queues[q].tasks.pop_back();
+                taken();
+                return true;
+            }
+        }
+
+        // The oldest task of another queue
+        for (size_t i = 1; i < queues.size(); ++i) {
+            auto& victim = queues[(q + i) % queues.size()];
+
+            std::lock_guard<std::mutex> l(victim.lock);
+
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                taken();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Take a background task
+     */
+    bool take_background(task_t& task) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (background.empty()) {
+            return false;
+        }
+
+        task = std::move(background.front());
+        background.pop_front();
+        --pending;
+
+        return true;
+    }
+
+    /*!
+     * \brief Indicates that a compute task has been taken
+     */
+    void taken() {
+        std::lock_guard<std::mutex> l(lock);
+        --pending;
+    }
+
+    /*!
+     * \brief The main function of a worker
+     */
+    void work(size_t w) {
+        scheduler_detail::worker_index() = w;
+
+        pin_pool_thread();
+
+        task_t task;
+
+        while (true) {
+            if (take_compute(w, task) || take_background(task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> l(lock);
+
+            condition.wait(l, [this] { return stop || pending > 0; });
+
+            if (stop && pending == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<queue> queues;        ///< The queue of compute tasks of each worker
+    std::deque<task_t> background;    ///< The background tasks
+    std::vector<std::thread> threads; ///< The worker threads
+    std::atomic<size_t> next_queue{0}; ///< The next queue for the tasks pushed by other threads
+
+    std::mutex lock;                   ///< The lock protecting the counter and the background tasks
+    std::condition_variable condition; ///< Signals new tasks
+    size_t pending = 0;                ///< The number of tasks not yet taken
+    bool stop      = false;            ///< Indicates that the workers must stop
+};
+
+/*!
+ * \brief Return the scheduler of DLL, the calling thread counting as one
+ * of the threads. There is always at least one worker for the background
+ * tasks.
+ */
+inline task_scheduler& scheduler() {
+    static task_scheduler s(std::max<size_t>(1, concurrency() - 1));
+    return s;
+}
+
+} //end of dll namespace
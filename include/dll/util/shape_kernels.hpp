@@ -0,0 +1,132 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Shape-specialized kernels for the dynamic layers.
+ *
+ * The products of the dynamic dense layers are computed with sizes only
+ * known at runtime. For the common sizes, a kernel compiled with the
+ * sizes as constants is selected once, when the layer is initialized:
+ * the loops have constant trip counts and are fully vectorized and
+ * unrolled by the compiler. The other sizes use the generic ETL
+ * product.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A kernel computing y = x * w for a batch x (B x V) and weights
+ * w (V x H) of fixed sizes.
+ */
+template <typename T>
+using dense_kernel = void (*)(T* y, const T* x, const T* w, size_t B);
+
+namespace shape_kernels_detail {
+
+/*!
+ * \brief Compute y = x * w with V and H known at compile-time.
+ *
+ * The batch is processed by tiles of rows, each row of the weights is
+ * loaded once per tile.
+ */
+template <size_t V, size_t H, typename T>
+void dense_mul(T* y, const T* x, const T* w, size_t B) {
+    constexpr size_t tile = 8;
+
+    auto task = [&](size_t t) {
+        const size_t first = t * tile;
+        const size_t last  = std::min(B, first + tile);
+
+        std::fill(y + first * H, y + last * H, T(0));
+
+        for (size_t i = 0; i < V; ++i) {
+            const T* w_row = w + i * H;
+
+            for (size_t r = first; r < last; ++r) {
+                const T x_i = x[r * V + i];
+                T* y_row    = y + r * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    y_row[j] += x_i * w_row[j];
+                }
+            }
+        }
+    };
+
+    const size_t tiles = (B + tile - 1) / tile;
+
+    if (tiles > 1) {
+        parallel_for_n(tiles, task);
+    } else {
+        task(0);
+    }
+}
+
+/*!
+ * \brief An entry of the table of kernels
+ */
+template <typename T>
+struct dense_entry {
+    size_t visible;          ///< The number of inputs
+    size_t hidden;           ///< The number of outputs
+    dense_kernel<T> kernel;  ///< The kernel for these sizes
+};
+
+} //end of namespace shape_kernels_detail
+
+/*!
+ * \brief Select the specialized kernel for the given sizes.
+ *
+ * \param V The number of inputs
+ * \param H The number of outputs
+ *
+ * \return The kernel, or nullptr if the generic product must be used
+ */
+template <typename T>
+dense_kernel<T> select_dense_kernel(size_t V, size_t H) {
+#if defined(ETL_BLAS_MODE) || defined(ETL_MKL_MODE) || defined(ETL_CUBLAS_MODE) || defined(ETL_GPU)
+    // The BLAS (or GPU) gemm is faster than the specialized kernels
+    cpp_unused(V);
+    cpp_unused(H);
+    return nullptr;
+#else
+    using shape_kernels_detail::dense_mul;
+
+    static const shape_kernels_detail::dense_entry<T> table[] = {
+        {784, 100, &dense_mul<784, 100, T>},
+        {784, 300, &dense_mul<784, 300, T>},
+        {784, 500, &dense_mul<784, 500, T>},
+        {784, 1000, &dense_mul<784, 1000, T>},
+        {100, 100, &dense_mul<100, 100, T>},
+        {100, 10, &dense_mul<100, 10, T>},
+        {300, 100, &dense_mul<300, 100, T>},
+        {300, 10, &dense_mul<300, 10, T>},
+        {500, 500, &dense_mul<500, 500, T>},
+        {500, 1000, &dense_mul<500, 1000, T>},
+        {500, 10, &dense_mul<500, 10, T>},
+        {1000, 1000, &dense_mul<1000, 1000, T>},
+        {1000, 500, &dense_mul<1000, 500, T>},
+        {1000, 10, &dense_mul<1000, 10, T>}};
+
+    for (auto& entry : table) {
+        if (entry.visible == V && entry.hidden == H) {
+            return entry.kernel;
+        }
+    }
+
+    return nullptr;
+#endif
+}
+
+} //end of dll namespace
@@ -0,0 +1,414 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sparse (CSR) batches for the layers with very sparse inputs.
+ *
+ * A batch is compressed in a single pass over the dense batch and the
+ * products are then computed only on the non-zero values, their cost
+ * scaling with the number of non-zeros instead of the width of the
+ * input.
+ *
+ * The same products are used for the errors of the ReLU layers, which
+ * are zero for all the units that are not active, during the
+ * backpropagation and the computation of the gradients.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/direct.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of samples in Compressed Sparse Row format
+ */
+template <typename T>
+struct csr_batch {
+    size_t rows    = 0;      ///< The number of samples
+    size_t columns = 0;      ///< The number of features per sample
+    std::vector<size_t> ptr; ///< The index of the first non-zero of each row (rows + 1)
+    std::vector<size_t> col; ///< The column of each non-zero
+    std::vector<T> values;   ///< The value of each non-zero
+
+    /*!
+     * \brief Compress the given dense batch (samples x features)
+     * \param input The dense batch, of any dimensions, the first being the samples
+     */
+    template <typename E>
+    void compress(const E& input) {
+        decltype(auto) in = direct_memory(input);
+
+        rows    = etl::dim<0>(in);
+        columns = etl::size(in) / rows;
+
+        ptr.resize(rows + 1);
+        col.clear();
+        values.clear();
+
+        const auto* x = in.memory_start();
+
+        for (size_t b = 0; b < rows; ++b) {
+            ptr[b] = col.size();
+
+            for (size_t j = 0; j < columns; ++j) {
+                if (x[b * columns + j] != T(0)) {
+                    col.push_back(j);
+                    values.push_back(x[b * columns + j]);
+                }
+            }
+        }
+
+        ptr[rows] = col.size();
+    }
+
+    /*!
+     * \brief Return the number of non-zero values
+     */
+    size_t nnz() const {
+        return values.size();
+    }
+
+    /*!
+     * \brief Return the ratio of non-zero values in the batch
+     */
+    double density() const {
+        return rows * columns ? double(nnz()) / double(rows * columns) : 0.0;
+    }
+};
+
+/*!
+ * \brief The maximum density of a batch for the sparse products to be
+ * used, the dense products are faster for denser batches.
+ */
+constexpr double sparse_max_density = 0.05;
+
+/*!
+ * \brief Compute y = x * w with a sparse batch x
+ * \param y The output (rows x M), with direct memory access
+ * \param x The sparse batch (rows x N)
+ * \param w The weights (N x M)
+ */
+template <typename T, typename Y, typename W>
+void csr_mul(Y&& y, const csr_batch<T>& x, const W& w) {
+    const size_t M = etl::dim<1>(w);
+
+    auto* out          = y.memory_start();
+    const auto* weight = w.memory_start();
+
+    std::fill(out, out + x.rows * M, T(0));
+
+    for (size_t b = 0; b < x.rows; ++b) {
+        auto* out_row = out + b * M;
+
+        for (size_t i = x.ptr[b]; i < x.ptr[b + 1]; ++i) {
+            const T v         = x.values[i];
+            const auto* w_row = weight + x.col[i] * M;
+
+            for (size_t m = 0; m < M; ++m) {
+                out_row[m] += v * w_row[m];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute grad = transpose(x) * errors with a sparse batch x,
+ * i.e. the sum of the outer products of the samples and the errors
+ *
+ * \param grad The output (N x M), with direct memory access
+ * \param x The sparse batch (rows x N)
+ * \param errors The errors (rows x M)
+ */
+template <typename T, typename G, typename E>
+void csr_batch_outer(G&& grad, const csr_batch<T>& x, const E& errors) {
+    decltype(auto) err = direct_memory(errors);
+
+    const size_t M = etl::size(err) / etl::dim<0>(err);
+
+    auto* out      = grad.memory_start();
+    const auto* dy = err.memory_start();
+
+    std::fill(out, out + x.columns * M, T(0));
+
+    for (size_t b = 0; b < x.rows; ++b) {
+        const auto* dy_row = dy + b * M;
+
+        for (size_t i = x.ptr[b]; i < x.ptr[b + 1]; ++i) {
+            const T v      = x.values[i];
+            auto* grad_row = out + x.col[i] * M;
+
+            for (size_t m = 0; m < M; ++m) {
+                grad_row[m] += v * dy_row[m];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief The minimum number of operations of a sparse product for its
+ * rows to be computed in parallel
+ */
+constexpr size_t sparse_parallel_threshold = 256 * 1024;
+
+/*!
+ * \brief Compute y = x * transpose(w) with a sparse batch x
+ *
+ * \param y The output (rows x N), with direct memory access
+ * \param x The sparse batch (rows x M)
+ * \param wt The transposed weights (M x N), with direct memory access
+ */
+template <typename T, typename Y>
+void csr_mul_transposed(Y&& y, const csr_batch<T>& x, const std::vector<T>& wt) {
+    const size_t N = wt.size() / x.columns;
+
+    auto* out          = y.memory_start();
+    const auto* weight = wt.data();
+
+    auto functor = [&](size_t b) {
+        auto* out_row = out + b * N;
+
+        std::fill(out_row, out_row + N, T(0));
+
+        for (size_t i = x.ptr[b]; i < x.ptr[b + 1]; ++i) {
+            const T v         = x.values[i];
+            const auto* w_row = weight + x.col[i] * N;
+
+            for (size_t n = 0; n < N; ++n) {
+                out_row[n] += v * w_row[n];
+            }
+        }
+    };
+
+    if (x.nnz() * N >= sparse_parallel_threshold) {
+        parallel_for_n(x.rows, functor);
+    } else {
+        for (size_t b = 0; b < x.rows; ++b) {
+            functor(b);
+        }
+    }
+}
+
+/*!
+ * \brief Compute grad += alpha * transpose(x) * errors with sparse
+ * errors, only the non-zero values of x being used
+ *
+ * \param grad The output (N x M), with direct memory access
+ * \param x The dense batch (rows x N)
+ * \param errors The sparse errors (rows x M)
+ * \param alpha The factor of the product
+ */
+template <typename T, typename G, typename X>
+void csr_errors_outer(G&& grad, const X& x, const csr_batch<T>& errors, T alpha) {
+    decltype(auto) in = direct_memory(x);
+
+    const size_t N = etl::size(in) / errors.rows;
+    const size_t M = errors.columns;
+
+    auto* out     = grad.memory_start();
+    const auto* v = in.memory_start();
+
+    // Each part of the rows of the gradients is computed independently
+    const size_t P = errors.nnz() * N >= sparse_parallel_threshold ? std::min(N, concurrency()) : 1;
+
+    auto functor = [&](size_t p) {
+        for (size_t b = 0; b < errors.rows; ++b) {
+            const auto* x_row = v + b * N;
+
+            for (size_t n = (p * N) / P; n < ((p + 1) * N) / P; ++n) {
+                const T xv = alpha * x_row[n];
+
+                if (xv == T(0)) {
+                    continue;
+                }
+
+                auto* grad_row = out + n * M;
+
+                for (size_t i = errors.ptr[b]; i < errors.ptr[b + 1]; ++i) {
+                    grad_row[errors.col[i]] += xv * errors.values[i];
+                }
+            }
+        }
+    };
+
+    if (P > 1) {
+        parallel_for_n(P, functor);
+    } else {
+        functor(0);
+    }
+}
+
+/*!
+ * \brief Return the CSR batch of the current thread, reused between the
+ * batches to avoid allocations
+ */
+template <typename T>
+csr_batch<T>& thread_csr_batch() {
+    static thread_local csr_batch<T> batch;
+    return batch;
+}
+
+/*!
+ * \brief Return the buffer of transposed weights of the current thread,
+ * reused between the batches to avoid allocations
+ */
+template <typename T>
+std::vector<T>& thread_transposed_weights() {
+    static thread_local std::vector<T> wt;
+    return wt;
+}
+
+/*!
+ * \brief Compute y = x * w with the sparse products if the given batch is
+ * sparse enough.
+ *
+ * \param y The output (samples x M), with direct memory access
+ * \param x The dense batch (samples x N)
+ * \param w The weights (N x M)
+ *
+ * \return true if the product was computed, false if the batch is too dense
+ */
+template <typename Y, typename X, typename W>
+bool sparse_mul(Y&& y, const X& x, const W& w) {
+    auto& csr = thread_csr_batch<etl::value_t<W>>();
+
+    csr.compress(x);
+
+    if (csr.density() > sparse_max_density) {
+        return false;
+    }
+
+    csr_mul(y, csr, w);
+
+    return true;
+}
+
+/*!
+ * \brief Compute grad = transpose(x) * errors with the sparse products if
+ * the given batch is sparse enough.
+ *
+ * \param grad The output (N x M), with direct memory access
+ * \param x The dense batch (samples x N)
+ * \param errors The errors (samples x M)
+ *
+ * \return true if the product was computed, false if the batch is too dense
+ */
+template <typename G, typename X, typename E>
+bool sparse_batch_outer(G&& grad, const X& x, const E& errors) {
+    auto& csr = thread_csr_batch<etl::value_t<E>>();
+
+    csr.compress(x);
+
+    if (csr.density() > sparse_max_density) {
+        return false;
+    }
+
+    csr_batch_outer(grad, csr, errors);
+
+    return true;
+}
+
+/*!
+ * \brief The maximum density of the errors of a ReLU layer for the sparse
+ * products to be used during the backpropagation
+ */
+constexpr double sparse_errors_max_density = 0.1;
+
+/*!
+ * \brief Compute y = errors * transpose(w) with the sparse products if the
+ * given errors are sparse enough.
+ *
+ * \param y The output (samples x N), with direct memory access
+ * \param errors The errors (samples x M)
+ * \param w The weights (N x M)
+ *
+ * \return true if the product was computed, false if the errors are too dense
+ */
+template <typename Y, typename E, typename W>
+bool sparse_mul_transposed(Y&& y, const E& errors, const W& w) {
+    using T = etl::value_t<W>;
+
+    auto& csr = thread_csr_batch<T>();
+
+    csr.compress(errors);
+
+    if (csr.density() > sparse_errors_max_density) {
+        return false;
+    }
+
+    // The transposed weights make the rows of the product contiguous
+    const size_t N = etl::dim<0>(w);
+    const size_t M = etl::dim<1>(w);
+
+    auto& wt = thread_transposed_weights<T>();
+
+    wt.resize(N * M);
+
+    const auto* weight = w.memory_start();
+
+    for (size_t n = 0; n < N; ++n) {
+        for (size_t m = 0; m < M; ++m) {
+            wt[m * N + n] = weight[n * M + m];
+        }
+    }
+
+    csr_mul_transposed(y, csr, wt);
+
+    return true;
+}
+
+/*!
+ * \brief Compute grad = alpha * transpose(x) * errors (or add it to grad)
+ * with the sparse products if the density of the errors times the density
+ * of the batch is low enough, the inputs of a ReLU layer being often the
+ * sparse outputs of another ReLU layer.
+ *
+ * \param grad The output (N x M), with direct memory access
+ * \param x The dense batch (samples x N)
+ * \param errors The errors (samples x M)
+ * \param alpha The factor of the product
+ * \param accumulate Indicates if the product is added to grad instead of replacing it
+ *
+ * \return true if the product was computed, false if the batches are too dense
+ */
+template <typename G, typename X, typename E>
+bool sparse_errors_outer(G&& grad, const X& x, const E& errors, etl::value_t<E> alpha = 1, bool accumulate = false) {
+    using T = etl::value_t<E>;
+
+    auto& csr = thread_csr_batch<T>();
+
+    csr.compress(errors);
+
+    decltype(auto) in = direct_memory(x);
+
+    const size_t n = etl::size(in);
+    const auto* v  = in.memory_start();
+
+    const size_t x_nnz = n - std::count(v, v + n, T(0));
+
+    // The cost of the product is in the product of the densities
+    if (csr.density() * (n ? double(x_nnz) / double(n) : 0.0) > sparse_errors_max_density) {
+        return false;
+    }
+
+    if (!accumulate) {
+        std::fill(grad.memory_start(), grad.memory_start() + etl::size(grad), T(0));
+    }
+
+    csr_errors_outer(grad, in, csr, alpha);
+
+    return true;
+}
+
+} //end of dll namespace
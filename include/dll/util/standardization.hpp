@@ -0,0 +1,225 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Dataset-level standardization of the inputs.
+ *
+ * Contrary to normalize_pre, which normalizes each sample by its own mean
+ * and standard deviation, the mean and the standard deviation are computed
+ * once over the whole dataset, for each feature or for each channel (the
+ * first dimension of the samples). They are computed in a single parallel
+ * pass: each thread accumulates a part of the samples with the Welford
+ * algorithm and the parts are merged pairwise (Chan et al.).
+ *
+ * The statistics can be stored with the model and applied to the samples
+ * given to the network at inference time.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#include "cpp_utils/io.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The mean and the inverse of the standard deviation of the
+ * features, or of the channels, of a dataset
+ */
+template <typename T>
+struct standardization {
+    std::vector<T> mean;  ///< The mean of each feature (or channel)
+    std::vector<T> scale; ///< The inverse of the standard deviation of each feature (or channel), 0 for the constant ones
+    size_t group = 1;     ///< The number of consecutive values of a sample sharing the same statistics
+
+    /*!
+     * \brief Indicates if the statistics have been computed
+     */
+    bool empty() const {
+        return mean.empty();
+    }
+
+    /*!
+     * \brief Returns the number of values of one sample
+     */
+    size_t sample_size() const {
+        return mean.size() * group;
+    }
+
+    /*!
+     * \brief Compute the statistics of n samples of the given size
+     *
+     * \param n The number of samples
+     * \param size The number of values of one sample
+     * \param channels The number of channels (0 for the statistics of each feature)
+     * \param sample A functor returning the memory of the given sample
+     */
+    template <typename Sample>
+    void compute(size_t n, size_t size, size_t channels, Sample&& sample) {
+        const size_t S = channels ? channels : size;
+
+        group = size / S;
+
+        // The partial statistics of a part of the samples
+        struct part {
+            double count = 0.0;
+            std::vector<double> mean;
+            std::vector<double> m2;
+        };
+
+        const size_t P = std::max<size_t>(1, std::min(n, concurrency()));
+
+        std::vector<part> parts(P);
+
+        parallel_for_n(P, [&](size_t p) {
+            auto& part = parts[p];
+
+            part.mean.assign(S, 0.0);
+            part.m2.assign(S, 0.0);
+
+            for (size_t i = (p * n) / P; i < ((p + 1) * n) / P; ++i) {
+                const T* x = sample(i);
+
+                for (size_t g = 0; g < group; ++g) {
+                    part.count += 1.0;
+
+                    const double inv = 1.0 / part.count;
+
+                    for (size_t s = 0; s < S; ++s) {
+                        const double v     = x[s * group + g];
+                        const double delta = v - part.mean[s];
+
+                        part.mean[s] += delta * inv;
+                        part.m2[s] += delta * (v - part.mean[s]);
+                    }
+                }
+            }
+        });
+
+        // Merge the parts pairwise, in the order of the samples
+        for (size_t p = 1; p < P; ++p) {
+            auto& a = parts[0];
+            auto& b = parts[p];
+
+            if (b.count == 0.0) {
+                continue;
+            }
+
+            const double count = a.count + b.count;
+
+            for (size_t s = 0; s < S; ++s) {
+                const double delta = b.mean[s] - a.mean[s];
+
+                a.mean[s] += delta * b.count / count;
+                a.m2[s] += b.m2[s] + delta * delta * a.count * b.count / count;
+            }
+
+            a.count = count;
+        }
+
+        mean.resize(S);
+        scale.resize(S);
+
+        for (size_t s = 0; s < S; ++s) {
+            const double stddev = parts[0].count > 0.0 ? std::sqrt(parts[0].m2[s] / parts[0].count) : 0.0;
+
+            mean[s]  = T(parts[0].mean[s]);
+            scale[s] = stddev > 0.0 ? T(1.0 / stddev) : T(0);
+        }
+    }
+
+    /*!
+     * \brief Standardize the given sample into the given output
+     * \param out The output of sample_size() values
+     * \param in The sample (can be the same memory as the output)
+     */
+    void apply(T* out, const T* in) const {
+        const size_t S = mean.size();
+
+        const T* m = mean.data();
+        const T* k = scale.data();
+
+        if (group == 1) {
+            for (size_t s = 0; s < S; ++s) {
+                out[s] = (in[s] - m[s]) * k[s];
+            }
+
+            return;
+        }
+
+        for (size_t s = 0; s < S; ++s) {
+            T* o       = out + s * group;
+            const T* x = in + s * group;
+
+            for (size_t g = 0; g < group; ++g) {
+                o[g] = (x[g] - m[s]) * k[s];
+            }
+        }
+    }
+
+    /*!
+     * \brief Standardize the given sample in place
+     */
+    template <typename Sample>
+    void apply(Sample&& sample) const {
+        cpp_assert(etl::size(sample) == sample_size(), "Invalid size of the sample to standardize");
+
+        apply(sample.memory_start(), sample.memory_start());
+    }
+
+    /*!
+     * \brief Store the statistics using the given output stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write(os, mean.size());
+        cpp::binary_write(os, group);
+        cpp::binary_write_all(os, mean);
+        cpp::binary_write_all(os, scale);
+    }
+
+    /*!
+     * \brief Load the statistics using the given input stream
+     */
+    void load(std::istream& is) {
+        size_t S = 0;
+
+        cpp::binary_load(is, S);
+        cpp::binary_load(is, group);
+
+        mean.resize(S);
+        scale.resize(S);
+
+        cpp::binary_load_all(is, mean);
+        cpp::binary_load_all(is, scale);
+    }
+
+    /*!
+     * \brief Store the statistics to the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the statistics from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+};
+
+} //end of dll namespace
@@ -9,6 +9,8 @@
 
 #include <chrono>
 
+#include "dll/util/profiler.hpp"
+
 #ifndef DLL_NO_TIMERS
 
 #include <iosfwd>
@@ -246,7 +248,14 @@ struct auto_timer {
      * \brief Destructs the timer, effectively incrementing the timer.
      */
     ~auto_timer() {
-        end           = std::chrono::steady_clock::now();
+        end = std::chrono::steady_clock::now();
+
+        // While profiling, the event only goes to the buffer of the thread
+        if (is_profiling()) {
+            record_profile(name, start, end);
+            return;
+        }
+
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
         decltype(auto) timers = get_timers();
@@ -0,0 +1,56 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Conversions to and from the uint8 storage format
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Store the given expression in the given uint8 container.
+ *
+ * The values are rounded and clamped to [0, 255].
+ *
+ * \param out The uint8 container (of the same size as in)
+ * \param in The values to store
+ */
+template <typename O, typename I>
+void u8_encode(O&& out, const I& in) {
+    cpp_assert(etl::size(out) == etl::size(in), "u8_encode needs containers of the same size");
+
+    for (size_t i = 0; i < etl::size(in); ++i) {
+        out[i] = uint8_t(std::min(255.0, std::max(0.0, std::round(double(in[i])))));
+    }
+}
+
+/*!
+ * \brief Load the values of the given uint8 container
+ * \param out The output floating point container (of the same size as in)
+ * \param in The uint8 container
+ */
+template <typename O, typename I>
+void u8_decode(O&& out, const I& in) {
+    cpp_assert(etl::size(out) == etl::size(in), "u8_decode needs containers of the same size");
+
+    using T = etl::value_t<O>;
+
+    for (size_t i = 0; i < etl::size(in); ++i) {
+        out[i] = T(in[i]);
+    }
+}
+
+} //end of dll namespace
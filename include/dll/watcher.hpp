@@ -13,12 +13,56 @@
 
 #include "cpp_utils/stop_watch.hpp"
 
+#include "dll/util/reporter.hpp"
+
 #include "trainer/rbm_training_context.hpp"
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
 
 namespace dll {
 
+namespace watcher_detail {
+
+template <typename Watcher>
+auto notify_samples(Watcher& watcher, size_t samples, int) -> decltype(watcher.epoch_samples(samples), void()) {
+    watcher.epoch_samples(samples);
+}
+
+template <typename Watcher>
+void notify_samples(Watcher& /*watcher*/, size_t /*samples*/, long) {}
+
+template <typename Watcher, typename Generator>
+auto notify_stalls(Watcher& watcher, const Generator& generator, int) -> decltype(watcher.epoch_stalls(generator.stalls()), void()) {
+    watcher.epoch_stalls(generator.stalls());
+}
+
+template <typename Watcher, typename Generator>
+void notify_stalls(Watcher& /*watcher*/, const Generator& /*generator*/, long) {}
+
+} //end of namespace watcher_detail
+
+/*!
+ * \brief Give the number of samples that have been processed (since the
+ * last call) to the watcher, if it has an epoch_samples function.
+ * \param watcher The watcher to notify
+ * \param samples The number of processed samples
+ */
+template <typename Watcher>
+void notify_watcher_samples(Watcher& watcher, size_t samples) {
+    watcher_detail::notify_samples(watcher, samples, 0);
+}
+
+/*!
+ * \brief Give the stalls of the generation of the epoch to the watcher, if
+ * it has an epoch_stalls function and the generator has a stalls function.
+ * \param watcher The watcher to notify
+ * \param generator The generator of the epoch
+ */
+template <typename Watcher, typename Generator>
+void notify_watcher_stalls(Watcher& watcher, const Generator& generator) {
+    watcher_detail::notify_stalls(watcher, generator, 0);
+}
+
 /*!
  * \brief The default watcher for RBM pretraining.
  * \tparam R The RBM type
@@ -26,6 +70,7 @@ namespace dll {
 template <typename R>
 struct default_rbm_watcher {
     cpp::stop_watch<std::chrono::seconds> watch; ///< Timer for the entire training
+    report_throttle throttle;                    ///< The throttling of the batches reported
 
     /*!
      * \brief Indicates that the training of the given RBM started.
@@ -86,6 +131,8 @@ struct default_rbm_watcher {
      */
     template <typename RBM = R>
     void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        reporter().flush();
+
         char formatted[1024];
         if (rbm_layer_traits<RBM>::free_energy()) {
             snprintf(formatted, 1024, "epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f", epoch,
@@ -108,10 +155,16 @@ struct default_rbm_watcher {
      */
     template <typename RBM = R>
     void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
-        char formatted[1024];
-        sprintf(formatted, "Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f",
-            batch, batches, context.batch_error, context.batch_sparsity);
-        std::cout << formatted << std::endl;
+        if (throttle.pass()) {
+            progress_record record;
+            record.kind    = progress_record::kind_t::RBM_BATCH;
+            record.batch   = batch;
+            record.batches = batches;
+            record.error   = context.batch_error;
+            record.value   = context.batch_sparsity;
+
+            reporter().push(record);
+        }
 
         cpp_unused(rbm);
     }
@@ -122,12 +175,33 @@ struct default_rbm_watcher {
      */
     template <typename RBM = R>
     void training_end(const RBM& rbm) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         cpp_unused(rbm);
     }
 };
 
+/*!
+ * \brief A watcher for RBM pretraining that does not output anything.
+ * \tparam R The RBM type
+ */
+template <typename R>
+struct mute_rbm_watcher {
+    template <typename RBM = R>
+    void training_begin(const RBM& /*rbm*/) {}
+
+    template <typename RBM = R>
+    void epoch_end(size_t /*epoch*/, const rbm_training_context& /*context*/, const RBM& /*rbm*/) {}
+
+    template <typename RBM = R>
+    void batch_end(const RBM& /*rbm*/, const rbm_training_context& /*context*/, size_t /*batch*/, size_t /*batches*/) {}
+
+    template <typename RBM = R>
+    void training_end(const RBM& /*rbm*/) {}
+};
+
 /*!
  * \brief The default watcher for DBN training/pretraining
  */
@@ -140,6 +214,7 @@ struct default_dbn_watcher {
     dll::stop_timer ft_epoch_timer;              ///< Timer for an epoch
     dll::stop_timer ft_batch_timer;              ///< Timer for a batch
     cpp::stop_watch<std::chrono::seconds> watch; ///< Timer for the entire training
+    report_throttle throttle;                    ///< The throttling of the batches reported
 
     /*!
      * \brief Indicates that the pretraining has begun for the given
@@ -265,6 +340,8 @@ struct default_dbn_watcher {
         cpp_unused(dbn);
         auto duration = ft_epoch_timer.stop();
 
+        reporter().flush();
+
         if /*constexpr*/ (dbn_traits<DBN>::error_on_epoch()){
             printf("Epoch %3ld/%ld - Classification error: %.5f Loss: %.5f Time %ldms \n", epoch, ft_max_epochs, error, loss, duration);
         } else {
@@ -285,6 +362,8 @@ struct default_dbn_watcher {
         cpp_unused(dbn);
         auto duration = ft_epoch_timer.stop();
 
+        reporter().flush();
+
         if /*constexpr*/ (dbn_traits<DBN>::error_on_epoch()){
             printf("Epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f Time %ldms \n",
                 epoch, ft_max_epochs, train_error, train_loss, val_error, val_loss, duration);
@@ -316,9 +395,18 @@ struct default_dbn_watcher {
      * \param dbn The DBN being trained
      */
     void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
-        auto duration = ft_batch_timer.stop();
-        printf("Epoch %3ld:%ld/%ld- B. Error: %.5f B. Loss: %.5f Time %ldms\n", epoch, batch, batches, batch_error, batch_loss, duration);
-        std::cout.flush();
+        if (throttle.pass()) {
+            progress_record record;
+            record.kind     = progress_record::kind_t::FT_BATCH;
+            record.epoch    = epoch;
+            record.batch    = batch;
+            record.batches  = batches;
+            record.duration = ft_batch_timer.stop();
+            record.error    = batch_error;
+            record.value    = batch_loss;
+
+            reporter().push(record);
+        }
 
         cpp_unused(dbn);
     }
@@ -331,9 +419,16 @@ struct default_dbn_watcher {
      * \param dbn The DBN being trained
      */
     void ft_batch_end(size_t epoch, double batch_error, double batch_loss, const DBN& dbn) {
-        auto duration = ft_batch_timer.stop();
-        printf("Epoch %3ld - B.Error: %.5f B.Loss: %.5f Time %ldms\n", epoch, batch_error, batch_loss, duration);
-        std::cout.flush();
+        if (throttle.pass()) {
+            progress_record record;
+            record.kind     = progress_record::kind_t::FT_EPOCH_BATCH;
+            record.epoch    = epoch;
+            record.duration = ft_batch_timer.stop();
+            record.error    = batch_error;
+            record.value    = batch_loss;
+
+            reporter().push(record);
+        }
 
         cpp_unused(dbn);
     }
@@ -343,6 +438,8 @@ struct default_dbn_watcher {
      * \param dbn The DBN that is being trained
      */
     void fine_tuning_end(const DBN& dbn) {
+        reporter().flush();
+
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         cpp_unused(dbn);
@@ -0,0 +1,18 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// The explicit instantiations of the prebuilt library (libdll_prebuilt.a)
+
+#include "dll/prebuilt.hpp"
+
+#define DLL_INSTANTIATE(...) template struct __VA_ARGS__;
+
+DLL_PREBUILT_LAYERS(DLL_INSTANTIATE)
+DLL_PREBUILT_TRAINERS(DLL_INSTANTIATE)
+DLL_PREBUILT_NETWORKS(DLL_INSTANTIATE)
+
+#undef DLL_INSTANTIATE
@@ -23,9 +23,11 @@ namespace {
 
 void print_usage() {
     std::cout << "Usage: dllp conf_file action" << std::endl;
+    std::cout << "       dllp --library conf_file action" << std::endl;
+    std::cout << "       dllp --sweep [--jobs N] conf_file... -- action" << std::endl;
 }
 
-void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::string& source_file) {
+void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::vector<std::string>& source_files, bool& sweep, size_t& jobs) {
     size_t i = 1;
 
     while (true) {
@@ -38,15 +40,41 @@ void parse_options(int argc, char* argv[], dll::processor::options& opt, std::ve
         } else if (std::string(argv[i]) == "--cublas") {
             opt.cublas = true;
             ++i;
+        } else if (std::string(argv[i]) == "--gpu") {
+            opt.gpu = true;
+            ++i;
         } else if (std::string(argv[i]) == "--cache") {
             opt.cache = true;
             ++i;
+        } else if (std::string(argv[i]) == "--no-build-cache") {
+            opt.build_cache = false;
+            ++i;
+        } else if (std::string(argv[i]) == "--pch") {
+            opt.pch = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--library") {
+            opt.library = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--sweep") {
+            sweep = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--jobs" && i + 1 < size_t(argc)) {
+            jobs = std::stoul(argv[i + 1]);
+            i += 2;
         } else {
             break;
         }
     }
 
-    source_file = argv[i++];
+    if (sweep) {
+        for (; i < size_t(argc) && std::string(argv[i]) != "--"; ++i) {
+            source_files.emplace_back(argv[i]);
+        }
+
+        ++i;
+    } else if (i < size_t(argc)) {
+        source_files.emplace_back(argv[i++]);
+    }
 
     for (; i < size_t(argc); ++i) {
         actions.emplace_back(argv[i]);
@@ -75,11 +103,23 @@ int main(int argc, char* argv[]) {
 
     dll::processor::options opt;
     std::vector<std::string> actions;
-    std::string source_file;
+    std::vector<std::string> source_files;
+    bool sweep  = false;
+    size_t jobs = 1;
 
-    parse_options(argc, argv, opt, actions, source_file);
+    parse_options(argc, argv, opt, actions, source_files, sweep, jobs);
 
-    //Process the file
+    if (source_files.empty() || actions.empty()) {
+        std::cout << "dllp: Not enough arguments" << std::endl;
+        print_usage();
+        return 1;
+    }
+
+    //Process the file(s)
+
+    if (sweep) {
+        return dll::processor::process_sweep(opt, actions, source_files, jobs);
+    }
 
-    return dll::processor::process_file(opt, actions, source_file);
+    return dll::processor::process_file(opt, actions, source_files.front());
 }
@@ -90,6 +90,14 @@ bool dllp::valid_sparsity(const std::string& sparsity) {
     return sparsity == "global" || sparsity == "local" || sparsity == "lee";
 }
 
+bool dllp::valid_optimization(const std::string& level) {
+    return level == "O1" || level == "O2" || level == "O3" || level == "Ofast";
+}
+
+bool dllp::valid_vectorize(const std::string& mode) {
+    return mode == "full" || mode == "expr" || mode == "impl" || mode == "none";
+}
+
 std::vector<std::string> dllp::read_lines(const std::string& source_file) {
     std::vector<std::string> lines;
 
@@ -11,9 +11,18 @@
 #include <fstream>
 #include <memory>
 #include <cstdlib>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "cpp_utils/string.hpp"
 
@@ -84,6 +93,24 @@ dll::processor::datasource parse_datasource(const std::vector<std::string>& line
             source.shift   = true;
             source.shift_d = std::stod(extract_value(lines[i], "shift: "));
             ++i;
+        } else if (starts_with(lines[i], "out_of_memory: ")) {
+            source.out_of_memory = extract_value(lines[i], "out_of_memory: ") == "true";
+            ++i;
+        } else if (starts_with(lines[i], "threaded: ")) {
+            source.threaded = extract_value(lines[i], "threaded: ") == "true";
+            ++i;
+        } else if (starts_with(lines[i], "big_batch_size: ")) {
+            source.big_batch_size = std::stol(extract_value(lines[i], "big_batch_size: "));
+            ++i;
+        } else if (starts_with(lines[i], "noise: ")) {
+            source.noise = std::stol(extract_value(lines[i], "noise: "));
+            ++i;
+        } else if (starts_with(lines[i], "mirroring: ")) {
+            source.mirroring = extract_value(lines[i], "mirroring: ") == "true";
+            ++i;
+        } else if (starts_with(lines[i], "elastic_distortion: ")) {
+            source.elastic_distortion = std::stol(extract_value(lines[i], "elastic_distortion: "));
+            ++i;
         } else {
             break;
         }
@@ -93,6 +120,14 @@ dll::processor::datasource parse_datasource(const std::vector<std::string>& line
         std::cout << "dllp:: error: missing source" << std::endl;
     }
 
+    if (source.streamed() && (source.shift || source.normal_noise)) {
+        std::cout << "dllp:: error: shift and normal_noise are not supported by streamed sources" << std::endl;
+    }
+
+    if (source.reader == "binary" && (source.threaded || source.big_batch_size > 1 || source.noise || source.mirroring || source.elastic_distortion)) {
+        std::cout << "dllp:: error: the binary reader does not support threads, big batches and augmentation" << std::endl;
+    }
+
     return source;
 }
 
@@ -115,8 +150,10 @@ void parse_datasource_pack(dll::processor::datasource_pack& pack, const std::vec
     pack.labels.limit  = limit;
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
-bool compile(const options& opt);
+void generate(const options& opt, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
+bool compile(const options& opt, const dll::processor::task& t);
+void generate_library(const options& opt, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t);
+bool compile_library(const options& opt, const dll::processor::task& t);
 
 void process_includes(std::vector<std::string>& lines){
     for (size_t i = 0; i < lines.size();) {
@@ -151,6 +188,8 @@ void process_data(size_t& i, const std::vector<std::string>& lines, dll::process
             dllp::parse_datasource_pack(t.training, lines, ++i);
         } else if (lines[i] == "testing:") {
             dllp::parse_datasource_pack(t.testing, lines, ++i);
+        } else if (lines[i] == "predicting:") {
+            dllp::parse_datasource_pack(t.predicting, lines, ++i);
         } else {
             break;
         }
@@ -184,6 +223,33 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                     ++i;
                 } else if (dllp::starts_with(lines[i], "big_batch: ")) {
                     t.general_desc.big_batch = std::stol(dllp::extract_value(lines[i], "big_batch: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "optimization: ")) {
+                    t.general_desc.optimization = dllp::extract_value(lines[i], "optimization: ");
+
+                    if (!dllp::valid_optimization(t.general_desc.optimization)) {
+                        std::cout << "dllp: error: invalid optimization must be one of [O1, O2, O3, Ofast]" << std::endl;
+                        return false;
+                    }
+
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "native: ")) {
+                    t.general_desc.native = dllp::extract_value(lines[i], "native: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "lto: ")) {
+                    t.general_desc.lto = dllp::extract_value(lines[i], "lto: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "pgo: ")) {
+                    t.general_desc.pgo = dllp::extract_value(lines[i], "pgo: ") == "true";
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "vectorize: ")) {
+                    t.general_desc.vectorize = dllp::extract_value(lines[i], "vectorize: ");
+
+                    if (!dllp::valid_vectorize(t.general_desc.vectorize)) {
+                        std::cout << "dllp: error: invalid vectorize must be one of [full, expr, impl, none]" << std::endl;
+                        return false;
+                    }
+
                     ++i;
                 } else {
                     break;
@@ -236,6 +302,26 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
             while (i < lines.size()) {
                 if (dllp::starts_with(lines[i], "file:")) {
                     t.w_desc.file = dllp::extract_value(lines[i], "file: ");
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+        } else if (lines[i] == "prediction:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "file:")) {
+                    t.p_desc.file = dllp::extract_value(lines[i], "file: ");
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "format: ")) {
+                    t.p_desc.format = dllp::extract_value(lines[i], "format: ");
+
+                    if (!t.p_desc.valid()) {
+                        std::cout << "dllp: error: invalid format must be one of [csv, float, bf16, bits]" << std::endl;
+                        return false;
+                    }
+
                     ++i;
                 } else {
                     break;
@@ -399,7 +485,8 @@ bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actio
         struct stat attr_exec;
 
         if (!stat(source_file.c_str(), &attr_conf)) {
-            if (!stat("./.dbn.out", &attr_exec)) {
+            // The library is compiled with the executable
+            if (!stat(("./" + opt.output + ".out").c_str(), &attr_exec) && (!opt.library || !stat(("./" + opt.output + ".so").c_str(), &attr_exec))) {
                 auto mtime_conf = attr_conf.st_mtime;
                 auto mtime_exec = attr_exec.st_mtime;
 
@@ -415,12 +502,21 @@ bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actio
 
     if (process) {
         //Generate the CPP file
-        dllp::generate(layers, t, actions);
+        dllp::generate(opt, layers, t, actions);
 
         //Compile the generate file
-        if (!dllp::compile(opt)) {
+        if (!dllp::compile(opt, t)) {
             return false;
         }
+
+        //Compile the inference library
+        if (opt.library) {
+            dllp::generate_library(opt, layers, t);
+
+            if (!dllp::compile_library(opt, t)) {
+                return false;
+            }
+        }
     }
 
     return true;
@@ -438,6 +534,12 @@ std::string datasource_to_string(const std::string& lhs, const dll::processor::d
     result += lhs + ".normal_noise = " + (ds.normal_noise ? "true" : "false") + ";\n";
     result += lhs + ".normal_noise_d = " + std::to_string(ds.normal_noise_d) + ";\n";
     result += lhs + ".limit = " + std::to_string(ds.limit) + ";\n";
+    result += lhs + ".out_of_memory = " + (ds.out_of_memory ? "true" : "false") + ";\n";
+    result += lhs + ".threaded = " + (ds.threaded ? "true" : "false") + ";\n";
+    result += lhs + ".big_batch_size = " + std::to_string(ds.big_batch_size) + ";\n";
+    result += lhs + ".noise = " + std::to_string(ds.noise) + ";\n";
+    result += lhs + ".mirroring = " + (ds.mirroring ? "true" : "false") + ";\n";
+    result += lhs + ".elastic_distortion = " + std::to_string(ds.elastic_distortion) + ";\n";
 
     return result;
 }
@@ -466,6 +568,15 @@ std::string w_desc_to_string(const std::string& lhs, const dll::processor::weigh
     return result;
 }
 
+std::string p_desc_to_string(const std::string& lhs, const dll::processor::prediction_desc& desc) {
+    std::string result;
+
+    result += lhs + ".file = \"" + desc.file + "\";\n";
+    result += lhs + ".format = \"" + desc.format + "\";";
+
+    return result;
+}
+
 std::string task_to_string(const std::string& name, const dll::processor::task& t) {
     std::string result;
 
@@ -484,12 +595,16 @@ std::string task_to_string(const std::string& name, const dll::processor::task&
     result += "\n";
     result += datasource_to_string("   " + name + ".testing.labels", t.testing.labels);
     result += "\n";
+    result += datasource_to_string("   " + name + ".predicting.samples", t.predicting.samples);
+    result += "\n";
     result += pt_desc_to_string("   " + name + ".pt_desc", t.pt_desc);
     result += "\n";
     result += ft_desc_to_string("   " + name + ".ft_desc", t.ft_desc);
     result += "\n";
     result += w_desc_to_string("   " + name + ".w_desc", t.w_desc);
     result += "\n";
+    result += p_desc_to_string("   " + name + ".p_desc", t.p_desc);
+    result += "\n";
 
     return result;
 }
@@ -513,6 +628,66 @@ std::string vector_to_string(const std::string& name, const std::vector<std::str
     return result;
 }
 
+std::string stream_to_string(const std::string& name, const dll::processor::datasource& ds) {
+    // The generators of the sources that are read at once are never used
+    if (!ds.streamed()) {
+        return "   template <typename... P>\n   using " + name + " = dll::outmemory_data_generator_desc<P...>;\n";
+    }
+
+    std::string params;
+
+    if (ds.binarize) {
+        params += ", dll::binarize_pre<30>";
+    }
+
+    if (ds.normalize) {
+        params += ", dll::normalize_pre";
+    }
+
+    if (ds.scale) {
+        const double divisor = std::round(1.0 / ds.scale_d);
+
+        if (divisor < 1.0 || std::abs(divisor * ds.scale_d - 1.0) > 1e-6) {
+            std::cout << "dllp: error: streamed sources can only be scaled by the inverse of an integer" << std::endl;
+        } else {
+            params += ", dll::scale_pre<" + std::to_string(size_t(divisor)) + ">";
+        }
+    }
+
+    std::string generator = "dll::binary_data_generator_desc";
+
+    if (ds.reader != "binary") {
+        generator = "dll::outmemory_data_generator_desc";
+
+        if (ds.threaded) {
+            params += ", dll::threaded";
+        }
+
+        if (ds.big_batch_size > 1) {
+            params += ", dll::big_batch_size<" + std::to_string(ds.big_batch_size) + ">";
+        }
+
+        if (ds.noise) {
+            params += ", dll::noise<" + std::to_string(ds.noise) + ">";
+        }
+
+        if (ds.mirroring) {
+            params += ", dll::horizontal_mirroring";
+        }
+
+        if (ds.elastic_distortion) {
+            params += ", dll::elastic_distortion<" + std::to_string(ds.elastic_distortion) + ">";
+        }
+    }
+
+    std::string result;
+
+    result += "   template <typename... P>\n";
+    result += "   using " + name + " = " + generator + "<P..." + params + ">;\n";
+
+    return result;
+}
+
 std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t){
     std::string reader;
     if(!t.training.samples.reader.empty()){
@@ -523,6 +698,8 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
         reader = t.pretraining.samples.reader;
     } else if(!t.pretraining_clean.samples.reader.empty()){
         reader = t.pretraining_clean.samples.reader;
+    } else if(!t.predicting.samples.reader.empty()){
+        reader = t.predicting.samples.reader;
     } else {
         std::cerr << "dllp: error: no reader specified " << std::endl;
         return "";
@@ -534,7 +711,7 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
         } else {
             return "etl::fast_dyn_vector<float, 784>";
         }
-    } else if(reader == "text"){
+    } else if(reader == "text" || reader == "binary"){
         if(layers.front()->is_conv()){
             return "etl::dyn_matrix<float, 3>";
         } else {
@@ -546,22 +723,7 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     }
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
-    std::ofstream out_stream(".dbn.cpp");
-
-    out_stream << "#include <memory>\n";
-
-    out_stream << "#include \"dll/processor/processor.hpp\"\n";
-    out_stream << "#include \"dll/rbm/rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
-    out_stream << "#include \"dll/neural/dense_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/conv_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/mp_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/avgp_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/activation_layer.hpp\"\n";
-    out_stream << "#include \"dll/dbn.hpp\"\n";
-
+void generate_network(std::ostream& out_stream, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t) {
     out_stream << "using dbn_t = dll::dbn_desc<dll::dbn_layers<\n";
 
     std::string comma = "  ";
@@ -603,6 +765,45 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
     out_stream << ", dll::weight_decay<dll::decay_type::" << decay_to_str(t.ft_desc.decay) << ">\n";
 
     out_stream << ">::dbn_t;\n\n";
+}
+
+void generate(const options& opt, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
+    // The headers are always the same, they are in a separate header
+    // that can be precompiled
+    {
+        std::ofstream header_stream(opt.output + ".hpp");
+
+        header_stream << "#include <memory>\n";
+
+        header_stream << "#include \"dll/processor/processor.hpp\"\n";
+        header_stream << "#include \"dll/rbm/rbm.hpp\"\n";
+        header_stream << "#include \"dll/rbm/conv_rbm.hpp\"\n";
+        header_stream << "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
+        header_stream << "#include \"dll/neural/dense_layer.hpp\"\n";
+        header_stream << "#include \"dll/neural/conv_layer.hpp\"\n";
+        header_stream << "#include \"dll/pooling/mp_layer.hpp\"\n";
+        header_stream << "#include \"dll/pooling/avgp_layer.hpp\"\n";
+        header_stream << "#include \"dll/neural/activation_layer.hpp\"\n";
+        header_stream << "#include \"dll/dbn.hpp\"\n";
+    }
+
+    std::ofstream out_stream(opt.output + ".cpp");
+
+    out_stream << "#include \"" << opt.output << ".hpp\"\n";
+
+    generate_network(out_stream, layers, t);
+
+    const bool streamed = t.pretraining.samples.streamed() || t.training.samples.streamed() || t.testing.samples.streamed() || t.predicting.samples.streamed();
+
+    // The generators of the streamed sources depend on their options
+    if (streamed) {
+        out_stream << "struct streams {\n";
+        out_stream << stream_to_string("pretraining", t.pretraining.samples);
+        out_stream << stream_to_string("training", t.training.samples);
+        out_stream << stream_to_string("testing", t.testing.samples);
+        out_stream << stream_to_string("predicting", t.predicting.samples);
+        out_stream << "};\n\n";
+    }
 
     out_stream << "int main(int argc, char* argv[]){\n";
     out_stream << "   auto dbn = std::make_unique<dbn_t>();\n";
@@ -640,7 +841,55 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
     out_stream << vector_to_string("actions", final_actions) << "\n";
     out_stream << "   using data_type = " << get_data_type(layers, t) << ";\n";
     out_stream << "   static constexpr bool three = " << layers.front()->is_conv() << ";\n";
-    out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+    if (streamed) {
+        out_stream << "   dll::processor::execute<data_type, three, streams>(*dbn, t, actions);\n";
+    } else {
+        out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+    }
+    out_stream << "}\n";
+}
+
+void generate_library(const options& opt, const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t) {
+    std::ofstream out_stream(opt.output + "_lib.cpp");
+
+    out_stream << "#include \"" << opt.output << ".hpp\"\n";
+    out_stream << "#include \"dll/processor/inference.h\"\n";
+    out_stream << "#include \"dll/processor/inference.hpp\"\n\n";
+
+    generate_network(out_stream, layers, t);
+
+    out_stream << "using model_t = dll::processor::inference_model<dbn_t>;\n\n";
+    out_stream << "namespace {\n";
+    out_stream << "std::unique_ptr<model_t> model;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "int dllp_load(const char* model_file){\n";
+    out_stream << "   model = model_t::load(model_file);\n";
+    out_stream << "   return model ? 0 : 1;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "void dllp_unload(){\n";
+    out_stream << "   model.reset();\n";
+    out_stream << "}\n\n";
+
+    out_stream << "size_t dllp_input_size(){\n";
+    out_stream << "   return model ? model->input_size : 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "size_t dllp_output_size(){\n";
+    out_stream << "   return model ? model->output_size : 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "int dllp_predict_batch(const float* input, size_t n, size_t* labels){\n";
+    out_stream << "   if (!model) { return 1; }\n";
+    out_stream << "   model->predict_batch(input, n, labels);\n";
+    out_stream << "   return 0;\n";
+    out_stream << "}\n\n";
+
+    out_stream << "int dllp_features_batch(const float* input, size_t n, float* features){\n";
+    out_stream << "   if (!model) { return 1; }\n";
+    out_stream << "   model->features_batch(input, n, features);\n";
+    out_stream << "   return 0;\n";
     out_stream << "}\n";
 }
 
@@ -667,50 +916,312 @@ bool append_pkg_flags(std::string& flags, const std::string& pkg) {
     return true;
 }
 
-bool compile(const options& opt) {
+uint64_t hash_content(const std::string& content, uint64_t hash = 14695981039346656037ULL) {
+    // FNV-1a
+    for (auto c : content) {
+        hash ^= uint64_t(static_cast<unsigned char>(c));
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+std::string hash_to_string(uint64_t hash) {
+    char buffer[17];
+    snprintf(buffer, 17, "%016llx", static_cast<unsigned long long>(hash));
+    return {buffer};
+}
+
+bool file_exists(const std::string& file) {
+    struct stat attr;
+    return !stat(file.c_str(), &attr);
+}
+
+bool copy_file(const std::string& from, const std::string& to) {
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary);
+
+    if (!in || !out) {
+        return false;
+    }
+
+    out << in.rdbuf();
+
+    out.close();
+
+    if (!out) {
+        return false;
+    }
+
+    return !chmod(to.c_str(), 0755);
+}
+
+std::string build_cache_directory() {
+    if (const auto* dir = std::getenv("DLLP_CACHE_DIR")) {
+        return dir;
+    }
+
+    const auto* home = std::getenv("HOME");
+
+    if (!home) {
+        return "";
+    }
+
+    std::string cache = std::string(home) + "/.cache";
+    mkdir(cache.c_str(), 0755);
+
+    return cache + "/dllp";
+}
+
+bool precompile_headers(const std::string& cxx, const std::string& flags, const options& opt) {
+    // The precompiled header is only valid for the same headers and flags
+    const auto header_file = opt.output + ".hpp";
+
+    auto header = command_result(cxx + flags + " -E -x c++-header " + header_file);
+
+    if (header.empty()) {
+        std::cout << "dllp: warning: impossible to preprocess the headers, no precompiled headers" << std::endl;
+        return true;
+    }
+
+    auto key = hash_to_string(hash_content(flags, hash_content(header)));
+
+    auto current = read_lines(header_file + ".key");
+
+    if (file_exists(header_file + ".gch") && !current.empty() && current.front() == key) {
+        return true;
+    }
+
     if (!opt.quiet) {
-        std::cout << "Compiling the program..." << std::endl;
+        std::cout << "Precompiling the headers..." << std::endl;
+    }
+
+    if (system((cxx + flags + " -x c++-header " + header_file + " -o " + header_file + ".gch").c_str())) {
+        std::cout << "Precompilation of the headers failed" << std::endl;
+        return false;
+    }
+
+    std::ofstream key_stream(header_file + ".key");
+    key_stream << key << std::endl;
+
+    return true;
+}
+
+std::string profile_flags(const dll::processor::general_desc& desc) {
+    std::string flags;
+
+    flags += " -" + desc.optimization + " ";
+
+    if (desc.vectorize == "full") {
+        flags += " -DETL_VECTORIZE_FULL ";
+    } else if (desc.vectorize == "expr") {
+        flags += " -DETL_VECTORIZE_EXPR ";
+    } else if (desc.vectorize == "impl") {
+        flags += " -DETL_VECTORIZE_IMPL ";
+    }
+
+    if (desc.native) {
+        flags += " -march=native ";
+    }
+
+    if (desc.lto) {
+        flags += " -flto ";
+    }
+
+    return flags;
+}
+
+bool profile_guided_compile(const options& opt, const std::string& compile_command) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the instrumented program..." << std::endl;
     }
 
-    const auto* cxx = std::getenv("CXX");
+    if (system((compile_command + " -fprofile-generate -fprofile-update=atomic ").c_str())) {
+        std::cout << "Compilation failed" << std::endl;
+        return false;
+    }
+
+    // The warm-up run is limited to one epoch of each action
+    if (!opt.quiet) {
+        std::cout << "Running the warm-up for the profile..." << std::endl;
+    }
 
-    std::string compile_command(cxx);
+    if (system(("DLLP_WARMUP=1 ./" + opt.output + ".out > /dev/null").c_str())) {
+        std::cout << "dllp: warning: the warm-up run failed, the profile may be incomplete" << std::endl;
+    }
 
-    compile_command += " -o .dbn.out ";
-    compile_command += " -g ";
-    compile_command += " -O2 -DETL_VECTORIZE_FULL ";
-    compile_command += " -std=c++1y ";
-    compile_command += " -pthread ";
-    compile_command += " .dbn.cpp ";
+    if (!opt.quiet) {
+        std::cout << "Compiling the optimized program..." << std::endl;
+    }
 
+    if (system((compile_command + " -fprofile-use -fprofile-correction -Wno-missing-profile ").c_str())) {
+        std::cout << "Compilation failed" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool package_flags(const options& opt, std::string& pkg_flags) {
     if (opt.mkl) {
-        compile_command += " -DETL_MKL_MODE ";
+        pkg_flags += " -DETL_MKL_MODE ";
 
-        if (!append_pkg_flags(compile_command, "mkl")) {
+        if (!append_pkg_flags(pkg_flags, "mkl")) {
             return false;
         }
     }
 
-    if (opt.cublas) {
-        compile_command += " -DETL_CUBLAS_MODE ";
+    // The GPU mode of ETL enables all its GPU libraries
+    if (opt.gpu) {
+        pkg_flags += " -DETL_GPU ";
 
-        if (!append_pkg_flags(compile_command, "cublas")) {
+        for (const auto* pkg : {"cublas", "cufft", "cudnn"}) {
+            if (!append_pkg_flags(pkg_flags, pkg)) {
+                return false;
+            }
+        }
+    }
+
+    if (opt.cublas && !opt.gpu) {
+        pkg_flags += " -DETL_CUBLAS_MODE ";
+
+        if (!append_pkg_flags(pkg_flags, "cublas")) {
             return false;
         }
     }
 
-    if (opt.cufft) {
-        compile_command += " -DETL_CUFFT_MODE ";
+    if (opt.cufft && !opt.gpu) {
+        pkg_flags += " -DETL_CUFFT_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cufft")) {
+        if (!append_pkg_flags(pkg_flags, "cufft")) {
             return false;
         }
     }
 
-    int compile_result = system(compile_command.c_str());
+    return true;
+}
 
-    if (compile_result) {
-        std::cout << "Compilation failed" << std::endl;
+bool compile(const options& opt, const dll::processor::task& t) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the program..." << std::endl;
+    }
+
+    const std::string cxx(std::getenv("CXX"));
+
+    std::string flags;
+
+    flags += " -g ";
+    flags += profile_flags(t.general_desc);
+    flags += " -std=c++1y ";
+    flags += " -pthread ";
+
+    if (opt.threads) {
+        flags += " -DETL_PARALLEL_THREADS=" + std::to_string(opt.threads) + " ";
+    }
+
+    // Defines and libraries, after the source file
+    std::string pkg_flags;
+
+    if (!package_flags(opt, pkg_flags)) {
+        return false;
+    }
+
+    const auto exe_file = opt.output + ".out";
+
+    std::string compile_command = cxx + " -o " + exe_file + " " + flags + " " + opt.output + ".cpp " + pkg_flags;
+
+    // The executable is cached by the hash of the preprocessed source (it
+    // covers the headers of DLL and ETL), the compiler and the command
+
+    std::string cached_file;
+
+    if (opt.build_cache) {
+        auto cache_dir = build_cache_directory();
+        auto source    = command_result(cxx + flags + pkg_flags + " -E " + opt.output + ".cpp 2>/dev/null");
+
+        if (cache_dir.empty() || source.empty()) {
+            std::cout << "dllp: warning: build cache disabled" << std::endl;
+        } else {
+            mkdir(cache_dir.c_str(), 0755);
+
+            auto hash = hash_content(source);
+            hash      = hash_content(command_result(cxx + " --version"), hash);
+            hash      = hash_content(compile_command, hash);
+            hash      = hash_content(t.general_desc.pgo ? "pgo" : "", hash);
+
+            cached_file = cache_dir + "/" + hash_to_string(hash) + ".out";
+
+            if (file_exists(cached_file) && copy_file(cached_file, exe_file)) {
+                if (!opt.quiet) {
+                    std::cout << "... reused cached executable" << std::endl;
+                }
+
+                return true;
+            }
+        }
+    }
+
+    if (opt.pch && !precompile_headers(cxx, flags + pkg_flags, opt)) {
+        return false;
+    }
+
+    if (t.general_desc.pgo) {
+        if (!profile_guided_compile(opt, compile_command)) {
+            return false;
+        }
+    } else {
+        int compile_result = system(compile_command.c_str());
+
+        if (compile_result) {
+            std::cout << "Compilation failed" << std::endl;
+            return false;
+        }
+    }
+
+    // The executable is stored under a temporary name and renamed, several
+    // dllp processes may share the cache
+    const auto temp_file = cached_file + "." + std::to_string(getpid()) + ".tmp";
+
+    if (!cached_file.empty() && !(copy_file(exe_file, temp_file) && !std::rename((temp_file).c_str(), cached_file.c_str()))) {
+        std::cout << "dllp: warning: impossible to store the executable in the build cache" << std::endl;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "... done" << std::endl;
+    }
+
+    return true;
+}
+
+bool compile_library(const options& opt, const dll::processor::task& t) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the inference library..." << std::endl;
+    }
+
+    const std::string cxx(std::getenv("CXX"));
+
+    // The library is compiled with the profile of the network, the
+    // profile-guided optimization needs the run of the program
+    std::string flags;
+
+    flags += " -g ";
+    flags += profile_flags(t.general_desc);
+    flags += " -std=c++1y ";
+    flags += " -pthread ";
+    flags += " -fPIC -shared ";
+
+    if (opt.threads) {
+        flags += " -DETL_PARALLEL_THREADS=" + std::to_string(opt.threads) + " ";
+    }
+
+    std::string pkg_flags;
+
+    if (!package_flags(opt, pkg_flags)) {
+        return false;
+    }
+
+    if (system((cxx + " -o " + opt.output + ".so " + flags + " " + opt.output + "_lib.cpp " + pkg_flags).c_str())) {
+        std::cout << "Compilation of the library failed" << std::endl;
         return false;
     }
 
@@ -745,7 +1256,7 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         std::cout << "Executing the program" << std::endl;
     }
 
-    auto exec_result = system("./.dbn.out");
+    auto exec_result = system(("./" + opt.output + ".out").c_str());
 
     if (exec_result) {
         std::cout << "Impossible to execute the generated file" << std::endl;
@@ -773,5 +1284,140 @@ std::string dll::processor::process_file_result(const dllp::options& opt, const
 
     //3. Execute and return the result directly
 
-    return dllp::command_result("./.dbn.out");
+    return dllp::command_result("./" + opt.output + ".out");
+}
+
+int dll::processor::process_sweep(const dllp::options& opt, const std::vector<std::string>& actions, const std::vector<std::string>& source_files, size_t jobs) {
+    const size_t n     = source_files.size();
+    const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    jobs = std::max<size_t>(1, std::min(std::min(jobs, n), cores));
+
+    // Each job has its own contiguous range of cores, the number of
+    // threads of each program is set accordingly
+
+    const size_t job_cores = cores / jobs;
+
+    std::vector<dll::processor::task> tasks(n);
+    std::vector<std::vector<std::unique_ptr<dllp::layer>>> layers(n);
+    std::vector<dllp::options> job_opts(n, opt);
+
+    //1. Parse all the configuration files
+
+    for (size_t k = 0; k < n; ++k) {
+        if (!dllp::parse_file(source_files[k], tasks[k], layers[k])) {
+            std::cout << "dllp: error: invalid configuration file " << source_files[k] << std::endl;
+            return 1;
+        }
+
+        job_opts[k].quiet   = true;
+        job_opts[k].threads = job_cores;
+        job_opts[k].output  = ".dbn_sweep_" + std::to_string(k);
+    }
+
+    // Runs the given functor for each experiment, on the given number of workers
+    auto run_jobs = [n](size_t workers, auto&& functor) {
+        std::atomic<size_t> next(0);
+
+        std::vector<std::thread> threads;
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([&, w] {
+                for (size_t k = next++; k < n; k = next++) {
+                    functor(k, w);
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+
+    std::mutex out_lock;
+
+    //2. Compile the programs in parallel, the identical programs are reused
+    //from the build cache
+
+    if (!opt.quiet) {
+        std::cout << "Compiling " << n << " programs..." << std::endl;
+    }
+
+    std::vector<char> compiled(n, false);
+
+    run_jobs(jobs, [&](size_t k, size_t) {
+        compiled[k] = dllp::compile_exe(job_opts[k], actions, source_files[k], tasks[k], layers[k]);
+
+        if (!compiled[k]) {
+            std::lock_guard<std::mutex> l(out_lock);
+            std::cout << "dllp: error: compilation of " << source_files[k] << " failed" << std::endl;
+        }
+    });
+
+    //3. Run the programs, each worker on its own cores
+
+    const bool pin = !dllp::command_result("command -v taskset").empty();
+
+    if (!pin && !opt.quiet) {
+        std::cout << "dllp: warning: taskset not found, the jobs are not pinned" << std::endl;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Running " << n << " experiments (" << jobs << " jobs of " << job_cores << " cores)..." << std::endl;
+    }
+
+    std::vector<int> results(n, -1);
+    std::vector<std::string> outputs(n);
+
+    run_jobs(jobs, [&](size_t k, size_t w) {
+        if (!compiled[k]) {
+            return;
+        }
+
+        std::string command = "./" + job_opts[k].output + ".out";
+
+        if (pin) {
+            const size_t first = w * job_cores;
+            command = "taskset -c " + std::to_string(first) + "-" + std::to_string(first + job_cores - 1) + " " + command;
+        }
+
+        const auto log_file = job_opts[k].output + ".log";
+
+        results[k] = system((command + " > " + log_file + " 2>&1").c_str());
+
+        std::ifstream log_stream(log_file);
+        std::stringstream log;
+        log << log_stream.rdbuf();
+        outputs[k] = log.str();
+
+        if (!opt.quiet) {
+            std::lock_guard<std::mutex> l(out_lock);
+            std::cout << "... " << source_files[k] << (results[k] ? " failed" : " done") << std::endl;
+        }
+    });
+
+    //4. Collect the results into one report
+
+    std::ofstream report("dllp_sweep.report");
+
+    int status = 0;
+
+    for (size_t k = 0; k < n; ++k) {
+        const std::string result = !compiled[k] ? "compilation failed" : results[k] ? "execution failed" : "success";
+
+        report << "=== " << source_files[k] << ": " << result << "\n";
+        report << outputs[k] << "\n";
+
+        std::cout << source_files[k] << ": " << result << std::endl;
+
+        if (!compiled[k] || results[k]) {
+            status = 1;
+        }
+    }
+
+    if (!opt.quiet) {
+        std::cout << "Report written to dllp_sweep.report" << std::endl;
+    }
+
+    return status;
 }
@@ -11,6 +11,8 @@
  */
 
 #include <deque>
+#include <thread>
+#include <sstream>
 
 #include "dll_test.hpp"
 
@@ -328,3 +330,1148 @@ TEST_CASE("unit/augment/mnist/8", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.3);
 }
+
+// Use a memory-mapped binary dataset for fine-tuning
+TEST_CASE("unit/augment/mnist/9", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_binary_dataset("/tmp/dll_mnist_train.bin", dataset.training_images, dataset.training_labels));
+    REQUIRE(dll::write_binary_dataset("/tmp/dll_mnist_test.bin", dataset.test_images, dataset.test_labels));
+
+    using generator_t = dll::binary_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_binary_generator<1>("/tmp/dll_mnist_train.bin", 10, generator_t{});
+    auto test_generator  = dll::make_binary_generator<1>("/tmp/dll_mnist_test.bin", 10, generator_t{});
+
+    REQUIRE(train_generator->size() == dataset.training_images.size());
+    REQUIRE(test_generator->size() == dataset.test_images.size());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a memory-mapped compressed dataset for fine-tuning
+TEST_CASE("unit/augment/mnist/compressed/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    // Chunks that are not multiples of the batch size, with a partial last one
+    REQUIRE(dll::write_compressed_dataset("/tmp/dll_mnist_train.dllz", dataset.training_images, dataset.training_labels, 64));
+    REQUIRE(dll::write_compressed_dataset("/tmp/dll_mnist_test.dllz", dataset.test_images, dataset.test_labels, 64));
+
+    using generator_t = dll::binary_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_compressed_generator<1>("/tmp/dll_mnist_train.dllz", 10, generator_t{});
+    auto test_generator  = dll::make_compressed_generator<1>("/tmp/dll_mnist_test.dllz", 10, generator_t{});
+
+    REQUIRE(train_generator->size() == dataset.training_images.size());
+    REQUIRE(test_generator->size() == dataset.test_images.size());
+
+    // The samples are read back in order
+    train_generator->reset();
+
+    for (size_t b = 0; b < 3; ++b) {
+        auto batch = train_generator->data_batch();
+
+        for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+            REQUIRE(etl::sum(etl::abs(batch(i) - dataset.training_images[b * 25 + i] / 255.0f)) == Approx(0.0f));
+        }
+
+        train_generator->next_batch();
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use several augmentation workers for in-memory and out-memory generators
+TEST_CASE("unit/augment/mnist/10", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::big_batch_size<6>, dll::threaded_workers<3>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+    using test_generator_t  = dll::outmemory_data_generator_desc<dll::batch_size<20>, dll::big_batch_size<6>, dll::threaded_workers<3>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        test_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a threaded out-memory generator spinning before parking
+TEST_CASE("unit/augment/mnist/11", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::threaded, dll::spin_wait<1000>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an in-memory generator with a bfloat16 input cache
+TEST_CASE("unit/augment/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::bf16_cache, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    // The inputs are only stored with 8 bits of mantissa
+    train_generator->reset();
+
+    auto batch = train_generator->data_batch();
+
+    for (size_t i = 0; i < etl::size(batch(0)); ++i) {
+        REQUIRE(batch(0)[i] == Approx(dataset.training_images[0][i] / 255.0f).epsilon(1e-2));
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Shuffle the indices instead of the samples
+TEST_CASE("unit/augment/mnist/13", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::index_shuffle, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    // The batches are gathered through the permutation
+    train_generator->reset_shuffle();
+
+    auto batch  = train_generator->data_batch();
+    auto labels = train_generator->label_batch();
+
+    for (size_t s = 0; s < 25; ++s) {
+        const size_t i = train_generator->order[s];
+
+        for (size_t j = 0; j < etl::size(batch(s)); ++j) {
+            REQUIRE(batch(s)[j] == Approx(dataset.training_images[i][j] / 255.0f));
+        }
+
+        REQUIRE(labels(s, dataset.training_labels[i]) == 1.0f);
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Keep the raw 8-bit images in the cache
+TEST_CASE("unit/augment/mnist/14", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::u8_cache, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(sizeof(etl::value_t<decltype(train_generator->input_cache)>) == 1);
+
+    // The scaling is done when the batch is generated
+    train_generator->reset();
+
+    auto batch = train_generator->data_batch();
+
+    for (size_t i = 0; i < etl::size(batch(0)); ++i) {
+        REQUIRE(batch(0)[i] == Approx(dataset.training_images[0][i] / 255.0f));
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an out-memory generator with prefetching for fine-tuning
+TEST_CASE("unit/augment/mnist/15", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    // Room for 3 batches per buffer
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::prefetch_budget<6 * 25 * (28 * 28 + 10) * 4>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    REQUIRE(train_generator->big_batches == 3);
+
+    // All the batches are generated, in order
+    size_t b = 0;
+    for (train_generator->reset(); train_generator->has_next_batch(); train_generator->next_batch()) {
+        auto batch = train_generator->data_batch();
+
+        REQUIRE(batch(0)[300] == Approx(dataset.training_images[b * 25][300] / 255.0f));
+
+        ++b;
+    }
+
+    REQUIRE(b == 20);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Masking noise on the batches of an in-memory generator
+TEST_CASE("unit/augment/mnist/16", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using pretrain_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::masking_noise<30>, dll::autoencoder, dll::binarize_pre<30>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_images,
+        dataset.training_images.size(), 10,
+        pretrain_generator_t{});
+
+    generator->reset();
+
+    etl::dyn_matrix<float, 2> first(generator->data_batch());
+
+    auto labels = generator->label_batch();
+
+    size_t ones   = 0;
+    size_t masked = 0;
+
+    for (size_t i = 0; i < etl::size(first); ++i) {
+        // The noise only removes values and the labels are not corrupted
+        REQUIRE(first[i] <= labels[i]);
+
+        ones += labels[i] == 1.0f;
+        masked += labels[i] == 1.0f && first[i] == 0.0f;
+    }
+
+    REQUIRE(ones > 0);
+    CHECK(double(masked) / ones == Approx(0.3).epsilon(0.1));
+
+    // The batch is generated once
+    etl::dyn_matrix<float, 2> again(generator->data_batch());
+    REQUIRE(etl::sum(first - again) == 0.0f);
+
+    // A new noise pattern for the next epoch
+    generator->reset();
+
+    etl::dyn_matrix<float, 2> second(generator->data_batch());
+    REQUIRE(etl::sum(etl::abs(first - second)) > 0.0f);
+}
+
+// The prefetched batches are the batches of the generator
+TEST_CASE("unit/augment/prefetch/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(110);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    std::vector<etl::dyn_matrix<float, 2>> expected;
+
+    generator->reset();
+
+    while (generator->has_next_batch()) {
+        expected.emplace_back(etl::force_temporary(generator->data_batch()));
+        generator->next_batch();
+    }
+
+    generator->reset();
+
+    size_t b = 0;
+
+    {
+        dll::batch_prefetcher<std::decay_t<decltype(*generator)>> prefetcher(*generator);
+
+        while (prefetcher.has_next_batch()) {
+            REQUIRE(b < expected.size());
+            REQUIRE(prefetcher.current_batch() == b);
+            REQUIRE(etl::dim<0>(prefetcher.data_batch()) == etl::dim<0>(expected[b]));
+
+            for (size_t i = 0; i < etl::size(expected[b]); ++i) {
+                REQUIRE(prefetcher.data_batch()[i] == Approx(expected[b][i]));
+            }
+
+            ++b;
+            prefetcher.next_batch();
+        }
+    }
+
+    REQUIRE(b == expected.size());
+}
+
+// The view generator gathers the same batches as the in-memory generator
+TEST_CASE("unit/augment/view/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(110);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // The same samples as std::vector rows and as raw contiguous storage
+    std::vector<std::vector<float>> rows;
+    std::vector<float> raw;
+
+    for (auto& image : dataset.training_images) {
+        rows.emplace_back(image.begin(), image.end());
+        raw.insert(raw.end(), image.begin(), image.end());
+    }
+
+    auto row_generator = dll::make_view_generator(rows, dataset.training_labels, 10, generator_t{});
+    auto raw_generator = dll::make_view_generator(raw.data(), rows.size(), std::array<size_t, 1>{{28 * 28}}, dataset.training_labels.begin(), 10, generator_t{});
+
+    REQUIRE(row_generator->size() == generator->size());
+    REQUIRE(row_generator->batches() == generator->batches());
+
+    generator->reset();
+    row_generator->reset();
+    raw_generator->reset();
+
+    while (generator->has_next_batch()) {
+        REQUIRE(row_generator->has_next_batch());
+        REQUIRE(raw_generator->has_next_batch());
+
+        auto data  = etl::force_temporary(generator->data_batch());
+        auto label = etl::force_temporary(generator->label_batch());
+
+        REQUIRE(etl::dim<0>(row_generator->data_batch()) == etl::dim<0>(data));
+
+        for (size_t i = 0; i < etl::size(data); ++i) {
+            REQUIRE(row_generator->data_batch()[i] == Approx(data[i]));
+            REQUIRE(raw_generator->data_batch()[i] == Approx(data[i]));
+        }
+
+        for (size_t i = 0; i < etl::size(label); ++i) {
+            REQUIRE(row_generator->label_batch()[i] == Approx(label[i]));
+        }
+
+        generator->next_batch();
+        row_generator->next_batch();
+        raw_generator->next_batch();
+    }
+
+    REQUIRE(!row_generator->has_next_batch());
+
+    // The shuffle does not modify the storage of the user
+    row_generator->reset_shuffle();
+    REQUIRE(rows[0][0] == dataset.training_images[0][0]);
+}
+
+// Fine-tune directly on std::vector rows, viewed by the network
+TEST_CASE("unit/augment/view/2", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    std::vector<std::vector<float>> rows;
+
+    for (auto& image : dataset.training_images) {
+        rows.emplace_back(image.begin(), image.end());
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(rows, dataset.training_labels, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(dataset.training_images, dataset.training_labels);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 5e-2);
+}
+
+// The compact labels give the same categorical batches
+TEST_CASE("unit/augment/labels/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(110);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t         = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+    using compact_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::compact_labels, dll::scale_pre<255>>;
+    using out_generator_t     = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<2>, dll::categorical, dll::compact_labels, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto compact_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        compact_generator_t{});
+
+    auto out_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        out_generator_t{});
+
+    // Only the class indices are stored
+    REQUIRE(etl::size(compact_generator->label_cache) == dataset.training_images.size());
+
+    generator->reset();
+    compact_generator->reset();
+    out_generator->reset();
+
+    while (generator->has_next_batch()) {
+        REQUIRE(compact_generator->has_next_batch());
+        REQUIRE(out_generator->has_next_batch());
+
+        auto label = etl::force_temporary(generator->label_batch());
+
+        REQUIRE(etl::dim<0>(compact_generator->label_batch()) == etl::dim<0>(label));
+        REQUIRE(etl::dim<1>(compact_generator->label_batch()) == 10);
+
+        for (size_t i = 0; i < etl::size(label); ++i) {
+            REQUIRE(compact_generator->label_batch()[i] == Approx(label[i]));
+            REQUIRE(out_generator->label_batch()[i] == Approx(label[i]));
+        }
+
+        generator->next_batch();
+        compact_generator->next_batch();
+        out_generator->next_batch();
+    }
+}
+
+// The batch cache of the threaded generators is sized from the memory budget
+TEST_CASE("unit/augment/budget/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(300);
+    REQUIRE(!dataset.training_images.empty());
+
+    // 5 batches of 25 samples (784 inputs and 10 labels)
+    constexpr size_t budget = 5 * 25 * (784 + 10) * sizeof(float);
+
+    using generator_t          = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+    using budget_generator_t   = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::threaded_workers<2>, dll::cache_budget<budget>, dll::categorical, dll::scale_pre<255>>;
+    using prefetch_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::threaded_workers<2>, dll::index_shuffle, dll::cache_budget<budget>, dll::prefetch_time<1>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto budget_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        budget_generator_t{});
+
+    auto prefetch_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        prefetch_generator_t{});
+
+    REQUIRE(budget_generator->ring.N == 5);
+    REQUIRE(etl::dim<0>(budget_generator->batch_cache) == 5);
+
+    // The in-memory generator only caches the data and the gathered labels
+    REQUIRE(prefetch_generator->ring.N == 5);
+
+    // The depth of the second epoch is computed from the first one
+    for (size_t epoch = 0; epoch < 2; ++epoch) {
+        generator->reset();
+        budget_generator->reset();
+        prefetch_generator->reset();
+
+        REQUIRE(prefetch_generator->ring.depth >= 1);
+        REQUIRE(prefetch_generator->ring.depth <= 5);
+
+        while (generator->has_next_batch()) {
+            REQUIRE(budget_generator->has_next_batch());
+            REQUIRE(prefetch_generator->has_next_batch());
+
+            auto data = etl::force_temporary(generator->data_batch());
+
+            REQUIRE(etl::dim<0>(budget_generator->data_batch()) == etl::dim<0>(data));
+            REQUIRE(etl::dim<0>(prefetch_generator->data_batch()) == etl::dim<0>(data));
+
+            for (size_t i = 0; i < etl::size(data); ++i) {
+                REQUIRE(budget_generator->data_batch()[i] == Approx(data[i]));
+                REQUIRE(prefetch_generator->data_batch()[i] == Approx(data[i]));
+            }
+
+            generator->next_batch();
+            budget_generator->next_batch();
+            prefetch_generator->next_batch();
+        }
+    }
+
+    budget_generator->display();
+    prefetch_generator->display();
+}
+
+TEST_CASE("unit/augment/pinned/1", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(300);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t        = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+    using pinned_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::threaded_workers<2>, dll::pinned_cache, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto pinned_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        pinned_generator_t{});
+
+    generator->reset();
+    pinned_generator->reset();
+
+    while (generator->has_next_batch()) {
+        REQUIRE(pinned_generator->has_next_batch());
+
+        auto data = etl::force_temporary(generator->data_batch());
+
+        for (size_t i = 0; i < etl::size(data); ++i) {
+            REQUIRE(pinned_generator->data_batch()[i] == Approx(data[i]));
+        }
+
+        generator->next_batch();
+
+        // The next batch is always generated eventually
+        while (generator->has_next_batch() && !pinned_generator->next_batch_ready()) {
+            std::this_thread::yield();
+        }
+
+        pinned_generator->next_batch();
+    }
+
+    REQUIRE(!pinned_generator->has_next_batch());
+    REQUIRE(!pinned_generator->next_batch_ready());
+
+    // All the batches of the epoch have been accounted
+    auto stats = pinned_generator->stalls();
+
+    REQUIRE(stats.batches == pinned_generator->batches());
+    REQUIRE(stats.transform_ms > 0.0);
+
+    pinned_generator->display();
+}
+
+namespace {
+
+/*!
+ * \brief Minimal descriptor of an elastic distortion
+ */
+struct elastic_desc {
+    static constexpr size_t ElasticDistortion = 5; ///< The elastic distortion kernel
+};
+
+/*!
+ * \brief Minimal descriptor of a random mirroring
+ */
+struct mirror_desc {
+    static constexpr bool HorizontalMirroring = true; ///< Horizontal mirroring
+    static constexpr bool VerticalMirroring   = true; ///< Vertical mirroring
+};
+
+/*!
+ * \brief Minimal descriptor of scaled and normalized inputs
+ */
+struct normalize_desc {
+    static constexpr size_t ScalePre    = 255;  ///< The scaling
+    static constexpr size_t BinarizePre = 0;    ///< The binarization threshold
+    static constexpr bool NormalizePre  = true; ///< The normalization
+};
+
+/*!
+ * \brief Minimal descriptor of scaled and binarized inputs
+ */
+struct binarize_desc {
+    static constexpr size_t ScalePre    = 2;     ///< The scaling
+    static constexpr size_t BinarizePre = 30;    ///< The binarization threshold
+    static constexpr bool NormalizePre  = false; ///< The normalization
+};
+
+} // end of anonymous namespace
+
+// The elastic distortion interpolates between the pixels of the image
+TEST_CASE("unit/augment/elastic/1", "[unit]") {
+    etl::dyn_matrix<float, 3> constant(2, 12, 10);
+    etl::dyn_matrix<float, 3> image(2, 12, 10);
+
+    constant = 0.5f;
+    image    = etl::uniform_generator(0.0, 1.0);
+
+    dll::elastic_distorter<elastic_desc> distorter(image);
+    dll::random_engine engine(42);
+
+    // The buffers are reused between the images
+    for (size_t t = 0; t < 3; ++t) {
+        distorter.transform(constant, engine);
+        distorter.transform(image, engine);
+
+        for (size_t i = 0; i < etl::size(image); ++i) {
+            REQUIRE(constant[i] == Approx(0.5f));
+            REQUIRE(image[i] >= -1e-5f);
+            REQUIRE(image[i] <= 1.0f + 1e-5f);
+        }
+    }
+}
+
+// The mirroring of a batch flips the images as the mirroring of each image
+TEST_CASE("unit/augment/mirror/1", "[unit]") {
+    etl::dyn_matrix<float, 4> batch(16, 2, 5, 7);
+    etl::dyn_matrix<float, 4> expected(16, 2, 5, 7);
+
+    batch    = etl::uniform_generator(0.0, 1.0);
+    expected = batch;
+
+    dll::random_mirrorer<mirror_desc> mirrorer(batch(0));
+    dll::random_mirrorer<mirror_desc> batch_mirrorer(batch(0));
+
+    dll::random_engine engine(42);
+    dll::random_engine batch_engine(42);
+
+    // The choices are drawn in the same order
+    for (size_t i = 0; i < 16; ++i) {
+        mirrorer.transform(expected(i), engine);
+    }
+
+    batch_mirrorer.transform_batch(batch, 16, batch_engine);
+
+    for (size_t i = 0; i < etl::size(batch); ++i) {
+        REQUIRE(batch[i] == Approx(expected[i]));
+    }
+}
+
+// The fused pre-transformations give the same inputs as the transformers
+TEST_CASE("unit/augment/pre/1", "[unit]") {
+    etl::dyn_matrix<float, 2> batch(8, 100);
+    etl::dyn_matrix<float, 2> fused(8, 100);
+    etl::dyn_matrix<float, 2> binarized(8, 100);
+
+    batch = etl::uniform_generator(0.0, 255.0);
+
+    fused     = batch;
+    binarized = batch;
+
+    dll::pre_transformer<normalize_desc>::transform_batch(fused, 8);
+    dll::pre_transformer<binarize_desc>::transform_batch(binarized, 8);
+
+    for (size_t i = 0; i < 8; ++i) {
+        etl::dyn_matrix<float, 1> expected(batch(i));
+
+        dll::pre_scaler<normalize_desc>::transform(expected);
+        dll::pre_normalizer<normalize_desc>::transform(expected);
+        dll::pre_binarizer<normalize_desc>::transform(expected);
+
+        for (size_t j = 0; j < 100; ++j) {
+            REQUIRE(fused(i, j) == Approx(expected(j)).epsilon(1e-4));
+        }
+
+        expected = batch(i);
+
+        dll::pre_scaler<binarize_desc>::transform(expected);
+        dll::pre_normalizer<binarize_desc>::transform(expected);
+        dll::pre_binarizer<binarize_desc>::transform(expected);
+
+        for (size_t j = 0; j < 100; ++j) {
+            REQUIRE(binarized(i, j) == expected(j));
+        }
+    }
+}
+
+namespace {
+
+// Read one epoch of a generator whose samples hold their index
+template <typename G>
+std::vector<size_t> read_indices(G& generator) {
+    std::vector<size_t> indices;
+
+    while (generator.has_next_batch()) {
+        auto data   = generator.data_batch();
+        auto labels = generator.label_batch();
+
+        for (size_t i = 0; i < etl::dim<0>(data); ++i) {
+            const size_t index = data(i, 0);
+
+            // The labels follow their samples
+            REQUIRE(labels(i, index % 10) == 1.0f);
+
+            indices.push_back(index);
+        }
+
+        generator.next_batch();
+    }
+
+    return indices;
+}
+
+template <typename G>
+void check_block_shuffle(G& generator, size_t n, size_t chunk) {
+    generator.reset();
+
+    auto ordered = read_indices(generator);
+
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(ordered[i] == i);
+    }
+
+    generator.reset_shuffle();
+
+    auto shuffled = read_indices(generator);
+
+    REQUIRE(shuffled.size() == n);
+    REQUIRE(shuffled != ordered);
+
+    // The samples of a chunk stay together and the partial chunk is the last
+    for (size_t c = 0; c * chunk < n; ++c) {
+        auto first = shuffled.begin() + c * chunk;
+        auto last  = shuffled.begin() + std::min(n, (c + 1) * chunk);
+
+        const size_t base = *std::min_element(first, last);
+
+        REQUIRE(base % chunk == 0);
+        REQUIRE(*std::max_element(first, last) == std::min(n, base + chunk) - 1);
+    }
+
+    std::sort(shuffled.begin(), shuffled.end());
+
+    REQUIRE(shuffled == ordered);
+}
+
+} // end of anonymous namespace
+
+// The out-of-memory generators are shuffled by blocks
+TEST_CASE("unit/augment/outmemory/shuffle/1", "[unit]") {
+    const size_t n = 95;
+
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < n; ++i) {
+        samples.emplace_back(4);
+        samples.back() = float(i);
+        labels.push_back(i % 10);
+    }
+
+    using generator_t = dll::outmemory_data_generator_desc<dll::batch_size<10>, dll::big_batch_size<3>, dll::categorical>;
+    using prefetched_t = dll::outmemory_data_generator_desc<dll::batch_size<10>, dll::prefetch_budget<2 * 3 * 10 * (4 + 10) * 4>, dll::categorical>;
+
+    auto generator  = dll::make_generator(samples, labels, n, 10, generator_t{});
+    auto prefetched = dll::make_generator(samples, labels, n, 10, prefetched_t{});
+
+    check_block_shuffle(*generator, n, 30);
+    check_block_shuffle(*prefetched, n, 30);
+}
+
+// Draw the epochs by the losses of the samples
+TEST_CASE("unit/augment/importance/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<4>, dll::importance_sampling<40, 10>, dll::categorical, dll::scale_pre<255>>;
+
+    auto first  = dll::make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, train_generator_t{});
+    auto second = dll::make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, train_generator_t{});
+
+    const size_t n = dataset.training_images.size();
+
+    // The first epoch uses all the samples
+    first->reset_shuffle();
+    second->reset_shuffle();
+
+    REQUIRE(first->size() == n);
+
+    // The samples of even index are the hard ones
+    for (auto* generator : {first.get(), second.get()}) {
+        std::vector<float> losses(25);
+
+        while (generator->has_next_batch()) {
+            for (size_t i = 0; i < 25 && generator->current + i < n; ++i) {
+                losses[i] = generator->order[generator->current + i] % 2 ? 0.01f : 1.0f;
+            }
+
+            generator->data_batch();
+            generator->report_losses(losses.data(), std::min<size_t>(25, n - generator->current));
+            generator->next_batch();
+        }
+    }
+
+    first->reset_shuffle();
+    second->reset_shuffle();
+
+    REQUIRE(first->size() == n * 40 / 100);
+    REQUIRE(first->batches() == (n * 40 / 100 + 24) / 25);
+
+    // The draws are deterministic
+    size_t hard = 0;
+
+    for (size_t i = 0; i < first->size(); ++i) {
+        REQUIRE(first->order[i] == second->order[i]);
+
+        hard += first->order[i] % 2 == 0;
+    }
+
+    CHECK(hard > first->size() * 3 / 4);
+
+    // The evaluation uses all the samples
+    first->reset();
+    REQUIRE(first->size() == n);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*first, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 0.1);
+}
+
+// The stages of a pipeline generator produce each sample once per epoch
+TEST_CASE("unit/augment/pipeline/1", "[unit]") {
+    const size_t n = 95;
+
+    std::vector<etl::dyn_vector<float>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < n; ++i) {
+        samples.emplace_back(4);
+        samples.back() = float(i);
+        labels.push_back(i % 10);
+    }
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>;
+
+    auto generator = dll::make_pipeline_generator(samples, labels, 10, generator_t{}, 2);
+
+    // The value of each sample is doubled and the augmentation adds 1000,
+    // only in train mode
+    generator->map([](auto& sample) { sample *= 2.0f; }, 3, 4)
+              .augment([](auto& sample, auto& /*g*/) { sample += 1000.0f; }, 2, 4)
+              .batch(2)
+              .prefetch(3);
+
+    REQUIRE(generator->batches() == 10);
+
+    for (bool train : {true, false}) {
+        if (train) {
+            generator->set_train();
+        } else {
+            generator->set_test();
+        }
+
+        for (size_t epoch = 0; epoch < 2; ++epoch) {
+            generator->reset_shuffle();
+
+            std::vector<size_t> seen(n, 0);
+            size_t batches = 0;
+
+            while (generator->has_next_batch()) {
+                auto data  = generator->data_batch();
+                auto label = generator->label_batch();
+
+                for (size_t b = 0; b < etl::dim<0>(data); ++b) {
+                    const size_t i = size_t(data(b, 0) - (train ? 1000.0f : 0.0f)) / 2;
+
+                    REQUIRE(i < n);
+                    REQUIRE(data(b, 3) == data(b, 0));
+                    REQUIRE(label(b, i % 10) == 1.0f);
+
+                    ++seen[i];
+                }
+
+                ++batches;
+                generator->next_batch();
+            }
+
+            REQUIRE(batches == 10);
+            REQUIRE(std::count(seen.begin(), seen.end(), 1) == long(n));
+        }
+    }
+}
+
+// Train a network with a pipeline generator
+TEST_CASE("unit/augment/pipeline/2", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_pipeline_generator(dataset.training_images, dataset.training_labels, 10, train_generator_t{}, 2);
+
+    generator->augment([](auto& sample, auto& g) {
+        std::uniform_real_distribution<float> dist(-0.01f, 0.01f);
+
+        for (auto& v : sample) {
+            v += dist(g);
+        }
+    }, 2).prefetch(4);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// The inputs are standardized by the statistics of the dataset
+TEST_CASE("unit/augment/standardize/1", "[unit]") {
+    const size_t n = 100;
+
+    std::vector<etl::dyn_matrix<float, 3>> samples;
+    std::vector<size_t> labels;
+
+    for (size_t i = 0; i < n; ++i) {
+        samples.emplace_back(2, 3, 3);
+
+        // The first channel is in [0, 99], the second one in [100, 298]
+        for (size_t j = 0; j < 9; ++j) {
+            samples.back()(0, j / 3, j % 3) = float(i);
+            samples.back()(1, j / 3, j % 3) = float(100 + 2 * ((i + j) % n));
+        }
+
+        labels.push_back(i % 10);
+    }
+
+    using features_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::standardize_pre>;
+    using channels_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::channel_standardize_pre>;
+
+    auto features = dll::make_generator(samples, labels, n, 10, features_t{});
+    auto channels = dll::make_generator(samples, labels, n, 10, channels_t{});
+    auto view     = dll::make_view_generator(samples, labels, 10, channels_t{});
+
+    REQUIRE(features->input_standardization().mean.size() == 18);
+    REQUIRE(channels->input_standardization().mean.size() == 2);
+    REQUIRE(view->input_standardization().mean.size() == 2);
+
+    REQUIRE(channels->input_standardization().mean[0] == Approx(49.5f));
+    REQUIRE(channels->input_standardization().mean[1] == Approx(199.0f));
+    REQUIRE(view->input_standardization().mean[1] == Approx(199.0f));
+    REQUIRE(view->input_standardization().scale[1] == Approx(channels->input_standardization().scale[1]));
+
+    // Each feature of the batches has a zero mean and a unit variance over the epoch
+    for (auto* generator : {features.get(), channels.get()}) {
+        std::vector<double> sum(18, 0.0);
+        std::vector<double> sum2(18, 0.0);
+
+        generator->reset_shuffle();
+
+        while (generator->has_next_batch()) {
+            auto batch = generator->data_batch();
+
+            for (size_t b = 0; b < etl::dim<0>(batch); ++b) {
+                for (size_t j = 0; j < 18; ++j) {
+                    const double v = batch(b, j / 9, (j % 9) / 3, j % 3);
+
+                    sum[j] += v;
+                    sum2[j] += v * v;
+                }
+            }
+
+            generator->next_batch();
+        }
+
+        for (size_t j = 0; j < 18; ++j) {
+            REQUIRE(sum[j] / n == Approx(0.0).margin(1e-4));
+            REQUIRE(sum2[j] / n == Approx(1.0).epsilon(1e-3));
+        }
+    }
+
+    // The samples of the cache are not modified
+    REQUIRE(channels->input_cache(0)(1, 0, 0) >= 100.0f);
+
+    // The statistics of the training set are stored with the model and
+    // used for the test set
+    std::stringstream stream;
+    channels->input_standardization().store(stream);
+
+    dll::standardization<float> stats;
+    stats.load(stream);
+
+    REQUIRE(stats.group == 9);
+    REQUIRE(stats.mean[1] == channels->input_standardization().mean[1]);
+
+    std::vector<etl::dyn_matrix<float, 3>> test_samples(1, etl::dyn_matrix<float, 3>(2, 3, 3));
+    std::vector<size_t> test_labels(1, 0);
+
+    test_samples[0] = 199.0f;
+
+    auto test = dll::make_generator(test_samples, test_labels, 1, 10, channels_t{});
+    test->set_input_standardization(stats);
+    test->reset();
+
+    REQUIRE(test->data_batch()(0, 1, 0, 0) == Approx(0.0f).margin(1e-5));
+    REQUIRE(test->data_batch()(0, 0, 0, 0) > 1.0f);
+
+    stats.apply(test_samples[0]);
+
+    REQUIRE(test_samples[0](1, 2, 2) == Approx(0.0f).margin(1e-5));
+}
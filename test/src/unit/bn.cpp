@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <deque>
+#include <cmath>
 
 #include "dll_test.hpp"
 
@@ -13,8 +14,10 @@
 #include "dll/neural/dense_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
 #include "dll/neural/batch_normalization_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/network.hpp"
+#include "dll/frozen_dbn.hpp"
 #include "dll/datasets.hpp"
 
 #include "mnist/mnist_reader.hpp"
@@ -204,3 +207,214 @@ TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// Frozen network, with BN folded in place
+TEST_CASE("unit/bn/6", "[unit][bn][frozen]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<6, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<6 * 24 * 24, 200, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dropout_layer_desc<50>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::early_training, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 2500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->initial_momentum = 0.9;
+    net->final_momentum   = 0.9;
+    net->learning_rate    = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 25, 5e-2);
+
+    auto frozen = dll::freeze(*net);
+
+    auto& generator = *dataset.test();
+    generator.reset();
+
+    auto batch = etl::force_temporary(generator.data_batch());
+
+    auto net_output    = net->forward_batch(batch);
+    auto frozen_output = frozen.forward_batch(batch);
+
+    REQUIRE(etl::dim<0>(frozen_output) == etl::dim<0>(net_output));
+
+    for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+        auto sample = etl::force_temporary(batch(i));
+
+        auto one_output = frozen.forward_one(sample);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(frozen_output(i, j) == Approx(net_output(i, j)).epsilon(1e-3));
+            REQUIRE(one_output[j] == Approx(net_output(i, j)).epsilon(1e-3));
+        }
+
+        REQUIRE(frozen.predict(sample) == net->predict(sample));
+    }
+}
+
+// The fused kernels must match the direct formulas
+TEST_CASE("unit/bn/7", "[unit][bn]") {
+    for (size_t S : {size_t(1), size_t(12)}) {
+        const size_t B = 7;
+        const size_t K = 5;
+        const size_t N = B * K * S;
+
+        std::vector<float> x(N), dy(N), xhat(N), y(N), dx(N);
+        std::vector<float> gamma(K), beta(K), mean(K), var(K), inv_var(K), dgamma(K), dbeta(K);
+
+        for (size_t i = 0; i < N; ++i) {
+            x[i]  = std::sin(0.37f * i) * 3.0f + 1.0f;
+            dy[i] = std::cos(0.11f * i);
+        }
+
+        for (size_t k = 0; k < K; ++k) {
+            gamma[k] = 0.5f + 0.25f * k;
+            beta[k]  = 0.1f * k;
+        }
+
+        const float e = 1e-8;
+
+        dll::bn_detail::train_forward(B, K, S, x.data(), xhat.data(), y.data(), gamma.data(), beta.data(), mean.data(), var.data(), inv_var.data(), e);
+        dll::bn_detail::backward(B, K, S, dy.data(), xhat.data(), gamma.data(), inv_var.data(), dx.data(), dgamma.data(), dbeta.data());
+
+        for (size_t k = 0; k < K; ++k) {
+            double m = 0;
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t s = 0; s < S; ++s) {
+                    m += x[(b * K + k) * S + s];
+                }
+            }
+            m /= B * S;
+
+            double v = 0;
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t s = 0; s < S; ++s) {
+                    v += (x[(b * K + k) * S + s] - m) * (x[(b * K + k) * S + s] - m);
+                }
+            }
+            v /= B * S;
+
+            REQUIRE(mean[k] == Approx(m).epsilon(1e-4));
+            REQUIRE(var[k] == Approx(v).epsilon(1e-4));
+
+            double db = 0;
+            double dg = 0;
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t s = 0; s < S; ++s) {
+                    const size_t i = (b * K + k) * S + s;
+                    const double h = (x[i] - m) / std::sqrt(v + e);
+
+                    REQUIRE(xhat[i] == Approx(h).epsilon(1e-3));
+                    REQUIRE(y[i] == Approx(gamma[k] * h + beta[k]).epsilon(1e-3));
+
+                    db += dy[i];
+                    dg += dy[i] * h;
+                }
+            }
+
+            REQUIRE(dbeta[k] == Approx(db).epsilon(1e-3));
+            REQUIRE(dgamma[k] == Approx(dg).epsilon(1e-3));
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t s = 0; s < S; ++s) {
+                    const size_t i = (b * K + k) * S + s;
+                    const double h = (x[i] - m) / std::sqrt(v + e);
+                    const double r = gamma[k] / std::sqrt(v + e) / (B * S) * (B * S * dy[i] - db - h * dg);
+
+                    REQUIRE(std::abs(dx[i] - r) < 1e-4);
+                }
+            }
+        }
+    }
+}
+
+// The inference network has smaller layers and the same outputs
+TEST_CASE("unit/bn/8", "[unit][bn]") {
+    using layers_t = dll::network_layers<
+        dll::dense_layer_desc<28 * 28, 100, dll::no_bias, dll::no_activation>::layer_t,
+        dll::batch_normalization_2d_layer_desc<100>::layer_t,
+        dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+        dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>;
+
+    using network_t   = dll::network_desc<layers_t, dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+    using inference_t = dll::network_desc<layers_t, dll::inference_only, dll::batch_size<25>>::network_t;
+
+    static_assert(sizeof(inference_t::layer_type<1>) < sizeof(network_t::layer_type<1>), "The inference layer must be smaller");
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 1000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->learning_rate = 0.01;
+
+    FT_CHECK_2_VAL(net, dataset, 10, 0.2);
+
+    net->store("inference.tmp.dat");
+
+    auto inference = std::make_unique<inference_t>();
+    inference->load("inference.tmp.dat");
+
+    auto& generator = *dataset.test();
+    generator.reset();
+
+    auto batch = etl::force_temporary(generator.data_batch());
+
+    auto net_output       = net->forward_batch(batch);
+    auto inference_output = inference->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(inference_output(i, j) == Approx(net_output(i, j)));
+        }
+    }
+}
+
+// Dropout, with the mask stored in the context
+TEST_CASE("unit/dropout/1", "[unit][dropout]") {
+    using layer_t = dll::dropout_layer_desc<50>::layer_t;
+
+    // Large enough to be generated in parallel
+    struct context_t {
+        etl::dyn_matrix<float, 2> input  = etl::dyn_matrix<float, 2>(25, 4000);
+        etl::dyn_matrix<float, 2> output = etl::dyn_matrix<float, 2>(25, 4000);
+        etl::dyn_matrix<float, 2> errors = etl::dyn_matrix<float, 2>(25, 4000);
+        std::vector<uint64_t> mask;
+    } context;
+
+    layer_t layer;
+
+    context.input  = etl::uniform_generator(1.0, 2.0);
+    context.errors = etl::uniform_generator(1.0, 2.0);
+
+    layer.train_forward_context(context);
+
+    etl::dyn_matrix<float, 2> dx(25, 4000);
+    layer.backward_batch(dx, context);
+
+    size_t dropped = 0;
+
+    for (size_t i = 0; i < etl::size(context.input); ++i) {
+        const bool kept = (context.mask[i / 64] >> (i & 63)) & 1;
+
+        if (kept) {
+            REQUIRE(context.output[i] == Approx(context.input[i] / 0.5f));
+            REQUIRE(dx[i] == Approx(context.errors[i] / 0.5f));
+        } else {
+            REQUIRE(context.output[i] == 0.0f);
+            REQUIRE(dx[i] == 0.0f);
+            ++dropped;
+        }
+    }
+
+    CHECK(double(dropped) / etl::size(context.input) == Approx(0.5).epsilon(0.05));
+}
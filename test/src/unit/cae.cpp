@@ -51,6 +51,34 @@ TEST_CASE("conv/ae/deconv/1", "[dense][dbn][mnist][sgd][ae]") {
     REQUIRE(test_error < 0.3);
 }
 
+// With deconv and max unpooling
+TEST_CASE("conv/ae/deconv/2", "[dense][dbn][mnist][sgd][ae]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 2, 5, 5, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::mp_3d_layer_desc<2, 24, 24, 1, 2, 2>::layer_t,
+            // Features
+            dll::upsample_3d_layer_desc<2, 12, 12, 1, 2, 2, dll::unpool_indices<1>>::layer_t,
+            dll::deconv_layer_desc<2, 24, 24, 1, 5, 5, dll::activation<dll::function::SIGMOID>>::layer_t
+        >, dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::batch_size<32>>::network_t network_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(1024);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<network_t>();
+
+    dbn->display();
+
+    dbn->learning_rate = 0.01;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.3);
+}
+
 // Conv <> Conv
 TEST_CASE("conv/ae/1", "[dense][dbn][mnist][sgd][ae]") {
     using network_t = dll::dbn_desc<
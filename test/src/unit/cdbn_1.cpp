@@ -14,6 +14,8 @@
 #include "dll/rbm/conv_rbm_mp.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/avgp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/lowering.hpp"
 #include "dll/dbn.hpp"
 
 #include "mnist/mnist_reader.hpp"
@@ -171,3 +173,50 @@ TEST_CASE("unit/cdbn/mnist/6", "[cdbn][mp][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.5);
 }
+
+TEST_CASE("unit/cdbn/mnist/lowering/1", "[cdbn][mp][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_rbm_square_desc<1, 28, 10, 17, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::mp_3d_layer_desc<10, 12, 12, 1, 2, 2>::layer_t,
+            dll::rbm_desc<10 * 6 * 6, 50, dll::momentum, dll::batch_size<25>>::layer_t>>::dbn_t dbn_t;
+
+    typedef dll::lowered_dbn_t<dbn_t> lowered_t;
+
+    // The RBMs are lowered to neural layers, the pooling layer is kept
+    REQUIRE(!dll::layer_traits<lowered_t::layer_type<0>>::is_rbm_layer());
+    REQUIRE(!dll::layer_traits<lowered_t::layer_type<2>>::is_rbm_layer());
+    REQUIRE(lowered_t::layer_type<0>::activation_function == dll::function::SIGMOID);
+    REQUIRE(lowered_t::layer_type<2>::activation_function == dll::function::SIGMOID);
+    REQUIRE((std::is_same<lowered_t::layer_type<1>, dbn_t::layer_type<1>>::value));
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    auto lowered = dll::lower(*dbn);
+
+    etl::fast_dyn_matrix<float, 25, 1, 28, 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    // The lowered network computes the same test representation
+    auto output         = dbn->forward_batch(batch);
+    auto lowered_output = lowered->forward_batch(batch);
+
+    REQUIRE(etl::size(lowered_output) == etl::size(output));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(lowered_output[i] == Approx(output[i]).epsilon(1e-3));
+    }
+
+    auto one = lowered->forward_one(dataset.training_images.front());
+    REQUIRE(one.size() == 50);
+}
@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <deque>
+#include <random>
 
 #include "dll_test.hpp"
 
@@ -13,6 +14,14 @@
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/datasets.hpp"
+#include "dll/quantized_dbn.hpp"
+#include "dll/pruning.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/dyn_mp_layer.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/streaming.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -162,3 +171,323 @@ TEST_CASE("unit/conv/sgd/partial/1", "[conv][dbn][mnist][sgd]") {
 
     TEST_CHECK(0.25);
 }
+
+TEST_CASE("unit/conv/sgd/quantized/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<6 * 24 * 24, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.25);
+
+    auto quantized = dll::quantize(*dbn, dataset.train());
+
+    // The quantized network must compute almost the same outputs
+    dataset.test().reset();
+
+    auto batch = dataset.test().data_batch();
+
+    auto reference = dbn->forward_batch(batch);
+    auto output    = quantized.forward_batch(batch);
+
+    REQUIRE(etl::size(output) == etl::size(reference));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(std::abs(output[i] - reference[i]) < 0.1);
+    }
+
+    auto metrics = quantized.evaluate_drift(dataset.test());
+
+    REQUIRE(std::abs(std::get<0>(metrics.second) - std::get<0>(metrics.first)) < 0.05);
+}
+
+TEST_CASE("unit/conv/sgd/quantized/2", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>, dll::quantization_aware>::layer_t,
+            dll::dense_layer_desc<6 * 24 * 24, 10, dll::activation<dll::function::SOFTMAX>, dll::quantization_aware>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    // The scales are trained with the weights and the biases
+    REQUIRE(std::tuple_size<decltype(dbn->template layer_get<0>().trainable_parameters())>::value == 4);
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.25);
+
+    REQUIRE(dbn->template layer_get<0>().quantization.trained());
+    REQUIRE(dbn->template layer_get<1>().quantization.trained());
+
+    // The int8 network uses the learned scales, without calibration
+    auto quantized = dll::quantize(*dbn, dataset.train());
+
+    auto metrics = quantized.evaluate_drift(dataset.test());
+
+    REQUIRE(std::abs(std::get<0>(metrics.second) - std::get<0>(metrics.first)) < 0.02);
+}
+
+TEST_CASE("unit/conv/sgd/pruning/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_2d_layer_desc<6, 24, 24, 2, 2>::layer_t,
+            dll::dense_layer_desc<6 * 12 * 12, 50, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_mp_2d_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t pruned_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(25, 5e-2);
+    TEST_CHECK_DATASET(0.25);
+
+    auto pruned = std::make_unique<pruned_t>();
+
+    dll::pruning_options options;
+    options.ratio = 0.5;
+
+    auto report = dll::prune(*dbn, *pruned, dataset.test(), options);
+
+    REQUIRE(report.units_after == std::vector<size_t>({3, 0, 25, 10}));
+    REQUIRE(pruned->layer_get<0>().output_size() == 3 * 24 * 24);
+    REQUIRE(pruned->layer_get<2>().input_size() == 3 * 12 * 12);
+    REQUIRE(report.parameters_after < report.parameters_before / 2);
+
+    // The pruned network can still be fine-tuned
+    auto ft_error = pruned->fine_tune(dataset.train(), 5);
+    REQUIRE(ft_error < 0.2);
+
+    options.criterion = dll::pruning_criterion::ACTIVATION;
+
+    auto pruned_2 = std::make_unique<pruned_t>();
+    auto report_2 = dll::prune(*dbn, *pruned_2, dataset.test(), options);
+
+    REQUIRE(report_2.units_after == report.units_after);
+    REQUIRE(std::get<0>(report_2.before) == Approx(std::get<0>(report.before)));
+}
+
+TEST_CASE("unit/conv/sgd/fusion/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_2d_layer_desc<6, 24, 24, 2, 2>::layer_t,
+            dll::dense_layer_desc<6 * 12 * 12, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    // The convolution and the pooling are fused, not the pooling and the dense layer
+    REQUIRE((dll::layer_fusion<dbn_t::layer_type<0>, dbn_t::layer_type<1>>::test));
+    REQUIRE((dll::layer_fusion<dbn_t::layer_type<0>, dbn_t::layer_type<1>>::train));
+    REQUIRE(!(dll::layer_fusion<dbn_t::layer_type<1>, dbn_t::layer_type<2>>::test));
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(25, 5e-2);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    // The fused network must compute the same outputs as the layers
+    auto conv   = dbn->layer_get<0>().test_forward_batch(batch);
+    auto pooled = dbn->layer_get<1>().test_forward_batch(conv);
+    auto output = dbn->layer_get<2>().test_forward_batch(pooled);
+
+    auto fused_pooled = dbn->forward_batch<1>(batch);
+    auto fused_output = dbn->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(pooled); ++i) {
+        REQUIRE(fused_pooled[i] == Approx(pooled[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(fused_output[i] == Approx(output[i]).epsilon(1e-4));
+    }
+
+    auto train_output = dbn->train_forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(train_output[i] == Approx(output[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/streaming/1", "[unit][conv][dbn][streaming]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_rbm_desc<1, 10, 12, 3, 3, 3, dll::batch_size<5>>::layer_t,
+            dll::mp_3d_layer_desc<3, 8, 10, 1, 2, 2>::layer_t,
+            dll::conv_layer_desc<3, 4, 5, 2, 3, 2, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<2 * 2 * 4, 4, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The three convolutional layers are streamed, not the dense layer
+    dll::streaming_dbn<dbn_t> streaming(*dbn, 2);
+
+    REQUIRE(streaming.streamed == 3);
+
+    std::mt19937_64 engine(42);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+    etl::fast_dyn_matrix<float, 1, 10, 12> window;
+
+    for (auto& v : window) {
+        v = dist(engine);
+    }
+
+    streaming.start(window);
+
+    for (size_t step = 0; step < 5; ++step) {
+        etl::fast_dyn_matrix<float, 1, 10, 2> frames;
+
+        for (auto& v : frames) {
+            v = dist(engine);
+        }
+
+        // Slide the reference window by the same frames
+        for (size_t i = 0; i < 10; ++i) {
+            for (size_t j = 0; j < 10; ++j) {
+                window(0, i, j) = window(0, i, j + 2);
+            }
+
+            window(0, i, 10) = frames(0, i, 0);
+            window(0, i, 11) = frames(0, i, 1);
+        }
+
+        streaming.push(frames);
+
+        auto features = dbn->test_forward_one<2>(window);
+
+        REQUIRE(etl::size(streaming.features()) == etl::size(features));
+
+        for (size_t i = 0; i < etl::size(features); ++i) {
+            REQUIRE(streaming.features()[i] == Approx(features[i]).epsilon(1e-4));
+        }
+
+        auto output = dbn->test_forward_one(window);
+        auto stream = streaming.output();
+
+        for (size_t i = 0; i < etl::size(output); ++i) {
+            REQUIRE(stream[i] == Approx(output[i]).epsilon(1e-4));
+        }
+
+        REQUIRE(streaming.predict() == dbn->predict(window));
+    }
+}
+
+TEST_CASE("unit/conv/sgd/stride/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::RELU>, dll::stride<2>, dll::padding<2>>::layer_t,
+            dll::dense_layer_desc<6 * 14 * 14, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    using conv_t = dbn_t::layer_type<0>;
+
+    REQUIRE(conv_t::NH1 == 14);
+    REQUIRE(conv_t::NH2 == 14);
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.25);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    auto& conv  = dbn->layer_get<0>();
+    auto output = conv.test_forward_batch(batch);
+
+    // Only the strided outputs of the zero-padded input are computed
+    for (size_t b = 0; b < 10; ++b) {
+        for (size_t k = 0; k < 6; ++k) {
+            for (size_t i = 0; i < 14; ++i) {
+                for (size_t j = 0; j < 14; ++j) {
+                    float acc = conv.b(k);
+
+                    for (size_t p = 0; p < 5; ++p) {
+                        for (size_t q = 0; q < 5; ++q) {
+                            const long ii = long(2 * i + p) - 2;
+                            const long jj = long(2 * j + q) - 2;
+
+                            if (ii >= 0 && ii < 28 && jj >= 0 && jj < 28) {
+                                acc += batch(b, 0, ii, jj) * conv.w(k, 0, p, q);
+                            }
+                        }
+                    }
+
+                    REQUIRE(output(b, k, i, j) == Approx(std::max(acc, 0.0f)).epsilon(1e-3));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("unit/conv/sgd/stride/2", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // 3x3 filters with a stride of 2 and a padding of 1
+    dbn->template init_layer<0>(1, 28, 28, 6, 3, 3, 2, 2, 1, 1);
+    dbn->template init_layer<1>(6 * 14 * 14, 10);
+
+    REQUIRE(dbn->layer_get<0>().output_size() == 6 * 14 * 14);
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.25);
+}
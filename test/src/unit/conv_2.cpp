@@ -10,6 +10,7 @@
 #include "dll_test.hpp"
 
 #include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
@@ -92,3 +93,117 @@ TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+TEST_CASE("unit/mp/kernels/1", "[unit][mp][sgd]") {
+    constexpr size_t B = 3;
+
+    etl::fast_dyn_matrix<float, B, 2, 9, 8> input;
+    etl::fast_dyn_matrix<float, B, 2, 4, 4> output;
+    etl::fast_dyn_matrix<float, B, 2, 4, 4> errors;
+    etl::fast_dyn_matrix<float, B, 2, 9, 8> input_errors;
+
+    // Without ties, the maximum of each window is unique
+    input = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+    input_errors = 1.0f;
+
+    std::vector<dll::mp_detail::index_t<2 * 2>> indices(etl::size(output));
+
+    dll::mp_detail::forward(B, 2, 9, 8, 1, 2, 2, input.memory_start(), output.memory_start(), indices.data());
+
+    auto ref_output = etl::force_temporary(etl::ml::max_pool_forward<2, 2>(input));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(ref_output[i]));
+    }
+
+    dll::mp_detail::backward(B, 2, 9, 8, 1, 2, 2, errors.memory_start(), indices.data(), input_errors.memory_start());
+
+    auto ref_errors = etl::force_temporary(etl::ml::max_pool_backward<2, 2>(input, output, errors));
+
+    // The last row of each plane is outside of the windows
+    for (size_t i = 0; i < etl::size(input_errors); ++i) {
+        REQUIRE(input_errors[i] == Approx(ref_errors[i]));
+    }
+}
+
+TEST_CASE("unit/avgp/kernels/1", "[unit][avgp][sgd]") {
+    constexpr size_t B = 3;
+
+    etl::fast_dyn_matrix<float, B, 5, 9, 8> input;
+    etl::fast_dyn_matrix<float, B, 2, 3, 4> output;
+    etl::fast_dyn_matrix<float, B, 2, 3, 4> errors;
+    etl::fast_dyn_matrix<float, B, 5, 9, 8> input_errors;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+    input_errors = 1.0f;
+
+    dll::avgp_detail::forward(B, 5, 9, 8, 2, 3, 2, input.memory_start(), output.memory_start());
+
+    auto ref_output = etl::force_temporary(etl::ml::avg_pool_3d_forward<2, 3, 2>(input));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(ref_output[i]));
+    }
+
+    dll::avgp_detail::backward(B, 5, 9, 8, 2, 3, 2, errors.memory_start(), input_errors.memory_start());
+
+    auto ref_errors = etl::force_temporary(etl::ml::avg_pool_3d_backward<2, 3, 2>(input, output, errors));
+
+    // The last plane of each sample is outside of the windows
+    for (size_t i = 0; i < etl::size(input_errors); ++i) {
+        REQUIRE(input_errors[i] == Approx(ref_errors[i]));
+    }
+}
+
+TEST_CASE("unit/conv/mp/1", "[unit][conv][mp]") {
+    dll::conv_layer<2, 12, 12, 3, 5, 5, dll::relu> conv;
+    dll::mp_2d_layer<3, 8, 8, 2, 2> mp;
+    dll::conv_mp_layer<2, 12, 12, 3, 5, 5, 2, 2, dll::relu> fused;
+
+    fused.w = conv.w;
+    fused.b = etl::uniform_generator(-0.1, 0.1);
+    conv.b  = fused.b;
+
+    etl::fast_dyn_matrix<float, 4, 2, 12, 12> input;
+    etl::fast_dyn_matrix<float, 4, 3, 8, 8> conv_output;
+    etl::fast_dyn_matrix<float, 4, 3, 4, 4> output;
+    etl::fast_dyn_matrix<float, 4, 3, 4, 4> fused_output;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    conv.forward_batch(conv_output, input);
+    mp.forward_batch(output, conv_output);
+
+    fused.forward_batch(fused_output, input);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(fused_output[i] == Approx(output[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/mp/sgd/1", "[unit][conv][mp][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_mp_layer<1, 28, 28, 6, 5, 5, 2, 2, dll::relu>,
+            dll::conv_layer<6, 12, 12, 5, 5, 5, dll::relu>,
+            dll::dense_layer<5 * 8 * 8, 100, dll::relu>,
+            dll::dense_layer<100, 10, dll::softmax>
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>,
+        dll::batch_size<20>
+    >::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.005;
+
+    FT_CHECK(50, 6e-2);
+    TEST_CHECK(0.25);
+}
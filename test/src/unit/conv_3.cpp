@@ -70,3 +70,244 @@ TEST_CASE("unit/conv/sgd/10", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.22);
 }
+
+TEST_CASE("unit/conv/engine/1", "[unit][conv][engine]") {
+    etl::fast_dyn_matrix<float, 3, 2, 9, 9> x;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> w3;
+    etl::fast_dyn_matrix<float, 4, 2, 7, 7> w7;
+
+    x  = etl::normal_generator<float>(0.0, 1.0);
+    w3 = etl::normal_generator<float>(0.0, 1.0);
+    w7 = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> y3_ref;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> y3;
+    etl::fast_dyn_matrix<float, 3, 4, 3, 3> y7_ref;
+    etl::fast_dyn_matrix<float, 3, 4, 3, 3> y7;
+
+    y3_ref = etl::ml::convolution_forward(x, w3);
+    y7_ref = etl::ml::convolution_forward(x, w7);
+
+    for (auto a : {dll::conv_algorithm::IM2COL, dll::conv_algorithm::WINOGRAD, dll::conv_algorithm::AUTO}) {
+        dll::conv_engine_forward(a, y3, x, w3);
+
+        for (size_t i = 0; i < etl::size(y3); ++i) {
+            REQUIRE(y3[i] == Approx(y3_ref[i]).epsilon(1e-3));
+        }
+    }
+
+    for (auto a : {dll::conv_algorithm::IM2COL, dll::conv_algorithm::FFT, dll::conv_algorithm::AUTO}) {
+        dll::conv_engine_forward(a, y7, x, w7);
+
+        for (size_t i = 0; i < etl::size(y7); ++i) {
+            REQUIRE(y7[i] == Approx(y7_ref[i]).epsilon(1e-3));
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 3, 2, 9, 9> dx_ref;
+    etl::fast_dyn_matrix<float, 3, 2, 9, 9> dx;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw_ref;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw;
+
+    dx_ref = etl::ml::convolution_backward(y3_ref, w3);
+    dw_ref = etl::ml::convolution_backward_filter(x, y3_ref);
+
+    for (auto a : {dll::conv_algorithm::IM2COL, dll::conv_algorithm::WINOGRAD, dll::conv_algorithm::FFT}) {
+        dll::conv_engine_backward(a, dx, y3_ref, w3);
+        dll::conv_engine_backward_filter(a, dw, x, y3_ref);
+
+        for (size_t i = 0; i < etl::size(dx); ++i) {
+            REQUIRE(dx[i] == Approx(dx_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(dw); ++i) {
+            REQUIRE(dw[i] == Approx(dw_ref[i]).epsilon(1e-3));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/engine/2", "[unit][conv][engine][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 3, 3, dll::activation<dll::function::RELU>, dll::conv_engine<dll::conv_algorithm::WINOGRAD>>::layer_t,
+            dll::mp_3d_layer_desc<6, 26, 26, 1, 2, 2>::layer_t,
+            dll::conv_layer_desc<6, 13, 13, 8, 3, 3, dll::activation<dll::function::RELU>, dll::conv_engine<dll::conv_algorithm::IM2COL>>::layer_t,
+            dll::dense_layer_desc<8 * 11 * 11, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.002;
+
+    FT_CHECK(25, 6e-2);
+    TEST_CHECK(0.2);
+}
+
+TEST_CASE("unit/conv/engine/3", "[unit][conv][engine]") {
+    etl::fast_dyn_matrix<float, 3, 2, 9, 9> x;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> w;
+
+    x = etl::normal_generator<float>(0.0, 1.0);
+    w = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> y_ref;
+    etl::fast_dyn_matrix<float, 3, 4, 7, 7> y;
+
+    y_ref = etl::ml::convolution_forward(x, w);
+
+    dll::conv_engine_forward(dll::conv_algorithm::AUTOTUNE, y, x, w);
+
+    for (size_t i = 0; i < etl::size(y); ++i) {
+        REQUIRE(y[i] == Approx(y_ref[i]).epsilon(1e-3));
+    }
+
+    // The second call must use the cached algorithm
+    dll::conv_algorithm tuned = dll::conv_algorithm::AUTOTUNE;
+    REQUIRE(dll::conv_tuning_cache::instance().find(dll::conv_tuning_key("forward", sizeof(float), 3, 2, 9, 9, 4, 3, 3), tuned));
+    REQUIRE(tuned != dll::conv_algorithm::AUTOTUNE);
+
+    y = 0.0;
+    dll::conv_engine_forward(dll::conv_algorithm::AUTOTUNE, y, x, w);
+
+    for (size_t i = 0; i < etl::size(y); ++i) {
+        REQUIRE(y[i] == Approx(y_ref[i]).epsilon(1e-3));
+    }
+}
+
+TEST_CASE("unit/conv/engine/4", "[unit][conv][engine]") {
+    etl::fast_dyn_matrix<float, 3, 2, 7, 7> x;
+    etl::fast_dyn_matrix<float, 2, 4, 3, 3> w3;
+    etl::fast_dyn_matrix<float, 2, 4, 5, 5> w5;
+
+    x  = etl::normal_generator<float>(0.0, 1.0);
+    w3 = etl::normal_generator<float>(0.0, 1.0);
+    w5 = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 4, 9, 9> y3_ref;
+    etl::fast_dyn_matrix<float, 3, 4, 9, 9> y3;
+    etl::fast_dyn_matrix<float, 3, 4, 11, 11> y5_ref;
+    etl::fast_dyn_matrix<float, 3, 4, 11, 11> y5;
+
+    y3_ref = etl::conv_4d_full_flipped(x, w3);
+    y5_ref = etl::conv_4d_full_flipped(x, w5);
+
+    for (auto a : {dll::conv_algorithm::IM2COL, dll::conv_algorithm::WINOGRAD, dll::conv_algorithm::FFT, dll::conv_algorithm::AUTO}) {
+        dll::deconv_engine_forward(a, y3, x, w3);
+        dll::deconv_engine_forward(a, y5, x, w5);
+
+        for (size_t i = 0; i < etl::size(y3); ++i) {
+            REQUIRE(y3[i] == Approx(y3_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(y5); ++i) {
+            REQUIRE(y5[i] == Approx(y5_ref[i]).epsilon(1e-3));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/engine/5", "[unit][conv][engine]") {
+    etl::fast_dyn_matrix<float, 3, 2, 9, 9> x;
+    etl::fast_dyn_matrix<float, 4, 2, 3, 3> w;
+
+    x = etl::normal_generator<float>(0.0, 1.0);
+    w = etl::normal_generator<float>(0.0, 1.0);
+
+    REQUIRE(dll::conv_engine_lowered(dll::conv_algorithm::IM2COL, 3, 3));
+    REQUIRE(dll::conv_engine_lowered(dll::conv_algorithm::DIRECT, 3, 3, 2, 2));
+    REQUIRE(!dll::conv_engine_lowered(dll::conv_algorithm::IM2COL, 1, 1));
+    REQUIRE(!dll::conv_engine_lowered(dll::conv_algorithm::FFT, 3, 3));
+
+    // Unit stride
+    {
+        etl::dyn_matrix<float, 3> cols(3, 2 * 3 * 3, 7 * 7);
+
+        etl::fast_dyn_matrix<float, 3, 4, 7, 7> y_ref;
+        etl::fast_dyn_matrix<float, 3, 4, 7, 7> y;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw_ref;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw;
+
+        dll::conv_engine_forward(dll::conv_algorithm::IM2COL, y_ref, x, w);
+        dll::conv_engine_backward_filter(dll::conv_algorithm::IM2COL, dw_ref, x, y_ref);
+
+        dll::conv_engine_forward_lowered(y, x, w, cols);
+        dll::conv_engine_backward_filter_lowered(dw, cols, y_ref);
+
+        for (size_t i = 0; i < etl::size(y); ++i) {
+            REQUIRE(y[i] == Approx(y_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(dw); ++i) {
+            REQUIRE(dw[i] == Approx(dw_ref[i]).epsilon(1e-3));
+        }
+    }
+
+    // Stride 2 and padding 1
+    {
+        etl::dyn_matrix<float, 3> cols(3, 2 * 3 * 3, 5 * 5);
+
+        etl::fast_dyn_matrix<float, 3, 4, 5, 5> y_ref;
+        etl::fast_dyn_matrix<float, 3, 4, 5, 5> y;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw_ref;
+        etl::fast_dyn_matrix<float, 4, 2, 3, 3> dw;
+
+        dll::conv_engine_forward(dll::conv_algorithm::IM2COL, y_ref, x, w, 2, 2, 1, 1);
+        dll::conv_engine_backward_filter(dll::conv_algorithm::IM2COL, dw_ref, x, y_ref, 2, 2, 1, 1);
+
+        dll::conv_engine_forward_lowered(y, x, w, cols, 2, 2, 1, 1);
+        dll::conv_engine_backward_filter_lowered(dw, cols, y_ref);
+
+        for (size_t i = 0; i < etl::size(y); ++i) {
+            REQUIRE(y[i] == Approx(y_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(dw); ++i) {
+            REQUIRE(dw[i] == Approx(dw_ref[i]).epsilon(1e-3));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/engine/6", "[unit][conv][engine]") {
+    etl::fast_dyn_matrix<float, 3, 1, 12, 11> x;
+    etl::fast_dyn_matrix<float, 5, 1, 5, 3> w;
+
+    x = etl::normal_generator<float>(0.0, 1.0);
+    w = etl::normal_generator<float>(0.0, 1.0);
+
+    REQUIRE(dll::single_channel_kernels<decltype(w)>::value);
+    REQUIRE(!dll::single_channel_kernels<etl::fast_dyn_matrix<float, 5, 2, 5, 3>>::value);
+    REQUIRE(!dll::single_channel_kernels<etl::dyn_matrix<float, 4>>::value);
+
+    etl::fast_dyn_matrix<float, 3, 5, 8, 9> y_ref;
+    etl::fast_dyn_matrix<float, 3, 5, 8, 9> y;
+    etl::fast_dyn_matrix<float, 3, 1, 12, 11> dx_ref;
+    etl::fast_dyn_matrix<float, 3, 1, 12, 11> dx;
+    etl::fast_dyn_matrix<float, 5, 1, 5, 3> dw_ref;
+    etl::fast_dyn_matrix<float, 5, 1, 5, 3> dw;
+
+    y_ref  = etl::ml::convolution_forward(x, w);
+    dx_ref = etl::ml::convolution_backward(y_ref, w);
+    dw_ref = etl::ml::convolution_backward_filter(x, y_ref);
+
+    for (auto a : {dll::conv_algorithm::DIRECT, dll::conv_algorithm::AUTO}) {
+        dll::conv_engine_forward(a, y, x, w);
+        dll::conv_engine_backward(a, dx, y_ref, w);
+        dll::conv_engine_backward_filter(a, dw, x, y_ref);
+
+        for (size_t i = 0; i < etl::size(y); ++i) {
+            REQUIRE(y[i] == Approx(y_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(dx); ++i) {
+            REQUIRE(dx[i] == Approx(dx_ref[i]).epsilon(1e-3));
+        }
+
+        for (size_t i = 0; i < etl::size(dw); ++i) {
+            REQUIRE(dw[i] == Approx(dw_ref[i]).epsilon(1e-3));
+        }
+    }
+}
@@ -160,3 +160,76 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+TEST_CASE("unit/crbm/tiled/1", "[crbm][unit]") {
+    using tiled_type = dll::conv_rbm_square_desc<
+        1, 28, 20, 24,
+        dll::batch_size<5>,
+        dll::conv_engine<dll::conv_algorithm::AUTO>,
+        dll::momentum>::layer_t;
+
+    using etl_type = dll::conv_rbm_square_desc<
+        1, 28, 20, 24,
+        dll::batch_size<5>,
+        dll::momentum>::layer_t;
+
+    tiled_type rbm;
+    etl_type ref;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 20);
+    REQUIRE(error < 5e-2);
+
+    ref.w = rbm.w;
+    ref.b = rbm.b;
+    ref.c = rbm.c;
+
+    etl::fast_dyn_matrix<float, 5, 1, 28, 28> v;
+
+    for (size_t i = 0; i < 5; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    // The tiled kernels and the ETL activations give the same probabilities
+    etl::fast_dyn_matrix<float, 5, 20, 24, 24> h;
+    etl::fast_dyn_matrix<float, 5, 20, 24, 24> h_ref;
+
+    rbm.batch_activate_hidden<true, false>(h, h, v, v);
+    ref.batch_activate_hidden<true, false>(h_ref, h_ref, v, v);
+
+    REQUIRE(etl::max(etl::abs(h - h_ref)) < 1e-4);
+
+    etl::fast_dyn_matrix<float, 5, 1, 28, 28> v2;
+    etl::fast_dyn_matrix<float, 5, 1, 28, 28> v2_ref;
+
+    rbm.batch_activate_visible<true, false>(h, h, v2, v2);
+    ref.batch_activate_visible<true, false>(h, h, v2_ref, v2_ref);
+
+    REQUIRE(etl::max(etl::abs(v2 - v2_ref)) < 1e-4);
+}
+
+TEST_CASE("unit/crbm/gradients/1", "[crbm][unit]") {
+    etl::fast_dyn_matrix<float, 6, 2, 12, 12> v1;
+    etl::fast_dyn_matrix<float, 6, 2, 12, 12> v2;
+    etl::fast_dyn_matrix<float, 6, 3, 8, 8> h1;
+    etl::fast_dyn_matrix<float, 6, 3, 8, 8> h2;
+
+    v1 = etl::uniform_generator(-1.0, 1.0);
+    v2 = etl::uniform_generator(-1.0, 1.0);
+    h1 = etl::uniform_generator(0.0, 1.0);
+    h2 = etl::uniform_generator(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 2, 5, 5> w_grad;
+    etl::fast_dyn_matrix<float, 3, 2, 5, 5> w_ref;
+
+    dll::crbm_detail::weight_gradients(6, 2, 12, 12, 3, 8, 8,
+                                       v1.memory_start(), h1.memory_start(), v2.memory_start(), h2.memory_start(), w_grad.memory_start());
+
+    w_ref = etl::conv_4d_valid_filter_flipped(v1, h1) - etl::conv_4d_valid_filter_flipped(v2, h2);
+
+    REQUIRE(etl::max(etl::abs(w_grad - w_ref)) < 1e-3);
+}
@@ -157,3 +157,42 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 30);
     REQUIRE(error < 0.1);
 }
+
+TEST_CASE("unit/crbm_mp/mnist/8", "[crbm_mp][pmp][unit]") {
+    dll::conv_rbm_mp_desc_square<
+        1, 28, 5, 17, 2,
+        dll::weight_type<float>,
+        dll::batch_size<10>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 5);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> v;
+    etl::fast_dyn_matrix<float, 10, 5, 12, 12> h;
+    etl::fast_dyn_matrix<float, 10, 5, 6, 6> p;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    rbm.batch_activate_hidden<true, false>(h, h, v, v);
+    rbm.batch_activate_pooling(p, v);
+
+    // Compare the fused kernels with the reference implementation
+    auto x = etl::force_temporary(rbm.get_batch_b_rep(v) + etl::conv_4d_valid_flipped(v, rbm.w));
+
+    etl::fast_dyn_matrix<float, 10, 5, 12, 12> ref_h = etl::p_max_pool_h(x, 2, 2);
+    etl::fast_dyn_matrix<float, 10, 5, 6, 6> ref_p   = etl::p_max_pool_p(x, 2, 2);
+
+    for (size_t i = 0; i < ref_h.size(); ++i) {
+        REQUIRE(h[i] == Approx(ref_h[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < ref_p.size(); ++i) {
+        REQUIRE(p[i] == Approx(ref_p[i]).epsilon(1e-4));
+    }
+}
@@ -6,6 +6,9 @@
 //=======================================================================
 
 #include <deque>
+#include <thread>
+#include <numeric>
+#include <sstream>
 
 #include "dll_test.hpp"
 
@@ -16,6 +19,12 @@
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/transform/binarize_layer.hpp"
+#include "dll/model_file.hpp"
+#include "dll/shared_dbn.hpp"
+#include "dll/checkpoint.hpp"
+#include "dll/feature_stream.hpp"
+#include "dll/binary_dbn.hpp"
+#include "dll/util/metrics.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -84,6 +93,15 @@ TEST_CASE("unit/dbn/mnist/2", "[dbn][unit]") {
     auto error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::label_predictor());
     std::cout << "test_error:" << error << std::endl;
     REQUIRE(error < 0.3);
+
+    // The labels predicted one sample at a time
+    auto one_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, [](auto& dbn, auto& image) {
+        return dbn->predict_labels(image, 10);
+    });
+    REQUIRE(one_error < 0.3);
+
+    auto predicted = dbn->predict_labels_many(dataset.training_images, 10);
+    REQUIRE(predicted.size() == dataset.training_images.size());
 }
 
 TEST_CASE("unit/dbn/mnist/3", "[dbn][unit]") {
@@ -397,3 +415,814 @@ TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
 
     dll::dump_timers();
 }
+
+// Batch mode with cached pretraining inputs
+TEST_CASE("unit/dbn/mnist/13", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::pretrain_cache, dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/model/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<100, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    REQUIRE(dll::store_model(*dbn, ".tmp.model"));
+
+    auto loaded = std::make_unique<dbn_t>();
+
+    REQUIRE(dll::load_model(*loaded, ".tmp.model"));
+
+    REQUIRE(etl::sum(etl::abs(loaded->layer_get<0>().w - dbn->layer_get<0>().w)) == 0.0);
+    REQUIRE(etl::sum(etl::abs(loaded->layer_get<0>().c - dbn->layer_get<0>().c)) == 0.0);
+    REQUIRE(etl::sum(etl::abs(loaded->layer_get<1>().b - dbn->layer_get<1>().b)) == 0.0);
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(loaded->predict(dataset.training_images[i]) == dbn->predict(dataset.training_images[i]));
+    }
+
+    // The payloads are aligned
+    std::ifstream is(".tmp.model", std::ifstream::binary);
+
+    dll::model_file_header header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    REQUIRE(header.valid());
+    REQUIRE(header.tensors == 6);
+
+    for (size_t t = 0; t < header.tensors; ++t) {
+        dll::model_file_entry entry;
+        is.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+
+        REQUIRE(entry.offset % dll::model_file_header::alignment == 0);
+    }
+
+    // A model file cannot be loaded in a different network
+    dll::dbn_desc<dll::dbn_layers<dll::rbm<28 * 28, 50>>>::dbn_t other;
+
+    REQUIRE(!dll::load_model(other, ".tmp.model"));
+}
+
+TEST_CASE("unit/dbn/mnist/features/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<100, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    // The last batch is incomplete
+    dataset.training_images.resize(195);
+    dataset.training_labels.resize(195);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // Only two batches can be waiting to be written
+    REQUIRE(dll::stream_features(*dbn, *generator, ".tmp.features", dll::feature_encoding::FLOAT, 2));
+    REQUIRE(dll::stream_features<0>(*dbn, *generator, ".tmp.features.bf16", dll::feature_encoding::BF16));
+    REQUIRE(dll::stream_features<0>(*dbn, *generator, ".tmp.features.bits", dll::feature_encoding::BITS));
+
+    etl::dyn_matrix<float, 2> features;
+    etl::dyn_matrix<float, 2> hidden;
+    std::vector<etl::dyn_vector<float>> bits;
+
+    REQUIRE(dll::load_features(".tmp.features", features));
+    REQUIRE(dll::load_features(".tmp.features.bf16", hidden));
+    REQUIRE(dll::load_features(".tmp.features.bits", bits));
+
+    REQUIRE(bits.size() == 195);
+
+    REQUIRE(etl::dim<0>(features) == 195);
+    REQUIRE(etl::dim<1>(features) == 10);
+    REQUIRE(etl::dim<0>(hidden) == 195);
+    REQUIRE(etl::dim<1>(hidden) == 100);
+
+    for (size_t i = 0; i < 195; ++i) {
+        auto output = dbn->forward_one(dataset.training_images[i]);
+        auto first  = dbn->forward_one<0>(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(features(i, j) == Approx(output[j]));
+        }
+
+        // bfloat16 only keeps 8 bits of mantissa
+        for (size_t j = 0; j < 100; ++j) {
+            REQUIRE(hidden(i, j) == Approx(first[j]).epsilon(1e-2));
+        }
+
+        // The binary features are bit-packed
+        for (size_t j = 0; j < 100; ++j) {
+            REQUIRE(bits[i][j] == (first[j] > 0.5f ? 1.0f : 0.0f));
+        }
+    }
+
+    // The packed features can be given directly to a generator
+    auto bits_generator = dll::make_generator(bits, dataset.training_labels, bits.size(), 10, generator_t{});
+
+    REQUIRE(bits_generator->size() == 195);
+}
+
+TEST_CASE("unit/dbn/mnist/binary/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<100, 70, dll::momentum, dll::batch_size<10>>,
+            dll::rbm<70, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+    REQUIRE(error < 0.2);
+
+    auto binary = dll::binarize(*dbn);
+    auto xnor   = dll::binarize<true>(*dbn);
+
+    auto& l0 = dbn->template layer_get<0>();
+    auto& l1 = dbn->template layer_get<1>();
+    auto& l2 = dbn->template layer_get<2>();
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto& image = dataset.training_images[i];
+
+        // The reference computation, with the hidden units thresholded at 0.5
+        etl::dyn_vector<float> h1(100);
+        etl::dyn_vector<float> h2(70);
+        etl::dyn_vector<float> a(10);
+
+        h1 = l0.b + image * l0.w;
+
+        for (size_t j = 0; j < 100; ++j) {
+            h1[j] = h1[j] > 0.0f ? 1.0f : 0.0f;
+        }
+
+        h2 = l1.b + h1 * l1.w;
+
+        for (size_t j = 0; j < 70; ++j) {
+            h2[j] = h2[j] > 0.0f ? 1.0f : 0.0f;
+        }
+
+        a = etl::stable_softmax(l2.b + h2 * l2.w);
+
+        auto output = binary.features(image);
+        auto approx = xnor.features(image);
+
+        REQUIRE(etl::size(output) == 10);
+        REQUIRE(etl::size(approx) == 10);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(a[j]).epsilon(1e-3));
+        }
+
+        REQUIRE(etl::sum(approx) == Approx(1.0f));
+    }
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto metrics = binary.evaluate_metrics(*generator);
+
+    REQUIRE(std::get<0>(metrics) < 0.3);
+}
+
+TEST_CASE("unit/dbn/mnist/svm/grid/1", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(490);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    svm::rbf_grid g;
+    g.c_steps     = 3;
+    g.gamma_steps = 3;
+
+    // The features are only extracted once for both
+    REQUIRE(dbn->svm_grid_search(dataset.training_images, dataset.training_labels, 3, g));
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
+
+TEST_CASE("unit/dbn/mnist/svm/batch/1", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(490);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    // The batched kernels must give the predictions of libsvm
+    auto predictions = dbn->svm_predict_many(dataset.training_images);
+
+    REQUIRE(predictions.size() == dataset.training_images.size());
+
+    size_t different = 0;
+
+    for (size_t i = 0; i < predictions.size(); ++i) {
+        auto expected = svm::predict(dbn->svm_model, dbn->forward_one(dataset.training_images[i]));
+
+        different += predictions[i] != expected;
+
+        if (i < 25) {
+            REQUIRE(dbn->svm_predict(dataset.training_images[i]) == predictions[i]);
+        }
+    }
+
+    REQUIRE(different <= 2);
+}
+
+TEST_CASE("unit/dbn/mnist/svm/linear/1", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(490);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    // Linear SVM
+    REQUIRE(dbn->linear_train(dataset.training_images, dataset.training_labels));
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+
+    // The classifier is stored with the weights
+    dbn->store("linear.tmp.dat");
+
+    auto loaded = std::make_unique<dbn_t>();
+    loaded->load("linear.tmp.dat");
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(loaded->svm_predict(dataset.training_images[i]) == dbn->svm_predict(dataset.training_images[i]));
+    }
+
+    // Logistic regression
+    dll::linear_parameters parameters;
+    parameters.type = dll::linear_type::LOGISTIC;
+
+    REQUIRE(dbn->linear_train(dataset.training_images, dataset.training_labels, parameters));
+
+    test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
+
+TEST_CASE("unit/dbn/mnist/features/2", "[dbn][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 50, dll::momentum, dll::batch_size<10>, dll::init_weights>::layer_t,
+            dll::rbm_desc<50, 20, dll::momentum, dll::batch_size<10>>::layer_t>,
+        dll::batch_size<10>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    etl::dyn_matrix<float, 2> batch(10, 28 * 28);
+
+    for (size_t b = 0; b < 10; ++b) {
+        batch(b) = dataset.training_images[b];
+    }
+
+    auto features = dbn->full_activation_probabilities_batch(batch);
+
+    REQUIRE(etl::dim<0>(features) == 10);
+    REQUIRE(etl::dim<1>(features) == dbn->full_output_size());
+
+    for (size_t b = 0; b < 10; ++b) {
+        auto expected = dbn->full_activation_probabilities(dataset.training_images[b]);
+
+        for (size_t j = 0; j < dbn->full_output_size(); ++j) {
+            REQUIRE(features(b, j) == Approx(expected[j]));
+        }
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/features/3", "[dbn][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 50, dll::momentum, dll::batch_size<10>, dll::init_weights>::layer_t,
+            dll::rbm_desc<50, 30, dll::momentum, dll::batch_size<10>>::layer_t,
+            dll::rbm_desc<30, 20, dll::momentum, dll::batch_size<10>>::layer_t>,
+        dll::batch_size<10>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    etl::dyn_matrix<float, 2> batch(10, 28 * 28);
+
+    for (size_t b = 0; b < 10; ++b) {
+        batch(b) = dataset.training_images[b];
+    }
+
+    // The layers are given at compile-time, in any order
+    etl::dyn_matrix<float, 2> third(10, 20);
+    etl::dyn_matrix<float, 2> first(10, 50);
+
+    dbn->test_forward_batch_layers<2, 0>(batch, third, first);
+
+    // The layers are given at runtime
+    std::vector<etl::dyn_matrix<float, 2>> outputs;
+
+    dbn->test_forward_batch_layers(batch, {1, 2}, outputs);
+
+    REQUIRE(outputs.size() == 2);
+    REQUIRE(etl::dim<1>(outputs[0]) == 30);
+    REQUIRE(etl::dim<1>(outputs[1]) == 20);
+
+    auto expected_first  = dbn->test_forward_batch<0>(batch);
+    auto expected_second = dbn->test_forward_batch<1>(batch);
+    auto expected_third  = dbn->test_forward_batch<2>(batch);
+
+    for (size_t b = 0; b < 10; ++b) {
+        for (size_t j = 0; j < 50; ++j) {
+            REQUIRE(first(b, j) == Approx(expected_first(b, j)));
+        }
+
+        for (size_t j = 0; j < 30; ++j) {
+            REQUIRE(outputs[0](b, j) == Approx(expected_second(b, j)));
+        }
+
+        for (size_t j = 0; j < 20; ++j) {
+            REQUIRE(third(b, j) == Approx(expected_third(b, j)));
+            REQUIRE(outputs[1](b, j) == Approx(expected_third(b, j)));
+        }
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/checkpoint/1", "[dbn][sgd][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    dll::checkpoint_manager checkpoints(".tmp.checkpoint");
+    checkpoints.epoch_period = 2;
+    checkpoints.keep         = 2;
+
+    dbn->checkpoints = &checkpoints;
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 6);
+
+    // The training waits for the last checkpoint
+    REQUIRE(checkpoints.latest() == ".tmp.checkpoint.6.0.dllm");
+    REQUIRE(!std::ifstream(".tmp.checkpoint.2.0.dllm"));
+    REQUIRE(std::ifstream(".tmp.checkpoint.4.0.dllm"));
+
+    auto resumed = std::make_unique<dbn_t>();
+
+    dll::checkpoint_manager resumed_checkpoints(".tmp.checkpoint");
+
+    REQUIRE(resumed_checkpoints.resume(*resumed));
+    REQUIRE(resumed_checkpoints.first_epoch == 6);
+
+    REQUIRE(etl::sum(etl::abs(resumed->layer_get<0>().w - dbn->layer_get<0>().w)) == 0.0);
+    REQUIRE(etl::sum(etl::abs(resumed->layer_get<1>().b - dbn->layer_get<1>().b)) == 0.0);
+
+    // The state of the training is restored and consumed by the trainer
+    REQUIRE(!resumed_checkpoints.state.empty());
+
+    resumed->learning_rate = 0.05;
+    resumed->checkpoints   = &resumed_checkpoints;
+
+    auto error = resumed->fine_tune(dataset.training_images, dataset.training_labels, 8);
+
+    REQUIRE(resumed_checkpoints.state.empty());
+    REQUIRE(resumed_checkpoints.latest() == ".tmp.checkpoint.8.0.dllm");
+    REQUIRE(error < 0.5);
+}
+
+TEST_CASE("unit/dbn/reporter/1", "[dbn][unit]") {
+    dll::progress_reporter reporter;
+
+    std::atomic<size_t> queued(0);
+
+    // Two watchers reporting concurrently
+    auto push = [&reporter, &queued](size_t epoch) {
+        for (size_t b = 0; b < 20; ++b) {
+            dll::progress_record record;
+            record.kind    = dll::progress_record::kind_t::FT_BATCH;
+            record.epoch   = epoch;
+            record.batch   = b;
+            record.batches = 20;
+            record.error   = 0.5;
+            record.value   = 0.25;
+
+            queued += reporter.push(record);
+        }
+    };
+
+    std::thread first(push, 0);
+    std::thread second(push, 1);
+
+    first.join();
+    second.join();
+
+    reporter.flush();
+
+    REQUIRE(queued == 40);
+    REQUIRE(reporter.dropped_records() == 0);
+
+    dll::report_throttle throttle;
+
+    REQUIRE(throttle.pass());
+    REQUIRE(throttle.pass());
+
+    throttle.period = 60 * 1000;
+
+    REQUIRE(throttle.pass());
+    REQUIRE(!throttle.pass());
+}
+
+TEST_CASE("unit/dbn/metrics/1", "[dbn][unit]") {
+    dll::metrics_config config;
+    config.file   = ".tmp.metrics.prom";
+    config.period = 10;
+
+    {
+        dll::metrics_exporter exporter(config);
+
+        exporter.update([](dll::training_metrics& m) {
+            for (size_t i = 0; i < 2 * dll::training_metrics::max_latencies; ++i) {
+                m.add_latency(i % 100);
+            }
+
+            m.samples = 1000;
+            m.loss    = 0.25;
+
+            REQUIRE(m.latencies.size() == dll::training_metrics::max_latencies);
+            REQUIRE(m.latency_percentile(0.0) == Approx(0.0));
+            REQUIRE(m.latency_percentile(0.9) == Approx(90.0).margin(1.0));
+            REQUIRE(m.latency_percentile(1.0) == Approx(99.0));
+        });
+
+        exporter.export_metrics();
+    }
+
+    std::ifstream is(".tmp.metrics.prom");
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+    REQUIRE(text.find("dll_samples_total 1000") != std::string::npos);
+    REQUIRE(text.find("dll_loss 0.25") != std::string::npos);
+    REQUIRE(text.find("dll_val_loss") == std::string::npos);
+}
+
+TEST_CASE("unit/dbn/memory/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<100, 50, dll::batch_size<10>>::layer_t,
+            dll::rbm_desc<50, 10, dll::batch_size<10>>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto report = dbn->memory_usage();
+
+    REQUIRE(report.layers.size() == 2);
+
+    REQUIRE(report.layers[0].parameters == (100 * 50 + 50 + 100) * sizeof(float));
+    REQUIRE(report.layers[0].backup == report.layers[0].parameters);
+    REQUIRE(report.layers[0].updater == (100 * 50 + 50) * sizeof(float));
+    REQUIRE(report.layers[0].activations == 10 * (100 + 2 * 50) * sizeof(float));
+    REQUIRE(report.layers[0].cd == 69600);
+    REQUIRE(report.layers[1].cd == 14960);
+
+    REQUIRE(report.resident() == 2 * (20600 + 2240));
+    REQUIRE(report.sgd() == 20200 + 8000 + 2040 + 2800);
+    REQUIRE(report.cd() == 69600);
+    REQUIRE(report.peak() == report.resident() + report.cd());
+
+    std::vector<etl::dyn_matrix<float, 1>> samples(20, etl::dyn_matrix<float, 1>(100, 1.0f));
+    std::vector<uint8_t> labels(20, 1);
+
+    auto generator = dll::make_generator(samples, labels, samples.size(), 10, dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>{});
+
+    auto full = dbn->memory_usage(*generator);
+
+    REQUIRE(full.generator >= 20 * 100 * sizeof(float));
+    REQUIRE(full.peak() == report.peak() + full.generator);
+}
+
+TEST_CASE("unit/dbn/roofline/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<100, 50, dll::batch_size<10>>::layer_t,
+            dll::rbm_desc<50, 10, dll::batch_size<10>>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto costs = dbn->costs();
+
+    REQUIRE(costs.size() == 2);
+    REQUIRE(costs[0].batch == 10);
+
+    // h = v * W for a batch of 10
+    REQUIRE(costs[0][dll::layer_phase::FORWARD].flops == Approx(2.0 * 10 * 100 * 50));
+    REQUIRE(costs[0][dll::layer_phase::FORWARD].bytes == Approx((10 * 100 + 100 * 50 + 10 * 50) * sizeof(float)));
+    REQUIRE(costs[1][dll::layer_phase::FORWARD].flops == Approx(2.0 * 10 * 50 * 10));
+
+    // Three products for the Gibbs step and two for the gradients
+    REQUIRE(costs[0][dll::layer_phase::CD].flops == Approx(5 * 2.0 * 10 * 100 * 50));
+    REQUIRE(costs[0][dll::layer_phase::BACKWARD].flops == 0.0);
+
+    std::vector<etl::dyn_matrix<float, 1>> samples(20, etl::dyn_matrix<float, 1>(100));
+
+    for (auto& sample : samples) {
+        sample = etl::uniform_generator(0.0, 1.0);
+    }
+
+    dll::start_profiling();
+    dbn->pretrain(samples, 1);
+    dll::stop_profiling();
+
+    auto measures = dll::measure_phases(2);
+
+    REQUIRE(measures[0][size_t(dll::layer_phase::CD)].count == 2);
+    REQUIRE(measures[1][size_t(dll::layer_phase::CD)].count == 2);
+
+    std::ostringstream os;
+    dll::display_performance(*dbn, os, 100.0, 10.0);
+
+    REQUIRE(os.str().find("GFLOP/s") != std::string::npos);
+
+    dll::reset_profiling();
+}
+
+TEST_CASE("unit/dbn/reentrant/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    // The expected results, computed serially
+    std::vector<size_t> expected(dataset.training_images.size());
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = dbn->predict(dataset.training_images[i]);
+    }
+
+    // Several threads share the same const network
+    const dbn_t& shared = *dbn;
+
+    std::vector<size_t> mismatches(4, 0);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t r = 0; r < 5; ++r) {
+                for (size_t i = t; i < expected.size(); i += 4) {
+                    if (shared.predict(dataset.training_images[i]) != expected[i]) {
+                        ++mismatches[t];
+                    }
+
+                    // The reconstruction is sampled, only its validity is checked
+                    if (!std::isfinite(shared.layer_get<0>().reconstruction_error(dataset.training_images[i]))) {
+                        ++mismatches[t];
+                    }
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(std::accumulate(mismatches.begin(), mismatches.end(), size_t(0)) == 0);
+}
+
+TEST_CASE("unit/dbn/shared/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t base_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t top_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto trained = std::make_unique<base_t>();
+
+    trained->pretrain(dataset.training_images, 5);
+
+    REQUIRE(dll::store_model(*trained, ".tmp.shared.model"));
+
+    // The base network is only loaded once
+    auto base   = dll::load_shared<base_t>(".tmp.shared.model");
+    auto second = dll::load_shared<base_t>(".tmp.shared.model");
+
+    REQUIRE(base);
+    REQUIRE(base.get() == second.get());
+
+    std::shared_ptr<const top_t> top_1 = std::make_shared<top_t>();
+    std::shared_ptr<const top_t> top_2 = std::make_shared<top_t>();
+
+    auto model_1 = dll::make_shared_dbn(base, top_1);
+    auto model_2 = dll::make_shared_dbn(base, top_2);
+
+    REQUIRE(base.use_count() == 4);
+
+    for (size_t i = 0; i < 10; ++i) {
+        auto& image = dataset.training_images[i];
+
+        REQUIRE(model_1.predict(image) == top_1->predict(trained->features(image)));
+        REQUIRE(model_2.predict(image) == top_2->predict(trained->features(image)));
+    }
+
+    // The variants can be used concurrently
+    std::vector<size_t> expected(dataset.training_images.size());
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = model_1.predict(dataset.training_images[i]);
+    }
+
+    std::vector<size_t> mismatches(4, 0);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < expected.size(); i += 4) {
+                if (model_1.predict(dataset.training_images[i]) != expected[i]) {
+                    ++mismatches[t];
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(std::accumulate(mismatches.begin(), mismatches.end(), size_t(0)) == 0);
+
+    // An invalid file is not loaded
+    REQUIRE(!dll::load_shared<base_t>(".tmp.missing.model"));
+}
+
+TEST_CASE("unit/dbn/pretrain/directory/1", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<10>>,
+            dll::rbm<100, 50, dll::momentum, dll::batch_size<10>>,
+            dll::rbm<50, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    char directory[] = "/tmp/dll_pretrain_XXXXXX";
+    REQUIRE(mkdtemp(directory));
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain_directory = directory;
+    dbn->pretrain(dataset.training_images, 10);
+
+    // The second pretraining reloads the weights and the outputs of every layer
+    auto resumed = std::make_unique<dbn_t>();
+    resumed->pretrain_directory = directory;
+    resumed->pretrain(dataset.training_images, 10);
+
+    REQUIRE(etl::sum(etl::abs(resumed->template layer_get<0>().w - dbn->template layer_get<0>().w)) == 0.0f);
+    REQUIRE(etl::sum(etl::abs(resumed->template layer_get<1>().w - dbn->template layer_get<1>().w)) == 0.0f);
+    REQUIRE(etl::sum(etl::abs(resumed->template layer_get<2>().w - dbn->template layer_get<2>().w)) == 0.0f);
+
+    auto error = resumed->fine_tune(dataset.training_images, dataset.training_labels, 5);
+    REQUIRE(error < 0.2);
+}
@@ -14,6 +14,9 @@
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/dbn.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
+#include "dll/anomaly.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/transform/binarize_layer.hpp"
 
@@ -49,3 +52,73 @@ TEST_CASE("dbn/ae/1", "[unit][rbm][dbn][mnist][sgd][ae]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+TEST_CASE("dbn/ae/tied/1", "[unit][dense][dbn][mnist][sgd][ae]") {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            dll::dense_layer_desc<100, 32, dll::relu>::layer_t,
+            // Features
+            dll::tied_dense_layer_desc<32, 100, dll::relu>::layer_t,
+            dll::tied_dense_layer_desc<100, 28 * 28, dll::sigmoid>::layer_t
+        >, dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::network_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<network_t>();
+
+    dbn->display();
+
+    // The decoder uses the weights of the encoder
+    REQUIRE(dbn->layer_get<2>().tied_w == &dbn->layer_get<1>().w);
+    REQUIRE(dbn->layer_get<3>().tied_w == &dbn->layer_get<0>().w);
+
+    dbn->learning_rate = 0.1;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.2);
+
+    auto test_error = dll::test_set_ae(*dbn, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+
+    // The batched scores of the samples
+    auto errors = dll::ae_reconstruction_errors(*dbn, dataset.test_images);
+
+    REQUIRE(errors.size() == dataset.test_images.size());
+    REQUIRE(std::all_of(errors.begin(), errors.end(), [](double e) { return std::isfinite(e) && e >= 0.0; }));
+}
+
+TEST_CASE("dbn/ae/tied/2", "[unit][dense][dbn][mnist][sgd][ae]") {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::relu>::layer_t,
+            // Features
+            dll::tied_dense_layer_desc<100, 28 * 28, dll::sigmoid>::layer_t
+        >, dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::network_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<network_t>();
+
+    REQUIRE(dbn->layer_get<1>().tied_w == &dbn->layer_get<0>().w);
+
+    dbn->learning_rate = 0.1;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.2);
+
+    auto test_error = dll::test_set_ae(*dbn, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
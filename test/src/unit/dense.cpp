@@ -6,14 +6,29 @@
 //=======================================================================
 
 #include <deque>
+#include <atomic>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
+#include "dll/transform/rectifier_layer.hpp"
+#include "dll/transform/scale_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/batch_predictor.hpp"
+#include "dll/trainer/online_trainer.hpp"
 #include "dll/datasets.hpp"
+#include "dll/perf_watcher.hpp"
+#include "dll/util/compression.hpp"
+#include "dll/trainer/updater_kernels.hpp"
+#include "dll/factorization.hpp"
+#include "dll/ensemble.hpp"
+#include "dll/early_exit.hpp"
+#include "dll/cascade.hpp"
+#include "dll/frozen_dbn.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -310,3 +325,1478 @@ TEST_CASE("unit/dense/sgd/14", "[unit][dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test data-parallel training
+TEST_CASE("unit/dense/sgd/15", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::data_parallel<4>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test pipeline-parallel training
+TEST_CASE("unit/dense/sgd/pipeline/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::data_parallel<4>, dll::pipeline_parallel<2>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The stages have about the same number of parameters
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+    REQUIRE(trainer.stage_begins[0] == 0);
+    REQUIRE(trainer.stage_begins[1] == 1);
+    REQUIRE(trainer.stage_begins[2] == 3);
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/16", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // All the contexts must be allocated inside the arena
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+    REQUIRE(trainer.training_memory() == dll::sgd_trainer<dbn_t>::arena_size);
+    REQUIRE(trainer.training_memory() >= 20 * (28 * 28 + 100 + 100 + 100 + 10 + 10) * sizeof(float));
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/17", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+
+    // The intermediate representations are released along the way, the
+    // results must not change
+    etl::dyn_matrix<float, 2> batch(20, 28 * 28);
+
+    for (size_t i = 0; i < 20; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    decltype(dataset.training_images) samples(dataset.training_images.begin(), dataset.training_images.begin() + 20);
+
+    auto batch_output = dbn->forward_batch(batch);
+    auto many_output  = dbn->test_forward_many(samples);
+
+    REQUIRE(many_output.size() == 20);
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto one_output = dbn->forward_one(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(batch_output(i, j) == Approx(one_output[j]));
+            REQUIRE(many_output[i][j] == Approx(one_output[j]));
+        }
+    }
+
+    // The input must not be released
+    REQUIRE(batch.size() == 20 * 28 * 28);
+    REQUIRE(samples.size() == 20);
+
+    // The collections are forwarded by chunks of the batch size, the last
+    // chunk being partial
+    auto chunked_output = dbn->test_forward_many(dataset.training_images.begin(), dataset.training_images.begin() + 45);
+    auto hidden_output  = dbn->forward_many<1>(dataset.training_images.begin(), dataset.training_images.begin() + 45);
+
+    REQUIRE(chunked_output.size() == 45);
+    REQUIRE(hidden_output.size() == 45);
+
+    for (size_t i = 0; i < 45; ++i) {
+        auto one_output = dbn->forward_one(dataset.training_images[i]);
+        auto hidden_one = dbn->forward_one<1>(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(chunked_output[i][j] == Approx(one_output[j]));
+        }
+
+        for (size_t j = 0; j < 50; ++j) {
+            REQUIRE(hidden_output[i][j] == Approx(hidden_one[j]));
+        }
+    }
+}
+
+TEST_CASE("unit/dense/sgd/18", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+
+    // The requests are flushed in batches of at most 10 samples
+    auto predictor = dll::make_batch_predictor(*dbn, 10, std::chrono::microseconds(1000));
+
+    std::vector<std::future<size_t>> labels;
+    std::vector<std::future<dll::batch_predictor<dbn_t>::output_one_t>> features;
+
+    for (size_t i = 0; i < 25; ++i) {
+        labels.push_back(predictor->predict(dataset.training_images[i]));
+        features.push_back(predictor->features(dataset.training_images[i]));
+    }
+
+    for (size_t i = 0; i < 25; ++i) {
+        auto one_output = dbn->forward_one(dataset.training_images[i]);
+        auto output     = features[i].get();
+
+        REQUIRE(labels[i].get() == dbn->predict(dataset.training_images[i]));
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(one_output[j]));
+        }
+    }
+}
+
+TEST_CASE("unit/dense/sgd/18/cache", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(10, 0.1);
+
+    // At most 1024 outputs are cached
+    auto predictor = dll::make_batch_predictor(*dbn, 10, std::chrono::microseconds(1000), 1024);
+
+    REQUIRE(predictor->output_cache());
+
+    for (size_t i = 0; i < 10; ++i) {
+        predictor->features(dataset.training_images[i]).get();
+    }
+
+    REQUIRE(predictor->output_cache()->hit_count() == 0);
+    REQUIRE(predictor->output_cache()->size() == 10);
+
+    // The repeated samples are answered from the cache
+    for (size_t i = 0; i < 10; ++i) {
+        auto one_output = dbn->forward_one(dataset.training_images[i]);
+        auto output     = predictor->features(dataset.training_images[i]).get();
+
+        REQUIRE(predictor->predict(dataset.training_images[i]).get() == dbn->predict(dataset.training_images[i]));
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(one_output[j]));
+        }
+    }
+
+    REQUIRE(predictor->output_cache()->hit_count() == 20);
+    REQUIRE(predictor->output_cache()->hit_rate() == Approx(20.0 / 30.0));
+
+    // Training the network invalidates the cached outputs
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 1);
+
+    auto one_output = dbn->forward_one(dataset.training_images[0]);
+    auto output     = predictor->features(dataset.training_images[0]).get();
+
+    REQUIRE(predictor->output_cache()->hit_count() == 20);
+
+    for (size_t j = 0; j < 10; ++j) {
+        REQUIRE(output[j] == Approx(one_output[j]));
+    }
+
+    // So does loading the network
+    dbn->store("cache.tmp.dat");
+    dbn->load("cache.tmp.dat");
+
+    predictor->features(dataset.training_images[0]).get();
+
+    REQUIRE(predictor->output_cache()->hit_count() == 20);
+    REQUIRE(predictor->output_cache()->size() == 1);
+}
+
+TEST_CASE("unit/dense/sgd/online/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The weights are published every 10 batches
+    auto online = dll::make_online_trainer(*dbn, 10);
+
+    REQUIRE(online->published_snapshots() == 1);
+
+    auto initial = online->snapshot();
+
+    auto batch           = etl::force_temporary(dataset.test().data_batch());
+    auto initial_outputs = etl::force_temporary(initial->forward_batch(batch));
+
+    // The snapshots are served while the network is trained
+    std::atomic<bool> done(false);
+    std::atomic<size_t> invalid(0);
+
+    std::thread server([&]() {
+        while (!done) {
+            auto snapshot = online->snapshot();
+
+            auto output = snapshot->forward_batch(batch);
+
+            if (!std::isfinite(etl::sum(output))) {
+                ++invalid;
+            }
+        }
+    });
+
+    auto& train = dataset.train();
+
+    for (size_t epoch = 0; epoch < 10; ++epoch) {
+        train.reset();
+
+        while (train.has_next_batch()) {
+            online->train_batch(train.data_batch(), train.label_batch());
+            train.next_batch();
+        }
+    }
+
+    done = true;
+    server.join();
+
+    REQUIRE(invalid == 0);
+    REQUIRE(online->trained_batches() == 250);
+    REQUIRE(online->published_snapshots() == 26);
+
+    // The initial snapshot was never modified
+    REQUIRE(etl::sum(etl::abs(initial->forward_batch(batch) - initial_outputs)) == 0.0f);
+
+    // The last snapshot has the weights of the network
+    online->publish();
+
+    auto snapshot = online->snapshot();
+    auto outputs  = etl::force_temporary(snapshot->forward_batch(batch));
+    auto expected = etl::force_temporary(dbn->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(outputs); ++i) {
+        REQUIRE(outputs[i] == Approx(expected[i]));
+    }
+
+    REQUIRE(dbn->evaluate_error(dataset.test()) < 0.25);
+}
+
+TEST_CASE("unit/dense/sgd/19", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    dll::start_profiling();
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    dll::stop_profiling();
+
+    std::ostringstream csv;
+    dll::export_profile_csv(csv);
+
+    // The events of the dense layers are attributed to their layer
+    REQUIRE(csv.str().find("dense:forward_batch,0,") != std::string::npos);
+    REQUIRE(csv.str().find("dense:forward_batch,1,") != std::string::npos);
+
+    std::ostringstream trace;
+    dll::export_chrome_trace(trace);
+
+    REQUIRE(trace.str().find("\"name\":\"dense:forward_batch\"") != std::string::npos);
+    REQUIRE(trace.str().find("\"layer\":1") != std::string::npos);
+}
+
+TEST_CASE("unit/dense/flight/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // 20 batches are trained, only the last 16 are kept
+    dll::start_flight_recorder(16);
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    dll::stop_flight_recorder();
+
+    auto records = dll::flight_records();
+
+    REQUIRE(records.size() == 16);
+    REQUIRE(records.front().batch == 4);
+    REQUIRE(records.back().batch == 19);
+
+    for (auto& record : records) {
+        REQUIRE(record.source == dll::flight_source::SGD);
+        REQUIRE(record.samples == 20);
+        REQUIRE(record.durations[size_t(dll::flight_phase::FORWARD)] > 0);
+        REQUIRE(record.durations[size_t(dll::flight_phase::BACKWARD)] > 0);
+    }
+
+    std::ostringstream trace;
+    dll::export_flight_chrome_trace(trace);
+
+    REQUIRE(trace.str().find("\"name\":\"forward\"") != std::string::npos);
+    REQUIRE(trace.str().find("\"batch\":19") != std::string::npos);
+}
+
+TEST_CASE("unit/dense/sgd/20", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::watcher<dll::perf_dbn_watcher>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The counters may not be available, but the training must not be affected
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.25);
+
+    // The listener must be removed after training
+    REQUIRE(dll::current_layer_listener() == nullptr);
+}
+
+TEST_CASE("unit/dense/sgd/21", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::parallel_evaluation>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    // The parallel evaluation must give the same metrics as the serial one
+    auto forward_helper = [&dbn](auto&& input_batch) {
+        return dbn->forward_batch(input_batch);
+    };
+
+    double parallel_error, parallel_loss;
+    std::tie(parallel_error, parallel_loss) = dbn->evaluate_metrics(*test_generator);
+
+    double serial_error, serial_loss;
+    std::tie(serial_error, serial_loss) = dbn->evaluate_metrics(*test_generator, forward_helper);
+
+    std::cout << "test_error:" << parallel_error << std::endl;
+
+    REQUIRE(parallel_error < 0.3);
+    REQUIRE(parallel_error == Approx(serial_error));
+    REQUIRE(parallel_loss == Approx(serial_loss));
+}
+
+TEST_CASE("unit/dense/sgd/22", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>,
+        dll::async_validation, dll::early_stopping<dll::strategy::LOSS_BEST>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 1000, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The validation runs on a snapshot while the next epoch is trained
+    FT_CHECK_2_VAL(dbn, dataset, 30, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/sgd/23", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>,
+        dll::early_stopping<dll::strategy::ERROR_BEST>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 1000, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+    dbn->patience      = 3;
+
+    // The early stopping decisions are taken on the first 100 validation samples
+    dbn->validation_subsample = 100;
+
+    FT_CHECK_2_VAL(dbn, dataset, 30, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+
+    // The subsample gives the same metrics as the samples it contains
+    auto forward_helper = [&dbn](auto&& input_batch) {
+        return dbn->forward_batch(input_batch);
+    };
+
+    double sub_error, sub_loss;
+    std::tie(sub_error, sub_loss) = dbn->evaluate_metrics(dataset.val(), forward_helper, 100);
+
+    double par_error, par_loss;
+    std::tie(par_error, par_loss) = dbn->evaluate_metrics_parallel(dataset.val(), 100);
+
+    REQUIRE(sub_error == Approx(par_error));
+    REQUIRE(sub_loss == Approx(par_loss));
+}
+
+TEST_CASE("unit/dense/sparse/1", "[unit][dense][sparse]") {
+    using dense_t  = dll::dense_layer_desc<64, 16, dll::activation<dll::function::IDENTITY>>::layer_t;
+    using sparse_t = dll::dense_layer_desc<64, 16, dll::activation<dll::function::IDENTITY>, dll::sparse_input>::layer_t;
+
+    dense_t dense;
+    sparse_t sparse;
+
+    sparse.w = dense.w;
+    sparse.b = dense.b;
+
+    // 3 non-zeros per sample (< 5%)
+    etl::fast_dyn_matrix<float, 8, 64> input(0.0);
+
+    for (size_t i = 0; i < 8; ++i) {
+        input(i, (i * 7) % 64)      = 1.0;
+        input(i, (i * 13 + 5) % 64) = 0.5;
+        input(i, (i * 3 + 40) % 64) = 2.0;
+    }
+
+    etl::fast_dyn_matrix<float, 8, 16> dense_output;
+    etl::fast_dyn_matrix<float, 8, 16> sparse_output;
+
+    dense.forward_batch(dense_output, input);
+    sparse.forward_batch(sparse_output, input);
+
+    for (size_t i = 0; i < etl::size(dense_output); ++i) {
+        REQUIRE(sparse_output[i] == Approx(dense_output[i]));
+    }
+
+    etl::fast_dyn_matrix<float, 8, 16> errors;
+    errors = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 64, 16> dense_grad;
+    etl::fast_dyn_matrix<float, 64, 16> sparse_grad;
+
+    dense_grad = etl::batch_outer(input, errors);
+
+    REQUIRE(dll::sparse_batch_outer(sparse_grad, input, errors));
+
+    for (size_t i = 0; i < etl::size(dense_grad); ++i) {
+        REQUIRE(sparse_grad[i] == Approx(dense_grad[i]));
+    }
+
+    // A dense batch is not computed with the sparse products
+    input = 1.0;
+
+    REQUIRE(!dll::sparse_batch_outer(sparse_grad, input, errors));
+}
+
+TEST_CASE("unit/dense/sparse/2", "[unit][dense][sparse]") {
+    // 2 active units per sample (< 10%)
+    etl::fast_dyn_matrix<float, 8, 32> errors(0.0);
+
+    for (size_t i = 0; i < 8; ++i) {
+        errors(i, (i * 5) % 32)      = 1.0;
+        errors(i, (i * 11 + 3) % 32) = -0.5;
+    }
+
+    etl::fast_dyn_matrix<float, 64, 32> w;
+    w = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 8, 64> dense_output;
+    etl::fast_dyn_matrix<float, 8, 64> sparse_output;
+
+    dense_output = errors * etl::transpose(w);
+
+    REQUIRE(dll::sparse_mul_transposed(sparse_output, errors, w));
+
+    for (size_t i = 0; i < etl::size(dense_output); ++i) {
+        REQUIRE(sparse_output[i] == Approx(dense_output[i]));
+    }
+
+    etl::fast_dyn_matrix<float, 8, 64> input;
+    input = etl::normal_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 64, 32> dense_grad;
+    etl::fast_dyn_matrix<float, 64, 32> sparse_grad;
+
+    dense_grad = etl::batch_outer(input, errors);
+
+    REQUIRE(dll::sparse_errors_outer(sparse_grad, input, errors));
+
+    for (size_t i = 0; i < etl::size(dense_grad); ++i) {
+        REQUIRE(sparse_grad[i] == Approx(dense_grad[i]));
+    }
+
+    // The product can be subtracted from the gradients
+    REQUIRE(dll::sparse_errors_outer(sparse_grad, input, errors, -1.0f, true));
+
+    for (size_t i = 0; i < etl::size(sparse_grad); ++i) {
+        REQUIRE(std::abs(sparse_grad[i]) < 1e-5);
+    }
+
+    // Dense errors are not computed with the sparse products
+    errors = 1.0;
+
+    REQUIRE(!dll::sparse_mul_transposed(sparse_output, errors, w));
+    REQUIRE(!dll::sparse_errors_outer(sparse_grad, input, errors));
+}
+
+TEST_CASE("unit/dense/sgd/sparse_relu/1", "[unit][dense][dbn][mnist][sgd][sparse]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200, dll::relu, dll::sparse_relu>::layer_t,
+            dll::dense_layer_desc<200, 100, dll::relu, dll::sparse_relu>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_2(dbn, dataset, 50, 0.1);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/fast_math/1", "[unit][dense][fast_math]") {
+    for (float x = -20.0f; x <= 20.0f; x += 0.01f) {
+        REQUIRE(dll::fast_exp(x) == Approx(std::exp(x)).epsilon(1e-5));
+        REQUIRE(std::abs(dll::fast_sigmoid(x) - 1.0f / (1.0f + std::exp(-x))) < 1e-5);
+        REQUIRE(std::abs(dll::fast_tanh(x) - std::tanh(x)) < 1e-5);
+    }
+
+    etl::fast_dyn_matrix<float, 4, 10> x;
+    x = etl::normal_generator<float>(0.0, 5.0);
+
+    etl::fast_dyn_matrix<float, 4, 10> ref;
+
+    for (size_t i = 0; i < 4; ++i) {
+        ref(i) = etl::stable_softmax(x(i));
+    }
+
+    dll::fast_activate<dll::function::SOFTMAX>(x);
+
+    for (size_t i = 0; i < etl::size(x); ++i) {
+        REQUIRE(std::abs(x[i] - ref[i]) < 1e-5);
+    }
+}
+
+TEST_CASE("unit/dense/fast_math/2", "[unit][dense][dbn][mnist][sgd][fast_math]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::fast_math>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax, dll::fast_math>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/compression/1", "[unit][dense][sgd][compression]") {
+    constexpr size_t n = 1000;
+
+    std::vector<float> g(n);
+    for (size_t i = 0; i < n; ++i) {
+        g[i] = std::sin(float(i)) * 0.1f;
+    }
+
+    auto check = [&](auto c) {
+        constexpr auto C = decltype(c)::value;
+
+        std::vector<float> residual(n, 0.0f);
+        std::vector<float> sum(n, 0.0f);
+        std::vector<char> message;
+
+        // With error feedback, the sum of the sent gradients follows the sum of the gradients
+        for (size_t step = 0; step < 200; ++step) {
+            dll::compress_feedback<C>(message, g.data(), residual.data(), n);
+            dll::decompress_add<C>(sum.data(), message, n);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            REQUIRE(std::abs(sum[i] + residual[i] - 200 * g[i]) < 1e-2);
+        }
+    };
+
+    check(std::integral_constant<dll::compression_type, dll::compression_type::NONE>());
+    check(std::integral_constant<dll::compression_type, dll::compression_type::TOP_K>());
+    check(std::integral_constant<dll::compression_type, dll::compression_type::ONE_BIT>());
+    check(std::integral_constant<dll::compression_type, dll::compression_type::EIGHT_BIT>());
+}
+
+// Fused errors and metrics of the last layer
+TEST_CASE("unit/dense/loss/1", "[unit][dense][sgd]") {
+    constexpr size_t B = 8;
+    constexpr size_t n = 6;
+    constexpr size_t K = 10;
+
+    etl::fast_dyn_matrix<float, B, K> output;
+    etl::fast_dyn_matrix<float, n, K> labels;
+    etl::fast_dyn_matrix<float, B, K> errors;
+
+    output = etl::uniform_generator(0.01, 1.0);
+    labels = 0.0f;
+    errors = 1.0f;
+
+    for (size_t b = 0; b < B; ++b) {
+        output(b) = output(b) / etl::sum(output(b));
+    }
+
+    for (size_t b = 0; b < n; ++b) {
+        labels(b, (3 * b) % K) = 1.0f;
+    }
+
+    auto cce = dll::loss_detail::last_errors<dll::loss_function::CATEGORICAL_CROSS_ENTROPY, false>(
+        B, n, K, output.memory_start(), labels.memory_start(), errors.memory_start(), true);
+
+    REQUIRE(cce.first == Approx(etl::ml::cce_error(etl::slice(output, 0, n), labels, 1.0)));
+    REQUIRE(cce.second == Approx(etl::ml::cce_loss(etl::slice(output, 0, n), labels, -1.0)));
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t k = 0; k < K; ++k) {
+            REQUIRE(errors(b, k) == Approx(b < n ? labels(b, k) - output(b, k) : 0.0f));
+        }
+    }
+
+    // With a sigmoid, the errors are the same without the derivative
+    auto bce = dll::loss_detail::last_errors<dll::loss_function::BINARY_CROSS_ENTROPY, true>(
+        B, n, K, output.memory_start(), labels.memory_start(), errors.memory_start(), true);
+
+    auto out = etl::force_temporary(etl::clip(etl::slice(output, 0, n), 0.001, 0.999));
+
+    REQUIRE(bce.first == Approx(etl::asum(labels - etl::slice(output, 0, n)) / K));
+    REQUIRE(bce.second == Approx(-etl::sum((labels >> etl::log(out)) + ((1.0 - labels) >> etl::log(1.0 - out))) / K));
+    REQUIRE(errors(0, 0) == Approx(labels(0, 0) - output(0, 0)));
+}
+
+// Test a view layer between two layers
+TEST_CASE("unit/dense/shape/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::shape_1d_layer_desc<100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::scale_pre<255>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The errors must go through the shape layer
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i] / 255.0f;
+    }
+
+    auto hidden = dbn->template forward_batch<0, 0>(batch);
+    auto output = dbn->forward_batch(batch);
+    auto direct = dbn->template forward_batch<2, 2>(hidden);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(direct[i]));
+    }
+}
+
+TEST_CASE("unit/dense/inplace/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::activation<dll::function::TANH>>::layer_t,
+            dll::rectifier_layer_desc<>::layer_t,
+            dll::scale_layer_desc<1, 2>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>, dll::scale_pre<255>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    // The errors must go through the rectifier and the scale layers
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i] / 255.0f;
+    }
+
+    // The temporaries are transformed in place, the lvalues are not
+    auto hidden    = dbn->template forward_batch<0, 0>(batch);
+    auto rectified = dbn->template forward_batch<1, 1>(hidden);
+    auto scaled    = dbn->template forward_batch<2, 2>(rectified);
+    auto direct    = dbn->template forward_batch<3, 3>(scaled);
+    auto output    = dbn->forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(hidden); ++i) {
+        REQUIRE(rectified[i] == Approx(std::abs(hidden[i])));
+        REQUIRE(scaled[i] == Approx(0.5f * rectified[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(direct[i]));
+    }
+}
+
+TEST_CASE("unit/dense/updater/1", "[unit][dense][sgd]") {
+    const size_t N = 1000;
+
+    etl::dyn_vector<float> w(N);
+    etl::dyn_vector<float> grad(N);
+    etl::dyn_vector<float> m(N);
+    etl::dyn_vector<float> v(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        w[i]    = std::sin(0.1f * i);
+        grad[i] = std::cos(0.37f * i);
+        m[i]    = 0.01f * std::cos(0.2f * i);
+        v[i]    = 0.01f * (1.0f + std::sin(0.3f * i));
+    }
+
+    // The reference updates, with the L2 decay and the clipping applied on the gradients
+    etl::dyn_vector<float> g  = 0.5f * (grad - 0.002f * w);
+    etl::dyn_vector<float> rm = 0.9f * m + 0.1f * g;
+    etl::dyn_vector<float> rv = 0.999f * v + 0.001f * (g >> g);
+    etl::dyn_vector<float> rw = w + (0.01f >> rm) / (etl::sqrt(rv) + 1e-8f);
+
+    dll::updater_detail::gradient_adjust<float> adjust{0.0f, 0.002f, 1.0f};
+
+    REQUIRE(dll::updater_detail::squared_norm(N, w.memory_start(), grad.memory_start(), adjust) == Approx(4.0 * etl::sum(g >> g)));
+
+    adjust.scale = 0.5f;
+
+    dll::updater_detail::adam(N, w.memory_start(), grad.memory_start(), m.memory_start(), v.memory_start(), adjust, 0.01f, 0.9f, 0.999f, 1e-8f);
+
+    for (size_t i = 0; i < N; ++i) {
+        REQUIRE(m[i] == Approx(rm[i]));
+        REQUIRE(v[i] == Approx(rv[i]));
+        REQUIRE(w[i] == Approx(rw[i]));
+    }
+}
+
+TEST_CASE("unit/dense/schedule/1", "[unit][dense][sgd]") {
+    dll::lr_schedule_params params;
+
+    // Linear warmup, then the schedule on the remaining iterations
+    params.schedule = dll::lr_schedule::COSINE;
+    params.warmup   = 10;
+    params.horizon  = 110;
+
+    REQUIRE(dll::lr_schedule_factor(params, 0) == Approx(0.1));
+    REQUIRE(dll::lr_schedule_factor(params, 9) == Approx(1.0));
+    REQUIRE(dll::lr_schedule_factor(params, 10) == Approx(1.0));
+    REQUIRE(dll::lr_schedule_factor(params, 60) == Approx(0.5));
+    REQUIRE(std::abs(dll::lr_schedule_factor(params, 110)) < 1e-12);
+    REQUIRE(std::abs(dll::lr_schedule_factor(params, 500)) < 1e-12);
+
+    params.schedule = dll::lr_schedule::STEP;
+    params.warmup   = 0;
+    params.step     = 20;
+    params.gamma    = 0.5;
+
+    REQUIRE(dll::lr_schedule_factor(params, 19) == Approx(1.0));
+    REQUIRE(dll::lr_schedule_factor(params, 20) == Approx(0.5));
+    REQUIRE(dll::lr_schedule_factor(params, 45) == Approx(0.25));
+
+    params.schedule   = dll::lr_schedule::ONE_CYCLE;
+    params.horizon    = 100;
+    params.min_factor = 0.01;
+
+    REQUIRE(dll::lr_schedule_factor(params, 0) == Approx(dll::one_cycle_start));
+    REQUIRE(dll::lr_schedule_factor(params, 30) == Approx(1.0));
+    REQUIRE(dll::lr_schedule_factor(params, 100) == Approx(0.01));
+}
+
+TEST_CASE("unit/dense/schedule/2", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate          = 0.1;
+    dbn->learning_rate_schedule = dll::lr_schedule::ONE_CYCLE;
+    dbn->warmup_iterations      = 25;
+    dbn->layer_wise_scaling     = true;
+    dbn->lars_coefficient       = 0.02;
+
+    FT_CHECK_2(dbn, dataset, 30, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/accumulation/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Updates with an effective batch of 40 samples
+    dbn->learning_rate      = 0.1;
+    dbn->accumulation_steps = 4;
+
+    FT_CHECK_2(dbn, dataset, 50, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/frozen/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+    dbn->frozen[0]     = true;
+
+    auto w = dbn->template layer_get<0>().w;
+    auto b = dbn->template layer_get<0>().b;
+
+    FT_CHECK_2(dbn, dataset, 50, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+
+    // The frozen layer is not modified by the fine-tuning, on its cached outputs
+    REQUIRE(etl::sum(etl::abs(dbn->template layer_get<0>().w - w)) == 0.0);
+    REQUIRE(etl::sum(etl::abs(dbn->template layer_get<0>().b - b)) == 0.0);
+}
+
+TEST_CASE("unit/dense/frozen/2", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The errors are backpropagated through the frozen layer, the outputs
+    // of the first layer cannot be cached
+    dbn->learning_rate = 0.1;
+    dbn->frozen[1]     = true;
+
+    auto w = dbn->template layer_get<1>().w;
+
+    FT_CHECK_2(dbn, dataset, 50, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+
+    REQUIRE(etl::sum(etl::abs(dbn->template layer_get<1>().w - w)) == 0.0);
+}
+
+TEST_CASE("unit/dense/test_set/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(20, 5e-2);
+
+    // The predictor is used by batches, the error must be the same as the
+    // one of the prediction of each sample
+    auto batch_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::predictor());
+
+    auto serial_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, [](auto& net, auto& image) {
+        return net->predict(image);
+    });
+
+    REQUIRE(batch_error == Approx(serial_error));
+    REQUIRE(batch_error < 0.3);
+}
+
+TEST_CASE("unit/dense/sgd/factorization/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    using factorized_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::IDENTITY>, dll::no_bias>::layer_t,
+            dll::dyn_dense_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+
+    // A factorization of the full rank must compute the same outputs
+    dll::factorization_options options;
+    options.ranks = {100};
+
+    auto full   = std::make_unique<factorized_t>();
+    auto report = dll::factorize<0>(*dbn, *full, dataset.test(), options);
+
+    REQUIRE(report.ranks == std::vector<size_t>({100}));
+    REQUIRE(report.energy[0] == Approx(1.0));
+    REQUIRE(std::get<0>(report.after) == Approx(std::get<0>(report.before)).epsilon(0.01));
+
+    // The rank of a factorization can be selected from the energy
+    options.ranks  = {};
+    options.energy = 0.8;
+
+    auto factorized = std::make_unique<factorized_t>();
+    report          = dll::factorize<0>(*dbn, *factorized, dataset.test(), options);
+
+    REQUIRE(report.ranks[0] < 100);
+    REQUIRE(report.energy[0] >= 0.8);
+    REQUIRE(factorized->layer_get<0>().output_size() == report.ranks[0]);
+    REQUIRE(report.parameters_after < report.parameters_before);
+
+    // The factorized network can be fine-tuned
+    auto ft_error = factorized->fine_tune(dataset.train(), 10);
+    REQUIRE(ft_error < 0.2);
+}
+
+TEST_CASE("unit/dense/sgd/block_sparse/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK_DATASET(50, 5e-2);
+
+    auto before = dbn->evaluate_error(dataset.test());
+
+    // The outputs are the same with the block-sparse kernel
+    dll::block_compress(dbn->layer_get<0>(), 4, 4);
+
+    REQUIRE(dbn->layer_get<0>().w_blocks.density() == Approx(1.0));
+    REQUIRE(dbn->evaluate_error(dataset.test()) == Approx(before));
+
+    // Remove 90% of the blocks and fine-tune the sparse network
+    dll::block_sparsify(dbn->layer_get<0>(), 4, 4, 0.9);
+
+    REQUIRE(dbn->layer_get<0>().w_blocks.density() == Approx(0.1).epsilon(0.05));
+
+    auto ft_error = dbn->fine_tune(dataset.train(), 10);
+    REQUIRE(ft_error < 0.2);
+
+    // The removed blocks stay at zero
+    dll::block_sparsity trained;
+    trained.compress(dbn->layer_get<0>().w, 4, 4);
+
+    REQUIRE(trained.blocks() <= dbn->layer_get<0>().w_blocks.blocks());
+}
+
+TEST_CASE("unit/dense/sgd/ensemble/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto first  = std::make_unique<dbn_t>();
+    auto second = std::make_unique<dbn_t>();
+
+    first->learning_rate  = 0.1;
+    second->learning_rate = 0.1;
+
+    REQUIRE(first->fine_tune(dataset.training_images, dataset.training_labels, 20) < 0.2);
+    REQUIRE(second->fine_tune(dataset.training_images, dataset.training_labels, 20) < 0.2);
+
+    auto& images = dataset.test_images;
+    images.resize(55);
+
+    // An ensemble of one network is the network
+    auto single = dll::make_ensemble(*first);
+    auto out    = single.forward_many(images);
+
+    REQUIRE(etl::dim<0>(out) == images.size());
+    REQUIRE(etl::dim<1>(out) == 10);
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        auto expected = first->forward_one(images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(out(i, j) == Approx(expected[j]));
+        }
+    }
+
+    // The output of the ensemble is the average of its networks
+    auto both = dll::make_ensemble(*first, *second);
+    out       = both.forward_many(images);
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        auto a = first->forward_one(images[i]);
+        auto b = second->forward_one(images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(out(i, j) == Approx(0.5 * (a[j] + b[j])));
+        }
+    }
+
+    auto predicted = both.predict_many(images);
+
+    REQUIRE(predicted.size() == images.size());
+    REQUIRE(predicted[0] == both.predict(images[0]));
+}
+
+TEST_CASE("unit/dense/sgd/early_exit/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    REQUIRE(dbn->fine_tune(dataset.training_images, dataset.training_labels, 20) < 0.2);
+
+    auto& images = dataset.test_images;
+    images.resize(55);
+
+    // Without confident heads, the network predicts all the samples
+    dll::early_exit<dbn_t> exits(*dbn, 2.0);
+
+    REQUIRE(exits.train_head<0>(dataset.training_images, dataset.training_labels));
+    REQUIRE(exits.heads[0].active());
+
+    auto predicted = exits.predict_many(images);
+
+    REQUIRE(predicted.size() == images.size());
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        REQUIRE(predicted[i] == dbn->predict(images[i]));
+    }
+
+    REQUIRE(exits.exits()[0] == 0);
+    REQUIRE(exits.exits()[2] == images.size());
+
+    // The first head predicts all the samples
+    exits.threshold = 0.0;
+    exits.reset_exits();
+
+    predicted = exits.predict_many(images);
+
+    REQUIRE(exits.exits()[0] == images.size());
+    REQUIRE(exits.exits()[2] == 0);
+
+    // The batched path routes the samples as the samples one by one
+    exits.threshold = 0.9;
+    exits.reset_exits();
+
+    predicted = exits.predict_many(images);
+
+    auto exited = exits.exits();
+
+    REQUIRE(exited[0] + exited[1] + exited[2] == images.size());
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        REQUIRE(predicted[i] == exits.predict(images[i]));
+
+        errors += predicted[i] != dataset.test_labels[i];
+    }
+
+    CHECK(errors < images.size() / 3);
+}
+
+TEST_CASE("unit/dense/sgd/cascade/1", "[unit][dense][dbn][mnist][sgd]") {
+    using small_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::normalize_pre>::dbn_t;
+
+    using large_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto small = std::make_unique<small_t>();
+    auto large = std::make_unique<large_t>();
+
+    small->learning_rate = 0.1;
+    large->learning_rate = 0.1;
+
+    REQUIRE(small->fine_tune(dataset.training_images, dataset.training_labels, 20) < 0.3);
+    REQUIRE(large->fine_tune(dataset.training_images, dataset.training_labels, 20) < 0.2);
+
+    auto& images = dataset.test_images;
+    images.resize(55);
+
+    auto models = dll::make_cascade(*small, *large);
+
+    // Only the confident samples of the first network are not escalated
+    models.thresholds[0] = 0.8;
+
+    auto predicted = models.predict_many(images);
+
+    REQUIRE(predicted.size() == images.size());
+
+    size_t escalated = 0;
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        auto out = small->forward_one(images[i]);
+
+        if (etl::max(out) >= 0.8) {
+            REQUIRE(predicted[i] == small->predict(images[i]));
+        } else {
+            REQUIRE(predicted[i] == large->predict(images[i]));
+            ++escalated;
+        }
+    }
+
+    REQUIRE(models.stats[0].samples == images.size());
+    REQUIRE(models.stats[0].escalated == escalated);
+    REQUIRE(models.stats[1].samples == escalated);
+    REQUIRE(models.escalated_fraction() == Approx(double(escalated) / images.size()));
+
+    models.display_stats();
+
+    // Everything is escalated to the last network
+    models.thresholds[0] = 2.0;
+    models.reset_stats();
+
+    predicted = models.predict_many(images);
+
+    REQUIRE(models.stats[1].samples == images.size());
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        REQUIRE(predicted[i] == large->predict(images[i]));
+    }
+}
+
+TEST_CASE("unit/dense/sgd/packed/1", "[unit][dense][dbn][mnist][sgd][frozen]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::normalize_pre>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<1>().init_layer(100, 50);
+
+    dbn->learning_rate = 0.1;
+
+    REQUIRE(dbn->fine_tune(dataset.training_images, dataset.training_labels, 5) < 0.5);
+
+    auto frozen = dll::freeze(*dbn);
+
+    // Packed weights for 5 samples, the layers themselves for 20
+    etl::fast_dyn_matrix<float, 5, 28 * 28> small;
+    etl::fast_dyn_matrix<float, 20, 28 * 28> large;
+
+    for (size_t i = 0; i < 20; ++i) {
+        large(i) = dataset.training_images[i];
+
+        if (i < 5) {
+            small(i) = dataset.training_images[i];
+        }
+    }
+
+    auto small_output = frozen.forward_batch(small);
+    auto large_output = frozen.forward_batch(large);
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto ref = dbn->forward_one(dataset.training_images[i]);
+        auto one = frozen.forward_one(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(one[j] == Approx(ref[j]).epsilon(1e-3));
+            REQUIRE(large_output(i, j) == Approx(ref[j]).epsilon(1e-3));
+
+            if (i < 5) {
+                REQUIRE(small_output(i, j) == Approx(ref[j]).epsilon(1e-3));
+            }
+        }
+    }
+}
+
+TEST_CASE("unit/dense/sgd/sampled_softmax/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<5>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The targets of the batch and 2 sampled classes (at most 7 of the 10 classes)
+    dbn->learning_rate   = 0.05;
+    dbn->sampled_softmax = 2;
+
+    FT_CHECK_2(dbn, dataset, 50, 0.1);
+
+    // The evaluation computes the full softmax
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/sgd/distill/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t teacher_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 30>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto teacher = std::make_unique<teacher_t>();
+
+    teacher->learning_rate = 0.05;
+
+    FT_CHECK_2(teacher, dataset, 50, 0.1);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate            = 0.05;
+    dbn->distillation_temperature = 2.0;
+
+    // The batches are not shuffled, the soft targets are cached in the file
+    auto ft_error = dbn->fine_tune_distill(*teacher, dataset.train(), 50, "distill.tmp.dat");
+    std::cout << "ft_error:" << ft_error << std::endl;
+    CHECK(ft_error < 0.15);
+
+    REQUIRE(!dbn->distillation);
+
+    dll::distillation_teacher<typename dbn_t::weight> targets(nullptr, 10, true);
+
+    REQUIRE(targets.load("distill.tmp.dat", 2.0));
+    REQUIRE(targets.batches.size() == 50);
+    REQUIRE(!targets.load("distill.tmp.dat", 4.0));
+
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
+
+TEST_CASE("unit/dense/sgd/reuse/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::ADAM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 200, dll::batch_size<10>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+    auto ref = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+    ref->learning_rate = 0.001;
+
+    dbn->store("reuse.tmp.dat");
+    ref->load("reuse.tmp.dat");
+
+    REQUIRE(!dbn->holds_training_memory());
+
+    // The contexts of the first training are kept for the second one
+    dbn->fine_tune_val(dataset.train(), 3);
+    REQUIRE(dbn->holds_training_memory());
+    dbn->fine_tune_val(dataset.train(), 3);
+
+    // The reference is trained with new contexts each time
+    ref->fine_tune_val(dataset.train(), 3);
+    ref->release_training_memory();
+    REQUIRE(!ref->holds_training_memory());
+    ref->fine_tune_val(dataset.train(), 3);
+
+    auto& w     = dbn->template layer_get<0>().w;
+    auto& ref_w = ref->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(w[i] == Approx(ref_w[i]));
+    }
+
+    dbn->release_training_memory();
+    REQUIRE(!dbn->holds_training_memory());
+}
@@ -0,0 +1,106 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <deque>
+#include <algorithm>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/depthwise_conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+TEST_CASE("unit/depthwise_conv/sgd/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::depthwise_conv_layer_desc<8, 26, 26, 3, 3, dll::activation<dll::function::RELU>, dll::stride<2>, dll::padding<1>>::layer_t,
+            dll::pointwise_conv_layer_desc<8, 13, 13, 16, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<16 * 13 * 13, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.25);
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    auto input  = dbn->layer_get<0>().test_forward_batch(batch);
+    auto& dw    = dbn->layer_get<1>();
+    auto output = dw.test_forward_batch(input);
+
+    // Each channel is only convolved with its own filter
+    for (size_t b = 0; b < 10; ++b) {
+        for (size_t c = 0; c < 8; ++c) {
+            for (size_t i = 0; i < 13; ++i) {
+                for (size_t j = 0; j < 13; ++j) {
+                    float acc = dw.b(c);
+
+                    for (size_t p = 0; p < 3; ++p) {
+                        for (size_t q = 0; q < 3; ++q) {
+                            const long ii = long(2 * i + p) - 1;
+                            const long jj = long(2 * j + q) - 1;
+
+                            if (ii >= 0 && ii < 26 && jj >= 0 && jj < 26) {
+                                acc += input(b, c, ii, jj) * dw.w(c, p, q);
+                            }
+                        }
+                    }
+
+                    REQUIRE(output(b, c, i, j) == Approx(std::max(acc, 0.0f)).epsilon(1e-3));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("unit/depthwise_conv/sgd/2", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_depthwise_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Depthwise 3x3 and pointwise 1x1 convolutions
+    dbn->template init_layer<0>(1, 28, 28, 8, 3, 3);
+    dbn->template init_layer<1>(8, 26, 26, 3, 3);
+    dbn->template init_layer<2>(8, 24, 24, 16, 1, 1);
+    dbn->template init_layer<3>(16 * 24 * 24, 10);
+
+    REQUIRE(dbn->layer_get<1>().parameters() == 8 * 3 * 3);
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.25);
+}
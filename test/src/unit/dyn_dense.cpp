@@ -6,12 +6,15 @@
 //=======================================================================
 
 #include <deque>
+#include <algorithm>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/dyn_dense_layer.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/datasets.hpp"
+#include "dll/trainer/batch_tuner.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -192,3 +195,188 @@ TEST_CASE("unit/dyn_dense/sgd/7", "[unit][dyn_dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test Relu -> Relu -> Relu -> Relu -> Softmax network, with gradient checkpointing
+TEST_CASE("unit/dyn_dense/sgd/8", "[unit][dyn_dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::gradient_checkpointing, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<0>().init_layer(28 * 28, 100);
+    dbn->template layer_get<1>().init_layer(100, 100);
+    dbn->template layer_get<2>().init_layer(100, 100);
+    dbn->template layer_get<3>().init_layer(100, 100);
+    dbn->template layer_get<4>().init_layer(100, 10);
+
+    dbn->initial_momentum = 0.9;
+    dbn->final_momentum   = 0.9;
+    dbn->learning_rate    = 0.01;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+// Test a dynamic network with a batch size reduced at runtime
+TEST_CASE("unit/dyn_dense/sgd/9", "[unit][dyn_dense][dbn][mnist][sgd]") {
+    typedef dll::dyn_dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate  = 0.05;
+    dbn->dyn_batch_size = 5;
+
+    REQUIRE(dbn->runtime_batch_size() == 5);
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+
+    // The collections are forwarded by chunks of the runtime batch size
+    auto outputs = dbn->forward_many(dataset.training_images);
+
+    REQUIRE(outputs.size() == dataset.training_images.size());
+
+    for (size_t i = 0; i < 10; ++i) {
+        auto output = dbn->forward_one(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(outputs[i][j] == Approx(output[j]));
+        }
+    }
+}
+
+// Test the segments of the recomputed layers
+TEST_CASE("unit/dyn_dense/checkpointing/1", "[unit][dyn_dense]") {
+    const size_t L = 6;
+
+    // Two segments of two layers, followed by a layer that is not recomputed
+    auto segments = dll::checkpointing_detail::choose_segments({100, 100, 100, 100, 0, 0});
+
+    REQUIRE(segments == std::vector<size_t>({0, 0, 2, 2, L, L}));
+
+    // A run of a single layer is not recomputed
+    segments = dll::checkpointing_detail::choose_segments({0, 100, 0, 0, 0, 0});
+
+    REQUIRE(segments == std::vector<size_t>(L, L));
+}
+
+// Test the specialized kernel against the generic product
+TEST_CASE("unit/dyn_dense/kernel/1", "[unit][dyn_dense]") {
+    dll::dyn_dense_layer_desc<dll::activation<dll::function::IDENTITY>>::layer_t layer;
+
+    layer.init_layer(100, 10);
+
+    etl::dyn_matrix<float, 2> input(20, 100);
+    etl::dyn_matrix<float, 2> output(20, 10);
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    etl::dyn_matrix<float, 2> expected(20, 10);
+    expected = bias_add_2d(input * layer.w, layer.b);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/dyn_dense/backup/1", "[unit][dyn_dense]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template layer_get<0>().init_layer(28 * 28, 100);
+    dbn->template layer_get<1>().init_layer(100, 10);
+
+    auto& layer = dbn->template layer_get<0>();
+
+    etl::dyn_matrix<float, 2> first(layer.w);
+
+    // The first backup is a copy, the weights are kept
+    dbn->swap_backup_weights();
+
+    REQUIRE(std::equal(layer.w.begin(), layer.w.end(), first.begin()));
+
+    layer.w = 2.0 * first;
+
+    etl::dyn_matrix<float, 2> second(layer.w);
+
+    // The next backups swap the storages
+    dbn->swap_backup_weights();
+
+    REQUIRE(std::equal(layer.w.begin(), layer.w.end(), first.begin()));
+
+    dbn->restore_weights();
+
+    REQUIRE(std::equal(layer.w.begin(), layer.w.end(), second.begin()));
+}
+
+// Test the calibration of the runtime batch size
+TEST_CASE("unit/dyn_dense/sgd/tune_batch/1", "[unit][dyn_dense][dbn][mnist][sgd]") {
+    typedef dll::dyn_dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 500, dll::batch_size<20>{}, dll::scale_pre<255>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto& layer = dbn->template layer_get<0>();
+    etl::dyn_matrix<float, 2> before(layer.w);
+
+    // The cap excludes the largest batch sizes
+    dbn->dyn_batch_size = 5;
+    const size_t cap    = dbn->memory_usage(dataset.train()).peak();
+    dbn->dyn_batch_size = 0;
+
+    dll::batch_tuning_params params;
+    params.memory_cap = cap;
+    params.scaling    = dll::lr_scaling::LINEAR;
+
+    auto result = dll::tune_batch_size(*dbn, dataset.train(), params);
+
+    REQUIRE(result.points.size() == 6);
+    REQUIRE(result.batch_size > 0);
+    REQUIRE(result.batch_size <= 5);
+    REQUIRE(dbn->runtime_batch_size() == result.batch_size);
+    REQUIRE(dbn->learning_rate == Approx(0.05 * result.batch_size / 20.0));
+
+    for (auto& point : result.points) {
+        REQUIRE(point.fits == (point.batch_size <= 5));
+    }
+
+    // The weights are not changed by the calibration
+    REQUIRE(std::equal(layer.w.begin(), layer.w.end(), before.begin()));
+
+    FT_CHECK_2(dbn, dataset, 50, 5e-2);
+    TEST_CHECK_2(dbn, dataset, 0.3);
+}
@@ -0,0 +1,84 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/dyn_network.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+template <typename Dataset>
+etl::dyn_matrix<float, 2> to_batch(const Dataset& dataset) {
+    etl::dyn_matrix<float, 2> samples(dataset.training_images.size(), 28 * 28);
+
+    for (size_t i = 0; i < dataset.training_images.size(); ++i) {
+        samples(i) = dataset.training_images[i] / 255.0f;
+    }
+
+    return samples;
+}
+
+template <typename Dataset>
+std::vector<size_t> to_labels(const Dataset& dataset) {
+    return {dataset.training_labels.begin(), dataset.training_labels.end()};
+}
+
+} // end of anonymous namespace
+
+// Test Sigmoid -> Softmax network
+TEST_CASE("unit/dyn_network/dense/1", "[unit][dyn_network][mnist]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll::dyn_network<float> net;
+
+    net.add_dense(28 * 28, 100, dll::function::SIGMOID);
+    net.add_dense(100, 10, dll::function::SOFTMAX);
+
+    REQUIRE(net.size() == 2);
+    REQUIRE(net.parameters() == 28 * 28 * 100 + 100 * 10);
+
+    net.batch_size    = 10;
+    net.learning_rate = 0.1;
+
+    auto samples = to_batch(dataset);
+    auto labels  = to_labels(dataset);
+
+    auto error = net.fine_tune(samples, labels, 30);
+    REQUIRE(error < 5e-2);
+
+    auto output = net.forward_batch(samples);
+    REQUIRE(etl::dim<0>(output) == samples.dim(0));
+    REQUIRE(etl::dim<1>(output) == 10);
+    REQUIRE(etl::sum(output(0)) == Approx(1.0f));
+}
+
+// Test Conv -> MP -> Dense network
+TEST_CASE("unit/dyn_network/conv/1", "[unit][dyn_network][mnist]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll::dyn_network<float> net;
+
+    net.add_conv(1, 28, 28, 6, 5, 5, dll::function::RELU);
+    net.add_mp(6, 24, 24, 2, 2);
+    net.add_dense(6 * 12 * 12, 10, dll::function::SOFTMAX);
+
+    net.batch_size    = 10;
+    net.learning_rate = 0.05;
+
+    auto samples = to_batch(dataset);
+    auto labels  = to_labels(dataset);
+
+    auto error = net.fine_tune(samples, labels, 20);
+    REQUIRE(error < 0.1);
+
+    REQUIRE(net.evaluate_error(samples, labels) == Approx(error));
+}
@@ -8,6 +8,7 @@
 #include "dll_test.hpp"
 
 #include "dll/rbm/dyn_rbm.hpp"
+#include "dll/trainer/rbm_multi_trainer.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -54,3 +55,31 @@ TEST_CASE("unit/dyn_rbm/mnist/3", "[rbm][dyn][relu][momentum][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 5e-2);
 }
+
+TEST_CASE("unit/dyn_rbm/mnist/4", "[rbm][dyn][momentum][concurrent][unit]") {
+    using rbm_t = dll::dyn_rbm_desc<dll::momentum>::layer_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    // Three configurations trained on the same batches
+    std::vector<std::unique_ptr<rbm_t>> rbms;
+    rbms.push_back(std::make_unique<rbm_t>(28 * 28, 100));
+    rbms.push_back(std::make_unique<rbm_t>(28 * 28, 100));
+    rbms.push_back(std::make_unique<rbm_t>(28 * 28, 150));
+
+    rbms[1]->learning_rate *= 2;
+
+    auto generator = dll::make_generator(dataset.training_images, dataset.training_images, dataset.training_images.size(), rbm_t::generator_t{});
+    generator->set_safe();
+
+    auto errors = dll::train_concurrently(rbms, *generator, 50);
+
+    REQUIRE(errors.size() == 3);
+
+    for (auto error : errors) {
+        REQUIRE(error < 5e-2);
+    }
+}
@@ -219,3 +219,33 @@ TEST_CASE("initializer/he", "[dense][unit][mnist][sgd]") {
 
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("initializer/reproducible", "[dense][unit]") {
+    using layer_t = dll::dense_layer_desc<28 * 28, 500, dll::initializer<dll::init_lecun>, dll::initializer_bias<dll::init_uniform<>>>::layer_t;
+
+    // Large enough to be filled in parallel
+    dll::set_seed(42);
+    auto first = std::make_unique<layer_t>();
+
+    dll::set_seed(42);
+    auto second = std::make_unique<layer_t>();
+
+    for (size_t i = 0; i < etl::size(first->w); ++i) {
+        REQUIRE(first->w[i] == second->w[i]);
+    }
+
+    for (size_t i = 0; i < etl::size(first->b); ++i) {
+        REQUIRE(first->b[i] == second->b[i]);
+        REQUIRE(first->b[i] >= -0.05f);
+        REQUIRE(first->b[i] < 0.05f);
+    }
+
+    double square = 0.0;
+
+    for (size_t i = 0; i < etl::size(first->w); ++i) {
+        square += first->w[i] * first->w[i];
+    }
+
+    REQUIRE(etl::mean(first->w) == Approx(0.0).margin(0.01));
+    REQUIRE(square / etl::size(first->w) == Approx(1.0 / (28.0 * 28.0)).epsilon(0.05));
+}
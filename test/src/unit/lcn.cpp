@@ -260,3 +260,36 @@ TEST_CASE("unit/cdbn/lcn/mnist/8", "[cdbn][lcn][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+TEST_CASE("unit/cdbn/lcn/mnist/9", "[cdbn][lcn][unit]") {
+    using layer_t = dll::lcn_layer_desc<9>::layer_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(20);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::dyn_matrix<float, 4> input(20, 2, 28, 28);
+    etl::dyn_matrix<float, 4> output(20, 2, 28, 28);
+
+    for (size_t i = 0; i < 20; ++i) {
+        input(i)(0) = dataset.training_images[i](0);
+        input(i)(1) = dataset.training_images[19 - i](0) * 0.5f;
+    }
+
+    layer_t layer;
+    layer.forward_batch(output, input);
+
+    // The separable filter must give the same result as the full 2D filter
+    auto w = layer_t::filter<float>(layer.sigma);
+
+    for (size_t i = 0; i < 20; ++i) {
+        auto expected = etl::force_temporary(input(i));
+
+        dll::lcn_compute(expected, input(i), w, 9, 4);
+
+        for (size_t j = 0; j < etl::size(expected); ++j) {
+            REQUIRE(std::abs(output(i)[j] - expected[j]) < 1e-4);
+        }
+    }
+}
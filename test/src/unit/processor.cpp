@@ -6,6 +6,9 @@
 //=======================================================================
 
 #include <deque>
+#include <fstream>
+
+#include <dlfcn.h>
 
 #include "cpp_utils/string.hpp"
 
@@ -212,6 +215,90 @@ TEST_CASE("unit/processor/dense/sgd/2", "[unit][dense][dbn][mnist][sgd][proc]")
     TEST_ERROR_BELOW(0.3);
 }
 
+// The samples are streamed from the files
+TEST_CASE("unit/processor/dense/sgd/3", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_3.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+// The predictions are written to a CSV file
+TEST_CASE("unit/processor/dense/sgd/4", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "predict"}, "dense_sgd_4.conf");
+    REQUIRE(!lines.empty());
+
+    std::ifstream is("dense_sgd_4.csv");
+    REQUIRE(is);
+
+    size_t n = 0;
+    std::string line;
+
+    while (std::getline(is, line)) {
+        REQUIRE(std::count(line.begin(), line.end(), ',') == 9);
+        ++n;
+    }
+
+    REQUIRE(n == 100);
+}
+
+TEST_CASE("unit/processor/dense/sgd/5", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt    = default_options();
+    opt.library = true;
+
+    auto lines = get_result(opt, {"train", "save"}, "dense_sgd_5.conf");
+    REQUIRE(!lines.empty());
+
+    auto* handle = dlopen(("./" + opt.output + ".so").c_str(), RTLD_NOW);
+    REQUIRE(handle);
+
+    auto load_f     = reinterpret_cast<int (*)(const char*)>(dlsym(handle, "dllp_load"));
+    auto size_f     = reinterpret_cast<size_t (*)()>(dlsym(handle, "dllp_output_size"));
+    auto predict_f  = reinterpret_cast<int (*)(const float*, size_t, size_t*)>(dlsym(handle, "dllp_predict_batch"));
+    auto features_f = reinterpret_cast<int (*)(const float*, size_t, float*)>(dlsym(handle, "dllp_features_batch"));
+
+    REQUIRE(load_f);
+    REQUIRE(size_f);
+    REQUIRE(predict_f);
+    REQUIRE(features_f);
+
+    REQUIRE(!load_f("dense_sgd_5.dat"));
+    REQUIRE(size_f() == 10);
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(105);
+    REQUIRE(!dataset.test_images.empty());
+    mnist::binarize_dataset(dataset);
+
+    const size_t n = dataset.test_images.size();
+
+    std::vector<float> input(n * 28 * 28);
+
+    for (size_t i = 0; i < n; ++i) {
+        std::copy(dataset.test_images[i].begin(), dataset.test_images[i].end(), input.begin() + i * 28 * 28);
+    }
+
+    std::vector<size_t> labels(n);
+    std::vector<float> features(n * 10);
+
+    REQUIRE(!predict_f(input.data(), n, labels.data()));
+    REQUIRE(!features_f(input.data(), n, features.data()));
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        auto first = features.begin() + i * 10;
+
+        REQUIRE(labels[i] == size_t(std::distance(first, std::max_element(first, first + 10))));
+
+        errors += labels[i] != dataset.test_labels[i];
+    }
+
+    REQUIRE(errors < 0.3 * n);
+
+    dlclose(handle);
+}
+
 // Conv+Dense (SGD)
 
 TEST_CASE("unit/processor/conv/sgd/1", "[unit][conv][dense][dbn][mnist][sgd][proc]") {
@@ -13,6 +13,7 @@
 #include "dll/rbm/conv_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/transform/random_layer.hpp"
+#include "dll/util/counter_rng.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -73,3 +74,97 @@ TEST_CASE("unit/cdbn/random/mnist/2", "[cdbn][rectifier][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 1.0);
 }
+
+TEST_CASE("unit/random/counter/1", "[unit][random]") {
+    dll::counter_rng rng(42, 7);
+
+    // Large enough to be generated in parallel
+    std::vector<float> a(100000);
+    rng.uniform(a.data(), a.size());
+
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        REQUIRE(a[i] >= 0.0f);
+        REQUIRE(a[i] < 1.0f);
+
+        sum += a[i];
+    }
+
+    REQUIRE(sum / a.size() == Approx(0.5).epsilon(0.01));
+
+    // A value only depends on the key, the stream and its index
+    for (size_t i = 0; i < a.size(); i += 997) {
+        REQUIRE(a[i] == dll::counter_rng::to_uniform<float>(rng.block(i / 4)[i % 4]));
+    }
+
+    std::vector<float> b(100);
+    dll::counter_rng(42, 8).uniform(b.data(), b.size());
+
+    REQUIRE(!std::equal(b.begin(), b.end(), a.begin()));
+}
+
+TEST_CASE("unit/random/counter/2", "[unit][random]") {
+    etl::fast_dyn_matrix<float, 100, 50> p;
+    p = etl::uniform_generator<float>(0.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 100, 50> s1;
+    etl::fast_dyn_matrix<float, 100, 50> s2;
+
+    dll::set_seed(123);
+    dll::sample_bernoulli(s1, p);
+
+    dll::set_seed(123);
+    dll::sample_bernoulli(s2, p);
+
+    // The same seed gives the same samples
+    for (size_t i = 0; i < etl::size(s1); ++i) {
+        REQUIRE(s1[i] == s2[i]);
+        REQUIRE((s1[i] == 0.0f || s1[i] == 1.0f));
+    }
+
+    REQUIRE(etl::mean(s1) == Approx(etl::mean(p)).epsilon(0.05));
+}
+
+TEST_CASE("unit/random/counter/3", "[unit][random]") {
+    dll::counter_rng rng(42, 7);
+
+    // Large enough to be generated in parallel
+    std::vector<float> z(100000);
+    rng.for_each_normal<float>(z.size(), [&](size_t i, float x) { z[i] = x; });
+
+    double sum    = 0.0;
+    double square = 0.0;
+
+    for (size_t i = 0; i < z.size(); ++i) {
+        sum += z[i];
+        square += z[i] * z[i];
+    }
+
+    REQUIRE(std::abs(sum / z.size()) < 0.02);
+    REQUIRE(square / z.size() == Approx(1.0).epsilon(0.02));
+
+    etl::fast_dyn_matrix<float, 100, 50> x;
+    x = etl::uniform_generator<float>(-2.0, 8.0);
+
+    etl::fast_dyn_matrix<float, 100, 50> s1;
+    etl::fast_dyn_matrix<float, 100, 50> s2;
+
+    dll::set_seed(123);
+    dll::sample_normal(s1, x);
+
+    dll::set_seed(123);
+    dll::sample_normal(s2, x);
+
+    for (size_t i = 0; i < etl::size(s1); ++i) {
+        REQUIRE(s1[i] == s2[i]);
+    }
+
+    REQUIRE(etl::mean(s1 - x) == Approx(0.0).margin(0.05));
+
+    dll::sample_noisy_relu(s1, x);
+    dll::sample_capped_relu(s2, x, 6.0f);
+
+    REQUIRE(etl::min(s1) >= 0.0f);
+    REQUIRE(etl::min(s2) >= 0.0f);
+    REQUIRE(etl::max(s2) <= 6.0f);
+}
@@ -12,6 +12,7 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/rbm.hpp"
+#include "dll/anomaly.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -144,6 +145,25 @@ TEST_CASE("unit/rbm/mnist/7", "[rbm][relu][unit]") {
     REQUIRE(error < 1e-2);
 }
 
+TEST_CASE("unit/rbm/mnist/7/sparse", "[rbm][relu][sparse][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::hidden<dll::unit_type::RELU>,
+        dll::sparse_relu>::layer_t rbm;
+
+    rbm.learning_rate *= 10;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-2);
+}
+
 TEST_CASE("unit/rbm/mnist/8", "[rbm][sparse][unit]") {
     using rbm_type = dll::rbm_desc<
         28 * 28, 100,
@@ -212,3 +232,330 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+TEST_CASE("unit/rbm/mnist/11", "[rbm][hogwild][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::hogwild>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+template <typename RBM>
+using pcd_chains_trainer_t = dll::pcd_chains_trainer<1, 32, RBM>;
+
+TEST_CASE("unit/rbm/mnist/12", "[rbm][pcd][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::trainer_rbm<pcd_chains_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+template <typename RBM>
+using pt_small_trainer_t = dll::pt_trainer<10, 4, RBM>;
+
+TEST_CASE("unit/rbm/mnist/13", "[rbm][pt][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::trainer_rbm<pt_small_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+template <typename RBM>
+using cd10_trainer_t = dll::cd_trainer<10, RBM>;
+
+TEST_CASE("unit/rbm/mnist/14", "[rbm][cdk][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<20>,
+        dll::momentum,
+        dll::trainer_rbm<cd10_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/free_energy/1", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::free_energy>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.free_energy_period = 2;
+
+    rbm.train(dataset.training_images, 5);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> v;
+    etl::fast_dyn_matrix<float, 10, 100> h;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    rbm.batch_activate_hidden<true, false>(h, h, v, v);
+
+    // The free energies from the probabilities of the positive phase
+    double expected = 0.0;
+
+    for (size_t i = 0; i < 8; ++i) {
+        expected += rbm.free_energy(dataset.training_images[i]);
+    }
+
+    REQUIRE(rbm.batch_free_energy(v, h, 8) == Approx(expected).epsilon(1e-3));
+}
+
+TEST_CASE("unit/rbm/statistics/1", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.statistics_period = 3;
+
+    auto error = rbm.train(dataset.training_images, 20);
+    REQUIRE(error < 5e-2);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> v1;
+    etl::fast_dyn_matrix<float, 10, 28 * 28> v2;
+    etl::fast_dyn_matrix<float, 10, 100> h1;
+    etl::fast_dyn_matrix<float, 10, 100> h2;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v1(i) = dataset.training_images[i];
+    }
+
+    rbm.batch_activate_hidden<true, false>(h1, h1, v1, v1);
+    rbm.batch_activate_visible<true, false>(h1, h1, v2, v2);
+    rbm.batch_activate_hidden<true, false>(h2, h2, v2, v2);
+
+    // The statistics of the gradient kernels and of the single pass
+    etl::fast_dyn_matrix<float, 28 * 28, 100> w_grad;
+    etl::fast_dyn_vector<float, 100> b_grad;
+    etl::fast_dyn_vector<float, 28 * 28> c_grad;
+
+    double fused[2];
+    double stats[2];
+
+    dll::fused_cd_gradients(
+        w_grad.memory_start(), b_grad.memory_start(), c_grad.memory_start(),
+        v1.memory_start(), h1.memory_start(), v2.memory_start(), h2.memory_start(),
+        10, 28 * 28, 100, fused);
+
+    dll::cd_statistics(v1.memory_start(), v2.memory_start(), h2.memory_start(), etl::size(v1), etl::size(h2), stats);
+
+    REQUIRE(fused[0] / etl::size(v1) == Approx(etl::mean((v1 - v2) >> (v1 - v2))).epsilon(1e-3));
+    REQUIRE(fused[1] / etl::size(h2) == Approx(etl::mean(h2)).epsilon(1e-3));
+    REQUIRE(stats[0] == Approx(fused[0]).epsilon(1e-3));
+    REQUIRE(stats[1] == Approx(fused[1]).epsilon(1e-3));
+}
+
+TEST_CASE("unit/rbm/softmax/1", "[rbm][softmax][unit]") {
+    dll::rbm_desc<
+        28 * 28, 10,
+        dll::batch_size<10>,
+        dll::hidden<dll::unit_type::SOFTMAX>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> v;
+    etl::fast_dyn_matrix<float, 10, 10> h_a;
+    etl::fast_dyn_matrix<float, 10, 10> h_s;
+    etl::fast_dyn_matrix<float, 10, 10> h_i;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    rbm.batch_activate_hidden<true, true>(h_a, h_s, v, v);
+    rbm.batch_activate_hidden<false, true>(h_i, h_i, v, v);
+
+    for (size_t i = 0; i < 10; ++i) {
+        etl::fast_dyn_vector<float, 10> a;
+        etl::fast_dyn_vector<float, 10> s;
+
+        rbm.activate_hidden<true, true>(a, s, dataset.training_images[i], dataset.training_images[i]);
+
+        // The probabilities are the same as the ones of the single sample
+        REQUIRE(etl::sum(h_a(i)) == Approx(1.0f));
+        REQUIRE(etl::max(etl::abs(h_a(i) - a)) < 1e-4);
+
+        // The samples are one-hot and drawn from the non-zero probabilities
+        REQUIRE(etl::sum(h_s(i)) == 1.0f);
+        REQUIRE(etl::sum(h_i(i)) == 1.0f);
+        REQUIRE(etl::sum(s) == 1.0f);
+        REQUIRE(etl::sum(h_s(i) >> h_a(i)) > 0.0f);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/block_sparse/1", "[rbm][sparse][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 20);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> v;
+    etl::fast_dyn_matrix<float, 10, 100> h_dense;
+    etl::fast_dyn_matrix<float, 10, 100> h_sparse;
+
+    for (size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    dll::block_sparsify(rbm, 4, 4, 0.9);
+
+    REQUIRE(rbm.w_blocks.density() == Approx(0.1).epsilon(0.05));
+
+    // The block-sparse kernel computes the same activations as the dense product
+    rbm.batch_activate_hidden(h_sparse, v);
+    h_dense = etl::sigmoid(etl::rep_l(rbm.b, 10) + v * rbm.w);
+
+    for (size_t i = 0; i < etl::size(h_dense); ++i) {
+        REQUIRE(h_sparse[i] == Approx(h_dense[i]).epsilon(1e-4));
+    }
+
+    // The removed blocks stay at zero during the training
+    auto error = rbm.train(dataset.training_images, 20);
+    REQUIRE(error < 5e-2);
+
+    dll::block_sparsity trained;
+    trained.compress(rbm.w, 4, 4);
+
+    REQUIRE(trained.blocks() <= rbm.w_blocks.blocks());
+}
+
+TEST_CASE("unit/rbm/sparsity/penalty/1", "[rbm][sparse][unit]") {
+    etl::fast_dyn_matrix<float, 300, 400> grad;
+    etl::fast_dyn_matrix<float, 300, 400> expected;
+    etl::fast_dyn_vector<float, 400> column;
+    etl::fast_dyn_vector<float, 300> block;
+
+    grad   = etl::uniform_generator(-1.0, 1.0);
+    column = etl::uniform_generator(-1.0, 1.0);
+    block  = etl::uniform_generator(-1.0, 1.0);
+
+    expected = grad;
+
+    // The penalty of each column
+    dll::subtract_penalty(grad.memory_start(), column.memory_start(), 300, 400, false);
+
+    for (size_t i = 0; i < 300; ++i) {
+        for (size_t j = 0; j < 400; ++j) {
+            REQUIRE(grad(i, j) == Approx(expected(i, j) - column(j)));
+        }
+    }
+
+    expected = grad;
+
+    // The penalty of each block
+    dll::subtract_penalty(grad.memory_start(), block.memory_start(), 300, 400, true);
+
+    for (size_t i = 0; i < 300; ++i) {
+        for (size_t j = 0; j < 400; ++j) {
+            REQUIRE(grad(i, j) == Approx(expected(i, j) - block(i)));
+        }
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/anomaly/1", "[rbm][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 20);
+
+    // Random images are anomalies for an RBM trained on digits
+    std::vector<etl::dyn_vector<float>> noise(25, etl::dyn_vector<float>(28 * 28));
+
+    for (auto& image : noise) {
+        image = etl::uniform_generator(0.0, 1.0);
+        image = etl::bernoulli(image);
+    }
+
+    auto errors       = dll::reconstruction_errors(rbm, dataset.test_images);
+    auto noise_errors = dll::reconstruction_errors(rbm, noise);
+
+    REQUIRE(errors.size() == dataset.test_images.size());
+    REQUIRE(noise_errors.size() == noise.size());
+
+    auto mean = [](const std::vector<double>& v) {
+        return std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+    };
+
+    REQUIRE(std::all_of(errors.begin(), errors.end(), [](double e) { return std::isfinite(e) && e >= 0.0; }));
+    REQUIRE(mean(noise_errors) > mean(errors));
+
+    // The free energies are the ones of the samples
+    auto energies = dll::free_energies(rbm, dataset.test_images);
+
+    REQUIRE(energies.size() == dataset.test_images.size());
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(energies[i] == Approx(rbm.free_energy(dataset.test_images[i])).epsilon(1e-3));
+    }
+}
@@ -124,3 +124,22 @@ TEST_CASE("unit/text_reader/images/5", "[unit][reader]") {
     REQUIRE(samples[7](0, 17, 16) == 9);
     REQUIRE(samples[8](0, 17, 15) == 253);
 }
+
+TEST_CASE("unit/text_reader/cache/1", "[unit][reader]") {
+    // The first full read stores the cache, the second one uses it
+    auto samples = dll::text::read_images<std::vector, std::vector<float>, false>("test/text_db/images", 0);
+    auto cached  = dll::text::read_images<std::vector, std::vector<float>, false>("test/text_db/images", 0);
+
+    REQUIRE(samples.size() == 9);
+    REQUIRE(cached.size() == 9);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        REQUIRE(samples[i] == cached[i]);
+    }
+
+    auto labels = dll::text::read_labels<std::vector, uint8_t>("test/text_db/labels", 0);
+    auto cached_labels = dll::text::read_labels<std::vector, uint8_t>("test/text_db/labels", 0);
+
+    REQUIRE(labels == cached_labels);
+    REQUIRE(labels[8] == 5);
+}
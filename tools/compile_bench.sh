@@ -0,0 +1,148 @@
+#!/bin/bash
+
+# Compile-time benchmark of the network templates
+#
+# Each compilation stress unit of the workbench (compile_*.cpp) and the
+# sources generated by dllp for the samples of the processor are compiled
+# one by one, the wall time, the peak memory of the compiler and the size
+# of the object are recorded:
+#
+#     tools/compile_bench.sh [--mode release_debug] [--json results.json]
+#                            [--baseline baseline.json] [--threshold percent]
+#
+# When a baseline is given, the program returns 1 if at least one unit is
+# slower or uses more memory than the baseline by more than the threshold
+# (10% by default).
+
+mode="release_debug"
+json=""
+baseline=""
+threshold="10"
+
+while [ $# -gt 0 ]
+do
+    case "$1" in
+        --mode) mode="$2"; shift ;;
+        --json) json="$2"; shift ;;
+        --baseline) baseline="$2"; shift ;;
+        --threshold) threshold="$2"; shift ;;
+        *) echo "ERROR: Unknown option $1"; exit 2 ;;
+    esac
+    shift
+done
+
+if [ ! -x /usr/bin/time ]
+then
+    echo "ERROR: /usr/bin/time is necessary to measure the peak memory"
+    exit 2
+fi
+
+root=$(pwd)
+
+# Generate the sources of the dllp samples, the compiler being replaced by
+# true, only the generated source is kept
+
+mkdir -p compile_bench
+
+if [ -x $mode/bin/dllp ]
+then
+    for conf in processor/samples/*.conf
+    do
+        name=$(basename $conf .conf)
+        tmp=$(mktemp -d)
+
+        (cd $tmp && CXX=true $root/$mode/bin/dllp --no-build-cache $root/$conf train > /dev/null 2>&1)
+
+        if [ -f $tmp/.dbn.cpp ]
+        then
+            cp $tmp/.dbn.cpp compile_bench/dllp_$name.cpp
+        else
+            echo "WARNING: Impossible to generate the source of $conf"
+        fi
+
+        rm -rf $tmp
+    done
+else
+    echo "WARNING: $mode/bin/dllp is not built, the dllp sources are not measured"
+fi
+
+units="$(ls workbench/src/compile_*.cpp) $(ls compile_bench/dllp_*.cpp 2>/dev/null)"
+
+results=""
+failed=0
+
+# Convert [h:]m:ss.xx to seconds
+to_seconds() {
+    echo "$1" | awk -F: '{ s = 0; for (i = 1; i <= NF; ++i) { s = s * 60 + $i }; print s }'
+}
+
+for f in $units
+do
+    rm -f $mode/$f.o
+
+    output=$(/usr/bin/time -v make $mode/$f.o 2>&1)
+
+    if [ ! -f $mode/$f.o ]
+    then
+        echo "ERROR: Impossible to compile $f"
+        failed=1
+        continue
+    fi
+
+    rss=$(echo "$output" | grep "Maximum resident set size" | rev | cut -d" " -f1 | rev)
+    elapsed=$(to_seconds $(echo "$output" | grep "Elapsed" | rev | cut -d" " -f1 | rev))
+    size=$(stat -c %s $mode/$f.o)
+
+    printf "%-48s time: %8.2fs memory: %8.1fMB object: %8.1fKB\n" $f $elapsed $(echo "scale=1; $rss/1024" | bc -l) $(echo "scale=1; $size/1024" | bc -l)
+
+    # One unit per line, so that the baseline can be read back without a JSON parser
+    results="$results    {\"name\": \"$f\", \"seconds\": $elapsed, \"rss_kb\": $rss, \"object_bytes\": $size},\n"
+done
+
+if [ -n "$json" ]
+then
+    printf "{\n  \"units\": [\n${results%,\\n}\n  ]\n}\n" > $json
+fi
+
+if [ -n "$baseline" ]
+then
+    if [ ! -f $baseline ]
+    then
+        echo "ERROR: Impossible to open the baseline $baseline"
+        exit 2
+    fi
+
+    echo "Comparison with $baseline (threshold: $threshold%)"
+
+    for line in $(printf "$results" | tr -d ' ')
+    do
+        name=$(echo $line | sed 's/.*"name":"\([^"]*\)".*/\1/')
+        seconds=$(echo $line | sed 's/.*"seconds":\([^,]*\),.*/\1/')
+        rss=$(echo $line | sed 's/.*"rss_kb":\([^,]*\),.*/\1/')
+
+        base=$(tr -d ' ' < $baseline | grep "\"name\":\"$name\"")
+
+        if [ -z "$base" ]
+        then
+            continue
+        fi
+
+        base_seconds=$(echo $base | sed 's/.*"seconds":\([^,]*\),.*/\1/')
+        base_rss=$(echo $base | sed 's/.*"rss_kb":\([^,]*\),.*/\1/')
+
+        time_diff=$(echo "scale=2; 100 * ($seconds - $base_seconds) / $base_seconds" | bc -l)
+        rss_diff=$(echo "scale=2; 100 * ($rss - $base_rss) / $base_rss" | bc -l)
+
+        status=""
+
+        if [ $(echo "$time_diff > $threshold" | bc) -eq 1 ] || [ $(echo "$rss_diff > $threshold" | bc) -eq 1 ]
+        then
+            status=" REGRESSION"
+            failed=1
+        fi
+
+        printf "%-48s time: %+7.2f%% memory: %+7.2f%%%s\n" $name $time_diff $rss_diff "$status"
+    done
+fi
+
+exit $failed
@@ -0,0 +1,442 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Unified benchmark suite.
+ *
+ * Each benchmark is run a few times to warm up and then repeated, the
+ * statistics of the repetitions are reported. The results can be written
+ * in JSON and compared against a previous JSON file:
+ *
+ *     dll_bench [--filter substr] [--warmup N] [--repeat N]
+ *               [--json results.json] [--baseline baseline.json] [--threshold percent]
+ *
+ * When a baseline is given, the program returns 1 if at least one
+ * benchmark is slower (median) than the baseline by more than the
+ * threshold (5% by default).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/dbn.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/generators.hpp"
+
+namespace {
+
+/*!
+ * \brief A registered benchmark
+ */
+struct benchmark {
+    std::string name;          ///< The name of the benchmark
+    std::string params;        ///< The parameters of the benchmark
+    std::function<void()> run; ///< One repetition of the benchmark
+};
+
+/*!
+ * \brief The statistics of the repetitions of one benchmark (in ms)
+ */
+struct bench_result {
+    std::string name;   ///< The name of the benchmark
+    std::string params; ///< The parameters of the benchmark
+    size_t repeat;      ///< The number of repetitions
+    double mean;        ///< The mean duration
+    double median;      ///< The median duration
+    double min;         ///< The minimum duration
+    double max;         ///< The maximum duration
+    double stddev;      ///< The standard deviation of the durations
+};
+
+std::vector<benchmark>& benchmarks() {
+    static std::vector<benchmark> list;
+    return list;
+}
+
+void add_bench(const std::string& name, const std::string& params, std::function<void()> run) {
+    benchmarks().push_back({name, params, std::move(run)});
+}
+
+bench_result run_bench(const benchmark& bench, size_t warmup, size_t repeat) {
+    for (size_t i = 0; i < warmup; ++i) {
+        bench.run();
+    }
+
+    std::vector<double> durations;
+
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        bench.run();
+        auto end = std::chrono::steady_clock::now();
+
+        durations.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1e6);
+    }
+
+    std::sort(durations.begin(), durations.end());
+
+    bench_result result;
+    result.name   = bench.name;
+    result.params = bench.params;
+    result.repeat = repeat;
+    result.min    = durations.front();
+    result.max    = durations.back();
+    result.median = repeat % 2 ? durations[repeat / 2] : (durations[repeat / 2 - 1] + durations[repeat / 2]) / 2.0;
+
+    double sum = 0.0;
+    for (auto d : durations) {
+        sum += d;
+    }
+
+    result.mean = sum / repeat;
+
+    double var = 0.0;
+    for (auto d : durations) {
+        var += (d - result.mean) * (d - result.mean);
+    }
+
+    result.stddev = std::sqrt(var / repeat);
+
+    return result;
+}
+
+// One benchmark per line, so that the baseline can be read back without a JSON parser
+
+void write_json(std::ostream& os, const std::vector<bench_result>& results) {
+    os << "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+
+        os << "    {\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\", \"repeat\": " << r.repeat
+           << ", \"mean_ms\": " << r.mean << ", \"median_ms\": " << r.median << ", \"min_ms\": " << r.min
+           << ", \"max_ms\": " << r.max << ", \"stddev_ms\": " << r.stddev << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    os << "  ]\n}" << std::endl;
+}
+
+bool read_field(const std::string& line, const std::string& field, std::string& value) {
+    auto key = "\"" + field + "\": ";
+    auto pos = line.find(key);
+
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    pos += key.size();
+
+    if (line[pos] == '"') {
+        auto end = line.find('"', pos + 1);
+        value    = line.substr(pos + 1, end - pos - 1);
+    } else {
+        auto end = line.find_first_of(",}", pos);
+        value    = line.substr(pos, end - pos);
+    }
+
+    return true;
+}
+
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+
+    std::ifstream is(path);
+
+    if (!is) {
+        std::cerr << "ERROR: Impossible to open the baseline " << path << std::endl;
+        return baseline;
+    }
+
+    std::string line;
+    while (std::getline(is, line)) {
+        std::string name;
+        std::string median;
+
+        if (read_field(line, "name", name) && read_field(line, "median_ms", median)) {
+            baseline[name] = std::stod(median);
+        }
+    }
+
+    return baseline;
+}
+
+// Random data for the benchmarks (they must not depend on a dataset)
+
+template <typename T>
+std::vector<T> random_inputs(size_t n, const T& prototype = T(), bool binary = false) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_real_distribution<float> dist(0.0, 1.0);
+
+    std::vector<T> inputs(n, prototype);
+
+    for (auto& input : inputs) {
+        for (auto& v : input) {
+            v = binary ? (dist(rand_engine) > 0.5f ? 1.0f : 0.0f) : dist(rand_engine);
+        }
+    }
+
+    return inputs;
+}
+
+std::vector<size_t> random_labels(size_t n) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_int_distribution<size_t> dist(0, 9);
+
+    std::vector<size_t> labels(n);
+
+    for (auto& label : labels) {
+        label = dist(rand_engine);
+    }
+
+    return labels;
+}
+
+template <size_t B>
+void register_dense() {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<B>, dll::trainer<dll::sgd_trainer>,
+        dll::watcher<dll::mute_dbn_watcher>>::dbn_t;
+
+    const std::string params = "784-500-250-10,batch=" + std::to_string(B);
+
+    auto net    = std::make_shared<dbn_t>();
+    auto batch  = std::make_shared<etl::fast_dyn_matrix<float, B, 28 * 28>>();
+    auto inputs = std::make_shared<std::vector<etl::fast_dyn_matrix<float, 28 * 28>>>(random_inputs<etl::fast_dyn_matrix<float, 28 * 28>>(10 * B));
+    auto labels = std::make_shared<std::vector<size_t>>(random_labels(10 * B));
+
+    *batch = etl::uniform_generator(0.0, 1.0);
+
+    add_bench("dense/forward", params, [net, batch] {
+        auto output = net->forward_batch(*batch);
+        cpp_unused(output);
+    });
+
+    // One epoch of 10 batches: forward, backward and update
+    add_bench("dense/train", params + ",batches=10", [net, inputs, labels] {
+        net->fine_tune(*inputs, *labels, 1);
+    });
+}
+
+template <size_t B>
+void register_conv() {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5>::layer_t,
+            dll::mp_2d_layer_desc<8, 24, 24, 2, 2>::layer_t,
+            dll::dense_layer_desc<8 * 12 * 12, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<B>, dll::trainer<dll::sgd_trainer>,
+        dll::watcher<dll::mute_dbn_watcher>>::dbn_t;
+
+    const std::string params = "1x28x28-8x5x5-mp2-10,batch=" + std::to_string(B);
+
+    auto net    = std::make_shared<dbn_t>();
+    auto batch  = std::make_shared<etl::fast_dyn_matrix<float, B, 1, 28, 28>>();
+    auto inputs = std::make_shared<std::vector<etl::fast_dyn_matrix<float, 1, 28, 28>>>(random_inputs<etl::fast_dyn_matrix<float, 1, 28, 28>>(10 * B));
+    auto labels = std::make_shared<std::vector<size_t>>(random_labels(10 * B));
+
+    *batch = etl::uniform_generator(0.0, 1.0);
+
+    add_bench("conv/forward", params, [net, batch] {
+        auto output = net->forward_batch(*batch);
+        cpp_unused(output);
+    });
+
+    // One epoch of 10 batches: forward, backward and update
+    add_bench("conv/train", params + ",batches=10", [net, inputs, labels] {
+        net->fine_tune(*inputs, *labels, 1);
+    });
+}
+
+template <size_t B>
+void register_pooling() {
+    using layer_t = dll::mp_2d_layer_desc<8, 24, 24, 2, 2>::layer_t;
+
+    auto input  = std::make_shared<etl::fast_dyn_matrix<float, B, 8, 24, 24>>();
+    auto output = std::make_shared<etl::fast_dyn_matrix<float, B, 8, 12, 12>>();
+
+    *input = etl::uniform_generator(0.0, 1.0);
+
+    add_bench("pooling/max/forward", "8x24x24-2x2,batch=" + std::to_string(B), [input, output] {
+        layer_t::forward_batch(*output, *input);
+    });
+}
+
+template <size_t B>
+void register_rbm() {
+    using cd_rbm_t = dll::rbm_desc<
+        28 * 28, 500,
+        dll::batch_size<B>,
+        dll::watcher<dll::mute_rbm_watcher>>::layer_t;
+
+    using pcd_rbm_t = dll::rbm_desc<
+        28 * 28, 500,
+        dll::batch_size<B>,
+        dll::trainer_rbm<dll::pcd1_trainer_t>,
+        dll::watcher<dll::mute_rbm_watcher>>::layer_t;
+
+    const std::string params = "784-500,batch=" + std::to_string(B) + ",batches=10";
+
+    auto inputs = std::make_shared<std::vector<etl::dyn_vector<float>>>(random_inputs(10 * B, etl::dyn_vector<float>(28 * 28), true));
+
+    auto cd_rbm  = std::make_shared<cd_rbm_t>();
+    auto pcd_rbm = std::make_shared<pcd_rbm_t>();
+
+    add_bench("rbm/cd1", params, [cd_rbm, inputs] {
+        cd_rbm->train(*inputs, 1);
+    });
+
+    add_bench("rbm/pcd1", params, [pcd_rbm, inputs] {
+        pcd_rbm->train(*inputs, 1);
+    });
+}
+
+template <size_t B>
+void register_generators() {
+    using plain_t     = dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::categorical, dll::scale_pre<255>>;
+    using augmented_t = dll::inmemory_data_generator_desc<dll::batch_size<B>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto inputs = std::make_shared<std::vector<etl::fast_dyn_matrix<float, 28 * 28>>>(random_inputs<etl::fast_dyn_matrix<float, 28 * 28>>(20 * B));
+    auto labels = std::make_shared<std::vector<size_t>>(random_labels(20 * B));
+
+    // The lambdas of the benchmarks must be copyable
+    auto plain_ptr     = dll::make_generator(*inputs, *labels, inputs->size(), 10, plain_t{});
+    auto augmented_ptr = dll::make_generator(*inputs, *labels, inputs->size(), 10, augmented_t{});
+
+    auto plain     = std::shared_ptr<std::decay_t<decltype(*plain_ptr)>>(std::move(plain_ptr));
+    auto augmented = std::shared_ptr<std::decay_t<decltype(*augmented_ptr)>>(std::move(augmented_ptr));
+
+    const std::string params = "784,batch=" + std::to_string(B) + ",batches=20";
+
+    auto epoch = [](auto& generator) {
+        generator.set_train();
+        generator.reset();
+
+        double checksum = 0.0;
+
+        while (generator.has_next_batch()) {
+            checksum += generator.data_batch()(0, 0);
+            generator.next_batch();
+        }
+
+        cpp_unused(checksum);
+    };
+
+    add_bench("generator/inmemory", params, [plain, epoch] {
+        epoch(*plain);
+    });
+
+    add_bench("augmentation/noise", params, [augmented, epoch] {
+        epoch(*augmented);
+    });
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json;
+    std::string baseline_path;
+
+    size_t warmup    = 2;
+    size_t repeat    = 10;
+    double threshold = 5.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (i + 1 == argc) {
+            std::cerr << "ERROR: Missing value for " << arg << std::endl;
+            return 2;
+        }
+
+        std::string value(argv[++i]);
+
+        if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--json") {
+            json = value;
+        } else if (arg == "--baseline") {
+            baseline_path = value;
+        } else if (arg == "--warmup") {
+            warmup = std::stoul(value);
+        } else if (arg == "--repeat") {
+            repeat = std::max(1UL, std::stoul(value));
+        } else if (arg == "--threshold") {
+            threshold = std::stod(value);
+        } else {
+            std::cerr << "ERROR: Unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    register_dense<100>();
+    register_conv<100>();
+    register_pooling<100>();
+    register_rbm<100>();
+    register_generators<100>();
+
+    auto baseline = baseline_path.empty() ? std::map<std::string, double>() : read_baseline(baseline_path);
+
+    std::vector<bench_result> results;
+    bool regression = false;
+
+    for (auto& bench : benchmarks()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto r = run_bench(bench, warmup, repeat);
+        results.push_back(r);
+
+        printf("%-22s %-40s median: %9.3fms mean: %9.3fms min: %9.3fms max: %9.3fms stddev: %7.3fms",
+               r.name.c_str(), r.params.c_str(), r.median, r.mean, r.min, r.max, r.stddev);
+
+        auto it = baseline.find(r.name);
+
+        if (it != baseline.end() && it->second > 0.0) {
+            const double change = 100.0 * (r.median - it->second) / it->second;
+
+            printf(" baseline: %9.3fms (%+.1f%%)", it->second, change);
+
+            if (change > threshold) {
+                printf(" REGRESSION");
+                regression = true;
+            }
+        }
+
+        printf("\n");
+        std::cout.flush();
+    }
+
+    if (!json.empty()) {
+        std::ofstream os(json);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << json << " for writing" << std::endl;
+            return 2;
+        }
+
+        write_json(os, results);
+    }
+
+    return regression ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+
+#include "dll/datasets.hpp"
+#include "dll/datasets/imagenet.hpp"
+
+int main(int argc, char* argv []) {
+    if (argc < 3) {
+        std::cout << "Usage: dll_imagenet_convert <imagenet_folder> <output_file>" << std::endl;
+        return 1;
+    }
+
+    if (!dll::convert_imagenet_binary(argv[1], argv[2])) {
+        std::cerr << "Conversion failed" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,464 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Inference latency benchmark suite.
+ *
+ * The latency of each call of predict, features (one sample) and
+ * test_forward_batch (one batch of 1 to 256 samples) is measured for the
+ * networks of the examples (the MNIST MLP and CNN) and of perf_conv (the
+ * convolutional RBM), with 1 to N client threads sharing the same network.
+ * The latencies are recorded in a log-linear histogram (less than 1% of
+ * relative error) and their percentiles are reported:
+ *
+ *     dll_latency_bench [--filter substr] [--threads N] [--max-batch B]
+ *                       [--warmup N] [--seconds S] [--pin]
+ *                       [--csv results.csv] [--json results.json]
+ *
+ * The networks are randomly initialized, the latency of the inference does
+ * not depend on the values of the weights.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/conv_rbm.hpp"
+#include "dll/dbn.hpp"
+
+namespace {
+
+/*!
+ * \brief Log-linear histogram of latencies, in nanoseconds.
+ *
+ * The values below 2^S are recorded exactly, the larger ones in 2^S
+ * sub-buckets per power of two, the relative error of a recorded value
+ * being at most 2^-S.
+ */
+struct latency_histogram {
+    static constexpr size_t S       = 7;  ///< The bits of precision of the sub-buckets
+    static constexpr size_t max_bit = 40; ///< The values are capped at 2^max_bit ns (about 18 minutes)
+
+    std::vector<uint64_t> counts; ///< The count of each bucket
+    uint64_t total = 0;           ///< The number of recorded values
+    uint64_t max   = 0;           ///< The largest recorded value
+    double sum     = 0.0;         ///< The sum of the recorded values
+
+    latency_histogram() : counts((max_bit - S + 1) << S) {}
+
+    static size_t index(uint64_t v) {
+        if (v < (1UL << S)) {
+            return v;
+        }
+
+        const size_t shift = 63 - __builtin_clzll(v) - S;
+
+        return ((shift + 1) << S) + (v >> shift) - (1UL << S);
+    }
+
+    /*!
+     * \brief Return the largest value of the given bucket
+     */
+    static uint64_t value(size_t i) {
+        if (i < (1UL << S)) {
+            return i;
+        }
+
+        const size_t shift      = (i >> S) - 1;
+        const uint64_t mantissa = (i & ((1UL << S) - 1)) + (1UL << S);
+
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    void record(uint64_t v) {
+        v = std::min(v, (1UL << max_bit) - 1);
+
+        ++counts[index(v)];
+        ++total;
+        max = std::max(max, v);
+        sum += v;
+    }
+
+    void merge(const latency_histogram& rhs) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += rhs.counts[i];
+        }
+
+        total += rhs.total;
+        max = std::max(max, rhs.max);
+        sum += rhs.sum;
+    }
+
+    /*!
+     * \brief Return the value at the given percentile (0 to 100)
+     */
+    uint64_t percentile(double p) const {
+        const auto target = std::max(uint64_t(1), uint64_t(std::ceil(p / 100.0 * total)));
+
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+
+            if (seen >= target) {
+                return std::min(value(i), max);
+            }
+        }
+
+        return max;
+    }
+};
+
+/*!
+ * \brief The parameters of the measures
+ */
+struct latency_params {
+    size_t warmup  = 10;    ///< The calls of each thread before the measure
+    double seconds = 1.0;   ///< The duration of the measure of each configuration
+    bool pin       = false; ///< Indicates if the client threads are pinned
+};
+
+/*!
+ * \brief The latencies of one configuration (in us)
+ */
+struct latency_result {
+    std::string name;  ///< The name of the benchmark (network/function)
+    size_t batch;      ///< The samples of each call
+    size_t threads;    ///< The number of client threads
+    uint64_t calls;    ///< The number of measured calls
+    double mean;       ///< The mean latency
+    double p50;        ///< The median latency
+    double p90;        ///< The 90th percentile of the latency
+    double p99;        ///< The 99th percentile of the latency
+    double p999;       ///< The 99.9th percentile of the latency
+    double max;        ///< The maximum latency
+    double throughput; ///< The samples per second of all the threads
+};
+
+/*!
+ * \brief A registered benchmark, one call of the function by the given client thread
+ */
+struct benchmark {
+    std::string name;                 ///< The name of the benchmark
+    size_t batch;                     ///< The samples of each call
+    std::function<void(size_t)> call; ///< One call by the given client thread
+};
+
+std::vector<benchmark>& benchmarks() {
+    static std::vector<benchmark> list;
+    return list;
+}
+
+latency_result run_latency(const benchmark& bench, size_t threads, const latency_params& params) {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<latency_histogram> histograms(threads);
+
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> start(false);
+
+    clock::time_point begin;
+
+    auto client = [&](size_t t) {
+        if (params.pin) {
+            dll::pin_worker(t);
+        }
+
+        for (size_t i = 0; i < params.warmup; ++i) {
+            bench.call(t);
+        }
+
+        ++ready;
+
+        while (!start.load()) {
+            std::this_thread::yield();
+        }
+
+        const auto deadline = begin + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(params.seconds));
+
+        auto& histogram = histograms[t];
+
+        while (true) {
+            auto before = clock::now();
+
+            if (before >= deadline) {
+                break;
+            }
+
+            bench.call(t);
+
+            histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - before).count());
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back(client, t);
+    }
+
+    // The measure starts once all the clients are warm
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+
+    begin = clock::now();
+    start = true;
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    const double elapsed = std::chrono::duration<double>(clock::now() - begin).count();
+
+    latency_histogram all;
+
+    for (auto& histogram : histograms) {
+        all.merge(histogram);
+    }
+
+    latency_result result;
+    result.name       = bench.name;
+    result.batch      = bench.batch;
+    result.threads    = threads;
+    result.calls      = all.total;
+    result.mean       = all.total ? all.sum / all.total / 1e3 : 0.0;
+    result.p50        = all.percentile(50.0) / 1e3;
+    result.p90        = all.percentile(90.0) / 1e3;
+    result.p99        = all.percentile(99.0) / 1e3;
+    result.p999       = all.percentile(99.9) / 1e3;
+    result.max        = all.max / 1e3;
+    result.throughput = elapsed > 0.0 ? all.total * bench.batch / elapsed : 0.0;
+
+    return result;
+}
+
+// Random data for the benchmarks (they must not depend on a dataset)
+
+template <typename T>
+T random_input(T input) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_real_distribution<float> dist(0.0, 1.0);
+
+    for (auto& v : input) {
+        v = dist(rand_engine);
+    }
+
+    return input;
+}
+
+/*!
+ * \brief Register the benchmarks of the given network, the sample being
+ * of shape Dims... and the batches of at most max_batch samples
+ */
+template <typename Network, size_t... Dims>
+void register_network(const std::string& name, size_t max_batch) {
+    auto net    = std::make_shared<Network>();
+    auto sample = std::make_shared<typename Network::input_one_t>(random_input(typename Network::input_one_t()));
+
+    benchmarks().push_back({name + "/predict", 1, [net, sample](size_t /*t*/) {
+        auto label = net->predict(*sample);
+        cpp_unused(label);
+    }});
+
+    benchmarks().push_back({name + "/features", 1, [net, sample](size_t /*t*/) {
+        auto output = net->features(*sample);
+        cpp_unused(output);
+    }});
+
+    for (size_t b = 1; b <= max_batch; b *= 2) {
+        auto batch = std::make_shared<etl::dyn_matrix<float, sizeof...(Dims) + 1>>(random_input(etl::dyn_matrix<float, sizeof...(Dims) + 1>(b, Dims...)));
+
+        benchmarks().push_back({name + "/test_forward_batch", b, [net, batch](size_t /*t*/) {
+            auto output = net->test_forward_batch(*batch);
+            cpp_unused(output);
+        }});
+    }
+}
+
+// The networks of examples/src/mnist_mlp.cpp and examples/src/mnist_cnn.cpp
+
+void register_mnist_mlp(size_t max_batch) {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::softmax>::layer_t>,
+        dll::watcher<dll::mute_dbn_watcher>>::dbn_t;
+
+    register_network<network_t, 28 * 28>("mnist_mlp", max_batch);
+}
+
+void register_mnist_cnn(size_t max_batch) {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5>::layer_t,
+            dll::mp_2d_layer_desc<8, 24, 24, 2, 2>::layer_t,
+            dll::conv_layer_desc<8, 12, 12, 8, 5, 5>::layer_t,
+            dll::mp_2d_layer_desc<8, 8, 8, 2, 2>::layer_t,
+            dll::dense_layer_desc<8 * 4 * 4, 150>::layer_t,
+            dll::dense_layer_desc<150, 10, dll::softmax>::layer_t>,
+        dll::watcher<dll::mute_dbn_watcher>>::dbn_t;
+
+    register_network<network_t, 1, 28, 28>("mnist_cnn", max_batch);
+}
+
+// The network of workbench/src/perf_conv.cpp
+
+void register_perf_conv(size_t max_batch) {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_rbm_square_desc<1, 28, 40, 17, dll::weight_type<float>>::layer_t>,
+        dll::watcher<dll::mute_dbn_watcher>>::dbn_t;
+
+    register_network<network_t, 1, 28, 28>("perf_conv", max_batch);
+}
+
+// One configuration per line, like dll_bench
+
+void write_json(std::ostream& os, const std::vector<latency_result>& results) {
+    os << "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+
+        os << "    {\"name\": \"" << r.name << "\", \"batch\": " << r.batch << ", \"threads\": " << r.threads
+           << ", \"calls\": " << r.calls << ", \"mean_us\": " << r.mean << ", \"p50_us\": " << r.p50
+           << ", \"p90_us\": " << r.p90 << ", \"p99_us\": " << r.p99 << ", \"p999_us\": " << r.p999
+           << ", \"max_us\": " << r.max << ", \"samples_per_sec\": " << r.throughput << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    os << "  ]\n}" << std::endl;
+}
+
+void write_csv(std::ostream& os, const std::vector<latency_result>& results) {
+    os << "name,batch,threads,calls,mean_us,p50_us,p90_us,p99_us,p999_us,max_us,samples_per_sec\n";
+
+    for (auto& r : results) {
+        os << r.name << "," << r.batch << "," << r.threads << "," << r.calls << "," << r.mean << "," << r.p50 << ","
+           << r.p90 << "," << r.p99 << "," << r.p999 << "," << r.max << "," << r.throughput << "\n";
+    }
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json;
+    std::string csv;
+
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t max_batch   = 256;
+
+    latency_params params;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (arg == "--pin") {
+            params.pin = true;
+            continue;
+        }
+
+        if (i + 1 == argc) {
+            std::cerr << "ERROR: Missing value for " << arg << std::endl;
+            return 2;
+        }
+
+        std::string value(argv[++i]);
+
+        if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--json") {
+            json = value;
+        } else if (arg == "--csv") {
+            csv = value;
+        } else if (arg == "--threads") {
+            max_threads = std::max(1UL, std::stoul(value));
+        } else if (arg == "--max-batch") {
+            max_batch = std::max(1UL, std::stoul(value));
+        } else if (arg == "--warmup") {
+            params.warmup = std::stoul(value);
+        } else if (arg == "--seconds") {
+            params.seconds = std::stod(value);
+        } else {
+            std::cerr << "ERROR: Unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    if (params.pin) {
+        dll::set_thread_affinity(true);
+    }
+
+    register_mnist_mlp(max_batch);
+    register_mnist_cnn(max_batch);
+    register_perf_conv(max_batch);
+
+    // 1, 2, 4, ... and the maximum number of threads
+    std::vector<size_t> thread_counts;
+
+    for (size_t t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+
+    thread_counts.push_back(max_threads);
+
+    std::vector<latency_result> results;
+
+    for (auto& bench : benchmarks()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        for (size_t threads : thread_counts) {
+            auto r = run_latency(bench, threads, params);
+            results.push_back(r);
+
+            printf("%-28s batch: %3lu threads: %3lu p50: %10.1fus p90: %10.1fus p99: %10.1fus p999: %10.1fus max: %10.1fus %12.1f samples/s\n",
+                   r.name.c_str(), r.batch, r.threads, r.p50, r.p90, r.p99, r.p999, r.max, r.throughput);
+            std::cout.flush();
+        }
+    }
+
+    if (!json.empty()) {
+        std::ofstream os(json);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << json << " for writing" << std::endl;
+            return 2;
+        }
+
+        write_json(os, results);
+    }
+
+    if (!csv.empty()) {
+        std::ofstream os(csv);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << csv << " for writing" << std::endl;
+            return 2;
+        }
+
+        write_csv(os, results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,359 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Data pipeline benchmark suite.
+ *
+ * The throughput (samples per second) of the input side of the training is
+ * measured without any network: one epoch of the in-memory and out-of-memory
+ * generators, in threaded and non-threaded modes, with each augmenter
+ * (random crop, mirroring, noise, elastic distortion), each pre-transformer
+ * (scale_pre, normalize_pre, binarize_pre) and various big_batch_size and
+ * numbers of workers, on random CIFAR-like images. The readers of the
+ * datasets (reading the files and one epoch of the generator) are measured
+ * when their folder is given:
+ *
+ *     dll_pipeline_bench [--filter substr] [--warmup N] [--repeat N] [--samples N]
+ *                        [--mnist folder] [--cifar folder] [--imagenet folder] [--imagenet-batches N]
+ *                        [--json results.json]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dll/generators.hpp"
+#include "dll/datasets.hpp"
+
+namespace {
+
+/*!
+ * \brief A registered benchmark
+ */
+struct benchmark {
+    std::string name;            ///< The name of the benchmark
+    std::string params;          ///< The parameters of the benchmark
+    std::function<size_t()> run; ///< One repetition of the benchmark, returns the number of samples
+};
+
+/*!
+ * \brief The throughput of the repetitions of one benchmark (in samples per second)
+ */
+struct bench_result {
+    std::string name;   ///< The name of the benchmark
+    std::string params; ///< The parameters of the benchmark
+    size_t repeat;      ///< The number of repetitions
+    size_t samples;     ///< The samples of one repetition
+    double median;      ///< The median throughput
+    double min;         ///< The minimum throughput
+    double max;         ///< The maximum throughput
+};
+
+std::vector<benchmark>& benchmarks() {
+    static std::vector<benchmark> list;
+    return list;
+}
+
+void add_bench(const std::string& name, const std::string& params, std::function<size_t()> run) {
+    benchmarks().push_back({name, params, std::move(run)});
+}
+
+bench_result run_bench(const benchmark& bench, size_t warmup, size_t repeat) {
+    for (size_t i = 0; i < warmup; ++i) {
+        bench.run();
+    }
+
+    std::vector<double> throughputs;
+
+    size_t samples = 0;
+
+    for (size_t i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        samples    = bench.run();
+        auto end   = std::chrono::steady_clock::now();
+
+        const double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1e9;
+
+        throughputs.push_back(seconds > 0.0 ? samples / seconds : 0.0);
+    }
+
+    std::sort(throughputs.begin(), throughputs.end());
+
+    bench_result result;
+    result.name    = bench.name;
+    result.params  = bench.params;
+    result.repeat  = repeat;
+    result.samples = samples;
+    result.min     = throughputs.front();
+    result.max     = throughputs.back();
+    result.median  = repeat % 2 ? throughputs[repeat / 2] : (throughputs[repeat / 2 - 1] + throughputs[repeat / 2]) / 2.0;
+
+    return result;
+}
+
+/*!
+ * \brief Go through one epoch of the given generator, at most max_batches
+ * batches if not zero, and return the number of samples
+ */
+template <typename Generator>
+size_t run_epoch(Generator& generator, size_t max_batches = 0) {
+    generator.reset();
+    generator.set_train();
+
+    size_t samples = 0;
+
+    for (size_t b = 0; generator.has_next_batch() && (!max_batches || b < max_batches); ++b) {
+        auto batch  = generator.data_batch();
+        auto labels = generator.label_batch();
+
+        samples += etl::dim<0>(batch);
+
+        cpp_unused(labels);
+
+        generator.next_batch();
+    }
+
+    return samples;
+}
+
+// Random CIFAR-like images, in [0, 255] (they must not depend on a dataset)
+
+using image_t = etl::fast_dyn_matrix<float, 3, 32, 32>;
+
+std::shared_ptr<std::vector<image_t>> random_images(size_t n) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_real_distribution<float> dist(0.0, 255.0);
+
+    auto images = std::make_shared<std::vector<image_t>>(n);
+
+    for (auto& image : *images) {
+        for (auto& v : image) {
+            v = dist(rand_engine);
+        }
+    }
+
+    return images;
+}
+
+std::shared_ptr<std::vector<size_t>> random_labels(size_t n) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_int_distribution<size_t> dist(0, 9);
+
+    auto labels = std::make_shared<std::vector<size_t>>(n);
+
+    for (auto& label : *labels) {
+        label = dist(rand_engine);
+    }
+
+    return labels;
+}
+
+template <typename T>
+std::shared_ptr<T> to_shared(std::unique_ptr<T>&& ptr) {
+    return std::shared_ptr<T>(std::move(ptr));
+}
+
+template <typename... Parameters>
+void register_inmemory(const std::string& name, const std::string& params,
+                       std::shared_ptr<std::vector<image_t>> images, std::shared_ptr<std::vector<size_t>> labels) {
+    // The in-memory generators are created once, the benchmark is the epoch
+    auto generator = to_shared(dll::make_generator(*images, *labels, 10, dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, Parameters...>{}));
+
+    add_bench(name, params, [generator] {
+        return run_epoch(*generator);
+    });
+}
+
+template <typename... Parameters>
+void register_outmemory(const std::string& name, const std::string& params,
+                        std::shared_ptr<std::vector<image_t>> images, std::shared_ptr<std::vector<size_t>> labels) {
+    add_bench(name, params, [images, labels] {
+        // The out-of-memory generators are created for each epoch, as they would be for a stream
+        auto generator = dll::make_generator(*images, *labels, images->size(), 10, dll::outmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, Parameters...>{});
+        return run_epoch(*generator);
+    });
+}
+
+template <typename Augmenter>
+void register_augmenter(const std::string& name, std::shared_ptr<std::vector<image_t>> images, std::shared_ptr<std::vector<size_t>> labels) {
+    register_inmemory<Augmenter>("inmemory/" + name, "batch=100", images, labels);
+    register_inmemory<Augmenter, dll::threaded, dll::threaded_workers<1>>("inmemory/" + name + "/threaded", "batch=100,workers=1", images, labels);
+    register_inmemory<Augmenter, dll::threaded, dll::threaded_workers<2>>("inmemory/" + name + "/threaded", "batch=100,workers=2", images, labels);
+    register_inmemory<Augmenter, dll::threaded, dll::threaded_workers<4>>("inmemory/" + name + "/threaded", "batch=100,workers=4", images, labels);
+}
+
+template <size_t B>
+void register_outmemory_big_batch(std::shared_ptr<std::vector<image_t>> images, std::shared_ptr<std::vector<size_t>> labels) {
+    const std::string params = "batch=100,big_batch=" + std::to_string(B);
+
+    register_outmemory<dll::big_batch_size<B>>("outmemory", params, images, labels);
+    register_outmemory<dll::big_batch_size<B>, dll::threaded, dll::threaded_workers<1>>("outmemory/threaded", params + ",workers=1", images, labels);
+    register_outmemory<dll::big_batch_size<B>, dll::threaded, dll::threaded_workers<2>>("outmemory/threaded", params + ",workers=2", images, labels);
+    register_outmemory<dll::big_batch_size<B>, dll::threaded, dll::threaded_workers<4>>("outmemory/threaded", params + ",workers=4", images, labels);
+    register_outmemory<dll::big_batch_size<B>, dll::random_crop<28, 28>, dll::threaded, dll::threaded_workers<4>>("outmemory/random_crop/threaded", params + ",workers=4", images, labels);
+}
+
+void register_generators(size_t n) {
+    auto images = random_images(n);
+    auto labels = random_labels(n);
+
+    register_inmemory<>("inmemory", "batch=100", images, labels);
+
+    // The augmenters, in the calling thread and in the augmentation workers
+    register_augmenter<dll::random_crop<28, 28>>("random_crop", images, labels);
+    register_augmenter<dll::horizontal_mirroring>("random_mirror", images, labels);
+    register_augmenter<dll::noise<10>>("random_noise", images, labels);
+    register_augmenter<dll::elastic_distortion<5>>("elastic_distortion", images, labels);
+
+    // The pre-transformers are applied on the whole cache, when the generator is created
+    add_bench("inmemory/scale_pre", "batch=100", [images, labels] {
+        auto generator = dll::make_generator(*images, *labels, 10, dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>>{});
+        return run_epoch(*generator);
+    });
+
+    add_bench("inmemory/normalize_pre", "batch=100", [images, labels] {
+        auto generator = dll::make_generator(*images, *labels, 10, dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::normalize_pre>{});
+        return run_epoch(*generator);
+    });
+
+    add_bench("inmemory/binarize_pre", "batch=100", [images, labels] {
+        auto generator = dll::make_generator(*images, *labels, 10, dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::binarize_pre<127>>{});
+        return run_epoch(*generator);
+    });
+
+    register_outmemory_big_batch<1>(images, labels);
+    register_outmemory_big_batch<4>(images, labels);
+    register_outmemory_big_batch<16>(images, labels);
+}
+
+// The readers: reading of the files and one epoch of the train generator
+
+void register_readers(const std::string& mnist, const std::string& cifar, const std::string& imagenet, size_t imagenet_batches) {
+    if (!mnist.empty()) {
+        add_bench("reader/mnist", "batch=100", [mnist] {
+            auto generator = dll::make_mnist_generator_train(mnist, 0UL, 60000UL, dll::batch_size<100>{}, dll::scale_pre<255>{});
+            return run_epoch(*generator);
+        });
+    }
+
+    if (!cifar.empty()) {
+        add_bench("reader/cifar10", "batch=100", [cifar] {
+            auto generator = dll::make_cifar10_generator_train(cifar, 0, dll::batch_size<100>{}, dll::scale_pre<255>{});
+            return run_epoch(*generator);
+        });
+    }
+
+    if (!imagenet.empty()) {
+        add_bench("reader/imagenet/threaded", "batch=64,big_batch=4,batches=" + std::to_string(imagenet_batches), [imagenet, imagenet_batches] {
+            auto dataset = dll::make_imagenet_dataset(imagenet, dll::batch_size<64>{}, dll::big_batch_size<4>{}, dll::threaded{}, dll::scale_pre<255>{});
+            return run_epoch(dataset.train(), imagenet_batches);
+        });
+    }
+}
+
+// One benchmark per line, like dll_bench
+
+void write_json(std::ostream& os, const std::vector<bench_result>& results) {
+    os << "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+
+        os << "    {\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\", \"repeat\": " << r.repeat
+           << ", \"samples\": " << r.samples << ", \"median_samples_per_sec\": " << r.median
+           << ", \"min_samples_per_sec\": " << r.min << ", \"max_samples_per_sec\": " << r.max << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    os << "  ]\n}" << std::endl;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json;
+    std::string mnist;
+    std::string cifar;
+    std::string imagenet;
+
+    size_t warmup           = 1;
+    size_t repeat           = 5;
+    size_t samples          = 5000;
+    size_t imagenet_batches = 20;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (i + 1 == argc) {
+            std::cerr << "ERROR: Missing value for " << arg << std::endl;
+            return 2;
+        }
+
+        std::string value(argv[++i]);
+
+        if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--json") {
+            json = value;
+        } else if (arg == "--warmup") {
+            warmup = std::stoul(value);
+        } else if (arg == "--repeat") {
+            repeat = std::max(1UL, std::stoul(value));
+        } else if (arg == "--samples") {
+            samples = std::max(1UL, std::stoul(value));
+        } else if (arg == "--mnist") {
+            mnist = value;
+        } else if (arg == "--cifar") {
+            cifar = value;
+        } else if (arg == "--imagenet") {
+            imagenet = value;
+        } else if (arg == "--imagenet-batches") {
+            imagenet_batches = std::max(1UL, std::stoul(value));
+        } else {
+            std::cerr << "ERROR: Unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    register_generators(samples);
+    register_readers(mnist, cifar, imagenet, imagenet_batches);
+
+    std::vector<bench_result> results;
+
+    for (auto& bench : benchmarks()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto r = run_bench(bench, warmup, repeat);
+        results.push_back(r);
+
+        printf("%-36s %-36s median: %12.1f samples/s min: %12.1f max: %12.1f\n", r.name.c_str(), r.params.c_str(), r.median, r.min, r.max);
+        std::cout.flush();
+    }
+
+    if (!json.empty()) {
+        std::ofstream os(json);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << json << " for writing" << std::endl;
+            return 2;
+        }
+
+        write_json(os, results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * Time-to-accuracy benchmark suite.
+ *
+ * Each reference network (the MLP and the CNN of the MNIST examples and a
+ * CIFAR-10 CNN) is trained until its accuracy on the test set reaches the
+ * target, or until the maximum number of epochs. The wall time of the
+ * training (including the validation of each epoch), the number of epochs
+ * and the throughput of the training are reported, and can be written in
+ * JSON:
+ *
+ *     dll_tta_bench [--filter substr] [--max-epochs N] [--json results.json]
+ *
+ * The program returns 1 if at least one network did not reach its target.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/network.hpp"
+#include "dll/datasets.hpp"
+
+namespace {
+
+/*!
+ * \brief The progress of the current training, updated by the watcher
+ */
+struct tta_progress {
+    size_t epochs = 0;   ///< The number of epochs done
+    double error  = 1.0; ///< The test error after the last epoch
+};
+
+tta_progress& progress() {
+    static tta_progress p;
+    return p;
+}
+
+/*!
+ * \brief Watcher recording the test error of each epoch
+ */
+template <typename DBN>
+struct tta_watcher : dll::mute_dbn_watcher<DBN> {
+    using dll::mute_dbn_watcher<DBN>::ft_epoch_end;
+
+    void fine_tuning_begin(const DBN& /*dbn*/, size_t /*max_epochs*/) {
+        progress() = tta_progress();
+    }
+
+    void ft_epoch_end(size_t epoch, double /*train_error*/, double /*train_loss*/, double val_error, double /*val_loss*/, const DBN& /*dbn*/) {
+        progress().epochs = epoch + 1;
+        progress().error  = val_error;
+    }
+};
+
+/*!
+ * \brief The result of one benchmark
+ */
+struct tta_result {
+    std::string name;       ///< The name of the benchmark
+    double target;          ///< The target accuracy
+    bool reached;           ///< Indicates if the target was reached
+    double accuracy;        ///< The final test accuracy
+    size_t epochs;          ///< The number of epochs
+    double seconds;         ///< The wall time of the training
+    double samples_per_sec; ///< The training samples per second
+};
+
+/*!
+ * \brief A registered benchmark
+ */
+struct benchmark {
+    std::string name;                      ///< The name of the benchmark
+    std::function<tta_result(size_t)> run; ///< Train the network with the given maximum number of epochs
+};
+
+std::vector<benchmark>& benchmarks() {
+    static std::vector<benchmark> list;
+    return list;
+}
+
+template <typename Network, typename Dataset>
+tta_result time_to_accuracy(const std::string& name, Dataset& dataset, double target, size_t max_epochs) {
+    auto net = std::make_unique<Network>();
+
+    net->goal = 1.0 - target;
+
+    auto start = std::chrono::steady_clock::now();
+
+    net->fine_tune_val(dataset.train(), dataset.test(), max_epochs);
+
+    auto end = std::chrono::steady_clock::now();
+
+    tta_result result;
+    result.name            = name;
+    result.target          = target;
+    result.accuracy        = 1.0 - progress().error;
+    result.reached         = result.accuracy >= target;
+    result.epochs          = progress().epochs;
+    result.seconds         = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1e9;
+    result.samples_per_sec = result.seconds > 0.0 ? result.epochs * dataset.train().size() / result.seconds : 0.0;
+
+    return result;
+}
+
+// The networks of examples/src/mnist_mlp.cpp and examples/src/mnist_cnn.cpp
+
+void register_mnist_mlp() {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dense_layer<28 * 28, 500>,
+            dll::dropout_layer<50>,
+            dll::dense_layer<500, 250>,
+            dll::dropout_layer<50>,
+            dll::dense_layer<250, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<100>
+        , dll::shuffle
+        , dll::early_stopping<dll::strategy::ERROR_GOAL>
+        , dll::watcher<tta_watcher>
+    >::network_t;
+
+    benchmarks().push_back({"mnist/mlp", [](size_t max_epochs) {
+        auto dataset = dll::make_mnist_dataset(dll::batch_size<100>{}, dll::normalize_pre{});
+        return time_to_accuracy<network_t>("mnist/mlp", dataset, 0.98, max_epochs);
+    }});
+}
+
+void register_mnist_cnn() {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::conv_layer<1, 28, 28, 8, 5, 5>,
+            dll::mp_2d_layer<8, 24, 24, 2, 2>,
+            dll::conv_layer<8, 12, 12, 8, 5, 5>,
+            dll::mp_2d_layer<8, 8, 8, 2, 2>,
+            dll::dense_layer<8 * 4 * 4, 150>,
+            dll::dense_layer<150, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<100>
+        , dll::shuffle
+        , dll::early_stopping<dll::strategy::ERROR_GOAL>
+        , dll::watcher<tta_watcher>
+    >::network_t;
+
+    benchmarks().push_back({"mnist/cnn", [](size_t max_epochs) {
+        auto dataset = dll::make_mnist_dataset(dll::batch_size<100>{}, dll::scale_pre<255>{});
+        return time_to_accuracy<network_t>("mnist/cnn", dataset, 0.985, max_epochs);
+    }});
+}
+
+void register_cifar_cnn() {
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::conv_layer<3, 32, 32, 12, 5, 5>,
+            dll::mp_2d_layer<12, 28, 28, 2, 2>,
+            dll::conv_layer<12, 14, 14, 24, 3, 3>,
+            dll::mp_2d_layer<24, 12, 12, 2, 2>,
+            dll::dense_layer<24 * 6 * 6, 64>,
+            dll::dense_layer<64, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<100>
+        , dll::shuffle
+        , dll::early_stopping<dll::strategy::ERROR_GOAL>
+        , dll::watcher<tta_watcher>
+    >::network_t;
+
+    benchmarks().push_back({"cifar10/cnn", [](size_t max_epochs) {
+        auto dataset = dll::make_cifar10_dataset(dll::batch_size<100>{}, dll::scale_pre<255>{});
+        return time_to_accuracy<network_t>("cifar10/cnn", dataset, 0.6, max_epochs);
+    }});
+}
+
+// One benchmark per line, like dll_bench
+
+void write_json(std::ostream& os, const std::vector<tta_result>& results) {
+    os << "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+
+        os << "    {\"name\": \"" << r.name << "\", \"target\": " << r.target << ", \"reached\": " << (r.reached ? "true" : "false")
+           << ", \"accuracy\": " << r.accuracy << ", \"epochs\": " << r.epochs << ", \"seconds\": " << r.seconds
+           << ", \"samples_per_sec\": " << r.samples_per_sec << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    os << "  ]\n}" << std::endl;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json;
+
+    size_t max_epochs = 50;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (i + 1 == argc) {
+            std::cerr << "ERROR: Missing value for " << arg << std::endl;
+            return 2;
+        }
+
+        std::string value(argv[++i]);
+
+        if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--json") {
+            json = value;
+        } else if (arg == "--max-epochs") {
+            max_epochs = std::max(1UL, std::stoul(value));
+        } else {
+            std::cerr << "ERROR: Unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    register_mnist_mlp();
+    register_mnist_cnn();
+    register_cifar_cnn();
+
+    std::vector<tta_result> results;
+    bool missed = false;
+
+    for (auto& bench : benchmarks()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto r = bench.run(max_epochs);
+        results.push_back(r);
+
+        printf("%-14s target: %.3f accuracy: %.4f epochs: %3lu time: %9.2fs throughput: %10.1f samples/s%s\n",
+               r.name.c_str(), r.target, r.accuracy, r.epochs, r.seconds, r.samples_per_sec, r.reached ? "" : " MISSED");
+        std::cout.flush();
+
+        missed |= !r.reached;
+    }
+
+    if (!json.empty()) {
+        std::ofstream os(json);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << json << " for writing" << std::endl;
+            return 2;
+        }
+
+        write_json(os, results);
+    }
+
+    return missed ? 1 : 0;
+}